@@ -44,6 +44,7 @@
 #include "sysemu/reset.h"
 #include "qemu/guest-random.h"
 #include "sysemu/hw_accel.h"
+#include "sysemu/dirtylimit.h"
 #include "kvm-cpus.h"
 
 #include "hw/boards.h"
@@ -148,6 +149,7 @@ struct KVMState
     } *as;
     uint64_t kvm_dirty_ring_bytes;  /* Size of the per-vcpu dirty ring */
     uint32_t kvm_dirty_ring_size;   /* Number of dirty GFNs per ring */
+    bool kvm_dirty_ring_with_bitmap;
     struct KVMDirtyRingReaper reaper;
 };
 
@@ -708,14 +710,20 @@ static void kvm_dirty_ring_mark_page(KVMState *s, uint32_t as_id,
     set_bit(offset, mem->dirty_bmap);
 }
 
+/*
+ * The flags order the accesses to the rest of the entry: the kernel
+ * publishes an entry with a store-release of F_DIRTY, and only reuses it
+ * once it has seen F_RESET.  This is what KVM_CAP_DIRTY_LOG_RING_ACQ_REL
+ * asks for on weakly ordered hosts, and free on x86.
+ */
 static bool dirty_gfn_is_dirtied(struct kvm_dirty_gfn *gfn)
 {
-    return gfn->flags == KVM_DIRTY_GFN_F_DIRTY;
+    return qatomic_load_acquire(&gfn->flags) == KVM_DIRTY_GFN_F_DIRTY;
 }
 
 static void dirty_gfn_set_collected(struct kvm_dirty_gfn *gfn)
 {
-    gfn->flags = KVM_DIRTY_GFN_F_RESET;
+    qatomic_store_release(&gfn->flags, KVM_DIRTY_GFN_F_RESET);
 }
 
 /*
@@ -1393,6 +1401,10 @@ static void kvm_set_phys_mem(KVMMemoryListener *kml,
                  */
                 if (kvm_state->kvm_dirty_ring_size) {
                     kvm_dirty_ring_reap_locked(kvm_state);
+                    if (kvm_state->kvm_dirty_ring_with_bitmap) {
+                        kvm_slot_sync_dirty_pages(mem);
+                        kvm_slot_get_dirty_log(kvm_state, mem);
+                    }
                 } else {
                     kvm_slot_get_dirty_log(kvm_state, mem);
                 }
@@ -1521,6 +1533,13 @@ static void kvm_log_sync_global(MemoryListener *l)
     KVMMemoryListener *kml = container_of(l, KVMMemoryListener, listener);
     KVMState *s = kvm_state;
     KVMSlot *mem;
+    /*
+     * Pages dirtied without a running vCPU, e.g. by saving the GICv3 ITS
+     * tables when the VM stops, only go to the backup bitmap.  Fetching it
+     * is as costly as the bitmap method, so do it only once the vCPUs are
+     * stopped.
+     */
+    bool with_bitmap = s->kvm_dirty_ring_with_bitmap && !runstate_is_running();
     int i;
 
     /* Flush all kernel dirty addresses into KVMSlot dirty bitmap */
@@ -1535,6 +1554,9 @@ static void kvm_log_sync_global(MemoryListener *l)
         mem = &kml->slots[i];
         if (mem->memory_size && mem->flags & KVM_MEM_LOG_DIRTY_PAGES) {
             kvm_slot_sync_dirty_pages(mem);
+            if (with_bitmap && kvm_slot_get_dirty_log(s, mem)) {
+                kvm_slot_sync_dirty_pages(mem);
+            }
             /*
              * This is not needed by KVM_GET_DIRTY_LOG because the
              * ioctl will unconditionally overwrite the whole region.
@@ -2303,6 +2325,11 @@ bool kvm_dirty_ring_enabled(void)
     return kvm_state->kvm_dirty_ring_size ? true : false;
 }
 
+uint32_t kvm_dirty_ring_size(void)
+{
+    return kvm_state->kvm_dirty_ring_size;
+}
+
 static int kvm_init(MachineState *ms)
 {
     MachineClass *mc = MACHINE_GET_CLASS(ms);
@@ -2461,11 +2488,20 @@ static int kvm_init(MachineState *ms)
      */
     if (s->kvm_dirty_ring_size > 0) {
         uint64_t ring_bytes;
+        int capability = KVM_CAP_DIRTY_LOG_RING;
 
         ring_bytes = s->kvm_dirty_ring_size * sizeof(struct kvm_dirty_gfn);
 
-        /* Read the max supported pages */
-        ret = kvm_vm_check_extension(s, KVM_CAP_DIRTY_LOG_RING);
+        /*
+         * Read the max supported pages.  Hosts with a weakly ordered
+         * memory model (e.g. arm64) only offer the acquire/release
+         * flavour of the ring.
+         */
+        ret = kvm_vm_check_extension(s, capability);
+        if (ret <= 0) {
+            capability = KVM_CAP_DIRTY_LOG_RING_ACQ_REL;
+            ret = kvm_vm_check_extension(s, capability);
+        }
         if (ret > 0) {
             if (ring_bytes > ret) {
                 error_report("KVM dirty ring size %" PRIu32 " too big "
@@ -2476,13 +2512,30 @@ static int kvm_init(MachineState *ms)
                 goto err;
             }
 
-            ret = kvm_vm_enable_cap(s, KVM_CAP_DIRTY_LOG_RING, 0, ring_bytes);
+            ret = kvm_vm_enable_cap(s, capability, 0, ring_bytes);
             if (ret) {
                 error_report("Enabling of KVM dirty ring failed: %s. "
                              "Suggested minimum value is 1024.", strerror(-ret));
                 goto err;
             }
 
+            /*
+             * Some devices dirty guest memory outside of vCPU context
+             * (the arm64 vGIC ITS); KVM then needs a backup bitmap, which
+             * must be enabled before any memslot logs dirty pages.
+             */
+            if (kvm_vm_check_extension(s,
+                                       KVM_CAP_DIRTY_LOG_RING_WITH_BITMAP) > 0) {
+                ret = kvm_vm_enable_cap(s, KVM_CAP_DIRTY_LOG_RING_WITH_BITMAP,
+                                        0);
+                if (ret) {
+                    error_report("Enabling of KVM dirty ring's backup bitmap "
+                                 "failed: %s", strerror(-ret));
+                    goto err;
+                }
+                s->kvm_dirty_ring_with_bitmap = true;
+            }
+
             s->kvm_dirty_ring_bytes = ring_bytes;
          } else {
              warn_report("KVM dirty ring not available, using bitmap method");
@@ -2933,6 +2986,7 @@ int kvm_cpu_exec(CPUState *cpu)
             qemu_mutex_lock_iothread();
             kvm_dirty_ring_reap(kvm_state);
             qemu_mutex_unlock_iothread();
+            dirtylimit_vcpu_execute(cpu);
             ret = 0;
             break;
         case KVM_EXIT_SYSTEM_EVENT:
@@ -33,6 +33,7 @@
 #include "qemu/timer.h"
 #include "qemu/rcu.h"
 #include "exec/log.h"
+#include "exec/gdbstub.h"
 #include "qemu/main-loop.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
 #include "hw/i386/apic.h"
@@ -168,6 +169,14 @@ uint32_t curr_cflags(CPUState *cpu)
         cflags |= CF_NO_GOTO_TB;
     }
 
+    /*
+     * A load forwarded from a store in the same TB would not hit a read
+     * watchpoint, so translate separately while any are inserted.
+     */
+    if (unlikely(!QTAILQ_EMPTY(&cpu->watchpoints))) {
+        cflags |= CF_NO_ST_FWD;
+    }
+
     return cflags;
 }
 
@@ -176,28 +185,29 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, target_ulong pc,
                                           target_ulong cs_base,
                                           uint32_t flags, uint32_t cflags)
 {
-    TranslationBlock *tb;
-    uint32_t hash;
+    TranslationBlock *tb, **set;
+    int i;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
-    tb = qatomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-
-    if (likely(tb &&
-               tb->pc == pc &&
-               tb->cs_base == cs_base &&
-               tb->flags == flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               tb_cflags(tb) == cflags)) {
-        return tb;
+    set = &cpu->tb_jmp_cache[tb_jmp_cache_set(pc)];
+    for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+        tb = qatomic_rcu_read(&set[i]);
+        if (likely(tb &&
+                   tb->pc == pc &&
+                   tb->cs_base == cs_base &&
+                   tb->flags == flags &&
+                   tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+                   tb_cflags(tb) == cflags)) {
+            return tb;
+        }
     }
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
-    qatomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(cpu, pc, tb);
     return tb;
 }
 
@@ -263,7 +273,7 @@ static bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
             bool match_bp = false;
 
             if (bp->flags & BP_GDB) {
-                match_bp = true;
+                match_bp = gdb_breakpoint_hit(cpu, pc);
             } else if (bp->flags & BP_CPU) {
 #ifdef CONFIG_USER_ONLY
                 g_assert_not_reached();
@@ -278,6 +288,8 @@ static bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
                 cpu->exception_index = EXCP_DEBUG;
                 return true;
             }
+            /* keep coming back here, the condition may hold next time */
+            match_page = true;
         } else if (((pc ^ bp->pc) & TARGET_PAGE_MASK) == 0) {
             match_page = true;
         }
@@ -301,6 +313,16 @@ static bool check_for_breakpoints(CPUState *cpu, target_ulong pc,
     return false;
 }
 
+/*
+ * Count a dispatch of @tb and report whether it has become hot enough
+ * to be retranslated as a superblock.
+ */
+static inline bool tb_superblock_due(TranslationBlock *tb)
+{
+    return unlikely(tb_superblock_threshold) && !tb->superblock &&
+           ++tb->exec_count >= tb_superblock_threshold;
+}
+
 /**
  * helper_lookup_tb_ptr: quick check for next tb
  * @env: current cpu state
@@ -324,10 +346,89 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     }
 
     tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
-    if (tb == NULL) {
+
+    if (unlikely(tb_chain_stats)) {
+        /* Slow, but tells which TB the indirect jump came from. */
+        TranslationBlock *src = tcg_tb_lookup(GETPC());
+
+        if (src) {
+            qatomic_inc(&src->exit_stats.indirect);
+            if (tb == NULL) {
+                qatomic_inc(&src->exit_stats.indirect_miss);
+            }
+        }
+    }
+
+    if (tb == NULL || tb_superblock_due(tb)) {
+        /* Let cpu_exec() translate it. */
         return tcg_code_gen_epilogue;
     }
 
+    tb_coverage_check(tb);
+    log_cpu_exec(pc, cpu, tb);
+
+    return tb->tc.ptr;
+}
+
+/**
+ * helper_lookup_tb_ptr_cached: quick check for next tb, with inline cache
+ * @env: current cpu state
+ * @src_ptr: the TB we are jumping from
+ *
+ * Like helper_lookup_tb_ptr, but try the last target of @src_ptr first.
+ * The entry is tagged with the CPU and its tb_jmp_cache generation, so it
+ * goes stale with the jump cache, e.g. on tlb_flush().  Front ends only
+ * emit this without CF_PARALLEL, so no other thread touches @src_ptr's
+ * cache while we use it.
+ */
+const void *HELPER(lookup_tb_ptr_cached)(CPUArchState *env, void *src_ptr)
+{
+    CPUState *cpu = env_cpu(env);
+    TranslationBlock *src = src_ptr;
+    TranslationBlock *tb;
+    target_ulong cs_base, pc;
+    uint32_t flags, cflags;
+
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+
+    cflags = curr_cflags(cpu);
+    if (check_for_breakpoints(cpu, pc, &cflags)) {
+        cpu_loop_exit(cpu);
+    }
+
+    tb = src->jmp_ic.tb;
+    if (likely(tb &&
+               src->jmp_ic.cpu == cpu &&
+               src->jmp_ic.gen == cpu->tb_jmp_cache_gen &&
+               tb->pc == pc &&
+               tb->cs_base == cs_base &&
+               tb->flags == flags &&
+               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+               tb_cflags(tb) == cflags)) {
+        src->jmp_ic.hits++;
+    } else {
+        src->jmp_ic.misses++;
+        tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
+        if (tb) {
+            src->jmp_ic.tb = tb;
+            src->jmp_ic.cpu = cpu;
+            src->jmp_ic.gen = cpu->tb_jmp_cache_gen;
+        }
+    }
+
+    if (unlikely(tb_chain_stats)) {
+        qatomic_inc(&src->exit_stats.indirect);
+        if (tb == NULL) {
+            qatomic_inc(&src->exit_stats.indirect_miss);
+        }
+    }
+
+    if (tb == NULL || tb_superblock_due(tb)) {
+        /* Let cpu_exec() translate it. */
+        return tcg_code_gen_epilogue;
+    }
+
+    tb_coverage_check(tb);
     log_cpu_exec(pc, cpu, tb);
 
     return tb->tc.ptr;
@@ -456,6 +557,7 @@ void cpu_exec_step_atomic(CPUState *cpu)
         }
 
         cpu_exec_enter(cpu);
+        tb_coverage_check(tb);
         /* execute the generated code */
         trace_exec_tb(tb, pc);
         cpu_tb_exec(cpu, tb, &tb_exit);
@@ -895,6 +997,14 @@ int cpu_exec(CPUState *cpu)
         return EXCP_HALTED;
     }
 
+    if (unlikely(qemu_loglevel_mask(LOG_STARTUP))) {
+        static bool started;
+
+        if (!qatomic_xchg(&started, true)) {
+            qemu_log_startup("first guest instruction");
+        }
+    }
+
     rcu_read_lock();
 
     cpu_exec_enter(cpu);
@@ -974,12 +1084,35 @@ int cpu_exec(CPUState *cpu)
             if (tb == NULL) {
                 mmap_lock();
                 tb = tb_gen_code(cpu, pc, cs_base, flags, cflags);
+#ifndef CONFIG_USER_ONLY
+                tb_cache_prefetch(cpu, tb);
+                if (tb_spec_enabled) {
+                    tb_spec_queue_exits(cpu, tb);
+                }
+#endif
                 mmap_unlock();
                 /*
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                qatomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
+                tb_jmp_cache_insert(cpu, pc, tb);
+            } else if (tb_superblock_due(tb)) {
+                /*
+                 * Hot: replace it with a translation that follows its
+                 * direct branches.  The new TB has the same lookup key,
+                 * so the old one must go first.
+                 */
+                mmap_lock();
+                tb_phys_invalidate(tb, -1);
+                tb = tb_gen_code(cpu, pc, cs_base, flags,
+                                 cflags | CF_SUPERBLOCK);
+                mmap_unlock();
+                tb_jmp_cache_insert(cpu, pc, tb);
+                last_tb = NULL;
+            }
+
+            if (unlikely(tb_chain_stats) && last_tb) {
+                qatomic_inc(&last_tb->exit_stats.unchained);
             }
 
 #ifndef CONFIG_USER_ONLY
@@ -990,9 +1123,13 @@ int cpu_exec(CPUState *cpu)
              * for the second page can change.
              */
             if (tb->page_addr[1] != -1) {
+                if (unlikely(tb_chain_stats) && last_tb) {
+                    qatomic_inc(&last_tb->exit_stats.unchainable);
+                }
                 last_tb = NULL;
             }
 #endif
+            tb_coverage_check(tb);
             /* See if we can patch the calling TB. */
             if (last_tb) {
                 tb_add_jump(last_tb, tb_exit, tb);
@@ -1000,12 +1137,24 @@ int cpu_exec(CPUState *cpu)
 
             cpu_loop_exec_tb(cpu, tb, &last_tb, &tb_exit);
 
+            /* Batched TLB flushes don't outlive a return to the main loop */
+            tlb_flush_batch_commit(cpu);
+
             /* Try to align the host and virtual clocks
                if the guest is in advance */
             align_clocks(&sc, cpu);
         }
     }
 
+    tlb_flush_batch_commit(cpu);
+    if (cpu->rr_slice) {
+        target_ulong cs_base, pc;
+        uint32_t flags;
+
+        /* Lets the round-robin thread spot polling loops */
+        cpu_get_tb_cpu_state(cpu->env_ptr, &pc, &cs_base, &flags);
+        cpu->rr_exit_pc = pc;
+    }
     cpu_exec_exit(cpu);
     rcu_read_unlock();
 
@@ -1076,6 +1225,81 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+static uint64_t tb_unchained_exits(const TranslationBlock *tb)
+{
+    return (uint64_t)tb->exit_stats.unchained + tb->exit_stats.indirect;
+}
+
+static gboolean tb_chain_stats_iter(gpointer key, gpointer value,
+                                    gpointer data)
+{
+    TranslationBlock *tb = value;
+    GPtrArray *tbs = data;
+
+    if (tb_unchained_exits(tb)) {
+        g_ptr_array_add(tbs, tb);
+    }
+    return false;
+}
+
+static gint tb_chain_stats_cmp(gconstpointer a, gconstpointer b)
+{
+    uint64_t ea = tb_unchained_exits(*(TranslationBlock *const *)a);
+    uint64_t eb = tb_unchained_exits(*(TranslationBlock *const *)b);
+
+    return ea > eb ? -1 : ea < eb;
+}
+
+#define TB_CHAINS_MAX_REPORT 32
+
+HumanReadableText *qmp_x_query_tb_chains(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    g_autoptr(GPtrArray) tbs = g_ptr_array_new();
+    guint i;
+
+    if (!tcg_enabled() || !tb_chain_stats) {
+        error_setg(errp, "TB chain statistics are only available with "
+                   "-accel tcg,chain-stats=on");
+        return NULL;
+    }
+
+    tcg_tb_foreach(tb_chain_stats_iter, tbs);
+    g_ptr_array_sort(tbs, tb_chain_stats_cmp);
+
+    g_string_append_printf(buf, "%-18s %5s %10s %11s %10s %10s %10s %10s\n",
+                           "guest pc", "links", "unchained", "unchainable",
+                           "indirect", "ind. miss", "ic hit", "ic miss");
+    for (i = 0; i < MIN(tbs->len, TB_CHAINS_MAX_REPORT); i++) {
+        TranslationBlock *tb = g_ptr_array_index(tbs, i);
+        int n, links = 0, slots = 0;
+
+        for (n = 0; n < 2; n++) {
+            if (tb->jmp_reset_offset[n] != TB_JMP_RESET_OFFSET_INVALID) {
+                slots++;
+                links += qatomic_read(&tb->jmp_dest[n]) != 0;
+            }
+        }
+        g_autofree char *pc = g_strdup_printf("0x" TARGET_FMT_lx, tb->pc);
+
+        g_string_append_printf(buf, "%-18s %3d/%d %10u %11u %10u %10u "
+                               "%10u %10u\n",
+                               pc, links, slots,
+                               qatomic_read(&tb->exit_stats.unchained),
+                               qatomic_read(&tb->exit_stats.unchainable),
+                               qatomic_read(&tb->exit_stats.indirect),
+                               qatomic_read(&tb->exit_stats.indirect_miss),
+                               qatomic_read(&tb->jmp_ic.hits),
+                               qatomic_read(&tb->jmp_ic.misses));
+    }
+    if (tbs->len > TB_CHAINS_MAX_REPORT) {
+        g_string_append_printf(buf, "(%u more TBs)\n",
+                               tbs->len - TB_CHAINS_MAX_REPORT);
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
 HumanReadableText *qmp_x_query_opcount(Error **errp)
 {
     g_autoptr(GString) buf = g_string_new("");
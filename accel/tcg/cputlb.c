@@ -28,6 +28,10 @@
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
 #include "qemu/error-report.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "qapi/type-helpers.h"
+#include "sysemu/tcg.h"
 #include "exec/log.h"
 #include "exec/helper-proto.h"
 #include "qemu/atomic.h"
@@ -91,6 +95,11 @@ static inline size_t sizeof_tlb(CPUTLBDescFast *fast)
     return fast->mask + (1 << CPU_TLB_ENTRY_BITS);
 }
 
+static inline void tlb_stat_inc(size_t *stat)
+{
+    qatomic_set(stat, *stat + 1);
+}
+
 static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
                              size_t max_entries)
 {
@@ -113,6 +122,55 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
        overlap the flushed page.  */
     tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
     tb_jmp_cache_clear_page(cpu, addr);
+    cpu->tb_jmp_cache_gen++;
+}
+
+/*
+ * Same as tb_flush_jmp_cache() for every page of [@addr, @addr + @len).
+ * The entries of a page are grouped, so clear each group once, and clear
+ * the whole cache once the range reaches every group anyway.
+ */
+static void tb_flush_jmp_cache_range(CPUState *cpu, target_ulong addr,
+                                     target_ulong len)
+{
+    target_ulong i;
+
+    if (len / TARGET_PAGE_SIZE + 1 >= TB_JMP_CACHE_SIZE / TB_JMP_PAGE_SIZE) {
+        cpu_tb_jmp_cache_clear(cpu);
+        return;
+    }
+
+    tb_jmp_cache_clear_page(cpu, addr - TARGET_PAGE_SIZE);
+    for (i = 0; i < len; i += TARGET_PAGE_SIZE) {
+        tb_jmp_cache_clear_page(cpu, addr + i);
+    }
+    cpu->tb_jmp_cache_gen++;
+}
+
+/*
+ * Set before the vCPUs are created.  Machines with a small footprint
+ * start from the smallest TLB, and never grow it past what is needed
+ * to map all of guest RAM at once.
+ */
+static unsigned tlb_default_bits = CPU_TLB_DYN_DEFAULT_BITS;
+static uint64_t tlb_max_coverage;
+
+void tlb_set_small_footprint(uint64_t ram_size)
+{
+    tlb_default_bits = CPU_TLB_DYN_MIN_BITS;
+    tlb_max_coverage = ram_size;
+}
+
+static size_t tlb_max_entries(void)
+{
+    size_t max = 1 << CPU_TLB_DYN_MAX_BITS;
+
+    if (tlb_max_coverage) {
+        size_t pages = pow2ceil(tlb_max_coverage >> TARGET_PAGE_BITS);
+
+        max = MIN(max, MAX(pages, 1 << CPU_TLB_DYN_MIN_BITS));
+    }
+    return max;
 }
 
 /**
@@ -154,24 +212,17 @@ static void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
  * is direct mapped, so we want the use rate to be low (or at least not too
  * high), since otherwise we are likely to have a significant amount of
  * conflict misses.
+ *
+ * The sizing decision itself is made by the policy selected with
+ * -accel tcg,tlb-resize=...; the above is the "dynamic" (default) policy.
  */
-static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
-                                  int64_t now)
+static size_t tlb_resize_dynamic(CPUTLBDesc *desc, size_t old_size,
+                                 size_t rate, bool window_expired)
 {
-    size_t old_size = tlb_n_entries(fast);
-    size_t rate;
     size_t new_size = old_size;
-    int64_t window_len_ms = 100;
-    int64_t window_len_ns = window_len_ms * 1000 * 1000;
-    bool window_expired = now > desc->window_begin_ns + window_len_ns;
-
-    if (desc->n_used_entries > desc->window_max_entries) {
-        desc->window_max_entries = desc->n_used_entries;
-    }
-    rate = desc->window_max_entries * 100 / old_size;
 
     if (rate > 70) {
-        new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
+        new_size = MIN(old_size << 1, tlb_max_entries());
     } else if (rate < 30 && window_expired) {
         size_t ceil = pow2ceil(desc->window_max_entries);
         size_t expected_rate = desc->window_max_entries * 100 / ceil;
@@ -191,7 +242,74 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
         }
         new_size = MAX(ceil, 1 << CPU_TLB_DYN_MIN_BITS);
     }
+    return new_size;
+}
 
+/*
+ * For guests that keep one working set (e.g. a single address space):
+ * flushes are rare and refills cost more than a large table.
+ */
+static size_t tlb_resize_grow_only(CPUTLBDesc *desc, size_t old_size,
+                                   size_t rate, bool window_expired)
+{
+    if (rate > 70) {
+        return MIN(old_size << 1, tlb_max_entries());
+    }
+    return old_size;
+}
+
+/* Keep the table of the initial size */
+static size_t tlb_resize_fixed(CPUTLBDesc *desc, size_t old_size,
+                               size_t rate, bool window_expired)
+{
+    return old_size;
+}
+
+typedef size_t TLBResizeFn(CPUTLBDesc *desc, size_t old_size,
+                           size_t rate, bool window_expired);
+
+static const struct {
+    const char *name;
+    TLBResizeFn *fn;
+} tlb_resize_policies[] = {
+    { "dynamic", tlb_resize_dynamic },
+    { "grow-only", tlb_resize_grow_only },
+    { "fixed", tlb_resize_fixed },
+};
+
+/* Set before the vCPUs are created */
+static unsigned tlb_resize_policy;
+
+bool tlb_set_resize_policy(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(tlb_resize_policies); i++) {
+        if (!strcmp(name, tlb_resize_policies[i].name)) {
+            tlb_resize_policy = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
+                                  int64_t now)
+{
+    size_t old_size = tlb_n_entries(fast);
+    size_t rate;
+    size_t new_size;
+    int64_t window_len_ms = 100;
+    int64_t window_len_ns = window_len_ms * 1000 * 1000;
+    bool window_expired = now > desc->window_begin_ns + window_len_ns;
+
+    if (desc->n_used_entries > desc->window_max_entries) {
+        desc->window_max_entries = desc->n_used_entries;
+    }
+    rate = desc->window_max_entries * 100 / old_size;
+
+    new_size = tlb_resize_policies[tlb_resize_policy].fn(desc, old_size, rate,
+                                                         window_expired);
     if (new_size == old_size) {
         if (window_expired) {
             tlb_window_reset(desc, now, desc->n_used_entries);
@@ -199,6 +317,8 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
         return;
     }
 
+    tlb_stat_inc(new_size > old_size ? &desc->stats.grow
+                                     : &desc->stats.shrink);
     g_free(fast->table);
     g_free(desc->iotlb);
 
@@ -230,14 +350,63 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
+static size_t tlb_victim_size = CPU_VTLB_SIZE;
+
+/* Set before the vCPUs are created; false if @n is not supported */
+bool tlb_set_victim_size(unsigned n)
+{
+    if (!is_power_of_2(n) || n < CPU_VTLB_WAYS || n > CPU_VTLB_MAX_SIZE) {
+        return false;
+    }
+    tlb_victim_size = n;
+    return true;
+}
+
+static inline size_t vtlb_n_entries(const CPUTLBDesc *desc)
+{
+    return desc->vtlb_sets * CPU_VTLB_WAYS;
+}
+
+/* Index of the first way of the set that holds @page */
+static inline size_t vtlb_set_index(const CPUTLBDesc *desc, target_ulong page)
+{
+    return ((page >> TARGET_PAGE_BITS) & (desc->vtlb_sets - 1)) *
+           CPU_VTLB_WAYS;
+}
+
+/*
+ * Tree pseudo-LRU over the 4 ways of a set: bit 0 selects the half to
+ * evict from next, bits 1 and 2 the way within the low and high half.
+ */
+QEMU_BUILD_BUG_ON(CPU_VTLB_WAYS != 4);
+
+static inline void vtlb_plru_touch(uint8_t *plru, unsigned way)
+{
+    if (way < 2) {
+        *plru = (*plru | 1) & ~2;
+        *plru |= way == 0 ? 2 : 0;
+    } else {
+        *plru = *plru & ~(1 | 4);
+        *plru |= way == 2 ? 4 : 0;
+    }
+}
+
+static inline unsigned vtlb_plru_victim(uint8_t plru)
+{
+    if (plru & 1) {
+        return plru & 4 ? 3 : 2;
+    }
+    return plru & 2 ? 1 : 0;
+}
+
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
 {
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
-    desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, vtlb_n_entries(desc) * sizeof(CPUTLBEntry));
+    memset(desc->vplru, 0, desc->vtlb_sets);
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
@@ -246,19 +415,24 @@ static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx,
     CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
     CPUTLBDescFast *fast = &env_tlb(env)->f[mmu_idx];
 
+    tlb_stat_inc(&desc->stats.flush);
     tlb_mmu_resize_locked(desc, fast, now);
     tlb_mmu_flush_locked(desc, fast);
 }
 
 static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
 {
-    size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+    size_t n_entries = 1 << tlb_default_bits;
 
     tlb_window_reset(desc, now, 0);
     desc->n_used_entries = 0;
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->iotlb = g_new(CPUIOTLBEntry, n_entries);
+    desc->vtlb_sets = tlb_victim_size / CPU_VTLB_WAYS;
+    desc->vplru = g_new(uint8_t, desc->vtlb_sets);
+    desc->vtable = g_new(CPUTLBEntry, tlb_victim_size);
+    desc->viotlb = g_new(CPUIOTLBEntry, tlb_victim_size);
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -272,6 +446,16 @@ static inline void tlb_n_used_entries_dec(CPUArchState *env, uintptr_t mmu_idx)
     env_tlb(env)->d[mmu_idx].n_used_entries--;
 }
 
+static void io_cache_flush(CPUArchState *env)
+{
+    CPUIOCacheEntry *cache = env_tlb(env)->c.io_cache;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(env_tlb(env)->c.io_cache); i++) {
+        cache[i].iotlb = -1;
+    }
+}
+
 void tlb_init(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -286,6 +470,7 @@ void tlb_init(CPUState *cpu)
     for (i = 0; i < NB_MMU_MODES; i++) {
         tlb_mmu_init(&env_tlb(env)->d[i], &env_tlb(env)->f[i], now);
     }
+    io_cache_flush(env);
 }
 
 void tlb_destroy(CPUState *cpu)
@@ -300,6 +485,9 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->iotlb);
+        g_free(desc->vplru);
+        g_free(desc->vtable);
+        g_free(desc->viotlb);
     }
 }
 
@@ -339,6 +527,47 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+HumanReadableText *qmp_x_query_tlb(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    CPUState *cpu;
+    int mmu_idx;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB statistics are only available with TCG");
+        return NULL;
+    }
+
+    g_string_append_printf(buf, "resize policy: %s\n",
+                           tlb_resize_policies[tlb_resize_policy].name);
+    g_string_append_printf(buf, "%-4s %3s %7s %12s %12s %12s %10s %6s %6s\n",
+                           "cpu", "mmu", "entries", "misses", "victim hits",
+                           "fills", "flushes", "grows", "shrinks");
+    CPU_FOREACH(cpu) {
+        CPUTLB *tlb = env_tlb(cpu->env_ptr);
+
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            CPUTLBDesc *desc = &tlb->d[mmu_idx];
+            size_t miss = qatomic_read(&desc->stats.miss);
+            size_t flush = qatomic_read(&desc->stats.flush);
+
+            if (!miss && !flush) {
+                continue;
+            }
+            g_string_append_printf(buf, "%-4d %3d %7zu %12zu %12zu %12zu "
+                                   "%10zu %6zu %6zu\n",
+                                   cpu->cpu_index, mmu_idx,
+                                   tlb_n_entries(&tlb->f[mmu_idx]), miss,
+                                   qatomic_read(&desc->stats.victim_hit),
+                                   qatomic_read(&desc->stats.fill), flush,
+                                   qatomic_read(&desc->stats.grow),
+                                   qatomic_read(&desc->stats.shrink));
+        }
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
 static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
@@ -366,6 +595,14 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 
     cpu_tb_jmp_cache_clear(cpu);
 
+    /*
+     * A change of the memory map renumbers the sections and flushes
+     * everything, whether or not anything was dirty.
+     */
+    if (asked == ALL_MMUIDX_BITS) {
+        io_cache_flush(env);
+    }
+
     if (to_clean == ALL_MMUIDX_BITS) {
         qatomic_set(&env_tlb(env)->c.full_flush_count,
                    env_tlb(env)->c.full_flush_count + 1);
@@ -453,6 +690,7 @@ static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
     return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
 }
 
+
 /* Called with tlb_c.lock held */
 static bool tlb_flush_entry_mask_locked(CPUTLBEntry *tlb_entry,
                                         target_ulong page,
@@ -477,10 +715,15 @@ static void tlb_flush_vtlb_page_mask_locked(CPUArchState *env, int mmu_idx,
                                             target_ulong mask)
 {
     CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
-    int k;
+    size_t k, start = 0, end = vtlb_n_entries(d);
 
     assert_cpu_is_self(env_cpu(env));
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    if (mask == -1) {
+        /* A single page can only be in its own set */
+        start = vtlb_set_index(d, page);
+        end = start + CPU_VTLB_WAYS;
+    }
+    for (k = start; k < end; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(env, mmu_idx);
         }
@@ -783,9 +1026,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
 
-    for (target_ulong i = 0; i < d.len; i += TARGET_PAGE_SIZE) {
-        tb_flush_jmp_cache(cpu, d.addr + i);
-    }
+    tb_flush_jmp_cache_range(cpu, d.addr, d.len);
 }
 
 static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
@@ -929,6 +1170,58 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                           RUN_ON_CPU_HOST_PTR(p));
 }
 
+void tlb_flush_batch_commit(CPUState *cpu)
+{
+    CPUTLBCommon *c = &env_tlb(cpu->env_ptr)->c;
+    target_ulong len = c->batch_len;
+
+    if (likely(!len)) {
+        return;
+    }
+    c->batch_len = 0;
+    if (c->batch_all_cpus) {
+        tlb_flush_range_by_mmuidx_all_cpus_synced(cpu, c->batch_addr, len,
+                                                  c->batch_idxmap,
+                                                  c->batch_bits);
+    } else {
+        tlb_flush_range_by_mmuidx(cpu, c->batch_addr, len,
+                                  c->batch_idxmap, c->batch_bits);
+    }
+}
+
+void tlb_flush_page_bits_by_mmuidx_batched(CPUState *cpu, target_ulong addr,
+                                           uint16_t idxmap, unsigned bits,
+                                           bool all_cpus)
+{
+    CPUTLBCommon *c = &env_tlb(cpu->env_ptr)->c;
+
+    assert_cpu_is_self(cpu);
+    addr &= TARGET_PAGE_MASK;
+
+    if (c->batch_len && c->batch_idxmap == idxmap &&
+        c->batch_bits == bits && c->batch_all_cpus == all_cpus) {
+        if (addr == c->batch_addr + c->batch_len) {
+            c->batch_len += TARGET_PAGE_SIZE;
+            return;
+        }
+        if (addr + TARGET_PAGE_SIZE == c->batch_addr) {
+            c->batch_addr = addr;
+            c->batch_len += TARGET_PAGE_SIZE;
+            return;
+        }
+        if (addr - c->batch_addr < c->batch_len) {
+            return;
+        }
+    }
+
+    tlb_flush_batch_commit(cpu);
+    c->batch_addr = addr;
+    c->batch_len = TARGET_PAGE_SIZE;
+    c->batch_idxmap = idxmap;
+    c->batch_bits = bits;
+    c->batch_all_cpus = all_cpus;
+}
+
 void tlb_flush_page_bits_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                    target_ulong addr,
                                                    uint16_t idxmap,
@@ -999,6 +1292,34 @@ static inline void copy_tlb_helper_locked(CPUTLBEntry *d, const CPUTLBEntry *s)
     *d = *s;
 }
 
+/*
+ * Called with tlb_c.lock held.
+ * Copy the non-empty @te, with its @io, into its set of the victim tlb,
+ * replacing a free way or else the pseudo-LRU one.
+ */
+static void vtlb_insert_locked(CPUTLBDesc *desc, const CPUTLBEntry *te,
+                               const CPUIOTLBEntry *io)
+{
+    target_ulong page = te->addr_read != -1 ? te->addr_read
+                      : te->addr_write != -1 ? te->addr_write
+                      : te->addr_code;
+    size_t set = vtlb_set_index(desc, page & TARGET_PAGE_MASK);
+    uint8_t *plru = &desc->vplru[set / CPU_VTLB_WAYS];
+    unsigned way;
+
+    for (way = 0; way < CPU_VTLB_WAYS; way++) {
+        if (tlb_entry_is_empty(&desc->vtable[set + way])) {
+            break;
+        }
+    }
+    if (way == CPU_VTLB_WAYS) {
+        way = vtlb_plru_victim(*plru);
+    }
+    vtlb_plru_touch(plru, way);
+    copy_tlb_helper_locked(&desc->vtable[set + way], te);
+    desc->viotlb[set + way] = *io;
+}
+
 /* This is a cross vCPU call (i.e. another vCPU resetting the flags of
  * the target vCPU).
  * We must take tlb_c.lock to avoid racing with another vCPU update. The only
@@ -1021,7 +1342,8 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        n = vtlb_n_entries(&env_tlb(env)->d[mmu_idx]);
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range_locked(&env_tlb(env)->d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -1054,9 +1376,11 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&env_tlb(env)->d[mmu_idx].vtable[k], vaddr);
+        CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+        size_t k, set = vtlb_set_index(desc, vaddr);
+
+        for (k = set; k < set + CPU_VTLB_WAYS; k++) {
+            tlb_set_dirty1_locked(&desc->vtable[k], vaddr);
         }
     }
     qemu_spin_unlock(&env_tlb(env)->c.lock);
@@ -1113,6 +1437,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     bool is_ram, is_romd;
 
     assert_cpu_is_self(cpu);
+    tlb_stat_inc(&desc->stats.fill);
 
     if (size <= TARGET_PAGE_SIZE) {
         sz = TARGET_PAGE_SIZE;
@@ -1205,12 +1530,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, vaddr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
-        CPUTLBEntry *tv = &desc->vtable[vidx];
-
         /* Evict the old entry into the victim tlb.  */
-        copy_tlb_helper_locked(tv, te);
-        desc->viotlb[vidx] = desc->iotlb[index];
+        vtlb_insert_locked(desc, te, &desc->iotlb[index]);
         tlb_n_used_entries_dec(env, mmu_idx);
     }
 
@@ -1274,11 +1595,11 @@ void tlb_set_page(CPUState *cpu, target_ulong vaddr,
                             prot, mmu_idx, size);
 }
 
-static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
+static inline ram_addr_t qemu_ram_code_addr_from_host_nofail(void *ptr)
 {
     ram_addr_t ram_addr;
 
-    ram_addr = qemu_ram_addr_from_host(ptr);
+    ram_addr = qemu_ram_code_addr_from_host(ptr);
     if (ram_addr == RAM_ADDR_INVALID) {
         error_report("Bad ram pointer %p", ptr);
         abort();
@@ -1332,6 +1653,36 @@ static inline void cpu_transaction_failed(CPUState *cpu, hwaddr physaddr,
     }
 }
 
+/*
+ * Resolve @iotlbentry through the vCPU's cache of recently used MMIO
+ * pages, so that a guest polling a few device registers skips the
+ * section lookup and the checks memory_region_dispatch_* would make.
+ * The iotlb value names the section and the page within its region;
+ * the address space it was looked up in only depends on attrs.secure,
+ * for every target with more than one.
+ */
+static CPUIOCacheEntry *io_cache_lookup(CPUArchState *env,
+                                        CPUIOTLBEntry *iotlbentry)
+{
+    hwaddr iotlb = iotlbentry->addr;
+    bool secure = iotlbentry->attrs.secure;
+    size_t i = (iotlb ^ (iotlb >> TARGET_PAGE_BITS)) &
+               ((1 << CPU_IO_CACHE_BITS) - 1);
+    CPUIOCacheEntry *c = &env_tlb(env)->c.io_cache[i];
+
+    if (unlikely(c->iotlb != iotlb || c->secure != secure)) {
+        MemoryRegionSection *section;
+
+        section = iotlb_to_section(env_cpu(env), iotlb, iotlbentry->attrs);
+        c->iotlb = iotlb;
+        c->secure = secure;
+        c->section = section;
+        c->direct[0] = memory_region_direct_access_sizes(section->mr, false);
+        c->direct[1] = memory_region_direct_access_sizes(section->mr, true);
+    }
+    return c;
+}
+
 static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
                          int mmu_idx, target_ulong addr, uintptr_t retaddr,
                          MMUAccessType access_type, MemOp op)
@@ -1341,22 +1692,33 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     MemoryRegionSection *section;
     MemoryRegion *mr;
     uint64_t val;
-    bool locked = false;
+    bool bql_held;
+    bool direct;
     MemTxResult r;
+    CPUIOCacheEntry *c = io_cache_lookup(env, iotlbentry);
 
-    section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
+    section = c->section;
     mr = section->mr;
     mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+    direct = (c->direct[0] & memop_size(op)) &&
+             !(mr_offset & (memop_size(op) - 1));
     cpu->mem_io_pc = retaddr;
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
 
-    if (!qemu_mutex_iothread_locked()) {
+    /* Regions with their own lock are read without the BQL */
+    bql_held = qemu_mutex_iothread_locked();
+    if (!bql_held && !mr->lock) {
         qemu_mutex_lock_iothread();
-        locked = true;
     }
-    r = memory_region_dispatch_read(mr, mr_offset, &val, op, iotlbentry->attrs);
+    if (direct) {
+        r = memory_region_dispatch_read_direct(mr, mr_offset, &val, op,
+                                               iotlbentry->attrs);
+    } else {
+        r = memory_region_dispatch_read(mr, mr_offset, &val, op,
+                                        iotlbentry->attrs);
+    }
     if (r != MEMTX_OK) {
         hwaddr physaddr = mr_offset +
             section->offset_within_address_space -
@@ -1365,7 +1727,8 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         cpu_transaction_failed(cpu, physaddr, addr, memop_size(op), access_type,
                                mmu_idx, iotlbentry->attrs, r, retaddr);
     }
-    if (locked) {
+    /* Also covers memory_region_take_bql() */
+    if (!bql_held && qemu_mutex_iothread_locked()) {
         qemu_mutex_unlock_iothread();
     }
 
@@ -1397,11 +1760,15 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     MemoryRegionSection *section;
     MemoryRegion *mr;
     bool locked = false;
+    bool direct;
     MemTxResult r;
+    CPUIOCacheEntry *c = io_cache_lookup(env, iotlbentry);
 
-    section = iotlb_to_section(cpu, iotlbentry->addr, iotlbentry->attrs);
+    section = c->section;
     mr = section->mr;
     mr_offset = (iotlbentry->addr & TARGET_PAGE_MASK) + addr;
+    direct = (c->direct[1] & memop_size(op)) &&
+             !(mr_offset & (memop_size(op) - 1));
     if (!cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
@@ -1417,7 +1784,13 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         qemu_mutex_lock_iothread();
         locked = true;
     }
-    r = memory_region_dispatch_write(mr, mr_offset, val, op, iotlbentry->attrs);
+    if (direct) {
+        r = memory_region_dispatch_write_direct(mr, mr_offset, val, op,
+                                                iotlbentry->attrs);
+    } else {
+        r = memory_region_dispatch_write(mr, mr_offset, val, op,
+                                         iotlbentry->attrs);
+    }
     if (r != MEMTX_OK) {
         hwaddr physaddr = mr_offset +
             section->offset_within_address_space -
@@ -1447,11 +1820,14 @@ static inline target_ulong tlb_read_ofs(CPUTLBEntry *entry, size_t ofs)
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
+    CPUTLBDesc *desc = &env_tlb(env)->d[mmu_idx];
+    size_t set = vtlb_set_index(desc, page);
     size_t vidx;
 
     assert_cpu_is_self(env_cpu(env));
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &env_tlb(env)->d[mmu_idx].vtable[vidx];
+    tlb_stat_inc(&desc->stats.miss);
+    for (vidx = set; vidx < set + CPU_VTLB_WAYS; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         target_ulong cmp;
 
         /* elt_ofs might correspond to .addr_write, so use qatomic_read */
@@ -1462,18 +1838,24 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
 #endif
 
         if (cmp == page) {
-            /* Found entry in victim tlb, swap tlb and iotlb.  */
+            /*
+             * Found entry in victim tlb: move it to the main tlb, and the
+             * entry it replaces to its own set of the victim tlb.
+             */
             CPUTLBEntry tmptlb, *tlb = &env_tlb(env)->f[mmu_idx].table[index];
+            CPUIOTLBEntry tmpio, *io = &desc->iotlb[index];
 
             qemu_spin_lock(&env_tlb(env)->c.lock);
             copy_tlb_helper_locked(&tmptlb, tlb);
             copy_tlb_helper_locked(tlb, vtlb);
-            copy_tlb_helper_locked(vtlb, &tmptlb);
+            memset(vtlb, -1, sizeof(*vtlb));
+            tmpio = *io;
+            *io = desc->viotlb[vidx];
+            if (!tlb_entry_is_empty(&tmptlb)) {
+                vtlb_insert_locked(desc, &tmptlb, &tmpio);
+            }
             qemu_spin_unlock(&env_tlb(env)->c.lock);
-
-            CPUIOTLBEntry tmpio, *io = &env_tlb(env)->d[mmu_idx].iotlb[index];
-            CPUIOTLBEntry *vio = &env_tlb(env)->d[mmu_idx].viotlb[vidx];
-            tmpio = *io; *io = *vio; *vio = tmpio;
+            tlb_stat_inc(&desc->stats.victim_hit);
             return true;
         }
     }
@@ -1532,7 +1914,7 @@ tb_page_addr_t get_page_addr_code_hostp(CPUArchState *env, target_ulong addr,
     if (hostp) {
         *hostp = p;
     }
-    return qemu_ram_addr_from_host_nofail(p);
+    return qemu_ram_code_addr_from_host_nofail(p);
 }
 
 tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
@@ -1547,7 +1929,8 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
 
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
-    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE) &&
+        tb_invalidate_phys_page_needed(ram_addr, size)) {
         struct page_collection *pages
             = page_collection_lock(ram_addr, ram_addr + size);
         tb_invalidate_phys_page_fast(pages, ram_addr, size, retaddr);
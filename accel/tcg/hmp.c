@@ -10,6 +10,9 @@ static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp_info_hrt("smc", qmp_x_query_smc);
+    monitor_register_hmp_info_hrt("tb-chains", qmp_x_query_tb_chains);
+    monitor_register_hmp_info_hrt("tlb-stats", qmp_x_query_tlb);
 }
 
 type_init(hmp_tcg_register);
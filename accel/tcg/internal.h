@@ -18,5 +18,68 @@ TranslationBlock *tb_gen_code(CPUState *cpu, target_ulong pc,
 void QEMU_NORETURN cpu_io_recompile(CPUState *cpu, uintptr_t retaddr);
 void page_init(void);
 void tb_htable_init(void);
+void tb_unlink_all(void);
+
+/*
+ * cflags that only make sense for the execution that asked for them, so
+ * that TBs with them set are not worth keeping or translating ahead.
+ */
+#define TB_CF_SKIP (CF_COUNT_MASK | CF_SINGLE_STEP | CF_LAST_IO | \
+                    CF_MEMI_ONLY | CF_NOIRQ | CF_INVALID)
+
+/* Collect TranslationBlock::exit_stats */
+extern bool tb_chain_stats;
+
+/* Lookups after which a TB is retranslated with CF_SUPERBLOCK, or 0 */
+extern uint32_t tb_superblock_threshold;
+
+/* Describe a new TB to perf, if enabled, see perf-map.c */
+void perf_report_tb(const TranslationBlock *tb);
+
+#ifndef CONFIG_USER_ONLY
+void tb_cache_init(const char *path);
+void tb_cache_prefetch(CPUState *cpu, const TranslationBlock *tb);
+
+/* Select how the softmmu TLB is resized on flush; false if unknown */
+bool tlb_set_resize_policy(const char *name);
+/* Set the number of victim TLB entries per mmu_idx; false if invalid */
+bool tlb_set_victim_size(unsigned n);
+/* Size the softmmu TLBs for a guest with @ram_size bytes of RAM */
+void tlb_set_small_footprint(uint64_t ram_size);
+
+/* Instructions per quantum of the lockstep vCPU threads, or 0 */
+extern uint32_t tcg_lockstep_quantum;
+
+/* Per-vCPU time slices for the round-robin thread, see tcg-accel-ops-rr.c */
+extern bool tcg_rr_adaptive;
+
+/* Speculative translation thread, see tb-spec.c */
+extern bool tb_spec_enabled;
+void tb_spec_init(void);
+void tb_spec_queue_exits(CPUState *cpu, const TranslationBlock *tb);
+void tb_spec_kick(void);
+void tb_spec_exec_begin(void);
+void tb_spec_exec_end(void);
+
+/* Guest coverage bitmap, see tb-coverage.c */
+extern uint32_t tb_coverage_gen;
+void tb_coverage_init(const char *path, uint32_t bits, Error **errp);
+void tb_coverage_mark(TranslationBlock *tb);
+#endif
+
+/*
+ * Called before @tb is entered other than through a direct jump.  Only
+ * the main loop chains TBs, after this check, so a TB that is not marked
+ * in the current generation of the bitmap can't be reached otherwise.
+ */
+static inline void tb_coverage_check(TranslationBlock *tb)
+{
+#ifndef CONFIG_USER_ONLY
+    if (unlikely(qatomic_read(&tb->coverage_gen) !=
+                 qatomic_read(&tb_coverage_gen))) {
+        tb_coverage_mark(tb);
+    }
+#endif
+}
 
 #endif /* ACCEL_TCG_INTERNAL_H */
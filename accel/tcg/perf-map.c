@@ -0,0 +1,197 @@
+/*
+ * Report the code TCG generates to the Linux perf tool
+ *
+ * Without help, perf sees the time spent in translated code as samples
+ * at anonymous addresses of the code_gen_buffer.  perf reads two kinds
+ * of descriptions of JIT code:
+ *
+ * - /tmp/perf-PID.map, one "start size name" line per symbol, which
+ *   perf report reads as is.  It has no notion of time, so once a TB
+ *   flush or region reclaim reuses the buffer, the samples of the new
+ *   code may be attributed to the TB that was there before.
+ *
+ * - jit-PID.dump, which holds a timestamped record per TB along with
+ *   a copy of its host code.  After "perf record -k 1", "perf inject
+ *   --jit" matches each sample with the TB that was loaded at the time,
+ *   so the buffer can be reused freely.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "exec/perf-map.h"
+#include "elf.h"
+#include "internal.h"
+
+#if defined(__x86_64__)
+#define PERF_ELF_MACHINE EM_X86_64
+#elif defined(__i386__)
+#define PERF_ELF_MACHINE EM_386
+#elif defined(__aarch64__)
+#define PERF_ELF_MACHINE EM_AARCH64
+#elif defined(__arm__)
+#define PERF_ELF_MACHINE EM_ARM
+#elif defined(__powerpc64__)
+#define PERF_ELF_MACHINE EM_PPC64
+#elif defined(__s390x__)
+#define PERF_ELF_MACHINE EM_S390
+#elif defined(__riscv)
+#define PERF_ELF_MACHINE EM_RISCV
+#elif defined(__mips__)
+#define PERF_ELF_MACHINE EM_MIPS
+#elif defined(__sparc__)
+#define PERF_ELF_MACHINE EM_SPARCV9
+#else
+#define PERF_ELF_MACHINE EM_NONE
+#endif
+
+/* See tools/perf/Documentation/jitdump-specification.txt in Linux */
+#define JITDUMP_MAGIC       0x4A695444
+#define JITDUMP_VERSION     1
+#define JIT_CODE_LOAD       0
+
+struct jitheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct jr_code_load {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+static FILE *perfmap;
+static FILE *jitdump;
+static void *jitdump_marker;
+static uint64_t jitdump_index;
+
+/* The clock perf uses with -k 1 */
+static uint64_t perf_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+}
+
+static void perf_exit(void)
+{
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+    if (jitdump) {
+        munmap(jitdump_marker, qemu_real_host_page_size);
+        fclose(jitdump);
+        jitdump = NULL;
+    }
+}
+
+void perf_map_enable(void)
+{
+    g_autofree char *path =
+        g_strdup_printf("%s/perf-%d.map", g_get_tmp_dir(), getpid());
+
+    perfmap = fopen(path, "w");
+    if (!perfmap) {
+        warn_report("perf-map: could not open %s: %s", path, strerror(errno));
+        return;
+    }
+    atexit(perf_exit);
+}
+
+void perf_jitdump_enable(void)
+{
+    g_autofree char *path =
+        g_strdup_printf("%s/jit-%d.dump", g_get_tmp_dir(), getpid());
+    struct jitheader header = {
+        .magic = JITDUMP_MAGIC,
+        .version = JITDUMP_VERSION,
+        .total_size = sizeof(header),
+        .elf_mach = PERF_ELF_MACHINE,
+        .pid = getpid(),
+        .timestamp = perf_timestamp(),
+    };
+
+    jitdump = fopen(path, "w+");
+    if (!jitdump) {
+        warn_report("jitdump: could not open %s: %s", path, strerror(errno));
+        return;
+    }
+    /*
+     * perf finds the file through the mmap event of an executable
+     * mapping of it, which must stay in place until the end.
+     */
+    jitdump_marker = mmap(NULL, qemu_real_host_page_size,
+                          PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                          fileno(jitdump), 0);
+    if (jitdump_marker == MAP_FAILED) {
+        warn_report("jitdump: could not map %s: %s", path, strerror(errno));
+        fclose(jitdump);
+        jitdump = NULL;
+        return;
+    }
+    fwrite(&header, sizeof(header), 1, jitdump);
+    fflush(jitdump);
+    atexit(perf_exit);
+}
+
+/* Called from tb_gen_code() once @tb is in the region tree and linked */
+void perf_report_tb(const TranslationBlock *tb)
+{
+    g_autofree char *name = NULL;
+    const char *sym;
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+    sym = lookup_symbol(tb->pc);
+    if (sym[0]) {
+        name = g_strdup_printf("guest:%s@0x" TARGET_FMT_lx, sym, tb->pc);
+    } else {
+        name = g_strdup_printf("guest:0x" TARGET_FMT_lx, tb->pc);
+    }
+
+    if (perfmap) {
+        /* a single call, so that the lines of two vCPUs don't mix */
+        fprintf(perfmap, "%" PRIxPTR " %zx %s\n",
+                (uintptr_t)tb->tc.ptr, tb->tc.size, name);
+    }
+    if (jitdump) {
+        size_t len = strlen(name) + 1;
+        struct jr_code_load rec = {
+            .id = JIT_CODE_LOAD,
+            .total_size = sizeof(rec) + len + tb->tc.size,
+            .timestamp = perf_timestamp(),
+            .pid = getpid(),
+            .tid = qemu_get_thread_id(),
+            .vma = (uintptr_t)tb->tc.ptr,
+            .code_addr = (uintptr_t)tb->tc.ptr,
+            .code_size = tb->tc.size,
+        };
+
+        flockfile(jitdump);
+        rec.code_index = jitdump_index++;
+        fwrite(&rec, sizeof(rec), 1, jitdump);
+        fwrite(name, len, 1, jitdump);
+        fwrite(tb->tc.ptr, tb->tc.size, 1, jitdump);
+        funlockfile(jitdump);
+    }
+}
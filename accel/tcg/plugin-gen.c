@@ -72,8 +72,11 @@ enum plugin_gen_from {
 
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
+    PLUGIN_GEN_CB_UDATA_R,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_COND,
     PLUGIN_GEN_CB_MEM,
+    PLUGIN_GEN_CB_MEM_RING,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
     PLUGIN_GEN_N_CBS,
@@ -86,6 +89,9 @@ enum plugin_gen_cb {
 void HELPER(plugin_vcpu_udata_cb)(uint32_t cpu_index, void *udata)
 { }
 
+void HELPER(plugin_vcpu_udata_cb_r)(uint32_t cpu_index, void *udata)
+{ }
+
 void HELPER(plugin_vcpu_mem_cb)(unsigned int vcpu_index,
                                 qemu_plugin_meminfo_t info, uint64_t vaddr,
                                 void *userdata)
@@ -123,21 +129,88 @@ static void gen_empty_udata_cb(void)
     tcg_temp_free_i32(cpu_index);
 }
 
+/* As above, but the call syncs the TCG globals back to env first */
+static void gen_empty_udata_cb_r(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr udata = tcg_const_ptr(NULL); /* will be overwritten later */
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb_r(cpu_index, udata);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_i32(cpu_index);
+}
+
 /*
  * For now we only support addi_i64.
  * When we support more ops, we can generate one empty inline cb for each.
  */
 static void gen_empty_inline_cb(void)
 {
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
     TCGv_i64 val = tcg_temp_new_i64();
     TCGv_ptr ptr = tcg_const_ptr(NULL); /* overwritten later */
 
+    /* ptr += cpu_index * stride, with the stride overwritten later too */
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
+
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
     tcg_gen_st_i64(val, ptr, 0);
     tcg_temp_free_ptr(ptr);
     tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
+}
+
+/*
+ * Count the execution in the vCPU's entry, and only call the udata
+ * helper once the count reaches the period.  The pointer, the stride,
+ * the increment, the period and the udata are all overwritten later.
+ */
+static void gen_empty_cond_cb(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_new_ptr();
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr base = tcg_const_ptr(NULL);
+    /* still needed after the branch */
+    TCGv_ptr ptr = tcg_temp_local_new_ptr();
+    TCGv_ptr udata;
+    TCGLabel *skip = gen_new_label();
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_add_ptr(ptr, base, cpu_offset);
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_addi_i64(val, val, 1);
+    tcg_gen_st_i64(val, ptr, 0);
+    tcg_gen_brcond_i64(TCG_COND_LTU, val, val, skip);
+
+    tcg_gen_st_i64(tcg_constant_i64(0), ptr, 0);
+    udata = tcg_const_ptr(NULL);
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    gen_set_label(skip);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_ptr(base);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
 }
 
 static void gen_empty_mem_cb(TCGv addr, uint32_t info)
@@ -145,6 +218,51 @@ static void gen_empty_mem_cb(TCGv addr, uint32_t info)
     do_gen_mem_cb(addr, info);
 }
 
+/*
+ * Append (addr, info) to the vCPU's ring.  The ring, its stride and its
+ * mask are overwritten later; there is no branch, since the temps of the
+ * instruction being translated are live around the access.
+ */
+static void gen_empty_mem_ring_cb(TCGv addr, uint32_t info)
+{
+    TCGv_i32 cpu_index = tcg_temp_new_i32();
+    TCGv_i32 head = tcg_temp_new_i32();
+    TCGv_ptr offset = tcg_temp_new_ptr();
+    TCGv_ptr entry = tcg_temp_new_ptr();
+    TCGv_ptr base = tcg_const_ptr(NULL);
+    TCGv_i64 vaddr64 = tcg_temp_new_i64();
+    size_t records = offsetof(struct plugin_mem_ring_head, records);
+
+    QEMU_BUILD_BUG_ON(sizeof(qemu_plugin_mem_record) != 16);
+
+    tcg_gen_ld_i32(cpu_index, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(offset, cpu_index);
+    tcg_gen_add_ptr(entry, base, offset);
+
+    tcg_gen_ld_i32(head, entry, PLUGIN_MEM_RING_HEAD_LO);
+    tcg_gen_and_i32(cpu_index, head, head);
+    tcg_gen_shli_i32(cpu_index, cpu_index, 4);
+    tcg_gen_ext_i32_ptr(offset, cpu_index);
+    tcg_gen_add_ptr(offset, entry, offset);
+
+    tcg_gen_extu_tl_i64(vaddr64, addr);
+    tcg_gen_st_i64(vaddr64, offset,
+                   records + offsetof(qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i32(tcg_constant_i32(info), offset,
+                   records + offsetof(qemu_plugin_mem_record, info));
+    tcg_gen_addi_i32(head, head, 1);
+    tcg_gen_st_i32(head, entry, PLUGIN_MEM_RING_HEAD_LO);
+
+    tcg_temp_free_i64(vaddr64);
+    tcg_temp_free_ptr(base);
+    tcg_temp_free_ptr(entry);
+    tcg_temp_free_ptr(offset);
+    tcg_temp_free_i32(head);
+    tcg_temp_free_i32(cpu_index);
+}
+
 /*
  * Share the same function for enable/disable. When enabling, the NULL
  * pointer will be overwritten later.
@@ -190,7 +308,9 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
         /* fall through */
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_UDATA_R, gen_empty_udata_cb_r);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_COND, gen_empty_cond_cb);
         break;
     default:
         g_assert_not_reached();
@@ -224,6 +344,9 @@ void plugin_gen_empty_mem_callback(TCGv addr, uint32_t info)
     fn.mem_fn = gen_empty_mem_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_MEM, &fn, addr, info, true);
 
+    fn.mem_fn = gen_empty_mem_ring_cb;
+    gen_mem_wrapped(PLUGIN_GEN_CB_MEM_RING, &fn, addr, info, true);
+
     fn.inline_fn = gen_empty_inline_cb;
     gen_mem_wrapped(PLUGIN_GEN_CB_INLINE, &fn, 0, info, false);
 }
@@ -366,6 +489,80 @@ static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
     return op;
 }
 
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* mov_i32 */
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        /* ext_i32_i64 */
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        /* add_i32 */
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        /* add_i64 */
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_brcond_i64(TCGOp **begin_op, TCGOp *op, uint64_t v,
+                              TCGLabel *l)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+        op->args[3] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
+        op->args[5] = label_arg(l);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[1] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[3] = label_arg(l);
+    }
+    l->refs++;
+    return op;
+}
+
+static TCGOp *copy_and_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_and_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static void skip_st_i64(TCGOp **begin_op)
+{
+    int i;
+
+    for (i = 0; i < 64 / TCG_TARGET_REG_BITS; i++) {
+        *begin_op = QTAILQ_NEXT(*begin_op, link);
+        tcg_debug_assert((*begin_op)->opc == INDEX_op_st_i32 ||
+                         (*begin_op)->opc == INDEX_op_st_i64);
+    }
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    l->present = 1;
+    return op;
+}
+
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -417,8 +614,9 @@ static TCGOp *copy_call(TCGOp **begin_op, TCGOp *op, void *empty_func,
  * empty callbacks. This will assert very quickly in a debug build as
  * we assert the ops we are replacing are the correct ones.
  */
-static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
-                              TCGOp *begin_op, TCGOp *op, int *cb_idx)
+static TCGOp *do_append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                                 TCGOp *begin_op, TCGOp *op, int *cb_idx,
+                                 void *empty_func)
 {
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
@@ -432,12 +630,25 @@ static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
     }
 
     /* call */
-    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
-                   cb->f.vcpu_udata, cb_idx);
+    op = copy_call(&begin_op, op, empty_func, cb->f.vcpu_udata, cb_idx);
 
     return op;
 }
 
+static TCGOp *append_udata_cb(const struct qemu_plugin_dyn_cb *cb,
+                              TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    return do_append_udata_cb(cb, begin_op, op, cb_idx,
+                              HELPER(plugin_vcpu_udata_cb));
+}
+
+static TCGOp *append_udata_r_cb(const struct qemu_plugin_dyn_cb *cb,
+                                TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    return do_append_udata_cb(cb, begin_op, op, cb_idx,
+                              HELPER(plugin_vcpu_udata_cb_r));
+}
+
 static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
@@ -445,6 +656,12 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     /* const_ptr */
     op = copy_const_ptr(&begin_op, op, cb->userp);
 
+    /* ld_i32 of cpu_index, mul_i32 by the stride, ext, add_ptr */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+    op = copy_mul_i32(&begin_op, op, cb->inline_insn.stride);
+    op = copy_ext_i32_ptr(&begin_op, op);
+    op = copy_add_ptr(&begin_op, op);
+
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
 
@@ -457,6 +674,73 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGOp *append_cond_cb(const struct qemu_plugin_dyn_cb *cb,
+                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
+{
+    /* each copy needs a label of its own */
+    TCGLabel *skip = gen_new_label();
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->cond.ptr);
+
+    /* ld_i32 of cpu_index, mul_i32 by the stride, ext, add_ptr */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+    op = copy_mul_i32(&begin_op, op, cb->cond.stride);
+    op = copy_ext_i32_ptr(&begin_op, op);
+    op = copy_add_ptr(&begin_op, op);
+
+    /* ld_i64, add_i64, st_i64, brcond below the period */
+    op = copy_ld_i64(&begin_op, op);
+    op = copy_add_i64(&begin_op, op, cb->cond.imm);
+    op = copy_st_i64(&begin_op, op);
+    op = copy_brcond_i64(&begin_op, op, cb->cond.period, skip);
+
+    /* st_i64 $0 if resetting, then the call as in append_udata_cb */
+    if (cb->cond.reset) {
+        op = copy_st_i64(&begin_op, op);
+    } else {
+        skip_st_i64(&begin_op);
+    }
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+    op = copy_call(&begin_op, op, HELPER(plugin_vcpu_udata_cb),
+                   cb->f.vcpu_udata, cb_idx);
+
+    /* set_label */
+    return copy_set_label(&begin_op, op, skip);
+}
+
+static TCGOp *append_mem_ring_cb(const struct qemu_plugin_dyn_cb *cb,
+                                 TCGOp *begin_op, TCGOp *op, int *unused)
+{
+    const struct qemu_plugin_mem_ring *ring = cb->userp;
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, ring->score->data);
+
+    /* ld_i32 of cpu_index, mul_i32 by the stride, ext, add_ptr */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+    op = copy_mul_i32(&begin_op, op, ring->score->stride);
+    op = copy_ext_i32_ptr(&begin_op, op);
+    op = copy_add_ptr(&begin_op, op);
+
+    /* ld_i32 of the head, and_i32 with the mask, shl_i32, ext, add_ptr */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+    op = copy_and_i32(&begin_op, op, ring->size - 1);
+    op = copy_op(&begin_op, op, INDEX_op_shl_i32);
+    op = copy_ext_i32_ptr(&begin_op, op);
+    op = copy_add_ptr(&begin_op, op);
+
+    /* extu_tl_i64, st_i64 and st_i32 of the record */
+    op = copy_extu_tl_i64(&begin_op, op);
+    op = copy_st_i64(&begin_op, op);
+    op = copy_op(&begin_op, op, INDEX_op_st_i32);
+
+    /* add_i32 and st_i32 of the head */
+    op = copy_op(&begin_op, op, INDEX_op_add_i32);
+    return copy_op(&begin_op, op, INDEX_op_st_i32);
+}
+
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -542,18 +826,36 @@ inject_udata_cb(const GArray *cbs, TCGOp *begin_op)
     inject_cb_type(cbs, begin_op, append_udata_cb, op_ok);
 }
 
+static void
+inject_udata_r_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_udata_r_cb, op_ok);
+}
+
 static void
 inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
 {
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void
+inject_cond_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_cond_cb, op_ok);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
     inject_cb_type(cbs, begin_op, append_mem_cb, op_rw);
 }
 
+static void
+inject_mem_ring_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    inject_cb_type(cbs, begin_op, append_mem_ring_cb, op_rw);
+}
+
 /* we could change the ops in place, but we can reuse more code by copying */
 static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 {
@@ -588,12 +890,13 @@ static void inject_mem_helper(TCGOp *begin_op, GArray *arr)
 static void inject_mem_enable_helper(struct qemu_plugin_insn *plugin_insn,
                                      TCGOp *begin_op)
 {
-    GArray *cbs[2];
+    GArray *cbs[3];
     GArray *arr;
     size_t n_cbs, i;
 
     cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
     cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    cbs[2] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING];
 
     n_cbs = 0;
     for (i = 0; i < ARRAY_SIZE(cbs); i++) {
@@ -649,12 +952,24 @@ static void plugin_gen_tb_udata(const struct qemu_plugin_tb *ptb,
     inject_udata_cb(ptb->cbs[PLUGIN_CB_REGULAR], begin_op);
 }
 
+static void plugin_gen_tb_udata_r(const struct qemu_plugin_tb *ptb,
+                                  TCGOp *begin_op)
+{
+    inject_udata_r_cb(ptb->cbs[PLUGIN_CB_REGULAR_R], begin_op);
+}
+
 static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
                                  TCGOp *begin_op)
 {
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_cond(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    inject_cond_cb(ptb->cbs[PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -663,6 +978,15 @@ static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
     inject_udata_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR], begin_op);
 }
 
+static void plugin_gen_insn_udata_r(const struct qemu_plugin_tb *ptb,
+                                    TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_udata_r_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR_R],
+                      begin_op);
+}
+
 static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -671,6 +995,14 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                      begin_op, op_ok);
 }
 
+static void plugin_gen_insn_cond(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cond_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -688,6 +1020,14 @@ static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(cbs, begin_op, op_rw);
 }
 
+static void plugin_gen_mem_ring(const struct qemu_plugin_tb *ptb,
+                                TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_mem_ring_cb(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING], begin_op);
+}
+
 static void plugin_gen_enable_mem_helper(const struct qemu_plugin_tb *ptb,
                                          TCGOp *begin_op, int insn_idx)
 {
@@ -734,12 +1074,21 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_UDATA:
                 type = "udata";
                 break;
+            case PLUGIN_GEN_CB_UDATA_R:
+                type = "udata (regs)";
+                break;
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_COND:
+                type = "cond";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
+            case PLUGIN_GEN_CB_MEM_RING:
+                type = "mem ring";
+                break;
             case PLUGIN_GEN_ENABLE_MEM_HELPER:
                 type = "enable mem helper";
                 break;
@@ -782,9 +1131,15 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_UDATA:
                     plugin_gen_tb_udata(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_UDATA_R:
+                    plugin_gen_tb_udata_r(plugin_tb, op);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_tb_cond(plugin_tb, op);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -798,9 +1153,15 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_UDATA:
                     plugin_gen_insn_udata(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_UDATA_R:
+                    plugin_gen_insn_udata_r(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_insn_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_insn_cond(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_ENABLE_MEM_HELPER:
                     plugin_gen_enable_mem_helper(plugin_tb, op, insn_idx);
                     break;
@@ -817,6 +1178,9 @@ static void plugin_gen_inject(const struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_MEM:
                     plugin_gen_mem_regular(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_MEM_RING:
+                    plugin_gen_mem_ring(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_mem_inline(plugin_tb, op, insn_idx);
                     break;
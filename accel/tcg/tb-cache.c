@@ -0,0 +1,257 @@
+/*
+ * Translation set persistence across runs
+ *
+ * The host code in the translation buffer cannot be reused by another
+ * process: it embeds the addresses of helpers, of the epilogue and of
+ * other TBs, all of which move from one run to the next.  What can be
+ * kept is the list of blocks the guest needed, keyed by the contents of
+ * the page they were translated from.  On the next run, the first time
+ * a page is executed and found unchanged, its remembered blocks are
+ * translated in one go instead of one main loop exit at a time.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+#include "qemu/error-report.h"
+#include "qemu/notify.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu-version.h"
+#include "exec/exec-all.h"
+#include "exec/memory.h"
+#include "sysemu/sysemu.h"
+#include "tcg/tcg.h"
+#include "internal.h"
+#include "trace.h"
+
+#define TB_CACHE_MAGIC    "QEMUTBC"
+#define TB_CACHE_VERSION  1
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nr_entries;
+    char build_id[64];
+} TBCacheHeader;
+
+typedef struct TBCacheEntry {
+    uint64_t page;      /* ram_addr_t of the page holding the TB */
+    uint64_t cs_base;
+    uint32_t hash;      /* crc32c of the page when the TB was saved */
+    uint32_t offset;    /* pc - page start */
+    uint32_t flags;
+    uint32_t cflags;
+} TBCacheEntry;
+
+static char *tb_cache_path;
+static Notifier tb_cache_exit_notifier;
+
+/* page -> GArray of TBCacheEntry, still waiting for their page to run */
+static GHashTable *tb_cache_pending;
+static QemuMutex tb_cache_lock;
+
+static void tb_cache_build_id(char *buf, size_t len)
+{
+    snprintf(buf, len, "%s %s %d", QEMU_FULL_VERSION, TARGET_NAME,
+             TARGET_PAGE_BITS);
+}
+
+static uint32_t tb_cache_hash_page(ram_addr_t page)
+{
+    RCU_READ_LOCK_GUARD();
+    return crc32c(0xffffffff, qemu_map_ram_ptr(NULL, page), TARGET_PAGE_SIZE);
+}
+
+static void tb_cache_load(const char *path)
+{
+    g_autofree char *buf = NULL;
+    g_autoptr(GError) gerr = NULL;
+    TBCacheHeader hdr, want = { 0 };
+    const TBCacheEntry *e;
+    gsize len;
+    uint32_t i;
+
+    if (!g_file_get_contents(path, &buf, &len, &gerr)) {
+        /* First run: nothing to prefetch yet */
+        return;
+    }
+    tb_cache_build_id(want.build_id, sizeof(want.build_id));
+    if (len < sizeof(hdr)) {
+        goto bad;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    if (memcmp(hdr.magic, TB_CACHE_MAGIC, sizeof(TB_CACHE_MAGIC)) ||
+        hdr.version != TB_CACHE_VERSION ||
+        len != sizeof(hdr) + (gsize)hdr.nr_entries * sizeof(*e)) {
+        goto bad;
+    }
+    if (strncmp(hdr.build_id, want.build_id, sizeof(hdr.build_id))) {
+        /* A different build may encode the TB flags differently */
+        return;
+    }
+
+    e = (const TBCacheEntry *)(buf + sizeof(hdr));
+    for (i = 0; i < hdr.nr_entries; i++, e++) {
+        GArray *list = g_hash_table_lookup(tb_cache_pending, &e->page);
+
+        if (!list) {
+            uint64_t *key = g_new(uint64_t, 1);
+
+            *key = e->page;
+            list = g_array_new(false, false, sizeof(TBCacheEntry));
+            g_hash_table_insert(tb_cache_pending, key, list);
+        }
+        g_array_append_val(list, *e);
+    }
+    trace_tb_cache_load(path, hdr.nr_entries);
+    return;
+
+ bad:
+    warn_report("tb-cache: ignoring malformed file '%s'", path);
+}
+
+typedef struct TBCacheSave {
+    GArray *entries;
+    GHashTable *hashes;     /* page -> crc32c, so each page is hashed once */
+} TBCacheSave;
+
+static gboolean tb_cache_save_one(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    TBCacheSave *s = data;
+    TBCacheEntry e;
+    gpointer hash;
+
+    if ((tb->cflags & TB_CF_SKIP) ||
+        tb->page_addr[0] == (tb_page_addr_t)-1 ||
+        tb->page_addr[1] != (tb_page_addr_t)-1) {
+        return false;
+    }
+
+    e.page = tb->page_addr[0];
+    if (!g_hash_table_lookup_extended(s->hashes, &e.page, NULL, &hash)) {
+        uint64_t *k = g_new(uint64_t, 1);
+
+        *k = e.page;
+        hash = GUINT_TO_POINTER(tb_cache_hash_page(e.page));
+        g_hash_table_insert(s->hashes, k, hash);
+    }
+    e.hash = GPOINTER_TO_UINT(hash);
+    e.offset = tb->pc & ~TARGET_PAGE_MASK;
+    e.cs_base = tb->cs_base;
+    e.flags = tb->flags;
+    e.cflags = tb->cflags;
+    g_array_append_val(s->entries, e);
+    return false;
+}
+
+static void tb_cache_save(Notifier *n, void *data)
+{
+    g_autoptr(GError) gerr = NULL;
+    TBCacheHeader hdr = { 0 };
+    TBCacheSave s;
+    GString *out;
+
+    s.entries = g_array_new(false, false, sizeof(TBCacheEntry));
+    s.hashes = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                     g_free, NULL);
+    tcg_tb_foreach(tb_cache_save_one, &s);
+
+    memcpy(hdr.magic, TB_CACHE_MAGIC, sizeof(TB_CACHE_MAGIC));
+    hdr.version = TB_CACHE_VERSION;
+    hdr.nr_entries = s.entries->len;
+    tb_cache_build_id(hdr.build_id, sizeof(hdr.build_id));
+
+    out = g_string_new_len((const char *)&hdr, sizeof(hdr));
+    g_string_append_len(out, s.entries->data,
+                        s.entries->len * sizeof(TBCacheEntry));
+    if (!g_file_set_contents(tb_cache_path, out->str, out->len, &gerr)) {
+        warn_report("tb-cache: could not write '%s': %s",
+                    tb_cache_path, gerr->message);
+    } else {
+        trace_tb_cache_save(tb_cache_path, s.entries->len);
+    }
+
+    g_string_free(out, true);
+    g_hash_table_destroy(s.hashes);
+    g_array_free(s.entries, true);
+}
+
+void tb_cache_init(const char *path)
+{
+    tb_cache_path = g_strdup(path);
+    qemu_mutex_init(&tb_cache_lock);
+    tb_cache_pending = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free,
+                                             (GDestroyNotify)g_array_unref);
+    tb_cache_load(path);
+
+    tb_cache_exit_notifier.notify = tb_cache_save;
+    qemu_add_exit_notifier(&tb_cache_exit_notifier);
+}
+
+/*
+ * @tb has just been translated because of a lookup miss.  If the saved
+ * set has blocks from the same page, and the page still holds what it
+ * held when they were saved, translate the ones that share @tb's state
+ * now.  Blocks saved for another state stay pending for a later miss.
+ */
+void tb_cache_prefetch(CPUState *cpu, const TranslationBlock *tb)
+{
+    target_ulong vpage = tb->pc & TARGET_PAGE_MASK;
+    uint64_t page = tb->page_addr[0];
+    g_autoptr(GArray) todo = NULL;
+    GArray *list;
+    uint32_t i;
+
+    if (!tb_cache_path || page == (tb_page_addr_t)-1 ||
+        (tb->cflags & TB_CF_SKIP)) {
+        return;
+    }
+
+    qemu_mutex_lock(&tb_cache_lock);
+    list = g_hash_table_lookup(tb_cache_pending, &page);
+    if (!list) {
+        qemu_mutex_unlock(&tb_cache_lock);
+        return;
+    }
+    if (g_array_index(list, TBCacheEntry, 0).hash !=
+        tb_cache_hash_page(page)) {
+        /* The page was reloaded with something else this time */
+        g_hash_table_remove(tb_cache_pending, &page);
+        qemu_mutex_unlock(&tb_cache_lock);
+        return;
+    }
+    todo = g_array_new(false, false, sizeof(TBCacheEntry));
+    for (i = 0; i < list->len; ) {
+        TBCacheEntry *e = &g_array_index(list, TBCacheEntry, i);
+
+        if (e->cs_base == tb->cs_base && e->flags == tb->flags &&
+            e->cflags == tb->cflags) {
+            g_array_append_val(todo, *e);
+            g_array_remove_index_fast(list, i);
+        } else {
+            i++;
+        }
+    }
+    if (list->len == 0) {
+        g_hash_table_remove(tb_cache_pending, &page);
+    }
+    qemu_mutex_unlock(&tb_cache_lock);
+
+    /*
+     * tb_gen_code may flush the buffer and longjmp out of here, in which
+     * case the rest of @todo is simply forgotten.
+     */
+    for (i = 0; i < todo->len; i++) {
+        const TBCacheEntry *e = &g_array_index(todo, TBCacheEntry, i);
+        target_ulong pc = vpage | e->offset;
+
+        if (!tb_htable_lookup(cpu, pc, e->cs_base, e->flags, e->cflags)) {
+            tb_gen_code(cpu, pc, e->cs_base, e->flags, e->cflags);
+        }
+    }
+    trace_tb_cache_prefetch(page, todo->len);
+}
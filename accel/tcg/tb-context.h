@@ -34,6 +34,9 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_reclaim_count;
+    uint64_t tb_reclaimed;      /* TBs discarded by reclaims */
+    int64_t tb_flush_time;      /* ns spent in flushes and reclaims */
     unsigned tb_phys_invalidate_count;
 };
 
@@ -0,0 +1,127 @@
+/*
+ * Guest code coverage bitmap
+ *
+ * One bit per translated block, set the first time the block runs.  The
+ * bitmap lives in a file mapped shared, so that a fuzzer or a coverage
+ * tool can watch it while the guest runs.
+ *
+ * Nothing is added to the translated code: only the main loop chains
+ * TBs, and it checks the coverage generation of a TB before entering it
+ * and linking it to its predecessor.  So a TB is only dispatched through
+ * tb_coverage_check() until it is marked, and runs at full speed from
+ * then on.  A reset starts a new generation and unlinks all the TBs, so
+ * that each goes through the check once more.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "exec/exec-all.h"
+#include "sysemu/cpus.h"
+#include "sysemu/runstate.h"
+#include "internal.h"
+#include "trace.h"
+
+uint32_t tb_coverage_gen;
+
+static uint8_t *tb_coverage_map;
+static uint32_t tb_coverage_shift;      /* 64 - log2(number of bits) */
+static size_t tb_coverage_size;         /* in bytes */
+
+void tb_coverage_init(const char *path, uint32_t bits, Error **errp)
+{
+    int fd;
+
+    assert(is_power_of_2(bits) && bits >= 8);
+    tb_coverage_size = bits / 8;
+    tb_coverage_shift = 64 - ctz32(bits);
+
+    fd = qemu_create(path, O_RDWR, 0644, errp);
+    if (fd < 0) {
+        return;
+    }
+    if (ftruncate(fd, 0) || ftruncate(fd, tb_coverage_size)) {
+        error_setg_errno(errp, errno, "could not resize coverage file '%s'",
+                         path);
+        close(fd);
+        return;
+    }
+    tb_coverage_map = mmap(NULL, tb_coverage_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+    close(fd);
+    if (tb_coverage_map == MAP_FAILED) {
+        error_setg_errno(errp, errno, "could not map coverage file '%s'",
+                         path);
+        tb_coverage_map = NULL;
+        return;
+    }
+    tb_coverage_gen = 1;
+}
+
+/* Fibonacci hashing: the top bits of the product, spread over the map */
+static uint32_t tb_coverage_index(target_ulong pc)
+{
+    return ((uint64_t)pc * 0x9e3779b97f4a7c15ull) >> tb_coverage_shift;
+}
+
+void tb_coverage_mark(TranslationBlock *tb)
+{
+    uint32_t i = tb_coverage_index(tb->pc);
+    uint8_t bit = 1 << (i & 7);
+
+    if (!(qatomic_read(&tb_coverage_map[i >> 3]) & bit)) {
+        qatomic_or(&tb_coverage_map[i >> 3], bit);
+        trace_tb_coverage_mark(tb->pc, i);
+    }
+    qatomic_set(&tb->coverage_gen, qatomic_read(&tb_coverage_gen));
+}
+
+/* Called with the vCPUs paused */
+static void tb_coverage_reset(void)
+{
+    memset(tb_coverage_map, 0, tb_coverage_size);
+    if (++tb_coverage_gen == 0) {
+        tb_coverage_gen = 1;
+    }
+    tb_unlink_all();
+}
+
+static void tb_coverage_dump(const char *filename, bool reset, Error **errp)
+{
+    g_autoptr(GError) gerr = NULL;
+    bool running = runstate_is_running();
+
+    if (!tb_coverage_map) {
+        error_setg(errp, "coverage is not enabled, "
+                   "use -accel tcg,coverage=FILE");
+        return;
+    }
+
+    if (running) {
+        pause_all_vcpus();
+    }
+    if (filename &&
+        !g_file_set_contents(filename, (const char *)tb_coverage_map,
+                             tb_coverage_size, &gerr)) {
+        error_setg(errp, "could not write coverage bitmap: %s",
+                   gerr->message);
+    } else if (reset) {
+        tb_coverage_reset();
+    }
+    if (running) {
+        resume_all_vcpus();
+    }
+}
+
+void qmp_x_coverage_dump(const char *filename, bool has_reset, bool reset,
+                         Error **errp)
+{
+    tb_coverage_dump(filename, has_reset && reset, errp);
+}
+
+void qmp_x_coverage_reset(Error **errp)
+{
+    tb_coverage_dump(NULL, true, errp);
+}
@@ -59,6 +59,30 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 
 #endif /* CONFIG_SOFTMMU */
 
+/*
+ * First entry of the set of tb_jmp_cache that can hold @pc.  The
+ * TB_JMP_CACHE_WAYS entries of a set are adjacent and hold the most
+ * recently inserted TB first.  Sets are much smaller than TB_JMP_PAGE_SIZE,
+ * so clearing the entries of a page still clears whole sets.
+ */
+static inline unsigned int tb_jmp_cache_set(target_ulong pc)
+{
+    QEMU_BUILD_BUG_ON(TB_JMP_CACHE_WAYS & (TB_JMP_CACHE_WAYS - 1));
+    return tb_jmp_cache_hash_func(pc) & ~(TB_JMP_CACHE_WAYS - 1);
+}
+
+static inline void tb_jmp_cache_insert(CPUState *cpu, target_ulong pc,
+                                       TranslationBlock *tb)
+{
+    TranslationBlock **set = &cpu->tb_jmp_cache[tb_jmp_cache_set(pc)];
+    int i;
+
+    for (i = TB_JMP_CACHE_WAYS - 1; i > 0; i--) {
+        qatomic_set(&set[i], qatomic_read(&set[i - 1]));
+    }
+    qatomic_set(&set[0], tb);
+}
+
 static inline
 uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc, uint32_t flags,
                       uint32_t cf_mask, uint32_t trace_vcpu_dstate)
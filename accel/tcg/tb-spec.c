@@ -0,0 +1,230 @@
+/*
+ * Speculative translation in a background thread
+ *
+ * When a lookup miss translates a TB, the guest addresses it can exit
+ * to directly are queued.  A worker thread with its own TCGContext (and
+ * so its own code_gen_buffer region) translates them into the TB hash
+ * table, so that the vCPU finds them there instead of calling
+ * tb_gen_code itself when it gets to them.
+ *
+ * Translating needs the vCPU's CPUArchState: the instruction fetches
+ * go through its softmmu TLB, and a fault longjmps to cpu->jmp_env.
+ * The worker therefore only runs while the vCPU thread is parked,
+ * holding tb_spec_exec_lock, which the vCPU takes around cpu_exec(),
+ * and the BQL, which covers everything else that touches the CPU
+ * state from outside cpu_exec().  This limits it to the round-robin
+ * vCPU thread, where idle time is otherwise spent waiting in WFI.  The
+ * vCPU thread drops the BQL for exclusive work, so the worker also
+ * brackets each translation with cpu_exec_start() and cpu_exec_end().
+ *
+ * Because of tb_spec_exec_lock, the vCPU filling the queue and the
+ * worker draining it never run at the same time, so the queue itself
+ * needs no lock and a lookup miss costs the vCPU no more than a few
+ * stores.  tb_spec_lock only covers the handshake that wakes the worker.
+ * Translation never overlaps with execution: the worker only uses time
+ * the vCPU would spend asleep, and what the vCPU gains is to find the
+ * TBs ready when it wakes up.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "exec/exec-all.h"
+#include "sysemu/cpus.h"
+#include "tcg/tcg.h"
+#include "internal.h"
+#include "trace.h"
+
+/* Queued requests; older ones are overwritten when it is full */
+#define TB_SPEC_QUEUE   256
+/* TBs translated per BQL hold, bounding the delay seen by the vCPU */
+#define TB_SPEC_BATCH   8
+
+typedef struct TBSpecRequest {
+    CPUState *cpu;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TBSpecRequest;
+
+bool tb_spec_enabled;
+
+static QemuMutex tb_spec_exec_lock;
+
+/* Accessed with tb_spec_exec_lock held; tb_spec_count is also polled */
+static TBSpecRequest tb_spec_queue[TB_SPEC_QUEUE];
+static unsigned tb_spec_head, tb_spec_count;
+
+static QemuMutex tb_spec_lock;      /* protects tb_spec_idle */
+static QemuCond tb_spec_cond;
+static bool tb_spec_idle;
+
+static void tb_spec_push(CPUState *cpu, const TranslationBlock *tb,
+                         target_ulong pc)
+{
+    TBSpecRequest *r;
+
+    if (pc == (target_ulong)-1 || pc == tb->pc) {
+        return;
+    }
+    if (tb_spec_count == TB_SPEC_QUEUE) {
+        tb_spec_head = (tb_spec_head + 1) % TB_SPEC_QUEUE;
+        qatomic_set(&tb_spec_count, tb_spec_count - 1);
+    }
+    r = &tb_spec_queue[(tb_spec_head + tb_spec_count) % TB_SPEC_QUEUE];
+    r->cpu = cpu;
+    r->pc = pc;
+    r->cs_base = tb->cs_base;
+    r->flags = tb->flags;
+    r->cflags = tb->cflags;
+    qatomic_set(&tb_spec_count, tb_spec_count + 1);
+}
+
+/*
+ * Called by the vCPU, inside cpu_exec(), after translating @tb on a
+ * lookup miss
+ */
+void tb_spec_queue_exits(CPUState *cpu, const TranslationBlock *tb)
+{
+    if (tb->cflags & TB_CF_SKIP) {
+        return;
+    }
+    tb_spec_push(cpu, tb, tb->jmp_pc[0]);
+    tb_spec_push(cpu, tb, tb->jmp_pc[1]);
+    tb_spec_push(cpu, tb, tb->pc + tb->size);
+}
+
+/* Called by the vCPU thread, with the BQL, when it is about to sleep */
+void tb_spec_kick(void)
+{
+    if (!qatomic_read(&tb_spec_count)) {
+        return;
+    }
+    qemu_mutex_lock(&tb_spec_lock);
+    tb_spec_idle = true;
+    qemu_cond_signal(&tb_spec_cond);
+    qemu_mutex_unlock(&tb_spec_lock);
+}
+
+void tb_spec_exec_begin(void)
+{
+    qemu_mutex_lock(&tb_spec_exec_lock);
+}
+
+void tb_spec_exec_end(void)
+{
+    qemu_mutex_unlock(&tb_spec_exec_lock);
+}
+
+/* Called by the worker with tb_spec_exec_lock held */
+static bool tb_spec_pop(TBSpecRequest *r)
+{
+    if (!tb_spec_count) {
+        return false;
+    }
+    *r = tb_spec_queue[tb_spec_head];
+    tb_spec_head = (tb_spec_head + 1) % TB_SPEC_QUEUE;
+    qatomic_set(&tb_spec_count, tb_spec_count - 1);
+    return true;
+}
+
+/*
+ * Translate @r if the vCPU is still in the state the request was made
+ * in, so that the worker sees the guest memory the way the vCPU will.
+ */
+static void tb_spec_translate(const TBSpecRequest *r)
+{
+    CPUState *cpu = r->cpu;
+    CPUArchState *env = cpu->env_ptr;
+    int exception_index = cpu->exception_index;
+    target_ulong pc, cs_base;
+    uint32_t flags;
+    void *host;
+
+    if (cpu->singlestep_enabled || !QTAILQ_EMPTY(&cpu->breakpoints)) {
+        return;
+    }
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+    if (cs_base != r->cs_base || flags != r->flags ||
+        r->cflags != curr_cflags(cpu)) {
+        return;
+    }
+    /* Don't take the fault for a target that isn't mapped (yet) */
+    if (probe_access_flags(env, r->pc, MMU_INST_FETCH,
+                           cpu_mmu_index(env, true), true, &host, 0)
+        & (TLB_INVALID_MASK | TLB_MMIO)) {
+        return;
+    }
+
+    /*
+     * Translate as the vCPU, so that exclusive work such as tb_flush,
+     * which the vCPU thread runs without the BQL, waits for the
+     * translation to finish and the translation waits for it.
+     */
+    cpu_exec_start(cpu);
+
+    /*
+     * The tail of the TB may still fault, or the buffer may fill up and
+     * tb_gen_code exit to flush it; either way the request is dropped.
+     * The flush is queued as safe work for the vCPU thread, which runs
+     * it once cpu_exec_end has been called.  The vCPU sets up
+     * cpu->jmp_env again before it next executes.
+     */
+    if (sigsetjmp(cpu->jmp_env, 0) == 0) {
+        if (!tb_htable_lookup(cpu, r->pc, r->cs_base, r->flags, r->cflags)) {
+            tb_gen_code(cpu, r->pc, r->cs_base, r->flags, r->cflags);
+            trace_tb_spec_translate(r->pc);
+        }
+    }
+    cpu_exec_end(cpu);
+    cpu->exception_index = exception_index;
+}
+
+static void *tb_spec_thread_fn(void *arg)
+{
+    TBSpecRequest r;
+    int n;
+
+    rcu_register_thread();
+    tcg_register_thread();
+
+    for (;;) {
+        qemu_mutex_lock(&tb_spec_lock);
+        while (!tb_spec_idle) {
+            qemu_cond_wait(&tb_spec_cond, &tb_spec_lock);
+        }
+        tb_spec_idle = false;
+        qemu_mutex_unlock(&tb_spec_lock);
+
+        do {
+            qemu_mutex_lock(&tb_spec_exec_lock);
+            qemu_mutex_lock_iothread();
+            WITH_RCU_READ_LOCK_GUARD() {
+                for (n = 0; n < TB_SPEC_BATCH && all_cpu_threads_idle() &&
+                            tb_spec_pop(&r); n++) {
+                    tb_spec_translate(&r);
+                }
+            }
+            qemu_mutex_unlock_iothread();
+            qemu_mutex_unlock(&tb_spec_exec_lock);
+        } while (n == TB_SPEC_BATCH);
+    }
+    return NULL;
+}
+
+void tb_spec_init(void)
+{
+    static QemuThread thread;
+
+    qemu_mutex_init(&tb_spec_exec_lock);
+    qemu_mutex_init(&tb_spec_lock);
+    qemu_cond_init(&tb_spec_cond);
+    tb_spec_enabled = true;
+
+    qemu_thread_create(&thread, "TCG spec", tb_spec_thread_fn, NULL,
+                       QEMU_THREAD_DETACHED);
+}
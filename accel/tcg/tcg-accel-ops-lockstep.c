@@ -0,0 +1,300 @@
+/*
+ * QEMU TCG lockstep multi-threaded vCPUs implementation
+ *
+ * Each vCPU has its own thread, as with MTTCG, but with icount: it runs
+ * a quantum of lockstep-quantum instructions, then waits at a barrier
+ * until every other vCPU has run its own.  The last vCPU to arrive
+ * moves virtual time by the quantum, runs the QEMU_CLOCK_VIRTUAL timers
+ * and delivers the interrupts raised for other vCPUs during the
+ * quantum, in vCPU index order, before releasing the others.  A vCPU
+ * thus only sees events at quantum boundaries, whatever the speed of
+ * the host threads, except for races on guest memory within a quantum.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "sysemu/tcg.h"
+#include "sysemu/cpus.h"
+#include "sysemu/cpu-timers.h"
+#include "sysemu/runstate.h"
+#include "qemu/main-loop.h"
+#include "qemu/notify.h"
+#include "qemu/guest-random.h"
+#include "exec/exec-all.h"
+#include "hw/boards.h"
+
+#include "internal.h"
+#include "tcg-accel-ops.h"
+#include "tcg-accel-ops-icount.h"
+#include "tcg-accel-ops-lockstep.h"
+
+typedef struct LockstepForceRcuNotifier {
+    Notifier notifier;
+    CPUState *cpu;
+} LockstepForceRcuNotifier;
+
+uint32_t tcg_lockstep_quantum;
+
+/* Signalled at the end of each quantum, protected by the BQL */
+static QemuCond lockstep_cond;
+/* The end of the quantum may wait for I/O, dropping the BQL */
+static bool lockstep_ending;
+
+static void do_nothing(CPUState *cpu, run_on_cpu_data d)
+{
+}
+
+static void lockstep_force_rcu(Notifier *notify, void *data)
+{
+    CPUState *cpu = container_of(notify, LockstepForceRcuNotifier,
+                                 notifier)->cpu;
+
+    async_run_on_cpu(cpu, do_nothing, RUN_ON_CPU_NULL);
+}
+
+static void lockstep_deliver_interrupt(CPUState *cpu)
+{
+    int mask = cpu->lockstep_interrupt;
+
+    if (mask) {
+        cpu->lockstep_interrupt = 0;
+        tcg_handle_interrupt(cpu, mask);
+    }
+}
+
+void lockstep_handle_interrupt(CPUState *cpu, int mask)
+{
+    g_assert(qemu_mutex_iothread_locked());
+
+    /*
+     * A vCPU at the barrier only looks at its interrupts in the next
+     * quantum anyway, so only defer those for a vCPU that still runs.
+     */
+    if (qemu_cpu_is_self(cpu) || cpu->lockstep_arrived ||
+        !runstate_is_running()) {
+        icount_handle_interrupt(cpu, mask);
+    } else {
+        cpu->lockstep_interrupt |= mask;
+    }
+}
+
+/* Nothing is left pending in the state that a stopped VM may save */
+static void lockstep_vm_state_change(void *opaque, bool running,
+                                     RunState state)
+{
+    CPUState *cpu;
+
+    if (!running) {
+        CPU_FOREACH(cpu) {
+            lockstep_deliver_interrupt(cpu);
+        }
+    }
+}
+
+/* Called by the last vCPU to arrive, with the BQL */
+static void lockstep_end_quantum(void)
+{
+    int64_t insns = tcg_lockstep_quantum;
+    bool idle = true;
+    CPUState *cpu;
+
+    lockstep_ending = true;
+    CPU_FOREACH(cpu) {
+        if (!cpu_thread_is_idle(cpu) || cpu->lockstep_interrupt) {
+            idle = false;
+        }
+    }
+
+    /*
+     * With every vCPU halted, nothing can happen before the next timer
+     * but for I/O from the main loop: skip to the timer.
+     */
+    if (idle) {
+        int64_t deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                                      QEMU_TIMER_ATTR_ALL);
+        if (deadline < 0) {
+            qemu_cond_timedwait_iothread(&lockstep_cond, 1);
+        } else {
+            insns = MAX(insns, ROUND_UP(icount_round(deadline),
+                                        tcg_lockstep_quantum));
+        }
+    }
+
+    icount_lockstep_advance(insns);
+    qemu_clock_notify(QEMU_CLOCK_VIRTUAL);
+    qemu_clock_run_timers(QEMU_CLOCK_VIRTUAL);
+
+    CPU_FOREACH(cpu) {
+        cpu->lockstep_done = 0;
+        cpu->lockstep_arrived = false;
+        lockstep_deliver_interrupt(cpu);
+    }
+    lockstep_ending = false;
+    qemu_cond_broadcast(&lockstep_cond);
+}
+
+static void lockstep_check_barrier(void)
+{
+    CPUState *cpu;
+
+    if (lockstep_ending) {
+        return;
+    }
+    CPU_FOREACH(cpu) {
+        if (!cpu->lockstep_arrived && !cpu->unplug) {
+            return;
+        }
+    }
+    lockstep_end_quantum();
+}
+
+static void lockstep_arrive(CPUState *cpu)
+{
+    cpu->lockstep_arrived = true;
+    lockstep_check_barrier();
+}
+
+static void lockstep_wait(CPUState *cpu)
+{
+    while (cpu->lockstep_arrived && !cpu->stop && cpu_work_list_empty(cpu)) {
+        qemu_cond_wait_iothread(&lockstep_cond);
+    }
+    qemu_wait_io_event_common(cpu);
+}
+
+/* Run at most @budget instructions, as icount_prepare_for_run() does */
+static int lockstep_cpu_exec(CPUState *cpu, int64_t budget, bool atomic)
+{
+    int insns_left = MIN(0xffff, budget);
+    int r = 0;
+
+    g_assert(cpu_neg(cpu)->icount_decr.u16.low == 0);
+    g_assert(cpu->icount_extra == 0);
+
+    cpu->icount_budget = budget;
+    cpu_neg(cpu)->icount_decr.u16.low = insns_left;
+    cpu->icount_extra = budget - insns_left;
+
+    qemu_mutex_unlock_iothread();
+    if (atomic) {
+        cpu_exec_step_atomic(cpu);
+    } else {
+        r = tcg_cpus_exec(cpu);
+    }
+    qemu_mutex_lock_iothread();
+
+    /* Adds to cpu->lockstep_done */
+    icount_update(cpu);
+    cpu_neg(cpu)->icount_decr.u16.low = 0;
+    cpu->icount_extra = 0;
+    cpu->icount_budget = 0;
+
+    return r;
+}
+
+static void *lockstep_cpu_thread_fn(void *arg)
+{
+    LockstepForceRcuNotifier force_rcu;
+    CPUState *cpu = arg;
+
+    assert(tcg_enabled());
+    g_assert(icount_lockstep);
+
+    rcu_register_thread();
+    force_rcu.notifier.notify = lockstep_force_rcu;
+    force_rcu.cpu = cpu;
+    rcu_add_force_rcu_notifier(&force_rcu.notifier);
+    tcg_register_thread();
+
+    qemu_mutex_lock_iothread();
+    qemu_thread_get_self(cpu->thread);
+
+    cpu->thread_id = qemu_get_thread_id();
+    cpu->can_do_io = 1;
+    current_cpu = cpu;
+    cpu_thread_signal_created(cpu);
+    qemu_guest_random_seed_thread_part2(cpu->random_seed);
+
+    /* process any pending work */
+    cpu->exit_request = 1;
+
+    do {
+        if (cpu_can_run(cpu) && !cpu->lockstep_arrived) {
+            int r = lockstep_cpu_exec(cpu, tcg_lockstep_quantum -
+                                      cpu->lockstep_done, false);
+
+            switch (r) {
+            case EXCP_DEBUG:
+                cpu_handle_guest_debug(cpu);
+                break;
+            case EXCP_HALTED:
+                g_assert(cpu->halted);
+                break;
+            case EXCP_ATOMIC:
+                lockstep_cpu_exec(cpu, 1, true);
+                break;
+            default:
+                break;
+            }
+
+            /* A halted vCPU waits for its interrupt at the barrier */
+            if (cpu->halted || cpu->lockstep_done >= tcg_lockstep_quantum) {
+                lockstep_arrive(cpu);
+            }
+        }
+
+        qatomic_mb_set(&cpu->exit_request, 0);
+        if (cpu->lockstep_arrived) {
+            lockstep_wait(cpu);
+        } else {
+            qemu_wait_io_event(cpu);
+        }
+    } while (!cpu->unplug || cpu_can_run(cpu));
+
+    /* The others no longer wait for this vCPU */
+    lockstep_check_barrier();
+
+    tcg_cpus_destroy(cpu);
+    qemu_mutex_unlock_iothread();
+    rcu_remove_force_rcu_notifier(&force_rcu.notifier);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+void lockstep_kick_vcpu_thread(CPUState *cpu)
+{
+    cpu_exit(cpu);
+    qemu_cond_broadcast(&lockstep_cond);
+}
+
+void lockstep_start_vcpu_thread(CPUState *cpu)
+{
+    char thread_name[VCPU_THREAD_NAME_SIZE];
+    static bool initialized;
+
+    g_assert(tcg_enabled());
+    tcg_cpu_init_cflags(cpu, current_machine->smp.max_cpus > 1);
+
+    if (!initialized) {
+        qemu_cond_init(&lockstep_cond);
+        qemu_add_vm_change_state_handler(lockstep_vm_state_change, NULL);
+        initialized = true;
+    }
+
+    cpu->thread = g_malloc0(sizeof(QemuThread));
+    cpu->halt_cond = g_malloc0(sizeof(QemuCond));
+    qemu_cond_init(cpu->halt_cond);
+
+    snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
+             cpu->cpu_index);
+
+    qemu_thread_create(cpu->thread, thread_name, lockstep_cpu_thread_fn,
+                       cpu, QEMU_THREAD_JOINABLE);
+
+#ifdef _WIN32
+    cpu->hThread = qemu_thread_get_handle(cpu->thread);
+#endif
+}
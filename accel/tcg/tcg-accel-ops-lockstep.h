@@ -0,0 +1,20 @@
+/*
+ * QEMU TCG lockstep multi-threaded vCPUs implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef TCG_CPUS_LOCKSTEP_H
+#define TCG_CPUS_LOCKSTEP_H
+
+/* kick lockstep vCPU thread */
+void lockstep_kick_vcpu_thread(CPUState *cpu);
+
+/* start a lockstep vCPU thread */
+void lockstep_start_vcpu_thread(CPUState *cpu);
+
+/* raise an interrupt, deferred to the barrier if another vCPU is running */
+void lockstep_handle_interrupt(CPUState *cpu, int mask);
+
+#endif /* TCG_CPUS_LOCKSTEP_H */
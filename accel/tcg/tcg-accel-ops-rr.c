@@ -31,7 +31,9 @@
 #include "qemu/notify.h"
 #include "qemu/guest-random.h"
 #include "exec/exec-all.h"
+#include "sysemu/cpus.h"
 
+#include "internal.h"
 #include "tcg-accel-ops.h"
 #include "tcg-accel-ops-rr.h"
 #include "tcg-accel-ops-icount.h"
@@ -61,6 +63,25 @@ void rr_kick_vcpu_thread(CPUState *unused)
 static QEMUTimer *rr_kick_vcpu_timer;
 static CPUState *rr_current_cpu;
 
+/*
+ * Adaptive time slices
+ *
+ * With rr-adaptive, each vCPU has a slice of its own and the kick
+ * timer is rearmed whenever another vCPU gets to run.  A vCPU whose
+ * slice runs out with its PC close to where the previous one ran out
+ * is most likely polling a device or another core, so its slice is
+ * halved, down to RR_MIN_SLICE; one that ran out anywhere else is
+ * doing useful work and gets its slice doubled again, up to
+ * TCG_KICK_PERIOD.  Halted vCPUs with nothing to do are skipped
+ * instead of being entered just to return at once.
+ */
+#define RR_MIN_SLICE        (TCG_KICK_PERIOD / 32)
+#define RR_IDLE_LOOP_BYTES  64
+
+bool tcg_rr_adaptive;
+static CPUState *rr_slice_cpu;
+static bool rr_slice_expired;
+
 static inline int64_t rr_next_kick_time(void)
 {
     return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + TCG_KICK_PERIOD;
@@ -81,9 +102,42 @@ static void rr_kick_next_cpu(void)
 static void rr_kick_thread(void *opaque)
 {
     timer_mod(rr_kick_vcpu_timer, rr_next_kick_time());
+    qatomic_set(&rr_slice_expired, true);
     rr_kick_next_cpu();
 }
 
+/* Give @cpu its own slice, unless it is still running the current one */
+static void rr_start_slice(CPUState *cpu)
+{
+    if (!cpu->rr_slice || cpu == rr_slice_cpu || !rr_kick_vcpu_timer) {
+        return;
+    }
+    rr_slice_cpu = cpu;
+    qatomic_set(&rr_slice_expired, false);
+    timer_mod(rr_kick_vcpu_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + cpu->rr_slice);
+}
+
+/* Resize the slice of @cpu after tcg_cpus_exec() returned @r */
+static void rr_end_slice(CPUState *cpu, int r)
+{
+    vaddr dist;
+
+    if (!cpu->rr_slice || r != EXCP_INTERRUPT ||
+        !qatomic_xchg(&rr_slice_expired, false)) {
+        return;
+    }
+
+    dist = MAX(cpu->rr_exit_pc, cpu->rr_expired_pc) -
+           MIN(cpu->rr_exit_pc, cpu->rr_expired_pc);
+    if (dist < RR_IDLE_LOOP_BYTES) {
+        cpu->rr_slice = MAX(cpu->rr_slice / 2, RR_MIN_SLICE);
+    } else {
+        cpu->rr_slice = MIN(cpu->rr_slice * 2, TCG_KICK_PERIOD);
+    }
+    cpu->rr_expired_pc = cpu->rr_exit_pc;
+}
+
 static void rr_start_kick_timer(void)
 {
     if (!rr_kick_vcpu_timer && CPU_NEXT(first_cpu)) {
@@ -108,6 +162,9 @@ static void rr_wait_io_event(void)
 
     while (all_cpu_threads_idle()) {
         rr_stop_kick_timer();
+        if (tb_spec_enabled) {
+            tb_spec_kick();
+        }
         qemu_cond_wait_iothread(first_cpu->halt_cond);
     }
 
@@ -207,6 +264,11 @@ static void *rr_cpu_thread_fn(void *arg)
 
         while (cpu && cpu_work_list_empty(cpu) && !cpu->exit_request) {
 
+            if (cpu->rr_slice && cpu_thread_is_idle(cpu)) {
+                cpu = CPU_NEXT(cpu);
+                continue;
+            }
+
             qatomic_mb_set(&rr_current_cpu, cpu);
             current_cpu = cpu;
 
@@ -220,11 +282,13 @@ static void *rr_cpu_thread_fn(void *arg)
                 if (icount_enabled()) {
                     icount_prepare_for_run(cpu);
                 }
+                rr_start_slice(cpu);
                 r = tcg_cpus_exec(cpu);
                 if (icount_enabled()) {
                     icount_process_data(cpu);
                 }
                 qemu_mutex_lock_iothread();
+                rr_end_slice(cpu, r);
 
                 if (r == EXCP_DEBUG) {
                     cpu_handle_guest_debug(cpu);
@@ -277,6 +341,7 @@ void rr_start_vcpu_thread(CPUState *cpu)
 
     g_assert(tcg_enabled());
     tcg_cpu_init_cflags(cpu, false);
+    cpu->rr_slice = tcg_rr_adaptive ? TCG_KICK_PERIOD : 0;
 
     if (!single_tcg_cpu_thread) {
         cpu->thread = g_malloc0(sizeof(QemuThread));
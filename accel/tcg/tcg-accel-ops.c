@@ -1,7 +1,8 @@
 /*
  * QEMU TCG vCPU common functionality
  *
- * Functionality common to all TCG vCPU variants: mttcg, rr and icount.
+ * Functionality common to all TCG vCPU variants: mttcg, lockstep, rr and
+ * icount.
  *
  * Copyright (c) 2003-2008 Fabrice Bellard
  * Copyright (c) 2014 Red Hat Inc.
@@ -33,8 +34,10 @@
 #include "qemu/guest-random.h"
 #include "exec/exec-all.h"
 
+#include "internal.h"
 #include "tcg-accel-ops.h"
 #include "tcg-accel-ops-mttcg.h"
+#include "tcg-accel-ops-lockstep.h"
 #include "tcg-accel-ops-rr.h"
 #include "tcg-accel-ops-icount.h"
 
@@ -63,9 +66,15 @@ int tcg_cpus_exec(CPUState *cpu)
 #ifdef CONFIG_PROFILER
     ti = profile_getclock();
 #endif
+    if (tb_spec_enabled) {
+        tb_spec_exec_begin();
+    }
     cpu_exec_start(cpu);
     ret = cpu_exec(cpu);
     cpu_exec_end(cpu);
+    if (tb_spec_enabled) {
+        tb_spec_exec_end();
+    }
 #ifdef CONFIG_PROFILER
     qatomic_set(&tcg_ctx->prof.cpu_exec_time,
                 tcg_ctx->prof.cpu_exec_time + profile_getclock() - ti);
@@ -93,7 +102,14 @@ void tcg_handle_interrupt(CPUState *cpu, int mask)
 
 static void tcg_accel_ops_init(AccelOpsClass *ops)
 {
-    if (qemu_tcg_mttcg_enabled()) {
+    if (tcg_lockstep_quantum) {
+        icount_lockstep = true;
+        ops->create_vcpu_thread = lockstep_start_vcpu_thread;
+        ops->kick_vcpu_thread = lockstep_kick_vcpu_thread;
+        ops->handle_interrupt = lockstep_handle_interrupt;
+        ops->get_virtual_clock = icount_get;
+        ops->get_elapsed_ticks = icount_get;
+    } else if (qemu_tcg_mttcg_enabled()) {
         ops->create_vcpu_thread = mttcg_start_vcpu_thread;
         ops->kick_vcpu_thread = mttcg_kick_vcpu_thread;
         ops->handle_interrupt = tcg_handle_interrupt;
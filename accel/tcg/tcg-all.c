@@ -27,13 +27,16 @@
 #include "qemu-common.h"
 #include "sysemu/tcg.h"
 #include "sysemu/cpu-timers.h"
+#include "sysemu/replay.h"
 #include "tcg/tcg.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "qemu/accel.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "qemu/units.h"
+#include "exec/perf-map.h"
 #if !defined(CONFIG_USER_ONLY)
+#include "exec/ram_addr.h"
 #include "hw/boards.h"
 #endif
 #include "internal.h"
@@ -44,6 +47,21 @@ struct TCGState {
     bool mttcg_enabled;
     int splitwx_enabled;
     unsigned long tb_size;
+    bool chain_stats;
+    bool perf_map;
+    bool jitdump;
+    bool keep_globals;
+    uint32_t superblock_threshold;
+    char *tb_cache;
+    bool spec_translate;
+    char *tlb_resize;
+    uint32_t victim_tlb;
+    char *coverage;
+    uint32_t coverage_bits;
+    uint32_t lockstep_quantum;
+    bool rr_adaptive;
+    uint32_t zero_reclaim;
+    int32_t code_numa_node;
 };
 typedef struct TCGState TCGState;
 
@@ -106,25 +124,83 @@ static void tcg_accel_instance_init(Object *obj)
 #else
     s->splitwx_enabled = 0;
 #endif
+    s->coverage_bits = 65536;
+    s->keep_globals = true;
+    s->code_numa_node = -1;
 }
 
 bool mttcg_enabled;
+bool tb_chain_stats;
+uint32_t tb_superblock_threshold;
 
 static int tcg_init_machine(MachineState *ms)
 {
     TCGState *s = TCG_STATE(current_accel());
+    size_t tb_size = s->tb_size * MiB;
 #ifdef CONFIG_USER_ONLY
-    unsigned max_cpus = 1;
+    unsigned max_threads = 1;
 #else
-    unsigned max_cpus = ms->smp.max_cpus;
+    unsigned max_threads = s->mttcg_enabled ? ms->smp.max_cpus : 1;
 #endif
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_chain_stats = s->chain_stats;
+    tb_superblock_threshold = s->superblock_threshold;
+    tcg_keep_globals = s->keep_globals;
+
+    if (mttcg_enabled && icount_enabled() && !s->lockstep_quantum) {
+        error_report("No MTTCG when icount is enabled");
+        return -EINVAL;
+    }
+
+#ifndef CONFIG_USER_ONLY
+    if (ms->small_footprint) {
+        /*
+         * Little guest RAM means little guest code: an eighth of it is
+         * plenty of room for the translations.
+         */
+        if (!tb_size) {
+            tb_size = MAX(ms->ram_size / 8, 4 * MiB);
+        }
+        tlb_set_small_footprint(ms->ram_size);
+    }
+    if (s->lockstep_quantum) {
+        if (!mttcg_enabled || icount_enabled() != 1 ||
+            replay_mode != REPLAY_MODE_NONE) {
+            error_report("lockstep-quantum requires thread=multi and "
+                         "icount with a fixed shift, without record/replay");
+            return -EINVAL;
+        }
+        tcg_lockstep_quantum = s->lockstep_quantum;
+    }
+    if (s->rr_adaptive && (mttcg_enabled || icount_enabled())) {
+        warn_report("rr-adaptive requires thread=single without icount, "
+                    "ignoring it");
+        s->rr_adaptive = false;
+    }
+    tcg_rr_adaptive = s->rr_adaptive;
+    if (s->spec_translate && mttcg_enabled) {
+        warn_report("spec-translate requires thread=single, ignoring it");
+        s->spec_translate = false;
+    }
+    if (s->spec_translate) {
+        /* The worker has a TCGContext of its own */
+        max_threads++;
+    }
+#endif
+
+    if (s->perf_map) {
+        perf_map_enable();
+    }
+    if (s->jitdump) {
+        perf_jitdump_enable();
+    }
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+    tcg_region_set_numa_node(s->code_numa_node);
+    tcg_init(tb_size, s->splitwx_enabled, max_threads);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -132,6 +208,19 @@ static int tcg_init_machine(MachineState *ms)
      * initialize the prologue now.
      */
     tcg_prologue_init(tcg_ctx);
+
+    if (s->tb_cache) {
+        tb_cache_init(s->tb_cache);
+    }
+    if (s->spec_translate) {
+        tb_spec_init();
+    }
+    if (s->coverage) {
+        tb_coverage_init(s->coverage, s->coverage_bits, &error_fatal);
+    }
+    if (s->zero_reclaim) {
+        ram_zero_reclaim_start(s->zero_reclaim);
+    }
 #endif
 
     return 0;
@@ -151,8 +240,6 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
     if (strcmp(value, "multi") == 0) {
         if (TCG_OVERSIZED_GUEST) {
             error_setg(errp, "No MTTCG when guest word size > hosts");
-        } else if (icount_enabled()) {
-            error_setg(errp, "No MTTCG when icount is enabled");
         } else {
 #ifndef TARGET_SUPPORTS_MTTCG
             warn_report("Guest not yet converted to MTTCG - "
@@ -196,6 +283,29 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_superblock_threshold(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->superblock_threshold, errp);
+}
+
+static void tcg_set_superblock_threshold(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->superblock_threshold = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -208,6 +318,270 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+#ifndef CONFIG_USER_ONLY
+static char *tcg_get_code_hugepages(Object *obj, Error **errp)
+{
+    return g_strdup(tcg_region_get_hugepages());
+}
+
+static void tcg_set_code_hugepages(Object *obj, const char *value,
+                                   Error **errp)
+{
+    if (!tcg_region_set_hugepages(value)) {
+        error_setg(errp, "Invalid 'code-hugepages' value '%s' "
+                   "(off, thp or hugetlb)", value);
+    }
+}
+
+static void tcg_get_code_numa_node(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_int32(v, name, &s->code_numa_node, errp);
+}
+
+static void tcg_set_code_numa_node(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    int32_t value;
+
+    if (!visit_type_int32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < -1) {
+        error_setg(errp, "Invalid 'code-numa-node' value %" PRId32, value);
+        return;
+    }
+    s->code_numa_node = value;
+}
+
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+
+static char *tcg_get_tlb_resize(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tlb_resize ? s->tlb_resize : "dynamic");
+}
+
+static void tcg_set_tlb_resize(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    if (!tlb_set_resize_policy(value)) {
+        error_setg(errp, "Invalid 'tlb-resize' value '%s' "
+                   "(dynamic, grow-only or fixed)", value);
+        return;
+    }
+    g_free(s->tlb_resize);
+    s->tlb_resize = g_strdup(value);
+}
+
+static void tcg_get_victim_tlb(Object *obj, Visitor *v, const char *name,
+                               void *opaque, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->victim_tlb ? s->victim_tlb : CPU_VTLB_SIZE;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_victim_tlb(Object *obj, Visitor *v, const char *name,
+                               void *opaque, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!tlb_set_victim_size(value)) {
+        error_setg(errp, "Invalid 'victim-tlb' value %" PRIu32 ": must be "
+                   "a power of 2 between %d and %d", value, CPU_VTLB_WAYS,
+                   CPU_VTLB_MAX_SIZE);
+        return;
+    }
+    s->victim_tlb = value;
+}
+
+static char *tcg_get_coverage(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->coverage);
+}
+
+static void tcg_set_coverage(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->coverage);
+    s->coverage = g_strdup(value);
+}
+
+static void tcg_get_coverage_bits(Object *obj, Visitor *v, const char *name,
+                                  void *opaque, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->coverage_bits, errp);
+}
+
+static void tcg_set_coverage_bits(Object *obj, Visitor *v, const char *name,
+                                  void *opaque, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (!is_power_of_2(value) || value < 8) {
+        error_setg(errp, "Invalid 'coverage-bits' value %" PRIu32 ": must be "
+                   "a power of 2, at least 8", value);
+        return;
+    }
+    s->coverage_bits = value;
+}
+
+static void tcg_get_lockstep_quantum(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->lockstep_quantum, errp);
+}
+
+static void tcg_set_lockstep_quantum(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->lockstep_quantum = value;
+}
+
+static void tcg_get_zero_reclaim(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    visit_type_uint32(v, name, &s->zero_reclaim, errp);
+}
+
+static void tcg_set_zero_reclaim(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    s->zero_reclaim = value;
+}
+
+static bool tcg_get_spec_translate(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->spec_translate;
+}
+
+static void tcg_set_spec_translate(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->spec_translate = value;
+}
+
+static bool tcg_get_rr_adaptive(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return s->rr_adaptive;
+}
+
+static void tcg_set_rr_adaptive(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    s->rr_adaptive = value;
+}
+#endif
+
+static bool tcg_get_chain_stats(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->chain_stats;
+}
+
+static void tcg_set_chain_stats(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->chain_stats = value;
+}
+
+static bool tcg_get_keep_globals(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->keep_globals;
+}
+
+static void tcg_set_keep_globals(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->keep_globals = value;
+}
+
+static bool tcg_get_perf_map(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->perf_map;
+}
+
+static void tcg_set_perf_map(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->perf_map = value;
+}
+
+static bool tcg_get_jitdump(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->jitdump;
+}
+
+static void tcg_set_jitdump(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->jitdump = value;
+}
+
 static void tcg_accel_class_init(ObjectClass *oc, void *data)
 {
     AccelClass *ac = ACCEL_CLASS(oc);
@@ -225,10 +599,102 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add_str(oc, "code-hugepages",
+        tcg_get_code_hugepages, tcg_set_code_hugepages);
+    object_class_property_set_description(oc, "code-hugepages",
+        "Host pages backing the TCG translation block cache "
+        "(off, thp, hugetlb)");
+
+    object_class_property_add(oc, "code-numa-node", "int32",
+        tcg_get_code_numa_node, tcg_set_code_numa_node,
+        NULL, NULL);
+    object_class_property_set_description(oc, "code-numa-node",
+        "Host NUMA node for the TCG translation block cache (-1 = any)");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
+
+    object_class_property_add_bool(oc, "chain-stats",
+        tcg_get_chain_stats, tcg_set_chain_stats);
+    object_class_property_set_description(oc, "chain-stats",
+        "Count the TB exits that are not chained (see info tb-chains)");
+
+    object_class_property_add_bool(oc, "perf-map",
+        tcg_get_perf_map, tcg_set_perf_map);
+    object_class_property_set_description(oc, "perf-map",
+        "Describe the translated code in /tmp/perf-PID.map");
+
+    object_class_property_add_bool(oc, "jitdump",
+        tcg_get_jitdump, tcg_set_jitdump);
+    object_class_property_set_description(oc, "jitdump",
+        "Record the translated code in /tmp/jit-PID.dump for perf inject");
+
+    object_class_property_add_bool(oc, "keep-globals",
+        tcg_get_keep_globals, tcg_set_keep_globals);
+    object_class_property_set_description(oc, "keep-globals",
+        "Keep TCG globals in host registers across forward branches");
+
+    object_class_property_add(oc, "superblock-threshold", "uint32",
+        tcg_get_superblock_threshold, tcg_set_superblock_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "superblock-threshold",
+        "Retranslate a TB as a superblock after this many lookups "
+        "(0 = never)");
+
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add_str(oc, "tb-cache",
+        tcg_get_tb_cache, tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File that remembers translated blocks across runs");
+
+    object_class_property_add_bool(oc, "spec-translate",
+        tcg_get_spec_translate, tcg_set_spec_translate);
+    object_class_property_set_description(oc, "spec-translate",
+        "Translate branch targets ahead of time in a background thread");
+
+    object_class_property_add_bool(oc, "rr-adaptive",
+        tcg_get_rr_adaptive, tcg_set_rr_adaptive);
+    object_class_property_set_description(oc, "rr-adaptive",
+        "Skip idle vCPUs and shorten the time slices of polling ones");
+
+    object_class_property_add_str(oc, "tlb-resize",
+        tcg_get_tlb_resize, tcg_set_tlb_resize);
+    object_class_property_set_description(oc, "tlb-resize",
+        "Softmmu TLB resize policy (dynamic, grow-only, fixed)");
+
+    object_class_property_add(oc, "victim-tlb", "uint32",
+        tcg_get_victim_tlb, tcg_set_victim_tlb,
+        NULL, NULL);
+    object_class_property_set_description(oc, "victim-tlb",
+        "Number of entries of the softmmu victim TLB, per MMU index");
+
+    object_class_property_add_str(oc, "coverage",
+        tcg_get_coverage, tcg_set_coverage);
+    object_class_property_set_description(oc, "coverage",
+        "File to map the guest block coverage bitmap from");
+
+    object_class_property_add(oc, "coverage-bits", "uint32",
+        tcg_get_coverage_bits, tcg_set_coverage_bits,
+        NULL, NULL);
+    object_class_property_set_description(oc, "coverage-bits",
+        "Size of the guest block coverage bitmap, in bits");
+
+    object_class_property_add(oc, "lockstep-quantum", "uint32",
+        tcg_get_lockstep_quantum, tcg_set_lockstep_quantum,
+        NULL, NULL);
+    object_class_property_set_description(oc, "lockstep-quantum",
+        "Run the MTTCG vCPUs with icount, synchronized every this many "
+        "instructions (0 = off)");
+
+    object_class_property_add(oc, "zero-reclaim", "uint32",
+        tcg_get_zero_reclaim, tcg_set_zero_reclaim,
+        NULL, NULL);
+    object_class_property_set_description(oc, "zero-reclaim",
+        "Discard the zeroed guest pages every this many milliseconds "
+        "(0 = off)");
+#endif
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -22,6 +22,7 @@
 #include "cpu.h"
 #include "exec/helper-proto.h"
 #include "tcg/tcg-gvec-desc.h"
+#include "tcg-runtime-gvec-host.c.inc"
 
 
 static inline void clear_high(void *d, intptr_t oprsz, uint32_t desc)
@@ -769,7 +770,8 @@ void HELPER(gvec_shl8v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
+    for (i = HOST_GVEC_OP(gvec_shl8v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint8_t)) {
         uint8_t sh = *(uint8_t *)(b + i) & 7;
         *(uint8_t *)(d + i) = *(uint8_t *)(a + i) << sh;
     }
@@ -781,7 +783,8 @@ void HELPER(gvec_shl16v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
+    for (i = HOST_GVEC_OP(gvec_shl16v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint16_t)) {
         uint8_t sh = *(uint16_t *)(b + i) & 15;
         *(uint16_t *)(d + i) = *(uint16_t *)(a + i) << sh;
     }
@@ -793,7 +796,8 @@ void HELPER(gvec_shl32v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+    for (i = HOST_GVEC_OP(gvec_shl32v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint32_t)) {
         uint8_t sh = *(uint32_t *)(b + i) & 31;
         *(uint32_t *)(d + i) = *(uint32_t *)(a + i) << sh;
     }
@@ -805,7 +809,8 @@ void HELPER(gvec_shl64v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (i = HOST_GVEC_OP(gvec_shl64v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint64_t)) {
         uint8_t sh = *(uint64_t *)(b + i) & 63;
         *(uint64_t *)(d + i) = *(uint64_t *)(a + i) << sh;
     }
@@ -817,7 +822,8 @@ void HELPER(gvec_shr8v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
+    for (i = HOST_GVEC_OP(gvec_shr8v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint8_t)) {
         uint8_t sh = *(uint8_t *)(b + i) & 7;
         *(uint8_t *)(d + i) = *(uint8_t *)(a + i) >> sh;
     }
@@ -829,7 +835,8 @@ void HELPER(gvec_shr16v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
+    for (i = HOST_GVEC_OP(gvec_shr16v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint16_t)) {
         uint8_t sh = *(uint16_t *)(b + i) & 15;
         *(uint16_t *)(d + i) = *(uint16_t *)(a + i) >> sh;
     }
@@ -841,7 +848,8 @@ void HELPER(gvec_shr32v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+    for (i = HOST_GVEC_OP(gvec_shr32v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint32_t)) {
         uint8_t sh = *(uint32_t *)(b + i) & 31;
         *(uint32_t *)(d + i) = *(uint32_t *)(a + i) >> sh;
     }
@@ -853,7 +861,8 @@ void HELPER(gvec_shr64v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (i = HOST_GVEC_OP(gvec_shr64v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint64_t)) {
         uint8_t sh = *(uint64_t *)(b + i) & 63;
         *(uint64_t *)(d + i) = *(uint64_t *)(a + i) >> sh;
     }
@@ -865,7 +874,8 @@ void HELPER(gvec_sar8v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int8_t)) {
+    for (i = HOST_GVEC_OP(gvec_sar8v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int8_t)) {
         uint8_t sh = *(uint8_t *)(b + i) & 7;
         *(int8_t *)(d + i) = *(int8_t *)(a + i) >> sh;
     }
@@ -877,7 +887,8 @@ void HELPER(gvec_sar16v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int16_t)) {
+    for (i = HOST_GVEC_OP(gvec_sar16v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int16_t)) {
         uint8_t sh = *(uint16_t *)(b + i) & 15;
         *(int16_t *)(d + i) = *(int16_t *)(a + i) >> sh;
     }
@@ -889,7 +900,8 @@ void HELPER(gvec_sar32v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
+    for (i = HOST_GVEC_OP(gvec_sar32v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int32_t)) {
         uint8_t sh = *(uint32_t *)(b + i) & 31;
         *(int32_t *)(d + i) = *(int32_t *)(a + i) >> sh;
     }
@@ -901,7 +913,8 @@ void HELPER(gvec_sar64v)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
+    for (i = HOST_GVEC_OP(gvec_sar64v, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int64_t)) {
         uint8_t sh = *(uint64_t *)(b + i) & 63;
         *(int64_t *)(d + i) = *(int64_t *)(a + i) >> sh;
     }
@@ -1009,7 +1022,8 @@ void HELPER(NAME)(void *d, void *a, void *b, uint32_t desc)                \
 {                                                                          \
     intptr_t oprsz = simd_oprsz(desc);                                     \
     intptr_t i;                                                            \
-    for (i = 0; i < oprsz; i += sizeof(TYPE)) {                            \
+    for (i = HOST_GVEC_OP(NAME, d, a, b, oprsz); i < oprsz;               \
+         i += sizeof(TYPE)) {                                              \
         *(TYPE *)(d + i) = -(*(TYPE *)(a + i) OP *(TYPE *)(b + i));        \
     }                                                                      \
     clear_high(d, oprsz, desc);                                            \
@@ -1036,7 +1050,8 @@ void HELPER(gvec_ssadd8)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int8_t)) {
+    for (i = HOST_GVEC_OP(gvec_ssadd8, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int8_t)) {
         int r = *(int8_t *)(a + i) + *(int8_t *)(b + i);
         if (r > INT8_MAX) {
             r = INT8_MAX;
@@ -1053,7 +1068,8 @@ void HELPER(gvec_ssadd16)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int16_t)) {
+    for (i = HOST_GVEC_OP(gvec_ssadd16, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int16_t)) {
         int r = *(int16_t *)(a + i) + *(int16_t *)(b + i);
         if (r > INT16_MAX) {
             r = INT16_MAX;
@@ -1070,7 +1086,8 @@ void HELPER(gvec_ssadd32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
+    for (i = HOST_GVEC_OP(gvec_ssadd32, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int32_t)) {
         int32_t ai = *(int32_t *)(a + i);
         int32_t bi = *(int32_t *)(b + i);
         int32_t di;
@@ -1087,7 +1104,8 @@ void HELPER(gvec_ssadd64)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
+    for (i = HOST_GVEC_OP(gvec_ssadd64, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int64_t)) {
         int64_t ai = *(int64_t *)(a + i);
         int64_t bi = *(int64_t *)(b + i);
         int64_t di;
@@ -1104,7 +1122,8 @@ void HELPER(gvec_sssub8)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
+    for (i = HOST_GVEC_OP(gvec_sssub8, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint8_t)) {
         int r = *(int8_t *)(a + i) - *(int8_t *)(b + i);
         if (r > INT8_MAX) {
             r = INT8_MAX;
@@ -1121,7 +1140,8 @@ void HELPER(gvec_sssub16)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int16_t)) {
+    for (i = HOST_GVEC_OP(gvec_sssub16, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int16_t)) {
         int r = *(int16_t *)(a + i) - *(int16_t *)(b + i);
         if (r > INT16_MAX) {
             r = INT16_MAX;
@@ -1138,7 +1158,8 @@ void HELPER(gvec_sssub32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int32_t)) {
+    for (i = HOST_GVEC_OP(gvec_sssub32, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int32_t)) {
         int32_t ai = *(int32_t *)(a + i);
         int32_t bi = *(int32_t *)(b + i);
         int32_t di;
@@ -1155,7 +1176,8 @@ void HELPER(gvec_sssub64)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(int64_t)) {
+    for (i = HOST_GVEC_OP(gvec_sssub64, d, a, b, oprsz);
+         i < oprsz; i += sizeof(int64_t)) {
         int64_t ai = *(int64_t *)(a + i);
         int64_t bi = *(int64_t *)(b + i);
         int64_t di;
@@ -1172,7 +1194,8 @@ void HELPER(gvec_usadd8)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
+    for (i = HOST_GVEC_OP(gvec_usadd8, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint8_t)) {
         unsigned r = *(uint8_t *)(a + i) + *(uint8_t *)(b + i);
         if (r > UINT8_MAX) {
             r = UINT8_MAX;
@@ -1187,7 +1210,8 @@ void HELPER(gvec_usadd16)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
+    for (i = HOST_GVEC_OP(gvec_usadd16, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint16_t)) {
         unsigned r = *(uint16_t *)(a + i) + *(uint16_t *)(b + i);
         if (r > UINT16_MAX) {
             r = UINT16_MAX;
@@ -1202,7 +1226,8 @@ void HELPER(gvec_usadd32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+    for (i = HOST_GVEC_OP(gvec_usadd32, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint32_t)) {
         uint32_t ai = *(uint32_t *)(a + i);
         uint32_t bi = *(uint32_t *)(b + i);
         uint32_t di;
@@ -1219,7 +1244,8 @@ void HELPER(gvec_usadd64)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (i = HOST_GVEC_OP(gvec_usadd64, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint64_t)) {
         uint64_t ai = *(uint64_t *)(a + i);
         uint64_t bi = *(uint64_t *)(b + i);
         uint64_t di;
@@ -1236,7 +1262,8 @@ void HELPER(gvec_ussub8)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
+    for (i = HOST_GVEC_OP(gvec_ussub8, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint8_t)) {
         int r = *(uint8_t *)(a + i) - *(uint8_t *)(b + i);
         if (r < 0) {
             r = 0;
@@ -1251,7 +1278,8 @@ void HELPER(gvec_ussub16)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
+    for (i = HOST_GVEC_OP(gvec_ussub16, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint16_t)) {
         int r = *(uint16_t *)(a + i) - *(uint16_t *)(b + i);
         if (r < 0) {
             r = 0;
@@ -1266,7 +1294,8 @@ void HELPER(gvec_ussub32)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
+    for (i = HOST_GVEC_OP(gvec_ussub32, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint32_t)) {
         uint32_t ai = *(uint32_t *)(a + i);
         uint32_t bi = *(uint32_t *)(b + i);
         uint32_t di;
@@ -1283,7 +1312,8 @@ void HELPER(gvec_ussub64)(void *d, void *a, void *b, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (i = HOST_GVEC_OP(gvec_ussub64, d, a, b, oprsz);
+         i < oprsz; i += sizeof(uint64_t)) {
         uint64_t ai = *(uint64_t *)(a + i);
         uint64_t bi = *(uint64_t *)(b + i);
         uint64_t di;
@@ -1524,7 +1554,8 @@ void HELPER(gvec_bitsel)(void *d, void *a, void *b, void *c, uint32_t desc)
     intptr_t oprsz = simd_oprsz(desc);
     intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
+    for (i = HOST_GVEC_OP(gvec_bitsel, d, a, b, c, oprsz);
+         i < oprsz; i += sizeof(uint64_t)) {
         uint64_t aa = *(uint64_t *)(a + i);
         uint64_t bb = *(uint64_t *)(b + i);
         uint64_t cc = *(uint64_t *)(c + i);
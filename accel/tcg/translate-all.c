@@ -43,6 +43,7 @@
 #endif
 #else
 #include "exec/ram_addr.h"
+#include "sysemu/sysemu.h"
 #endif
 
 #include "exec/cputlb.h"
@@ -51,11 +52,14 @@
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
+#include "qemu/mem-usage.h"
 #include "exec/log.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
 #include "sysemu/tcg.h"
 #include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "qapi/type-helpers.h"
 #include "hw/core/tcg-cpu-ops.h"
 #include "tb-hash.h"
 #include "tb-context.h"
@@ -103,6 +107,15 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+/*
+ * A page whose TBs are invalidated by guest stores this many times
+ * within one second is translated one instruction per TB for the next
+ * SMC_THRASH_HOLD seconds: each store then only throws away the TB of
+ * the instruction it hit.
+ */
+#define SMC_THRASH_THRESHOLD 16
+#define SMC_THRASH_HOLD 2
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
@@ -111,6 +124,11 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned long *code_bitmap;
     unsigned int code_write_count;
+    /* SMC thrash detection: invalidating stores during smc_second */
+    uint16_t smc_count;
+    uint32_t smc_second;
+    /* Realtime second until which the page is in single-insn mode */
+    uint32_t smc_until;
 #else
     unsigned long flags;
     void *target_data;
@@ -218,6 +236,21 @@ static int v_l2_levels;
 
 static void *l1_map[V_L1_MAX_SIZE];
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * The ram_addr_t space of most machines is small and dense, so once the
+ * board has created its RAM and ROMs the leaves of l1_map covering it are
+ * also indexed by a flat array, sparing page_find_alloc() the walk down
+ * the intermediate levels.  l1_map stays the authority: leaves are never
+ * freed, the flat array only caches pointers to them, and pages of RAM
+ * added later beyond l1_flat_pages keep using the tree alone.
+ */
+#define L1_FLAT_MAX_LEAVES  (64 * 1024)
+
+static PageDesc **l1_flat;
+static tb_page_addr_t l1_flat_pages;
+#endif
+
 TBContext tb_ctx;
 
 static void page_table_config_init(void)
@@ -375,7 +408,8 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                 prof->restore_time + profile_getclock() - ti);
     qatomic_set(&prof->restore_count, prof->restore_count + 1);
 #endif
-    return 0;
+    /* Index in the TB of the instruction the state was restored to */
+    return i;
 }
 
 bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc, bool will_exit)
@@ -400,10 +434,43 @@ bool cpu_restore_state(CPUState *cpu, uintptr_t host_pc, bool will_exit)
     return false;
 }
 
+static PageDesc *page_find_alloc_tree(tb_page_addr_t index, int alloc);
+
+#ifndef CONFIG_USER_ONLY
+/* Index the leaves of l1_map covering the RAM and ROMs of the machine */
+static void page_flat_init(Notifier *notifier, void *data)
+{
+    tb_page_addr_t pages = ROUND_UP(last_ram_page(), V_L2_SIZE);
+    tb_page_addr_t index;
+    size_t leaves = pages / V_L2_SIZE;
+
+    if (!leaves || leaves > L1_FLAT_MAX_LEAVES) {
+        return;
+    }
+
+    /* No vCPU runs before machine init done; fill in what exists already */
+    l1_flat = g_new0(PageDesc *, leaves);
+    for (index = 0; index < pages; index += V_L2_SIZE) {
+        l1_flat[index / V_L2_SIZE] = page_find_alloc_tree(index, 0);
+    }
+    mem_usage_add(MEMORY_USAGE_SUBSYSTEM_TB_METADATA,
+                  sizeof(PageDesc *) * leaves);
+    qatomic_store_release(&l1_flat_pages, pages);
+    trace_page_flat_init(pages, leaves);
+}
+
+static Notifier page_flat_notifier = {
+    .notify = page_flat_init,
+};
+#endif
+
 void page_init(void)
 {
     page_size_init();
     page_table_config_init();
+#ifndef CONFIG_USER_ONLY
+    qemu_add_machine_init_done_notifier(&page_flat_notifier);
+#endif
 
 #if defined(CONFIG_BSD) && defined(CONFIG_USER_ONLY)
     {
@@ -471,7 +538,7 @@ void page_init(void)
 #endif
 }
 
-static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
+static PageDesc *page_find_alloc_tree(tb_page_addr_t index, int alloc)
 {
     PageDesc *pd;
     void **lp;
@@ -495,6 +562,9 @@ static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
             if (unlikely(existing)) {
                 g_free(p);
                 p = existing;
+            } else {
+                mem_usage_add(MEMORY_USAGE_SUBSYSTEM_TB_METADATA,
+                              sizeof(void *) * V_L2_SIZE);
             }
         }
 
@@ -531,17 +601,51 @@ static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
 #endif
             g_free(pd);
             pd = existing;
+        } else {
+            mem_usage_add(MEMORY_USAGE_SUBSYSTEM_TB_METADATA,
+                          sizeof(PageDesc) * V_L2_SIZE);
         }
     }
 
     return pd + (index & (V_L2_SIZE - 1));
 }
 
+static PageDesc *page_find_alloc(tb_page_addr_t index, int alloc)
+{
+#ifndef CONFIG_USER_ONLY
+    if (index < qatomic_load_acquire(&l1_flat_pages)) {
+        PageDesc **slot = l1_flat + (index >> V_L2_BITS);
+        PageDesc *pd = qatomic_rcu_read(slot);
+
+        if (likely(pd)) {
+            return pd + (index & (V_L2_SIZE - 1));
+        }
+        if (!alloc) {
+            return NULL;
+        }
+        pd = page_find_alloc_tree(index, alloc);
+        qatomic_rcu_set(slot, pd - (index & (V_L2_SIZE - 1)));
+        return pd;
+    }
+#endif
+    return page_find_alloc_tree(index, alloc);
+}
+
 static inline PageDesc *page_find(tb_page_addr_t index)
 {
     return page_find_alloc(index, 0);
 }
 
+/*
+ * Number of pages from @index to the end of its leaf of l1_map.  Their
+ * PageDescs are contiguous, so walks over ranges of pages only need to
+ * look up the map once per leaf.
+ */
+static inline tb_page_addr_t page_leaf_remaining(tb_page_addr_t index)
+{
+    return V_L2_SIZE - (index & (V_L2_SIZE - 1));
+}
+
 static void page_lock_pair(PageDesc **ret_p1, tb_page_addr_t phys1,
                            PageDesc **ret_p2, tb_page_addr_t phys2, int alloc);
 
@@ -952,6 +1056,31 @@ static void page_flush_tb(void)
     }
 }
 
+/*
+ * Account the code of @tb and the TranslationBlock itself, which sits
+ * in the code buffer just before it.  TBs are accounted from the time
+ * they enter the region tree until their region is reclaimed or flushed.
+ */
+static void tb_mem_usage(const TranslationBlock *tb, bool add)
+{
+    size_t meta = ROUND_UP(sizeof(*tb), qemu_icache_linesize);
+
+    if (add) {
+        mem_usage_add(MEMORY_USAGE_SUBSYSTEM_TB_CODE, tb->tc.size);
+        mem_usage_add(MEMORY_USAGE_SUBSYSTEM_TB_METADATA, meta);
+    } else {
+        mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_TB_CODE, tb->tc.size);
+        mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_TB_METADATA, meta);
+    }
+}
+
+static gboolean tb_mem_usage_sub_iter(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    tb_mem_usage(value, false);
+    return false;
+}
+
 static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
 {
     const TranslationBlock *tb = value;
@@ -965,6 +1094,7 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
 static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
 {
     bool did_flush = false;
+    int64_t t0 = get_clock();
 
     mmap_lock();
     /* If it is already been done on request of another CPU,
@@ -991,10 +1121,12 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     page_flush_tb();
 
+    tcg_tb_foreach(tb_mem_usage_sub_iter, NULL);
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     qatomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
+    tb_ctx.tb_flush_time += get_clock() - t0;
 
 done:
     mmap_unlock();
@@ -1017,6 +1149,67 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static void tb_reclaim_invalidate(TranslationBlock *tb)
+{
+    /* Already invalidated TBs are off every list, so this is a no-op */
+    tb_phys_invalidate(tb, -1);
+    tb_mem_usage(tb, false);
+}
+
+/*
+ * Make room in the code buffer by discarding the TBs of its oldest
+ * regions, falling back to a full flush if none of them can go.
+ */
+static void do_tb_reclaim(CPUState *cpu, run_on_cpu_data tb_reclaim_count)
+{
+    int64_t t0 = get_clock();
+    ssize_t n;
+
+    mmap_lock();
+    /* If it is already been done on request of another CPU, just retry */
+    if (tb_ctx.tb_reclaim_count != tb_reclaim_count.host_int) {
+        mmap_unlock();
+        return;
+    }
+
+    n = tcg_region_reclaim(tb_reclaim_invalidate);
+    if (n < 0) {
+        unsigned tb_flush_count = tb_ctx.tb_flush_count;
+
+        qatomic_mb_set(&tb_ctx.tb_reclaim_count, tb_reclaim_count.host_int + 1);
+        mmap_unlock();
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+        return;
+    }
+
+    /*
+     * The TBs are out of the hash table and unlinked from the survivors,
+     * but the per-CPU jump caches, and the indirect jump caches keyed on
+     * their generation, may still point to them.
+     */
+    CPU_FOREACH(cpu) {
+        cpu_tb_jmp_cache_clear(cpu);
+    }
+
+    qatomic_mb_set(&tb_ctx.tb_reclaim_count, tb_ctx.tb_reclaim_count + 1);
+    tb_ctx.tb_reclaimed += n;
+    tb_ctx.tb_flush_time += get_clock() - t0;
+    trace_tb_reclaim(n);
+    mmap_unlock();
+}
+
+static void tb_reclaim(CPUState *cpu)
+{
+    unsigned tb_reclaim_count = qatomic_mb_read(&tb_ctx.tb_reclaim_count);
+
+    if (cpu_in_exclusive_context(cpu)) {
+        do_tb_reclaim(cpu, RUN_ON_CPU_HOST_INT(tb_reclaim_count));
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_reclaim,
+                              RUN_ON_CPU_HOST_INT(tb_reclaim_count));
+    }
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1164,6 +1357,20 @@ static inline void tb_jmp_unlink(TranslationBlock *dest)
     qemu_spin_unlock(&dest->jmp_lock);
 }
 
+static gboolean tb_unlink_one(gpointer key, gpointer value, gpointer data)
+{
+    tb_jmp_unlink(value);
+    return false;
+}
+
+/* Reset all the direct jumps, so that every TB is entered afresh */
+void tb_unlink_all(void)
+{
+    qemu_thread_jit_write();
+    tcg_tb_foreach(tb_unlink_one, NULL);
+    qemu_thread_jit_execute();
+}
+
 /*
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
@@ -1176,6 +1383,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     uint32_t h;
     tb_page_addr_t phys_pc;
     uint32_t orig_cflags = tb_cflags(tb);
+    int i;
 
     assert_memory_lock();
 
@@ -1194,21 +1402,25 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     /* remove the TB from the page list */
     if (rm_from_page_list) {
+        /*
+         * The code bitmaps are left with the bytes of the TB set: they
+         * may cover more than the remaining TBs, which is harmless.
+         */
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
         if (tb->page_addr[1] != -1) {
             p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
         }
     }
 
     /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
+    h = tb_jmp_cache_set(tb->pc);
     CPU_FOREACH(cpu) {
-        if (qatomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            qatomic_set(&cpu->tb_jmp_cache[h], NULL);
+        for (i = 0; i < TB_JMP_CACHE_WAYS; i++) {
+            if (qatomic_read(&cpu->tb_jmp_cache[h + i]) == tb) {
+                qatomic_set(&cpu->tb_jmp_cache[h + i], NULL);
+            }
         }
     }
 
@@ -1246,30 +1458,119 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
+static uint32_t smc_now(void)
+{
+    return get_clock_realtime() / NANOSECONDS_PER_SECOND;
+}
+
+/* A guest store just invalidated TBs in @p; call with @p->lock held */
+static void page_smc_note(PageDesc *p, tb_page_addr_t addr)
+{
+    uint32_t now = smc_now();
+
+    assert_page_locked(p);
+    if (p->smc_second != now) {
+        p->smc_second = now;
+        p->smc_count = 0;
+    }
+    if (p->smc_count < UINT16_MAX) {
+        p->smc_count++;
+    }
+    if (p->smc_count >= SMC_THRASH_THRESHOLD) {
+        if (qatomic_read(&p->smc_until) < now) {
+            trace_tb_smc_thrash(addr & TARGET_PAGE_MASK);
+        }
+        qatomic_set(&p->smc_until, now + SMC_THRASH_HOLD);
+    }
+}
+
+#ifdef CONFIG_SOFTMMU
+/*
+ * With icount, I/O is only allowed in the last instruction of a TB, so a
+ * TB that does it earlier is rewound by cpu_io_recompile() every time it
+ * runs.  Remember, for the start of such a TB, how many instructions come
+ * before the I/O one, so that tb_gen_code() ends the TB there and lets a
+ * TB starting with the I/O instruction do it.  A hint only ever shrinks,
+ * so a stale one can only make TBs shorter than needed.  icount runs all
+ * vCPUs from one thread, which serializes the accesses.
+ */
+static GHashTable *tb_io_hints;
+
+static void tb_io_hint_record(tb_page_addr_t phys_pc, int io_insn)
+{
+    gpointer old;
+    int64_t *key;
+
+    if (!tb_io_hints) {
+        tb_io_hints = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                            g_free, NULL);
+    }
+    old = g_hash_table_lookup(tb_io_hints, &(int64_t){ phys_pc });
+    if (old && GPOINTER_TO_INT(old) - 1 <= io_insn) {
+        return;
+    }
+    key = g_new(int64_t, 1);
+    *key = phys_pc;
+    /* Store the index plus one, NULL means no hint */
+    g_hash_table_replace(tb_io_hints, key, GINT_TO_POINTER(io_insn + 1));
+}
+
+/* Index of the instruction doing I/O in the TB at @phys_pc, or -1 */
+static int tb_io_hint_lookup(tb_page_addr_t phys_pc)
+{
+    if (!tb_io_hints) {
+        return -1;
+    }
+    return GPOINTER_TO_INT(g_hash_table_lookup(tb_io_hints,
+                                               &(int64_t){ phys_pc })) - 1;
+}
+#endif
+
+/*
+ * Whether the code at @phys_pc is being rewritten too often to be worth
+ * translating more than one instruction at a time.  TBs translated in
+ * the meantime stay short until the next store invalidates them.
+ */
+static bool page_smc_thrashing(tb_page_addr_t phys_pc)
+{
+    PageDesc *p = page_find(phys_pc >> TARGET_PAGE_BITS);
+    uint32_t until = p ? qatomic_read(&p->smc_until) : 0;
+
+    return until && smc_now() <= until;
+}
+
+/* call with @p->lock held */
+static void page_bitmap_add_tb(PageDesc *p, TranslationBlock *tb, int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE) {
+            tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+}
+
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
     TranslationBlock *tb;
+    int n;
 
     assert_page_locked(p);
     p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        page_bitmap_add_tb(p, tb, n);
     }
 }
 #endif
@@ -1294,7 +1595,15 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     page_already_protected = p->first_tb != (uintptr_t)NULL;
 #endif
     p->first_tb = (uintptr_t)tb | n;
-    invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
+    /*
+     * Keep the code bitmap up to date rather than start counting writes
+     * again: pages that mix code and data get new TBs all the time.
+     */
+    if (p->code_bitmap) {
+        page_bitmap_add_tb(p, tb, n);
+    }
+#endif
 
 #if defined(CONFIG_USER_ONLY)
     /* translator_loop() must have made all TB pages non-writable */
@@ -1388,6 +1697,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
+    bool io_last = false;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
@@ -1408,14 +1718,34 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         max_insns = TCG_MAX_INSNS;
     }
     QEMU_BUILD_BUG_ON(CF_COUNT_MASK + 1 != TCG_MAX_INSNS);
+#ifdef CONFIG_SOFTMMU
+    if (phys_pc != -1 && page_smc_thrashing(phys_pc)) {
+        /* Still found by lookups with @cflags, just shorter */
+        max_insns = 1;
+        cflags &= ~CF_SUPERBLOCK;
+    }
+    if (phys_pc != -1 && (cflags & CF_USE_ICOUNT) &&
+        !(cflags & (CF_COUNT_MASK | CF_LAST_IO))) {
+        int io_insn = tb_io_hint_lookup(phys_pc);
+
+        if (io_insn == 0) {
+            /* Only translated with CF_LAST_IO, see below */
+            max_insns = 1;
+            cflags &= ~CF_SUPERBLOCK;
+            io_last = true;
+        } else if (io_insn > 0) {
+            max_insns = MIN(max_insns, io_insn);
+        }
+    }
+#endif
 
  buffer_overflow:
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* reclaim must be done */
+        tb_reclaim(cpu);
         mmap_unlock();
-        /* Make the execution loop process the flush as soon as possible.  */
+        /* Make the execution loop process the reclaim as soon as possible. */
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
     }
@@ -1425,9 +1755,21 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->pc = pc;
     tb->cs_base = cs_base;
     tb->flags = flags;
-    tb->cflags = cflags;
+    /*
+     * CF_SUPERBLOCK only changes how the code is translated; the TB
+     * must still be found by lookups using the usual cflags.
+     */
+    tb->cflags = cflags & ~CF_SUPERBLOCK;
+    tb->superblock = cflags & CF_SUPERBLOCK;
+    tb->exec_count = 0;
+    tb->coverage_gen = 0;
+    tb->jmp_pc[0] = tb->jmp_pc[1] = -1;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
-    tcg_ctx->tb_cflags = cflags;
+    /*
+     * A TB that io_last makes accept I/O is still found by lookups with
+     * @cflags, so CF_LAST_IO is only seen by the translator.
+     */
+    tcg_ctx->tb_cflags = cflags | (io_last ? CF_LAST_IO : 0);
  tb_overflow:
 
 #ifdef CONFIG_PROFILER
@@ -1443,6 +1785,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
     tcg_func_start(tcg_ctx);
 
+    tcg_ctx->no_st_fwd = cflags & CF_NO_ST_FWD;
     tcg_ctx->cpu = env_cpu(env);
     gen_intermediate_code(cpu, tb, max_insns);
     assert(tb->size != 0);
@@ -1604,6 +1947,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->jmp_list_next[1] = (uintptr_t)NULL;
     tb->jmp_dest[0] = (uintptr_t)NULL;
     tb->jmp_dest[1] = (uintptr_t)NULL;
+    memset(&tb->exit_stats, 0, sizeof(tb->exit_stats));
+    memset(&tb->jmp_ic, 0, sizeof(tb->jmp_ic));
 
     /* init original jump addresses which have been set during tcg_gen_code() */
     if (tb->jmp_reset_offset[0] != TB_JMP_RESET_OFFSET_INVALID) {
@@ -1651,6 +1996,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         tcg_tb_remove(tb);
         return existing_tb;
     }
+    tb_mem_usage(tb, true);
+    perf_report_tb(tb);
     return tb;
 }
 
@@ -1667,6 +2014,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 {
     TranslationBlock *tb;
     tb_page_addr_t tb_start, tb_end;
+    bool invalidated = false;
     int n;
 #ifdef TARGET_HAS_PRECISE_SMC
     CPUState *cpu = current_cpu;
@@ -1725,8 +2073,18 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
             }
 #endif /* TARGET_HAS_PRECISE_SMC */
             tb_phys_invalidate__locked(tb);
+            invalidated = true;
         }
     }
+#ifdef CONFIG_SOFTMMU
+    /* Whatever code the range held is gone */
+    if (p->code_bitmap) {
+        bitmap_clear(p->code_bitmap, start & ~TARGET_PAGE_MASK, end - start);
+    }
+    if (invalidated && retaddr) {
+        page_smc_note(p, start);
+    }
+#endif
 #if !defined(CONFIG_USER_ONLY)
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
@@ -1806,6 +2164,46 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* call with @p->lock held */
+static bool page_bitmap_hit(PageDesc *p, tb_page_addr_t start, int len)
+{
+    unsigned int nr = start & ~TARGET_PAGE_MASK;
+    unsigned long b;
+
+    b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+    return b & ((1 << len) - 1);
+}
+
+/*
+ * Return false if a write of @len bytes at @start, in a page that holds
+ * code, is known not to touch any TB.  This only takes the lock of the
+ * one page, so that the frequent writes to data sitting next to code
+ * don't pay for locking a page collection in tb_invalidate_phys_page_fast.
+ * Builds the page's code bitmap once it has seen enough such writes.
+ *
+ * len must be <= 8 and start must be a multiple of len.
+ */
+bool tb_invalidate_phys_page_needed(tb_page_addr_t start, int len)
+{
+    PageDesc *p = page_find(start >> TARGET_PAGE_BITS);
+    bool ret = true;
+
+    if (!p) {
+        return false;
+    }
+
+    page_lock(p);
+    if (!p->code_bitmap &&
+        ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
+        build_page_bitmap(p);
+    }
+    if (p->code_bitmap) {
+        ret = page_bitmap_hit(p, start, len);
+    }
+    page_unlock(p);
+    return ret;
+}
+
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
  * iothread mutex not held.
@@ -1826,25 +2224,75 @@ void tb_invalidate_phys_page_fast(struct page_collection *pages,
     }
 
     assert_page_locked(p);
-    if (!p->code_bitmap &&
-        ++p->code_write_count >= SMC_BITMAP_USE_THRESHOLD) {
-        build_page_bitmap(p);
+    /* The write count is kept by tb_invalidate_phys_page_needed */
+    if (!p->code_bitmap || page_bitmap_hit(p, start, len)) {
+        tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
+                                              retaddr);
     }
-    if (p->code_bitmap) {
-        unsigned int nr;
-        unsigned long b;
+}
+
+static void tb_smc_format_1(GString *buf, int level, void **lp,
+                            tb_page_addr_t index, uint32_t now)
+{
+    int i;
 
-        nr = start & ~TARGET_PAGE_MASK;
-        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
-        if (b & ((1 << len) - 1)) {
-            goto do_invalidate;
+    if (*lp == NULL) {
+        return;
+    }
+    if (level == 0) {
+        PageDesc *pd = *lp;
+
+        for (i = 0; i < V_L2_SIZE; i++) {
+            PageDesc *p = &pd[i];
+            uint32_t until = qatomic_read(&p->smc_until);
+            tb_page_addr_t addr;
+
+            if (!until) {
+                continue;
+            }
+            addr = ((index << V_L2_BITS) | i) << TARGET_PAGE_BITS;
+            page_lock(p);
+            g_string_append_printf(buf, "0x%016" PRIx64 " %10u  ",
+                                   (uint64_t)addr,
+                                   p->smc_second == now ? p->smc_count : 0);
+            if (now <= until) {
+                g_string_append_printf(buf, "single-insn for %us\n",
+                                       until - now + 1);
+            } else {
+                g_string_append_printf(buf, "stable for %us\n",
+                                       now - until);
+            }
+            page_unlock(p);
         }
     } else {
-    do_invalidate:
-        tb_invalidate_phys_page_range__locked(pages, p, start, start + len,
-                                              retaddr);
+        void **pp = *lp;
+
+        for (i = 0; i < V_L2_SIZE; i++) {
+            tb_smc_format_1(buf, level - 1, pp + i,
+                            (index << V_L2_BITS) | i, now);
+        }
     }
 }
+
+HumanReadableText *qmp_x_query_smc(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    uint32_t now = smc_now();
+    int i;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "SMC statistics are only available with TCG");
+        return NULL;
+    }
+
+    g_string_append_printf(buf, "%-18s %10s  %s\n",
+                           "ram page", "stores/s", "state");
+    for (i = 0; i < v_l1_size; i++) {
+        tb_smc_format_1(buf, v_l2_levels, l1_map + i, i, now);
+    }
+
+    return human_readable_text_from_str(buf);
+}
 #else
 /* Called with mmap_lock held. If pc is not 0 then it indicates the
  * host PC of the faulting store instruction that caused this invalidate.
@@ -1955,13 +2403,14 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
     TranslationBlock *tb;
     CPUClass *cc;
     uint32_t n;
+    int io_insn;
 
     tb = tcg_tb_lookup(retaddr);
     if (!tb) {
         cpu_abort(cpu, "cpu_io_recompile: could not find TB for pc=%p",
                   (void *)retaddr);
     }
-    cpu_restore_state_from_tb(cpu, tb, retaddr, true);
+    io_insn = cpu_restore_state_from_tb(cpu, tb, retaddr, true);
 
     /*
      * Some guests must re-execute the branch when re-executing a delay
@@ -1976,6 +2425,20 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
         n = 2;
     }
 
+#ifdef CONFIG_SOFTMMU
+    /*
+     * Make the next translations of a regular TB stop short of the I/O
+     * instruction, instead of being rewound here each time they run.
+     */
+    if (n == 1 && io_insn >= 0 &&
+        !(tb_cflags(tb) & (CF_COUNT_MASK | CF_LAST_IO))) {
+        tb_io_hint_record(tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK),
+                          io_insn);
+        trace_tb_io_split(tb->pc, io_insn);
+        tb_phys_invalidate(tb, -1);
+    }
+#endif
+
     /*
      * Exit the loop and potentially generate a new TB executing the
      * just the I/O insns. We also limit instrumentation to memory
@@ -2082,6 +2545,7 @@ void dump_exec_info(GString *buf)
      */
     g_string_append_printf(buf, "gen code size       %zu/%zu\n",
                            tcg_code_size(), tcg_code_capacity());
+    tcg_region_dump_info(buf);
     g_string_append_printf(buf, "TB count            %zu\n", nb_tbs);
     g_string_append_printf(buf, "TB avg target size  %zu max=%zu bytes\n",
                            nb_tbs ? tst.target_size / nb_tbs : 0,
@@ -2108,6 +2572,12 @@ void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB reclaim count    %u (%" PRIu64
+                           " TBs)\n",
+                           qatomic_read(&tb_ctx.tb_reclaim_count),
+                           tb_ctx.tb_reclaimed);
+    g_string_append_printf(buf, "TB flush/reclaim    %" PRId64 " us\n",
+                           tb_ctx.tb_flush_time / SCALE_US);
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
@@ -2260,7 +2730,7 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
+    target_ulong addr, npages;
     bool reset_target_data;
 
     /* This function should never be called with addresses outside the
@@ -2281,25 +2751,30 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     reset_target_data = !(flags & PAGE_VALID) || (flags & PAGE_RESET);
     flags &= ~PAGE_RESET;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
-
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
-        }
-        if (reset_target_data) {
-            g_free(p->target_data);
-            p->target_data = NULL;
-            p->flags = flags;
-        } else {
-            /* Using mprotect on a page does not change MAP_ANON. */
-            p->flags = (p->flags & PAGE_ANON) | flags;
+    addr = start;
+    npages = (end - start) >> TARGET_PAGE_BITS;
+    while (npages) {
+        tb_page_addr_t index = addr >> TARGET_PAGE_BITS;
+        tb_page_addr_t n = MIN(npages, page_leaf_remaining(index));
+        PageDesc *p = page_find_alloc(index, 1);
+
+        npages -= n;
+        for (; n; n--, p++, addr += TARGET_PAGE_SIZE) {
+            /* If the write protection bit is set, then we invalidate
+               the code inside.  */
+            if (!(p->flags & PAGE_WRITE) &&
+                (flags & PAGE_WRITE) &&
+                p->first_tb) {
+                tb_invalidate_phys_page(addr, 0);
+            }
+            if (reset_target_data) {
+                g_free(p->target_data);
+                p->target_data = NULL;
+                p->flags = flags;
+            } else {
+                /* Using mprotect on a page does not change MAP_ANON. */
+                p->flags = (p->flags & PAGE_ANON) | flags;
+            }
         }
     }
 }
@@ -2328,7 +2803,7 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
 {
     PageDesc *p;
     target_ulong end;
-    target_ulong addr;
+    target_ulong addr, npages;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2349,30 +2824,36 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     end = TARGET_PAGE_ALIGN(start + len);
     start = start & TARGET_PAGE_MASK;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
+    addr = start;
+    npages = (end - start) >> TARGET_PAGE_BITS;
+    while (npages) {
+        tb_page_addr_t index = addr >> TARGET_PAGE_BITS;
+        tb_page_addr_t n = MIN(npages, page_leaf_remaining(index));
+
+        p = page_find(index);
         if (!p) {
             return -1;
         }
-        if (!(p->flags & PAGE_VALID)) {
-            return -1;
-        }
+        npages -= n;
+        for (; n; n--, p++, addr += TARGET_PAGE_SIZE) {
+            if (!(p->flags & PAGE_VALID)) {
+                return -1;
+            }
 
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
-        }
-        if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
+            if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
                 return -1;
             }
-            /* unprotect the page if it was put read-only because it
-               contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
+            if (flags & PAGE_WRITE) {
+                if (!(p->flags & PAGE_WRITE_ORG)) {
                     return -1;
                 }
+                /* unprotect the page if it was put read-only because it
+                   contains translated code */
+                if (!(p->flags & PAGE_WRITE)) {
+                    if (!page_unprotect(addr, 0)) {
+                        return -1;
+                    }
+                }
             }
         }
     }
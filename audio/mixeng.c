@@ -283,26 +283,27 @@ static const float float_scale_reciprocal = 1.f / ((int64_t)INT32_MAX + 1);
 #endif
 #endif
 
+/* Counted loops like in mixeng_template.h, so that they vectorise */
 static void conv_natural_float_to_mono(struct st_sample *dst, const void *src,
                                        int samples)
 {
-    float *in = (float *)src;
+    const float *in = src;
+    int i;
 
-    while (samples--) {
-        dst->r = dst->l = CONV_NATURAL_FLOAT(*in++);
-        dst++;
+    for (i = 0; i < samples; i++) {
+        dst[i].r = dst[i].l = CONV_NATURAL_FLOAT(in[i]);
     }
 }
 
 static void conv_natural_float_to_stereo(struct st_sample *dst, const void *src,
                                          int samples)
 {
-    float *in = (float *)src;
+    const float *in = src;
+    int i;
 
-    while (samples--) {
-        dst->l = CONV_NATURAL_FLOAT(*in++);
-        dst->r = CONV_NATURAL_FLOAT(*in++);
-        dst++;
+    for (i = 0; i < samples; i++) {
+        dst[i].l = CONV_NATURAL_FLOAT(in[2 * i]);
+        dst[i].r = CONV_NATURAL_FLOAT(in[2 * i + 1]);
     }
 }
 
@@ -314,23 +315,23 @@ t_sample *mixeng_conv_float[2] = {
 static void clip_natural_float_from_mono(void *dst, const struct st_sample *src,
                                          int samples)
 {
-    float *out = (float *)dst;
+    float *out = dst;
+    int i;
 
-    while (samples--) {
-        *out++ = CLIP_NATURAL_FLOAT(src->l + src->r);
-        src++;
+    for (i = 0; i < samples; i++) {
+        out[i] = CLIP_NATURAL_FLOAT(src[i].l + src[i].r);
     }
 }
 
 static void clip_natural_float_from_stereo(
     void *dst, const struct st_sample *src, int samples)
 {
-    float *out = (float *)dst;
+    float *out = dst;
+    int i;
 
-    while (samples--) {
-        *out++ = CLIP_NATURAL_FLOAT(src->l);
-        *out++ = CLIP_NATURAL_FLOAT(src->r);
-        src++;
+    for (i = 0; i < samples; i++) {
+        out[2 * i] = CLIP_NATURAL_FLOAT(src[i].l);
+        out[2 * i + 1] = CLIP_NATURAL_FLOAT(src[i].r);
     }
 }
 
@@ -457,6 +458,11 @@ void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol)
         return;
     }
 
+    /* Full volume, the usual case, leaves the samples as they are */
+    if (vol->l == nominal_volume.l && vol->r == nominal_volume.r) {
+        return;
+    }
+
     while (len--) {
 #ifdef FLOAT_MIXENG
         buf->l = buf->l * vol->l;
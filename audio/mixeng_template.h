@@ -83,30 +83,36 @@ static inline int64_t glue (conv_, ET) (IN_T v)
 
 static inline IN_T glue (clip_, ET) (int64_t v)
 {
+#ifdef SIGNED
+    /* Saturate without branches so that the callers' loops vectorise */
+    v = MIN(MAX(v, -2147483648LL), 0x7fffffffLL);
+    return ENDIAN_CONVERT ((IN_T) (v >> (32 - SHIFT)));
+#else
     if (v >= 0x7fffffffLL) {
         return IN_MAX;
     } else if (v < -2147483648LL) {
         return IN_MIN;
     }
 
-#ifdef SIGNED
-    return ENDIAN_CONVERT ((IN_T) (v >> (32 - SHIFT)));
-#else
     return ENDIAN_CONVERT ((IN_T) ((v >> (32 - SHIFT)) + HALF));
 #endif
 }
 #endif
 
+/*
+ * Plain counted loops, so that the compiler can turn the conversions into
+ * vector code for whole blocks of frames.
+ */
 static void glue (glue (conv_, ET), _to_stereo)
     (struct st_sample *dst, const void *src, int samples)
 {
     struct st_sample *out = dst;
-    IN_T *in = (IN_T *) src;
+    const IN_T *in = src;
+    int i;
 
-    while (samples--) {
-        out->l = glue (conv_, ET) (*in++);
-        out->r = glue (conv_, ET) (*in++);
-        out += 1;
+    for (i = 0; i < samples; i++) {
+        out[i].l = glue (conv_, ET) (in[2 * i]);
+        out[i].r = glue (conv_, ET) (in[2 * i + 1]);
     }
 }
 
@@ -114,13 +120,12 @@ static void glue (glue (conv_, ET), _to_mono)
     (struct st_sample *dst, const void *src, int samples)
 {
     struct st_sample *out = dst;
-    IN_T *in = (IN_T *) src;
+    const IN_T *in = src;
+    int i;
 
-    while (samples--) {
-        out->l = glue (conv_, ET) (in[0]);
-        out->r = out->l;
-        out += 1;
-        in += 1;
+    for (i = 0; i < samples; i++) {
+        out[i].l = glue (conv_, ET) (in[i]);
+        out[i].r = out[i].l;
     }
 }
 
@@ -128,11 +133,12 @@ static void glue (glue (clip_, ET), _from_stereo)
     (void *dst, const struct st_sample *src, int samples)
 {
     const struct st_sample *in = src;
-    IN_T *out = (IN_T *) dst;
-    while (samples--) {
-        *out++ = glue (clip_, ET) (in->l);
-        *out++ = glue (clip_, ET) (in->r);
-        in += 1;
+    IN_T *out = dst;
+    int i;
+
+    for (i = 0; i < samples; i++) {
+        out[2 * i] = glue (clip_, ET) (in[i].l);
+        out[2 * i + 1] = glue (clip_, ET) (in[i].r);
     }
 }
 
@@ -140,10 +146,11 @@ static void glue (glue (clip_, ET), _from_mono)
     (void *dst, const struct st_sample *src, int samples)
 {
     const struct st_sample *in = src;
-    IN_T *out = (IN_T *) dst;
-    while (samples--) {
-        *out++ = glue (clip_, ET) (in->l + in->r);
-        in += 1;
+    IN_T *out = dst;
+    int i;
+
+    for (i = 0; i < samples; i++) {
+        out[i] = glue (clip_, ET) (in[i].l + in[i].r);
     }
 }
 
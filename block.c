@@ -7291,6 +7291,21 @@ int bdrv_amend_options(BlockDriverState *bs, QemuOpts *opts,
                                        cb_opaque, force, errp);
 }
 
+int bdrv_dedupe(BlockDriverState *bs, BlockDriverAmendStatusCB *status_cb,
+                void *cb_opaque, int64_t *shared, Error **errp)
+{
+    if (!bs->drv) {
+        error_setg(errp, "Node is ejected");
+        return -ENOMEDIUM;
+    }
+    if (!bs->drv->bdrv_dedupe) {
+        error_setg(errp, "Block driver '%s' does not support deduplication",
+                   bs->drv->format_name);
+        return -ENOTSUP;
+    }
+    return bs->drv->bdrv_dedupe(bs, status_cb, cb_opaque, shared, errp);
+}
+
 /*
  * This function checks whether the given @to_replace is allowed to be
  * replaced by a node that always shows the same data as @bs.  This is
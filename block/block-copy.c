@@ -29,6 +29,7 @@
 #define BLOCK_COPY_MAX_WORKERS 64
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
+#define BLOCK_COPY_STATUS_EXTENTS 32
 
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
@@ -605,8 +606,56 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     return ret;
 }
 
-static int block_copy_block_status(BlockCopyState *s, int64_t offset,
-                                   int64_t bytes, int64_t *pnum)
+/* Block status of the source, queried for many extents at once */
+typedef struct BlockCopyStatus {
+    BlockDriverState *base;
+    BlockStatusExtent extents[BLOCK_COPY_STATUS_EXTENTS];
+    int count;
+} BlockCopyStatus;
+
+/*
+ * Like bdrv_co_block_status_above(), from the extents of @status if
+ * they cover @offset, else querying them up to @end
+ */
+static int coroutine_fn block_copy_status_lookup(BlockCopyState *s,
+                                                 BlockCopyStatus *status,
+                                                 BlockDriverState *base,
+                                                 int64_t offset, int64_t bytes,
+                                                 int64_t end, int64_t *pnum)
+{
+    BlockStatusExtent *e;
+    int i, ret;
+
+    if (status->base == base) {
+        for (i = 0; i < status->count; i++) {
+            e = &status->extents[i];
+            if (offset >= e->offset && offset < e->offset + e->bytes) {
+                goto found;
+            }
+        }
+    }
+
+    status->base = base;
+    ret = bdrv_co_block_status_above_batch(s->source->bs, base, false, true,
+                                           offset, MAX(bytes, end - offset),
+                                           status->extents,
+                                           BLOCK_COPY_STATUS_EXTENTS);
+    status->count = MAX(ret, 0);
+    if (ret <= 0) {
+        *pnum = 0;
+        return ret;
+    }
+    e = &status->extents[0];
+
+found:
+    *pnum = MIN(bytes, e->offset + e->bytes - offset);
+    return e->ret;
+}
+
+static int coroutine_fn block_copy_block_status(BlockCopyState *s,
+                                                BlockCopyStatus *status,
+                                                int64_t offset, int64_t bytes,
+                                                int64_t end, int64_t *pnum)
 {
     int64_t num;
     BlockDriverState *base;
@@ -618,8 +667,7 @@ static int block_copy_block_status(BlockCopyState *s, int64_t offset,
         base = NULL;
     }
 
-    ret = bdrv_block_status_above(s->source->bs, base, offset, bytes, &num,
-                                  NULL, NULL);
+    ret = block_copy_status_lookup(s, status, base, offset, bytes, end, &num);
     if (ret < 0 || num < s->cluster_size) {
         /*
          * On error or if failed to obtain large enough chunk just fallback to
@@ -731,6 +779,7 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
     bool found_dirty = false;
     int64_t end = offset + bytes;
     AioTaskPool *aio = NULL;
+    g_autofree BlockCopyStatus *status = g_new0(BlockCopyStatus, 1);
 
     /*
      * block_copy() user is responsible for keeping source and target in same
@@ -759,8 +808,8 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
 
         found_dirty = true;
 
-        ret = block_copy_block_status(s, task->offset, task->bytes,
-                                      &status_bytes);
+        ret = block_copy_block_status(s, status, task->offset, task->bytes,
+                                      end, &status_bytes);
         assert(ret >= 0); /* never fail */
         if (status_bytes < task->bytes) {
             block_copy_task_shrink(task, status_bytes);
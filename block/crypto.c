@@ -22,6 +22,7 @@
 
 #include "block/block_int.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -33,11 +34,27 @@
 #include "qemu/cutils.h"
 #include "crypto.h"
 
+/*
+ * Large requests are encrypted and decrypted in parallel in the thread
+ * pool, in at most BLOCK_CRYPTO_MAX_THREADS chunks of at least
+ * BLOCK_CRYPTO_MIN_CHUNK bytes.  Smaller ones run in the coroutine.
+ */
+#define BLOCK_CRYPTO_MAX_THREADS 4
+#define BLOCK_CRYPTO_MIN_CHUNK (64 * 1024)
+
 typedef struct BlockCrypto BlockCrypto;
 
 struct BlockCrypto {
     QCryptoBlock *block;
     bool updating_keys;
+
+    /*
+     * Each thread uses one of the BLOCK_CRYPTO_MAX_THREADS ciphers of the
+     * block, so the number of threads across requests is limited.
+     */
+    CoMutex lock;
+    CoQueue thread_task_queue;
+    int nb_threads;
 };
 
 
@@ -294,7 +311,7 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
                                        block_crypto_read_func,
                                        bs,
                                        cflags,
-                                       1,
+                                       BLOCK_CRYPTO_MAX_THREADS,
                                        errp);
 
     if (!crypto->block) {
@@ -302,6 +319,8 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
         goto cleanup;
     }
 
+    qemu_co_mutex_init(&crypto->lock);
+    qemu_co_queue_init(&crypto->thread_task_queue);
     bs->encrypted = true;
 
     ret = 0;
@@ -396,6 +415,104 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+typedef int (*BlockCryptoEncDecFunc)(QCryptoBlock *block, uint64_t offset,
+                                     uint8_t *buf, size_t len, Error **errp);
+
+typedef struct BlockCryptoEncDec {
+    Coroutine *co;
+    int pending;
+    int ret;
+} BlockCryptoEncDec;
+
+typedef struct BlockCryptoEncDecTask {
+    BlockCryptoEncDec *req;
+    QCryptoBlock *block;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+    BlockCryptoEncDecFunc func;
+} BlockCryptoEncDecTask;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoEncDecTask *task = opaque;
+
+    return task->func(task->block, task->offset, task->buf, task->len, NULL);
+}
+
+static void block_crypto_encdec_cb(void *opaque, int ret)
+{
+    BlockCryptoEncDecTask *task = opaque;
+    BlockCryptoEncDec *req = task->req;
+
+    if (ret < 0) {
+        req->ret = ret;
+    }
+    if (--req->pending == 0) {
+        aio_co_wake(req->co);
+    }
+}
+
+/*
+ * Encrypt or decrypt the @len bytes of @buf, at guest @offset, with as
+ * many threads as are free, up to one per BLOCK_CRYPTO_MIN_CHUNK bytes.
+ */
+static int coroutine_fn
+block_crypto_co_encdec(BlockDriverState *bs, uint64_t offset, uint8_t *buf,
+                       size_t len, BlockCryptoEncDecFunc func)
+{
+    BlockCrypto *crypto = bs->opaque;
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    BlockCryptoEncDecTask tasks[BLOCK_CRYPTO_MAX_THREADS];
+    BlockCryptoEncDec req = { .co = qemu_coroutine_self() };
+    size_t chunk, done;
+    int n, i;
+
+    qemu_co_mutex_lock(&crypto->lock);
+    while (crypto->nb_threads >= BLOCK_CRYPTO_MAX_THREADS) {
+        qemu_co_queue_wait(&crypto->thread_task_queue, &crypto->lock);
+    }
+    n = MIN(BLOCK_CRYPTO_MAX_THREADS - crypto->nb_threads,
+            DIV_ROUND_UP(len, BLOCK_CRYPTO_MIN_CHUNK));
+    crypto->nb_threads += n;
+    qemu_co_mutex_unlock(&crypto->lock);
+
+    if (n == 1) {
+        /* Not worth the trip to a worker thread */
+        req.ret = func(crypto->block, offset, buf, len, NULL);
+    } else {
+        chunk = QEMU_ALIGN_UP(DIV_ROUND_UP(len, n), sector_size);
+        for (i = 0, done = 0; done < len; i++, done += chunk) {
+            tasks[i] = (BlockCryptoEncDecTask) {
+                .req = &req,
+                .block = crypto->block,
+                .offset = offset + done,
+                .buf = buf + done,
+                .len = MIN(chunk, len - done),
+                .func = func,
+            };
+            req.pending++;
+        }
+        /* The callbacks only run once we yield */
+        for (i = 0; i < req.pending; i++) {
+            thread_pool_submit_aio(pool, block_crypto_encdec_pool_func,
+                                   &tasks[i], block_crypto_encdec_cb,
+                                   &tasks[i]);
+        }
+        qemu_coroutine_yield();
+    }
+
+    qemu_co_mutex_lock(&crypto->lock);
+    crypto->nb_threads -= n;
+    for (i = 0; i < n; i++) {
+        qemu_co_queue_next(&crypto->thread_task_queue);
+    }
+    qemu_co_mutex_unlock(&crypto->lock);
+
+    return req.ret;
+}
+
 static coroutine_fn int
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -439,8 +556,8 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
+        if (block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                   cur_bytes, qcrypto_block_decrypt) < 0) {
             ret = -EIO;
             goto cleanup;
         }
@@ -495,8 +612,8 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
+        if (block_crypto_co_encdec(bs, offset + bytes_done, cipher_data,
+                                   cur_bytes, qcrypto_block_encrypt) < 0) {
             ret = -EIO;
             goto cleanup;
         }
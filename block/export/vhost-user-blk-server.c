@@ -10,6 +10,7 @@
  * later.  See the COPYING file in the top-level directory.
  */
 #include "qemu/osdep.h"
+#include "qemu/bitmap.h"
 #include "block/block.h"
 #include "subprojects/libvhost-user/libvhost-user.h" /* only for the type definitions */
 #include "standard-headers/linux/virtio_blk.h"
@@ -54,15 +55,44 @@ typedef struct {
     QIOChannelSocket *sioc;
     struct virtio_blk_config blkcfg;
     bool writable;
+
+    /* Queues with used buffers the driver has not been notified about */
+    unsigned long *notify_pending;
+    QEMUBH *notify_bh;
 } VuBlkExport;
 
+static void vu_blk_notify_bh(void *opaque)
+{
+    VuBlkExport *vexp = opaque;
+    VuDev *vu_dev = &vexp->vu_server.vu_dev;
+    long nr_queues = le16_to_cpu(vexp->blkcfg.num_queues);
+    long idx;
+
+    for (idx = find_first_bit(vexp->notify_pending, nr_queues);
+         idx < nr_queues;
+         idx = find_next_bit(vexp->notify_pending, nr_queues, idx + 1)) {
+        clear_bit(idx, vexp->notify_pending);
+        if (vu_dev->vq) {
+            vu_queue_notify(vu_dev, vu_get_queue(vu_dev, idx));
+        }
+    }
+}
+
 static void vu_blk_req_complete(VuBlkReq *req)
 {
     VuDev *vu_dev = &req->server->vu_dev;
+    VuBlkExport *vexp = container_of(req->server, VuBlkExport, vu_server);
 
     /* IO size with 1 extra status byte */
     vu_queue_push(vu_dev, req->vq, &req->elem, req->size + 1);
-    vu_queue_notify(vu_dev, req->vq);
+
+    /*
+     * Requests completing in the same event loop iteration share one
+     * notification.  With VIRTIO_RING_F_EVENT_IDX, vu_queue_notify() then
+     * also skips it if the driver did not ask for one.
+     */
+    set_bit(req->vq - vu_dev->vq, vexp->notify_pending);
+    qemu_bh_schedule(vexp->notify_bh);
 
     free(req);
 }
@@ -295,8 +325,12 @@ err:
 static void vu_blk_process_vq(VuDev *vu_dev, int idx)
 {
     VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+    VuBlkExport *vexp = container_of(server, VuBlkExport, vu_server);
     VuVirtq *vq = vu_get_queue(vu_dev, idx);
 
+    /* Submit the requests found in one go */
+    blk_io_plug(vexp->export.blk);
+
     while (1) {
         VuBlkReq *req;
 
@@ -312,6 +346,8 @@ static void vu_blk_process_vq(VuDev *vu_dev, int idx)
             qemu_coroutine_create(vu_blk_virtio_process_req, req);
         qemu_coroutine_enter(co);
     }
+
+    blk_io_unplug(vexp->export.blk);
 }
 
 static void vu_blk_queue_set_started(VuDev *vu_dev, int idx, bool started)
@@ -424,6 +460,7 @@ static void blk_aio_attached(AioContext *ctx, void *opaque)
     VuBlkExport *vexp = opaque;
 
     vexp->export.ctx = ctx;
+    vexp->notify_bh = aio_bh_new(ctx, vu_blk_notify_bh, vexp);
     vhost_user_server_attach_aio_context(&vexp->vu_server, ctx);
 }
 
@@ -432,6 +469,11 @@ static void blk_aio_detach(void *opaque)
     VuBlkExport *vexp = opaque;
 
     vhost_user_server_detach_aio_context(&vexp->vu_server);
+
+    /* Deliver what the old AioContext still had pending */
+    vu_blk_notify_bh(vexp);
+    qemu_bh_delete(vexp->notify_bh);
+    vexp->notify_bh = NULL;
     vexp->export.ctx = NULL;
 }
 
@@ -503,6 +545,9 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     vu_blk_initialize_config(blk_bs(exp->blk), &vexp->blkcfg,
                              logical_block_size, num_queues);
 
+    vexp->notify_pending = bitmap_new(num_queues);
+    vexp->notify_bh = aio_bh_new(exp->ctx, vu_blk_notify_bh, vexp);
+
     blk_add_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                  vexp);
 
@@ -510,6 +555,8 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
                                  num_queues, &vu_blk_iface, errp)) {
         blk_remove_aio_context_notifier(exp->blk, blk_aio_attached,
                                         blk_aio_detach, vexp);
+        qemu_bh_delete(vexp->notify_bh);
+        g_free(vexp->notify_pending);
         return -EADDRNOTAVAIL;
     }
 
@@ -522,6 +569,8 @@ static void vu_blk_exp_delete(BlockExport *exp)
 
     blk_remove_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                     vexp);
+    qemu_bh_delete(vexp->notify_bh);
+    g_free(vexp->notify_pending);
 }
 
 const BlockExportDriver blk_exp_vhost_user_blk = {
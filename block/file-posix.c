@@ -164,6 +164,12 @@ typedef struct BDRVRawState {
     bool discard_zeroes:1;
     bool use_linux_aio:1;
     bool use_linux_io_uring:1;
+    bool io_uring_fixed_buffers:1;
+#ifdef CONFIG_LINUX_IO_URING
+    /* The ring that s->fd is registered with, and its index there */
+    LuringState *luring_file_ring;
+    int luring_file;
+#endif
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -497,6 +503,37 @@ static int check_hdev_writable(int fd)
     return 0;
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Register s->fd with @aio when first used there.  Returns its index, or
+ * -errno if s->fd has to be used as is.
+ */
+static int raw_luring_file(BDRVRawState *s, LuringState *aio)
+{
+    if (s->luring_file_ring != aio) {
+        if (s->luring_file_ring && s->luring_file >= 0) {
+            luring_unregister_file(s->luring_file_ring, s->luring_file);
+        }
+        s->luring_file = luring_register_file(aio, s->fd);
+        s->luring_file_ring = aio;
+    }
+    return s->luring_file;
+}
+
+/* Must be called before s->fd is closed */
+static void raw_luring_release_file(BDRVRawState *s)
+{
+    if (s->luring_file_ring && s->luring_file >= 0) {
+        luring_unregister_file(s->luring_file_ring, s->luring_file);
+    }
+    s->luring_file_ring = NULL;
+}
+#else
+static void raw_luring_release_file(BDRVRawState *s)
+{
+}
+#endif
+
 static void raw_parse_flags(int bdrv_flags, int *open_flags, bool has_writers)
 {
     bool read_write = false;
@@ -565,6 +602,13 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "invalidate page cache during live migration (default: on)",
         },
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "x-io-uring-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM with io_uring (default: off)",
+        },
 #endif
         {
             .name = "x-check-cache-dropped",
@@ -626,6 +670,9 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
 #ifdef CONFIG_LINUX_IO_URING
     s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->io_uring_fixed_buffers = qemu_opt_get_bool(opts,
+                                                  "x-io-uring-fixed-buffers",
+                                                  false);
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
@@ -724,10 +771,18 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        if (!aio_setup_linux_io_uring(bdrv_get_aio_context(bs), errp)) {
+        LuringState *aio = aio_setup_linux_io_uring(bdrv_get_aio_context(bs),
+                                                    errp);
+        if (!aio) {
             error_prepend(errp, "Unable to use io_uring: ");
             goto fail;
         }
+        if (s->io_uring_fixed_buffers) {
+            ret = luring_enable_fixed_buffers(aio, errp);
+            if (ret < 0) {
+                goto fail;
+            }
+        }
     }
 #else
     if (s->use_linux_io_uring) {
@@ -2072,7 +2127,8 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, uint64_t offset,
     } else if (s->use_linux_io_uring) {
         LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
         assert(qiov->size == bytes);
-        return luring_co_submit(bs, aio, s->fd, offset, qiov, type);
+        return luring_co_submit(bs, aio, s->fd, raw_luring_file(s, aio),
+                                offset, qiov, type);
 #endif
 #ifdef CONFIG_LINUX_AIO
     } else if (s->use_linux_aio) {
@@ -2168,7 +2224,8 @@ static int raw_co_flush_to_disk(BlockDriverState *bs)
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
         LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
-        return luring_co_submit(bs, aio, s->fd, 0, NULL, QEMU_AIO_FLUSH);
+        return luring_co_submit(bs, aio, s->fd, raw_luring_file(s, aio), 0,
+                                NULL, QEMU_AIO_FLUSH);
     }
 #endif
     return raw_thread_pool_submit(bs, handle_aiocb_flush, &acb);
@@ -2191,10 +2248,15 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
         Error *local_err = NULL;
-        if (!aio_setup_linux_io_uring(new_context, &local_err)) {
+        LuringState *aio = aio_setup_linux_io_uring(new_context, &local_err);
+        if (!aio) {
             error_reportf_err(local_err, "Unable to use linux io_uring, "
                                          "falling back to thread pool: ");
             s->use_linux_io_uring = false;
+        } else if (s->io_uring_fixed_buffers &&
+                   luring_enable_fixed_buffers(aio, &local_err) < 0) {
+            error_reportf_err(local_err, "Unable to use io_uring fixed "
+                                         "buffers: ");
         }
     }
 #endif
@@ -2204,6 +2266,7 @@ static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
 
+    raw_luring_release_file(s);
     if (s->fd >= 0) {
         qemu_close(s->fd);
         s->fd = -1;
@@ -3200,6 +3263,7 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+        raw_luring_release_file(s);
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -2720,6 +2720,248 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
     return ret;
 }
 
+/*
+ * Status of the range [@offset, @offset + @bytes) of @bs alone, as
+ * bdrv_co_block_status() would return it, in up to @nb_extents extents.
+ * The driver answers for as many extents as it can at once; those that
+ * need more than its answer go through bdrv_co_block_status() one by one,
+ * cutting the batch short when that answer is shorter.
+ *
+ * Returns the number of extents filled, 0 at end of file, or a negative
+ * errno.
+ */
+static int coroutine_fn bdrv_co_block_status_batch(BlockDriverState *bs,
+                                                   bool want_zero,
+                                                   int64_t offset,
+                                                   int64_t bytes,
+                                                   BlockStatusExtent *extents,
+                                                   int nb_extents)
+{
+    int64_t total_size, end, aligned_offset, aligned_bytes;
+    uint32_t align;
+    int i, n, ret;
+
+    total_size = bdrv_getlength(bs);
+    if (total_size < 0) {
+        return total_size;
+    }
+    if (offset >= total_size || !bytes) {
+        return 0;
+    }
+    bytes = MIN(bytes, total_size - offset);
+    end = offset + bytes;
+
+    assert(bs->drv);
+    if (!bs->drv->bdrv_co_block_status_batch) {
+        BlockStatusExtent *e = &extents[0];
+
+        ret = bdrv_co_block_status(bs, want_zero, offset, bytes, &e->bytes,
+                                   &e->map, &e->file);
+        if (ret < 0) {
+            return ret;
+        }
+        e->offset = offset;
+        e->ret = ret;
+        return 1;
+    }
+
+    bdrv_inc_in_flight(bs);
+
+    align = bs->bl.request_alignment;
+    aligned_offset = QEMU_ALIGN_DOWN(offset, align);
+    aligned_bytes = ROUND_UP(end, align) - aligned_offset;
+
+    n = bs->drv->bdrv_co_block_status_batch(bs, want_zero, aligned_offset,
+                                            aligned_bytes, extents,
+                                            nb_extents);
+    if (n < 0) {
+        goto out;
+    }
+    assert(n > 0 && n <= nb_extents && extents[0].offset == aligned_offset);
+
+    for (i = 0; i < n; i++) {
+        BlockStatusExtent *e = &extents[i];
+
+        assert(e->bytes && QEMU_IS_ALIGNED(e->bytes, align));
+        assert(!i || e->offset == extents[i - 1].offset +
+                                  extents[i - 1].bytes);
+
+        /* Clamp to the request, as bdrv_co_block_status() does */
+        if (e->offset < offset) {
+            if (e->ret & BDRV_BLOCK_OFFSET_VALID) {
+                e->map += offset - e->offset;
+            }
+            e->bytes -= offset - e->offset;
+            e->offset = offset;
+        }
+        if (e->offset + e->bytes >= end) {
+            e->bytes = end - e->offset;
+            n = i + 1;
+        }
+
+        if ((e->ret & BDRV_BLOCK_RAW) ||
+            (want_zero && (e->ret & BDRV_BLOCK_RECURSE))) {
+            int64_t pnum;
+
+            ret = bdrv_co_block_status(bs, want_zero, e->offset, e->bytes,
+                                       &pnum, &e->map, &e->file);
+            if (ret < 0) {
+                n = ret;
+                goto out;
+            }
+            e->ret = ret;
+            if (pnum < e->bytes) {
+                e->bytes = pnum;
+                n = i + 1;
+            }
+            continue;
+        }
+
+        e->ret &= ~BDRV_BLOCK_RECURSE;
+        if (e->ret & (BDRV_BLOCK_DATA | BDRV_BLOCK_ZERO)) {
+            e->ret |= BDRV_BLOCK_ALLOCATED;
+        } else if (bs->drv->supports_backing) {
+            BlockDriverState *cow_bs = bdrv_cow_bs(bs);
+
+            if (!cow_bs) {
+                e->ret |= BDRV_BLOCK_ZERO;
+            } else if (want_zero) {
+                int64_t size2 = bdrv_getlength(cow_bs);
+
+                if (size2 >= 0 && e->offset >= size2) {
+                    e->ret |= BDRV_BLOCK_ZERO;
+                }
+            }
+        }
+        if (e->offset + e->bytes == total_size) {
+            e->ret |= BDRV_BLOCK_EOF;
+        }
+    }
+
+out:
+    bdrv_dec_in_flight(bs);
+    return n;
+}
+
+/* Append @e to the @count extents of @extents, merging it if possible */
+static int bdrv_block_status_extent_add(BlockStatusExtent *extents, int count,
+                                        const BlockStatusExtent *e)
+{
+    BlockStatusExtent *prev = count ? &extents[count - 1] : NULL;
+
+    if (prev && prev->file == e->file &&
+        (prev->ret & ~BDRV_BLOCK_EOF) == (e->ret & ~BDRV_BLOCK_EOF) &&
+        (!(e->ret & BDRV_BLOCK_OFFSET_VALID) ||
+         prev->map + prev->bytes == e->map)) {
+        prev->bytes += e->bytes;
+        prev->ret |= e->ret & BDRV_BLOCK_EOF;
+        return count;
+    }
+
+    extents[count] = *e;
+    return count + 1;
+}
+
+/*
+ * Fill @extents with the status of [@offset, @offset + @bytes) of @bs
+ * and its backing chain down to @base, as consecutive calls to
+ * bdrv_co_common_block_status_above() would, but with one call into the
+ * drivers that support it for many extents.  Adjacent extents with the
+ * same status are merged.
+ *
+ * Returns the number of extents filled, at most @nb_extents and 0 only
+ * at end of file, or a negative errno.  The extents may cover less than
+ * @bytes.
+ */
+int coroutine_fn
+bdrv_co_block_status_above_batch(BlockDriverState *bs, BlockDriverState *base,
+                                 bool include_base, bool want_zero,
+                                 int64_t offset, int64_t bytes,
+                                 BlockStatusExtent *extents, int nb_extents)
+{
+    BlockDriverState *lower = bdrv_filter_or_cow_bs(bs);
+    bool dive;
+    int count = 0;
+
+    assert(!include_base || base);
+    assert(nb_extents > 0);
+
+    if (!include_base && bs == base) {
+        extents[0] = (BlockStatusExtent) {
+            .offset = offset,
+            .bytes = bytes,
+        };
+        return bytes ? 1 : 0;
+    }
+    dive = lower && bs != base && (include_base || lower != base);
+
+    while (count < nb_extents && bytes) {
+        BlockStatusExtent *e = &extents[count];
+        int i, n;
+
+        n = bdrv_co_block_status_batch(bs, want_zero, offset, bytes, e,
+                                       nb_extents - count);
+        if (n < 0) {
+            return n;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        for (i = 0; i < n; i++, e++) {
+            bool short_extent = false;
+
+            /* Dive into the backing chain like the single-extent query */
+            if (!(e->ret & BDRV_BLOCK_ALLOCATED) && dive) {
+                int64_t pnum, map = 0;
+                BlockDriverState *file = NULL;
+                int ret;
+
+                ret = bdrv_co_common_block_status_above(lower, base,
+                                                        include_base,
+                                                        want_zero, e->offset,
+                                                        e->bytes, &pnum, &map,
+                                                        &file, NULL);
+                if (ret < 0) {
+                    return ret;
+                }
+                if (pnum == 0) {
+                    /* Zeroes past the end of a shorter layer */
+                    assert(ret & BDRV_BLOCK_EOF);
+                    pnum = e->bytes;
+                    file = lower;
+                    ret = BDRV_BLOCK_ZERO | BDRV_BLOCK_ALLOCATED;
+                } else {
+                    ret &= ~BDRV_BLOCK_EOF;
+                }
+                if (pnum < e->bytes) {
+                    short_extent = true;
+                } else {
+                    ret |= e->ret & BDRV_BLOCK_EOF;
+                }
+                e->ret = ret;
+                e->bytes = pnum;
+                e->map = map;
+                e->file = file;
+            }
+
+            count = bdrv_block_status_extent_add(extents, count, e);
+            if (short_extent) {
+                break;
+            }
+        }
+
+        e = &extents[count - 1];
+        bytes -= e->offset + e->bytes - offset;
+        offset = e->offset + e->bytes;
+        if (e->ret & BDRV_BLOCK_EOF) {
+            break;
+        }
+    }
+
+    return count;
+}
+
 int bdrv_block_status_above(BlockDriverState *bs, BlockDriverState *base,
                             int64_t offset, int64_t bytes, int64_t *pnum,
                             int64_t *map, BlockDriverState **file)
@@ -16,12 +16,22 @@
 #include "block/block.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
+#include "qemu/lockable.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
+#include "exec/memory.h"
+#include "exec/ramlist.h"
 #include "trace.h"
 
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Files that can be registered at once */
+#define MAX_FIXED_FILES 64
+
+/* Largest buffer that the kernel accepts to register */
+#define MAX_FIXED_BUFFER (1 * GiB)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -56,6 +66,26 @@ typedef struct LuringState {
 
     /* I/O completion processing.  Only runs in I/O thread.  */
     QEMUBH *completion_bh;
+
+    /* Protects files and ram, which are changed from other threads */
+    QemuMutex lock;
+
+    /* Registered files, -1 for free slots, or NULL if not supported */
+    int *files;
+
+    /*
+     * With fixed buffers enabled, the guest RAM blocks, which
+     * buffers_bh registers as bufs, sorted by address.  bufs_stale is
+     * set, under lock, as soon as RAM goes away or is remapped, so
+     * that bufs is not used until buffers_bh has registered it again.
+     */
+    bool fixed_buffers;
+    RAMBlockNotifier ram_notifier;
+    GArray *ram;
+    QEMUBH *buffers_bh;
+    struct iovec *bufs;
+    unsigned int nr_bufs;
+    bool bufs_stale;
 } LuringState;
 
 /**
@@ -221,6 +251,55 @@ end:
     qemu_bh_cancel(s->completion_bh);
 }
 
+/* Find the registered buffer that holds @iov, or return -1 */
+static int luring_find_buffer(LuringState *s, const struct iovec *iov)
+{
+    unsigned int lo = 0, hi = s->nr_bufs;
+    uintptr_t addr = (uintptr_t)iov->iov_base;
+
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        uintptr_t base = (uintptr_t)s->bufs[mid].iov_base;
+
+        if (addr < base) {
+            hi = mid;
+        } else if (addr - base >= s->bufs[mid].iov_len) {
+            lo = mid + 1;
+        } else {
+            return iov->iov_len <= s->bufs[mid].iov_len - (addr - base) ?
+                   mid : -1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Turn a read or write of a single vector into guest RAM into a
+ * READ_FIXED or WRITE_FIXED, so that the kernel need not pin its
+ * pages.  This is done as the request goes to the ring, as buffers may
+ * have been registered again since the request was queued.
+ */
+static void luring_use_fixed_buffer(LuringState *s, struct io_uring_sqe *sqe)
+{
+    const struct iovec *iov = (void *)(uintptr_t)sqe->addr;
+    int index;
+
+    if ((sqe->opcode != IORING_OP_READV && sqe->opcode != IORING_OP_WRITEV) ||
+        sqe->len != 1 || !s->nr_bufs || qatomic_read(&s->bufs_stale)) {
+        return;
+    }
+
+    index = luring_find_buffer(s, iov);
+    if (index < 0) {
+        return;
+    }
+    sqe->opcode = sqe->opcode == IORING_OP_READV ? IORING_OP_READ_FIXED :
+                                                   IORING_OP_WRITE_FIXED;
+    sqe->addr = (uintptr_t)iov->iov_base;
+    sqe->len = iov->iov_len;
+    sqe->buf_index = index;
+}
+
 static int ioq_submit(LuringState *s)
 {
     int ret = 0;
@@ -239,6 +318,7 @@ static int ioq_submit(LuringState *s)
             }
             /* Prep sqe for submission */
             *sqes = luringcb->sqeq;
+            luring_use_fixed_buffer(s, sqes);
             QSIMPLEQ_REMOVE_HEAD(&s->io_q.submit_queue, next);
         }
         ret = io_uring_submit(&s->ring);
@@ -328,7 +408,8 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
 
 /**
  * luring_do_submit:
- * @fd: file descriptor for I/O
+ * @fd: file descriptor for I/O, or index of a registered file if
+ *      @fixed_file
  * @luringcb: AIO control block
  * @s: AIO state
  * @offset: offset for request
@@ -337,8 +418,8 @@ void luring_io_unplug(BlockDriverState *bs, LuringState *s)
  * Fetches sqes from ring, adds to pending queue and preps them
  *
  */
-static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
-                            uint64_t offset, int type)
+static int luring_do_submit(int fd, bool fixed_file, LuringAIOCB *luringcb,
+                            LuringState *s, uint64_t offset, int type)
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
@@ -360,6 +441,9 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (fixed_file) {
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -377,7 +461,8 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 }
 
 int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
-                                  uint64_t offset, QEMUIOVector *qiov, int type)
+                                  int file, uint64_t offset,
+                                  QEMUIOVector *qiov, int type)
 {
     int ret;
     LuringAIOCB luringcb = {
@@ -388,7 +473,11 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
     };
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
-    ret = luring_do_submit(fd, &luringcb, s, offset, type);
+    if (file >= 0) {
+        ret = luring_do_submit(file, true, &luringcb, s, offset, type);
+    } else {
+        ret = luring_do_submit(fd, false, &luringcb, s, offset, type);
+    }
 
     if (ret < 0) {
         return ret;
@@ -400,11 +489,208 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
     return luringcb.ret;
 }
 
+/**
+ * luring_register_file:
+ * @s: AIO state
+ * @fd: file descriptor to register
+ *
+ * Register @fd with the ring, so that requests on it save the kernel
+ * the lookup of the file.  This may be called from any thread.
+ *
+ * Returns the index to pass to luring_co_submit(), or -errno.
+ */
+int luring_register_file(LuringState *s, int fd)
+{
+    int i, ret = -ENOSPC;
+
+    QEMU_LOCK_GUARD(&s->lock);
+    if (!s->files) {
+        return -ENOTSUP;
+    }
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->files[i] == -1) {
+            ret = io_uring_register_files_update(&s->ring, i, &fd, 1);
+            if (ret == 1) {
+                s->files[i] = fd;
+                ret = i;
+            }
+            break;
+        }
+    }
+    trace_luring_register_file(s, fd, ret);
+    return ret;
+}
+
+/* Unregister the file at @index, before it is closed */
+void luring_unregister_file(LuringState *s, int index)
+{
+    int fd = -1;
+
+    QEMU_LOCK_GUARD(&s->lock);
+    assert(s->files && s->files[index] != -1);
+    io_uring_register_files_update(&s->ring, index, &fd, 1);
+    s->files[index] = -1;
+}
+
+static gint luring_ram_compare(gconstpointer a, gconstpointer b)
+{
+    uintptr_t x = (uintptr_t)((const struct iovec *)a)->iov_base;
+    uintptr_t y = (uintptr_t)((const struct iovec *)b)->iov_base;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Register the guest RAM blocks as they are now, in the I/O thread */
+static void luring_buffers_bh(void *opaque)
+{
+    LuringState *s = opaque;
+    GArray *bufs = g_array_new(false, false, sizeof(struct iovec));
+    unsigned int i;
+    int ret;
+
+    aio_context_acquire(s->aio_context);
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        qatomic_set(&s->bufs_stale, false);
+        for (i = 0; i < s->ram->len; i++) {
+            struct iovec ram = g_array_index(s->ram, struct iovec, i);
+            size_t done;
+
+            for (done = 0; done < ram.iov_len; done += MAX_FIXED_BUFFER) {
+                struct iovec iov = {
+                    .iov_base = ram.iov_base + done,
+                    .iov_len = MIN(ram.iov_len - done, MAX_FIXED_BUFFER),
+                };
+                g_array_append_val(bufs, iov);
+            }
+        }
+    }
+    g_array_sort(bufs, luring_ram_compare);
+
+    if (s->nr_bufs) {
+        io_uring_unregister_buffers(&s->ring);
+        g_free(s->bufs);
+        s->bufs = NULL;
+        s->nr_bufs = 0;
+    }
+
+    ret = bufs->len ? io_uring_register_buffers(&s->ring,
+                                                (struct iovec *)bufs->data,
+                                                bufs->len) : 0;
+    trace_luring_register_buffers(s, bufs->len, ret);
+    if (ret == 0 && bufs->len) {
+        s->nr_bufs = bufs->len;
+        s->bufs = (struct iovec *)g_array_free(bufs, false);
+    } else {
+        g_array_free(bufs, true);
+    }
+    aio_context_release(s->aio_context);
+}
+
+static void luring_ram_block_added(RAMBlockNotifier *n, void *host,
+                                   size_t size, size_t max_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+    struct iovec iov = { .iov_base = host, .iov_len = size };
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        g_array_append_val(s->ram, iov);
+    }
+    qemu_bh_schedule(s->buffers_bh);
+}
+
+static void luring_ram_block_removed(RAMBlockNotifier *n, void *host,
+                                     size_t size, size_t max_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+    unsigned int i;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        for (i = 0; i < s->ram->len; i++) {
+            if (g_array_index(s->ram, struct iovec, i).iov_base == host) {
+                g_array_remove_index_fast(s->ram, i);
+                break;
+            }
+        }
+        qatomic_set(&s->bufs_stale, true);
+    }
+    qemu_bh_schedule(s->buffers_bh);
+}
+
+static void luring_ram_block_resized(RAMBlockNotifier *n, void *host,
+                                     size_t old_size, size_t new_size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+    unsigned int i;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        for (i = 0; i < s->ram->len; i++) {
+            struct iovec *iov = &g_array_index(s->ram, struct iovec, i);
+
+            if (iov->iov_base == host) {
+                iov->iov_len = new_size;
+                break;
+            }
+        }
+        qatomic_set(&s->bufs_stale, true);
+    }
+    qemu_bh_schedule(s->buffers_bh);
+}
+
+/*
+ * The registered buffers still hold the pages that were mapped before,
+ * so I/O to them would miss the new memory.
+ */
+static void luring_ram_block_remapped(RAMBlockNotifier *n, void *host,
+                                      size_t size)
+{
+    LuringState *s = container_of(n, LuringState, ram_notifier);
+
+    WITH_QEMU_LOCK_GUARD(&s->lock) {
+        qatomic_set(&s->bufs_stale, true);
+    }
+    qemu_bh_schedule(s->buffers_bh);
+}
+
+/**
+ * luring_enable_fixed_buffers:
+ * @s: AIO state
+ *
+ * Register guest RAM with the ring, and keep it registered as RAM blocks
+ * come and go, so that I/O to and from guest RAM can use fixed buffers.
+ * That pins guest RAM, so it also disables RAM discards.
+ *
+ * Returns 0 on success, or -errno.
+ */
+int luring_enable_fixed_buffers(LuringState *s, Error **errp)
+{
+    int ret;
+
+    if (s->fixed_buffers) {
+        return 0;
+    }
+
+    ret = ram_block_discard_disable(true);
+    if (ret) {
+        error_setg_errno(errp, -ret, "Cannot set discarding of RAM broken");
+        return ret;
+    }
+
+    s->fixed_buffers = true;
+    s->ram_notifier.ram_block_added = luring_ram_block_added;
+    s->ram_notifier.ram_block_removed = luring_ram_block_removed;
+    s->ram_notifier.ram_block_resized = luring_ram_block_resized;
+    s->ram_notifier.ram_block_remapped = luring_ram_block_remapped;
+    ram_block_notifier_add(&s->ram_notifier);
+    return 0;
+}
+
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
     aio_set_fd_handler(old_context, s->ring.ring_fd, false, NULL, NULL, NULL,
                        s);
     qemu_bh_delete(s->completion_bh);
+    qemu_bh_delete(s->buffers_bh);
     s->aio_context = NULL;
 }
 
@@ -412,19 +698,27 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
 {
     s->aio_context = new_context;
     s->completion_bh = aio_bh_new(new_context, qemu_luring_completion_bh, s);
+    s->buffers_bh = aio_bh_new(new_context, luring_buffers_bh, s);
     aio_set_fd_handler(s->aio_context, s->ring.ring_fd, false,
                        qemu_luring_completion_cb, NULL, qemu_luring_poll_cb, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(int sqpoll_cpu, Error **errp)
 {
-    int rc;
+    int rc, i;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
+    struct io_uring_params params = {};
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    /* A kernel thread on @sqpoll_cpu picks up the requests */
+    if (sqpoll_cpu >= 0) {
+        params.flags = IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF;
+        params.sq_thread_cpu = sqpoll_cpu;
+    }
+
+    rc = io_uring_queue_init_params(MAX_ENTRIES, ring, &params);
     if (rc < 0) {
         error_setg_errno(errp, errno, "failed to init linux io_uring ring");
         g_free(s);
@@ -432,13 +726,33 @@ LuringState *luring_init(Error **errp)
     }
 
     ioq_init(&s->io_q);
+    qemu_mutex_init(&s->lock);
+    s->ram = g_array_new(false, false, sizeof(struct iovec));
+
+    /* Start with empty slots; older kernels cannot register files */
+    s->files = g_new(int, MAX_FIXED_FILES);
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        s->files[i] = -1;
+    }
+    if (io_uring_register_files(ring, s->files, MAX_FIXED_FILES) < 0) {
+        g_free(s->files);
+        s->files = NULL;
+    }
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    if (s->fixed_buffers) {
+        ram_block_notifier_remove(&s->ram_notifier);
+        ram_block_discard_disable(false);
+    }
     io_uring_queue_exit(&s->ring);
+    g_array_free(s->ram, true);
+    g_free(s->bufs);
+    g_free(s->files);
+    qemu_mutex_destroy(&s->lock);
     trace_luring_cleanup_state(s);
     g_free(s);
 }
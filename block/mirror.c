@@ -27,6 +27,8 @@
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
+/* Block status extents queried at once */
+#define MIRROR_STATUS_EXTENTS 64
 
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
@@ -83,6 +85,9 @@ typedef struct MirrorBlockJob {
     int in_active_write_counter;
     bool prepared;
     bool in_drain;
+    /* Block status of the source, for the current iteration */
+    BlockStatusExtent status[MIRROR_STATUS_EXTENTS];
+    int status_count;
 } MirrorBlockJob;
 
 typedef struct MirrorBDSOpaque {
@@ -472,6 +477,40 @@ static unsigned mirror_perform(MirrorBlockJob *s, int64_t offset,
     return bytes_handled;
 }
 
+/*
+ * Block status of the source at @offset, from the extents of the last
+ * query of this iteration if they cover it
+ */
+static int coroutine_fn mirror_block_status(MirrorBlockJob *s,
+                                            BlockDriverState *source,
+                                            int64_t offset, int64_t bytes,
+                                            int64_t *pnum)
+{
+    BlockStatusExtent *e;
+    int i, ret;
+
+    for (i = 0; i < s->status_count; i++) {
+        e = &s->status[i];
+        if (offset >= e->offset && offset < e->offset + e->bytes) {
+            goto found;
+        }
+    }
+
+    ret = bdrv_co_block_status_above_batch(source, NULL, false, true, offset,
+                                           bytes, s->status,
+                                           MIRROR_STATUS_EXTENTS);
+    s->status_count = MAX(ret, 0);
+    if (ret <= 0) {
+        *pnum = 0;
+        return ret < 0 ? ret : BDRV_BLOCK_EOF;
+    }
+    e = &s->status[0];
+
+found:
+    *pnum = MIN(bytes, e->offset + e->bytes - offset);
+    return e->ret;
+}
+
 static uint64_t coroutine_fn mirror_iteration(MirrorBlockJob *s)
 {
     BlockDriverState *source = s->mirror_top_bs->backing->bs;
@@ -529,6 +568,7 @@ static uint64_t coroutine_fn mirror_iteration(MirrorBlockJob *s)
     bdrv_reset_dirty_bitmap_locked(s->dirty_bitmap, offset,
                                    nb_chunks * s->granularity);
     bdrv_dirty_bitmap_unlock(s->dirty_bitmap);
+    s->status_count = 0;
 
     /* Before claiming an area in the in-flight bitmap, we have to
      * create a MirrorOp for it so that conflicting requests can wait
@@ -553,9 +593,8 @@ static uint64_t coroutine_fn mirror_iteration(MirrorBlockJob *s)
         MirrorMethod mirror_method = MIRROR_METHOD_COPY;
 
         assert(!(offset % s->granularity));
-        ret = bdrv_block_status_above(source, NULL, offset,
-                                      nb_chunks * s->granularity,
-                                      &io_bytes, NULL, NULL);
+        ret = mirror_block_status(s, source, offset,
+                                  nb_chunks * s->granularity, &io_bytes);
         if (ret < 0) {
             io_bytes = MIN(nb_chunks * s->granularity, max_io_bytes);
         } else if (ret & BDRV_BLOCK_DATA) {
@@ -817,8 +856,8 @@ static int coroutine_fn mirror_dirty_init(MirrorBlockJob *s)
     int64_t offset;
     BlockDriverState *bs = s->mirror_top_bs->backing->bs;
     BlockDriverState *target_bs = blk_bs(s->target);
-    int ret;
-    int64_t count;
+    BlockStatusExtent *extents = s->status;
+    int i, ret;
 
     if (s->zero_target) {
         if (!bdrv_can_write_zeroes_with_unmap(target_bs)) {
@@ -865,17 +904,21 @@ static int coroutine_fn mirror_dirty_init(MirrorBlockJob *s)
             return 0;
         }
 
-        ret = bdrv_is_allocated_above(bs, s->base_overlay, true, offset, bytes,
-                                      &count);
+        ret = bdrv_co_block_status_above_batch(bs, s->base_overlay, true,
+                                               false, offset, bytes, extents,
+                                               MIRROR_STATUS_EXTENTS);
         if (ret < 0) {
             return ret;
         }
 
-        assert(count);
-        if (ret > 0) {
-            bdrv_set_dirty_bitmap(s->dirty_bitmap, offset, count);
+        assert(ret);
+        for (i = 0; i < ret; i++) {
+            if (extents[i].ret & BDRV_BLOCK_ALLOCATED) {
+                bdrv_set_dirty_bitmap(s->dirty_bitmap, extents[i].offset,
+                                      extents[i].bytes);
+            }
         }
-        offset += count;
+        offset = extents[ret - 1].offset + extents[ret - 1].bytes;
     }
     return 0;
 }
@@ -23,14 +23,27 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/mem-usage.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/*
+ * Tables are looked up through a hash table of their offsets, so that
+ * lookups stay O(1) however big the cache is.  On a miss, the table
+ * to replace is picked with the CLOCK algorithm: the clock hand goes
+ * round the entries, and takes the first unused one that was not used
+ * since the hand last went past it.
+ */
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
+    /* Next entry in the same hash bucket, or -1 */
+    int      next;
     bool     dirty;
+    /* Whether the entry was used since the clock hand went past it */
+    bool     referenced;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -42,6 +55,10 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+    /* First entry of each hash bucket, or -1 */
+    int                    *buckets;
+    int                     hash_bits;
+    int                     clock_hand;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -57,6 +74,49 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline unsigned int qcow2_cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    return (offset / c->table_size * 0x9e3779b97f4a7c15ULL) >>
+           (64 - c->hash_bits);
+}
+
+/* Returns the index of the entry that caches @offset, or -1 */
+static int qcow2_cache_find(Qcow2Cache *c, uint64_t offset)
+{
+    int i;
+
+    for (i = c->buckets[qcow2_cache_hash(c, offset)]; i >= 0;
+         i = c->entries[i].next) {
+        if (c->entries[i].offset == offset) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Make entry @i cache @offset, or nothing if @offset is 0 */
+static void qcow2_cache_set_offset(Qcow2Cache *c, int i, int64_t offset)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+
+    if (t->offset) {
+        int *p = &c->buckets[qcow2_cache_hash(c, t->offset)];
+
+        while (*p != i) {
+            p = &c->entries[*p].next;
+        }
+        *p = t->next;
+    }
+
+    t->offset = offset;
+    if (offset) {
+        unsigned int h = qcow2_cache_hash(c, offset);
+
+        t->next = c->buckets[h];
+        c->buckets[h] = i;
+    }
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -104,7 +164,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
+            qcow2_cache_set_offset(c, i, 0);
             c->entries[i].lru_counter = 0;
             i++;
             to_clean++;
@@ -123,6 +183,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int nr_buckets;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -135,12 +196,20 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
+    nr_buckets = pow2ceil(MAX(num_tables, 2));
+    c->hash_bits = ctz32(nr_buckets);
+    c->buckets = g_try_new(int, nr_buckets);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->table_array || !c->buckets) {
         qemu_vfree(c->table_array);
         g_free(c->entries);
+        g_free(c->buckets);
         g_free(c);
         c = NULL;
+    } else {
+        memset(c->buckets, -1, nr_buckets * sizeof(int));
+        mem_usage_add(MEMORY_USAGE_SUBSYSTEM_BLOCK_CACHE,
+                      (size_t) num_tables * c->table_size);
     }
 
     return c;
@@ -154,8 +223,11 @@ int qcow2_cache_destroy(Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
     }
 
+    mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_BLOCK_CACHE,
+                  (size_t) c->size * c->table_size);
     qemu_vfree(c->table_array);
     g_free(c->entries);
+    g_free(c->buckets);
     g_free(c);
 
     return 0;
@@ -305,8 +377,9 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
 
     for (i = 0; i < c->size; i++) {
         assert(c->entries[i].ref == 0);
-        c->entries[i].offset = 0;
+        qcow2_cache_set_offset(c, i, 0);
         c->entries[i].lru_counter = 0;
+        c->entries[i].referenced = false;
     }
 
     qcow2_cache_table_release(c, 0, c->size);
@@ -316,15 +389,37 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
     return 0;
 }
 
+/* Returns the index of the entry to replace, or -1 if all are in use */
+static int qcow2_cache_find_victim(Qcow2Cache *c)
+{
+    int n;
+
+    /* The second round finds any unused entry, referenced or not */
+    for (n = 0; n < 2 * c->size; n++) {
+        int i = c->clock_hand;
+        Qcow2CachedTable *t = &c->entries[i];
+
+        if (++c->clock_hand == c->size) {
+            c->clock_hand = 0;
+        }
+        if (t->ref > 0) {
+            continue;
+        }
+        if (t->offset && t->referenced) {
+            t->referenced = false;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
 static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     uint64_t offset, void **table, bool read_from_disk)
 {
     BDRVQcow2State *s = bs->opaque;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -339,29 +434,19 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    i = qcow2_cache_find(c, offset);
+    if (i >= 0) {
+        goto found;
+    }
 
-    if (min_lru_index == -1) {
+    i = qcow2_cache_find_victim(c);
+    if (i == -1) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -372,7 +457,7 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    qcow2_cache_set_offset(c, i, 0);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -386,7 +471,7 @@ static int qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c,
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_set_offset(c, i, offset);
 
     /* And return the right table */
 found:
@@ -420,6 +505,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        c->entries[i].referenced = true;
     }
 
     assert(c->entries[i].ref >= 0);
@@ -434,14 +520,9 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_find(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i >= 0 ? qcow2_cache_get_table_addr(c, i) : NULL;
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -450,9 +531,10 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
+    qcow2_cache_set_offset(c, i, 0);
     c->entries[i].lru_counter = 0;
     c->entries[i].dirty = false;
+    c->entries[i].referenced = false;
 
     qcow2_cache_table_release(c, i, 1);
 }
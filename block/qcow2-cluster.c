@@ -27,6 +27,7 @@
 
 #include "qapi/error.h"
 #include "qcow2.h"
+#include "crypto/hash.h"
 #include "qemu/bswap.h"
 #include "trace.h"
 
@@ -1613,7 +1614,8 @@ static int do_alloc_cluster_offset(BlockDriverState *bs, uint64_t guest_offset,
     trace_qcow2_cluster_alloc_phys(qemu_coroutine_self());
     if (*host_offset == INV_OFFSET) {
         int64_t cluster_offset =
-            qcow2_alloc_clusters(bs, *nb_clusters * s->cluster_size);
+            qcow2_alloc_data_clusters(bs, start_of_cluster(s, guest_offset),
+                                      nb_clusters);
         if (cluster_offset < 0) {
             return cluster_offset;
         }
@@ -2494,6 +2496,252 @@ fail:
     return ret;
 }
 
+/* A data cluster of the active L2 tables, by the hash of its contents */
+typedef struct Qcow2DedupeCluster {
+    uint64_t hash;              /* the key */
+    uint64_t host_offset;
+    uint64_t slice_offset;      /* of the L2 slice that references it */
+    int index;                  /* in that slice */
+    bool copied;                /* whether its entry has QCOW_OFLAG_COPIED */
+} Qcow2DedupeCluster;
+
+static int qcow2_dedupe_hash(const uint8_t *buf, size_t len, uint64_t *hash,
+                             Error **errp)
+{
+    g_autofree uint8_t *result = NULL;
+    size_t resultlen = 0;
+
+    if (qcrypto_hash_bytes(QCRYPTO_HASH_ALG_SHA256, (const char *)buf, len,
+                           &result, &resultlen, errp) < 0) {
+        return -EIO;
+    }
+    *hash = ldq_le_p(result);
+    return 0;
+}
+
+/* Make the L2 entry of @c share its cluster, without QCOW_OFLAG_COPIED */
+static int qcow2_dedupe_uncopy(BlockDriverState *bs, Qcow2DedupeCluster *c,
+                               uint64_t *l2_slice, uint64_t slice_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t *other = l2_slice;
+    int ret;
+
+    if (c->slice_offset != slice_offset) {
+        ret = qcow2_cache_get(bs, s->l2_table_cache, c->slice_offset,
+                              (void **)&other);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    set_l2_entry(s, other, c->index, c->host_offset);
+    qcow2_cache_entry_mark_dirty(s->l2_table_cache, other);
+    c->copied = false;
+
+    if (other != l2_slice) {
+        qcow2_cache_put(s->l2_table_cache, (void **)&other);
+    }
+    return 0;
+}
+
+/*
+ * Make the data clusters of the active L2 tables that have the same
+ * contents share a single host cluster, as internal snapshots do, and
+ * return the others to the free space.  *@shared is set to the number
+ * of clusters given up.
+ *
+ * L2 tables that are shared with snapshots are left alone, since
+ * changing them would change the snapshots.
+ */
+int qcow2_dedupe(BlockDriverState *bs, BlockDriverAmendStatusCB *status_cb,
+                 void *cb_opaque, int64_t *shared, Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    g_autoptr(GHashTable) seen = NULL;
+    uint8_t *buf = NULL, *other_buf = NULL;
+    uint64_t *l2_slice = NULL;
+    unsigned slice, slice_size2, n_slices;
+    int ret = 0;
+    int i, j;
+
+    *shared = 0;
+
+    if (has_data_file(bs)) {
+        error_setg(errp, "Cannot deduplicate images with an external data "
+                   "file");
+        return -ENOTSUP;
+    }
+    if (s->crypto) {
+        error_setg(errp, "Cannot deduplicate encrypted images");
+        return -ENOTSUP;
+    }
+    if (has_subclusters(s)) {
+        error_setg(errp, "Cannot deduplicate images with subclusters");
+        return -ENOTSUP;
+    }
+
+    buf = qemu_try_blockalign(bs->file->bs, s->cluster_size);
+    other_buf = qemu_try_blockalign(bs->file->bs, s->cluster_size);
+    if (!buf || !other_buf) {
+        error_setg(errp, "Cannot allocate cluster buffers");
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    seen = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+    slice_size2 = s->l2_slice_size * l2_entry_size(s);
+    n_slices = s->cluster_size / slice_size2;
+
+    if (s->use_lazy_refcounts) {
+        qcow2_mark_dirty(bs);
+    }
+
+    for (i = 0; i < s->l1_size; i++) {
+        uint64_t l2_offset = s->l1_table[i] & L1E_OFFSET_MASK;
+
+        if (!l2_offset || !(s->l1_table[i] & QCOW_OFLAG_COPIED)) {
+            goto next;
+        }
+
+        for (slice = 0; slice < n_slices; slice++) {
+            uint64_t slice_offset = l2_offset + slice * slice_size2;
+
+            ret = qcow2_cache_get(bs, s->l2_table_cache, slice_offset,
+                                  (void **)&l2_slice);
+            if (ret < 0) {
+                error_setg_errno(errp, -ret, "Cannot read L2 table");
+                goto out;
+            }
+
+            for (j = 0; j < s->l2_slice_size; j++) {
+                uint64_t l2_entry = get_l2_entry(s, l2_slice, j);
+                uint64_t offset = l2_entry & L2E_OFFSET_MASK;
+                Qcow2DedupeCluster *c;
+                uint64_t hash, refcount;
+
+                if (qcow2_get_cluster_type(bs, l2_entry) !=
+                    QCOW2_CLUSTER_NORMAL) {
+                    continue;
+                }
+                if (offset_into_cluster(s, offset)) {
+                    qcow2_signal_corruption(bs, true, -1, -1,
+                                            "Data cluster offset %#" PRIx64
+                                            " unaligned (L2 offset: %#"
+                                            PRIx64 ", L2 index: %#x)", offset,
+                                            l2_offset,
+                                            slice * s->l2_slice_size + j);
+                    ret = -EIO;
+                    error_setg(errp, "Image is corrupt");
+                    goto out;
+                }
+
+                ret = bdrv_pread(bs->file, offset, buf, s->cluster_size);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "Cannot read data cluster");
+                    goto out;
+                }
+                ret = qcow2_dedupe_hash(buf, s->cluster_size, &hash, errp);
+                if (ret < 0) {
+                    goto out;
+                }
+
+                c = g_hash_table_lookup(seen, &hash);
+                if (!c) {
+                    c = g_new(Qcow2DedupeCluster, 1);
+                    *c = (Qcow2DedupeCluster) {
+                        .hash = hash,
+                        .host_offset = offset,
+                        .slice_offset = slice_offset,
+                        .index = j,
+                        .copied = l2_entry & QCOW_OFLAG_COPIED,
+                    };
+                    g_hash_table_insert(seen, &c->hash, c);
+                    continue;
+                }
+                if (c->host_offset == offset) {
+                    continue;
+                }
+
+                /* The hash only picks candidates */
+                ret = bdrv_pread(bs->file, c->host_offset, other_buf,
+                                 s->cluster_size);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "Cannot read data cluster");
+                    goto out;
+                }
+                if (memcmp(buf, other_buf, s->cluster_size)) {
+                    continue;
+                }
+
+                ret = qcow2_get_refcount(bs, c->host_offset >> s->cluster_bits,
+                                         &refcount);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "Cannot get refcount");
+                    goto out;
+                }
+                if (refcount >= s->refcount_max) {
+                    continue;
+                }
+
+                /* The new reference must be counted before it exists */
+                ret = qcow2_update_cluster_refcount(
+                    bs, c->host_offset >> s->cluster_bits, 1, false,
+                    QCOW2_DISCARD_NEVER);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "Cannot update refcount");
+                    goto out;
+                }
+                if (qcow2_need_accurate_refcounts(s)) {
+                    qcow2_cache_set_dependency(bs, s->l2_table_cache,
+                                               s->refcount_block_cache);
+                }
+
+                if (c->copied) {
+                    ret = qcow2_dedupe_uncopy(bs, c, l2_slice, slice_offset);
+                    if (ret < 0) {
+                        error_setg_errno(errp, -ret, "Cannot read L2 table");
+                        goto out;
+                    }
+                }
+                set_l2_entry(s, l2_slice, j, c->host_offset);
+                qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+
+                /* Does not go to disk before the L2 entry no longer uses it */
+                ret = qcow2_update_cluster_refcount(bs,
+                                                    offset >> s->cluster_bits,
+                                                    1, true,
+                                                    QCOW2_DISCARD_OTHER);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "Cannot update refcount");
+                    goto out;
+                }
+                (*shared)++;
+            }
+
+            qcow2_cache_put(s->l2_table_cache, (void **)&l2_slice);
+        }
+
+next:
+        if (status_cb) {
+            status_cb(bs, i + 1, s->l1_size, cb_opaque);
+        }
+    }
+
+    ret = qcow2_flush_caches(bs);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot flush metadata");
+    }
+
+out:
+    if (l2_slice) {
+        qcow2_cache_put(s->l2_table_cache, (void **)&l2_slice);
+    }
+    qemu_vfree(buf);
+    qemu_vfree(other_buf);
+    return ret;
+}
+
 void qcow2_parse_compressed_l2_entry(BlockDriverState *bs, uint64_t l2_entry,
                                      uint64_t *coffset, int *csize)
 {
@@ -25,6 +25,7 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qcow2.h"
+#include "block/aio_task.h"
 #include "qemu/range.h"
 #include "qemu/bswap.h"
 #include "qemu/cutils.h"
@@ -1026,6 +1027,87 @@ int64_t qcow2_alloc_clusters(BlockDriverState *bs, uint64_t size)
     return offset;
 }
 
+static void qcow2_release_alloc_extent(BlockDriverState *bs,
+                                       Qcow2AllocExtent *e)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (e->nb_clusters) {
+        qcow2_free_clusters(bs, e->host_offset,
+                            e->nb_clusters << s->cluster_bits,
+                            QCOW2_DISCARD_NEVER);
+        e->nb_clusters = 0;
+    }
+}
+
+/*
+ * Give back the clusters reserved for writers, before anything that
+ * expects every cluster with a refcount to be in use.  A crash leaves
+ * them leaked, which is harmless.
+ */
+void qcow2_release_alloc_extents(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < QCOW2_ALLOC_EXTENTS; i++) {
+        qcow2_release_alloc_extent(bs, &s->alloc_extents[i]);
+    }
+}
+
+/*
+ * Allocate up to *nb_clusters host clusters for the guest clusters at
+ * @guest_offset, a cluster boundary.  The clusters come from the extent
+ * reserved by the writer that stopped at @guest_offset, if any, so that
+ * writers going on in parallel each get contiguous host clusters, and
+ * refcounts are raised once per extent rather than once per write.
+ * *nb_clusters is reduced to what the extent has left.
+ *
+ * Return the offset of the first cluster, or -errno.
+ */
+int64_t qcow2_alloc_data_clusters(BlockDriverState *bs, uint64_t guest_offset,
+                                  uint64_t *nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t extent_clusters = QCOW2_ALLOC_EXTENT_SIZE >> s->cluster_bits;
+    Qcow2AllocExtent *e;
+    int64_t offset;
+    uint64_t n;
+    int i;
+
+    if (extent_clusters <= 1) {
+        return qcow2_alloc_clusters(bs, *nb_clusters << s->cluster_bits);
+    }
+
+    for (i = 0; i < QCOW2_ALLOC_EXTENTS; i++) {
+        e = &s->alloc_extents[i];
+        if (e->nb_clusters && e->guest_offset == guest_offset) {
+            goto take;
+        }
+    }
+
+    e = &s->alloc_extents[s->alloc_extent_next];
+    s->alloc_extent_next = (s->alloc_extent_next + 1) % QCOW2_ALLOC_EXTENTS;
+    qcow2_release_alloc_extent(bs, e);
+
+    n = MAX(*nb_clusters, extent_clusters);
+    offset = qcow2_alloc_clusters(bs, n << s->cluster_bits);
+    if (offset < 0) {
+        return offset;
+    }
+    trace_qcow2_alloc_extent(qemu_coroutine_self(), guest_offset, offset, n);
+    e->host_offset = offset;
+    e->nb_clusters = n;
+
+take:
+    *nb_clusters = MIN(*nb_clusters, e->nb_clusters);
+    offset = e->host_offset;
+    e->host_offset += *nb_clusters << s->cluster_bits;
+    e->nb_clusters -= *nb_clusters;
+    e->guest_offset = guest_offset + (*nb_clusters << s->cluster_bits);
+    return offset;
+}
+
 int64_t qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
                                 int64_t nb_clusters)
 {
@@ -1649,8 +1731,8 @@ fail:
 
 /*
  * Increases the refcount in the given refcount table for the all clusters
- * referenced in the L2 table. While doing so, performs some checks on L2
- * entries.
+ * referenced in the L2 table at @l2_offset, whose contents the caller has
+ * read into @l2_table. While doing so, performs some checks on L2 entries.
  *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
@@ -1658,24 +1740,15 @@ fail:
 static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                               void **refcount_table,
                               int64_t *refcount_table_size, int64_t l2_offset,
+                              uint64_t *l2_table,
                               int flags, BdrvCheckMode fix, bool active)
 {
     BDRVQcow2State *s = bs->opaque;
     uint64_t l2_entry, l2_bitmap;
     uint64_t next_contiguous_offset = 0;
     int i, ret;
-    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
-    g_autofree uint64_t *l2_table = g_malloc(l2_size_bytes);
     bool metadata_overlap;
 
-    /* Read L2 table from disk */
-    ret = bdrv_pread(bs->file, l2_offset, l2_table, l2_size_bytes);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
-        res->check_errors++;
-        return ret;
-    }
-
     /* Do the actual checks */
     for (i = 0; i < s->l2_size; i++) {
         uint64_t coffset;
@@ -1846,6 +1919,123 @@ static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
     return 0;
 }
 
+/* How much of the L2 tables check_refcounts_l1() reads ahead */
+#define QCOW2_CHECK_L2_READAHEAD (8 * MiB)
+
+typedef struct Qcow2CheckReadTask {
+    AioTask task;
+    BlockDriverState *bs;
+    uint64_t offset;
+    void *buf;
+    size_t bytes;
+} Qcow2CheckReadTask;
+
+static int coroutine_fn qcow2_check_read_task_entry(AioTask *task)
+{
+    Qcow2CheckReadTask *t = container_of(task, Qcow2CheckReadTask, task);
+
+    return bdrv_co_pread(t->bs->file, t->offset, t->bytes, t->buf, 0);
+}
+
+/*
+ * Read the @n L2 tables at @l2_offsets into consecutive slices of @buf.
+ * In coroutine context the reads are issued in parallel, so that checking
+ * a large image is not bound by the latency of one read at a time.
+ */
+static int check_read_l2_tables(BlockDriverState *bs, uint64_t *l2_offsets,
+                                int n, void *buf, size_t l2_size_bytes)
+{
+    AioTaskPool *pool;
+    int i, ret;
+
+    if (!qemu_in_coroutine()) {
+        for (i = 0; i < n; i++) {
+            ret = bdrv_pread(bs->file, l2_offsets[i],
+                             buf + i * l2_size_bytes, l2_size_bytes);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        return 0;
+    }
+
+    pool = aio_task_pool_new(QCOW2_MAX_WORKERS);
+    for (i = 0; i < n && aio_task_pool_status(pool) == 0; i++) {
+        Qcow2CheckReadTask *task = g_new(Qcow2CheckReadTask, 1);
+
+        *task = (Qcow2CheckReadTask) {
+            .task.func = qcow2_check_read_task_entry,
+            .bs = bs,
+            .offset = l2_offsets[i],
+            .buf = buf + i * l2_size_bytes,
+            .bytes = l2_size_bytes,
+        };
+        aio_task_pool_start_task(pool, &task->task);
+    }
+    aio_task_pool_wait_all(pool);
+    ret = aio_task_pool_status(pool);
+    aio_task_pool_free(pool);
+
+    return ret;
+}
+
+/*
+ * Run the checks on @n entries of an L1 table, whose non-zero entries have
+ * their L2 tables one after the other in @l2_tables.
+ */
+static int check_refcounts_l1_batch(BlockDriverState *bs,
+                                    BdrvCheckResult *res,
+                                    void **refcount_table,
+                                    int64_t *refcount_table_size,
+                                    uint64_t *l1_table, int n,
+                                    uint64_t *l2_tables,
+                                    int flags, BdrvCheckMode fix, bool active)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t l2_offset;
+    int i, ret;
+
+    for (i = 0; i < n; i++) {
+        if (!l1_table[i]) {
+            continue;
+        }
+
+        if (l1_table[i] & L1E_RESERVED_MASK) {
+            fprintf(stderr, "ERROR found L1 entry with reserved bits set: "
+                    "%" PRIx64 "\n", l1_table[i]);
+            res->corruptions++;
+        }
+
+        l2_offset = l1_table[i] & L1E_OFFSET_MASK;
+
+        /* Mark L2 table as used */
+        ret = qcow2_inc_refcounts_imrt(bs, res,
+                                       refcount_table, refcount_table_size,
+                                       l2_offset, s->cluster_size);
+        if (ret < 0) {
+            return ret;
+        }
+
+        /* L2 tables are cluster aligned */
+        if (offset_into_cluster(s, l2_offset)) {
+            fprintf(stderr, "ERROR l2_offset=%" PRIx64 ": Table is not "
+                "cluster aligned; L1 entry corrupted\n", l2_offset);
+            res->corruptions++;
+        }
+
+        /* Process and check L2 entries */
+        ret = check_refcounts_l2(bs, res, refcount_table,
+                                 refcount_table_size, l2_offset, l2_tables,
+                                 flags, fix, active);
+        if (ret < 0) {
+            return ret;
+        }
+        l2_tables += s->l2_size * l2_entry_size(s) / sizeof(uint64_t);
+    }
+
+    return 0;
+}
+
 /*
  * Increases the refcount for the L1 table, its L2 tables and all referenced
  * clusters in the given refcount table. While doing so, performs some checks
@@ -1863,9 +2053,12 @@ static int check_refcounts_l1(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     size_t l1_size_bytes = l1_size * L1E_SIZE;
+    size_t l2_size_bytes = s->l2_size * l2_entry_size(s);
+    int batch_size = MAX(QCOW2_CHECK_L2_READAHEAD / l2_size_bytes, 1);
     g_autofree uint64_t *l1_table = NULL;
-    uint64_t l2_offset;
-    int i, ret;
+    g_autofree uint64_t *l2_offsets = NULL;
+    g_autofree uint64_t *l2_tables = NULL;
+    int i, j, n, ret;
 
     if (!l1_size) {
         return 0;
@@ -1896,39 +2089,35 @@ static int check_refcounts_l1(BlockDriverState *bs,
         be64_to_cpus(&l1_table[i]);
     }
 
-    /* Do the actual checks */
-    for (i = 0; i < l1_size; i++) {
-        if (!l1_table[i]) {
-            continue;
-        }
+    l2_offsets = g_new(uint64_t, batch_size);
+    l2_tables = g_try_malloc(batch_size * l2_size_bytes);
+    if (l2_tables == NULL) {
+        res->check_errors++;
+        return -ENOMEM;
+    }
 
-        if (l1_table[i] & L1E_RESERVED_MASK) {
-            fprintf(stderr, "ERROR found L1 entry with reserved bits set: "
-                    "%" PRIx64 "\n", l1_table[i]);
-            res->corruptions++;
+    /*
+     * Read the L2 tables of up to batch_size L1 entries at once, then check
+     * them in L1 order so that the report does not depend on I/O timing.
+     */
+    for (i = 0; i < l1_size; i = j) {
+        for (j = i, n = 0; j < l1_size && n < batch_size; j++) {
+            if (l1_table[j]) {
+                l2_offsets[n++] = l1_table[j] & L1E_OFFSET_MASK;
+            }
         }
 
-        l2_offset = l1_table[i] & L1E_OFFSET_MASK;
-
-        /* Mark L2 table as used */
-        ret = qcow2_inc_refcounts_imrt(bs, res,
-                                       refcount_table, refcount_table_size,
-                                       l2_offset, s->cluster_size);
+        ret = check_read_l2_tables(bs, l2_offsets, n, l2_tables,
+                                   l2_size_bytes);
         if (ret < 0) {
+            fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
+            res->check_errors++;
             return ret;
         }
 
-        /* L2 tables are cluster aligned */
-        if (offset_into_cluster(s, l2_offset)) {
-            fprintf(stderr, "ERROR l2_offset=%" PRIx64 ": Table is not "
-                "cluster aligned; L1 entry corrupted\n", l2_offset);
-            res->corruptions++;
-        }
-
-        /* Process and check L2 entries */
-        ret = check_refcounts_l2(bs, res, refcount_table,
-                                 refcount_table_size, l2_offset, flags,
-                                 fix, active);
+        ret = check_refcounts_l1_batch(bs, res, refcount_table,
+                                       refcount_table_size, l1_table + i,
+                                       j - i, l2_tables, flags, fix, active);
         if (ret < 0) {
             return ret;
         }
@@ -611,6 +611,8 @@ static int coroutine_fn qcow2_co_check_locked(BlockDriverState *bs,
 
     memset(result, 0, sizeof(*result));
 
+    qcow2_release_alloc_extents(bs);
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -2069,6 +2071,47 @@ static void qcow2_join_options(QDict *options, QDict *old_options)
     }
 }
 
+/* The block status of @bytes of @type mapped at @host_offset */
+static int qcow2_block_status(BlockDriverState *bs, QCow2SubclusterType type,
+                              uint64_t host_offset, int64_t *map,
+                              BlockDriverState **file)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int status = 0;
+
+    if ((type == QCOW2_SUBCLUSTER_NORMAL ||
+         type == QCOW2_SUBCLUSTER_ZERO_ALLOC ||
+         type == QCOW2_SUBCLUSTER_UNALLOCATED_ALLOC) && !s->crypto) {
+        *map = host_offset;
+        *file = s->data_file->bs;
+        status |= BDRV_BLOCK_OFFSET_VALID;
+    }
+    if (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
+        type == QCOW2_SUBCLUSTER_ZERO_ALLOC) {
+        status |= BDRV_BLOCK_ZERO;
+    } else if (type != QCOW2_SUBCLUSTER_UNALLOCATED_PLAIN &&
+               type != QCOW2_SUBCLUSTER_UNALLOCATED_ALLOC) {
+        status |= BDRV_BLOCK_DATA;
+    }
+    if (s->metadata_preallocation && (status & BDRV_BLOCK_DATA) &&
+        (status & BDRV_BLOCK_OFFSET_VALID))
+    {
+        status |= BDRV_BLOCK_RECURSE;
+    }
+    return status;
+}
+
+static void coroutine_fn qcow2_check_metadata_preallocation(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (!s->metadata_preallocation_checked) {
+        int ret = qcow2_detect_metadata_preallocation(bs);
+        s->metadata_preallocation = (ret == 1);
+        s->metadata_preallocation_checked = true;
+    }
+}
+
 static int coroutine_fn qcow2_co_block_status(BlockDriverState *bs,
                                               bool want_zero,
                                               int64_t offset, int64_t count,
@@ -2079,15 +2122,11 @@ static int coroutine_fn qcow2_co_block_status(BlockDriverState *bs,
     uint64_t host_offset;
     unsigned int bytes;
     QCow2SubclusterType type;
-    int ret, status = 0;
+    int ret;
 
     qemu_co_mutex_lock(&s->lock);
 
-    if (!s->metadata_preallocation_checked) {
-        ret = qcow2_detect_metadata_preallocation(bs);
-        s->metadata_preallocation = (ret == 1);
-        s->metadata_preallocation_checked = true;
-    }
+    qcow2_check_metadata_preallocation(bs);
 
     bytes = MIN(INT_MAX, count);
     ret = qcow2_get_host_offset(bs, offset, &bytes, &host_offset, &type);
@@ -2097,27 +2136,62 @@ static int coroutine_fn qcow2_co_block_status(BlockDriverState *bs,
     }
 
     *pnum = bytes;
+    return qcow2_block_status(bs, type, host_offset, map, file);
+}
 
-    if ((type == QCOW2_SUBCLUSTER_NORMAL ||
-         type == QCOW2_SUBCLUSTER_ZERO_ALLOC ||
-         type == QCOW2_SUBCLUSTER_UNALLOCATED_ALLOC) && !s->crypto) {
-        *map = host_offset;
-        *file = s->data_file->bs;
-        status |= BDRV_BLOCK_OFFSET_VALID;
-    }
-    if (type == QCOW2_SUBCLUSTER_ZERO_PLAIN ||
-        type == QCOW2_SUBCLUSTER_ZERO_ALLOC) {
-        status |= BDRV_BLOCK_ZERO;
-    } else if (type != QCOW2_SUBCLUSTER_UNALLOCATED_PLAIN &&
-               type != QCOW2_SUBCLUSTER_UNALLOCATED_ALLOC) {
-        status |= BDRV_BLOCK_DATA;
-    }
-    if (s->metadata_preallocation && (status & BDRV_BLOCK_DATA) &&
-        (status & BDRV_BLOCK_OFFSET_VALID))
-    {
-        status |= BDRV_BLOCK_RECURSE;
+/*
+ * Walk the L2 tables for up to @nb_extents extents, taking s->lock only
+ * once, and merge those that continue each other.  At most 1024 lookups
+ * are done per call, to not hold the lock for too long.
+ */
+static int coroutine_fn qcow2_co_block_status_batch(BlockDriverState *bs,
+                                                    bool want_zero,
+                                                    int64_t offset,
+                                                    int64_t count,
+                                                    BlockStatusExtent *extents,
+                                                    int nb_extents)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int n = 0;
+    int ret = 0;
+    int lookups;
+
+    qemu_co_mutex_lock(&s->lock);
+
+    qcow2_check_metadata_preallocation(bs);
+
+    for (lookups = 0; count > 0 && lookups < 1024; lookups++) {
+        BlockStatusExtent e = { .offset = offset };
+        BlockStatusExtent *prev = n ? &extents[n - 1] : NULL;
+        uint64_t host_offset;
+        unsigned int bytes = MIN(INT_MAX, count);
+        QCow2SubclusterType type;
+
+        ret = qcow2_get_host_offset(bs, offset, &bytes, &host_offset, &type);
+        if (ret < 0) {
+            break;
+        }
+        e.bytes = bytes;
+        e.ret = qcow2_block_status(bs, type, host_offset, &e.map, &e.file);
+
+        if (prev && prev->ret == e.ret && prev->file == e.file &&
+            (!(e.ret & BDRV_BLOCK_OFFSET_VALID) ||
+             prev->map + prev->bytes == e.map)) {
+            prev->bytes += e.bytes;
+        } else if (n < nb_extents) {
+            extents[n++] = e;
+        } else {
+            break;
+        }
+
+        offset += bytes;
+        count -= bytes;
     }
-    return status;
+
+    qemu_co_mutex_unlock(&s->lock);
+
+    /* Whatever was found before an error is still good */
+    return n ? n : ret;
 }
 
 static coroutine_fn int qcow2_handle_l2meta(BlockDriverState *bs,
@@ -2684,6 +2758,8 @@ static int qcow2_inactivate(BlockDriverState *bs)
     int ret, result = 0;
     Error *local_err = NULL;
 
+    qcow2_release_alloc_extents(bs);
+
     qcow2_store_persistent_dirty_bitmaps(bs, true, &local_err);
     if (local_err != NULL) {
         result = -EINVAL;
@@ -4229,6 +4305,8 @@ static int coroutine_fn qcow2_co_truncate(BlockDriverState *bs, int64_t offset,
             goto fail;
         }
 
+        qcow2_release_alloc_extents(bs);
+
         ret = qcow2_cluster_discard(bs, ROUND_UP(offset, s->cluster_size),
                                     old_length - ROUND_UP(offset,
                                                           s->cluster_size),
@@ -4768,6 +4846,8 @@ static int make_completely_empty(BlockDriverState *bs)
     BLKDBG_EVENT(bs->file, BLKDBG_L1_UPDATE);
 
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
+
+    qcow2_release_alloc_extents(bs);
     l1_size2 = (uint64_t)s->l1_size * L1E_SIZE;
 
     /* After this call, neither the in-memory nor the on-disk refcount
@@ -5973,6 +6053,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_co_create       = qcow2_co_create,
     .bdrv_has_zero_init   = qcow2_has_zero_init,
     .bdrv_co_block_status = qcow2_co_block_status,
+    .bdrv_co_block_status_batch = qcow2_co_block_status_batch,
 
     .bdrv_co_preadv_part    = qcow2_co_preadv_part,
     .bdrv_co_pwritev_part   = qcow2_co_pwritev_part,
@@ -6012,6 +6093,7 @@ BlockDriver bdrv_qcow2 = {
     .mutable_opts        = mutable_opts,
     .bdrv_co_check       = qcow2_co_check,
     .bdrv_amend_options  = qcow2_amend_options,
+    .bdrv_dedupe         = qcow2_dedupe,
     .bdrv_co_amend       = qcow2_co_amend,
 
     .bdrv_detach_aio_context  = qcow2_detach_aio_context,
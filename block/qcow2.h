@@ -71,6 +71,11 @@
 /* Maximum of parallel sub-request per guest request */
 #define QCOW2_MAX_WORKERS 8
 
+/* Sequential writers that can each have host clusters reserved */
+#define QCOW2_ALLOC_EXTENTS 8
+/* Host clusters reserved at once for a writer */
+#define QCOW2_ALLOC_EXTENT_SIZE (4 * MiB)
+
 /* indicate that the refcount of the referenced cluster is exactly one. */
 #define QCOW_OFLAG_COPIED     (1ULL << 63)
 /* indicate that the cluster is compressed (they never have the copied flag) */
@@ -323,6 +328,17 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/*
+ * Host clusters that are allocated, with their refcounts already
+ * raised, but not yet used by the writer whose next data cluster is
+ * @guest_offset
+ */
+typedef struct Qcow2AllocExtent {
+    uint64_t guest_offset;
+    uint64_t host_offset;
+    uint64_t nb_clusters;
+} Qcow2AllocExtent;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -355,6 +371,8 @@ typedef struct BDRVQcow2State {
     uint32_t max_refcount_table_index; /* Last used entry in refcount_table */
     uint64_t free_cluster_index;
     uint64_t free_byte_offset;
+    Qcow2AllocExtent alloc_extents[QCOW2_ALLOC_EXTENTS];
+    int alloc_extent_next; /* Next one to replace */
 
     CoMutex lock;
 
@@ -864,6 +882,9 @@ int64_t qcow2_refcount_area(BlockDriverState *bs, uint64_t offset,
 int64_t qcow2_alloc_clusters(BlockDriverState *bs, uint64_t size);
 int64_t qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
                                 int64_t nb_clusters);
+int64_t qcow2_alloc_data_clusters(BlockDriverState *bs, uint64_t guest_offset,
+                                  uint64_t *nb_clusters);
+void qcow2_release_alloc_extents(BlockDriverState *bs);
 int64_t qcow2_alloc_bytes(BlockDriverState *bs, int size);
 void qcow2_free_clusters(BlockDriverState *bs,
                           int64_t offset, int64_t size,
@@ -929,6 +950,8 @@ int qcow2_subcluster_zeroize(BlockDriverState *bs, uint64_t offset,
 int qcow2_expand_zero_clusters(BlockDriverState *bs,
                                BlockDriverAmendStatusCB *status_cb,
                                void *cb_opaque);
+int qcow2_dedupe(BlockDriverState *bs, BlockDriverAmendStatusCB *status_cb,
+                 void *cb_opaque, int64_t *shared, Error **errp);
 
 /* qcow2-snapshot.c functions */
 int qcow2_snapshot_create(BlockDriverState *bs, QEMUSnapshotInfo *sn_info);
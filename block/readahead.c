@@ -0,0 +1,556 @@
+/*
+ * Read-ahead filter block driver
+ *
+ * The filter detects sequential streams among the reads that go through
+ * it, and keeps the data that these streams are about to read prefetched
+ * in a bounded cache.  This hides the latency of protocols such as http,
+ * nfs or rbd, which otherwise see each guest read only when it comes.
+ *
+ * Up to READAHEAD_STREAMS streams are tracked, each by the offset at
+ * which its next read is expected.  Once a stream has gone on reading
+ * in sequence READAHEAD_TRIGGER times, the @window bytes after its next
+ * read are fetched in the background, in chunks of READAHEAD_CHUNK_SIZE
+ * bytes.  @cache-size bytes of chunks are kept, least recently used ones
+ * being reused first.  Writes through the filter drop the chunks they
+ * touch; writes to the child from elsewhere are not allowed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qemu/coroutine.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "block/block_int.h"
+#include "trace.h"
+
+#define READAHEAD_CHUNK_SIZE    (256 * KiB)
+#define READAHEAD_STREAMS       8
+#define READAHEAD_TRIGGER       2
+
+typedef struct ReadaheadOpts {
+    int64_t window;
+    int64_t cache_size;
+} ReadaheadOpts;
+
+typedef struct ReadaheadChunk {
+    BlockDriverState *bs;
+    /* aligned to READAHEAD_CHUNK_SIZE, -1 if the chunk holds nothing */
+    int64_t offset;
+    uint8_t *buf;
+    bool in_flight;
+    /* written to while in flight, to be dropped when it completes */
+    bool stale;
+    /* readers waiting for the chunk to be fetched */
+    CoQueue waiters;
+    uint64_t used;
+} ReadaheadChunk;
+
+typedef struct ReadaheadStream {
+    /* where the next read of the stream is expected */
+    int64_t next;
+    /* how far the stream was prefetched */
+    int64_t prefetched;
+    unsigned sequential;
+    uint64_t used;
+} ReadaheadStream;
+
+typedef struct BDRVReadaheadState {
+    ReadaheadOpts opts;
+    ReadaheadChunk *chunks;
+    int nb_chunks;
+    ReadaheadStream streams[READAHEAD_STREAMS];
+    /* for recently used stamps */
+    uint64_t clock;
+} BDRVReadaheadState;
+
+#define READAHEAD_OPT_WINDOW "window"
+#define READAHEAD_OPT_CACHE_SIZE "cache-size"
+static QemuOptsList runtime_opts = {
+    .name = "readahead",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = READAHEAD_OPT_WINDOW,
+            .type = QEMU_OPT_SIZE,
+            .help = "how far to read ahead of a sequential stream, "
+                "default 2M",
+        },
+        {
+            .name = READAHEAD_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "how much prefetched data to keep, default 16M",
+        },
+        { /* end of list */ }
+    },
+};
+
+static bool readahead_absorb_opts(ReadaheadOpts *dest, QDict *options,
+                                  BlockDriverState *child_bs, Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return false;
+    }
+
+    dest->window = qemu_opt_get_size(opts, READAHEAD_OPT_WINDOW, 2 * MiB);
+    dest->cache_size =
+        qemu_opt_get_size(opts, READAHEAD_OPT_CACHE_SIZE, 16 * MiB);
+
+    qemu_opts_del(opts);
+
+    if (dest->cache_size < READAHEAD_CHUNK_SIZE ||
+        dest->cache_size > 1 * GiB) {
+        error_setg(errp, "cache-size parameter of readahead filter must be "
+                   "between %" PRId64 " and %" PRId64, READAHEAD_CHUNK_SIZE,
+                   1 * GiB);
+        return false;
+    }
+
+    if (dest->window > dest->cache_size) {
+        error_setg(errp, "window parameter of readahead filter must not be "
+                   "larger than cache-size");
+        return false;
+    }
+
+    if (READAHEAD_CHUNK_SIZE % child_bs->bl.request_alignment) {
+        error_setg(errp, "readahead filter cannot be used above a node "
+                   "with a request alignment of %" PRIu32,
+                   child_bs->bl.request_alignment);
+        return false;
+    }
+
+    return true;
+}
+
+static void readahead_alloc_chunks(BlockDriverState *bs)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int i;
+
+    s->nb_chunks = s->opts.cache_size / READAHEAD_CHUNK_SIZE;
+    s->chunks = g_new0(ReadaheadChunk, s->nb_chunks);
+    for (i = 0; i < s->nb_chunks; i++) {
+        s->chunks[i].bs = bs;
+        s->chunks[i].offset = -1;
+        qemu_co_queue_init(&s->chunks[i].waiters);
+    }
+}
+
+static void readahead_free_chunks(BlockDriverState *bs)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < s->nb_chunks; i++) {
+        assert(!s->chunks[i].in_flight);
+        qemu_vfree(s->chunks[i].buf);
+    }
+    g_free(s->chunks);
+    s->chunks = NULL;
+    s->nb_chunks = 0;
+}
+
+static int readahead_open(BlockDriverState *bs, QDict *options, int flags,
+                          Error **errp)
+{
+    BDRVReadaheadState *s = bs->opaque;
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        return -EINVAL;
+    }
+
+    if (!readahead_absorb_opts(&s->opts, options, bs->file->bs, errp)) {
+        return -EINVAL;
+    }
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    readahead_alloc_chunks(bs);
+    return 0;
+}
+
+static void readahead_close(BlockDriverState *bs)
+{
+    readahead_free_chunks(bs);
+}
+
+static int readahead_reopen_prepare(BDRVReopenState *reopen_state,
+                                    BlockReopenQueue *queue, Error **errp)
+{
+    ReadaheadOpts *opts = g_new0(ReadaheadOpts, 1);
+
+    if (!readahead_absorb_opts(opts, reopen_state->options,
+                               reopen_state->bs->file->bs, errp)) {
+        g_free(opts);
+        return -EINVAL;
+    }
+
+    reopen_state->opaque = opts;
+
+    return 0;
+}
+
+/* Reopen happens in a drained section, so no chunk is in flight */
+static void readahead_reopen_commit(BDRVReopenState *state)
+{
+    BDRVReadaheadState *s = state->bs->opaque;
+
+    readahead_free_chunks(state->bs);
+    s->opts = *(ReadaheadOpts *)state->opaque;
+    memset(s->streams, 0, sizeof(s->streams));
+    readahead_alloc_chunks(state->bs);
+
+    g_free(state->opaque);
+    state->opaque = NULL;
+}
+
+static void readahead_reopen_abort(BDRVReopenState *state)
+{
+    g_free(state->opaque);
+    state->opaque = NULL;
+}
+
+static ReadaheadChunk *readahead_find(BDRVReadaheadState *s, int64_t offset)
+{
+    int64_t chunk_offset = QEMU_ALIGN_DOWN(offset, READAHEAD_CHUNK_SIZE);
+    int i;
+
+    for (i = 0; i < s->nb_chunks; i++) {
+        if (s->chunks[i].offset == chunk_offset && !s->chunks[i].stale) {
+            return &s->chunks[i];
+        }
+    }
+    return NULL;
+}
+
+/* Drop the chunks that overlap with [@offset, @offset + @bytes) */
+static void readahead_invalidate(BDRVReadaheadState *s, int64_t offset,
+                                 int64_t bytes)
+{
+    int i;
+
+    for (i = 0; i < s->nb_chunks; i++) {
+        ReadaheadChunk *chunk = &s->chunks[i];
+
+        if (chunk->offset < 0 || chunk->offset >= offset + bytes ||
+            chunk->offset + READAHEAD_CHUNK_SIZE <= offset) {
+            continue;
+        }
+        if (chunk->in_flight) {
+            chunk->stale = true;
+        } else {
+            chunk->offset = -1;
+        }
+    }
+}
+
+/*
+ * Account for a read in the streams, and return the stream that it
+ * continues if that stream is to be prefetched.
+ */
+static ReadaheadStream *readahead_stream(BDRVReadaheadState *s,
+                                         int64_t offset, int64_t bytes)
+{
+    ReadaheadStream *lru = &s->streams[0];
+    int i;
+
+    for (i = 0; i < READAHEAD_STREAMS; i++) {
+        ReadaheadStream *stream = &s->streams[i];
+
+        if (stream->used && stream->next == offset) {
+            stream->next += bytes;
+            stream->sequential++;
+            stream->used = ++s->clock;
+            return stream->sequential >= READAHEAD_TRIGGER ? stream : NULL;
+        }
+        if (stream->used < lru->used) {
+            lru = stream;
+        }
+    }
+
+    *lru = (ReadaheadStream) {
+        .next = offset + bytes,
+        .prefetched = offset + bytes,
+        .used = ++s->clock,
+    };
+    return NULL;
+}
+
+static void coroutine_fn readahead_co_fetch(void *opaque)
+{
+    ReadaheadChunk *chunk = opaque;
+    BlockDriverState *bs = chunk->bs;
+    int ret;
+
+    ret = bdrv_co_pread(bs->file, chunk->offset, READAHEAD_CHUNK_SIZE,
+                        chunk->buf, 0);
+    trace_readahead_fetch(bs, chunk->offset, ret);
+
+    chunk->in_flight = false;
+    if (ret < 0 || chunk->stale) {
+        chunk->offset = -1;
+        chunk->stale = false;
+    }
+    qemu_co_queue_restart_all(&chunk->waiters);
+
+    bdrv_dec_in_flight(bs);
+}
+
+/* Pick the least recently used chunk that is not in flight */
+static ReadaheadChunk *readahead_evict(BDRVReadaheadState *s)
+{
+    ReadaheadChunk *victim = NULL;
+    int i;
+
+    for (i = 0; i < s->nb_chunks; i++) {
+        ReadaheadChunk *chunk = &s->chunks[i];
+
+        if (!chunk->in_flight && (!victim || chunk->used < victim->used)) {
+            victim = chunk;
+        }
+    }
+    return victim;
+}
+
+static void readahead_prefetch(BlockDriverState *bs, ReadaheadStream *stream)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int64_t end = stream->next + s->opts.window;
+    int64_t offset = QEMU_ALIGN_DOWN(MAX(stream->next, stream->prefetched),
+                                     READAHEAD_CHUNK_SIZE);
+
+    /* Chunks past the end of the image simply read as zeroes */
+    for (; offset < end; offset += READAHEAD_CHUNK_SIZE) {
+        ReadaheadChunk *chunk = readahead_find(s, offset);
+        Coroutine *co;
+
+        if (chunk) {
+            continue;
+        }
+
+        chunk = readahead_evict(s);
+        if (!chunk) {
+            break;
+        }
+        if (!chunk->buf) {
+            chunk->buf = qemu_try_blockalign(bs->file->bs,
+                                             READAHEAD_CHUNK_SIZE);
+            if (!chunk->buf) {
+                break;
+            }
+        }
+
+        chunk->offset = offset;
+        chunk->in_flight = true;
+        chunk->used = ++s->clock;
+
+        bdrv_inc_in_flight(bs);
+        co = qemu_coroutine_create(readahead_co_fetch, chunk);
+        aio_co_enter(bdrv_get_aio_context(bs), co);
+    }
+    stream->prefetched = offset;
+}
+
+static int coroutine_fn readahead_co_preadv_part(BlockDriverState *bs,
+                                                 int64_t offset, int64_t bytes,
+                                                 QEMUIOVector *qiov,
+                                                 size_t qiov_offset,
+                                                 BdrvRequestFlags flags)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    ReadaheadStream *stream;
+    int ret;
+
+    stream = readahead_stream(s, offset, bytes);
+    if (stream) {
+        readahead_prefetch(bs, stream);
+    }
+
+    while (bytes) {
+        ReadaheadChunk *chunk = readahead_find(s, offset);
+        int64_t n;
+
+        if (chunk && chunk->in_flight) {
+            qemu_co_queue_wait(&chunk->waiters, NULL);
+            continue;
+        }
+
+        if (chunk) {
+            n = MIN(bytes, chunk->offset + READAHEAD_CHUNK_SIZE - offset);
+            qemu_iovec_from_buf(qiov, qiov_offset,
+                                chunk->buf + (offset - chunk->offset), n);
+            chunk->used = ++s->clock;
+            trace_readahead_hit(bs, offset, n);
+        } else {
+            /* Read up to the next chunk that the cache has */
+            n = 0;
+            do {
+                n = MIN(bytes, QEMU_ALIGN_UP(offset + n + 1,
+                                             READAHEAD_CHUNK_SIZE) - offset);
+            } while (n < bytes && !readahead_find(s, offset + n));
+
+            ret = bdrv_co_preadv_part(bs->file, offset, n, qiov, qiov_offset,
+                                      flags);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+
+    return 0;
+}
+
+static int coroutine_fn readahead_co_pwritev_part(BlockDriverState *bs,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  QEMUIOVector *qiov,
+                                                  size_t qiov_offset,
+                                                  BdrvRequestFlags flags)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    /* Again once done, for the chunks fetched meanwhile */
+    readahead_invalidate(s, offset, bytes);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    readahead_invalidate(s, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn readahead_co_pwrite_zeroes(BlockDriverState *bs,
+                                                   int64_t offset,
+                                                   int64_t bytes,
+                                                   BdrvRequestFlags flags)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    readahead_invalidate(s, offset, bytes);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    readahead_invalidate(s, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn readahead_co_pdiscard(BlockDriverState *bs,
+                                              int64_t offset, int64_t bytes)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    readahead_invalidate(s, offset, bytes);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    readahead_invalidate(s, offset, bytes);
+
+    return ret;
+}
+
+static int coroutine_fn readahead_co_truncate(BlockDriverState *bs,
+                                              int64_t offset, bool exact,
+                                              PreallocMode prealloc,
+                                              BdrvRequestFlags flags,
+                                              Error **errp)
+{
+    BDRVReadaheadState *s = bs->opaque;
+    int ret;
+
+    readahead_invalidate(s, 0, INT64_MAX);
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+    readahead_invalidate(s, 0, INT64_MAX);
+
+    return ret;
+}
+
+static int64_t readahead_getlength(BlockDriverState *bs)
+{
+    return bdrv_getlength(bs->file->bs);
+}
+
+static void readahead_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                 BdrvChildRole role,
+                                 BlockReopenQueue *reopen_queue,
+                                 uint64_t perm, uint64_t shared,
+                                 uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared, nperm, nshared);
+
+    /* The cache would miss writes that do not go through the filter */
+    if (perm & BLK_PERM_CONSISTENT_READ) {
+        *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+    }
+}
+
+static void readahead_eject(BlockDriverState *bs, bool eject_flag)
+{
+    bdrv_eject(bs->file->bs, eject_flag);
+}
+
+static void readahead_lock_medium(BlockDriverState *bs, bool locked)
+{
+    bdrv_lock_medium(bs->file->bs, locked);
+}
+
+static BlockDriver bdrv_readahead = {
+    .format_name                        = "readahead",
+    .instance_size                      = sizeof(BDRVReadaheadState),
+
+    .bdrv_open                          = readahead_open,
+    .bdrv_close                         = readahead_close,
+    .bdrv_child_perm                    = readahead_child_perm,
+
+    .bdrv_reopen_prepare                = readahead_reopen_prepare,
+    .bdrv_reopen_commit                 = readahead_reopen_commit,
+    .bdrv_reopen_abort                  = readahead_reopen_abort,
+
+    .bdrv_getlength                     = readahead_getlength,
+
+    .bdrv_co_preadv_part                = readahead_co_preadv_part,
+    .bdrv_co_pwritev_part               = readahead_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes              = readahead_co_pwrite_zeroes,
+    .bdrv_co_pdiscard                   = readahead_co_pdiscard,
+    .bdrv_co_truncate                   = readahead_co_truncate,
+
+    .bdrv_eject                         = readahead_eject,
+    .bdrv_lock_medium                   = readahead_lock_medium,
+
+    .has_variable_length                = true,
+    .is_filter                          = true,
+};
+
+static void bdrv_readahead_init(void)
+{
+    bdrv_register(&bdrv_readahead);
+}
+
+block_init(bdrv_readahead_init);
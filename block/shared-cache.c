@@ -0,0 +1,516 @@
+/*
+ * Host-wide shared cache filter block driver
+ *
+ * The filter keeps the data read from a read-only node in a file that
+ * every QEMU process on the host can map, usually on /dev/shm.  When
+ * many VMs use the same base image, each part of it is then read from
+ * the disk once for all of them.  Placed between the format node of the
+ * base image and its protocol node, it caches metadata as well.
+ *
+ * The file holds a set-associative cache of SHARED_CACHE_SLOT_SIZE
+ * slots, tagged with a hash of the image ID and the offset of the slot.
+ * Processes share nothing else: each slot is protected by a sequence
+ * count, odd while someone fills it, that readers check before and
+ * after copying the slot out.  A process that dies while filling a slot
+ * only loses that slot.
+ *
+ * Only the process that creates the file fills the cache.  The others
+ * map it read-only and read their misses from the child, so that none
+ * of them can hand wrong data to the rest.
+ *
+ * The image must not change while any process uses the cache, and two
+ * different images must not have the same ID.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/units.h"
+#include "qemu/xxhash.h"
+#include "block/block_int.h"
+#include "trace.h"
+
+#define SHARED_CACHE_MAGIC      "QEMUSHCA"
+#define SHARED_CACHE_VERSION    1
+#define SHARED_CACHE_SLOT_SIZE  (64 * KiB)
+#define SHARED_CACHE_WAYS       4
+/* Most bytes read from the child at once on a miss */
+#define SHARED_CACHE_MAX_READ   (1 * MiB)
+
+typedef struct SharedCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t nb_sets;
+} SharedCacheHeader;
+
+typedef struct SharedCacheTag {
+    uint32_t seq;               /* odd while the slot is being filled */
+    uint32_t padding;
+    uint64_t image;             /* 0 if the slot holds nothing */
+    uint64_t offset;
+} SharedCacheTag;
+
+typedef struct SharedCacheSet {
+    SharedCacheTag tags[SHARED_CACHE_WAYS];
+    uint32_t next;              /* the way to fill next */
+    uint32_t padding;
+} SharedCacheSet;
+
+typedef struct BDRVSharedCacheState {
+    char *path;
+    char *image_id;
+    uint64_t image;
+    int fd;
+    /* Whether this process created the cache file, and may fill it */
+    bool owner;
+    void *map;
+    size_t map_size;
+    uint64_t nb_sets;
+    SharedCacheSet *sets;
+    uint8_t *data;
+} BDRVSharedCacheState;
+
+#define SHARED_CACHE_OPT_PATH "path"
+#define SHARED_CACHE_OPT_SIZE "size"
+#define SHARED_CACHE_OPT_IMAGE_ID "image-id"
+static QemuOptsList runtime_opts = {
+    .name = "shared-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = SHARED_CACHE_OPT_PATH,
+            .type = QEMU_OPT_STRING,
+            .help = "file holding the cache, shared by all its users",
+        },
+        {
+            .name = SHARED_CACHE_OPT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "size of the cache when creating it, default 1G",
+        },
+        {
+            .name = SHARED_CACHE_OPT_IMAGE_ID,
+            .type = QEMU_OPT_STRING,
+            .help = "identifies the image host-wide, default the file name "
+                "of the child",
+        },
+        { /* end of list */ }
+    },
+};
+
+static size_t shared_cache_data_offset(uint64_t nb_sets)
+{
+    return ROUND_UP(sizeof(SharedCacheHeader) +
+                    nb_sets * sizeof(SharedCacheSet), qemu_real_host_page_size);
+}
+
+static size_t shared_cache_file_size(uint64_t nb_sets)
+{
+    return shared_cache_data_offset(nb_sets) +
+           nb_sets * SHARED_CACHE_WAYS * SHARED_CACHE_SLOT_SIZE;
+}
+
+/*
+ * Create the cache file, unless another process already did, and tell
+ * in @created which one happened.
+ */
+static int shared_cache_init_file(int fd, uint64_t size, bool *created,
+                                  Error **errp)
+{
+    SharedCacheHeader header = {
+        .magic = SHARED_CACHE_MAGIC,
+        .version = SHARED_CACHE_VERSION,
+        .slot_size = SHARED_CACHE_SLOT_SIZE,
+        .nb_sets = size / (SHARED_CACHE_WAYS * SHARED_CACHE_SLOT_SIZE),
+    };
+    struct stat st;
+    int ret;
+
+    ret = qemu_lock_fd(fd, 0, 0, true);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot lock the cache file");
+        return ret;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Cannot stat the cache file");
+        goto out;
+    }
+    *created = false;
+    if (st.st_size) {
+        ret = 0;
+        goto out;
+    }
+
+    /* The sets read as zeroes, which is empty */
+    if (ftruncate(fd, shared_cache_file_size(header.nb_sets)) < 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        ret = errno ? -errno : -EIO;
+        error_setg_errno(errp, -ret, "Cannot create the cache file");
+        goto out;
+    }
+    *created = true;
+    ret = 0;
+
+out:
+    qemu_unlock_fd(fd, 0, 0);
+    return ret;
+}
+
+static int shared_cache_map(BDRVSharedCacheState *s, uint64_t size,
+                            Error **errp)
+{
+    SharedCacheHeader header;
+    struct stat st;
+    int ret;
+
+    /*
+     * Processes that attach to an existing cache don't need to write it.
+     * The creator holds the lock until the file is complete.
+     */
+    s->owner = false;
+    s->fd = qemu_open(s->path, O_RDONLY, NULL);
+    if (s->fd >= 0) {
+        ret = qemu_lock_fd(s->fd, 0, 0, false);
+        if (ret < 0 || fstat(s->fd, &st) < 0 || !st.st_size) {
+            qemu_close(s->fd);
+            s->fd = -1;
+        } else {
+            qemu_unlock_fd(s->fd, 0, 0);
+        }
+    }
+    if (s->fd < 0) {
+        s->fd = qemu_create(s->path, O_RDWR, 0600, errp);
+        if (s->fd < 0) {
+            return -errno;
+        }
+        ret = shared_cache_init_file(s->fd, size, &s->owner, errp);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    if (pread(s->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, SHARED_CACHE_MAGIC, sizeof(header.magic)) ||
+        header.version != SHARED_CACHE_VERSION ||
+        header.slot_size != SHARED_CACHE_SLOT_SIZE || !header.nb_sets ||
+        header.nb_sets > SIZE_MAX / SHARED_CACHE_WAYS /
+                         SHARED_CACHE_SLOT_SIZE) {
+        error_setg(errp, "'%s' is not a shared cache file", s->path);
+        return -EINVAL;
+    }
+
+    s->nb_sets = header.nb_sets;
+    s->map_size = shared_cache_file_size(s->nb_sets);
+    s->map = mmap(NULL, s->map_size,
+                  s->owner ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                  s->fd, 0);
+    if (s->map == MAP_FAILED) {
+        ret = -errno;
+        s->map = NULL;
+        error_setg_errno(errp, -ret, "Cannot map the cache file");
+        return ret;
+    }
+
+    s->sets = s->map + sizeof(SharedCacheHeader);
+    s->data = s->map + shared_cache_data_offset(s->nb_sets);
+    return 0;
+}
+
+/* FNV-1a, never 0 so that it does not match empty slots */
+static uint64_t shared_cache_image_hash(const char *id)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (; *id; id++) {
+        hash = (hash ^ (uint8_t)*id) * 0x100000001b3ULL;
+    }
+    return hash ?: 1;
+}
+
+static void shared_cache_close(BlockDriverState *bs)
+{
+    BDRVSharedCacheState *s = bs->opaque;
+
+    if (s->map) {
+        munmap(s->map, s->map_size);
+        s->map = NULL;
+    }
+    if (s->fd >= 0) {
+        qemu_close(s->fd);
+        s->fd = -1;
+    }
+    g_free(s->path);
+    s->path = NULL;
+    g_free(s->image_id);
+    s->image_id = NULL;
+}
+
+static int shared_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                             Error **errp)
+{
+    BDRVSharedCacheState *s = bs->opaque;
+    QemuOpts *opts;
+    uint64_t size;
+    int ret;
+
+    s->fd = -1;
+
+    if (flags & BDRV_O_RDWR) {
+        error_setg(errp, "shared-cache nodes must be read-only");
+        return -EINVAL;
+    }
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        return -EINVAL;
+    }
+
+    opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    s->path = g_strdup(qemu_opt_get(opts, SHARED_CACHE_OPT_PATH));
+    if (!s->path) {
+        error_setg(errp, "shared-cache needs a path");
+        ret = -EINVAL;
+        goto out;
+    }
+    s->image_id = g_strdup(qemu_opt_get(opts, SHARED_CACHE_OPT_IMAGE_ID));
+    if (!s->image_id) {
+        s->image_id = g_strdup(bs->file->bs->filename);
+    }
+    s->image = shared_cache_image_hash(s->image_id);
+
+    size = qemu_opt_get_size(opts, SHARED_CACHE_OPT_SIZE, 1 * GiB);
+    if (size < SHARED_CACHE_WAYS * SHARED_CACHE_SLOT_SIZE) {
+        error_setg(errp, "shared-cache size must be at least %" PRId64,
+                   SHARED_CACHE_WAYS * SHARED_CACHE_SLOT_SIZE);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    if (SHARED_CACHE_SLOT_SIZE % bs->file->bs->bl.request_alignment) {
+        error_setg(errp, "shared-cache cannot be used above a node "
+                   "with a request alignment of %" PRIu32,
+                   bs->file->bs->bl.request_alignment);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    ret = shared_cache_map(s, size, errp);
+
+out:
+    qemu_opts_del(opts);
+    if (ret < 0) {
+        shared_cache_close(bs);
+    }
+    return ret;
+}
+
+static int shared_cache_reopen_prepare(BDRVReopenState *reopen_state,
+                                       BlockReopenQueue *queue, Error **errp)
+{
+    BDRVSharedCacheState *s = reopen_state->bs->opaque;
+    QDict *options = reopen_state->options;
+    const char *path = qdict_get_try_str(options, SHARED_CACHE_OPT_PATH);
+    const char *id = qdict_get_try_str(options, SHARED_CACHE_OPT_IMAGE_ID);
+
+    if (reopen_state->flags & BDRV_O_RDWR) {
+        error_setg(errp, "shared-cache nodes must be read-only");
+        return -EINVAL;
+    }
+    if (g_strcmp0(path, s->path) ||
+        (id && strcmp(id, s->image_id))) {
+        error_setg(errp, "Cannot change the path or image-id of a "
+                   "shared-cache node");
+        return -EINVAL;
+    }
+
+    qdict_del(options, SHARED_CACHE_OPT_PATH);
+    qdict_del(options, SHARED_CACHE_OPT_SIZE);
+    qdict_del(options, SHARED_CACHE_OPT_IMAGE_ID);
+    return 0;
+}
+
+static SharedCacheSet *shared_cache_set(BDRVSharedCacheState *s,
+                                        int64_t offset)
+{
+    return &s->sets[qemu_xxhash64_4(s->image, offset, 0, 0) % s->nb_sets];
+}
+
+static uint8_t *shared_cache_slot_data(BDRVSharedCacheState *s,
+                                       SharedCacheSet *set, int way)
+{
+    uint64_t slot = (set - s->sets) * SHARED_CACHE_WAYS + way;
+
+    return s->data + slot * SHARED_CACHE_SLOT_SIZE;
+}
+
+/*
+ * Copy the slot at @offset to @buf, if the cache has it.  With a NULL
+ * @buf, only tell whether the cache seems to have it.
+ */
+static bool shared_cache_lookup(BDRVSharedCacheState *s, int64_t offset,
+                                uint8_t *buf)
+{
+    SharedCacheSet *set = shared_cache_set(s, offset);
+    int way;
+
+    for (way = 0; way < SHARED_CACHE_WAYS; way++) {
+        SharedCacheTag *tag = &set->tags[way];
+        uint32_t seq = qatomic_load_acquire(&tag->seq);
+
+        /* The tag may change under us, which the sequence count tells */
+        if ((seq & 1) || tag->image != s->image || tag->offset != offset) {
+            continue;
+        }
+        if (!buf) {
+            return true;
+        }
+
+        memcpy(buf, shared_cache_slot_data(s, set, way),
+               SHARED_CACHE_SLOT_SIZE);
+        smp_rmb();
+        if (qatomic_read(&tag->seq) == seq) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void shared_cache_insert(BDRVSharedCacheState *s, int64_t offset,
+                                const uint8_t *buf)
+{
+    SharedCacheSet *set = shared_cache_set(s, offset);
+    int way = qatomic_fetch_inc(&set->next) % SHARED_CACHE_WAYS;
+    SharedCacheTag *tag = &set->tags[way];
+    uint32_t seq = qatomic_read(&tag->seq);
+
+    /* Somebody else is filling it */
+    if ((seq & 1) || qatomic_cmpxchg(&tag->seq, seq, seq + 1) != seq) {
+        return;
+    }
+    smp_wmb();
+
+    tag->image = s->image;
+    tag->offset = offset;
+    memcpy(shared_cache_slot_data(s, set, way), buf, SHARED_CACHE_SLOT_SIZE);
+
+    qatomic_store_release(&tag->seq, seq + 2);
+}
+
+static int coroutine_fn shared_cache_co_preadv_part(BlockDriverState *bs,
+                                                    int64_t offset,
+                                                    int64_t bytes,
+                                                    QEMUIOVector *qiov,
+                                                    size_t qiov_offset,
+                                                    BdrvRequestFlags flags)
+{
+    BDRVSharedCacheState *s = bs->opaque;
+    g_autofree uint8_t *slot = g_malloc(SHARED_CACHE_SLOT_SIZE);
+    uint8_t *buf = NULL;
+    int ret = 0;
+
+    while (bytes) {
+        int64_t start = QEMU_ALIGN_DOWN(offset, SHARED_CACHE_SLOT_SIZE);
+        int64_t skip = offset - start;
+        int64_t n, end, pos;
+
+        if (shared_cache_lookup(s, start, slot)) {
+            n = MIN(bytes, SHARED_CACHE_SLOT_SIZE - skip);
+            qemu_iovec_from_buf(qiov, qiov_offset, slot + skip, n);
+            trace_shared_cache_hit(bs, start);
+            goto next;
+        }
+
+        /* Read the slots that miss at once, reading as zeroes past EOF */
+        end = start + SHARED_CACHE_SLOT_SIZE;
+        while (end < offset + bytes && end - start < SHARED_CACHE_MAX_READ &&
+               !shared_cache_lookup(s, end, NULL)) {
+            end += SHARED_CACHE_SLOT_SIZE;
+        }
+        if (!buf) {
+            buf = qemu_try_blockalign(bs->file->bs, SHARED_CACHE_MAX_READ);
+            if (!buf) {
+                ret = -ENOMEM;
+                break;
+            }
+        }
+
+        ret = bdrv_co_pread(bs->file, start, end - start, buf, flags);
+        trace_shared_cache_miss(bs, start, end - start, ret);
+        if (ret < 0) {
+            break;
+        }
+        for (pos = start; s->owner && pos < end;
+             pos += SHARED_CACHE_SLOT_SIZE) {
+            shared_cache_insert(s, pos, buf + (pos - start));
+        }
+
+        n = MIN(bytes, end - offset);
+        qemu_iovec_from_buf(qiov, qiov_offset, buf + skip, n);
+
+next:
+        offset += n;
+        qiov_offset += n;
+        bytes -= n;
+    }
+
+    qemu_vfree(buf);
+    return ret < 0 ? ret : 0;
+}
+
+static int64_t shared_cache_getlength(BlockDriverState *bs)
+{
+    return bdrv_getlength(bs->file->bs);
+}
+
+static void shared_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                    BdrvChildRole role,
+                                    BlockReopenQueue *reopen_queue,
+                                    uint64_t perm, uint64_t shared,
+                                    uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared, nperm, nshared);
+
+    /* Nothing in this process may change the image under the cache */
+    *nperm &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+    *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+}
+
+static BlockDriver bdrv_shared_cache = {
+    .format_name                        = "shared-cache",
+    .instance_size                      = sizeof(BDRVSharedCacheState),
+
+    .bdrv_open                          = shared_cache_open,
+    .bdrv_close                         = shared_cache_close,
+    .bdrv_reopen_prepare                = shared_cache_reopen_prepare,
+    .bdrv_child_perm                    = shared_cache_child_perm,
+
+    .bdrv_getlength                     = shared_cache_getlength,
+
+    .bdrv_co_preadv_part                = shared_cache_co_preadv_part,
+
+    .is_filter                          = true,
+};
+
+static void bdrv_shared_cache_init(void)
+{
+    bdrv_register(&bdrv_shared_cache);
+}
+
+block_init(bdrv_shared_cache_init);
@@ -25,12 +25,167 @@
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qerror.h"
+#include "qemu/timer.h"
 #include "sysemu/replay.h"
 
 #include "chardev/char-fe.h"
 #include "chardev/char-io.h"
 #include "chardev-internal.h"
 
+/*
+ * With "coalesce=on", front end writes are held back here until a
+ * newline, until the buffer is full, or until the timer fires, so that
+ * UARTs that write a byte at a time don't cost one back end write (and
+ * often one system call) per byte.
+ *
+ * Only qemu_chr_fe_write_all() and qemu_chr_fe_flush() wait for the back
+ * end.  Otherwise, what the back end doesn't take stays in the buffer
+ * and is retried when it can take more, and front end writes are short
+ * once the buffer is full, as they would be without coalescing.
+ */
+#define CHR_FE_COALESCE_SIZE        256
+#define CHR_FE_COALESCE_DELAY_NS    (1 * SCALE_MS)
+
+struct CharFeCoalesce {
+    QemuMutex lock;
+    QEMUTimer *timer;
+    /* Watch for the back end to take more output, set atomically */
+    guint watch;
+    /* errno of a flush that failed, reported by the next write */
+    int error;
+    int len;
+    uint8_t buf[CHR_FE_COALESCE_SIZE];
+};
+
+static gboolean qemu_chr_fe_coalesce_writable(void *do_not_use,
+                                              GIOCondition cond,
+                                              void *opaque)
+{
+    CharBackend *be = opaque;
+    CharFeCoalesce *c = be->coalesce;
+
+    /* Flush from the timer, which doesn't wait for the lock */
+    qatomic_set(&c->watch, 0);
+    timer_mod(c->timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
+    return G_SOURCE_REMOVE;
+}
+
+/*
+ * Pass on as much held-back output as the back end takes, waiting for
+ * it to take everything if @block.  Returns false if output is left,
+ * which is then retried once the back end can take more.  If the back
+ * end fails, the output is dropped as it would be without coalescing,
+ * and the next front end write returns the error.
+ */
+static bool qemu_chr_fe_flush_locked(CharBackend *be, bool block)
+{
+    CharFeCoalesce *c = be->coalesce;
+    int ret;
+
+    timer_del(c->timer);
+    if (!be->chr) {
+        c->len = 0;
+    }
+    while (c->len) {
+        ret = qemu_chr_write(be->chr, c->buf, c->len, block);
+        if (ret < 0 && errno != EAGAIN) {
+            c->error = errno;
+            c->len = 0;
+        } else if (ret <= 0) {
+            break;
+        } else {
+            c->len -= ret;
+            memmove(c->buf, c->buf + ret, c->len);
+        }
+    }
+    if (!c->len) {
+        return true;
+    }
+
+    if (!qatomic_read(&c->watch)) {
+        qatomic_set(&c->watch,
+                    qemu_chr_fe_add_watch(be, G_IO_OUT | G_IO_HUP,
+                                          qemu_chr_fe_coalesce_writable, be));
+    }
+    if (!qatomic_read(&c->watch)) {
+        /* The back end can't tell, poll it */
+        timer_mod(c->timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                  CHR_FE_COALESCE_DELAY_NS);
+    }
+    return false;
+}
+
+void qemu_chr_fe_flush(CharBackend *be)
+{
+    CharFeCoalesce *c = be->coalesce;
+
+    if (c) {
+        qemu_mutex_lock(&c->lock);
+        qemu_chr_fe_flush_locked(be, true);
+        qemu_mutex_unlock(&c->lock);
+    }
+}
+
+static void qemu_chr_fe_coalesce_timer(void *opaque)
+{
+    CharBackend *be = opaque;
+    CharFeCoalesce *c = be->coalesce;
+
+    /* Runs in the main loop, so it must not wait for the back end */
+    if (qemu_mutex_trylock(&c->lock)) {
+        timer_mod(c->timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                  CHR_FE_COALESCE_DELAY_NS);
+        return;
+    }
+    qemu_chr_fe_flush_locked(be, false);
+    qemu_mutex_unlock(&c->lock);
+}
+
+static int qemu_chr_fe_write_coalesced(CharBackend *be, const uint8_t *buf,
+                                       int len, bool write_all)
+{
+    CharFeCoalesce *c = be->coalesce;
+    int ret;
+
+    if (!c) {
+        c = g_new0(CharFeCoalesce, 1);
+        qemu_mutex_init(&c->lock);
+        c->timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                qemu_chr_fe_coalesce_timer, be);
+        be->coalesce = c;
+    }
+
+    qemu_mutex_lock(&c->lock);
+    if (c->len + len > CHR_FE_COALESCE_SIZE) {
+        qemu_chr_fe_flush_locked(be, write_all);
+    }
+    if (c->error) {
+        errno = c->error;
+        c->error = 0;
+        ret = -1;
+    } else if (len > CHR_FE_COALESCE_SIZE && !c->len) {
+        ret = qemu_chr_write(be->chr, buf, len, write_all);
+    } else {
+        ret = MIN(len, CHR_FE_COALESCE_SIZE - c->len);
+        if (!ret) {
+            errno = EAGAIN;
+            ret = -1;
+            goto out;
+        }
+        memcpy(c->buf + c->len, buf, ret);
+        c->len += ret;
+        if (c->len == CHR_FE_COALESCE_SIZE || memchr(buf, '\n', ret)) {
+            qemu_chr_fe_flush_locked(be, write_all);
+        } else if (!timer_pending(c->timer) && !qatomic_read(&c->watch)) {
+            timer_mod(c->timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                      CHR_FE_COALESCE_DELAY_NS);
+        }
+    }
+out:
+    qemu_mutex_unlock(&c->lock);
+    return ret;
+}
+
 int qemu_chr_fe_write(CharBackend *be, const uint8_t *buf, int len)
 {
     Chardev *s = be->chr;
@@ -39,6 +194,9 @@ int qemu_chr_fe_write(CharBackend *be, const uint8_t *buf, int len)
         return 0;
     }
 
+    if (s->coalesce && !qemu_chr_replay(s)) {
+        return qemu_chr_fe_write_coalesced(be, buf, len, false);
+    }
     return qemu_chr_write(s, buf, len, false);
 }
 
@@ -50,6 +208,9 @@ int qemu_chr_fe_write_all(CharBackend *be, const uint8_t *buf, int len)
         return 0;
     }
 
+    if (s->coalesce && !qemu_chr_replay(s)) {
+        return qemu_chr_fe_write_coalesced(be, buf, len, true);
+    }
     return qemu_chr_write(s, buf, len, true);
 }
 
@@ -225,6 +386,17 @@ void qemu_chr_fe_deinit(CharBackend *b, bool del)
 {
     assert(b);
 
+    if (b->coalesce) {
+        qemu_chr_fe_flush(b);
+        if (b->coalesce->watch) {
+            g_source_remove(b->coalesce->watch);
+        }
+        timer_free(b->coalesce->timer);
+        qemu_mutex_destroy(&b->coalesce->lock);
+        g_free(b->coalesce);
+        b->coalesce = NULL;
+    }
+
     if (b->chr) {
         qemu_chr_fe_set_handlers(b, NULL, NULL, NULL, NULL, NULL, NULL, true);
         if (b->chr->be == b) {
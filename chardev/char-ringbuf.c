@@ -23,22 +23,33 @@
  */
 
 #include "qemu/osdep.h"
+#ifdef CONFIG_POSIX
+#include <sys/mman.h>
+#endif
 #include "chardev/char.h"
+#include "chardev/shm-ring.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-char.h"
+#include "qemu/atomic.h"
 #include "qemu/base64.h"
+#include "qemu/cutils.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qom/object.h"
 
 /* Ring buffer chardev */
 
+#define SHM_RING_DATA_OFFSET 4096
+
 struct RingBufChardev {
     Chardev parent;
     size_t size;
     size_t prod;
     size_t cons;
     uint8_t *cbuf;
+    /* Set if the ring is in a file shared with a reader process */
+    QemuShmRing *shm;
+    int notify_fd;
 };
 typedef struct RingBufChardev RingBufChardev;
 
@@ -52,6 +63,45 @@ static size_t ringbuf_count(const Chardev *chr)
     return d->prod - d->cons;
 }
 
+/*
+ * Single producer side of the shared ring; see chardev/shm-ring.h for
+ * the protocol.  Only the reader moves cons, so what doesn't fit is
+ * dropped instead of overwriting the oldest data.  The reader can write
+ * anything to cons; a value that is not between prod - size and prod is
+ * taken as a full ring, so that nothing is written out of bounds.
+ */
+static int ringbuf_shm_write(RingBufChardev *d, const uint8_t *buf, int len)
+{
+    QemuShmRing *r = d->shm;
+    uint32_t prod = d->prod;
+    uint32_t cons = qatomic_load_acquire(&r->cons);
+    uint32_t used = MIN(prod - cons, d->size);
+    size_t n = MIN(len, d->size - used);
+    size_t off = prod & (d->size - 1);
+    size_t first = MIN(n, d->size - off);
+
+    memcpy(d->cbuf + off, buf, first);
+    memcpy(d->cbuf, buf + first, n - first);
+    d->prod = (uint32_t)(prod + n);
+    qatomic_store_release(&r->prod, d->prod);
+    if (n < len) {
+        qatomic_set(&r->lost, r->lost + len - n);
+    }
+
+    /* Pairs with the barrier of the reader between waiting and prod */
+    smp_mb();
+    if (qatomic_read(&r->waiting)) {
+        uint64_t one = 1;
+
+        qatomic_set(&r->waiting, 0);
+        if (d->notify_fd >= 0 &&
+            write(d->notify_fd, &one, sizeof(one)) < 0) {
+            /* The reader sees the data next time it looks anyway */
+        }
+    }
+    return len;
+}
+
 static int ringbuf_chr_write(Chardev *chr, const uint8_t *buf, int len)
 {
     RingBufChardev *d = RINGBUF_CHARDEV(chr);
@@ -61,6 +111,10 @@ static int ringbuf_chr_write(Chardev *chr, const uint8_t *buf, int len)
         return -1;
     }
 
+    if (d->shm) {
+        return ringbuf_shm_write(d, buf, len);
+    }
+
     for (i = 0; i < len; i++) {
         d->cbuf[d->prod++ & (d->size - 1)] = buf[i];
         if (d->prod - d->cons > d->size) {
@@ -89,9 +143,65 @@ static void char_ringbuf_finalize(Object *obj)
 {
     RingBufChardev *d = RINGBUF_CHARDEV(obj);
 
+    if (d->notify_fd >= 0) {
+        close(d->notify_fd);
+    }
+#ifdef CONFIG_POSIX
+    if (d->shm) {
+        munmap(d->shm, SHM_RING_DATA_OFFSET + d->size);
+        return;
+    }
+#endif
     g_free(d->cbuf);
 }
 
+#ifdef CONFIG_POSIX
+static bool ringbuf_shm_open(RingBufChardev *d, const char *path,
+                             Error **errp)
+{
+    size_t total = SHM_RING_DATA_OFFSET + d->size;
+    void *ptr;
+    int fd;
+
+    if (d->size > UINT32_MAX / 2) {
+        error_setg(errp, "size of shared ringbuf chardev must be below 2 GiB");
+        return false;
+    }
+    fd = qemu_open_old(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "cannot create %s", path);
+        return false;
+    }
+    if (ftruncate(fd, total) < 0) {
+        error_setg_errno(errp, errno, "cannot resize %s", path);
+        close(fd);
+        return false;
+    }
+    ptr = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        error_setg_errno(errp, errno, "cannot map %s", path);
+        return false;
+    }
+
+    d->shm = ptr;
+    d->cbuf = ptr + SHM_RING_DATA_OFFSET;
+    d->shm->size = d->size;
+    d->shm->data_offset = SHM_RING_DATA_OFFSET;
+    d->shm->version = QEMU_SHM_RING_VERSION;
+    smp_wmb();
+    qatomic_set(&d->shm->magic, QEMU_SHM_RING_MAGIC);
+    return true;
+}
+#else
+static bool ringbuf_shm_open(RingBufChardev *d, const char *path,
+                             Error **errp)
+{
+    error_setg(errp, "shared ringbuf chardev not supported on this host");
+    return false;
+}
+#endif
+
 static void qemu_chr_open_ringbuf(Chardev *chr,
                                   ChardevBackend *backend,
                                   bool *be_opened,
@@ -100,6 +210,7 @@ static void qemu_chr_open_ringbuf(Chardev *chr,
     ChardevRingbuf *opts = backend->u.ringbuf.data;
     RingBufChardev *d = RINGBUF_CHARDEV(chr);
 
+    d->notify_fd = -1;
     d->size = opts->has_size ? opts->size : 65536;
 
     /* The size must be power of 2 */
@@ -110,7 +221,18 @@ static void qemu_chr_open_ringbuf(Chardev *chr,
 
     d->prod = 0;
     d->cons = 0;
-    d->cbuf = g_malloc0(d->size);
+    if (opts->has_path) {
+        if (!ringbuf_shm_open(d, opts->path, errp)) {
+            return;
+        }
+        if (opts->has_fd) {
+            d->notify_fd = opts->fd;
+        }
+    } else if (opts->has_fd) {
+        error_setg(errp, "'fd' of ringbuf chardev requires 'path'");
+    } else {
+        d->cbuf = g_malloc0(d->size);
+    }
 }
 
 void qmp_ringbuf_write(const char *device, const char *data,
@@ -177,6 +299,11 @@ char *qmp_ringbuf_read(const char *device, int64_t size,
         return NULL;
     }
 
+    if (RINGBUF_CHARDEV(chr)->shm) {
+        error_setg(errp, "%s is read through its shared memory file", device);
+        return NULL;
+    }
+
     if (size <= 0) {
         error_setg(errp, "size must be greater than zero");
         return NULL;
@@ -221,6 +348,18 @@ static void qemu_chr_parse_ringbuf(QemuOpts *opts, ChardevBackend *backend,
         ringbuf->has_size = true;
         ringbuf->size = val;
     }
+
+    ringbuf->path = g_strdup(qemu_opt_get(opts, "path"));
+    ringbuf->has_path = ringbuf->path != NULL;
+    if (qemu_opt_get(opts, "fd")) {
+        ringbuf->fd = qemu_parse_fd(qemu_opt_get(opts, "fd"));
+        if (ringbuf->fd < 0) {
+            error_setg(errp, "Invalid file descriptor number '%s'",
+                       qemu_opt_get(opts, "fd"));
+            return;
+        }
+        ringbuf->has_fd = true;
+    }
 }
 
 static void char_ringbuf_class_init(ObjectClass *oc, void *data)
@@ -253,6 +253,9 @@ static void qemu_char_open(Chardev *chr, ChardevBackend *backend,
             return;
         }
     }
+    if (common && common->has_coalesce) {
+        chr->coalesce = common->coalesce;
+    }
 
     if (cc->open) {
         cc->open(chr, backend, be_opened, errp);
@@ -295,6 +298,7 @@ static void char_finalize(Object *obj)
     Chardev *chr = CHARDEV(obj);
 
     if (chr->be) {
+        qemu_chr_fe_flush(chr->be);
         chr->be->chr = NULL;
     }
     g_free(chr->filename);
@@ -501,6 +505,9 @@ void qemu_chr_parse_common(QemuOpts *opts, ChardevCommon *backend)
 
     backend->has_logappend = true;
     backend->logappend = qemu_opt_get_bool(opts, "logappend", false);
+
+    backend->has_coalesce = true;
+    backend->coalesce = qemu_opt_get_bool(opts, "coalesce", false);
 }
 
 static const ChardevClass *char_get_class(const char *driver, Error **errp)
@@ -928,6 +935,9 @@ QemuOptsList qemu_chardev_opts = {
         },{
             .name = "logappend",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "coalesce",
+            .type = QEMU_OPT_BOOL,
         },{
             .name = "mouse",
             .type = QEMU_OPT_BOOL,
@@ -20,6 +20,10 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 /* Store last executed instruction on each vCPU as a GString */
 GArray *last_exec;
 
+/* Log one executed instruction in @sample_period, 0 to log them all */
+static uint64_t sample_period;
+static struct qemu_plugin_scoreboard *sample_count;
+
 /**
  * Add memory read or write information to current instruction log
  */
@@ -105,6 +109,20 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         char *output = g_strdup_printf("0x%"PRIx64", 0x%"PRIx32", \"%s\"",
                                        insn_vaddr, insn_opcode, insn_disas);
 
+        if (sample_period) {
+            /*
+             * Count all instructions in one entry, so that one executed
+             * instruction in sample_period is logged (without its memory
+             * accesses, which would end up on the previous sample).
+             */
+            qemu_plugin_u64 count = { .score = sample_count, .offset = 0 };
+
+            qemu_plugin_register_vcpu_insn_exec_sampled_cb(
+                insn, vcpu_insn_exec, QEMU_PLUGIN_CB_NO_REGS, count,
+                sample_period, output);
+            continue;
+        }
+
         /* Register callback on memory read or write */
         qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem,
                                          QEMU_PLUGIN_CB_NO_REGS,
@@ -145,6 +163,20 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
      */
     last_exec = g_array_new(FALSE, FALSE, sizeof(GString *));
 
+    for (int i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_autofree char **tokens = g_strsplit(opt, "=", 2);
+        if (g_strcmp0(tokens[0], "sample") == 0 && tokens[1]) {
+            sample_period = g_ascii_strtoull(tokens[1], NULL, 0);
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+    if (sample_period) {
+        sample_count = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    }
+
     /* Register translation block and exit callbacks */
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
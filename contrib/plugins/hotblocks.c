@@ -34,16 +34,30 @@ static guint64 limit = 20;
  */
 typedef struct {
     uint64_t start_addr;
-    uint64_t exec_count;
+    struct qemu_plugin_scoreboard *exec_count;  /* per vCPU */
+    uint64_t total_count;
     int      trans_count;
     unsigned long insns;
 } ExecCount;
 
+static qemu_plugin_u64 exec_count_u64(ExecCount *cnt)
+{
+    return (qemu_plugin_u64) { .score = cnt->exec_count, .offset = 0 };
+}
+
 static gint cmp_exec_count(gconstpointer a, gconstpointer b)
 {
     ExecCount *ea = (ExecCount *) a;
     ExecCount *eb = (ExecCount *) b;
-    return ea->exec_count > eb->exec_count ? -1 : 1;
+    return ea->total_count > eb->total_count ? -1 : 1;
+}
+
+static void exec_count_free(gpointer key, gpointer value, gpointer user_data)
+{
+    ExecCount *cnt = value;
+
+    qemu_plugin_scoreboard_free(cnt->exec_count);
+    g_free(cnt);
 }
 
 static void plugin_exit(qemu_plugin_id_t id, void *p)
@@ -56,6 +70,11 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     g_string_append_printf(report, "%d entries in the hash table\n",
                            g_hash_table_size(hotblocks));
     counts = g_hash_table_get_values(hotblocks);
+    for (it = counts; it; it = it->next) {
+        ExecCount *rec = (ExecCount *) it->data;
+
+        rec->total_count = qemu_plugin_u64_sum(exec_count_u64(rec));
+    }
     it = g_list_sort(counts, cmp_exec_count);
 
     if (it) {
@@ -65,14 +84,17 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
             ExecCount *rec = (ExecCount *) it->data;
             g_string_append_printf(report, "0x%016"PRIx64", %d, %ld, %"PRId64"\n",
                                    rec->start_addr, rec->trans_count,
-                                   rec->insns, rec->exec_count);
+                                   rec->insns, rec->total_count);
         }
 
         g_list_free(it);
-        g_mutex_unlock(&lock);
     }
 
     qemu_plugin_outs(report->str);
+
+    g_hash_table_foreach(hotblocks, exec_count_free, NULL);
+    g_hash_table_destroy(hotblocks);
+    g_mutex_unlock(&lock);
 }
 
 static void plugin_init(void)
@@ -82,15 +104,11 @@ static void plugin_init(void)
 
 static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
 {
-    ExecCount *cnt;
-    uint64_t hash = (uint64_t) udata;
+    ExecCount *cnt = udata;
+    uint64_t *count = qemu_plugin_scoreboard_find(cnt->exec_count, cpu_index);
 
-    g_mutex_lock(&lock);
-    cnt = (ExecCount *) g_hash_table_lookup(hotblocks, (gconstpointer) hash);
-    /* should always succeed */
-    g_assert(cnt);
-    cnt->exec_count++;
-    g_mutex_unlock(&lock);
+    /* each vCPU has its own counter, so no lock is needed */
+    (*count)++;
 }
 
 /*
@@ -114,18 +132,18 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         cnt->start_addr = pc;
         cnt->trans_count = 1;
         cnt->insns = insns;
+        cnt->exec_count = qemu_plugin_scoreboard_new(sizeof(uint64_t));
         g_hash_table_insert(hotblocks, (gpointer) hash, (gpointer) cnt);
     }
 
     g_mutex_unlock(&lock);
 
     if (do_inline) {
-        qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
-                                                 &cnt->exec_count, 1);
+        qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+            tb, QEMU_PLUGIN_INLINE_ADD_U64, exec_count_u64(cnt), 1);
     } else {
         qemu_plugin_register_vcpu_tb_exec_cb(tb, vcpu_tb_exec,
-                                             QEMU_PLUGIN_CB_NO_REGS,
-                                             (void *)hash);
+                                             QEMU_PLUGIN_CB_NO_REGS, cnt);
     }
 }
 
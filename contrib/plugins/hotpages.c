@@ -27,6 +27,8 @@ static uint64_t page_mask;
 static int limit = 50;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 static bool track_io;
+static bool batch;
+static struct qemu_plugin_mem_ring *ring;
 
 enum sort_type {
     SORT_RW = 0,
@@ -79,6 +81,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     int i;
     GList *counts;
 
+    if (ring) {
+        qemu_plugin_mem_ring_drain(ring);
+    }
+
     counts = g_hash_table_get_values(pages);
     if (counts && g_list_next(counts)) {
         GList *it;
@@ -106,12 +112,48 @@ static void plugin_init(void)
     pages = g_hash_table_new(NULL, g_direct_equal);
 }
 
+/* Called with the lock held */
+static void count_access(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
+                         uint64_t page)
+{
+    PageCounters *count;
+
+    count = (PageCounters *) g_hash_table_lookup(pages, GUINT_TO_POINTER(page));
+
+    if (!count) {
+        count = g_new0(PageCounters, 1);
+        count->page_address = page;
+        g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
+    }
+    if (qemu_plugin_mem_is_store(meminfo)) {
+        count->writes++;
+        count->cpu_write |= (1 << cpu_index);
+    } else {
+        count->reads++;
+        count->cpu_read |= (1 << cpu_index);
+    }
+}
+
+/* Batched accesses only have the virtual address at hand */
+static void vcpu_mem_batch(unsigned int cpu_index,
+                           const qemu_plugin_mem_record *records,
+                           size_t n, void *udata)
+{
+    size_t i;
+
+    g_mutex_lock(&lock);
+    for (i = 0; i < n; i++) {
+        count_access(cpu_index, records[i].info,
+                     records[i].vaddr & ~page_mask);
+    }
+    g_mutex_unlock(&lock);
+}
+
 static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
                        uint64_t vaddr, void *udata)
 {
     struct qemu_plugin_hwaddr *hwaddr = qemu_plugin_get_hwaddr(meminfo, vaddr);
     uint64_t page;
-    PageCounters *count;
 
     /* We only get a hwaddr for system emulation */
     if (track_io) {
@@ -130,21 +172,7 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
     page &= ~page_mask;
 
     g_mutex_lock(&lock);
-    count = (PageCounters *) g_hash_table_lookup(pages, GUINT_TO_POINTER(page));
-
-    if (!count) {
-        count = g_new0(PageCounters, 1);
-        count->page_address = page;
-        g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
-    }
-    if (qemu_plugin_mem_is_store(meminfo)) {
-        count->writes++;
-        count->cpu_write |= (1 << cpu_index);
-    } else {
-        count->reads++;
-        count->cpu_read |= (1 << cpu_index);
-    }
-
+    count_access(cpu_index, meminfo, page);
     g_mutex_unlock(&lock);
 }
 
@@ -155,6 +183,11 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     for (i = 0; i < n; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        if (ring) {
+            qemu_plugin_register_vcpu_mem_ring(insn, rw, ring);
+            continue;
+        }
         qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
                                          QEMU_PLUGIN_CB_NO_REGS,
                                          rw, NULL);
@@ -187,6 +220,11 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "batch") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &batch)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else if (g_strcmp0(tokens[0], "pagesize") == 0) {
             page_size = g_ascii_strtoull(tokens[1], NULL, 10);
         } else {
@@ -195,7 +233,15 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         }
     }
 
+    if (batch && track_io) {
+        fprintf(stderr, "batch=on cannot track IO addresses\n");
+        return -1;
+    }
+
     plugin_init();
+    if (batch) {
+        ring = qemu_plugin_mem_ring_new(4096, vcpu_mem_batch, NULL);
+    }
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
@@ -0,0 +1,198 @@
+/*
+ * Sampling profiler
+ *
+ * Every N executed translation blocks of a vCPU, record the guest PC
+ * and call stack, and print the samples at exit as folded stacks that
+ * flamegraph.pl and similar tools take as input.  The blocks are only
+ * counted inline in the translated code, so the guest runs at close to
+ * full speed between two samples.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+/* Plugins need to take care of their own locking */
+static GMutex lock;
+static GHashTable *stacks;          /* folded stack -> sample count */
+static uint64_t n_samples;
+
+static struct qemu_plugin_scoreboard *counts;
+static uint64_t period = 10007;     /* prime, so as not to beat with loops */
+static int depth = 32;
+static bool frame_pointers;
+
+static struct qemu_plugin_register *reg_lr, *reg_fp;
+static int ptr_size;
+
+static uint64_t read_reg(struct qemu_plugin_register *reg)
+{
+    uint64_t val = 0;
+
+    /* little-endian guests only, which is what we have to profile */
+    if (!reg || qemu_plugin_read_register(reg, &val, sizeof(val)) <= 0) {
+        return 0;
+    }
+    return val;
+}
+
+static uint64_t read_ptr(uint64_t addr, bool *ok)
+{
+    uint64_t val = 0;
+
+    *ok = qemu_plugin_read_memory_vaddr(addr, &val, ptr_size);
+    return val;
+}
+
+/*
+ * Walk the frame records of an AAPCS64 stack: x29 points to the caller's
+ * x29, followed by the return address.  Without frame pointers only the
+ * link register tells us about the caller, which is still enough to
+ * attribute the leaf functions.
+ */
+static void vcpu_sample(unsigned int vcpu_index, void *udata)
+{
+    g_autoptr(GString) folded = g_string_new(NULL);
+    GArray *pcs = g_array_new(false, false, sizeof(uint64_t));
+    uint64_t pc = (uintptr_t)udata;
+    uint64_t lr = read_reg(reg_lr);
+    gpointer count;
+    int i;
+
+    g_array_append_val(pcs, pc);
+    if (frame_pointers) {
+        uint64_t fp = read_reg(reg_fp);
+        bool ok = true;
+
+        while (fp && ok && pcs->len < depth) {
+            uint64_t next = read_ptr(fp, &ok);
+            uint64_t ret = ok ? read_ptr(fp + ptr_size, &ok) : 0;
+
+            if (!ok || !ret || next <= fp) {
+                break;
+            }
+            g_array_append_val(pcs, ret);
+            fp = next;
+        }
+    } else if (lr && lr != pc) {
+        g_array_append_val(pcs, lr);
+    }
+
+    /* folded stacks are printed from the outermost frame */
+    for (i = pcs->len - 1; i >= 0; i--) {
+        g_string_append_printf(folded, "0x%" PRIx64 "%s",
+                               g_array_index(pcs, uint64_t, i),
+                               i ? ";" : "");
+    }
+    g_array_free(pcs, true);
+
+    g_mutex_lock(&lock);
+    count = g_hash_table_lookup(stacks, folded->str);
+    g_hash_table_replace(stacks, g_strdup(folded->str),
+                         GSIZE_TO_POINTER(GPOINTER_TO_SIZE(count) + 1));
+    n_samples++;
+    g_mutex_unlock(&lock);
+}
+
+/*
+ * The pc register of the vCPU is only written back when a block exits
+ * to the main loop, not when it chains to the next block, so the
+ * address of the block is passed along instead.
+ */
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    qemu_plugin_u64 entry = { .score = counts, .offset = 0 };
+    uintptr_t pc = qemu_plugin_tb_vaddr(tb);
+
+    qemu_plugin_register_vcpu_tb_exec_sampled_cb(tb, vcpu_sample,
+                                                 QEMU_PLUGIN_CB_R_REGS,
+                                                 entry, period, (void *)pc);
+}
+
+static void vcpu_init(qemu_plugin_id_t id, unsigned int vcpu_index)
+{
+    /* all the vCPUs are of the same type */
+    g_mutex_lock(&lock);
+    if (!reg_lr) {
+        reg_lr = qemu_plugin_find_register(vcpu_index, "lr");
+        if (!reg_lr) {
+            reg_lr = qemu_plugin_find_register(vcpu_index, "x30");
+        }
+        reg_fp = qemu_plugin_find_register(vcpu_index, "x29");
+    }
+    g_mutex_unlock(&lock);
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autoptr(GString) report = g_string_new(NULL);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_mutex_lock(&lock);
+    g_string_printf(report, "# %" PRIu64 " samples, one every %" PRIu64
+                    " blocks\n", n_samples, period);
+    g_hash_table_iter_init(&iter, stacks);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_string_append_printf(report, "%s %zu\n", (char *)key,
+                               GPOINTER_TO_SIZE(value));
+    }
+    g_hash_table_destroy(stacks);
+    qemu_plugin_scoreboard_free(counts);
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_outs(report->str);
+}
+
+QEMU_PLUGIN_EXPORT
+int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
+                        int argc, char **argv)
+{
+    bool is_aarch64 = !strcmp(info->target_name, "aarch64");
+
+    frame_pointers = is_aarch64;
+    for (int i = 0; i < argc; i++) {
+        char *opt = argv[i];
+        g_autofree char **tokens = g_strsplit(opt, "=", 2);
+
+        if (g_strcmp0(tokens[0], "period") == 0) {
+            period = g_ascii_strtoull(tokens[1], NULL, 10);
+        } else if (g_strcmp0(tokens[0], "depth") == 0) {
+            depth = atoi(tokens[1]);
+        } else if (g_strcmp0(tokens[0], "fp") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1],
+                                        &frame_pointers)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "option parsing failed: %s\n", opt);
+            return -1;
+        }
+    }
+    if (frame_pointers && !is_aarch64) {
+        fprintf(stderr, "sampler: fp=on is only supported for aarch64\n");
+        return -1;
+    }
+    if (period == 0 || depth < 1) {
+        fprintf(stderr, "sampler: period and depth must be positive\n");
+        return -1;
+    }
+    ptr_size = is_aarch64 ? 8 : 4;
+
+    stacks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    counts = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+
+    qemu_plugin_register_vcpu_init_cb(id, vcpu_init);
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
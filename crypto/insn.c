@@ -0,0 +1,600 @@
+/*
+ * Primitives for emulating the AES and SHA instructions of guest CPUs
+ *
+ * Each primitive has a portable implementation, moved from the Arm
+ * Crypto Extensions helpers, and one using the host instructions on
+ * x86 hosts with AES-NI and SHA-NI and on Arm hosts with the Crypto
+ * Extensions.  The guest instructions are single AES rounds and groups
+ * of four SHA rounds, which map onto the host ones almost directly.
+ *
+ * Copyright (C) 2013 - 2018 Linaro Ltd <ard.biesheuvel@linaro.org>
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "crypto/aes.h"
+#include "crypto/insn.h"
+
+typedef struct CryptoInsnAccel {
+    const char *name;
+    void (*aese)(uint64_t *rd, const uint64_t *rn, const uint64_t *rm,
+                 bool decrypt);
+    void (*aesmc)(uint64_t *rd, const uint64_t *rm, bool decrypt);
+    void (*sha1)(uint64_t *abcd, uint32_t e, const uint64_t *wk,
+                 CryptoInsnSha1Fn fn);
+    void (*sha256)(uint64_t *abcd, uint64_t *efgh, const uint64_t *wk);
+} CryptoInsnAccel;
+
+static inline uint8_t vec_byte(const uint64_t *v, int i)
+{
+    return v[i / 8] >> (i % 8 * 8);
+}
+
+static inline uint32_t vec_word(const uint64_t *v, int i)
+{
+    return v[i / 2] >> (i % 2 * 32);
+}
+
+static inline void vec_set_words(uint64_t *v, const uint32_t *w)
+{
+    v[0] = deposit64(w[0], 32, 32, w[1]);
+    v[1] = deposit64(w[2], 32, 32, w[3]);
+}
+
+static void aese_int(uint64_t *rd, const uint64_t *rn, const uint64_t *rm,
+                     bool decrypt)
+{
+    static uint8_t const * const sbox[2] = { AES_sbox, AES_isbox };
+    static uint8_t const * const shift[2] = { AES_shifts, AES_ishifts };
+    uint64_t st[2] = { rn[0] ^ rm[0], rn[1] ^ rm[1] };
+    uint64_t res[2] = { 0, 0 };
+    int i;
+
+    /* combine ShiftRows operation and sbox substitution */
+    for (i = 0; i < 16; i++) {
+        uint64_t b = sbox[decrypt][vec_byte(st, shift[decrypt][i])];
+
+        res[i / 8] |= b << (i % 8 * 8);
+    }
+
+    rd[0] = res[0];
+    rd[1] = res[1];
+}
+
+static const uint32_t aes_mc[][256] = { {
+    /* MixColumns lookup table */
+    0x00000000, 0x03010102, 0x06020204, 0x05030306,
+    0x0c040408, 0x0f05050a, 0x0a06060c, 0x0907070e,
+    0x18080810, 0x1b090912, 0x1e0a0a14, 0x1d0b0b16,
+    0x140c0c18, 0x170d0d1a, 0x120e0e1c, 0x110f0f1e,
+    0x30101020, 0x33111122, 0x36121224, 0x35131326,
+    0x3c141428, 0x3f15152a, 0x3a16162c, 0x3917172e,
+    0x28181830, 0x2b191932, 0x2e1a1a34, 0x2d1b1b36,
+    0x241c1c38, 0x271d1d3a, 0x221e1e3c, 0x211f1f3e,
+    0x60202040, 0x63212142, 0x66222244, 0x65232346,
+    0x6c242448, 0x6f25254a, 0x6a26264c, 0x6927274e,
+    0x78282850, 0x7b292952, 0x7e2a2a54, 0x7d2b2b56,
+    0x742c2c58, 0x772d2d5a, 0x722e2e5c, 0x712f2f5e,
+    0x50303060, 0x53313162, 0x56323264, 0x55333366,
+    0x5c343468, 0x5f35356a, 0x5a36366c, 0x5937376e,
+    0x48383870, 0x4b393972, 0x4e3a3a74, 0x4d3b3b76,
+    0x443c3c78, 0x473d3d7a, 0x423e3e7c, 0x413f3f7e,
+    0xc0404080, 0xc3414182, 0xc6424284, 0xc5434386,
+    0xcc444488, 0xcf45458a, 0xca46468c, 0xc947478e,
+    0xd8484890, 0xdb494992, 0xde4a4a94, 0xdd4b4b96,
+    0xd44c4c98, 0xd74d4d9a, 0xd24e4e9c, 0xd14f4f9e,
+    0xf05050a0, 0xf35151a2, 0xf65252a4, 0xf55353a6,
+    0xfc5454a8, 0xff5555aa, 0xfa5656ac, 0xf95757ae,
+    0xe85858b0, 0xeb5959b2, 0xee5a5ab4, 0xed5b5bb6,
+    0xe45c5cb8, 0xe75d5dba, 0xe25e5ebc, 0xe15f5fbe,
+    0xa06060c0, 0xa36161c2, 0xa66262c4, 0xa56363c6,
+    0xac6464c8, 0xaf6565ca, 0xaa6666cc, 0xa96767ce,
+    0xb86868d0, 0xbb6969d2, 0xbe6a6ad4, 0xbd6b6bd6,
+    0xb46c6cd8, 0xb76d6dda, 0xb26e6edc, 0xb16f6fde,
+    0x907070e0, 0x937171e2, 0x967272e4, 0x957373e6,
+    0x9c7474e8, 0x9f7575ea, 0x9a7676ec, 0x997777ee,
+    0x887878f0, 0x8b7979f2, 0x8e7a7af4, 0x8d7b7bf6,
+    0x847c7cf8, 0x877d7dfa, 0x827e7efc, 0x817f7ffe,
+    0x9b80801b, 0x98818119, 0x9d82821f, 0x9e83831d,
+    0x97848413, 0x94858511, 0x91868617, 0x92878715,
+    0x8388880b, 0x80898909, 0x858a8a0f, 0x868b8b0d,
+    0x8f8c8c03, 0x8c8d8d01, 0x898e8e07, 0x8a8f8f05,
+    0xab90903b, 0xa8919139, 0xad92923f, 0xae93933d,
+    0xa7949433, 0xa4959531, 0xa1969637, 0xa2979735,
+    0xb398982b, 0xb0999929, 0xb59a9a2f, 0xb69b9b2d,
+    0xbf9c9c23, 0xbc9d9d21, 0xb99e9e27, 0xba9f9f25,
+    0xfba0a05b, 0xf8a1a159, 0xfda2a25f, 0xfea3a35d,
+    0xf7a4a453, 0xf4a5a551, 0xf1a6a657, 0xf2a7a755,
+    0xe3a8a84b, 0xe0a9a949, 0xe5aaaa4f, 0xe6abab4d,
+    0xefacac43, 0xecadad41, 0xe9aeae47, 0xeaafaf45,
+    0xcbb0b07b, 0xc8b1b179, 0xcdb2b27f, 0xceb3b37d,
+    0xc7b4b473, 0xc4b5b571, 0xc1b6b677, 0xc2b7b775,
+    0xd3b8b86b, 0xd0b9b969, 0xd5baba6f, 0xd6bbbb6d,
+    0xdfbcbc63, 0xdcbdbd61, 0xd9bebe67, 0xdabfbf65,
+    0x5bc0c09b, 0x58c1c199, 0x5dc2c29f, 0x5ec3c39d,
+    0x57c4c493, 0x54c5c591, 0x51c6c697, 0x52c7c795,
+    0x43c8c88b, 0x40c9c989, 0x45caca8f, 0x46cbcb8d,
+    0x4fcccc83, 0x4ccdcd81, 0x49cece87, 0x4acfcf85,
+    0x6bd0d0bb, 0x68d1d1b9, 0x6dd2d2bf, 0x6ed3d3bd,
+    0x67d4d4b3, 0x64d5d5b1, 0x61d6d6b7, 0x62d7d7b5,
+    0x73d8d8ab, 0x70d9d9a9, 0x75dadaaf, 0x76dbdbad,
+    0x7fdcdca3, 0x7cdddda1, 0x79dedea7, 0x7adfdfa5,
+    0x3be0e0db, 0x38e1e1d9, 0x3de2e2df, 0x3ee3e3dd,
+    0x37e4e4d3, 0x34e5e5d1, 0x31e6e6d7, 0x32e7e7d5,
+    0x23e8e8cb, 0x20e9e9c9, 0x25eaeacf, 0x26ebebcd,
+    0x2fececc3, 0x2cededc1, 0x29eeeec7, 0x2aefefc5,
+    0x0bf0f0fb, 0x08f1f1f9, 0x0df2f2ff, 0x0ef3f3fd,
+    0x07f4f4f3, 0x04f5f5f1, 0x01f6f6f7, 0x02f7f7f5,
+    0x13f8f8eb, 0x10f9f9e9, 0x15fafaef, 0x16fbfbed,
+    0x1ffcfce3, 0x1cfdfde1, 0x19fefee7, 0x1affffe5,
+}, {
+    /* Inverse MixColumns lookup table */
+    0x00000000, 0x0b0d090e, 0x161a121c, 0x1d171b12,
+    0x2c342438, 0x27392d36, 0x3a2e3624, 0x31233f2a,
+    0x58684870, 0x5365417e, 0x4e725a6c, 0x457f5362,
+    0x745c6c48, 0x7f516546, 0x62467e54, 0x694b775a,
+    0xb0d090e0, 0xbbdd99ee, 0xa6ca82fc, 0xadc78bf2,
+    0x9ce4b4d8, 0x97e9bdd6, 0x8afea6c4, 0x81f3afca,
+    0xe8b8d890, 0xe3b5d19e, 0xfea2ca8c, 0xf5afc382,
+    0xc48cfca8, 0xcf81f5a6, 0xd296eeb4, 0xd99be7ba,
+    0x7bbb3bdb, 0x70b632d5, 0x6da129c7, 0x66ac20c9,
+    0x578f1fe3, 0x5c8216ed, 0x41950dff, 0x4a9804f1,
+    0x23d373ab, 0x28de7aa5, 0x35c961b7, 0x3ec468b9,
+    0x0fe75793, 0x04ea5e9d, 0x19fd458f, 0x12f04c81,
+    0xcb6bab3b, 0xc066a235, 0xdd71b927, 0xd67cb029,
+    0xe75f8f03, 0xec52860d, 0xf1459d1f, 0xfa489411,
+    0x9303e34b, 0x980eea45, 0x8519f157, 0x8e14f859,
+    0xbf37c773, 0xb43ace7d, 0xa92dd56f, 0xa220dc61,
+    0xf66d76ad, 0xfd607fa3, 0xe07764b1, 0xeb7a6dbf,
+    0xda595295, 0xd1545b9b, 0xcc434089, 0xc74e4987,
+    0xae053edd, 0xa50837d3, 0xb81f2cc1, 0xb31225cf,
+    0x82311ae5, 0x893c13eb, 0x942b08f9, 0x9f2601f7,
+    0x46bde64d, 0x4db0ef43, 0x50a7f451, 0x5baafd5f,
+    0x6a89c275, 0x6184cb7b, 0x7c93d069, 0x779ed967,
+    0x1ed5ae3d, 0x15d8a733, 0x08cfbc21, 0x03c2b52f,
+    0x32e18a05, 0x39ec830b, 0x24fb9819, 0x2ff69117,
+    0x8dd64d76, 0x86db4478, 0x9bcc5f6a, 0x90c15664,
+    0xa1e2694e, 0xaaef6040, 0xb7f87b52, 0xbcf5725c,
+    0xd5be0506, 0xdeb30c08, 0xc3a4171a, 0xc8a91e14,
+    0xf98a213e, 0xf2872830, 0xef903322, 0xe49d3a2c,
+    0x3d06dd96, 0x360bd498, 0x2b1ccf8a, 0x2011c684,
+    0x1132f9ae, 0x1a3ff0a0, 0x0728ebb2, 0x0c25e2bc,
+    0x656e95e6, 0x6e639ce8, 0x737487fa, 0x78798ef4,
+    0x495ab1de, 0x4257b8d0, 0x5f40a3c2, 0x544daacc,
+    0xf7daec41, 0xfcd7e54f, 0xe1c0fe5d, 0xeacdf753,
+    0xdbeec879, 0xd0e3c177, 0xcdf4da65, 0xc6f9d36b,
+    0xafb2a431, 0xa4bfad3f, 0xb9a8b62d, 0xb2a5bf23,
+    0x83868009, 0x888b8907, 0x959c9215, 0x9e919b1b,
+    0x470a7ca1, 0x4c0775af, 0x51106ebd, 0x5a1d67b3,
+    0x6b3e5899, 0x60335197, 0x7d244a85, 0x7629438b,
+    0x1f6234d1, 0x146f3ddf, 0x097826cd, 0x02752fc3,
+    0x335610e9, 0x385b19e7, 0x254c02f5, 0x2e410bfb,
+    0x8c61d79a, 0x876cde94, 0x9a7bc586, 0x9176cc88,
+    0xa055f3a2, 0xab58faac, 0xb64fe1be, 0xbd42e8b0,
+    0xd4099fea, 0xdf0496e4, 0xc2138df6, 0xc91e84f8,
+    0xf83dbbd2, 0xf330b2dc, 0xee27a9ce, 0xe52aa0c0,
+    0x3cb1477a, 0x37bc4e74, 0x2aab5566, 0x21a65c68,
+    0x10856342, 0x1b886a4c, 0x069f715e, 0x0d927850,
+    0x64d90f0a, 0x6fd40604, 0x72c31d16, 0x79ce1418,
+    0x48ed2b32, 0x43e0223c, 0x5ef7392e, 0x55fa3020,
+    0x01b79aec, 0x0aba93e2, 0x17ad88f0, 0x1ca081fe,
+    0x2d83bed4, 0x268eb7da, 0x3b99acc8, 0x3094a5c6,
+    0x59dfd29c, 0x52d2db92, 0x4fc5c080, 0x44c8c98e,
+    0x75ebf6a4, 0x7ee6ffaa, 0x63f1e4b8, 0x68fcedb6,
+    0xb1670a0c, 0xba6a0302, 0xa77d1810, 0xac70111e,
+    0x9d532e34, 0x965e273a, 0x8b493c28, 0x80443526,
+    0xe90f427c, 0xe2024b72, 0xff155060, 0xf418596e,
+    0xc53b6644, 0xce366f4a, 0xd3217458, 0xd82c7d56,
+    0x7a0ca137, 0x7101a839, 0x6c16b32b, 0x671bba25,
+    0x5638850f, 0x5d358c01, 0x40229713, 0x4b2f9e1d,
+    0x2264e947, 0x2969e049, 0x347efb5b, 0x3f73f255,
+    0x0e50cd7f, 0x055dc471, 0x184adf63, 0x1347d66d,
+    0xcadc31d7, 0xc1d138d9, 0xdcc623cb, 0xd7cb2ac5,
+    0xe6e815ef, 0xede51ce1, 0xf0f207f3, 0xfbff0efd,
+    0x92b479a7, 0x99b970a9, 0x84ae6bbb, 0x8fa362b5,
+    0xbe805d9f, 0xb58d5491, 0xa89a4f83, 0xa397468d,
+} };
+
+static void aesmc_int(uint64_t *rd, const uint64_t *rm, bool decrypt)
+{
+    uint32_t w[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        w[i] = aes_mc[decrypt][vec_byte(rm, 4 * i)] ^
+               rol32(aes_mc[decrypt][vec_byte(rm, 4 * i + 1)], 8) ^
+               rol32(aes_mc[decrypt][vec_byte(rm, 4 * i + 2)], 16) ^
+               rol32(aes_mc[decrypt][vec_byte(rm, 4 * i + 3)], 24);
+    }
+    vec_set_words(rd, w);
+}
+
+/*
+ * SHA-1 and SHA-256 logical functions
+ */
+
+static uint32_t cho(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (x & (y ^ z)) ^ z;
+}
+
+static uint32_t par(uint32_t x, uint32_t y, uint32_t z)
+{
+    return x ^ y ^ z;
+}
+
+static uint32_t maj(uint32_t x, uint32_t y, uint32_t z)
+{
+    return (x & y) | ((x | y) & z);
+}
+
+static uint32_t S0(uint32_t x)
+{
+    return ror32(x, 2) ^ ror32(x, 13) ^ ror32(x, 22);
+}
+
+static uint32_t S1(uint32_t x)
+{
+    return ror32(x, 6) ^ ror32(x, 11) ^ ror32(x, 25);
+}
+
+static void sha1_int(uint64_t *abcd, uint32_t e, const uint64_t *wk,
+                     CryptoInsnSha1Fn fn)
+{
+    uint32_t d[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        d[i] = vec_word(abcd, i);
+    }
+    for (i = 0; i < 4; i++) {
+        uint32_t t;
+
+        switch (fn) {
+        case CRYPTO_INSN_SHA1_CHOOSE:
+            t = cho(d[1], d[2], d[3]);
+            break;
+        case CRYPTO_INSN_SHA1_PARITY:
+            t = par(d[1], d[2], d[3]);
+            break;
+        case CRYPTO_INSN_SHA1_MAJORITY:
+            t = maj(d[1], d[2], d[3]);
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        t += rol32(d[0], 5) + e + vec_word(wk, i);
+
+        e = d[3];
+        d[3] = d[2];
+        d[2] = ror32(d[1], 2);
+        d[1] = d[0];
+        d[0] = t;
+    }
+    vec_set_words(abcd, d);
+}
+
+static void sha256_int(uint64_t *abcd, uint64_t *efgh, const uint64_t *wk)
+{
+    uint32_t d[4], n[4];
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        d[i] = vec_word(abcd, i);
+        n[i] = vec_word(efgh, i);
+    }
+    for (i = 0; i < 4; i++) {
+        uint32_t t = cho(n[0], n[1], n[2]) + n[3] + S1(n[0])
+                     + vec_word(wk, i);
+
+        n[3] = n[2];
+        n[2] = n[1];
+        n[1] = n[0];
+        n[0] = d[3] + t;
+
+        t += maj(d[0], d[1], d[2]) + S0(d[0]);
+
+        d[3] = d[2];
+        d[2] = d[1];
+        d[1] = d[0];
+        d[0] = t;
+    }
+    vec_set_words(abcd, d);
+    vec_set_words(efgh, n);
+}
+
+static const CryptoInsnAccel crypto_insn_int = {
+    .name = "C",
+    .aese = aese_int,
+    .aesmc = aesmc_int,
+    .sha1 = sha1_int,
+    .sha256 = sha256_int,
+};
+
+#if defined(CONFIG_AES_SHA_OPT) && defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("aes,sha,sse4.1")
+#include <immintrin.h>
+
+/* The SHA-1 round constants, which SHA1RNDS4 adds on its own */
+static const uint32_t sha1_k[] = {
+    [CRYPTO_INSN_SHA1_CHOOSE] = 0x5a827999,
+    [CRYPTO_INSN_SHA1_PARITY] = 0x6ed9eba1,
+    [CRYPTO_INSN_SHA1_MAJORITY] = 0x8f1bbcdc,
+};
+
+static void aese_x86(uint64_t *rd, const uint64_t *rn, const uint64_t *rm,
+                     bool decrypt)
+{
+    __m128i st = _mm_xor_si128(_mm_loadu_si128((const __m128i *)rn),
+                               _mm_loadu_si128((const __m128i *)rm));
+    __m128i zero = _mm_setzero_si128();
+
+    /* The last round of AES-NI has no MixColumns and adds the key last */
+    st = decrypt ? _mm_aesdeclast_si128(st, zero) :
+                   _mm_aesenclast_si128(st, zero);
+    _mm_storeu_si128((__m128i *)rd, st);
+}
+
+static void aesmc_x86(uint64_t *rd, const uint64_t *rm, bool decrypt)
+{
+    __m128i st = _mm_loadu_si128((const __m128i *)rm);
+    __m128i zero = _mm_setzero_si128();
+
+    /*
+     * There is no MixColumns on its own: undo the ShiftRows and SubBytes
+     * of a full encryption round first, since they commute.
+     */
+    st = decrypt ? _mm_aesimc_si128(st) :
+                   _mm_aesenc_si128(_mm_aesdeclast_si128(st, zero), zero);
+    _mm_storeu_si128((__m128i *)rd, st);
+}
+
+/* Immediate of SHA1RNDS4 for each function, which selects the constant */
+#define SHA1_RNDS4(fn, abcd, msg) \
+    ((fn) == CRYPTO_INSN_SHA1_CHOOSE ? _mm_sha1rnds4_epu32(abcd, msg, 0) : \
+     (fn) == CRYPTO_INSN_SHA1_PARITY ? _mm_sha1rnds4_epu32(abcd, msg, 1) : \
+                                       _mm_sha1rnds4_epu32(abcd, msg, 2))
+
+static void sha1_x86(uint64_t *abcd, uint32_t e, const uint64_t *wk,
+                     CryptoInsnSha1Fn fn)
+{
+    /* SHA-NI keeps A and W0 in the top element */
+    __m128i st = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)abcd),
+                                   0x1b);
+    __m128i msg = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)wk),
+                                    0x1b);
+
+    /* Take out the constant that SHA1RNDS4 adds, and add E to W0 */
+    msg = _mm_sub_epi32(msg, _mm_set1_epi32(sha1_k[fn]));
+    msg = _mm_add_epi32(msg, _mm_set_epi32(e, 0, 0, 0));
+    st = SHA1_RNDS4(fn, st, msg);
+    _mm_storeu_si128((__m128i *)abcd, _mm_shuffle_epi32(st, 0x1b));
+}
+
+static void sha256_x86(uint64_t *abcd, uint64_t *efgh, const uint64_t *wk)
+{
+    /* SHA-NI splits the state as ABEF and CDGH, A and C on top */
+    __m128i ba = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)abcd),
+                                   0xb1);
+    __m128i fe = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)efgh),
+                                   0xb1);
+    __m128i msg = _mm_loadu_si128((const __m128i *)wk);
+    __m128i abef = _mm_unpacklo_epi64(fe, ba);
+    __m128i cdgh = _mm_unpackhi_epi64(fe, ba);
+    __m128i abef2;
+
+    /* Two rounds each, with the two low elements of the message */
+    abef2 = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+    cdgh = abef;
+    abef = _mm_sha256rnds2_epu32(cdgh, abef2, _mm_shuffle_epi32(msg, 0x0e));
+    cdgh = abef2;
+
+    _mm_storeu_si128((__m128i *)abcd,
+                     _mm_shuffle_epi32(_mm_unpackhi_epi64(abef, cdgh), 0xb1));
+    _mm_storeu_si128((__m128i *)efgh,
+                     _mm_shuffle_epi32(_mm_unpacklo_epi64(abef, cdgh), 0xb1));
+}
+
+#pragma GCC pop_options
+
+static const CryptoInsnAccel crypto_insn_aesni = {
+    .name = "AES-NI",
+    .aese = aese_x86,
+    .aesmc = aesmc_x86,
+    .sha1 = sha1_int,
+    .sha256 = sha256_int,
+};
+
+static const CryptoInsnAccel crypto_insn_aesni_sha = {
+    .name = "AES-NI+SHA-NI",
+    .aese = aese_x86,
+    .aesmc = aesmc_x86,
+    .sha1 = sha1_x86,
+    .sha256 = sha256_x86,
+};
+#endif /* CONFIG_AES_SHA_OPT && __x86_64__ */
+
+#if defined(CONFIG_AES_SHA_OPT) && defined(__aarch64__)
+#pragma GCC push_options
+#pragma GCC target("+crypto")
+#include <arm_neon.h>
+
+/* The host has the very instructions the guest does */
+static void aese_arm(uint64_t *rd, const uint64_t *rn, const uint64_t *rm,
+                     bool decrypt)
+{
+    uint8x16_t st = vld1q_u8((const uint8_t *)rn);
+    uint8x16_t rk = vld1q_u8((const uint8_t *)rm);
+
+    st = decrypt ? vaesdq_u8(st, rk) : vaeseq_u8(st, rk);
+    vst1q_u8((uint8_t *)rd, st);
+}
+
+static void aesmc_arm(uint64_t *rd, const uint64_t *rm, bool decrypt)
+{
+    uint8x16_t st = vld1q_u8((const uint8_t *)rm);
+
+    st = decrypt ? vaesimcq_u8(st) : vaesmcq_u8(st);
+    vst1q_u8((uint8_t *)rd, st);
+}
+
+static void sha1_arm(uint64_t *abcd, uint32_t e, const uint64_t *wk,
+                     CryptoInsnSha1Fn fn)
+{
+    uint32x4_t st = vld1q_u32((const uint32_t *)abcd);
+    uint32x4_t msg = vld1q_u32((const uint32_t *)wk);
+
+    switch (fn) {
+    case CRYPTO_INSN_SHA1_CHOOSE:
+        st = vsha1cq_u32(st, e, msg);
+        break;
+    case CRYPTO_INSN_SHA1_PARITY:
+        st = vsha1pq_u32(st, e, msg);
+        break;
+    case CRYPTO_INSN_SHA1_MAJORITY:
+        st = vsha1mq_u32(st, e, msg);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    vst1q_u32((uint32_t *)abcd, st);
+}
+
+static void sha256_arm(uint64_t *abcd, uint64_t *efgh, const uint64_t *wk)
+{
+    uint32x4_t st0 = vld1q_u32((const uint32_t *)abcd);
+    uint32x4_t st1 = vld1q_u32((const uint32_t *)efgh);
+    uint32x4_t msg = vld1q_u32((const uint32_t *)wk);
+
+    vst1q_u32((uint32_t *)abcd, vsha256hq_u32(st0, st1, msg));
+    vst1q_u32((uint32_t *)efgh, vsha256h2q_u32(st1, st0, msg));
+}
+
+#pragma GCC pop_options
+
+static const CryptoInsnAccel crypto_insn_armv8 = {
+    .name = "Armv8 Crypto",
+    .aese = aese_arm,
+    .aesmc = aesmc_arm,
+    .sha1 = sha1_arm,
+    .sha256 = sha256_arm,
+};
+#endif /* CONFIG_AES_SHA_OPT && __aarch64__ */
+
+/* Cleared from the lowest bit up by crypto_insn_next_accel() */
+#define CACHE_SHA     1
+#define CACHE_AES     2
+
+static unsigned cpuid_cache;
+static const CryptoInsnAccel *crypto_insn_accel = &crypto_insn_int;
+
+static void init_accel(unsigned cache)
+{
+    const CryptoInsnAccel *accel = &crypto_insn_int;
+
+#if defined(CONFIG_AES_SHA_OPT) && defined(__x86_64__)
+    if ((cache & CACHE_AES) && (cache & CACHE_SHA)) {
+        accel = &crypto_insn_aesni_sha;
+    } else if (cache & CACHE_AES) {
+        accel = &crypto_insn_aesni;
+    }
+#elif defined(CONFIG_AES_SHA_OPT) && defined(__aarch64__)
+    if ((cache & CACHE_AES) && (cache & CACHE_SHA)) {
+        accel = &crypto_insn_armv8;
+    }
+#endif
+    crypto_insn_accel = accel;
+}
+
+#if defined(CONFIG_AES_SHA_OPT) && defined(__x86_64__)
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if ((c & bit_AES) && (c & bit_SSE4_1)) {
+            cache |= CACHE_AES;
+        }
+    }
+    if (max >= 7) {
+        __cpuid_count(7, 0, a, b, c, d);
+        if (b & bit_SHA) {
+            cache |= CACHE_SHA;
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#elif defined(CONFIG_AES_SHA_OPT) && defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES   (1 << 3)
+#endif
+#ifndef HWCAP_SHA1
+#define HWCAP_SHA1  (1 << 5)
+#endif
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2  (1 << 6)
+#endif
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned long hwcap = qemu_getauxval(AT_HWCAP);
+    unsigned cache = 0;
+
+    if (hwcap & HWCAP_AES) {
+        cache |= CACHE_AES;
+    }
+    if ((hwcap & HWCAP_SHA1) && (hwcap & HWCAP_SHA2)) {
+        cache |= CACHE_SHA;
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif
+
+bool crypto_insn_next_accel(void)
+{
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+const char *crypto_insn_accel_name(void)
+{
+    return crypto_insn_accel->name;
+}
+
+void crypto_insn_aese(uint64_t *rd, const uint64_t *rn, const uint64_t *rm,
+                      bool decrypt)
+{
+    crypto_insn_accel->aese(rd, rn, rm, decrypt);
+}
+
+void crypto_insn_aesmc(uint64_t *rd, const uint64_t *rm, bool decrypt)
+{
+    crypto_insn_accel->aesmc(rd, rm, decrypt);
+}
+
+void crypto_insn_sha1(uint64_t *abcd, uint32_t e, const uint64_t *wk,
+                      CryptoInsnSha1Fn fn)
+{
+    crypto_insn_accel->sha1(abcd, e, wk, fn);
+}
+
+void crypto_insn_sha256(uint64_t *abcd, uint64_t *efgh, const uint64_t *wk)
+{
+    crypto_insn_accel->sha256(abcd, efgh, wk);
+}
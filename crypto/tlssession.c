@@ -33,6 +33,18 @@
 
 #include <gnutls/x509.h>
 
+#ifdef CONFIG_LINUX_KTLS
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
 
 struct QCryptoTLSSession {
     QCryptoTLSCreds *creds;
@@ -539,6 +551,123 @@ qcrypto_tls_session_get_key_size(QCryptoTLSSession *session,
 }
 
 
+#ifdef CONFIG_LINUX_KTLS
+/*
+ * Fill the kernel's description of an AES-GCM write state, laid out
+ * the same way whatever the key size.  TLS 1.2 sends an explicit nonce,
+ * which the kernel takes from the record sequence number; TLS 1.3
+ * derives it from the IV that gnutls exports after the salt.
+ */
+#define QCRYPTO_KTLS_FILL_GCM(ci, CIPHER)                               \
+    do {                                                                \
+        if (cipher_key.size != TLS_CIPHER_##CIPHER##_KEY_SIZE ||        \
+            iv.size < TLS_CIPHER_##CIPHER##_SALT_SIZE ||                \
+            (version == GNUTLS_TLS1_3 &&                                \
+             iv.size != TLS_CIPHER_##CIPHER##_SALT_SIZE +               \
+                        TLS_CIPHER_##CIPHER##_IV_SIZE)) {               \
+            goto unsupported;                                           \
+        }                                                               \
+        (ci).info.version = version == GNUTLS_TLS1_2 ?                  \
+                            TLS_1_2_VERSION : TLS_1_3_VERSION;          \
+        (ci).info.cipher_type = TLS_CIPHER_##CIPHER;                    \
+        memcpy((ci).key, cipher_key.data, sizeof((ci).key));            \
+        memcpy((ci).salt, iv.data, sizeof((ci).salt));                  \
+        memcpy((ci).rec_seq, seq, sizeof((ci).rec_seq));                \
+        if (version == GNUTLS_TLS1_2) {                                 \
+            memcpy((ci).iv, seq, sizeof((ci).iv));                      \
+        } else {                                                        \
+            memcpy((ci).iv, iv.data + sizeof((ci).salt),                \
+                   sizeof((ci).iv));                                    \
+        }                                                               \
+        info_len = sizeof(ci);                                          \
+    } while (0)
+
+int
+qcrypto_tls_session_enable_ktls_send(QCryptoTLSSession *session,
+                                     int fd,
+                                     Error **errp)
+{
+    gnutls_protocol_t version = gnutls_protocol_get_version(session->handle);
+    gnutls_cipher_algorithm_t cipher = gnutls_cipher_get(session->handle);
+    gnutls_datum_t mac_key, iv, cipher_key;
+    unsigned char seq[8];
+    union {
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+    } info;
+    socklen_t info_len;
+    int ret;
+
+    if (!session->creds->ktls) {
+        return 0;
+    }
+    if (!session->handshakeComplete) {
+        error_setg(errp, "Kernel TLS needs a completed handshake");
+        return -1;
+    }
+    if (fd < 0) {
+        error_setg(errp, "Kernel TLS needs a socket");
+        return -1;
+    }
+    if (version != GNUTLS_TLS1_2 && version != GNUTLS_TLS1_3) {
+        goto unsupported;
+    }
+
+    ret = gnutls_record_get_state(session->handle, 0, &mac_key, &iv,
+                                  &cipher_key, seq);
+    if (ret < 0) {
+        error_setg(errp, "Cannot get TLS write state: %s",
+                   gnutls_strerror(ret));
+        return -1;
+    }
+
+    memset(&info, 0, sizeof(info));
+    switch (cipher) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        QCRYPTO_KTLS_FILL_GCM(info.aes128, AES_GCM_128);
+        break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+        QCRYPTO_KTLS_FILL_GCM(info.aes256, AES_GCM_256);
+        break;
+    default:
+        goto unsupported;
+    }
+
+    ret = setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls"));
+    if (ret == 0) {
+        ret = setsockopt(fd, SOL_TLS, TLS_TX, &info, info_len);
+    }
+    memset(&info, 0, sizeof(info));
+    if (ret < 0) {
+        error_setg_errno(errp, errno, "Cannot enable kernel TLS");
+        return -1;
+    }
+
+    trace_qcrypto_tls_session_ktls_send(session,
+                                        gnutls_cipher_get_name(cipher));
+    return 1;
+
+ unsupported:
+    error_setg(errp, "Kernel TLS does not support %s with %s",
+               gnutls_cipher_get_name(cipher),
+               gnutls_protocol_get_name(version));
+    return -1;
+}
+#else /* ! CONFIG_LINUX_KTLS */
+int
+qcrypto_tls_session_enable_ktls_send(QCryptoTLSSession *session,
+                                     int fd G_GNUC_UNUSED,
+                                     Error **errp)
+{
+    if (!session->creds->ktls) {
+        return 0;
+    }
+    error_setg(errp, "Kernel TLS is not supported on this host");
+    return -1;
+}
+#endif /* ! CONFIG_LINUX_KTLS */
+
+
 char *
 qcrypto_tls_session_get_peer_name(QCryptoTLSSession *session)
 {
@@ -634,6 +763,15 @@ qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
 }
 
 
+int
+qcrypto_tls_session_enable_ktls_send(QCryptoTLSSession *sess G_GNUC_UNUSED,
+                                     int fd G_GNUC_UNUSED,
+                                     Error **errp G_GNUC_UNUSED)
+{
+    return 0;
+}
+
+
 char *
 qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess)
 {
@@ -3,6 +3,10 @@
 #include "disas/dis-asm.h"
 #include "elf.h"
 #include "qemu/qemu-print.h"
+#include "qemu/crc32c.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "qemu/xxhash.h"
 
 #include "disas/disas.h"
 #include "disas/capstone.h"
@@ -210,45 +214,7 @@ static void initialize_debug_host(CPUDebug *s)
 #endif
 }
 
-/* Disassemble this for me please... (debugging).  */
-void target_disas(FILE *out, CPUState *cpu, target_ulong code,
-                  target_ulong size)
-{
-    target_ulong pc;
-    int count;
-    CPUDebug s;
-
-    initialize_debug_target(&s, cpu);
-    s.info.fprintf_func = fprintf;
-    s.info.stream = out;
-    s.info.buffer_vma = code;
-    s.info.buffer_length = size;
-
-    if (s.info.cap_arch >= 0 && cap_disas_target(&s.info, code, size)) {
-        return;
-    }
-
-    if (s.info.print_insn == NULL) {
-        s.info.print_insn = print_insn_od_target;
-    }
-
-    for (pc = code; size > 0; pc += count, size -= count) {
-	fprintf(out, "0x" TARGET_FMT_lx ":  ", pc);
-	count = s.info.print_insn(pc, &s.info);
-	fprintf(out, "\n");
-	if (count < 0)
-	    break;
-        if (size < count) {
-            fprintf(out,
-                    "Disassembler disagrees with translator over instruction "
-                    "decoding\n"
-                    "Please report this to qemu-devel@nongnu.org\n");
-            break;
-        }
-    }
-}
-
-static int plugin_printf(FILE *stream, const char *fmt, ...)
+static int gstring_printf(FILE *stream, const char *fmt, ...)
 {
     /* We abuse the FILE parameter to pass a GString. */
     GString *s = (GString *)stream;
@@ -267,36 +233,225 @@ static void plugin_print_address(bfd_vma addr, struct disassemble_info *info)
     /* does nothing */
 }
 
+/*
+ * Disassembly cache
+ *
+ * Firmware code gets translated, hence disassembled for "-d in_asm"
+ * and for plugins, over and over: after every tb_flush, and whenever
+ * a TB is retranslated.  The text only depends on the bytes, on the
+ * address they are at, through PC-relative operands, and on the setup
+ * of the disassembler, such as ARM or Thumb, so it is cached under all
+ * three and capstone only runs for code it hasn't seen.  The cache is
+ * emptied when the code and text it holds reach DISAS_CACHE_MAX bytes.
+ */
+#define DISAS_CACHE_MAX     (16 * MiB)
+
+typedef enum {
+    DISAS_CACHE_TARGET,
+    DISAS_CACHE_PLUGIN,
+} DisasCacheKind;
+
+typedef struct DisasCacheKey {
+    uint32_t hash;
+    DisasCacheKind kind;
+    uint64_t addr;
+    int cap_arch;
+    int cap_mode;
+    unsigned long mach;
+    unsigned long flags;
+    enum bfd_endian endian;
+    disassembler_ftype print_insn;
+    size_t len;
+    uint8_t bytes[];
+} DisasCacheKey;
+
+static QemuMutex disas_cache_lock;
+static GHashTable *disas_cache;
+static size_t disas_cache_size;
+
+static guint disas_cache_hash(gconstpointer p)
+{
+    const DisasCacheKey *k = p;
+
+    return k->hash;
+}
+
+static gboolean disas_cache_equal(gconstpointer a, gconstpointer b)
+{
+    const DisasCacheKey *ka = a, *kb = b;
+
+    return ka->len == kb->len &&
+           !memcmp(ka, kb, offsetof(DisasCacheKey, bytes) + ka->len);
+}
+
+static void __attribute__((__constructor__)) disas_cache_init(void)
+{
+    qemu_mutex_init(&disas_cache_lock);
+    disas_cache = g_hash_table_new_full(disas_cache_hash, disas_cache_equal,
+                                        g_free, g_free);
+}
+
+/*
+ * Return the key of the @size bytes at @addr for @s, or NULL if they
+ * can't be read.
+ */
+static DisasCacheKey *disas_cache_key(CPUDebug *s, DisasCacheKind kind,
+                                      uint64_t addr, size_t size)
+{
+    DisasCacheKey *k = g_malloc0(sizeof(*k) + size);
+
+    k->kind = kind;
+    k->addr = addr;
+    k->cap_arch = s->info.cap_arch;
+    k->cap_mode = s->info.cap_mode;
+    k->mach = s->info.mach;
+    k->flags = s->info.flags;
+    k->endian = s->info.endian;
+    k->print_insn = s->info.print_insn;
+    k->len = size;
+    if (cpu_memory_rw_debug(s->cpu, addr, k->bytes, size, 0)) {
+        g_free(k);
+        return NULL;
+    }
+    /* The key is zero-initialized, so padding compares equal too */
+    k->hash = qemu_xxhash7(addr, size, kind,
+                           qemu_xxhash2(k->cap_mode, k->mach),
+                           crc32c(0xffffffff, k->bytes, size));
+    return k;
+}
+
+/* Return a copy of the cached text for @k */
+static char *disas_cache_lookup(DisasCacheKey *k)
+{
+    char *text;
+
+    qemu_mutex_lock(&disas_cache_lock);
+    text = g_strdup(g_hash_table_lookup(disas_cache, k));
+    qemu_mutex_unlock(&disas_cache_lock);
+    return text;
+}
+
+/* Cache @text under @k, which the cache takes */
+static void disas_cache_insert(DisasCacheKey *k, const char *text)
+{
+    size_t size = sizeof(*k) + k->len + strlen(text) + 1;
+
+    qemu_mutex_lock(&disas_cache_lock);
+    if (disas_cache_size + size > DISAS_CACHE_MAX) {
+        g_hash_table_remove_all(disas_cache);
+        disas_cache_size = 0;
+    }
+    if (g_hash_table_insert(disas_cache, k, g_strdup(text))) {
+        disas_cache_size += size;
+    }
+    qemu_mutex_unlock(&disas_cache_lock);
+}
+
+static void target_disas_text(CPUDebug *s, GString *ds, target_ulong code,
+                              target_ulong size)
+{
+    target_ulong pc;
+    int count;
+
+    s->info.fprintf_func = gstring_printf;
+    s->info.stream = (FILE *)ds;  /* abuse this slot */
+    s->info.buffer_vma = code;
+    s->info.buffer_length = size;
+
+    if (s->info.cap_arch >= 0 && cap_disas_target(&s->info, code, size)) {
+        return;
+    }
+
+    if (s->info.print_insn == NULL) {
+        s->info.print_insn = print_insn_od_target;
+    }
+
+    for (pc = code; size > 0; pc += count, size -= count) {
+        g_string_append_printf(ds, "0x" TARGET_FMT_lx ":  ", pc);
+        count = s->info.print_insn(pc, &s->info);
+        g_string_append_c(ds, '\n');
+        if (count < 0) {
+            break;
+        }
+        if (size < count) {
+            g_string_append(ds,
+                            "Disassembler disagrees with translator over "
+                            "instruction decoding\n"
+                            "Please report this to qemu-devel@nongnu.org\n");
+            break;
+        }
+    }
+}
 
 /*
  * We should only be dissembling one instruction at a time here. If
  * there is left over it usually indicates the front end has read more
  * bytes than it needed.
  */
-char *plugin_disas(CPUState *cpu, uint64_t addr, size_t size)
+static void plugin_disas_text(CPUDebug *s, GString *ds, target_ulong addr,
+                              target_ulong size)
 {
-    CPUDebug s;
-    GString *ds = g_string_new(NULL);
+    s->info.fprintf_func = gstring_printf;
+    s->info.stream = (FILE *)ds;  /* abuse this slot */
+    s->info.buffer_vma = addr;
+    s->info.buffer_length = size;
+    s->info.print_address_func = plugin_print_address;
 
-    initialize_debug_target(&s, cpu);
-    s.info.fprintf_func = plugin_printf;
-    s.info.stream = (FILE *)ds;  /* abuse this slot */
-    s.info.buffer_vma = addr;
-    s.info.buffer_length = size;
-    s.info.print_address_func = plugin_print_address;
-
-    if (s.info.cap_arch >= 0 && cap_disas_plugin(&s.info, addr, size)) {
+    if (s->info.cap_arch >= 0 && cap_disas_plugin(&s->info, addr, size)) {
         ; /* done */
-    } else if (s.info.print_insn) {
-        s.info.print_insn(addr, &s.info);
+    } else if (s->info.print_insn) {
+        s->info.print_insn(addr, &s->info);
     } else {
         ; /* cannot disassemble -- return empty string */
     }
+}
+
+/* Disassemble the @size bytes at @addr with @fn, or take them from cache */
+static char *disas_cached(CPUState *cpu, DisasCacheKind kind,
+                          void (*fn)(CPUDebug *, GString *, target_ulong,
+                                     target_ulong),
+                          target_ulong addr, target_ulong size)
+{
+    CPUDebug s;
+    DisasCacheKey *k;
+    GString *ds;
+    char *text;
+
+    initialize_debug_target(&s, cpu);
+    k = disas_cache_key(&s, kind, addr, size);
+    if (k) {
+        text = disas_cache_lookup(k);
+        if (text) {
+            g_free(k);
+            return text;
+        }
+    }
 
+    ds = g_string_new(NULL);
+    fn(&s, ds, addr, size);
+    if (k) {
+        disas_cache_insert(k, ds->str);
+    }
     /* Return the buffer, freeing the GString container.  */
     return g_string_free(ds, false);
 }
 
+/* Disassemble this for me please... (debugging).  */
+void target_disas(FILE *out, CPUState *cpu, target_ulong code,
+                  target_ulong size)
+{
+    g_autofree char *text = disas_cached(cpu, DISAS_CACHE_TARGET,
+                                         target_disas_text, code, size);
+
+    fputs(text, out);
+}
+
+char *plugin_disas(CPUState *cpu, uint64_t addr, size_t size)
+{
+    return disas_cached(cpu, DISAS_CACHE_PLUGIN, plugin_disas_text,
+                        addr, size);
+}
+
 /* Disassemble this for me please... (debugging). */
 void disas(FILE *out, const void *code, unsigned long size)
 {
@@ -241,6 +241,40 @@ static inline bool can_use_fpu(const float_status *s)
                   s->float_rounding_mode == float_round_nearest_even);
 }
 
+/*
+ * Conversions to integer take their rounding mode from the caller, which
+ * is often not the one in @s (e.g. Arm's VCVT always truncates).  Casts
+ * truncate and rint() rounds to nearest-even, since QEMU never changes
+ * the host rounding mode; the other modes go the soft way.
+ */
+static inline bool can_use_fpu_toint(const float_status *s,
+                                     FloatRoundMode rmode)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely(s->float_exception_flags & float_flag_inexact &&
+                  (rmode == float_round_to_zero ||
+                   rmode == float_round_nearest_even));
+}
+
+/*
+ * Round @d to an integer in [@min, @max].  NaNs, infinities and values
+ * out of range only fail the range check, so that the soft code raises
+ * invalid for them.  The caller must rule out denormals, which have to
+ * raise input_denormal when flushing inputs to zero.
+ */
+static inline bool hard_f64_to_int(double d, FloatRoundMode rmode,
+                                   double min, double max, int64_t *r)
+{
+    d = rmode == float_round_to_zero ? trunc(d) : rint(d);
+    if (likely(d >= min && d <= max)) {
+        *r = (int64_t)d;
+        return true;
+    }
+    return false;
+}
+
 /*
  * Hardfloat generation functions. Each operation can have two flavors:
  * either using softfloat primitives (e.g. float32_is_zero_or_normal) for
@@ -2698,7 +2732,8 @@ float16 float64_to_float16(float64 a, bool ieee, float_status *s)
     return float16a_round_pack_canonical(&p, s, fmt);
 }
 
-float32 float64_to_float32(float64 a, float_status *s)
+static float32 QEMU_SOFTFLOAT_ATTR
+soft_float64_to_float32(float64 a, float_status *s)
 {
     FloatParts64 p;
 
@@ -2707,6 +2742,28 @@ float32 float64_to_float32(float64 a, float_status *s)
     return float32_round_pack_canonical(&p, s);
 }
 
+float32 float64_to_float32(float64 a, float_status *s)
+{
+    if (likely(float64_is_normal(a)) && can_use_fpu(s)) {
+        /*
+         * Narrowing can be inexact, but the flag is already set.  Results
+         * that may overflow or underflow need the soft code to get the
+         * flags, tininess detection and flush-to-zero right.
+         */
+        union_float64 ud;
+        union_float32 uf;
+
+        ud.s = a;
+        uf.h = ud.h;
+        if (likely(!isinf(uf.h) && fabs(ud.h) > FLT_MIN)) {
+            return uf.s;
+        }
+    } else if (float64_is_zero(a)) {
+        return float32_set_sign(float32_zero, float64_is_neg(a));
+    }
+    return soft_float64_to_float32(a, s);
+}
+
 float32 bfloat16_to_float32(bfloat16 a, float_status *s)
 {
     FloatParts64 p;
@@ -2966,6 +3023,17 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_toint(s, rmode) &&
+        float32_is_zero_or_normal(a)) {
+        union_float32 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_f64_to_int(ua.h, rmode, INT32_MIN, INT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -2993,6 +3061,17 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_toint(s, rmode) &&
+        float64_is_zero_or_normal(a)) {
+        union_float64 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_f64_to_int(ua.h, rmode, INT32_MIN, INT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3292,6 +3371,17 @@ uint32_t float32_to_uint32_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_toint(s, rmode) &&
+        float32_is_zero_or_normal(a)) {
+        union_float32 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_f64_to_int(ua.h, rmode, 0, UINT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
 }
@@ -3319,6 +3409,17 @@ uint32_t float64_to_uint32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu_toint(s, rmode) &&
+        float64_is_zero_or_normal(a)) {
+        union_float64 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_f64_to_int(ua.h, rmode, 0, UINT32_MAX, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_uint(&p, rmode, scale, UINT32_MAX, s);
 }
@@ -3893,10 +3994,43 @@ static bfloat16 bfloat16_minmax(bfloat16 a, bfloat16 b,
     return bfloat16_round_pack_canonical(pr, s);
 }
 
+/* zero, normal or infinity */
+static inline bool float32_is_zoi(float32 a)
+{
+    return float32_is_zero_or_normal(a) || float32_is_infinity(a);
+}
+
+static inline bool float64_is_zoi(float64 a)
+{
+    return float64_is_zero_or_normal(a) || float64_is_infinity(a);
+}
+
 static float32 float32_minmax(float32 a, float32 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    /*
+     * NaNs and denormals need the soft code for default-NaN and
+     * flush-to-zero handling; otherwise the result is one of the inputs,
+     * unless they are zeros of different sign.
+     */
+    if (!QEMU_NO_HARDFLOAT && !(flags & minmax_ismag) &&
+        float32_is_zoi(a) && float32_is_zoi(b)) {
+        union_float32 ua, ub;
+
+        ua.s = a;
+        ub.s = b;
+        if (isless(ua.h, ub.h)) {
+            return flags & minmax_ismin ? a : b;
+        }
+        if (isgreater(ua.h, ub.h)) {
+            return flags & minmax_ismin ? b : a;
+        }
+        if (float32_val(a) == float32_val(b)) {
+            return a;
+        }
+    }
+
     float32_unpack_canonical(&pa, a, s);
     float32_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -3908,6 +4042,24 @@ static float64 float64_minmax(float64 a, float64 b, float_status *s, int flags)
 {
     FloatParts64 pa, pb, *pr;
 
+    /* See float32_minmax */
+    if (!QEMU_NO_HARDFLOAT && !(flags & minmax_ismag) &&
+        float64_is_zoi(a) && float64_is_zoi(b)) {
+        union_float64 ua, ub;
+
+        ua.s = a;
+        ub.s = b;
+        if (isless(ua.h, ub.h)) {
+            return flags & minmax_ismin ? a : b;
+        }
+        if (isgreater(ua.h, ub.h)) {
+            return flags & minmax_ismin ? b : a;
+        }
+        if (float64_val(a) == float64_val(b)) {
+            return a;
+        }
+    }
+
     float64_unpack_canonical(&pa, a, s);
     float64_unpack_canonical(&pb, b, s);
     pr = parts_minmax(&pa, &pb, s, flags);
@@ -42,7 +42,11 @@
 #include "hw/boards.h"
 #endif
 
-#define MAX_PACKET_LENGTH 4096
+/*
+ * Large enough for a debugger to move memory in big blocks; the buffers
+ * below are sized after it.
+ */
+#define MAX_PACKET_LENGTH (128 * 1024)
 
 #include "qemu/sockets.h"
 #include "sysemu/hw_accel.h"
@@ -368,6 +372,8 @@ typedef struct GDBState {
     gdb_syscall_complete_cb current_syscall_cb;
     GString *str_buf;
     GByteArray *mem_buf;
+    /* conditions of the breakpoints that have some, by address */
+    GHashTable *bp_conds;
 } GDBState;
 
 /* By default use no IRQs and no timers while single stepping so as to
@@ -865,12 +871,49 @@ static CPUState *gdb_get_cpu(uint32_t pid, uint32_t tid)
     }
 }
 
+/* Find the XML file @p (of size @len) describing registers of @cpu */
+static const char *gdb_find_xml(CPUState *cpu, const char *p, size_t len)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    const char *name;
+    int i;
+
+    if (cc->gdb_get_dynamic_xml) {
+        char *xmlname = g_strndup(p, len);
+        const char *xml = cc->gdb_get_dynamic_xml(cpu, xmlname);
+
+        g_free(xmlname);
+        if (xml) {
+            return xml;
+        }
+    }
+    for (i = 0; ; i++) {
+        name = xml_builtin[i][0];
+        if (!name || (strncmp(name, p, len) == 0 && strlen(name) == len))
+            break;
+    }
+    return name ? xml_builtin[i][1] : NULL;
+}
+
+/* Return the value of attribute @attr in the XML element [@p, @end) */
+static char *gdb_xml_attr(const char *p, const char *end, const char *attr)
+{
+    g_autofree char *pat = g_strdup_printf(" %s=\"", attr);
+    const char *v = g_strstr_len(p, end - p, pat);
+    const char *q;
+
+    if (!v) {
+        return NULL;
+    }
+    v += strlen(pat);
+    q = memchr(v, '"', end - v);
+    return q ? g_strndup(v, q - v) : NULL;
+}
+
 static const char *get_feature_xml(const char *p, const char **newp,
                                    GDBProcess *process)
 {
     size_t len;
-    int i;
-    const char *name;
     CPUState *cpu = get_first_cpu_in_process(process);
     CPUClass *cc = CPU_GET_CLASS(cpu);
 
@@ -879,7 +922,6 @@ static const char *get_feature_xml(const char *p, const char **newp,
         len++;
     *newp = p + len;
 
-    name = NULL;
     if (strncmp(p, "target.xml", len) == 0) {
         char *buf = process->target_xml;
         const size_t buf_sz = sizeof(process->target_xml);
@@ -911,24 +953,71 @@ static const char *get_feature_xml(const char *p, const char **newp,
         }
         return buf;
     }
-    if (cc->gdb_get_dynamic_xml) {
-        char *xmlname = g_strndup(p, len);
-        const char *xml = cc->gdb_get_dynamic_xml(cpu, xmlname);
+    return gdb_find_xml(cpu, p, len);
+}
 
-        g_free(xmlname);
+/*
+ * Append the registers described by @xml to @regs, numbering them from
+ * @reg unless the XML gives an explicit regnum.
+ */
+static void gdb_xml_add_regs(GArray *regs, const char *xml, int reg)
+{
+    const char *feature = NULL;
+    const char *p, *end;
+    char *name;
+
+    p = strstr(xml, "<feature");
+    if (p && (end = strchr(p, '>'))) {
+        name = gdb_xml_attr(p, end, "name");
+        feature = name ? g_intern_string(name) : NULL;
+        g_free(name);
+    }
+
+    for (p = xml; (p = strstr(p, "<reg ")) && (end = strchr(p, '>'));
+         p = end) {
+        GDBRegDesc desc;
+        char *regnum = gdb_xml_attr(p, end, "regnum");
+
+        name = gdb_xml_attr(p, end, "name");
+        if (regnum) {
+            reg = strtol(regnum, NULL, 0);
+            g_free(regnum);
+        }
+        if (name) {
+            desc.gdb_reg = reg;
+            desc.name = g_intern_string(name);
+            desc.feature_name = feature;
+            g_array_append_val(regs, desc);
+            g_free(name);
+        }
+        reg++;
+    }
+}
+
+GArray *gdb_get_register_list(CPUState *cpu)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    GArray *regs = g_array_new(false, false, sizeof(GDBRegDesc));
+    GDBRegisterState *r;
+    const char *xml;
+
+    if (cc->gdb_core_xml_file) {
+        xml = gdb_find_xml(cpu, cc->gdb_core_xml_file,
+                           strlen(cc->gdb_core_xml_file));
         if (xml) {
-            return xml;
+            gdb_xml_add_regs(regs, xml, 0);
         }
     }
-    for (i = 0; ; i++) {
-        name = xml_builtin[i][0];
-        if (!name || (strncmp(name, p, len) == 0 && strlen(name) == len))
-            break;
+    for (r = cpu->gdb_regs; r; r = r->next) {
+        xml = gdb_find_xml(cpu, r->xml, strlen(r->xml));
+        if (xml) {
+            gdb_xml_add_regs(regs, xml, r->base_reg);
+        }
     }
-    return name ? xml_builtin[i][1] : NULL;
+    return regs;
 }
 
-static int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
     CPUArchState *env = cpu->env_ptr;
@@ -1025,18 +1114,376 @@ static inline int xlat_gdb_type(CPUState *cpu, int gdbtype)
 }
 #endif
 
-static int gdb_breakpoint_insert(int type, target_ulong addr, target_ulong len)
+/*
+ * Breakpoint conditions
+ *
+ * GDB sends the conditions of a breakpoint as agent expressions along
+ * with the Z0/Z1 packet, and they are evaluated here when the guest
+ * reaches the breakpoint, without stopping the VM.  The breakpoint is
+ * hit if any condition is true, or if one cannot be evaluated.
+ */
+
+#define GDB_AGENT_STACK_SIZE 64
+#define GDB_AGENT_MAX_STEPS  10000
+
+enum {
+    GDB_AX_ADD = 0x02,
+    GDB_AX_SUB = 0x03,
+    GDB_AX_MUL = 0x04,
+    GDB_AX_DIV_SIGNED = 0x05,
+    GDB_AX_DIV_UNSIGNED = 0x06,
+    GDB_AX_REM_SIGNED = 0x07,
+    GDB_AX_REM_UNSIGNED = 0x08,
+    GDB_AX_LSH = 0x09,
+    GDB_AX_RSH_SIGNED = 0x0a,
+    GDB_AX_RSH_UNSIGNED = 0x0b,
+    GDB_AX_LOG_NOT = 0x0e,
+    GDB_AX_BIT_AND = 0x0f,
+    GDB_AX_BIT_OR = 0x10,
+    GDB_AX_BIT_XOR = 0x11,
+    GDB_AX_BIT_NOT = 0x12,
+    GDB_AX_EQUAL = 0x13,
+    GDB_AX_LESS_SIGNED = 0x14,
+    GDB_AX_LESS_UNSIGNED = 0x15,
+    GDB_AX_EXT = 0x16,
+    GDB_AX_REF8 = 0x17,
+    GDB_AX_REF16 = 0x18,
+    GDB_AX_REF32 = 0x19,
+    GDB_AX_REF64 = 0x1a,
+    GDB_AX_IF_GOTO = 0x20,
+    GDB_AX_GOTO = 0x21,
+    GDB_AX_CONST8 = 0x22,
+    GDB_AX_CONST16 = 0x23,
+    GDB_AX_CONST32 = 0x24,
+    GDB_AX_CONST64 = 0x25,
+    GDB_AX_REG = 0x26,
+    GDB_AX_END = 0x27,
+    GDB_AX_DUP = 0x28,
+    GDB_AX_POP = 0x29,
+    GDB_AX_ZERO_EXT = 0x2a,
+    GDB_AX_SWAP = 0x2b,
+    GDB_AX_PICK = 0x32,
+    GDB_AX_ROT = 0x33,
+};
+
+/* Operands are big-endian, whatever the target */
+static uint64_t gdb_agent_operand(GByteArray *code, unsigned pc, int size)
+{
+    return ldn_be_p(code->data + pc, size);
+}
+
+/*
+ * Run the agent expression @code on @cpu.  The floating point, trace
+ * and printf bytecodes make no sense in a condition and are errors.
+ *
+ * Returns: false if the expression could not be evaluated.
+ */
+static bool gdb_agent_eval(CPUState *cpu, GByteArray *code, uint64_t *result)
+{
+    uint64_t stack[GDB_AGENT_STACK_SIZE];
+    g_autoptr(GByteArray) regbuf = NULL;
+    uint8_t mem[8];
+    unsigned pc = 0, steps = 0;
+    int sp = 0, size;
+    uint64_t a, b;
+
+/* Elements below the top of the stack, with the top as 0; sp is checked */
+#define TOP(n) stack[sp - 1 - (n)]
+#define NEED(n, push) do {                                      \
+        if (sp < (n) || sp - (n) + (push) > GDB_AGENT_STACK_SIZE) {  \
+            return false;                                       \
+        }                                                       \
+    } while (0)
+#define OPERAND(size) do {                                      \
+        if (pc + (size) > code->len) {                          \
+            return false;                                       \
+        }                                                       \
+        a = gdb_agent_operand(code, pc, (size));                \
+        pc += (size);                                           \
+    } while (0)
+
+    while (pc < code->len && steps++ < GDB_AGENT_MAX_STEPS) {
+        uint8_t op = code->data[pc++];
+
+        switch (op) {
+        case GDB_AX_ADD ... GDB_AX_RSH_UNSIGNED:
+        case GDB_AX_BIT_AND ... GDB_AX_BIT_XOR:
+        case GDB_AX_EQUAL ... GDB_AX_LESS_UNSIGNED:
+            NEED(2, 0);
+            b = TOP(0);
+            a = TOP(1);
+            sp--;
+            switch (op) {
+            case GDB_AX_ADD:
+                a += b;
+                break;
+            case GDB_AX_SUB:
+                a -= b;
+                break;
+            case GDB_AX_MUL:
+                a *= b;
+                break;
+            case GDB_AX_DIV_SIGNED:
+            case GDB_AX_REM_SIGNED:
+                if (b == 0 || ((int64_t)a == INT64_MIN && (int64_t)b == -1)) {
+                    return false;
+                }
+                a = op == GDB_AX_DIV_SIGNED ? (int64_t)a / (int64_t)b
+                                            : (int64_t)a % (int64_t)b;
+                break;
+            case GDB_AX_DIV_UNSIGNED:
+            case GDB_AX_REM_UNSIGNED:
+                if (b == 0) {
+                    return false;
+                }
+                a = op == GDB_AX_DIV_UNSIGNED ? a / b : a % b;
+                break;
+            case GDB_AX_LSH:
+                a = b < 64 ? a << b : 0;
+                break;
+            case GDB_AX_RSH_SIGNED:
+                a = (int64_t)a >> MIN(b, 63);
+                break;
+            case GDB_AX_RSH_UNSIGNED:
+                a = b < 64 ? a >> b : 0;
+                break;
+            case GDB_AX_BIT_AND:
+                a &= b;
+                break;
+            case GDB_AX_BIT_OR:
+                a |= b;
+                break;
+            case GDB_AX_BIT_XOR:
+                a ^= b;
+                break;
+            case GDB_AX_EQUAL:
+                a = a == b;
+                break;
+            case GDB_AX_LESS_SIGNED:
+                a = (int64_t)a < (int64_t)b;
+                break;
+            case GDB_AX_LESS_UNSIGNED:
+                a = a < b;
+                break;
+            }
+            TOP(0) = a;
+            break;
+        case GDB_AX_LOG_NOT:
+            NEED(1, 1);
+            TOP(0) = !TOP(0);
+            break;
+        case GDB_AX_BIT_NOT:
+            NEED(1, 1);
+            TOP(0) = ~TOP(0);
+            break;
+        case GDB_AX_EXT:
+        case GDB_AX_ZERO_EXT:
+            OPERAND(1);
+            NEED(1, 1);
+            if (a == 0 || a > 64) {
+                return false;
+            }
+            if (a < 64) {
+                TOP(0) = op == GDB_AX_EXT ? sextract64(TOP(0), 0, a)
+                                          : extract64(TOP(0), 0, a);
+            }
+            break;
+        case GDB_AX_REF8 ... GDB_AX_REF64:
+            NEED(1, 1);
+            size = 1 << (op - GDB_AX_REF8);
+            if (target_memory_rw_debug(cpu, TOP(0), mem, size, false)) {
+                return false;
+            }
+            TOP(0) = ldn_p(mem, size);
+            break;
+        case GDB_AX_IF_GOTO:
+        case GDB_AX_GOTO:
+            OPERAND(2);
+            if (op == GDB_AX_IF_GOTO) {
+                NEED(1, 0);
+                if (!stack[--sp]) {
+                    break;
+                }
+            }
+            pc = a;
+            break;
+        case GDB_AX_CONST8:
+        case GDB_AX_CONST16:
+        case GDB_AX_CONST32:
+        case GDB_AX_CONST64:
+            OPERAND(1 << (op - GDB_AX_CONST8));
+            NEED(0, 1);
+            stack[sp++] = a;
+            break;
+        case GDB_AX_REG:
+            OPERAND(2);
+            NEED(0, 1);
+            if (!regbuf) {
+                regbuf = g_byte_array_sized_new(64);
+            }
+            g_byte_array_set_size(regbuf, 0);
+            size = gdb_read_register(cpu, regbuf, a);
+            if (size == 0) {
+                return false;
+            }
+            stack[sp++] = ldn_p(regbuf->data, MIN(size, 8));
+            break;
+        case GDB_AX_END:
+            NEED(1, 0);
+            *result = TOP(0);
+            return true;
+        case GDB_AX_DUP:
+            NEED(1, 2);
+            stack[sp] = TOP(0);
+            sp++;
+            break;
+        case GDB_AX_POP:
+            NEED(1, 0);
+            sp--;
+            break;
+        case GDB_AX_SWAP:
+            NEED(2, 2);
+            a = TOP(0);
+            TOP(0) = TOP(1);
+            TOP(1) = a;
+            break;
+        case GDB_AX_PICK:
+            OPERAND(1);
+            NEED(a + 1, a + 2);
+            stack[sp] = TOP(a);
+            sp++;
+            break;
+        case GDB_AX_ROT:
+            NEED(3, 3);
+            a = TOP(0);
+            TOP(0) = TOP(1);
+            TOP(1) = TOP(2);
+            TOP(2) = a;
+            break;
+        default:
+            return false;
+        }
+    }
+    return false;
+
+#undef TOP
+#undef NEED
+#undef OPERAND
+}
+
+bool gdb_breakpoint_hit(CPUState *cpu, vaddr pc)
+{
+    uint64_t addr = pc, result;
+    GPtrArray *conds;
+    guint i;
+
+    if (!gdbserver_state.bp_conds) {
+        return true;
+    }
+    conds = g_hash_table_lookup(gdbserver_state.bp_conds, &addr);
+    if (!conds) {
+        return true;
+    }
+
+    for (i = 0; i < conds->len; i++) {
+        if (!gdb_agent_eval(cpu, g_ptr_array_index(conds, i), &result)) {
+            trace_gdbstub_bp_cond_error(pc, i);
+            return true;
+        }
+        if (result) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Parse the conditions of a Z packet, "X len,expr" one after the
+ * other, up to the next ';'.  Returns NULL if there are none.
+ */
+static GPtrArray *gdb_parse_bp_conds(const char *p, bool *ok)
+{
+    g_autoptr(GPtrArray) conds =
+        g_ptr_array_new_with_free_func((GDestroyNotify)g_byte_array_unref);
+    uint64_t len;
+
+    *ok = true;
+    while (p && *p == 'X') {
+        GByteArray *code;
+
+        if (qemu_strtou64(p + 1, &p, 16, &len) || *p != ',' ||
+            len == 0 || len > MAX_PACKET_LENGTH || strlen(p + 1) < len * 2) {
+            *ok = false;
+            return NULL;
+        }
+        code = g_byte_array_sized_new(len);
+        hextomem(code, p + 1, len);
+        g_ptr_array_add(conds, code);
+        p += 1 + len * 2;
+    }
+    return conds->len ? g_steal_pointer(&conds) : NULL;
+}
+
+static void gdb_set_bp_conds(target_ulong addr, GPtrArray *conds)
+{
+    uint64_t *key;
+
+    if (!gdbserver_state.bp_conds) {
+        if (!conds) {
+            return;
+        }
+        gdbserver_state.bp_conds =
+            g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                  (GDestroyNotify)g_ptr_array_unref);
+    }
+    key = g_new(uint64_t, 1);
+    *key = addr;
+    if (conds) {
+        g_hash_table_insert(gdbserver_state.bp_conds, key, conds);
+    } else {
+        g_hash_table_remove(gdbserver_state.bp_conds, key);
+        g_free(key);
+    }
+}
+
+static bool gdb_breakpoint_present(target_ulong addr)
+{
+    CPUBreakpoint *bp;
+
+    QTAILQ_FOREACH(bp, &first_cpu->breakpoints, entry) {
+        if (bp->pc == addr && (bp->flags & BP_GDB)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int gdb_breakpoint_insert(int type, target_ulong addr, target_ulong len,
+                                 GPtrArray *conds)
 {
     CPUState *cpu;
     int err = 0;
 
+    if (type != GDB_BREAKPOINT_SW && type != GDB_BREAKPOINT_HW && conds) {
+        /* GDB only sends conditions for breakpoints */
+        g_ptr_array_unref(conds);
+        conds = NULL;
+    }
+
     if (kvm_enabled()) {
+        /* not advertised, see handle_query_supported() */
+        assert(!conds);
         return kvm_insert_breakpoint(gdbserver_state.c_cpu, addr, len, type);
     }
 
     switch (type) {
     case GDB_BREAKPOINT_SW:
     case GDB_BREAKPOINT_HW:
+        /* GDB inserts the breakpoint again when its conditions change */
+        gdb_set_bp_conds(addr, conds);
+        if (gdb_breakpoint_present(addr)) {
+            return 0;
+        }
         CPU_FOREACH(cpu) {
             err = cpu_breakpoint_insert(cpu, addr, BP_GDB, NULL);
             if (err) {
@@ -1074,6 +1521,7 @@ static int gdb_breakpoint_remove(int type, target_ulong addr, target_ulong len)
     switch (type) {
     case GDB_BREAKPOINT_SW:
     case GDB_BREAKPOINT_HW:
+        gdb_set_bp_conds(addr, NULL);
         CPU_FOREACH(cpu) {
             err = cpu_breakpoint_remove(cpu, addr, BP_GDB);
             if (err) {
@@ -1100,6 +1548,9 @@ static int gdb_breakpoint_remove(int type, target_ulong addr, target_ulong len)
 
 static inline void gdb_cpu_breakpoint_remove_all(CPUState *cpu)
 {
+    if (gdbserver_state.bp_conds) {
+        g_hash_table_remove_all(gdbserver_state.bp_conds);
+    }
     cpu_breakpoint_remove_all(cpu, BP_GDB);
 #ifndef CONFIG_USER_ONLY
     cpu_watchpoint_remove_all(cpu, BP_GDB);
@@ -1653,16 +2104,26 @@ static void handle_set_thread(GArray *params, void *user_ctx)
 
 static void handle_insert_bp(GArray *params, void *user_ctx)
 {
+    GPtrArray *conds = NULL;
+    bool ok;
     int res;
 
-    if (params->len != 3) {
+    if (params->len != 3 && params->len != 4) {
         put_packet("E22");
         return;
     }
 
+    if (params->len == 4) {
+        conds = gdb_parse_bp_conds(get_param(params, 3)->data, &ok);
+        if (!ok) {
+            put_packet("E22");
+            return;
+        }
+    }
+
     res = gdb_breakpoint_insert(get_param(params, 0)->val_ul,
                                 get_param(params, 1)->val_ull,
-                                get_param(params, 2)->val_ull);
+                                get_param(params, 2)->val_ull, conds);
     if (res >= 0) {
         put_packet("OK");
         return;
@@ -1813,6 +2274,54 @@ static void handle_read_mem(GArray *params, void *user_ctx)
     put_strbuf();
 }
 
+/*
+ * Binary memory read, 'x addr,length'.  The reply is 'b' followed by
+ * the data with the same escapes as 'X', and may be short when the
+ * escapes do not fit in a packet.
+ */
+static void handle_read_mem_binary(GArray *params, void *user_ctx)
+{
+    const uint8_t *mem;
+    size_t len, i;
+
+    if (params->len != 2) {
+        put_packet("E22");
+        return;
+    }
+
+    len = MIN(get_param(params, 1)->val_ull, MAX_PACKET_LENGTH - 1);
+    g_byte_array_set_size(gdbserver_state.mem_buf, len);
+    if (target_memory_rw_debug(gdbserver_state.g_cpu,
+                               get_param(params, 0)->val_ull,
+                               gdbserver_state.mem_buf->data, len, false)) {
+        put_packet("E14");
+        return;
+    }
+
+    mem = gdbserver_state.mem_buf->data;
+    g_string_assign(gdbserver_state.str_buf, "b");
+    for (i = 0; i < len; i++) {
+        switch (mem[i]) {
+        case '#': case '$': case '*': case '}':
+            if (gdbserver_state.str_buf->len + 2 > MAX_PACKET_LENGTH) {
+                goto out;
+            }
+            g_string_append_c(gdbserver_state.str_buf, '}');
+            g_string_append_c(gdbserver_state.str_buf, mem[i] ^ 0x20);
+            break;
+        default:
+            if (gdbserver_state.str_buf->len + 1 > MAX_PACKET_LENGTH) {
+                goto out;
+            }
+            g_string_append_c(gdbserver_state.str_buf, mem[i]);
+            break;
+        }
+    }
+out:
+    put_packet_binary(gdbserver_state.str_buf->str,
+                      gdbserver_state.str_buf->len, true);
+}
+
 static void handle_write_all_regs(GArray *params, void *user_ctx)
 {
     target_ulong addr, len;
@@ -2178,7 +2687,11 @@ static void handle_query_supported(GArray *params, void *user_ctx)
         gdbserver_state.multiprocess = true;
     }
 
-    g_string_append(gdbserver_state.str_buf, ";vContSupported+;multiprocess+");
+    g_string_append(gdbserver_state.str_buf,
+                    ";vContSupported+;multiprocess+;binary-upload+");
+    if (!kvm_enabled()) {
+        g_string_append(gdbserver_state.str_buf, ";ConditionalBreakpoints+");
+    }
     put_strbuf();
 }
 
@@ -2286,9 +2799,88 @@ static void handle_query_attached(GArray *params, void *user_ctx)
     put_packet(GDB_ATTACHED);
 }
 
+/*
+ * 'qqemu.DumpMem:addr,length:file', with the name of the file in hex,
+ * writes that memory to a file on the host instead of sending it
+ * through the connection.  Physical memory is written straight from
+ * guest RAM.
+ */
+static void handle_query_qemu_dump_mem(GArray *params, void *user_ctx)
+{
+    g_autofree char *name = NULL;
+    Error *err = NULL;
+    uint64_t addr, len;
+    int fd, ret = 0;
+
+    if (params->len != 3) {
+        put_packet("E22");
+        return;
+    }
+
+    addr = get_param(params, 0)->val_ull;
+    len = get_param(params, 1)->val_ull;
+    g_assert(gdbserver_state.mem_buf->len == 0);
+    hextomem(gdbserver_state.mem_buf, get_param(params, 2)->data,
+             strlen(get_param(params, 2)->data) / 2);
+    name = g_strndup((const char *)gdbserver_state.mem_buf->data,
+                     gdbserver_state.mem_buf->len);
+
+    fd = qemu_create(name, O_WRONLY | O_TRUNC, 0644, &err);
+    if (fd < 0) {
+        error_free(err);
+        put_packet("E02");
+        return;
+    }
+
+    while (len && ret == 0) {
+#ifndef CONFIG_USER_ONLY
+        if (phy_memory_mode) {
+            hwaddr l = len;
+            void *p = cpu_physical_memory_map(addr, &l, false);
+
+            if (!p) {
+                ret = -EFAULT;
+                break;
+            }
+            if (qemu_write_full(fd, p, l) != l) {
+                ret = -errno;
+            }
+            cpu_physical_memory_unmap(p, l, false, l);
+            addr += l;
+            len -= l;
+            continue;
+        }
+#endif
+        {
+            size_t l = MIN(len, MAX_PACKET_LENGTH);
+
+            g_byte_array_set_size(gdbserver_state.mem_buf, l);
+            if (target_memory_rw_debug(gdbserver_state.g_cpu, addr,
+                                       gdbserver_state.mem_buf->data, l,
+                                       false)) {
+                ret = -EFAULT;
+            } else if (qemu_write_full(fd, gdbserver_state.mem_buf->data,
+                                       l) != l) {
+                ret = -errno;
+            }
+            addr += l;
+            len -= l;
+        }
+    }
+    close(fd);
+
+    if (ret == -EFAULT) {
+        put_packet("E14");
+    } else if (ret < 0) {
+        put_packet("E05");
+    } else {
+        put_packet("OK");
+    }
+}
+
 static void handle_query_qemu_supported(GArray *params, void *user_ctx)
 {
-    g_string_printf(gdbserver_state.str_buf, "sstepbits;sstep");
+    g_string_printf(gdbserver_state.str_buf, "sstepbits;sstep;DumpMem");
 #ifndef CONFIG_USER_ONLY
     g_string_append(gdbserver_state.str_buf, ";PhyMemMode");
 #endif
@@ -2407,6 +2999,12 @@ static const GdbCmdParseEntry gdb_gen_query_table[] = {
         .handler = handle_query_qemu_supported,
         .cmd = "qemu.Supported",
     },
+    {
+        .handler = handle_query_qemu_dump_mem,
+        .cmd = "qemu.DumpMem:",
+        .cmd_startswith = 1,
+        .schema = "L,L:s0"
+    },
 #ifndef CONFIG_USER_ONLY
     {
         .handler = handle_query_qemu_phy_mem_mode,
@@ -2630,6 +3228,17 @@ static int gdb_handle_packet(const char *line_buf)
             cmd_parser = &write_mem_cmd_desc;
         }
         break;
+    case 'x':
+        {
+            static const GdbCmdParseEntry read_mem_binary_cmd_desc = {
+                .handler = handle_read_mem_binary,
+                .cmd = "x",
+                .cmd_startswith = 1,
+                .schema = "L,L0"
+            };
+            cmd_parser = &read_mem_binary_cmd_desc;
+        }
+        break;
     case 'p':
         {
             static const GdbCmdParseEntry get_reg_cmd_desc = {
@@ -2658,7 +3267,7 @@ static int gdb_handle_packet(const char *line_buf)
                 .handler = handle_insert_bp,
                 .cmd = "Z",
                 .cmd_startswith = 1,
-                .schema = "l?L?L0"
+                .schema = "l?L?L?s0"
             };
             cmd_parser = &insert_bp_cmd_desc;
         }
@@ -239,18 +239,79 @@ ERST
 
     {
         .name       = "mtree",
-        .args_type  = "flatview:-f,dispatch_tree:-d,owner:-o,disabled:-D",
-        .params     = "[-f][-d][-o][-D]",
+        .args_type  = "flatview:-f,dispatch_tree:-d,owner:-o,disabled:-D,"
+                      "stats:-s",
+        .params     = "[-f][-d][-o][-D][-s]",
         .help       = "show memory tree (-f: dump flat view for address spaces;"
                       "-d: dump dispatch tree, valid with -f only);"
                       "-o: dump region owners/parents;"
-                      "-D: dump disabled regions",
+                      "-D: dump disabled regions;"
+                      "-s: dump MMIO access counts and times",
         .cmd        = hmp_info_mtree,
     },
 
 SRST
   ``info mtree``
-    Show memory tree.
+    Show memory tree.  With ``-s``, also show the accesses to each I/O
+    region and the average host time they took, as counted after
+    ``mtree-stats on``.
+ERST
+
+    {
+        .name       = "mtree-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the I/O regions that took the most host time",
+        .cmd_info_hrt = qmp_x_query_mtree_stats,
+    },
+
+SRST
+  ``info mtree-stats``
+    Show the I/O memory regions with the most host time spent in their
+    read and write callbacks, as counted after ``mtree-stats on``.
+ERST
+
+    {
+        .name       = "coroutines",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show coroutine pool statistics",
+        .cmd_info_hrt = qmp_x_query_coroutines,
+    },
+
+SRST
+  ``info coroutines``
+    Show how many coroutines were created, how many came from the pools
+    and how many needed a new stack.
+ERST
+
+    {
+        .name       = "rcu",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show RCU grace period and callback statistics",
+        .cmd_info_hrt = qmp_x_query_rcu,
+    },
+
+SRST
+  ``info rcu``
+    Show how long RCU grace periods take and how many ``call_rcu()``
+    callbacks are waiting for one.
+ERST
+
+    {
+        .name       = "main-loop",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show main loop callback latencies",
+        .cmd_info_hrt = qmp_x_query_main_loop,
+    },
+
+SRST
+  ``info main-loop``
+    Show histograms of the time taken by the bottom halves, file
+    descriptor handlers and timers run by the main loop, and list the
+    last ones that took more than 10 milliseconds.
 ERST
 
 #if defined(CONFIG_TCG)
@@ -281,6 +342,58 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-chains",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the TBs that exit most often without chaining",
+    },
+#endif
+
+SRST
+  ``info tb-chains``
+    Show the translation blocks whose exits most often go back to the
+    main loop or through the indirect jump lookup helper instead of
+    being chained, as counted with ``-accel tcg,chain-stats=on``, along
+    with the hit and miss counts of their indirect branch target cache.
+ERST
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "smc",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show pages with frequently rewritten code",
+    },
+#endif
+
+SRST
+  ``info smc``
+    Show the guest RAM pages whose translated code was invalidated by
+    guest stores often enough that TCG now translates them one
+    instruction per block, so that each store only discards the block
+    of the instruction it hit.  Pages go back to normal translation
+    once the stores stop for a couple of seconds.
+ERST
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tlb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show softmmu TLB statistics",
+    },
+#endif
+
+SRST
+  ``info tlb-stats``
+    Show, for each vCPU and MMU index, the current number of entries of
+    the TCG softmmu TLB, how often lookups missed the fast path, how many
+    of those were resolved from the victim TLB, and how often the TLB
+    was flushed, grown and shrunk.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -333,6 +446,48 @@ SRST
     Show NUMA information.
 ERST
 
+    {
+        .name       = "qmp-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show how long QMP commands take",
+        .cmd_info_hrt = qmp_x_query_qmp_stats,
+    },
+
+SRST
+  ``info qmp-stats``
+    Show how many times each QMP command ran, with its total, average
+    and longest latency, most expensive command first.
+ERST
+
+    {
+        .name       = "virtio-net",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show virtio-net per-queue statistics",
+        .cmd_info_hrt = qmp_x_query_virtio_net,
+    },
+
+SRST
+  ``info virtio-net``
+    Show the packets, bytes and interrupts of each virtio-net queue, and
+    how often a packet found no receive buffers.
+ERST
+
+    {
+        .name       = "digic-mmio",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show accesses to unmodelled DIGIC registers",
+        .cmd_info_hrt = qmp_x_query_digic_mmio,
+    },
+
+SRST
+  ``info digic-mmio``
+    Show how often each unmodelled register of a Canon DIGIC machine
+    was accessed, busiest first.
+ERST
+
     {
         .name       = "usb",
         .args_type  = "",
@@ -780,6 +935,21 @@ SRST
     Dump all the ramblocks of the system.
 ERST
 
+    {
+        .name       = "ram-backing",
+        .args_type  = "",
+        .params     = "",
+        .help       = "Display how the host backs each ramblock",
+        .cmd_info_hrt = qmp_x_query_ram_backing,
+    },
+
+SRST
+  ``info ram-backing``
+    Show, for each ramblock, how much of it is resident on the host, how
+    much of that is backed by huge pages, and the share of it on each
+    host NUMA node.  Only available on Linux hosts.
+ERST
+
     {
         .name       = "hotpluggable-cpus",
         .args_type  = "",
@@ -822,6 +992,20 @@ SRST
     enabled) memory in bytes.
 ERST
 
+    {
+        .name       = "memory-usage",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the memory used by the main allocators of QEMU",
+        .cmd        = hmp_info_memory_usage,
+    },
+
+SRST
+  ``info memory-usage``
+    Show how many bytes the main allocators of QEMU (translated code, QOM
+    objects, block caches, display surfaces, ...) currently use.
+ERST
+
 #if defined(TARGET_I386)
     {
         .name       = "sev",
@@ -863,6 +1047,20 @@ SRST
     Display the vcpu dirty rate information.
 ERST
 
+    {
+        .name       = "vcpu_dirty_limit",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show vcpu dirty page rate limits",
+        .cmd        = hmp_info_vcpu_dirty_limit,
+    },
+
+SRST
+  ``info vcpu_dirty_limit``
+    Display the dirty page rate limit and the current dirty page rate
+    of each vcpu.
+ERST
+
 #if defined(TARGET_I386)
     {
         .name       = "sgx",
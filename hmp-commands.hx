@@ -622,6 +622,23 @@ SRST
   whether profiling is on or off.
 ERST
 
+    {
+        .name       = "mtree-stats",
+        .args_type  = "op:s?",
+        .params     = "[on|off|reset]",
+        .help       = "enable, disable or reset MMIO access counting. "
+                      "With no arguments, prints whether counting is on or off.",
+        .cmd        = hmp_mtree_stats,
+    },
+
+SRST
+``mtree-stats [on|off|reset]``
+  Enable, disable or reset the counting of the accesses to each I/O memory
+  region and of the host time spent handling them, as shown by
+  ``info mtree -s`` and ``info mtree-stats``. With no arguments, prints
+  whether counting is on or off.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
@@ -1744,3 +1761,47 @@ ERST
                       "\n\t\t\t -b to specify dirty bitmap as method of calculation)",
         .cmd        = hmp_calc_dirty_rate,
     },
+
+SRST
+``set_vcpu_dirty_limit`` *dirty_rate* [*cpu_index*]
+  Limit the dirty page rate of the vcpu *cpu_index*, or of every vcpu if
+  it is omitted, to *dirty_rate* MB/s.  Needs the KVM dirty ring.  The
+  limits may be observed with ``info vcpu_dirty_limit``.
+ERST
+
+    {
+        .name       = "set_vcpu_dirty_limit",
+        .args_type  = "dirty_rate:l,cpu_index:l?",
+        .params     = "dirty_rate [cpu_index]",
+        .help       = "limit the dirty page rate of a vcpu, or of all vcpus",
+        .cmd        = hmp_set_vcpu_dirty_limit,
+    },
+
+SRST
+``cancel_vcpu_dirty_limit`` [*cpu_index*]
+  Remove the dirty page rate limit of the vcpu *cpu_index*, or of every
+  vcpu if it is omitted.
+ERST
+
+    {
+        .name       = "cancel_vcpu_dirty_limit",
+        .args_type  = "cpu_index:l?",
+        .params     = "[cpu_index]",
+        .help       = "remove the dirty page rate limit of a vcpu, or of all vcpus",
+        .cmd        = hmp_cancel_vcpu_dirty_limit,
+    },
+
+SRST
+``memsnap`` *save|restore|drop*
+  Keep a snapshot of the VM in host memory, return to it, or free it.
+  Restoring only copies back the guest pages written since the snapshot
+  was saved.  Disks are not part of the snapshot.
+ERST
+
+    {
+        .name       = "memsnap",
+        .args_type  = "op:s",
+        .params     = "save|restore|drop",
+        .help       = "save, restore or drop the in-memory VM snapshot",
+        .cmd        = hmp_memsnap,
+    },
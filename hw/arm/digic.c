@@ -23,20 +23,73 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 #include "hw/arm/digic.h"
 #include "hw/qdev-properties.h"
-#include "sysemu/sysemu.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "exec/address-spaces.h"
 
-#define DIGIC4_TIMER_BASE(n)    (0xc0210000 + (n) * 0x100)
+#define DIGIC4_INTC_BASE         0xc0201000
+
+#define DIGIC4_CLOCK_BASE        0xc0242000
+
+#define DIGIC4_TIMER_BASE        0xc0210000
+#define DIGIC4_TIMER_STRIDE      0x100
 
 #define DIGIC_UART_BASE          0xc0800000
 
+#define DIGIC4_SDHOST_BASE       0xc0c10000
+
+#define DIGIC4_LCD_BASE          0xc0f14000
+
+#define DIGIC4_EDMAC_BASE        0xc0f04000
+
+#define DIGIC4_MPU_BASE          0xc0820000
+
+/* Interrupt controller inputs */
+#define DIGIC4_IRQ_TIMER0        0x0a
+#define DIGIC4_IRQ_UART_RX       0x2e
+#define DIGIC4_IRQ_SDHOST        0x32
+#define DIGIC4_IRQ_MPU           0x36
+#define DIGIC4_IRQ_EDMAC0        0x40
+
+/*
+ * Background region catching accesses to unmodelled peripherals.  Like
+ * the unassigned accesses it replaces, reads return 0 and writes are
+ * ignored, but every access is counted.
+ */
+static uint64_t digic_unimp_read(void *opaque, hwaddr addr, unsigned size)
+{
+    digic_mmio_stats_record(addr, false);
+    return 0;
+}
+
+static void digic_unimp_write(void *opaque, hwaddr addr, uint64_t value,
+                              unsigned size)
+{
+    digic_mmio_stats_record(addr, true);
+}
+
+static const MemoryRegionOps digic_unimp_ops = {
+    .read = digic_unimp_read,
+    .write = digic_unimp_write,
+    .impl.min_access_size = 1,
+    .impl.max_access_size = 4,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
 static void digic_init(Object *obj)
 {
     DigicState *s = DIGIC(obj);
     int i;
 
-    object_initialize_child(obj, "cpu", &s->cpu, ARM_CPU_TYPE_NAME("arm946"));
+    object_initialize_child(obj, "cluster", &s->cluster, TYPE_CPU_CLUSTER);
+    object_initialize_child(OBJECT(&s->cluster), "cpu", &s->cpu,
+                            ARM_CPU_TYPE_NAME("arm946"));
+    object_initialize_child(obj, "intc", &s->intc, TYPE_DIGIC_INTC);
+    object_initialize_child(obj, "clock", &s->clock, TYPE_DIGIC_CLOCK);
 
     for (i = 0; i < DIGIC4_NB_TIMERS; i++) {
 #define DIGIC_TIMER_NAME_MLEN    11
@@ -47,6 +100,42 @@ static void digic_init(Object *obj)
     }
 
     object_initialize_child(obj, "uart", &s->uart, TYPE_DIGIC_UART);
+    object_property_add_alias(obj, "chardev", OBJECT(&s->uart), "chardev");
+
+    object_initialize_child(obj, "sdhost", &s->sdhost, TYPE_DIGIC_SDHOST);
+    object_initialize_child(obj, "lcd", &s->lcd, TYPE_DIGIC_LCD);
+    object_initialize_child(obj, "edmac", &s->edmac, TYPE_DIGIC_EDMAC);
+    object_initialize_child(obj, "mpu", &s->mpu, TYPE_DIGIC_MPU);
+}
+
+/*
+ * The second core starts from its own reset vector, with the vectors
+ * low, and has no interrupt input yet: the firmware it runs talks to
+ * the main core through memory.
+ */
+static bool digic_realize_cpu2(DigicState *s, Error **errp)
+{
+    ObjectClass *oc = cpu_class_by_name(TYPE_ARM_CPU, s->cpu2_type);
+
+    if (!oc) {
+        error_setg(errp, "Unknown ARM CPU model '%s' for the second core",
+                   s->cpu2_type);
+        return false;
+    }
+
+    object_initialize_child(OBJECT(s), "cpu2-cluster", &s->cpu2_cluster,
+                            TYPE_CPU_CLUSTER);
+    qdev_prop_set_uint32(DEVICE(&s->cpu2_cluster), "cluster-id",
+                         s->cluster_id + 1);
+    s->cpu2 = ARM_CPU(object_new(object_class_get_name(oc)));
+    object_property_add_child(OBJECT(&s->cpu2_cluster), "cpu",
+                              OBJECT(s->cpu2));
+    object_unref(OBJECT(s->cpu2));
+
+    return object_property_set_link(OBJECT(s->cpu2), "memory",
+                                    OBJECT(s->memory), errp) &&
+           qdev_realize(DEVICE(&s->cpu2_cluster), NULL, errp) &&
+           qdev_realize(DEVICE(s->cpu2), NULL, errp);
 }
 
 static void digic_realize(DeviceState *dev, Error **errp)
@@ -55,39 +144,150 @@ static void digic_realize(DeviceState *dev, Error **errp)
     SysBusDevice *sbd;
     int i;
 
+    if (!s->memory) {
+        s->memory = get_system_memory();
+    }
+    address_space_init(&s->as, s->memory, "digic");
+
     if (!object_property_set_bool(OBJECT(&s->cpu), "reset-hivecs", true,
                                   errp)) {
         return;
     }
+    if (!object_property_set_link(OBJECT(&s->cpu), "memory",
+                                  OBJECT(s->memory), errp)) {
+        return;
+    }
 
-    if (!qdev_realize(DEVICE(&s->cpu), NULL, errp)) {
+    qdev_prop_set_uint32(DEVICE(&s->cluster), "cluster-id", s->cluster_id);
+    if (!qdev_realize(DEVICE(&s->cluster), NULL, errp) ||
+        !qdev_realize(DEVICE(&s->cpu), NULL, errp)) {
         return;
     }
 
+    if (s->cpu2_type && !digic_realize_cpu2(s, errp)) {
+        return;
+    }
+
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->intc), errp)) {
+        return;
+    }
+
+    sbd = SYS_BUS_DEVICE(&s->intc);
+    memory_region_add_subregion(s->memory, s->intc_base,
+                                sysbus_mmio_get_region(sbd, 0));
+    sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(DEVICE(&s->cpu), ARM_CPU_IRQ));
+
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->clock), errp)) {
+        return;
+    }
+
+    sbd = SYS_BUS_DEVICE(&s->clock);
+    memory_region_add_subregion(s->memory, s->clock_base,
+                                sysbus_mmio_get_region(sbd, 0));
+
     for (i = 0; i < DIGIC4_NB_TIMERS; i++) {
-        if (!sysbus_realize(SYS_BUS_DEVICE(&s->timer[i]), errp)) {
+        if (!object_property_set_link(OBJECT(&s->timer[i]), "clock",
+                                      OBJECT(&s->clock), errp) ||
+            !sysbus_realize(SYS_BUS_DEVICE(&s->timer[i]), errp)) {
             return;
         }
 
         sbd = SYS_BUS_DEVICE(&s->timer[i]);
-        sysbus_mmio_map(sbd, 0, DIGIC4_TIMER_BASE(i));
+        memory_region_add_subregion(s->memory,
+                                    s->timer_base + i * DIGIC4_TIMER_STRIDE,
+                                    sysbus_mmio_get_region(sbd, 0));
+        sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(DEVICE(&s->intc),
+                                                    DIGIC4_IRQ_TIMER0 + i));
     }
 
-    qdev_prop_set_chr(DEVICE(&s->uart), "chardev", serial_hd(0));
     if (!sysbus_realize(SYS_BUS_DEVICE(&s->uart), errp)) {
         return;
     }
 
     sbd = SYS_BUS_DEVICE(&s->uart);
-    sysbus_mmio_map(sbd, 0, DIGIC_UART_BASE);
+    memory_region_add_subregion(s->memory, s->uart_base,
+                                sysbus_mmio_get_region(sbd, 0));
+    sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(DEVICE(&s->intc),
+                                                DIGIC4_IRQ_UART_RX));
+
+    if (!object_property_set_link(OBJECT(&s->sdhost), "dma",
+                                  OBJECT(s->memory), errp) ||
+        !sysbus_realize(SYS_BUS_DEVICE(&s->sdhost), errp)) {
+        return;
+    }
+
+    sbd = SYS_BUS_DEVICE(&s->sdhost);
+    memory_region_add_subregion(s->memory, s->sdhost_base,
+                                sysbus_mmio_get_region(sbd, 0));
+    sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(DEVICE(&s->intc),
+                                                DIGIC4_IRQ_SDHOST));
+
+    if (!object_property_set_link(OBJECT(&s->lcd), "memory",
+                                  OBJECT(s->memory), errp) ||
+        !sysbus_realize(SYS_BUS_DEVICE(&s->lcd), errp)) {
+        return;
+    }
+
+    sbd = SYS_BUS_DEVICE(&s->lcd);
+    memory_region_add_subregion(s->memory, s->lcd_base,
+                                sysbus_mmio_get_region(sbd, 0));
+
+    if (!object_property_set_link(OBJECT(&s->edmac), "dma",
+                                  OBJECT(s->memory), errp) ||
+        !sysbus_realize(SYS_BUS_DEVICE(&s->edmac), errp)) {
+        return;
+    }
+
+    sbd = SYS_BUS_DEVICE(&s->edmac);
+    memory_region_add_subregion(s->memory, s->edmac_base,
+                                sysbus_mmio_get_region(sbd, 0));
+    for (i = 0; i < DIGIC_EDMAC_NB_CHANNELS; i++) {
+        sysbus_connect_irq(sbd, i, qdev_get_gpio_in(DEVICE(&s->intc),
+                                                    DIGIC4_IRQ_EDMAC0 + i));
+    }
+
+    if (!sysbus_realize(SYS_BUS_DEVICE(&s->mpu), errp)) {
+        return;
+    }
+
+    sbd = SYS_BUS_DEVICE(&s->mpu);
+    memory_region_add_subregion(s->memory, s->mpu_base,
+                                sysbus_mmio_get_region(sbd, 0));
+    sysbus_connect_irq(sbd, 0, qdev_get_gpio_in(DEVICE(&s->intc),
+                                                DIGIC4_IRQ_MPU));
+
+    memory_region_init_io(&s->unimp, OBJECT(s), &digic_unimp_ops, s,
+                          "digic.unimp", 4 * GiB);
+    memory_region_add_subregion_overlap(s->memory, 0, &s->unimp, -1000);
 }
 
+static Property digic_properties[] = {
+    DEFINE_PROP_UINT64("intc-base", DigicState, intc_base, DIGIC4_INTC_BASE),
+    DEFINE_PROP_UINT64("clock-base", DigicState, clock_base,
+                       DIGIC4_CLOCK_BASE),
+    DEFINE_PROP_UINT64("timer-base", DigicState, timer_base,
+                       DIGIC4_TIMER_BASE),
+    DEFINE_PROP_UINT64("uart-base", DigicState, uart_base, DIGIC_UART_BASE),
+    DEFINE_PROP_UINT64("sdhost-base", DigicState, sdhost_base,
+                       DIGIC4_SDHOST_BASE),
+    DEFINE_PROP_UINT64("lcd-base", DigicState, lcd_base, DIGIC4_LCD_BASE),
+    DEFINE_PROP_UINT64("edmac-base", DigicState, edmac_base,
+                       DIGIC4_EDMAC_BASE),
+    DEFINE_PROP_UINT64("mpu-base", DigicState, mpu_base, DIGIC4_MPU_BASE),
+    DEFINE_PROP_STRING("cpu2-type", DigicState, cpu2_type),
+    DEFINE_PROP_UINT32("cluster-id", DigicState, cluster_id, 0),
+    DEFINE_PROP_LINK("memory", DigicState, memory, TYPE_MEMORY_REGION,
+                     MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void digic_class_init(ObjectClass *oc, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(oc);
 
     dc->realize = digic_realize;
-    /* Reason: Uses serial_hds in the realize function --> not usable twice */
+    device_class_set_props(dc, digic_properties);
+    /* Reason: the board maps the RAM and ROMs into "memory" */
     dc->user_creatable = false;
 }
 
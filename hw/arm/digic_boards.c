@@ -25,14 +25,25 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "qemu-common.h"
 #include "qemu/datadir.h"
 #include "hw/boards.h"
 #include "qemu/error-report.h"
 #include "hw/arm/digic.h"
 #include "hw/block/flash.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "hw/sysbus.h"
 #include "hw/loader.h"
+#include "sysemu/blockdev.h"
+#include "sysemu/block-backend.h"
 #include "sysemu/qtest.h"
+#include "sysemu/reset.h"
+#include "sysemu/runstate.h"
+#include "sysemu/sysemu.h"
+#include "migration/vmstate.h"
+#include "qemu/timer.h"
 #include "qemu/units.h"
 #include "qemu/cutils.h"
 
@@ -40,24 +51,193 @@
 #define DIGIC4_ROM1_BASE      0xf8000000
 #define DIGIC4_ROM_MAX_SIZE   0x08000000
 
+#define DIGIC_NB_ROMS         2
+/* The flash that checkpoints cover */
+#define DIGIC_CHECKPOINT_ROM  1
+
+#define DIGIC_MAX_CAMERAS     16
+
+#define TYPE_DIGIC_MACHINE MACHINE_TYPE_NAME("digic")
+OBJECT_DECLARE_SIMPLE_TYPE(DigicMachineState, DIGIC_MACHINE)
+
+struct DigicMachineState {
+    /*< private >*/
+    MachineState parent_obj;
+    /*< public >*/
+
+    bool rom_mmap;
+    bool fast_delays;
+    uint32_t cameras;
+    char *board_file;
+    char *checkpoint;
+    char *checkpoint_save;
+    uint64_t checkpoint_save_at;
+
+    /* The first camera; the only one checkpoints deal with */
+    DigicState *soc;
+    MemoryRegion *ram;
+    PFlashCFI02 *flash;
+    MemoryRegion checkpoint_ram;
+    bool checkpoint_restored;
+    QEMUTimer *checkpoint_timer;
+    /* Pristine ROM images the translated code of all cameras refers to */
+    MemoryRegion rom_code[DIGIC_NB_ROMS];
+};
+
+/* A CFI02 NOR flash holding a ROM image; absent if @size is 0. */
+typedef struct DigicFlash {
+    hwaddr base;
+    hwaddr size;
+    uint32_t sector_len;
+    uint8_t width;
+    uint16_t id[4];
+    uint16_t unlock_addr[2];
+    const char *def_filename;
+    /* Symbol map of the image, see load_symbol_map() */
+    const char *symbols;
+} DigicFlash;
+
 typedef struct DigicBoard {
-    void (*add_rom0)(DigicState *, hwaddr, const char *);
-    const char *rom0_def_filename;
-    void (*add_rom1)(DigicState *, hwaddr, const char *);
-    const char *rom1_def_filename;
+    ram_addr_t ram_size;
+    /* SoC peripheral bases; 0 keeps the DIGIC4 default */
+    hwaddr intc_base;
+    hwaddr clock_base;
+    hwaddr timer_base;
+    hwaddr uart_base;
+    hwaddr sdhost_base;
+    hwaddr lcd_base;
+    hwaddr edmac_base;
+    hwaddr mpu_base;
+    /* CPU model of the second core, NULL for none */
+    const char *cpu2_type;
+    DigicFlash rom[DIGIC_NB_ROMS];
 } DigicBoard;
 
-static void digic4_board_init(MachineState *machine, DigicBoard *board)
+/*
+ * Map the RAM image of the checkpoint copy-on-write in place of the
+ * machine RAM.
+ */
+static MemoryRegion *digic_map_checkpoint_ram(DigicMachineState *dms)
+{
+    MachineState *machine = MACHINE(dms);
+    g_autofree char *path = g_strconcat(dms->checkpoint,
+                                        DIGIC_CHECKPOINT_RAM, NULL);
+    Error *err = NULL;
+#ifdef CONFIG_POSIX
+    int fd = qemu_open(path, O_RDONLY, &err);
+
+    if (fd >= 0) {
+        memory_region_init_ram_from_fd(&dms->checkpoint_ram, OBJECT(machine),
+                                       "digic.checkpoint-ram",
+                                       machine->ram_size, 0, fd, 0, &err);
+        if (err) {
+            qemu_close(fd);
+        }
+    }
+#else
+    error_setg(&err, "checkpoints are not supported on this host");
+#endif
+    if (err) {
+        error_reportf_err(err, "Couldn't map '%s': ", path);
+        exit(1);
+    }
+    vmstate_register_ram_global(&dms->checkpoint_ram);
+    return &dms->checkpoint_ram;
+}
+
+static void digic_checkpoint_save_timer(void *opaque)
 {
+    DigicMachineState *dms = opaque;
+    bool running = runstate_is_running();
     Error *err = NULL;
+
+    vm_stop(RUN_STATE_SAVE_VM);
+    if (!digic_checkpoint_save(dms->soc, dms->ram,
+                               pflash_cfi02_get_memory(dms->flash),
+                               dms->checkpoint_save, &err)) {
+        error_reportf_err(err, "Couldn't save checkpoint: ");
+    }
+    if (running) {
+        vm_start();
+    }
+}
+
+static void digic_add_flash(DigicMachineState *dms, DigicState *s,
+                            unsigned cam, int n, const DigicFlash *fl,
+                            const char *filename);
+static const DigicBoard *digic_board_load(const char *filename, Error **errp);
+
+/*
+ * Create camera @cam, with its cores in the clusters from @cluster_id.
+ * The first one uses the system memory and the machine RAM; the others
+ * get their own address space and RAM.
+ */
+static void digic_add_camera(MachineState *machine, const DigicBoard *board,
+                             unsigned cam, uint32_t cluster_id)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(machine);
     DigicState *s = DIGIC(object_new(TYPE_DIGIC));
-    MachineClass *mc = MACHINE_GET_CLASS(machine);
+    g_autofree char *name = g_strdup_printf("camera[%u]", cam);
+    MemoryRegion *sysmem, *ram;
+    DriveInfo *di;
+    DeviceState *card;
+    Error *err = NULL;
+    int i;
 
-    if (machine->ram_size != mc->default_ram_size) {
-        char *sz = size_to_str(mc->default_ram_size);
-        error_report("Invalid RAM size, should be %s", sz);
-        g_free(sz);
-        exit(EXIT_FAILURE);
+    object_property_add_child(OBJECT(machine), name, OBJECT(s));
+    object_unref(OBJECT(s));
+
+    if (cam == 0) {
+        sysmem = get_system_memory();
+        ram = dms->checkpoint ? digic_map_checkpoint_ram(dms) : machine->ram;
+    } else {
+        g_autofree char *mem_name = g_strdup_printf("digic.memory.%u", cam);
+        g_autofree char *ram_name = g_strdup_printf("ram.%u", cam);
+
+        sysmem = g_new(MemoryRegion, 1);
+        memory_region_init(sysmem, OBJECT(machine), mem_name, 4 * GiB);
+        ram = g_new(MemoryRegion, 1);
+        /* memory_region_init_ram() wants a device as the owner */
+        memory_region_init_ram_nomigrate(ram, OBJECT(machine), ram_name,
+                                         machine->ram_size, &error_fatal);
+        vmstate_register_ram_global(ram);
+    }
+    object_property_set_link(OBJECT(s), "memory", OBJECT(sysmem),
+                             &error_abort);
+    qdev_prop_set_chr(DEVICE(s), "chardev", serial_hd(cam));
+    qdev_prop_set_uint32(DEVICE(s), "cluster-id", cluster_id);
+
+    if (board->intc_base) {
+        qdev_prop_set_uint64(DEVICE(s), "intc-base", board->intc_base);
+    }
+    if (board->clock_base) {
+        qdev_prop_set_uint64(DEVICE(s), "clock-base", board->clock_base);
+    }
+    if (board->timer_base) {
+        qdev_prop_set_uint64(DEVICE(s), "timer-base", board->timer_base);
+    }
+    if (board->uart_base) {
+        qdev_prop_set_uint64(DEVICE(s), "uart-base", board->uart_base);
+    }
+    if (board->sdhost_base) {
+        qdev_prop_set_uint64(DEVICE(s), "sdhost-base", board->sdhost_base);
+    }
+    if (board->lcd_base) {
+        qdev_prop_set_uint64(DEVICE(s), "lcd-base", board->lcd_base);
+    }
+    if (board->edmac_base) {
+        qdev_prop_set_uint64(DEVICE(s), "edmac-base", board->edmac_base);
+    }
+    if (board->mpu_base) {
+        qdev_prop_set_uint64(DEVICE(s), "mpu-base", board->mpu_base);
+    }
+    if (board->cpu2_type) {
+        qdev_prop_set_string(DEVICE(s), "cpu2-type", board->cpu2_type);
+    }
+
+    if (dms->fast_delays) {
+        object_property_set_uint(OBJECT(&s->edmac), "bytes-per-us", 0,
+                                 &error_abort);
     }
 
     if (!qdev_realize(DEVICE(s), NULL, &err)) {
@@ -65,40 +245,124 @@ static void digic4_board_init(MachineState *machine, DigicBoard *board)
         exit(1);
     }
 
-    memory_region_add_subregion(get_system_memory(), 0, machine->ram);
+    /* Camera @cam gets the card of -drive if=sd,index=@cam */
+    di = drive_get(IF_SD, 0, cam);
+    card = qdev_new(TYPE_SD_CARD);
+    qdev_prop_set_drive_err(card, "drive", di ? blk_by_legacy_dinfo(di) : NULL,
+                            &error_fatal);
+    qdev_realize_and_unref(card, qdev_get_child_bus(DEVICE(&s->sdhost),
+                                                    "sd-bus"),
+                           &error_fatal);
 
-    if (board->add_rom0) {
-        board->add_rom0(s, DIGIC4_ROM0_BASE,
-                        machine->firmware ?: board->rom0_def_filename);
+    memory_region_add_subregion(sysmem, 0, ram);
+
+    for (i = 0; i < DIGIC_NB_ROMS; i++) {
+        if (board->rom[i].size) {
+            digic_add_flash(dms, s, cam, i, &board->rom[i],
+                            machine->firmware ?: board->rom[i].def_filename);
+        }
     }
 
-    if (board->add_rom1) {
-        board->add_rom1(s, DIGIC4_ROM1_BASE,
-                        machine->firmware ?: board->rom1_def_filename);
+    if (cam == 0) {
+        dms->soc = s;
+        dms->ram = ram;
     }
 }
 
-static void digic_load_rom(DigicState *s, hwaddr addr,
-                           hwaddr max_size, const char *filename)
+static void digic4_board_init(MachineState *machine, const DigicBoard *board)
 {
-    target_long rom_size;
+    Error *err = NULL;
+    DigicMachineState *dms = DIGIC_MACHINE(machine);
+    unsigned i;
 
-    if (qtest_enabled()) {
-        /* qtest runs no code so don't attempt a ROM load which
-         * could fail and result in a spurious test failure.
-         */
-        return;
+    if (dms->board_file) {
+        board = digic_board_load(dms->board_file, &err);
+        if (!board) {
+            error_reportf_err(err, "Couldn't load board description: ");
+            exit(1);
+        }
+    } else if (!board) {
+        error_report("This machine needs a board description (board=FILE)");
+        exit(1);
     }
 
-    if (filename) {
-        char *fn = qemu_find_file(QEMU_FILE_TYPE_BIOS, filename);
+    if (machine->ram_size != board->ram_size) {
+        char *sz = size_to_str(board->ram_size);
+        error_report("Invalid RAM size, should be %s", sz);
+        g_free(sz);
+        exit(EXIT_FAILURE);
+    }
 
-        if (!fn) {
-            error_report("Couldn't find rom image '%s'.", filename);
+    if (dms->cameras > 1 && (dms->checkpoint || dms->checkpoint_save)) {
+        error_report("Checkpoints only support a single camera");
+        exit(1);
+    }
+
+    for (i = 0; i < dms->cameras; i++) {
+        /* The gdbstub tells the clusters of all cameras apart by ID */
+        digic_add_camera(machine, board, i, i * (board->cpu2_type ? 2 : 1));
+    }
+
+    if (dms->checkpoint_save) {
+        if (!dms->flash) {
+            error_report("This board does not support checkpoints");
+            exit(1);
+        }
+        dms->checkpoint_timer = timer_new_ms(QEMU_CLOCK_VIRTUAL,
+                                             digic_checkpoint_save_timer, dms);
+        timer_mod(dms->checkpoint_timer, dms->checkpoint_save_at);
+    }
+}
+
+static void digic_machine_reset(MachineState *machine)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(machine);
+    Error *err = NULL;
+
+    qemu_devices_reset();
+
+    /*
+     * Only the reset done when the machine is created restores the
+     * checkpoint; later ones reset the devices as usual.
+     */
+    if (dms->checkpoint && !dms->checkpoint_restored) {
+        dms->checkpoint_restored = true;
+        if (!digic_checkpoint_load(dms->soc, dms->checkpoint, &err)) {
+            error_reportf_err(err, "Couldn't restore checkpoint: ");
             exit(1);
         }
+    }
+}
+
+/*
+ * Returns the full path of the ROM image @filename, or NULL when no image
+ * should be loaded.  qtest runs no code so don't attempt a ROM load which
+ * could fail and result in a spurious test failure.
+ */
+static char *digic_find_rom(const char *filename)
+{
+    char *fn;
 
-        rom_size = load_image_targphys(fn, addr, max_size);
+    if (qtest_enabled() || !filename) {
+        return NULL;
+    }
+
+    fn = qemu_find_file(QEMU_FILE_TYPE_BIOS, filename);
+    if (!fn) {
+        error_report("Couldn't find rom image '%s'.", filename);
+        exit(1);
+    }
+    return fn;
+}
+
+static void digic_load_rom(DigicState *s, hwaddr addr,
+                           hwaddr max_size, const char *filename)
+{
+    target_long rom_size;
+    char *fn = digic_find_rom(filename);
+
+    if (fn) {
+        rom_size = load_image_targphys_as(fn, addr, max_size, &s->as);
         if (rom_size < 0 || rom_size > max_size) {
             error_report("Couldn't load rom image '%s'.", filename);
             exit(1);
@@ -107,29 +371,325 @@ static void digic_load_rom(DigicState *s, hwaddr addr,
     }
 }
 
+static MemoryRegion *digic_rom_code_source(DigicMachineState *dms, int n,
+                                           const char *filename, hwaddr size)
+{
+    MemoryRegion *mr = &dms->rom_code[n];
+    Error *err = NULL;
+#ifdef CONFIG_POSIX
+    g_autofree char *name = NULL;
+    int fd;
+
+    if (memory_region_size(mr)) {
+        return mr;
+    }
+
+    fd = qemu_open(filename, O_RDONLY, &err);
+    if (fd >= 0) {
+        name = g_strdup_printf("digic.rom%d-code", n);
+        memory_region_init_ram_from_fd(mr, OBJECT(dms), name, size, 0, fd, 0,
+                                       &err);
+        if (err) {
+            qemu_close(fd);
+        }
+    }
+#else
+    error_setg(&err, "ROM code sharing is not supported on this host");
+#endif
+    if (err) {
+        error_reportf_err(err, "Couldn't map '%s': ", filename);
+        exit(1);
+    }
+    return mr;
+}
+
+static void digic_add_flash(DigicMachineState *dms, DigicState *s,
+                            unsigned cam, int n, const DigicFlash *fl,
+                            const char *filename)
+{
+    /* ROM1 keeps the name it always had, for migration compatibility. */
+    const char *base_name = n == DIGIC_CHECKPOINT_ROM ? "pflash" :
+                                                        "pflash-rom0";
+    g_autofree char *name = cam ? g_strdup_printf("%s.%u", base_name, cam) :
+                                  g_strdup(base_name);
+    bool checkpointed = dms->checkpoint && n == DIGIC_CHECKPOINT_ROM;
+    bool mapped = dms->rom_mmap || checkpointed;
+    g_autofree char *fn = NULL;
+    DeviceState *dev;
+
+    dev = qdev_new(TYPE_PFLASH_CFI02);
+    qdev_prop_set_uint32(dev, "num-blocks", fl->size / fl->sector_len);
+    qdev_prop_set_uint32(dev, "sector-length", fl->sector_len);
+    qdev_prop_set_uint8(dev, "width", fl->width);
+    qdev_prop_set_uint8(dev, "mappings", DIGIC4_ROM_MAX_SIZE / fl->size);
+    qdev_prop_set_uint8(dev, "big-endian", 0);
+    qdev_prop_set_uint16(dev, "id0", fl->id[0]);
+    qdev_prop_set_uint16(dev, "id1", fl->id[1]);
+    qdev_prop_set_uint16(dev, "id2", fl->id[2]);
+    qdev_prop_set_uint16(dev, "id3", fl->id[3]);
+    qdev_prop_set_uint16(dev, "unlock-addr0", fl->unlock_addr[0]);
+    qdev_prop_set_uint16(dev, "unlock-addr1", fl->unlock_addr[1]);
+    qdev_prop_set_string(dev, "name", name);
+    qdev_prop_set_bit(dev, "fast-erase", dms->fast_delays);
+
+    /*
+     * When mapped, the image goes straight into the flash backing store
+     * instead of being copied there, so that all instances running the
+     * same dump share its pages.  The image must cover the whole flash.
+     */
+    if (checkpointed) {
+        fn = g_strconcat(dms->checkpoint, DIGIC_CHECKPOINT_FLASH, NULL);
+    } else if (mapped) {
+        fn = digic_find_rom(filename);
+    }
+    if (fn) {
+        qdev_prop_set_string(dev, "rom-file", fn);
+    }
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(dev), &error_fatal);
+    memory_region_add_subregion(s->memory, fl->base,
+                                sysbus_mmio_get_region(SYS_BUS_DEVICE(dev),
+                                                       0));
+
+    /*
+     * All cameras map the same image, so they can run the same
+     * translated code until one of them reprograms its flash.
+     */
+    if (dms->rom_mmap && dms->cameras > 1 && fn) {
+        memory_region_share_code(pflash_cfi02_get_memory(PFLASH_CFI02(dev)),
+                                 digic_rom_code_source(dms, n, fn, fl->size));
+    }
+
+    if (!mapped) {
+        digic_load_rom(s, fl->base, fl->size, filename);
+    }
+
+    if (cam == 0 && n == DIGIC_CHECKPOINT_ROM) {
+        dms->flash = PFLASH_CFI02(dev);
+    }
+
+    /* Symbols are global, all cameras run the same firmware */
+    if (cam == 0 && fl->symbols && !qtest_enabled()) {
+        g_autofree char *map = qemu_find_file(QEMU_FILE_TYPE_BIOS,
+                                              fl->symbols);
+
+        load_symbol_map(map ?: fl->symbols, &error_fatal);
+    }
+}
+
 /*
- * Samsung K8P3215UQB
- * 64M Bit (4Mx16) Page Mode / Multi-Bank NOR Flash Memory
+ * Board description files
+ *
+ * A board description lets a camera model be brought up without
+ * rebuilding QEMU.  It is a GKeyFile, for example:
+ *
+ *   [board]
+ *   ram-size = 64M
+ *   intc-base = 0xc0201000
+ *   clock-base = 0xc0242000
+ *   timer-base = 0xc0210000
+ *   uart-base = 0xc0800000
+ *   sdhost-base = 0xc0c10000
+ *   lcd-base = 0xc0f14000
+ *   edmac-base = 0xc0f04000
+ *   mpu-base = 0xc0820000
+ *   cpu2 = arm946
+ *
+ *   [rom1]
+ *   file = canon-a1100-rom1.bin
+ *   symbols = canon-a1100-rom1.sym
+ *   size = 4M
+ *   sector-length = 64K
+ *   width = 4
+ *   id = 0x00ec;0x007e;0x0003;0x0001
+ *   unlock-addr = 0x555;0x2aa
+ *
+ * The [rom0] and [rom1] groups describe the flash chips mapped at
+ * DIGIC4_ROM0_BASE and DIGIC4_ROM1_BASE (or at "base"), and are
+ * optional.  Descriptions are parsed once per process and cached.
  */
-static void digic4_add_k8p3215uqb_rom(DigicState *s, hwaddr addr,
-                                      const char *filename)
+
+static bool digic_board_get_u64(GKeyFile *kf, const char *group,
+                                const char *key, bool is_size,
+                                uint64_t *value, Error **errp)
 {
-#define FLASH_K8P3215UQB_SIZE (4 * 1024 * 1024)
-#define FLASH_K8P3215UQB_SECTOR_SIZE (64 * 1024)
+    g_autofree char *str = g_key_file_get_string(kf, group, key, NULL);
+    int ret;
 
-    pflash_cfi02_register(addr, "pflash", FLASH_K8P3215UQB_SIZE,
-                          NULL, FLASH_K8P3215UQB_SECTOR_SIZE,
-                          DIGIC4_ROM_MAX_SIZE / FLASH_K8P3215UQB_SIZE,
-                          4,
-                          0x00EC, 0x007E, 0x0003, 0x0001,
-                          0x0555, 0x2aa, 0);
+    if (!str) {
+        /* Keep the default */
+        return true;
+    }
 
-    digic_load_rom(s, addr, FLASH_K8P3215UQB_SIZE, filename);
+    ret = is_size ? qemu_strtosz(str, NULL, value) :
+                    qemu_strtou64(str, NULL, 0, value);
+    if (ret < 0) {
+        error_setg(errp, "[%s] %s: invalid value '%s'", group, key, str);
+        return false;
+    }
+    return true;
 }
 
-static DigicBoard digic4_board_canon_a1100 = {
-    .add_rom1 = digic4_add_k8p3215uqb_rom,
-    .rom1_def_filename = "canon-a1100-rom1.bin",
+static bool digic_board_get_u16_list(GKeyFile *kf, const char *group,
+                                     const char *key, uint16_t *values,
+                                     size_t nb_values, Error **errp)
+{
+    g_auto(GStrv) strs = g_key_file_get_string_list(kf, group, key, NULL,
+                                                     NULL);
+    uint64_t value;
+    size_t i;
+
+    if (!strs) {
+        return true;
+    }
+
+    for (i = 0; strs[i]; i++) {
+        if (i >= nb_values ||
+            qemu_strtou64(strs[i], NULL, 0, &value) < 0 || value > UINT16_MAX) {
+            error_setg(errp, "[%s] %s: expected %zu 16-bit values", group, key,
+                       nb_values);
+            return false;
+        }
+        values[i] = value;
+    }
+    return true;
+}
+
+static bool digic_board_parse_flash(GKeyFile *kf, const char *group,
+                                    DigicFlash *fl, Error **errp)
+{
+    uint64_t base = fl->base, size = 0, sector_len = 64 * KiB, width = 4;
+
+    if (!g_key_file_has_group(kf, group)) {
+        return true;
+    }
+
+    if (!digic_board_get_u64(kf, group, "base", false, &base, errp) ||
+        !digic_board_get_u64(kf, group, "size", true, &size, errp) ||
+        !digic_board_get_u64(kf, group, "sector-length", true, &sector_len,
+                             errp) ||
+        !digic_board_get_u64(kf, group, "width", false, &width, errp) ||
+        !digic_board_get_u16_list(kf, group, "id", fl->id,
+                                  ARRAY_SIZE(fl->id), errp) ||
+        !digic_board_get_u16_list(kf, group, "unlock-addr", fl->unlock_addr,
+                                  ARRAY_SIZE(fl->unlock_addr), errp)) {
+        return false;
+    }
+
+    /* The flash is replicated over the whole ROM window. */
+    if (!size || !is_power_of_2(size) || size > DIGIC4_ROM_MAX_SIZE ||
+        DIGIC4_ROM_MAX_SIZE / size > UINT8_MAX) {
+        error_setg(errp, "[%s] size: must be a power of 2 between 1 MiB "
+                   "and 128 MiB", group);
+        return false;
+    }
+    if (!sector_len || size % sector_len) {
+        error_setg(errp, "[%s] sector-length: must divide the flash size",
+                   group);
+        return false;
+    }
+    if (width != 1 && width != 2 && width != 4) {
+        error_setg(errp, "[%s] width: must be 1, 2 or 4", group);
+        return false;
+    }
+
+    fl->base = base;
+    fl->size = size;
+    fl->sector_len = sector_len;
+    fl->width = width;
+    fl->def_filename = g_key_file_get_string(kf, group, "file", NULL);
+    fl->symbols = g_key_file_get_string(kf, group, "symbols", NULL);
+    return true;
+}
+
+static DigicBoard *digic_board_parse(const char *filename, Error **errp)
+{
+    g_autoptr(GKeyFile) kf = g_key_file_new();
+    g_autoptr(GError) gerr = NULL;
+    g_autofree DigicBoard *board = g_new0(DigicBoard, 1);
+    uint64_t ram_size = 64 * MiB, timer_base = 0, uart_base = 0;
+    uint64_t intc_base = 0, sdhost_base = 0, lcd_base = 0, edmac_base = 0;
+    uint64_t mpu_base = 0, clock_base = 0;
+
+    if (!g_key_file_load_from_file(kf, filename, G_KEY_FILE_NONE, &gerr)) {
+        error_setg(errp, "'%s': %s", filename, gerr->message);
+        return NULL;
+    }
+
+    if (!digic_board_get_u64(kf, "board", "ram-size", true, &ram_size,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "intc-base", false, &intc_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "clock-base", false, &clock_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "timer-base", false, &timer_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "uart-base", false, &uart_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "sdhost-base", false, &sdhost_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "lcd-base", false, &lcd_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "edmac-base", false, &edmac_base,
+                             errp) ||
+        !digic_board_get_u64(kf, "board", "mpu-base", false, &mpu_base,
+                             errp)) {
+        return NULL;
+    }
+    board->ram_size = ram_size;
+    board->intc_base = intc_base;
+    board->clock_base = clock_base;
+    board->timer_base = timer_base;
+    board->uart_base = uart_base;
+    board->sdhost_base = sdhost_base;
+    board->lcd_base = lcd_base;
+    board->edmac_base = edmac_base;
+    board->mpu_base = mpu_base;
+    board->cpu2_type = g_key_file_get_string(kf, "board", "cpu2", NULL);
+
+    board->rom[0].base = DIGIC4_ROM0_BASE;
+    board->rom[1].base = DIGIC4_ROM1_BASE;
+    if (!digic_board_parse_flash(kf, "rom0", &board->rom[0], errp) ||
+        !digic_board_parse_flash(kf, "rom1", &board->rom[1], errp)) {
+        return NULL;
+    }
+
+    return g_steal_pointer(&board);
+}
+
+static const DigicBoard *digic_board_load(const char *filename, Error **errp)
+{
+    static GHashTable *cache;
+    DigicBoard *board;
+
+    if (!cache) {
+        cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    board = g_hash_table_lookup(cache, filename);
+    if (!board) {
+        board = digic_board_parse(filename, errp);
+        if (board) {
+            g_hash_table_insert(cache, g_strdup(filename), board);
+        }
+    }
+    return board;
+}
+
+/*
+ * Samsung K8P3215UQB
+ * 64M Bit (4Mx16) Page Mode / Multi-Bank NOR Flash Memory
+ */
+static const DigicBoard digic4_board_canon_a1100 = {
+    .ram_size = 64 * MiB,
+    .rom[1] = {
+        .base = DIGIC4_ROM1_BASE,
+        .size = 4 * MiB,
+        .sector_len = 64 * KiB,
+        .width = 4,
+        .id = { 0x00EC, 0x007E, 0x0003, 0x0001 },
+        .unlock_addr = { 0x0555, 0x2aa },
+        .def_filename = "canon-a1100-rom1.bin",
+    },
 };
 
 static void canon_a1100_init(MachineState *machine)
@@ -137,8 +697,192 @@ static void canon_a1100_init(MachineState *machine)
     digic4_board_init(machine, &digic4_board_canon_a1100);
 }
 
-static void canon_a1100_machine_init(MachineClass *mc)
+static void digic4_init(MachineState *machine)
+{
+    digic4_board_init(machine, NULL);
+}
+
+static char *digic_get_board(Object *obj, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    return g_strdup(dms->board_file);
+}
+
+static void digic_set_board(Object *obj, const char *value, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    g_free(dms->board_file);
+    dms->board_file = g_strdup(value);
+}
+
+static bool digic_get_rom_mmap(Object *obj, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    return dms->rom_mmap;
+}
+
+static void digic_set_rom_mmap(Object *obj, bool value, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    dms->rom_mmap = value;
+}
+
+static bool digic_get_fast_delays(Object *obj, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    return dms->fast_delays;
+}
+
+static void digic_set_fast_delays(Object *obj, bool value, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    dms->fast_delays = value;
+}
+
+static char *digic_get_checkpoint(Object *obj, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    return g_strdup(dms->checkpoint);
+}
+
+static void digic_set_checkpoint(Object *obj, const char *value, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    g_free(dms->checkpoint);
+    dms->checkpoint = g_strdup(value);
+}
+
+static char *digic_get_checkpoint_save(Object *obj, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    return g_strdup(dms->checkpoint_save);
+}
+
+static void digic_set_checkpoint_save(Object *obj, const char *value,
+                                      Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    g_free(dms->checkpoint_save);
+    dms->checkpoint_save = g_strdup(value);
+}
+
+static void digic_get_checkpoint_save_at(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    visit_type_uint64(v, name, &dms->checkpoint_save_at, errp);
+}
+
+static void digic_set_checkpoint_save_at(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    visit_type_uint64(v, name, &dms->checkpoint_save_at, errp);
+}
+
+static void digic_get_cameras(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
 {
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    visit_type_uint32(v, name, &dms->cameras, errp);
+}
+
+static void digic_set_cameras(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value < 1 || value > DIGIC_MAX_CAMERAS) {
+        error_setg(errp, "cameras must be between 1 and %d",
+                   DIGIC_MAX_CAMERAS);
+        return;
+    }
+    dms->cameras = value;
+}
+
+static void digic_machine_instance_init(Object *obj)
+{
+    DigicMachineState *dms = DIGIC_MACHINE(obj);
+
+    dms->cameras = 1;
+}
+
+static void digic_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
+    mc->reset = digic_machine_reset;
+    mc->small_footprint = true;
+
+    object_class_property_add(oc, "cameras", "uint32", digic_get_cameras,
+                              digic_set_cameras, NULL, NULL);
+    object_class_property_set_description(oc, "cameras",
+                                          "Number of cameras to emulate, "
+                                          "each with its own SoC, RAM and "
+                                          "serial port");
+    object_class_property_add_str(oc, "board", digic_get_board,
+                                  digic_set_board);
+    object_class_property_set_description(oc, "board",
+                                          "Board description file to use "
+                                          "instead of the built-in one");
+    object_class_property_add_str(oc, "checkpoint", digic_get_checkpoint,
+                                  digic_set_checkpoint);
+    object_class_property_set_description(oc, "checkpoint",
+                                          "Start from the checkpoint files "
+                                          "with this prefix instead of "
+                                          "booting from reset");
+    object_class_property_add_str(oc, "checkpoint-save",
+                                  digic_get_checkpoint_save,
+                                  digic_set_checkpoint_save);
+    object_class_property_set_description(oc, "checkpoint-save",
+                                          "Save checkpoint files with this "
+                                          "prefix at checkpoint-save-at");
+    object_class_property_add(oc, "checkpoint-save-at", "uint64",
+                              digic_get_checkpoint_save_at,
+                              digic_set_checkpoint_save_at, NULL, NULL);
+    object_class_property_set_description(oc, "checkpoint-save-at",
+                                          "Virtual time in milliseconds at "
+                                          "which to save the checkpoint");
+
+    object_class_property_add_bool(oc, "rom-mmap", digic_get_rom_mmap,
+                                   digic_set_rom_mmap);
+    object_class_property_set_description(oc, "rom-mmap",
+                                          "Set on to map the ROM image "
+                                          "copy-on-write instead of loading "
+                                          "a private copy of it");
+
+    object_class_property_add_bool(oc, "fast-delays", digic_get_fast_delays,
+                                   digic_set_fast_delays);
+    object_class_property_set_description(oc, "fast-delays",
+                                          "Set on to complete flash erases "
+                                          "and EDMAC transfers without "
+                                          "waiting for their hardware "
+                                          "duration");
+}
+
+static void canon_a1100_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
     mc->desc = "Canon PowerShot A1100 IS (ARM946)";
     mc->init = &canon_a1100_init;
     mc->ignore_memory_transaction_failures = true;
@@ -146,4 +890,34 @@ static void canon_a1100_machine_init(MachineClass *mc)
     mc->default_ram_id = "ram";
 }
 
-DEFINE_MACHINE("canon-a1100", canon_a1100_machine_init)
+static void digic4_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
+    mc->desc = "Canon DIGIC4 camera described by a board file (ARM946)";
+    mc->init = &digic4_init;
+    mc->ignore_memory_transaction_failures = true;
+    mc->default_ram_size = 64 * MiB;
+    mc->default_ram_id = "ram";
+}
+
+static const TypeInfo digic_machine_types[] = {
+    {
+        .name           = TYPE_DIGIC_MACHINE,
+        .parent         = TYPE_MACHINE,
+        .abstract       = true,
+        .instance_size  = sizeof(DigicMachineState),
+        .instance_init  = digic_machine_instance_init,
+        .class_init     = digic_machine_class_init,
+    }, {
+        .name           = MACHINE_TYPE_NAME("canon-a1100"),
+        .parent         = TYPE_DIGIC_MACHINE,
+        .class_init     = canon_a1100_machine_class_init,
+    }, {
+        .name           = MACHINE_TYPE_NAME("digic4"),
+        .parent         = TYPE_DIGIC_MACHINE,
+        .class_init     = digic4_machine_class_init,
+    },
+};
+
+DEFINE_TYPES(digic_machine_types)
@@ -0,0 +1,199 @@
+/*
+ * Checkpoints of the Canon DIGIC SoC state, used to start a machine
+ * at a known point after boot.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+/*
+ * A checkpoint is made of three files sharing a common prefix:
+ *
+ *   PREFIX.ram    raw image of the main RAM
+ *   PREFIX.flash  raw image of the ROM1 flash
+ *   PREFIX.state  device state
+ *
+ * The two images are mapped copy-on-write by the board when the
+ * checkpoint is restored, so only the pages the guest touches are read
+ * and only those it writes are copied.  The device state file holds a
+ * small header followed by, for each device, the name and version of
+ * its VMStateDescription and the state it describes.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "hw/arm/digic.h"
+#include "hw/core/sysemu-cpu-ops.h"
+#include "io/channel-file.h"
+#include "migration/vmstate.h"
+#include "migration/qemu-file-types.h"
+#include "migration/qemu-file.h"
+#include "migration/qemu-file-channel.h"
+
+#define DIGIC_CHECKPOINT_MAGIC      0x44474350 /* "DGCP" */
+#define DIGIC_CHECKPOINT_VERSION    3
+
+/* The state of the second core, if any, comes last */
+#define DIGIC_CHECKPOINT_MAX_ENTRIES (2 + 2 + DIGIC4_NB_TIMERS + 1 + 2)
+
+typedef struct DigicCheckpointEntry {
+    const VMStateDescription *vmsd;
+    void *opaque;
+} DigicCheckpointEntry;
+
+static int digic_checkpoint_cpu_entries(ARMCPU *cpu, DigicCheckpointEntry *e)
+{
+    CPUState *cs = CPU(cpu);
+
+    e[0] = (DigicCheckpointEntry) { &vmstate_cpu_common, cs };
+    e[1] = (DigicCheckpointEntry) {
+        CPU_GET_CLASS(cs)->sysemu_ops->legacy_vmsd, cs
+    };
+    return 2;
+}
+
+/* Fill @e and return the number of entries */
+static int digic_checkpoint_entries(DigicState *s, DigicCheckpointEntry *e)
+{
+    int i, n = 0;
+
+    n += digic_checkpoint_cpu_entries(&s->cpu, &e[n]);
+    e[n++] = (DigicCheckpointEntry) { qdev_get_vmsd(DEVICE(&s->intc)),
+                                      &s->intc };
+    /* Before the timers, whose post_load reads it */
+    e[n++] = (DigicCheckpointEntry) { qdev_get_vmsd(DEVICE(&s->clock)),
+                                      &s->clock };
+    for (i = 0; i < DIGIC4_NB_TIMERS; i++) {
+        e[n++] = (DigicCheckpointEntry) {
+            qdev_get_vmsd(DEVICE(&s->timer[i])), &s->timer[i]
+        };
+    }
+    e[n++] = (DigicCheckpointEntry) { qdev_get_vmsd(DEVICE(&s->uart)),
+                                      &s->uart };
+    if (s->cpu2) {
+        n += digic_checkpoint_cpu_entries(s->cpu2, &e[n]);
+    }
+    assert(n <= DIGIC_CHECKPOINT_MAX_ENTRIES);
+    return n;
+}
+
+static bool digic_checkpoint_save_image(MemoryRegion *mr, const char *prefix,
+                                        const char *suffix, Error **errp)
+{
+    g_autofree char *path = g_strconcat(prefix, suffix, NULL);
+    g_autoptr(GError) gerr = NULL;
+
+    if (!g_file_set_contents(path, memory_region_get_ram_ptr(mr),
+                             memory_region_size(mr), &gerr)) {
+        error_setg(errp, "Couldn't write '%s': %s", path, gerr->message);
+        return false;
+    }
+    return true;
+}
+
+static bool digic_checkpoint_save_state(DigicState *s, const char *prefix,
+                                        Error **errp)
+{
+    g_autofree char *path = g_strconcat(prefix, DIGIC_CHECKPOINT_STATE, NULL);
+    DigicCheckpointEntry entries[DIGIC_CHECKPOINT_MAX_ENTRIES];
+    QIOChannelFile *ioc;
+    QEMUFile *f;
+    int i, n, ret = 0;
+
+    ioc = qio_channel_file_new_path(path, O_WRONLY | O_CREAT | O_TRUNC,
+                                    0660, errp);
+    if (!ioc) {
+        return false;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "digic-checkpoint-save");
+    f = qemu_fopen_channel_output(QIO_CHANNEL(ioc));
+    object_unref(OBJECT(ioc));
+
+    qemu_put_be32(f, DIGIC_CHECKPOINT_MAGIC);
+    qemu_put_be32(f, DIGIC_CHECKPOINT_VERSION);
+
+    n = digic_checkpoint_entries(s, entries);
+    for (i = 0; i < n && ret >= 0; i++) {
+        qemu_put_counted_string(f, entries[i].vmsd->name);
+        qemu_put_be32(f, entries[i].vmsd->version_id);
+        ret = vmstate_save_state(f, entries[i].vmsd, entries[i].opaque, NULL);
+    }
+
+    if (qemu_fclose(f) < 0 || ret < 0) {
+        error_setg(errp, "Couldn't write '%s'", path);
+        return false;
+    }
+    return true;
+}
+
+bool digic_checkpoint_save(DigicState *s, MemoryRegion *ram,
+                           MemoryRegion *flash, const char *prefix,
+                           Error **errp)
+{
+    return digic_checkpoint_save_image(ram, prefix, DIGIC_CHECKPOINT_RAM,
+                                       errp) &&
+           digic_checkpoint_save_image(flash, prefix, DIGIC_CHECKPOINT_FLASH,
+                                       errp) &&
+           digic_checkpoint_save_state(s, prefix, errp);
+}
+
+bool digic_checkpoint_load(DigicState *s, const char *prefix, Error **errp)
+{
+    g_autofree char *path = g_strconcat(prefix, DIGIC_CHECKPOINT_STATE, NULL);
+    DigicCheckpointEntry entries[DIGIC_CHECKPOINT_MAX_ENTRIES];
+    QIOChannelFile *ioc;
+    QEMUFile *f;
+    char name[256];
+    int i, n, ret = 0;
+
+    ioc = qio_channel_file_new_path(path, O_RDONLY | O_BINARY, 0, errp);
+    if (!ioc) {
+        return false;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "digic-checkpoint-load");
+    f = qemu_fopen_channel_input(QIO_CHANNEL(ioc));
+    object_unref(OBJECT(ioc));
+
+    if (qemu_get_be32(f) != DIGIC_CHECKPOINT_MAGIC ||
+        qemu_get_be32(f) != DIGIC_CHECKPOINT_VERSION) {
+        error_setg(errp, "'%s' is not a DIGIC checkpoint", path);
+        qemu_fclose(f);
+        return false;
+    }
+
+    n = digic_checkpoint_entries(s, entries);
+    for (i = 0; i < n; i++) {
+        const VMStateDescription *vmsd = entries[i].vmsd;
+
+        if (!qemu_get_counted_string(f, name) || strcmp(name, vmsd->name)) {
+            error_setg(errp, "'%s': expected state of '%s'", path,
+                       vmsd->name);
+            qemu_fclose(f);
+            return false;
+        }
+        ret = vmstate_load_state(f, vmsd, entries[i].opaque,
+                                 qemu_get_be32(f));
+        if (ret < 0) {
+            error_setg(errp, "'%s': couldn't load state of '%s'", path,
+                       vmsd->name);
+            qemu_fclose(f);
+            return false;
+        }
+    }
+
+    ret = qemu_file_get_error(f);
+    qemu_fclose(f);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Couldn't read '%s'", path);
+        return false;
+    }
+    return true;
+}
@@ -42,6 +42,7 @@
 #include "qemu/bitmap.h"
 #include "qemu/timer.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/runstate.h"
 #include "qemu/host-utils.h"
 #include "qemu/module.h"
 #include "hw/sysbus.h"
@@ -81,6 +82,8 @@ struct PFlashCFI02 {
     int wcycle; /* if 0, the flash is read normally */
     int bypass;
     int ro;
+    /* Complete erase operations right away instead of at CFI timings */
+    bool fast_erase;
     uint8_t cmd;
     uint8_t status;
     /* FIXME: implement array device properties */
@@ -100,13 +103,35 @@ struct PFlashCFI02 {
     MemoryRegion mem;
     MemoryRegion *mem_mappings;    /* array; one per mapping */
     MemoryRegion orig_mem;
+    /*
+     * I/O window laid over the sector a command is addressed to, so that
+     * the rest of the array is still executed from RAM while the command
+     * is in progress.  Erase and identification commands, whose status
+     * or data can be read from any sector, switch the whole of .orig_mem
+     * out of ROMD mode instead.
+     */
+    MemoryRegion sector_mem;
+    hwaddr sector_mem_base;
+    bool sector_io;
     bool rom_mode;
     int read_counter; /* used for lazy switch-back to rom mode */
     int sectors_to_erase;
     uint64_t erase_time_remaining;
     unsigned long *sector_erase_map;
     char *name;
+    char *rom_file;
     void *storage;
+    /*
+     * Write-back of programmed data: dirty BDRV_SECTOR_SIZE sectors of
+     * .storage, written out by .flush_timer at most writeback_ms after
+     * they were first dirtied.  Only one write-back is in flight at a
+     * time, so that runs of the same sectors land in order.
+     */
+    uint32_t writeback_ms;
+    unsigned long *dirty_map;
+    QEMUTimer flush_timer;
+    bool flush_inflight;
+    VMChangeStateEntry *vmstate;
 };
 
 /*
@@ -187,7 +212,13 @@ static void pflash_mode_read_array(PFlashCFI02 *pfl)
     trace_pflash_mode_read_array(pfl->name);
     pflash_reset_state_machine(pfl);
     pfl->rom_mode = true;
+    memory_region_transaction_begin();
+    if (pfl->sector_io) {
+        pfl->sector_io = false;
+        memory_region_set_enabled(&pfl->sector_mem, false);
+    }
     memory_region_rom_device_set_romd(&pfl->orig_mem, true);
+    memory_region_transaction_commit();
 }
 
 static size_t pflash_regions_count(PFlashCFI02 *pfl)
@@ -202,6 +233,13 @@ static size_t pflash_regions_count(PFlashCFI02 *pfl)
  */
 static uint64_t pflash_erase_time(PFlashCFI02 *pfl)
 {
+    /*
+     * A fast erase still takes a nanosecond, so that an erase suspended
+     * before the end of the erase timeout has time left to resume.
+     */
+    if (pfl->fast_erase) {
+        return 1;
+    }
     /*
      * If there are no sectors to erase (which can happen if all of the sectors
      * to be erased are protected), then erase takes 100 us. Protected sectors
@@ -210,6 +248,18 @@ static uint64_t pflash_erase_time(PFlashCFI02 *pfl)
     return ((1ULL << pfl->cfi_table[0x21]) * pfl->sectors_to_erase) * SCALE_US;
 }
 
+/*
+ * Returns the time a chip erase takes, based on CFI address 0x22 which is
+ * "Typical timeout for full chip erase 2^N ms."
+ */
+static uint64_t pflash_chip_erase_time(PFlashCFI02 *pfl)
+{
+    if (pfl->fast_erase) {
+        return 1;
+    }
+    return (1ULL << pfl->cfi_table[0x22]) * SCALE_MS;
+}
+
 /*
  * Returns true if the device is currently in erase suspend mode.
  */
@@ -218,6 +268,8 @@ static inline bool pflash_erase_suspend_mode(PFlashCFI02 *pfl)
     return pfl->erase_time_remaining > 0;
 }
 
+static void pflash_flush(PFlashCFI02 *pfl);
+
 static void pflash_timer(void *opaque)
 {
     PFlashCFI02 *pfl = opaque;
@@ -240,6 +292,8 @@ static void pflash_timer(void *opaque)
         }
         trace_pflash_erase_complete(pfl->name);
         bitmap_zero(pfl->sector_erase_map, pfl->total_sectors);
+        /* Firmware often saves its settings right after an erase */
+        pflash_flush(pfl);
         pfl->sectors_to_erase = 0;
         reset_dq3(pfl);
     }
@@ -294,6 +348,75 @@ static SectorInfo pflash_sector_info(PFlashCFI02 *pfl, hwaddr offset)
     abort();
 }
 
+/*
+ * Leave ROMD mode for the sector containing @offset only.  If the device is
+ * already in I/O mode for another sector then the window moves, because
+ * the status of a command is read back at the address it was issued to.
+ */
+static void pflash_mode_sector_io(PFlashCFI02 *pfl, hwaddr offset)
+{
+    SectorInfo sector_info;
+    hwaddr base;
+
+    if (!pfl->rom_mode && !pfl->sector_io) {
+        /* The whole chip is in I/O mode already. */
+        return;
+    }
+
+    sector_info = pflash_sector_info(pfl, offset);
+    base = offset & ~(hwaddr)(sector_info.len - 1);
+    if (pfl->sector_io && pfl->sector_mem_base == base) {
+        return;
+    }
+
+    trace_pflash_mode_sector_io(pfl->name, base, sector_info.len);
+    pfl->rom_mode = false;
+    pfl->sector_io = true;
+    pfl->sector_mem_base = base;
+    memory_region_transaction_begin();
+    memory_region_set_size(&pfl->sector_mem, sector_info.len);
+    memory_region_set_address(&pfl->sector_mem, base);
+    memory_region_set_enabled(&pfl->sector_mem, true);
+    memory_region_transaction_commit();
+}
+
+/*
+ * Leave ROMD mode for the whole chip.
+ */
+static void pflash_mode_chip_io(PFlashCFI02 *pfl)
+{
+    if (!pfl->rom_mode && !pfl->sector_io) {
+        return;
+    }
+
+    trace_pflash_mode_chip_io(pfl->name);
+    pfl->rom_mode = false;
+    memory_region_transaction_begin();
+    if (pfl->sector_io) {
+        pfl->sector_io = false;
+        memory_region_set_enabled(&pfl->sector_mem, false);
+    }
+    memory_region_rom_device_set_romd(&pfl->orig_mem, false);
+    memory_region_transaction_commit();
+}
+
+/*
+ * The flash contents were modified behind the back of the memory API;
+ * drop any TBs translated from them and mark them dirty.  When the whole
+ * chip is in I/O mode, the TLB entries are already gone and no code can
+ * run from it.
+ */
+static void pflash_storage_changed(PFlashCFI02 *pfl, hwaddr offset,
+                                   hwaddr size)
+{
+    memory_region_unshare_code(&pfl->orig_mem, offset, size);
+    if (memory_region_is_romd(&pfl->orig_mem)) {
+        memory_region_flush_rom_device(&pfl->orig_mem, offset, size);
+    } else {
+        memory_region_set_dirty(&pfl->orig_mem, offset, size);
+    }
+}
+
 /*
  * Returns true if the offset refers to a flash sector that is currently being
  * erased.
@@ -390,12 +513,115 @@ static uint64_t pflash_read(void *opaque, hwaddr offset, unsigned int width)
     return ret;
 }
 
+typedef struct PFlashWriteback {
+    PFlashCFI02 *pfl;
+    QEMUIOVector qiov;
+    void *buf;
+} PFlashWriteback;
+
+static void pflash_flush_done(void *opaque, int ret)
+{
+    PFlashWriteback *wb = opaque;
+    PFlashCFI02 *pfl = wb->pfl;
+
+    if (ret < 0) {
+        error_report("Could not update PFLASH: %s", strerror(-ret));
+    }
+    qemu_iovec_destroy(&wb->qiov);
+    qemu_vfree(wb->buf);
+    g_free(wb);
+
+    /*
+     * Go on with the next run, unless the guest has programmed more since
+     * and the timer will pick it all up.  When stopping, write everything
+     * out now.
+     */
+    pfl->flush_inflight = false;
+    if (!timer_pending(&pfl->flush_timer) || !runstate_is_running()) {
+        pflash_flush(pfl);
+    }
+}
+
+/*
+ * Start writing back the dirty sectors, one run of contiguous sectors at a
+ * time.  Each run is written from a copy, so that the guest can keep
+ * programming them meanwhile.
+ */
+static void pflash_flush(PFlashCFI02 *pfl)
+{
+    unsigned long nb_sectors = pfl->chip_len >> BDRV_SECTOR_BITS;
+    unsigned long start, end;
+    PFlashWriteback *wb;
+    size_t len;
+
+    if (!pfl->dirty_map || pfl->flush_inflight) {
+        return;
+    }
+
+    start = find_first_bit(pfl->dirty_map, nb_sectors);
+    if (start >= nb_sectors) {
+        return;
+    }
+    end = find_next_zero_bit(pfl->dirty_map, nb_sectors, start);
+    bitmap_clear(pfl->dirty_map, start, end - start);
+
+    len = (end - start) << BDRV_SECTOR_BITS;
+    wb = g_new(PFlashWriteback, 1);
+    wb->pfl = pfl;
+    wb->buf = blk_blockalign(pfl->blk, len);
+    memcpy(wb->buf, pfl->storage + (start << BDRV_SECTOR_BITS), len);
+    qemu_iovec_init(&wb->qiov, 1);
+    qemu_iovec_add(&wb->qiov, wb->buf, len);
+
+    trace_pflash_writeback(pfl->name, start << BDRV_SECTOR_BITS, len);
+    pfl->flush_inflight = true;
+    blk_aio_pwritev(pfl->blk, start << BDRV_SECTOR_BITS, &wb->qiov, 0,
+                    pflash_flush_done, wb);
+}
+
+static void pflash_flush_timer(void *opaque)
+{
+    PFlashCFI02 *pfl = opaque;
+
+    if (pfl->flush_inflight) {
+        /* Try again once the current write-back is done */
+        timer_mod(&pfl->flush_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + pfl->writeback_ms);
+        return;
+    }
+    pflash_flush(pfl);
+}
+
+static void pflash_vm_state_change(void *opaque, bool running,
+                                   RunState state)
+{
+    PFlashCFI02 *pfl = opaque;
+
+    /*
+     * The block layer is drained right after this, which completes the
+     * write-back started here; its completion starts the next run.
+     */
+    if (!running) {
+        pflash_flush(pfl);
+    }
+}
+
 /* update flash content on disk */
 static void pflash_update(PFlashCFI02 *pfl, int offset, int size)
 {
     int offset_end;
     int ret;
-    if (pfl->blk) {
+    if (pfl->blk && pfl->dirty_map) {
+        offset_end = offset + size;
+        bitmap_set(pfl->dirty_map, offset >> BDRV_SECTOR_BITS,
+                   DIV_ROUND_UP(offset_end, BDRV_SECTOR_SIZE) -
+                   (offset >> BDRV_SECTOR_BITS));
+        if (!timer_pending(&pfl->flush_timer)) {
+            timer_mod(&pfl->flush_timer,
+                      qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                      pfl->writeback_ms);
+        }
+    } else if (pfl->blk) {
         offset_end = offset + size;
         /* widen to sector boundaries */
         offset = QEMU_ALIGN_DOWN(offset, BDRV_SECTOR_SIZE);
@@ -419,8 +645,11 @@ static void pflash_sector_erase(PFlashCFI02 *pfl, hwaddr offset)
     if (!pfl->ro) {
         uint8_t *p = pfl->storage;
         memset(p + offset, 0xff, sector_len);
+        pflash_storage_changed(pfl, offset, sector_len);
         pflash_update(pfl, offset, sector_len);
     }
+    /* Erasing sectors report their status wherever they are read. */
+    pflash_mode_chip_io(pfl);
     set_dq7(pfl, 0x00);
     ++pfl->sectors_to_erase;
     set_bit(sector_info.num, pfl->sector_erase_map);
@@ -462,16 +691,14 @@ static void pflash_write(void *opaque, hwaddr offset, uint64_t value,
     boff &= 0x7FF;
     switch (pfl->wcycle) {
     case 0:
-        /* Set the device in I/O access mode if required */
-        if (pfl->rom_mode) {
-            pfl->rom_mode = false;
-            memory_region_rom_device_set_romd(&pfl->orig_mem, false);
-        }
+        /* Set the addressed sector in I/O access mode if required */
+        pflash_mode_sector_io(pfl, offset);
         pfl->read_counter = 0;
         /* We're in read mode */
     check_unlock0:
         if (boff == 0x55 && cmd == 0x98) {
             /* Enter CFI query mode */
+            pflash_mode_chip_io(pfl);
             pfl->wcycle = WCYCLE_CFI;
             pfl->cmd = 0x98;
             return;
@@ -480,6 +707,7 @@ static void pflash_write(void *opaque, hwaddr offset, uint64_t value,
         if (cmd == 0x30) { /* Erase Resume */
             if (pflash_erase_suspend_mode(pfl)) {
                 /* Resume the erase. */
+                pflash_mode_chip_io(pfl);
                 timer_mod(&pfl->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
                           pfl->erase_time_remaining);
                 pfl->erase_time_remaining = 0;
@@ -521,8 +749,11 @@ static void pflash_write(void *opaque, hwaddr offset, uint64_t value,
         case 0x20:
             pfl->bypass = 1;
             goto do_bypass;
-        case 0x80: /* Erase */
         case 0x90: /* Autoselect */
+            /* Identification data can be read back anywhere. */
+            pflash_mode_chip_io(pfl);
+            /* fall through */
+        case 0x80: /* Erase */
         case 0xA0: /* Program */
             pfl->cmd = cmd;
             trace_pflash_write_start(pfl->name, cmd);
@@ -547,6 +778,7 @@ static void pflash_write(void *opaque, hwaddr offset, uint64_t value,
                 goto reset_flash;
             }
             trace_pflash_data_write(pfl->name, offset, width, value, 0);
+            pflash_mode_sector_io(pfl, offset);
             if (!pfl->ro) {
                 p = (uint8_t *)pfl->storage + offset;
                 if (pfl->be) {
@@ -556,6 +788,7 @@ static void pflash_write(void *opaque, hwaddr offset, uint64_t value,
                     uint64_t current = ldn_le_p(p, width);
                     stn_le_p(p, width, current & value);
                 }
+                pflash_storage_changed(pfl, offset, width);
                 pflash_update(pfl, offset, width);
             }
             /*
@@ -616,12 +849,13 @@ static void pflash_write(void *opaque, hwaddr offset, uint64_t value,
             trace_pflash_chip_erase_start(pfl->name);
             if (!pfl->ro) {
                 memset(pfl->storage, 0xff, pfl->chip_len);
+                pflash_storage_changed(pfl, 0, pfl->chip_len);
                 pflash_update(pfl, 0, pfl->chip_len);
             }
+            pflash_mode_chip_io(pfl);
             set_dq7(pfl, 0x00);
-            /* Wait the time specified at CFI address 0x22. */
             timer_mod(&pfl->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
-                      (1ULL << pfl->cfi_table[0x22]) * SCALE_MS);
+                      pflash_chip_erase_time(pfl));
             break;
         case 0x30: /* Sector erase */
             pflash_sector_erase(pfl, offset);
@@ -714,6 +948,30 @@ static const MemoryRegionOps pflash_cfi02_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+static uint64_t pflash_sector_read(void *opaque, hwaddr offset,
+                                   unsigned int width)
+{
+    PFlashCFI02 *pfl = opaque;
+
+    return pflash_read(pfl, pfl->sector_mem_base + offset, width);
+}
+
+static void pflash_sector_write(void *opaque, hwaddr offset, uint64_t value,
+                                unsigned int width)
+{
+    PFlashCFI02 *pfl = opaque;
+
+    pflash_write(pfl, pfl->sector_mem_base + offset, value, width);
+}
+
+static const MemoryRegionOps pflash_cfi02_sector_ops = {
+    .read = pflash_sector_read,
+    .write = pflash_sector_write,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
 static void pflash_cfi02_fill_cfi_table(PFlashCFI02 *pfl, int nb_regions)
 {
     /* Hardcoded CFI table (mostly from SG29 Spansion flash) */
@@ -880,15 +1138,54 @@ static void pflash_cfi02_realize(DeviceState *dev, Error **errp)
         return;
     }
 
-    memory_region_init_rom_device(&pfl->orig_mem, OBJECT(pfl),
-                                  &pflash_cfi02_ops, pfl, pfl->name,
-                                  pfl->chip_len, errp);
-    if (*errp) {
+    if (pfl->rom_file) {
+#ifdef CONFIG_POSIX
+        int fd;
+
+        if (pfl->blk) {
+            error_setg(errp, "attributes \"drive\" and \"rom-file\" "
+                       "are mutually exclusive.");
+            return;
+        }
+        /*
+         * Map the image copy-on-write: instances using the same file share
+         * its pages until the guest programs or erases a sector.
+         */
+        fd = qemu_open(pfl->rom_file, O_RDONLY, errp);
+        if (fd < 0) {
+            return;
+        }
+        memory_region_init_rom_device_from_fd(&pfl->orig_mem, OBJECT(pfl),
+                                              &pflash_cfi02_ops, pfl,
+                                              pfl->name, pfl->chip_len,
+                                              fd, errp);
+        if (*errp) {
+            qemu_close(fd);
+            error_prepend(errp, "Couldn't map \"%s\": ", pfl->rom_file);
+            return;
+        }
+#else
+        error_setg(errp, "attribute \"rom-file\" is not supported "
+                   "on this host.");
         return;
+#endif
+    } else {
+        memory_region_init_rom_device(&pfl->orig_mem, OBJECT(pfl),
+                                      &pflash_cfi02_ops, pfl, pfl->name,
+                                      pfl->chip_len, errp);
+        if (*errp) {
+            return;
+        }
     }
 
     pfl->storage = memory_region_get_ram_ptr(&pfl->orig_mem);
 
+    memory_region_init_io(&pfl->sector_mem, OBJECT(pfl),
+                          &pflash_cfi02_sector_ops, pfl, "pflash-sector",
+                          pfl->sector_len[0]);
+    memory_region_set_enabled(&pfl->sector_mem, false);
+    memory_region_add_subregion_overlap(&pfl->orig_mem, 0, &pfl->sector_mem, 1);
+
     if (pfl->blk) {
         uint64_t perm;
         pfl->ro = !blk_supports_write_perm(pfl->blk);
@@ -927,6 +1224,14 @@ static void pflash_cfi02_realize(DeviceState *dev, Error **errp)
     timer_init_ns(&pfl->timer, QEMU_CLOCK_VIRTUAL, pflash_timer, pfl);
     pfl->status = 0;
 
+    if (pfl->blk && !pfl->ro && pfl->writeback_ms) {
+        pfl->dirty_map = bitmap_new(pfl->chip_len >> BDRV_SECTOR_BITS);
+        timer_init_ms(&pfl->flush_timer, QEMU_CLOCK_REALTIME,
+                      pflash_flush_timer, pfl);
+        pfl->vmstate = qemu_add_vm_change_state_handler(pflash_vm_state_change,
+                                                        pfl);
+    }
+
     pflash_cfi02_fill_cfi_table(pfl, nb_regions);
 }
 
@@ -959,6 +1264,20 @@ static Property pflash_cfi02_properties[] = {
     DEFINE_PROP_UINT16("unlock-addr0", PFlashCFI02, unlock_addr0, 0),
     DEFINE_PROP_UINT16("unlock-addr1", PFlashCFI02, unlock_addr1, 0),
     DEFINE_PROP_STRING("name", PFlashCFI02, name),
+    DEFINE_PROP_STRING("rom-file", PFlashCFI02, rom_file),
+    /*
+     * Erase operations normally take the time the CFI table announces,
+     * in virtual time, which without icount means waiting for it.  Set
+     * this to complete them as soon as the sector erase timeout expires.
+     */
+    DEFINE_PROP_BOOL("fast-erase", PFlashCFI02, fast_erase, false),
+    /*
+     * Programmed data is normally written to the drive right away, from
+     * the vCPU thread.  Set this to write it back asynchronously instead,
+     * this many milliseconds after it was first programmed, when an
+     * erase completes, and when the VM stops.
+     */
+    DEFINE_PROP_UINT32("writeback-ms", PFlashCFI02, writeback_ms, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -967,6 +1286,16 @@ static void pflash_cfi02_unrealize(DeviceState *dev)
     PFlashCFI02 *pfl = PFLASH_CFI02(dev);
     timer_del(&pfl->timer);
     g_free(pfl->sector_erase_map);
+
+    if (pfl->dirty_map) {
+        qemu_del_vm_change_state_handler(pfl->vmstate);
+        timer_del(&pfl->flush_timer);
+        do {
+            blk_drain(pfl->blk);
+            pflash_flush(pfl);
+        } while (pfl->flush_inflight);
+        g_free(pfl->dirty_map);
+    }
 }
 
 static void pflash_cfi02_class_init(ObjectClass *klass, void *data)
@@ -994,6 +1323,11 @@ static void pflash_cfi02_register_types(void)
 
 type_init(pflash_cfi02_register_types)
 
+MemoryRegion *pflash_cfi02_get_memory(PFlashCFI02 *fl)
+{
+    return &fl->orig_mem;
+}
+
 PFlashCFI02 *pflash_cfi02_register(hwaddr base,
                                    const char *name,
                                    hwaddr size,
@@ -1242,6 +1242,9 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
                          conf->conf.lcyls,
                          conf->conf.lheads,
                          conf->conf.lsecs);
+
+    /* Keep a coroutine around for every other descriptor of the queues */
+    qemu_coroutine_inc_pool_size(conf->num_queues * conf->queue_size / 2);
 }
 
 static void virtio_blk_device_unrealize(DeviceState *dev)
@@ -1252,6 +1255,7 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
     unsigned i;
 
     blk_drain(s->blk);
+    qemu_coroutine_dec_pool_size(conf->num_queues * conf->queue_size / 2);
     del_boot_device_lchs(dev, "/disk@0,0");
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
@@ -28,12 +28,16 @@
 
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
+#include "hw/irq.h"
 #include "migration/vmstate.h"
 #include "chardev/char-fe.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
 
 #include "hw/char/digic-uart.h"
+#include "hw/misc/digic-mmio-stats.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
 
@@ -42,6 +46,101 @@ enum {
     ST_TX_RDY = (1 << 1),
 };
 
+/* Delay between the first byte queued in the TX FIFO and its flush. */
+#define DIGIC_UART_FLUSH_INTERVAL_NS (1 * SCALE_MS)
+
+#define DIGIC_UART_FIFO_DEPTH_MAX 4096
+
+static bool digic_uart_fifo_enabled(DigicUartState *s)
+{
+    return s->fifo_depth > 0;
+}
+
+/*
+ * In FIFO mode the status bits reflect the FIFO levels: RX is ready
+ * while any byte is pending, TX while there is room for another byte.
+ */
+static void digic_uart_update_status(DigicUartState *s)
+{
+    s->reg_st &= ~(ST_RX_RDY | ST_TX_RDY);
+    if (!fifo8_is_empty(&s->rx_fifo)) {
+        s->reg_st |= ST_RX_RDY;
+    }
+    if (s->tx_count < s->fifo_depth) {
+        s->reg_st |= ST_TX_RDY;
+    }
+}
+
+static void digic_uart_update_irq(DigicUartState *s)
+{
+    qemu_set_irq(s->irq, s->reg_st & ST_RX_RDY);
+}
+
+static gboolean digic_uart_xmit(void *do_not_use, GIOCondition cond,
+                                void *opaque)
+{
+    DigicUartState *s = opaque;
+    int ret;
+
+    s->watch_tag = 0;
+
+    /* instant drain the fifo when there's no back-end */
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        s->tx_count = 0;
+        goto out;
+    }
+
+    if (!s->tx_count) {
+        goto out;
+    }
+
+    ret = qemu_chr_fe_write(&s->chr, s->tx_fifo, s->tx_count);
+    if (ret > 0) {
+        s->tx_count -= ret;
+        memmove(s->tx_fifo, s->tx_fifo + ret, s->tx_count);
+    }
+
+    if (s->tx_count) {
+        s->watch_tag = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                             digic_uart_xmit, s);
+        if (!s->watch_tag) {
+            s->tx_count = 0;
+        }
+    }
+
+out:
+    digic_uart_update_status(s);
+    return FALSE;
+}
+
+static void digic_uart_flush_timer(void *opaque)
+{
+    DigicUartState *s = opaque;
+
+    if (!s->watch_tag) {
+        digic_uart_xmit(NULL, G_IO_OUT, s);
+    }
+}
+
+static void digic_uart_fifo_tx(DigicUartState *s, uint8_t ch)
+{
+    if (s->tx_count == s->fifo_depth) {
+        /* The guest ignored ST_TX_RDY; drop the byte like the hardware. */
+        qemu_log_mask(LOG_GUEST_ERROR, "digic-uart: TX FIFO overrun\n");
+        return;
+    }
+
+    s->tx_fifo[s->tx_count++] = ch;
+    if (s->tx_count == s->fifo_depth) {
+        timer_del(s->flush_timer);
+        digic_uart_flush_timer(s);
+    } else if (!timer_pending(s->flush_timer)) {
+        timer_mod(s->flush_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  DIGIC_UART_FLUSH_INTERVAL_NS);
+    }
+    digic_uart_update_status(s);
+}
+
 static uint64_t digic_uart_read(void *opaque, hwaddr addr,
                                 unsigned size)
 {
@@ -52,7 +151,18 @@ static uint64_t digic_uart_read(void *opaque, hwaddr addr,
 
     switch (addr) {
     case R_RX:
+        if (digic_uart_fifo_enabled(s)) {
+            if (!fifo8_is_empty(&s->rx_fifo)) {
+                s->reg_rx = fifo8_pop(&s->rx_fifo);
+            }
+            digic_uart_update_status(s);
+            digic_uart_update_irq(s);
+            qemu_chr_fe_accept_input(&s->chr);
+            ret = s->reg_rx;
+            break;
+        }
         s->reg_st &= ~(ST_RX_RDY);
+        digic_uart_update_irq(s);
         ret = s->reg_rx;
         break;
 
@@ -61,6 +171,7 @@ static uint64_t digic_uart_read(void *opaque, hwaddr addr,
         break;
 
     default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), false);
         qemu_log_mask(LOG_UNIMP,
                       "digic-uart: read access to unknown register 0x"
                       TARGET_FMT_plx "\n", addr << 2);
@@ -79,6 +190,10 @@ static void digic_uart_write(void *opaque, hwaddr addr, uint64_t value,
 
     switch (addr) {
     case R_TX:
+        if (digic_uart_fifo_enabled(s)) {
+            digic_uart_fifo_tx(s, ch);
+            break;
+        }
         /* XXX this blocks entire thread. Rewrite to use
          * qemu_chr_fe_write and background I/O callbacks */
         qemu_chr_fe_write_all(&s->chr, &ch, 1);
@@ -99,6 +214,7 @@ static void digic_uart_write(void *opaque, hwaddr addr, uint64_t value,
         break;
 
     default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), true);
         qemu_log_mask(LOG_UNIMP,
                       "digic-uart: write access to unknown register 0x"
                       TARGET_FMT_plx "\n", addr << 2);
@@ -119,6 +235,10 @@ static int uart_can_rx(void *opaque)
 {
     DigicUartState *s = opaque;
 
+    if (digic_uart_fifo_enabled(s)) {
+        return fifo8_num_free(&s->rx_fifo);
+    }
+
     return !(s->reg_st & ST_RX_RDY);
 }
 
@@ -128,8 +248,16 @@ static void uart_rx(void *opaque, const uint8_t *buf, int size)
 
     assert(uart_can_rx(opaque));
 
+    if (digic_uart_fifo_enabled(s)) {
+        fifo8_push_all(&s->rx_fifo, buf, size);
+        digic_uart_update_status(s);
+        digic_uart_update_irq(s);
+        return;
+    }
+
     s->reg_st |= ST_RX_RDY;
     s->reg_rx = *buf;
+    digic_uart_update_irq(s);
 }
 
 static void uart_event(void *opaque, QEMUChrEvent event)
@@ -142,16 +270,51 @@ static void digic_uart_reset(DeviceState *d)
 
     s->reg_rx = 0;
     s->reg_st = ST_TX_RDY;
+
+    if (digic_uart_fifo_enabled(s)) {
+        timer_del(s->flush_timer);
+        fifo8_reset(&s->rx_fifo);
+        s->tx_count = 0;
+    }
+    digic_uart_update_irq(s);
 }
 
 static void digic_uart_realize(DeviceState *dev, Error **errp)
 {
     DigicUartState *s = DIGIC_UART(dev);
 
+    if (s->fifo_depth > DIGIC_UART_FIFO_DEPTH_MAX) {
+        error_setg(errp, "fifo-depth must be at most %d",
+                   DIGIC_UART_FIFO_DEPTH_MAX);
+        return;
+    }
+
+    if (digic_uart_fifo_enabled(s)) {
+        fifo8_create(&s->rx_fifo, s->fifo_depth);
+        s->tx_fifo = g_malloc(s->fifo_depth);
+        s->flush_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                      digic_uart_flush_timer, s);
+    }
+
     qemu_chr_fe_set_handlers(&s->chr, uart_can_rx, uart_rx,
                              uart_event, NULL, s, NULL, true);
 }
 
+static void digic_uart_unrealize(DeviceState *dev)
+{
+    DigicUartState *s = DIGIC_UART(dev);
+
+    if (digic_uart_fifo_enabled(s)) {
+        if (s->watch_tag) {
+            g_source_remove(s->watch_tag);
+            s->watch_tag = 0;
+        }
+        timer_free(s->flush_timer);
+        g_free(s->tx_fifo);
+        fifo8_destroy(&s->rx_fifo);
+    }
+}
+
 static void digic_uart_init(Object *obj)
 {
     DigicUartState *s = DIGIC_UART(obj);
@@ -159,8 +322,48 @@ static void digic_uart_init(Object *obj)
     memory_region_init_io(&s->regs_region, OBJECT(s), &uart_mmio_ops, s,
                           TYPE_DIGIC_UART, 0x18);
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->regs_region);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+}
+
+static bool digic_uart_fifo_needed(void *opaque)
+{
+    return digic_uart_fifo_enabled(opaque);
 }
 
+static bool digic_uart_tx_count_valid(void *opaque, int version_id)
+{
+    DigicUartState *s = opaque;
+
+    return s->tx_count <= s->fifo_depth;
+}
+
+static int digic_uart_fifo_post_load(void *opaque, int version_id)
+{
+    DigicUartState *s = opaque;
+
+    if (s->tx_count) {
+        timer_mod(s->flush_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  DIGIC_UART_FLUSH_INTERVAL_NS);
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_digic_uart_fifo = {
+    .name = "digic-uart/fifo",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = digic_uart_fifo_needed,
+    .post_load = digic_uart_fifo_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_FIFO8(rx_fifo, DigicUartState),
+        VMSTATE_UINT32(tx_count, DigicUartState),
+        VMSTATE_VALIDATE("tx_count within fifo-depth",
+                         digic_uart_tx_count_valid),
+        VMSTATE_VBUFFER_UINT32(tx_fifo, DigicUartState, 1, NULL, tx_count),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_digic_uart = {
     .name = "digic-uart",
     .version_id = 1,
@@ -169,11 +372,20 @@ static const VMStateDescription vmstate_digic_uart = {
         VMSTATE_UINT32(reg_rx, DigicUartState),
         VMSTATE_UINT32(reg_st, DigicUartState),
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_digic_uart_fifo,
+        NULL
     }
 };
 
 static Property digic_uart_properties[] = {
     DEFINE_PROP_CHR("chardev", DigicUartState, chr),
+    /*
+     * A non-zero depth buffers TX bytes and flushes them to the chardev
+     * in batches, and lets RX accept bursts of up to that many bytes.
+     */
+    DEFINE_PROP_UINT32("fifo-depth", DigicUartState, fifo_depth, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -182,6 +394,7 @@ static void digic_uart_class_init(ObjectClass *klass, void *data)
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = digic_uart_realize;
+    dc->unrealize = digic_uart_unrealize;
     dc->reset = digic_uart_reset;
     dc->vmsd = &vmstate_digic_uart;
     device_class_set_props(dc, digic_uart_properties);
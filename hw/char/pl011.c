@@ -90,6 +90,8 @@ static uint64_t pl011_read(void *opaque, hwaddr offset,
 
     switch (offset >> 2) {
     case 0: /* UARTDR */
+        /* Reading the FIFO updates the interrupts and the chardev */
+        memory_region_take_bql(&s->iomem);
         s->flags &= ~PL011_FLAG_RXFF;
         c = s->read_fifo[s->read_pos];
         if (s->read_count > 0) {
@@ -105,7 +107,10 @@ static uint64_t pl011_read(void *opaque, hwaddr offset,
         trace_pl011_read_fifo(s->read_count);
         s->rsr = c >> 8;
         pl011_update(s);
+        /* This can call back into pl011_receive() */
+        qemu_mutex_unlock(&s->lock);
         qemu_chr_fe_accept_input(&s->chr);
+        qemu_mutex_lock(&s->lock);
         r = c;
         break;
     case 1: /* UARTRSR */
@@ -273,6 +278,7 @@ static int pl011_can_receive(void *opaque)
     PL011State *s = (PL011State *)opaque;
     int r;
 
+    /* Like all writers, we hold the BQL; no need for the lock to read */
     if (s->lcr & 0x10) {
         r = s->read_count < 16;
     } else {
@@ -287,6 +293,8 @@ static void pl011_put_fifo(void *opaque, uint32_t value)
     PL011State *s = (PL011State *)opaque;
     int slot;
 
+    qemu_mutex_lock(&s->lock);
+
     slot = s->read_pos + s->read_count;
     if (slot >= 16)
         slot -= 16;
@@ -302,6 +310,7 @@ static void pl011_put_fifo(void *opaque, uint32_t value)
         s->int_level |= PL011_INT_RX;
         pl011_update(s);
     }
+    qemu_mutex_unlock(&s->lock);
 }
 
 static void pl011_receive(void *opaque, const uint8_t *buf, int size)
@@ -387,7 +396,9 @@ static void pl011_init(Object *obj)
     PL011State *s = PL011(obj);
     int i;
 
+    qemu_mutex_init(&s->lock);
     memory_region_init_io(&s->iomem, OBJECT(s), &pl011_ops, s, "pl011", 0x1000);
+    memory_region_set_lock(&s->iomem, &s->lock);
     sysbus_init_mmio(sbd, &s->iomem);
     for (i = 0; i < ARRAY_SIZE(s->irq); i++) {
         sysbus_init_irq(sbd, &s->irq[i]);
@@ -404,6 +415,13 @@ static void pl011_init(Object *obj)
     s->id = pl011_id_arm;
 }
 
+static void pl011_finalize(Object *obj)
+{
+    PL011State *s = PL011(obj);
+
+    qemu_mutex_destroy(&s->lock);
+}
+
 static void pl011_realize(DeviceState *dev, Error **errp)
 {
     PL011State *s = PL011(dev);
@@ -426,6 +444,7 @@ static const TypeInfo pl011_arm_info = {
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(PL011State),
     .instance_init = pl011_init,
+    .instance_finalize = pl011_finalize,
     .class_init    = pl011_class_init,
 };
 
@@ -76,6 +76,7 @@ void cpu_reset_interrupt(CPUState *cpu, int mask)
         qemu_mutex_lock_iothread();
     }
     cpu->interrupt_request &= ~mask;
+    cpu->lockstep_interrupt &= ~mask;
     if (need_lock) {
         qemu_mutex_unlock_iothread();
     }
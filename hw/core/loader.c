@@ -62,6 +62,7 @@
 #include "hw/boards.h"
 #include "qemu/cutils.h"
 #include "sysemu/runstate.h"
+#include "sysemu/tcg.h"
 
 #include <zlib.h>
 
@@ -509,6 +510,125 @@ ssize_t load_elf_ram_sym(const char *filename,
     return ret;
 }
 
+typedef struct SymbolMapEntry {
+    uint64_t addr;
+    uint64_t size;
+    char *name;
+} SymbolMapEntry;
+
+typedef struct SymbolMap {
+    struct syminfo info;
+    SymbolMapEntry *syms;
+} SymbolMap;
+
+static int symbol_map_cmp(const void *a, const void *b)
+{
+    const SymbolMapEntry *sa = a, *sb = b;
+
+    return sa->addr < sb->addr ? -1 : sa->addr > sb->addr;
+}
+
+static int symbol_map_find(const void *key, const void *elt)
+{
+    hwaddr addr = *(const hwaddr *)key;
+    const SymbolMapEntry *sym = elt;
+
+    if (addr < sym->addr) {
+        return -1;
+    }
+    return addr - sym->addr >= sym->size;
+}
+
+static const char *symbol_map_lookup(struct syminfo *s, hwaddr orig_addr)
+{
+    SymbolMap *map = container_of(s, SymbolMap, info);
+    SymbolMapEntry *sym;
+
+    sym = bsearch(&orig_addr, map->syms, s->disas_num_syms,
+                  sizeof(*map->syms), symbol_map_find);
+    return sym ? sym->name : "";
+}
+
+bool load_symbol_map(const char *filename, Error **errp)
+{
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    g_autoptr(GError) gerr = NULL;
+    g_autoptr(GArray) syms = g_array_new(false, false,
+                                         sizeof(SymbolMapEntry));
+    SymbolMapEntry *sym;
+    SymbolMap *map;
+    unsigned i, n;
+
+    if (!g_file_get_contents(filename, &contents, NULL, &gerr)) {
+        error_setg(errp, "Couldn't read symbol map '%s': %s",
+                   filename, gerr->message);
+        return false;
+    }
+
+    lines = g_strsplit(contents, "\n", -1);
+    for (i = 0; lines[i]; i++) {
+        g_auto(GStrv) fields = g_strsplit_set(g_strstrip(lines[i]),
+                                              " \t", -1);
+        const char *f[3];
+        SymbolMapEntry e = { };
+        char **p;
+
+        if (!*lines[i] || *lines[i] == '#') {
+            continue;
+        }
+        for (n = 0, p = fields; *p; p++) {
+            if (**p && n < ARRAY_SIZE(f)) {
+                f[n] = *p;
+            }
+            n += !!**p;
+        }
+        if (n < 2 || n > 3 ||
+            qemu_strtou64(f[0], NULL, 16, &e.addr) < 0 ||
+            (n == 3 && qemu_strtou64(f[1], NULL, 16, &e.size) < 0)) {
+            error_setg(errp, "%s:%u: expected an address, an optional size "
+                       "and a name", filename, i + 1);
+            goto fail;
+        }
+        e.name = g_strdup(f[n - 1]);
+        g_array_append_val(syms, e);
+    }
+
+    if (!syms->len) {
+        return true;
+    }
+
+    /*
+     * Sizeless symbols extend to the next one, the last one to itself.
+     * Symbols are clipped where the next one starts, so that the ranges
+     * don't overlap and can be binary searched.
+     */
+    g_array_sort(syms, symbol_map_cmp);
+    for (i = 0; i < syms->len; i++) {
+        sym = &g_array_index(syms, SymbolMapEntry, i);
+        if (i + 1 < syms->len &&
+            (!sym->size || sym->size > sym[1].addr - sym->addr)) {
+            sym->size = sym[1].addr - sym->addr;
+        } else if (!sym->size) {
+            sym->size = 1;
+        }
+    }
+
+    map = g_new0(SymbolMap, 1);
+    map->info.lookup_symbol = symbol_map_lookup;
+    map->info.disas_num_syms = syms->len;
+    map->syms = (SymbolMapEntry *)g_array_free(g_steal_pointer(&syms), false);
+    map->info.next = syminfos;
+    syminfos = &map->info;
+    return true;
+
+ fail:
+    for (n = 0; n < syms->len; n++) {
+        g_free(g_array_index(syms, SymbolMapEntry, n).name);
+    }
+    return false;
+}
+
 static void bswap_uboot_header(uboot_image_header_t *hdr)
 {
 #ifndef HOST_WORDS_BIGENDIAN
@@ -863,6 +983,16 @@ struct Rom {
     char *fw_dir;
     char *fw_file;
     GMappedFile *mapped_file;
+    /* If not NULL, "data" is shared with the other Roms with this blob */
+    GBytes *blob;
+
+    /*
+     * The RAM the data is copied to on reset, if its writes are tracked
+     * through the dirty log, and whether it still holds the data.
+     */
+    MemoryRegion *dirty_mr;
+    hwaddr dirty_offset;
+    bool in_place;
 
     bool committed;
 
@@ -874,7 +1004,49 @@ static FWCfgState *fw_cfg;
 static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
 
 /*
- * rom->data can be heap-allocated or memory-mapped (e.g. when added with
+ * Identical blobs, such as the same image added for each instance of a
+ * device, share their data.  The table maps each blob to the number of
+ * Roms using it.
+ */
+static GHashTable *rom_blobs;
+
+static GBytes *rom_blob_get(const void *data, size_t len)
+{
+    GBytes *blob = g_bytes_new(data, len);
+    gpointer orig, users;
+
+    if (!rom_blobs) {
+        rom_blobs = g_hash_table_new_full(g_bytes_hash, g_bytes_equal,
+                                          (GDestroyNotify)g_bytes_unref,
+                                          NULL);
+    }
+    if (g_hash_table_lookup_extended(rom_blobs, blob, &orig, &users)) {
+        g_bytes_unref(blob);
+        blob = orig;
+        /* The table keeps its key and drops the new reference */
+        g_hash_table_insert(rom_blobs, g_bytes_ref(blob),
+                            GUINT_TO_POINTER(GPOINTER_TO_UINT(users) + 1));
+    } else {
+        g_hash_table_insert(rom_blobs, blob, GUINT_TO_POINTER(1));
+    }
+    return blob;
+}
+
+static void rom_blob_put(GBytes *blob)
+{
+    unsigned users = GPOINTER_TO_UINT(g_hash_table_lookup(rom_blobs, blob));
+
+    if (users > 1) {
+        g_hash_table_insert(rom_blobs, g_bytes_ref(blob),
+                            GUINT_TO_POINTER(users - 1));
+    } else {
+        g_hash_table_remove(rom_blobs, blob);
+    }
+}
+
+/*
+ * rom->data can be heap-allocated, shared with other Roms or
+ * memory-mapped (e.g. when added with rom_add_file() or
  * rom_add_elf_program())
  */
 static void rom_free_data(Rom *rom)
@@ -882,6 +1054,9 @@ static void rom_free_data(Rom *rom)
     if (rom->mapped_file) {
         g_mapped_file_unref(rom->mapped_file);
         rom->mapped_file = NULL;
+    } else if (rom->blob) {
+        rom_blob_put(rom->blob);
+        rom->blob = NULL;
     } else {
         g_free(rom->data);
     }
@@ -889,6 +1064,20 @@ static void rom_free_data(Rom *rom)
     rom->data = NULL;
 }
 
+/*
+ * Give @rom data of its own, before handing it out to callers that may
+ * patch it.  A mapped file is private already.
+ */
+static void rom_unshare_data(Rom *rom)
+{
+    if (rom->blob) {
+        uint8_t *data = g_memdup(rom->data, rom->datasize);
+
+        rom_free_data(rom);
+        rom->data = data;
+    }
+}
+
 static void rom_free(Rom *rom)
 {
     rom_free_data(rom);
@@ -1001,13 +1190,32 @@ int rom_add_file(const char *file, const char *fw_dir,
     }
 
     rom->datasize = rom->romsize;
-    rom->data     = g_malloc0(rom->datasize);
-    lseek(fd, 0, SEEK_SET);
-    rc = read(fd, rom->data, rom->datasize);
-    if (rc != rom->datasize) {
-        fprintf(stderr, "rom: file %-20s: read error: rc=%d (expected %zd)\n",
-                rom->name, rc, rom->datasize);
-        goto err;
+
+    /*
+     * Map the file rather than reading it, so that its pages are only
+     * read in when used and shared with every other process running the
+     * same image.  The mapping is private, as callers of rom_ptr() may
+     * patch the data.
+     */
+    rom->mapped_file = rom->datasize ?
+                       g_mapped_file_new_from_fd(fd, true, NULL) : NULL;
+    if (rom->mapped_file &&
+        g_mapped_file_get_length(rom->mapped_file) == rom->datasize) {
+        rom->data = (uint8_t *)g_mapped_file_get_contents(rom->mapped_file);
+    } else {
+        if (rom->mapped_file) {
+            g_mapped_file_unref(rom->mapped_file);
+            rom->mapped_file = NULL;
+        }
+        rom->data = g_malloc0(rom->datasize);
+        lseek(fd, 0, SEEK_SET);
+        rc = read(fd, rom->data, rom->datasize);
+        if (rc != rom->datasize) {
+            fprintf(stderr,
+                    "rom: file %-20s: read error: rc=%d (expected %zd)\n",
+                    rom->name, rc, rom->datasize);
+            goto err;
+        }
     }
     close(fd);
     rom_insert(rom);
@@ -1069,8 +1277,14 @@ MemoryRegion *rom_add_blob(const char *name, const void *blob, size_t len,
     rom->romsize  = max_len ? max_len : len;
     rom->datasize = len;
     g_assert(rom->romsize >= rom->datasize);
-    rom->data     = g_malloc0(rom->datasize);
-    memcpy(rom->data, blob, len);
+    if (fw_file_name && fw_cfg) {
+        /* fw_cfg may hand the data out, even to guest writes */
+        rom->data = g_malloc0(rom->datasize);
+        memcpy(rom->data, blob, len);
+    } else {
+        rom->blob = rom_blob_get(blob, len);
+        rom->data = (uint8_t *)g_bytes_get_data(rom->blob, NULL);
+    }
     rom_insert(rom);
     if (fw_file_name && fw_cfg) {
         char devpath[100];
@@ -1161,6 +1375,23 @@ static void rom_reset(void *unused)
         if (rom->data == NULL) {
             continue;
         }
+
+        /*
+         * Skip the copy if the guest didn't write to the RAM since the
+         * last one, which keeps the pages of copy-on-write RAM shared.
+         */
+        if (rom->dirty_mr) {
+            bool dirty = memory_region_test_and_clear_dirty(rom->dirty_mr,
+                                                            rom->dirty_offset,
+                                                            rom->datasize,
+                                                            DIRTY_MEMORY_ROM);
+
+            if (rom->in_place && !dirty) {
+                trace_loader_skip_rom(rom->name, rom->addr, rom->datasize);
+                continue;
+            }
+        }
+
         if (rom->mr) {
             void *host = memory_region_get_ram_ptr(rom->mr);
             memcpy(host, rom->data, rom->datasize);
@@ -1180,10 +1411,73 @@ static void rom_reset(void *unused)
          */
         cpu_flush_icache_range(rom->addr, rom->datasize);
 
+        /* Our own write doesn't count as a guest modification */
+        if (rom->dirty_mr) {
+            memory_region_reset_dirty(rom->dirty_mr, rom->dirty_offset,
+                                      rom->datasize, DIRTY_MEMORY_ROM);
+            rom->in_place = true;
+        }
+
         trace_loader_write_rom(rom->name, rom->addr, rom->datasize, rom->isrom);
     }
 }
 
+/*
+ * Loading a snapshot, or anything else done to RAM while the VM is
+ * stopped, bypasses the dirty log, so copy the data again on the next
+ * reset.
+ */
+static void rom_vm_state_change(void *opaque, bool running, RunState state)
+{
+    Rom *rom;
+
+    if (running) {
+        QTAILQ_FOREACH(rom, &roms, next) {
+            rom->in_place = false;
+        }
+    }
+}
+
+/*
+ * Track guest writes to the RAM or ROM device that @rom is copied to on
+ * reset, through the DIRTY_MEMORY_ROM client.  Only TCG feeds it, for RAM
+ * at no cost until the memory is written to.  ROM devices must mark what
+ * they modify behind the back of the memory API as dirty.
+ */
+static bool rom_track_dirty(Rom *rom)
+{
+    MemoryRegionSection section;
+
+    if (!tcg_enabled() || rom->isrom || !rom->datasize) {
+        return false;
+    }
+
+    if (rom->mr) {
+        section = (MemoryRegionSection) {
+            .mr = rom->mr,
+            .size = int128_make64(memory_region_size(rom->mr)),
+        };
+        memory_region_ref(rom->mr);
+    } else {
+        section = memory_region_find(rom->as->root, rom->addr,
+                                     rom->datasize);
+    }
+    if (!section.mr) {
+        return false;
+    }
+    if (int128_lt(section.size, int128_make64(rom->datasize)) ||
+        !(memory_region_is_ram(section.mr) || section.mr->rom_device) ||
+        memory_region_is_ram_device(section.mr) ||
+        memory_region_is_rom(section.mr)) {
+        memory_region_unref(section.mr);
+        return false;
+    }
+
+    rom->dirty_mr = section.mr;
+    rom->dirty_offset = section.offset_within_region;
+    return true;
+}
+
 /* Return true if two consecutive ROMs in the ROM list overlap */
 static bool roms_overlap(Rom *last_rom, Rom *this_rom)
 {
@@ -1230,6 +1524,7 @@ int rom_check_and_register_reset(void)
     MemoryRegionSection section;
     Rom *rom, *last_rom = NULL;
     bool found_overlap = false;
+    bool tracked = false;
 
     QTAILQ_FOREACH(rom, &roms, next) {
         if (rom->fw_file) {
@@ -1250,11 +1545,15 @@ int rom_check_and_register_reset(void)
                                      rom->addr, 1);
         rom->isrom = int128_nz(section.size) && memory_region_is_rom(section.mr);
         memory_region_unref(section.mr);
+        tracked |= rom_track_dirty(rom);
     }
     if (found_overlap) {
         return -1;
     }
 
+    if (tracked) {
+        qemu_add_vm_change_state_handler(rom_vm_state_change, NULL);
+    }
     qemu_register_reset(rom_reset, NULL);
     roms_loaded = 1;
     return 0;
@@ -1398,6 +1697,7 @@ void *rom_ptr(hwaddr addr, size_t size)
     rom = find_rom(addr, size);
     if (!rom || !rom->data)
         return NULL;
+    rom_unshare_data(rom);
     return rom->data + (addr - rom->addr);
 }
 
@@ -33,6 +33,7 @@ struct ptimer_state
     QEMUTimer *timer;
     ptimer_cb callback;
     void *callback_opaque;
+    QemuMutex *lock;
     /*
      * These track whether we're in a transaction block, and if we
      * need to do a timer reload when the block finishes. They don't
@@ -158,6 +159,10 @@ static void ptimer_tick(void *opaque)
     ptimer_state *s = (ptimer_state *)opaque;
     bool trigger = true;
 
+    if (s->lock) {
+        qemu_mutex_lock(s->lock);
+    }
+
     /*
      * We perform all the tick actions within a begin/commit block
      * because the callback function that ptimer_trigger() calls
@@ -197,6 +202,10 @@ static void ptimer_tick(void *opaque)
     }
 
     ptimer_transaction_commit(s);
+
+    if (s->lock) {
+        qemu_mutex_unlock(s->lock);
+    }
 }
 
 uint64_t ptimer_get_count(ptimer_state *s)
@@ -479,6 +488,11 @@ ptimer_state *ptimer_init(ptimer_cb callback, void *callback_opaque,
     return s;
 }
 
+void ptimer_set_lock(ptimer_state *s, QemuMutex *lock)
+{
+    s->lock = lock;
+}
+
 void ptimer_free(ptimer_state *s)
 {
     timer_free(s->timer);
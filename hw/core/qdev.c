@@ -32,6 +32,7 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/visitor.h"
 #include "qemu/error-report.h"
+#include "qemu/log.h"
 #include "qemu/option.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
@@ -917,8 +918,24 @@ bool phase_check(MachineInitPhase phase)
 
 void phase_advance(MachineInitPhase phase)
 {
+    static const char *const names[] = {
+        [PHASE_MACHINE_CREATED] = "machine created",
+        [PHASE_ACCEL_CREATED] = "accelerator created",
+        [PHASE_MACHINE_INITIALIZED] = "machine initialized",
+        [PHASE_MACHINE_READY] = "machine ready",
+    };
+
     assert(machine_phase == phase - 1);
     machine_phase = phase;
+
+    if (qemu_loglevel_mask(LOG_STARTUP)) {
+        unsigned count;
+        int64_t time_us;
+
+        object_class_init_stats(&count, &time_us);
+        qemu_log_startup("%s, %u classes initialized (%.3f ms in class_init)",
+                         names[phase], count, time_us / 1000.0);
+    }
 }
 
 static const TypeInfo device_type_info = {
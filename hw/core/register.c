@@ -17,6 +17,7 @@
 
 #include "qemu/osdep.h"
 #include "hw/register.h"
+#include "qemu/host-utils.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 
@@ -176,20 +177,39 @@ void register_reset(RegisterInfo *reg)
     }
 }
 
-void register_write_memory(void *opaque, hwaddr addr,
-                           uint64_t value, unsigned size)
+static inline RegisterInfo *register_lookup(RegisterInfoArray *reg_array,
+                                            hwaddr addr, unsigned *flags)
 {
-    RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
-    uint64_t we;
+    uint64_t index = addr >> reg_array->data_shift;
+    RegisterDispatch *d;
     int i;
 
+    *flags = 0;
+    if (index >= reg_array->nb_dispatch) {
+        return NULL;
+    }
+    d = &reg_array->dispatch[index];
+    if (likely(!d->reg || d->reg->access->addr == addr)) {
+        *flags = d->flags;
+        return d->reg;
+    }
+
+    /* Another register at an unaligned address took the slot */
     for (i = 0; i < reg_array->num_elements; i++) {
         if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
+            return reg_array->r[i];
         }
     }
+    return NULL;
+}
+
+void register_write_memory(void *opaque, hwaddr addr,
+                           uint64_t value, unsigned size)
+{
+    RegisterInfoArray *reg_array = opaque;
+    unsigned flags;
+    RegisterInfo *reg = register_lookup(reg_array, addr, &flags);
+    uint64_t we;
 
     if (!reg) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unimplemented register " \
@@ -200,6 +220,17 @@ void register_write_memory(void *opaque, hwaddr addr,
     /* Generate appropriate write enable mask */
     we = register_enabled_mask(reg->data_size, size);
 
+    if (flags & REGISTER_DISPATCH_FAST_WRITE) {
+        /* What register_write() does when only @we restricts the write */
+        uint64_t new_val = (value & we) | (register_read_val(reg) & ~we);
+
+        register_write_val(reg, new_val);
+        if (reg->access->post_write) {
+            reg->access->post_write(reg, new_val);
+        }
+        return;
+    }
+
     register_write(reg, value, we, reg_array->prefix,
                    reg_array->debug);
 }
@@ -208,17 +239,10 @@ uint64_t register_read_memory(void *opaque, hwaddr addr,
                               unsigned size)
 {
     RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
+    unsigned flags;
+    RegisterInfo *reg = register_lookup(reg_array, addr, &flags);
     uint64_t read_val;
     uint64_t re;
-    int i;
-
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
-        }
-    }
 
     if (!reg) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s:  read to unimplemented register " \
@@ -229,12 +253,66 @@ uint64_t register_read_memory(void *opaque, hwaddr addr,
     /* Generate appropriate read enable mask */
     re = register_enabled_mask(reg->data_size, size);
 
-    read_val = register_read(reg, re, reg_array->prefix,
-                             reg_array->debug);
+    if (flags & REGISTER_DISPATCH_FAST_READ) {
+        read_val = register_read_val(reg) & re;
+    } else {
+        read_val = register_read(reg, re, reg_array->prefix,
+                                 reg_array->debug);
+    }
 
     return extract64(read_val, 0, size * 8);
 }
 
+/*
+ * Which accesses to @reg can bypass register_read() and register_write():
+ * those with no mask or hook to apply besides post_write, no debug output,
+ * and storage behind the register.
+ */
+static unsigned register_dispatch_flags(RegisterInfo *reg, bool debug)
+{
+    const RegisterAccessInfo *ac = reg->access;
+    unsigned flags = 0;
+
+    if (debug || !ac->name || !reg->data) {
+        return 0;
+    }
+    if (!ac->cor && !ac->post_read) {
+        flags |= REGISTER_DISPATCH_FAST_READ;
+    }
+    if (!ac->ro && !ac->w1c && !ac->rsvd && !ac->unimp && !ac->pre_write) {
+        flags |= REGISTER_DISPATCH_FAST_WRITE;
+    }
+    return flags;
+}
+
+static void register_init_dispatch(RegisterInfoArray *r_array,
+                                   int data_size)
+{
+    hwaddr max_addr = 0;
+    int i;
+
+    for (i = 0; i < r_array->num_elements; i++) {
+        max_addr = MAX(max_addr, r_array->r[i]->access->addr);
+    }
+
+    r_array->data_shift = ctz32(data_size);
+    r_array->nb_dispatch = r_array->num_elements ?
+                           (max_addr >> r_array->data_shift) + 1 : 0;
+    r_array->dispatch = g_new0(RegisterDispatch, r_array->nb_dispatch);
+
+    /* The first register listed at an address wins, as in a linear search */
+    for (i = 0; i < r_array->num_elements; i++) {
+        RegisterInfo *r = r_array->r[i];
+        RegisterDispatch *d =
+            &r_array->dispatch[r->access->addr >> r_array->data_shift];
+
+        if (!d->reg) {
+            d->reg = r;
+            d->flags = register_dispatch_flags(r, r_array->debug);
+        }
+    }
+}
+
 static RegisterInfoArray *register_init_block(DeviceState *owner,
                                               const RegisterAccessInfo *rae,
                                               int num, RegisterInfo *ri,
@@ -270,6 +348,8 @@ static RegisterInfoArray *register_init_block(DeviceState *owner,
         r_array->r[i] = r;
     }
 
+    register_init_dispatch(r_array, data_size);
+
     memory_region_init_io(&r_array->mem, OBJECT(owner), ops, r_array,
                           device_prefix, memory_size);
 
@@ -315,6 +395,7 @@ RegisterInfoArray *register_init_block64(DeviceState *owner,
 void register_finalize_block(RegisterInfoArray *r_array)
 {
     object_unparent(OBJECT(&r_array->mem));
+    g_free(r_array->dispatch);
     g_free(r_array->r);
     g_free(r_array);
 }
@@ -34,6 +34,7 @@
 #include "migration/vmstate.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/pixconv.h"
 
 #define DEFAULT_VCRAM_SIZE 0x4000000
 #define BCM2835_FB_OFFSET  0x00100000
@@ -61,6 +62,22 @@ static void draw_line_src16(void *opaque, uint8_t *dst, const uint8_t *src,
     uint8_t r, g, b;
     DisplaySurface *surface = qemu_console_surface(s->con);
     int bpp = surface_bits_per_pixel(surface);
+    /* pixel order 0 means BGR */
+    bool bgr = s->config.pixo == 0;
+
+    if (bpp == 32) {
+        switch (s->config.bpp) {
+        case 16:
+            pixconv_rgb565((uint32_t *)dst, src, width, bgr);
+            return;
+        case 24:
+            pixconv_rgb888((uint32_t *)dst, src, width, bgr);
+            return;
+        case 32:
+            pixconv_rgbx8888((uint32_t *)dst, src, width, bgr);
+            return;
+        }
+    }
 
     while (width--) {
         switch (s->config.bpp) {
@@ -102,7 +119,7 @@ static void draw_line_src16(void *opaque, uint8_t *dst, const uint8_t *src,
             break;
         }
 
-        if (s->config.pixo == 0) {
+        if (bgr) {
             /* swap to BGR pixel format */
             uint8_t tmp = r;
             r = b;
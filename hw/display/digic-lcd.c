@@ -0,0 +1,359 @@
+/*
+ * QEMU model of the Canon DIGIC LCD controller.
+ *
+ * The display is composed of two layers scanned out from guest RAM:
+ *
+ * - the YUV layer, which holds the LiveView image or the pictures being
+ *   played back, in UYVY 4:2:2 format with signed chroma;
+ * - the BMP overlay with the user interface, in 8-bit palette indexes.
+ *   Palette entries are 0xAARRGGBB; those with a zero alpha are
+ *   transparent and let the YUV layer show through.
+ *
+ * Both buffers are tracked with the DIRTY_MEMORY_VGA bitmap, so only
+ * the scanlines where either layer changed are converted again.
+ *
+ * The register layout is a simplified model of the Canon block.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/pixconv.h"
+#include "qapi/error.h"
+#include "hw/display/digic-lcd.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "ui/pixel_ops.h"
+#include "framebuffer.h"
+#include "trace.h"
+
+/* CTRL register */
+#define DIGIC_LCD_CTRL_BMP_EN   (1 << 0)
+#define DIGIC_LCD_CTRL_YUV_EN   (1 << 1)
+
+#define DIGIC_LCD_MAX_SIZE      2048
+
+typedef struct DigicLcdUpdate {
+    uint8_t *dest;
+    int pitch;
+    unsigned long *rows;
+} DigicLcdUpdate;
+
+static void digic_lcd_bmp_line(DigicLcdState *s, uint32_t *d,
+                               const uint8_t *src, int width)
+{
+    int i;
+
+    for (i = 0; i < width; i++) {
+        uint32_t c = s->palette[src[i]];
+
+        if (c >> 24) {
+            d[i] = rgb_to_pixel32((c >> 16) & 0xff, (c >> 8) & 0xff,
+                                  c & 0xff);
+        }
+    }
+}
+
+/* Only collect the dirty rows; they are composed once both are known */
+static void digic_lcd_mark_row(void *opaque, uint8_t *d, const uint8_t *src,
+                               int width, int deststep)
+{
+    DigicLcdUpdate *u = opaque;
+
+    set_bit((d - u->dest) / u->pitch, u->rows);
+}
+
+static const uint8_t *digic_lcd_row(MemoryRegionSection *section,
+                                    uint32_t pitch, int row)
+{
+    return (uint8_t *)memory_region_get_ram_ptr(section->mr) +
+           section->offset_within_region + (hwaddr)row * pitch;
+}
+
+static uint32_t digic_lcd_bmp_pitch(DigicLcdState *s)
+{
+    return MAX(s->bmp_pitch, s->width);
+}
+
+static uint32_t digic_lcd_yuv_pitch(DigicLcdState *s)
+{
+    return MAX(s->yuv_pitch, s->width * 2);
+}
+
+static void digic_lcd_update_section(DigicLcdState *s,
+                                     MemoryRegionSection *section,
+                                     bool enabled, hwaddr base,
+                                     uint32_t pitch)
+{
+    if (enabled) {
+        framebuffer_update_memory_section(section, s->dma_mr, base,
+                                          s->height, pitch);
+    } else if (section->mr) {
+        memory_region_set_log(section->mr, false, DIRTY_MEMORY_VGA);
+        memory_region_unref(section->mr);
+        section->mr = NULL;
+    }
+}
+
+static void digic_lcd_update(void *opaque)
+{
+    DigicLcdState *s = opaque;
+    DisplaySurface *surface = qemu_console_surface(s->con);
+    bool bmp = s->ctrl & DIGIC_LCD_CTRL_BMP_EN;
+    bool yuv = s->ctrl & DIGIC_LCD_CTRL_YUV_EN;
+    DigicLcdUpdate u;
+    int first, last, row;
+
+    if (surface_bits_per_pixel(surface) != 32) {
+        return;
+    }
+
+    if (s->invalidate) {
+        digic_lcd_update_section(s, &s->bmp_section, bmp, s->bmp_addr,
+                                 digic_lcd_bmp_pitch(s));
+        digic_lcd_update_section(s, &s->yuv_section, yuv, s->yuv_addr,
+                                 digic_lcd_yuv_pitch(s));
+        bitmap_set(s->dirty_rows, 0, s->height);
+    }
+
+    u.dest = surface_data(surface);
+    u.pitch = surface_stride(surface);
+    u.rows = s->dirty_rows;
+    if (bmp) {
+        first = 0;
+        framebuffer_update_display(surface, &s->bmp_section, s->width,
+                                   s->height, digic_lcd_bmp_pitch(s),
+                                   u.pitch, 0, s->invalidate,
+                                   digic_lcd_mark_row, &u, &first, &last);
+    }
+    if (yuv) {
+        first = 0;
+        framebuffer_update_display(surface, &s->yuv_section, s->width,
+                                   s->height, digic_lcd_yuv_pitch(s),
+                                   u.pitch, 0, s->invalidate,
+                                   digic_lcd_mark_row, &u, &first, &last);
+    }
+    s->invalidate = false;
+
+    first = find_first_bit(s->dirty_rows, s->height);
+    if (first >= s->height) {
+        return;
+    }
+    last = first;
+    for (row = first; row < s->height;
+         row = find_next_bit(s->dirty_rows, s->height, row + 1)) {
+        uint32_t *d = (uint32_t *)(u.dest + row * u.pitch);
+
+        if (yuv && s->yuv_section.mr) {
+            pixconv_uyvy(d, digic_lcd_row(&s->yuv_section,
+                                          digic_lcd_yuv_pitch(s), row),
+                         s->width, true);
+        } else {
+            memset(d, 0, s->width * sizeof(uint32_t));
+        }
+        if (bmp && s->bmp_section.mr) {
+            digic_lcd_bmp_line(s, d, digic_lcd_row(&s->bmp_section,
+                                                   digic_lcd_bmp_pitch(s),
+                                                   row),
+                               s->width);
+        }
+        last = row;
+    }
+    bitmap_zero(s->dirty_rows, s->height);
+
+    trace_digic_lcd_update(first, last);
+    dpy_gfx_update(s->con, 0, first, s->width, last - first + 1);
+}
+
+static void digic_lcd_invalidate(void *opaque)
+{
+    DigicLcdState *s = opaque;
+
+    s->invalidate = true;
+}
+
+static const GraphicHwOps digic_lcd_gfx_ops = {
+    .invalidate = digic_lcd_invalidate,
+    .gfx_update = digic_lcd_update,
+};
+
+static uint64_t digic_lcd_read(void *opaque, hwaddr addr, unsigned size)
+{
+    DigicLcdState *s = opaque;
+
+    addr >>= 2;
+
+    switch (addr) {
+    case R_LCD_CTRL:
+        return s->ctrl;
+    case R_LCD_BMP_ADDR:
+        return s->bmp_addr;
+    case R_LCD_BMP_PITCH:
+        return s->bmp_pitch;
+    case R_LCD_YUV_ADDR:
+        return s->yuv_addr;
+    case R_LCD_YUV_PITCH:
+        return s->yuv_pitch;
+    case R_LCD_PALETTE ... R_LCD_MAX - 1:
+        return s->palette[addr - R_LCD_PALETTE];
+
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), false);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-lcd: read access to unknown register 0x%"
+                      HWADDR_PRIx "\n", addr << 2);
+        return 0;
+    }
+}
+
+static void digic_lcd_write(void *opaque, hwaddr addr, uint64_t value,
+                            unsigned size)
+{
+    DigicLcdState *s = opaque;
+
+    addr >>= 2;
+
+    switch (addr) {
+    case R_LCD_CTRL:
+        s->ctrl = value & (DIGIC_LCD_CTRL_BMP_EN | DIGIC_LCD_CTRL_YUV_EN);
+        break;
+    case R_LCD_BMP_ADDR:
+        s->bmp_addr = value;
+        break;
+    case R_LCD_BMP_PITCH:
+        s->bmp_pitch = value & 0xffff;
+        break;
+    case R_LCD_YUV_ADDR:
+        s->yuv_addr = value;
+        break;
+    case R_LCD_YUV_PITCH:
+        s->yuv_pitch = value & 0xffff;
+        break;
+    case R_LCD_PALETTE ... R_LCD_MAX - 1:
+        s->palette[addr - R_LCD_PALETTE] = value;
+        break;
+
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), true);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-lcd: write access to unknown register 0x%"
+                      HWADDR_PRIx "\n", addr << 2);
+        return;
+    }
+    s->invalidate = true;
+}
+
+static const MemoryRegionOps digic_lcd_ops = {
+    .read = digic_lcd_read,
+    .write = digic_lcd_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void digic_lcd_reset(DeviceState *dev)
+{
+    DigicLcdState *s = DIGIC_LCD(dev);
+
+    s->ctrl = 0;
+    s->bmp_addr = 0;
+    s->bmp_pitch = s->width;
+    s->yuv_addr = 0;
+    s->yuv_pitch = s->width * 2;
+    memset(s->palette, 0, sizeof(s->palette));
+    s->invalidate = true;
+}
+
+static int digic_lcd_post_load(void *opaque, int version_id)
+{
+    DigicLcdState *s = opaque;
+
+    s->invalidate = true;
+    return 0;
+}
+
+static const VMStateDescription vmstate_digic_lcd = {
+    .name = TYPE_DIGIC_LCD,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = digic_lcd_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(ctrl, DigicLcdState),
+        VMSTATE_UINT32(bmp_addr, DigicLcdState),
+        VMSTATE_UINT32(bmp_pitch, DigicLcdState),
+        VMSTATE_UINT32(yuv_addr, DigicLcdState),
+        VMSTATE_UINT32(yuv_pitch, DigicLcdState),
+        VMSTATE_UINT32_ARRAY(palette, DigicLcdState, DIGIC_LCD_PALETTE_SIZE),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void digic_lcd_init(Object *obj)
+{
+    DigicLcdState *s = DIGIC_LCD(obj);
+
+    memory_region_init_io(&s->regs_region, obj, &digic_lcd_ops, s,
+                          TYPE_DIGIC_LCD, R_LCD_MAX << 2);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->regs_region);
+}
+
+static void digic_lcd_realize(DeviceState *dev, Error **errp)
+{
+    DigicLcdState *s = DIGIC_LCD(dev);
+
+    if (!s->dma_mr) {
+        error_setg(errp, "'memory' property is not set");
+        return;
+    }
+    if (!s->width || s->width > DIGIC_LCD_MAX_SIZE || (s->width & 1) ||
+        !s->height || s->height > DIGIC_LCD_MAX_SIZE) {
+        error_setg(errp, "invalid display size %" PRIu32 "x%" PRIu32
+                   " (the width must be even, both at most %d)",
+                   s->width, s->height, DIGIC_LCD_MAX_SIZE);
+        return;
+    }
+
+    s->dirty_rows = bitmap_new(s->height);
+    s->con = graphic_console_init(dev, 0, &digic_lcd_gfx_ops, s);
+    qemu_console_resize(s->con, s->width, s->height);
+}
+
+static Property digic_lcd_properties[] = {
+    DEFINE_PROP_UINT32("width", DigicLcdState, width, 720),
+    DEFINE_PROP_UINT32("height", DigicLcdState, height, 480),
+    DEFINE_PROP_LINK("memory", DigicLcdState, dma_mr, TYPE_MEMORY_REGION,
+                     MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void digic_lcd_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    set_bit(DEVICE_CATEGORY_DISPLAY, dc->categories);
+    dc->realize = digic_lcd_realize;
+    dc->reset = digic_lcd_reset;
+    dc->vmsd = &vmstate_digic_lcd;
+    device_class_set_props(dc, digic_lcd_properties);
+}
+
+static const TypeInfo digic_lcd_info = {
+    .name          = TYPE_DIGIC_LCD,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DigicLcdState),
+    .instance_init = digic_lcd_init,
+    .class_init    = digic_lcd_class_init,
+};
+
+static void digic_lcd_register_types(void)
+{
+    type_register_static(&digic_lcd_info);
+}
+
+type_init(digic_lcd_register_types)
@@ -490,6 +490,17 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
     }
 }
 
+/*
+ * A blob scanout is handed to the console as a dmabuf when the console
+ * can take one, and as a surface wrapping the blob memory otherwise.
+ */
+static bool
+virtio_gpu_scanout_uses_dmabuf(struct virtio_gpu_scanout *scanout,
+                               struct virtio_gpu_simple_resource *res)
+{
+    return console_has_gl(scanout->con) && res->dmabuf_fd >= 0;
+}
+
 static void virtio_gpu_resource_flush(VirtIOGPU *g,
                                       struct virtio_gpu_ctrl_command *cmd)
 {
@@ -514,21 +525,21 @@ static void virtio_gpu_resource_flush(VirtIOGPU *g,
         for (i = 0; i < g->parent_obj.conf.max_outputs; i++) {
             scanout = &g->parent_obj.scanout[i];
             if (scanout->resource_id == res->resource_id &&
-                console_has_gl(scanout->con)) {
+                virtio_gpu_scanout_uses_dmabuf(scanout, res)) {
                 dpy_gl_update(scanout->con, 0, 0, scanout->width,
                               scanout->height);
             }
         }
-        return;
-    }
-
-    if (!res->blob &&
-        (rf.r.x > res->width ||
-        rf.r.y > res->height ||
-        rf.r.width > res->width ||
-        rf.r.height > res->height ||
-        rf.r.x + rf.r.width > res->width ||
-        rf.r.y + rf.r.height > res->height)) {
+        /*
+         * The other scanouts show the blob memory in place, only tell
+         * their consoles what changed.
+         */
+    } else if (rf.r.x > res->width ||
+               rf.r.y > res->height ||
+               rf.r.width > res->width ||
+               rf.r.height > res->height ||
+               rf.r.x + rf.r.width > res->width ||
+               rf.r.y + rf.r.height > res->height) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: flush bounds outside resource"
                       " bounds for resource %d: %d %d %d %d vs %d %d\n",
                       __func__, rf.resource_id, rf.r.x, rf.r.y,
@@ -547,6 +558,9 @@ static void virtio_gpu_resource_flush(VirtIOGPU *g,
             continue;
         }
         scanout = &g->parent_obj.scanout[i];
+        if (res->blob && virtio_gpu_scanout_uses_dmabuf(scanout, res)) {
+            continue;
+        }
 
         pixman_region_init(&finalregion);
         pixman_region_init_rect(&region, scanout->x, scanout->y,
@@ -626,7 +640,7 @@ static void virtio_gpu_do_set_scanout(VirtIOGPU *g,
     g->parent_obj.enable = 1;
 
     if (res->blob) {
-        if (console_has_gl(scanout->con)) {
+        if (virtio_gpu_scanout_uses_dmabuf(scanout, res)) {
             if (!virtio_gpu_update_dmabuf(g, scanout_id, res, fb, r)) {
                 virtio_gpu_update_scanout(g, scanout_id, res, r);
                 return;
@@ -638,10 +652,15 @@ static void virtio_gpu_do_set_scanout(VirtIOGPU *g,
         data = (uint8_t *)pixman_image_get_data(res->image);
     }
 
-    /* create a surface for this scanout */
-    if ((res->blob && !console_has_gl(scanout->con)) ||
-        !scanout->ds ||
+    /*
+     * Create a surface for this scanout.  A blob surface points at guest
+     * memory, so flipping back to a blob that is already shown with the
+     * same layout needs no new surface.
+     */
+    if (!scanout->ds ||
         surface_data(scanout->ds) != data + fb->offset ||
+        surface_stride(scanout->ds) != fb->stride ||
+        surface_format(scanout->ds) != fb->format ||
         scanout->width != r->width ||
         scanout->height != r->height) {
         pixman_image_t *rect;
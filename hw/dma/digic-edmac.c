@@ -0,0 +1,372 @@
+/*
+ * QEMU model of the Canon DIGIC EDMAC engines.
+ *
+ * The register layout is a simplified model rather than the exact Canon
+ * one, and only memory to memory transfers are modelled.  A transfer
+ * moves YSIZE rows of XSIZE bytes; consecutive rows start PITCH bytes
+ * apart on each side, which covers both plain copies and the 2D
+ * transfers the firmware uses to move image tiles.
+ *
+ * Transfers are not emulated word by word: when one completes, each row
+ * is copied with a single bulk access to the address space (contiguous
+ * transfers as a single row), and completion is scheduled on the
+ * virtual clock according to the "bytes-per-us" rate.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "hw/dma/digic-edmac.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "migration/vmstate.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "trace.h"
+
+enum {
+    CTRL_START = (1 << 0),
+    CTRL_IRQ_EN = (1 << 1),
+};
+
+enum {
+    STATUS_DONE = (1 << 0),
+};
+
+#define DIGIC_EDMAC_YSIZE_MAX   0xffff
+/* The bus is 32 bits wide, larger transfers would only wrap around */
+#define DIGIC_EDMAC_BYTES_MAX   (1ULL << 32)
+
+static void digic_edmac_update_irq(DigicEdmacChannel *ch)
+{
+    qemu_set_irq(ch->irq, (ch->ctrl & CTRL_IRQ_EN) &&
+                          (ch->status & STATUS_DONE));
+}
+
+/*
+ * Bytes moved by the transfer programmed in @ch, which is capped to
+ * the size of the bus.
+ */
+static uint64_t digic_edmac_bytes(DigicEdmacChannel *ch)
+{
+    return MIN((uint64_t)ch->xsize * ch->ysize, DIGIC_EDMAC_BYTES_MAX);
+}
+
+/*
+ * Copy @len bytes, straight from source to destination when both can be
+ * mapped.  Firmware moves image data in place, so they may overlap.
+ */
+static void digic_edmac_copy(DigicEdmacState *s, hwaddr src, hwaddr dst,
+                             hwaddr len)
+{
+    while (len) {
+        hwaddr sl = len, dl = len, l;
+        void *sp, *dp = NULL;
+
+        sp = address_space_map(&s->dma_as, src, &sl, false,
+                               MEMTXATTRS_UNSPECIFIED);
+        if (sp) {
+            dp = address_space_map(&s->dma_as, dst, &dl, true,
+                                   MEMTXATTRS_UNSPECIFIED);
+        }
+        if (sp && dp) {
+            l = MIN(sl, dl);
+            memmove(dp, sp, l);
+            address_space_unmap(&s->dma_as, dp, dl, true, l);
+            address_space_unmap(&s->dma_as, sp, sl, false, l);
+        } else {
+            uint8_t buf[1024];
+
+            if (sp) {
+                address_space_unmap(&s->dma_as, sp, sl, false, 0);
+            }
+            l = MIN(len, sizeof(buf));
+            address_space_read(&s->dma_as, src, MEMTXATTRS_UNSPECIFIED,
+                               buf, l);
+            address_space_write(&s->dma_as, dst, MEMTXATTRS_UNSPECIFIED,
+                                buf, l);
+        }
+        src += l;
+        dst += l;
+        len -= l;
+    }
+}
+
+static void digic_edmac_complete(void *opaque)
+{
+    DigicEdmacChannel *ch = opaque;
+    DigicEdmacState *s = ch->edmac;
+    hwaddr src = ch->src, dst = ch->dst;
+    uint64_t bytes = digic_edmac_bytes(ch);
+    uint32_t y;
+
+    trace_digic_edmac_transfer(ch - s->ch, ch->src, ch->dst, ch->xsize,
+                               ch->ysize);
+    if (ch->src_pitch == ch->xsize && ch->dst_pitch == ch->xsize) {
+        digic_edmac_copy(s, src, dst, bytes);
+    } else {
+        for (y = 0; y < ch->ysize && bytes; y++) {
+            hwaddr l = MIN(ch->xsize, bytes);
+
+            digic_edmac_copy(s, src, dst, l);
+            bytes -= l;
+            src += (int32_t)ch->src_pitch;
+            dst += (int32_t)ch->dst_pitch;
+        }
+    }
+
+    ch->ctrl &= ~CTRL_START;
+    ch->status |= STATUS_DONE;
+    digic_edmac_update_irq(ch);
+}
+
+static void digic_edmac_start(DigicEdmacChannel *ch)
+{
+    DigicEdmacState *s = ch->edmac;
+    uint64_t bytes = digic_edmac_bytes(ch);
+    int64_t delay = 0;
+
+    if (bytes < (uint64_t)ch->xsize * ch->ysize) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "digic-edmac: transfer truncated to 4 GiB\n");
+    }
+    if (s->bytes_per_us) {
+        delay = bytes * SCALE_US / s->bytes_per_us;
+    }
+    ch->status &= ~STATUS_DONE;
+    digic_edmac_update_irq(ch);
+    timer_mod(ch->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay);
+}
+
+static uint64_t digic_edmac_read(void *opaque, hwaddr addr, unsigned size)
+{
+    DigicEdmacState *s = opaque;
+    DigicEdmacChannel *ch = &s->ch[addr / DIGIC_EDMAC_CHANNEL_STRIDE];
+    hwaddr reg = (addr % DIGIC_EDMAC_CHANNEL_STRIDE) >> 2;
+
+    switch (reg) {
+    case R_EDMAC_CTRL:
+        return ch->ctrl;
+    case R_EDMAC_STATUS:
+        return ch->status;
+    case R_EDMAC_SRC:
+        return ch->src;
+    case R_EDMAC_DST:
+        return ch->dst;
+    case R_EDMAC_XSIZE:
+        return ch->xsize;
+    case R_EDMAC_YSIZE:
+        return ch->ysize;
+    case R_EDMAC_SRC_PITCH:
+        return ch->src_pitch;
+    case R_EDMAC_DST_PITCH:
+        return ch->dst_pitch;
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + addr, false);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-edmac: read access to unknown register 0x"
+                      TARGET_FMT_plx "\n", addr);
+        return 0;
+    }
+}
+
+static void digic_edmac_write(void *opaque, hwaddr addr, uint64_t value,
+                              unsigned size)
+{
+    DigicEdmacState *s = opaque;
+    DigicEdmacChannel *ch = &s->ch[addr / DIGIC_EDMAC_CHANNEL_STRIDE];
+    hwaddr reg = (addr % DIGIC_EDMAC_CHANNEL_STRIDE) >> 2;
+    bool busy = ch->ctrl & CTRL_START;
+
+    if (busy && reg != R_EDMAC_CTRL && reg != R_EDMAC_STATUS &&
+        reg < R_EDMAC_MAX) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "digic-edmac: channel %d reprogrammed while busy\n",
+                      (int)(ch - s->ch));
+        return;
+    }
+
+    switch (reg) {
+    case R_EDMAC_CTRL:
+        ch->ctrl = value & (CTRL_START | CTRL_IRQ_EN);
+        if (!busy && (ch->ctrl & CTRL_START)) {
+            digic_edmac_start(ch);
+        } else if (busy && !(ch->ctrl & CTRL_START)) {
+            /* Abort, nothing is copied */
+            timer_del(ch->timer);
+        }
+        digic_edmac_update_irq(ch);
+        break;
+    case R_EDMAC_STATUS:
+        /* Write 1 to clear */
+        ch->status &= ~value;
+        digic_edmac_update_irq(ch);
+        break;
+    case R_EDMAC_SRC:
+        ch->src = value;
+        break;
+    case R_EDMAC_DST:
+        ch->dst = value;
+        break;
+    case R_EDMAC_XSIZE:
+        ch->xsize = value;
+        break;
+    case R_EDMAC_YSIZE:
+        ch->ysize = MIN(value, DIGIC_EDMAC_YSIZE_MAX);
+        break;
+    case R_EDMAC_SRC_PITCH:
+        ch->src_pitch = value;
+        break;
+    case R_EDMAC_DST_PITCH:
+        ch->dst_pitch = value;
+        break;
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + addr, true);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-edmac: write access to unknown register 0x"
+                      TARGET_FMT_plx "\n", addr);
+    }
+}
+
+static const MemoryRegionOps digic_edmac_ops = {
+    .read = digic_edmac_read,
+    .write = digic_edmac_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void digic_edmac_reset(DeviceState *dev)
+{
+    DigicEdmacState *s = DIGIC_EDMAC(dev);
+    int i;
+
+    for (i = 0; i < DIGIC_EDMAC_NB_CHANNELS; i++) {
+        DigicEdmacChannel *ch = &s->ch[i];
+
+        timer_del(ch->timer);
+        ch->ctrl = 0;
+        ch->status = 0;
+        ch->src = 0;
+        ch->dst = 0;
+        ch->xsize = 0;
+        ch->ysize = 0;
+        ch->src_pitch = 0;
+        ch->dst_pitch = 0;
+        digic_edmac_update_irq(ch);
+    }
+}
+
+static void digic_edmac_init(Object *obj)
+{
+    DigicEdmacState *s = DIGIC_EDMAC(obj);
+    int i;
+
+    memory_region_init_io(&s->regs_region, obj, &digic_edmac_ops, s,
+                          TYPE_DIGIC_EDMAC,
+                          DIGIC_EDMAC_NB_CHANNELS * DIGIC_EDMAC_CHANNEL_STRIDE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->regs_region);
+    for (i = 0; i < DIGIC_EDMAC_NB_CHANNELS; i++) {
+        s->ch[i].edmac = s;
+        sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->ch[i].irq);
+    }
+}
+
+static void digic_edmac_realize(DeviceState *dev, Error **errp)
+{
+    DigicEdmacState *s = DIGIC_EDMAC(dev);
+    int i;
+
+    address_space_init(&s->dma_as, s->dma_mr ?: get_system_memory(),
+                       "digic-edmac");
+    for (i = 0; i < DIGIC_EDMAC_NB_CHANNELS; i++) {
+        s->ch[i].timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                      digic_edmac_complete, &s->ch[i]);
+    }
+}
+
+static void digic_edmac_unrealize(DeviceState *dev)
+{
+    DigicEdmacState *s = DIGIC_EDMAC(dev);
+    int i;
+
+    for (i = 0; i < DIGIC_EDMAC_NB_CHANNELS; i++) {
+        timer_free(s->ch[i].timer);
+    }
+    address_space_destroy(&s->dma_as);
+}
+
+static const VMStateDescription vmstate_digic_edmac_channel = {
+    .name = "digic-edmac/channel",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(ctrl, DigicEdmacChannel),
+        VMSTATE_UINT32(status, DigicEdmacChannel),
+        VMSTATE_UINT32(src, DigicEdmacChannel),
+        VMSTATE_UINT32(dst, DigicEdmacChannel),
+        VMSTATE_UINT32(xsize, DigicEdmacChannel),
+        VMSTATE_UINT32(ysize, DigicEdmacChannel),
+        VMSTATE_UINT32(src_pitch, DigicEdmacChannel),
+        VMSTATE_UINT32(dst_pitch, DigicEdmacChannel),
+        VMSTATE_TIMER_PTR(timer, DigicEdmacChannel),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_digic_edmac = {
+    .name = "digic-edmac",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(ch, DigicEdmacState, DIGIC_EDMAC_NB_CHANNELS, 1,
+                             vmstate_digic_edmac_channel, DigicEdmacChannel),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property digic_edmac_properties[] = {
+    DEFINE_PROP_LINK("dma", DigicEdmacState, dma_mr, TYPE_MEMORY_REGION,
+                     MemoryRegion *),
+    DEFINE_PROP_UINT32("bytes-per-us", DigicEdmacState, bytes_per_us, 200),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void digic_edmac_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = digic_edmac_realize;
+    dc->unrealize = digic_edmac_unrealize;
+    dc->reset = digic_edmac_reset;
+    dc->vmsd = &vmstate_digic_edmac;
+    device_class_set_props(dc, digic_edmac_properties);
+}
+
+static const TypeInfo digic_edmac_info = {
+    .name = TYPE_DIGIC_EDMAC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DigicEdmacState),
+    .instance_init = digic_edmac_init,
+    .class_init = digic_edmac_class_init,
+};
+
+static void digic_edmac_register_types(void)
+{
+    type_register_static(&digic_edmac_info);
+}
+
+type_init(digic_edmac_register_types)
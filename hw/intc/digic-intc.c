@@ -0,0 +1,221 @@
+/*
+ * QEMU model of the Canon DIGIC interrupt controller.
+ *
+ * The register layout is a simplified model rather than the exact Canon
+ * one: DryOS only needs the number of the interrupt to service, which
+ * R_INTC_ID returns, and per-interrupt enable and acknowledge.
+ *
+ * Each input is pending while its line is high, and from a rising edge
+ * until the guest acknowledges it, so that both level sources like the
+ * UART and pulses like the timer rollovers are seen.  Lower numbers
+ * have higher priority.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "hw/intc/digic-intc.h"
+#include "hw/irq.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "migration/vmstate.h"
+#include "qemu/bitops.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+/*
+ * Recompute the interrupt to service: with a handful of words this is
+ * a find-first-bit over pending & enabled, independent of how many
+ * interrupts are pending.
+ */
+static void digic_intc_update(DigicIntcState *s)
+{
+    uint32_t active = DIGIC_INTC_ID_NONE;
+    int i;
+
+    for (i = 0; i < DIGIC_INTC_NB_WORDS; i++) {
+        uint32_t word = (s->level[i] | s->latched[i]) & s->enabled[i];
+
+        if (word) {
+            active = i * 32 + ctz32(word);
+            break;
+        }
+    }
+
+    if (active != s->active) {
+        trace_digic_intc_update(active);
+        s->active = active;
+    }
+    qemu_set_irq(s->irq, active != DIGIC_INTC_ID_NONE);
+}
+
+static void digic_intc_set_irq(void *opaque, int irq, int level)
+{
+    DigicIntcState *s = opaque;
+    uint32_t mask = 1u << (irq % 32);
+    uint32_t *word = &s->level[irq / 32];
+
+    assert(irq >= 0 && irq < DIGIC_INTC_NB_IRQS);
+    if (level && !(*word & mask)) {
+        s->latched[irq / 32] |= mask;
+    }
+    *word = level ? *word | mask : *word & ~mask;
+    digic_intc_update(s);
+}
+
+static uint64_t digic_intc_read(void *opaque, hwaddr addr, unsigned size)
+{
+    DigicIntcState *s = opaque;
+    uint64_t ret = 0;
+
+    addr >>= 2;
+
+    switch (addr) {
+    case R_INTC_ID:
+        ret = s->active;
+        break;
+
+    case R_INTC_PENDING0 ... R_INTC_PENDING0 + DIGIC_INTC_NB_WORDS - 1:
+        ret = s->level[addr - R_INTC_PENDING0] |
+              s->latched[addr - R_INTC_PENDING0];
+        break;
+
+    case R_INTC_ENABLED0 ... R_INTC_MAX - 1:
+        ret = s->enabled[addr - R_INTC_ENABLED0];
+        break;
+
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), false);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-intc: read access to unknown register 0x"
+                      TARGET_FMT_plx "\n", addr << 2);
+    }
+
+    return ret;
+}
+
+static void digic_intc_write(void *opaque, hwaddr addr, uint64_t value,
+                             unsigned size)
+{
+    DigicIntcState *s = opaque;
+
+    addr >>= 2;
+
+    switch (addr) {
+    case R_INTC_ENABLE:
+    case R_INTC_DISABLE:
+    case R_INTC_ACK:
+        if (value >= DIGIC_INTC_NB_IRQS) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "digic-intc: bad interrupt number %" PRIu64 "\n",
+                          value);
+            return;
+        }
+        if (addr == R_INTC_ENABLE) {
+            s->enabled[value / 32] |= 1u << (value % 32);
+        } else if (addr == R_INTC_DISABLE) {
+            s->enabled[value / 32] &= ~(1u << (value % 32));
+        } else {
+            s->latched[value / 32] &= ~(1u << (value % 32));
+        }
+        break;
+
+    case R_INTC_ENABLED0 ... R_INTC_MAX - 1:
+        s->enabled[addr - R_INTC_ENABLED0] = value;
+        break;
+
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), true);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-intc: write access to unknown register 0x"
+                      TARGET_FMT_plx "\n", addr << 2);
+        return;
+    }
+
+    digic_intc_update(s);
+}
+
+static const MemoryRegionOps digic_intc_ops = {
+    .read = digic_intc_read,
+    .write = digic_intc_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void digic_intc_reset(DeviceState *dev)
+{
+    DigicIntcState *s = DIGIC_INTC(dev);
+
+    /* The input levels belong to the sources, which reset on their own */
+    memset(s->latched, 0, sizeof(s->latched));
+    memset(s->enabled, 0, sizeof(s->enabled));
+    digic_intc_update(s);
+}
+
+static void digic_intc_init(Object *obj)
+{
+    DigicIntcState *s = DIGIC_INTC(obj);
+
+    memory_region_init_io(&s->regs_region, obj, &digic_intc_ops, s,
+                          TYPE_DIGIC_INTC, R_INTC_MAX << 2);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->regs_region);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+    qdev_init_gpio_in(DEVICE(obj), digic_intc_set_irq, DIGIC_INTC_NB_IRQS);
+    s->active = DIGIC_INTC_ID_NONE;
+}
+
+static int digic_intc_post_load(void *opaque, int version_id)
+{
+    DigicIntcState *s = opaque;
+
+    digic_intc_update(s);
+    return 0;
+}
+
+static const VMStateDescription vmstate_digic_intc = {
+    .name = "digic-intc",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = digic_intc_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(level, DigicIntcState, DIGIC_INTC_NB_WORDS),
+        VMSTATE_UINT32_ARRAY(latched, DigicIntcState, DIGIC_INTC_NB_WORDS),
+        VMSTATE_UINT32_ARRAY(enabled, DigicIntcState, DIGIC_INTC_NB_WORDS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void digic_intc_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = digic_intc_reset;
+    dc->vmsd = &vmstate_digic_intc;
+}
+
+static const TypeInfo digic_intc_info = {
+    .name = TYPE_DIGIC_INTC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DigicIntcState),
+    .instance_init = digic_intc_init,
+    .class_init = digic_intc_class_init,
+};
+
+static void digic_intc_register_types(void)
+{
+    type_register_static(&digic_intc_info);
+}
+
+type_init(digic_intc_register_types)
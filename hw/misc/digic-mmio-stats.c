@@ -0,0 +1,94 @@
+/*
+ * Access counters for unmodelled Canon DIGIC registers.
+ *
+ * Firmware that polls an unmodelled register in a tight loop burns
+ * host CPU without making progress.  Counting accesses per address
+ * shows which registers are worth modelling.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "qapi/type-helpers.h"
+#include "hw/misc/digic-mmio-stats.h"
+
+typedef struct DigicMMIOStat {
+    hwaddr addr;
+    uint64_t reads;
+    uint64_t writes;
+} DigicMMIOStat;
+
+/* Keyed by &DigicMMIOStat::addr; protected by the BQL */
+static GHashTable *digic_mmio_stats;
+
+void digic_mmio_stats_record(hwaddr addr, bool is_write)
+{
+    DigicMMIOStat *stat;
+
+    if (!digic_mmio_stats) {
+        digic_mmio_stats = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                                 NULL, g_free);
+    }
+
+    stat = g_hash_table_lookup(digic_mmio_stats, &addr);
+    if (!stat) {
+        stat = g_new0(DigicMMIOStat, 1);
+        stat->addr = addr;
+        g_hash_table_insert(digic_mmio_stats, &stat->addr, stat);
+    }
+
+    if (is_write) {
+        stat->writes++;
+    } else {
+        stat->reads++;
+    }
+}
+
+/* Busiest registers first */
+static gint digic_mmio_stat_cmp(gconstpointer a, gconstpointer b)
+{
+    const DigicMMIOStat *sa = *(DigicMMIOStat *const *)a;
+    const DigicMMIOStat *sb = *(DigicMMIOStat *const *)b;
+    uint64_t ca = sa->reads + sa->writes;
+    uint64_t cb = sb->reads + sb->writes;
+
+    if (ca != cb) {
+        return ca > cb ? -1 : 1;
+    }
+    return sa->addr < sb->addr ? -1 : sa->addr > sb->addr;
+}
+
+HumanReadableText *qmp_x_query_digic_mmio(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    g_autoptr(GPtrArray) stats = NULL;
+    GHashTableIter iter;
+    gpointer value;
+    guint i;
+
+    if (!digic_mmio_stats) {
+        error_setg(errp, "No unmodelled DIGIC register accessed");
+        return NULL;
+    }
+
+    stats = g_ptr_array_sized_new(g_hash_table_size(digic_mmio_stats));
+    g_hash_table_iter_init(&iter, digic_mmio_stats);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        g_ptr_array_add(stats, value);
+    }
+    g_ptr_array_sort(stats, digic_mmio_stat_cmp);
+
+    g_string_append_printf(buf, "%-18s %20s %20s\n",
+                           "address", "reads", "writes");
+    for (i = 0; i < stats->len; i++) {
+        DigicMMIOStat *stat = g_ptr_array_index(stats, i);
+
+        g_string_append_printf(buf, "0x%016" HWADDR_PRIx " %20" PRIu64
+                               " %20" PRIu64 "\n",
+                               stat->addr, stat->reads, stat->writes);
+    }
+
+    return human_readable_text_from_str(buf);
+}
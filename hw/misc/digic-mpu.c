@@ -0,0 +1,449 @@
+/*
+ * QEMU model of the channel between a Canon DIGIC and its MPU.
+ *
+ * EOS cameras have a second microcontroller, the MPU, which handles the
+ * buttons, the battery and the lens, and exchanges short messages with
+ * the DIGIC over a serial link.  Instead of emulating the serial port
+ * byte by byte, this device hands whole messages to an external process
+ * emulating the MPU, through a pair of rings in a shared file (see
+ * include/hw/misc/digic-mpu.h).  Sending a message makes no system call
+ * unless the other side is asleep; the other side wakes QEMU up with the
+ * "kick-fd" eventfd.
+ *
+ * The register layout is a simplified model: the firmware reads the
+ * received message from a window and pops it, and writes the message to
+ * send into another window before writing its length to TX_SEND.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "qemu/osdep.h"
+#ifdef CONFIG_POSIX
+#include <sys/mman.h>
+#endif
+#include "hw/misc/digic-mpu.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "trace.h"
+
+enum {
+    ST_RX_RDY = (1 << 0),
+    ST_TX_RDY = (1 << 1),
+};
+
+#define DIGIC_MPU_TO_DATA_OFFSET    (2 * DIGIC_MPU_RING_FROM_OFFSET)
+#define DIGIC_MPU_FROM_DATA_OFFSET \
+    (DIGIC_MPU_TO_DATA_OFFSET + DIGIC_MPU_RING_SIZE)
+#define DIGIC_MPU_SHM_SIZE \
+    (DIGIC_MPU_FROM_DATA_OFFSET + DIGIC_MPU_RING_SIZE)
+
+/* Not r->data_offset, which the MPU can overwrite */
+static uint8_t *digic_mpu_ring_data(DigicMpuState *s, QemuShmRing *r)
+{
+    return (uint8_t *)s->shm + (r == s->to_mpu ? DIGIC_MPU_TO_DATA_OFFSET
+                                               : DIGIC_MPU_FROM_DATA_OFFSET);
+}
+
+static void digic_mpu_ring_get(DigicMpuState *s, QemuShmRing *r,
+                               uint32_t pos, void *buf, size_t len)
+{
+    uint8_t *data = digic_mpu_ring_data(s, r);
+    size_t off = pos & (DIGIC_MPU_RING_SIZE - 1);
+    size_t first = MIN(len, DIGIC_MPU_RING_SIZE - off);
+
+    memcpy(buf, data + off, first);
+    memcpy((uint8_t *)buf + first, data, len - first);
+}
+
+static void digic_mpu_ring_put(DigicMpuState *s, QemuShmRing *r,
+                               uint32_t pos, const void *buf, size_t len)
+{
+    uint8_t *data = digic_mpu_ring_data(s, r);
+    size_t off = pos & (DIGIC_MPU_RING_SIZE - 1);
+    size_t first = MIN(len, DIGIC_MPU_RING_SIZE - off);
+
+    memcpy(data + off, buf, first);
+    memcpy(data, (const uint8_t *)buf + first, len - first);
+}
+
+static bool digic_mpu_tx_ready(DigicMpuState *s)
+{
+    QemuShmRing *r = s->to_mpu;
+
+    if (!r) {
+        /* Nobody listens; messages are dropped */
+        return true;
+    }
+    return DIGIC_MPU_RING_SIZE -
+           (qatomic_read(&r->prod) - qatomic_load_acquire(&r->cons)) >=
+           2 + DIGIC_MPU_MSG_MAX;
+}
+
+static void digic_mpu_update_irq(DigicMpuState *s)
+{
+    qemu_set_irq(s->irq, (s->irq_en & ST_RX_RDY) && s->rx_len);
+}
+
+/*
+ * Move the next message from the MPU into rx_msg, if rx_msg is free.
+ * When the ring is empty, ask the MPU to kick us on its next message.
+ */
+static void digic_mpu_fetch(DigicMpuState *s)
+{
+    QemuShmRing *r = s->from_mpu;
+    uint32_t prod, cons;
+    uint8_t hdr[2];
+    uint16_t len;
+
+    if (!r || s->rx_len) {
+        return;
+    }
+
+    cons = qatomic_read(&r->cons);
+    prod = qatomic_load_acquire(&r->prod);
+    if (prod == cons) {
+        qatomic_set(&r->waiting, 1);
+        /* Pairs with the barrier of the MPU between prod and waiting */
+        smp_mb();
+        prod = qatomic_load_acquire(&r->prod);
+        if (prod == cons) {
+            return;
+        }
+    }
+
+    if (prod - cons < sizeof(hdr)) {
+        goto bad;
+    }
+    digic_mpu_ring_get(s, r, cons, hdr, sizeof(hdr));
+    len = lduw_le_p(hdr);
+    if (len == 0 || len > DIGIC_MPU_MSG_MAX ||
+        prod - cons < sizeof(hdr) + len) {
+        goto bad;
+    }
+    digic_mpu_ring_get(s, r, cons + sizeof(hdr), s->rx_msg, len);
+    qatomic_store_release(&r->cons, cons + sizeof(hdr) + len);
+
+    trace_digic_mpu_rx(len);
+    s->rx_len = len;
+    return;
+
+bad:
+    /* Messages are published whole, so the MPU broke the protocol */
+    qemu_log_mask(LOG_GUEST_ERROR, "digic-mpu: bad message from the MPU\n");
+    qatomic_store_release(&r->cons, prod);
+}
+
+static void digic_mpu_send(DigicMpuState *s, uint32_t len)
+{
+    QemuShmRing *r = s->to_mpu;
+    uint8_t hdr[2];
+    uint32_t prod;
+
+    if (len == 0 || len > DIGIC_MPU_MSG_MAX) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "digic-mpu: bad message length %" PRIu32 "\n", len);
+        return;
+    }
+    trace_digic_mpu_tx(len);
+    if (!r) {
+        return;
+    }
+    if (!digic_mpu_tx_ready(s)) {
+        s->lost++;
+        return;
+    }
+
+    prod = qatomic_read(&r->prod);
+    stw_le_p(hdr, len);
+    digic_mpu_ring_put(s, r, prod, hdr, sizeof(hdr));
+    digic_mpu_ring_put(s, r, prod + sizeof(hdr), s->tx_msg, len);
+    qatomic_store_release(&r->prod, prod + sizeof(hdr) + len);
+
+    /* Pairs with the barrier of the MPU between waiting and prod */
+    smp_mb();
+    if (qatomic_read(&r->waiting)) {
+        uint64_t one = 1;
+
+        qatomic_set(&r->waiting, 0);
+        if (s->notify_fd >= 0 &&
+            write(s->notify_fd, &one, sizeof(one)) < 0) {
+            /* The MPU sees the message next time it looks anyway */
+        }
+    }
+}
+
+static void digic_mpu_kick(void *opaque)
+{
+    DigicMpuState *s = opaque;
+    uint64_t count;
+
+    if (read(s->kick_fd, &count, sizeof(count)) < 0) {
+        /* Spurious wakeup, the ring tells what there is to do */
+    }
+    digic_mpu_fetch(s);
+    digic_mpu_update_irq(s);
+}
+
+static uint64_t digic_mpu_read(void *opaque, hwaddr addr, unsigned size)
+{
+    DigicMpuState *s = opaque;
+
+    if (addr >= DIGIC_MPU_RX_WINDOW &&
+        addr + size <= DIGIC_MPU_RX_WINDOW + DIGIC_MPU_MSG_MAX) {
+        return ldn_le_p(s->rx_msg + addr - DIGIC_MPU_RX_WINDOW, size);
+    }
+    if (addr >= DIGIC_MPU_TX_WINDOW &&
+        addr + size <= DIGIC_MPU_TX_WINDOW + DIGIC_MPU_MSG_MAX) {
+        return ldn_le_p(s->tx_msg + addr - DIGIC_MPU_TX_WINDOW, size);
+    }
+
+    switch (addr >> 2) {
+    case R_MPU_STATUS:
+        /* Check for a message the MPU sent without kicking us */
+        digic_mpu_fetch(s);
+        digic_mpu_update_irq(s);
+        return (s->rx_len ? ST_RX_RDY : 0) |
+               (digic_mpu_tx_ready(s) ? ST_TX_RDY : 0);
+    case R_MPU_IRQ_EN:
+        return s->irq_en;
+    case R_MPU_RX_LEN:
+        return s->rx_len;
+    case R_MPU_LOST:
+        return s->lost;
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + addr, false);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-mpu: read access to unknown register 0x"
+                      TARGET_FMT_plx "\n", addr);
+        return 0;
+    }
+}
+
+static void digic_mpu_write(void *opaque, hwaddr addr, uint64_t value,
+                            unsigned size)
+{
+    DigicMpuState *s = opaque;
+
+    if (addr >= DIGIC_MPU_TX_WINDOW &&
+        addr + size <= DIGIC_MPU_TX_WINDOW + DIGIC_MPU_MSG_MAX) {
+        stn_le_p(s->tx_msg + addr - DIGIC_MPU_TX_WINDOW, size, value);
+        return;
+    }
+
+    switch (addr >> 2) {
+    case R_MPU_IRQ_EN:
+        s->irq_en = value & ST_RX_RDY;
+        break;
+    case R_MPU_RX_POP:
+        s->rx_len = 0;
+        digic_mpu_fetch(s);
+        break;
+    case R_MPU_TX_SEND:
+        digic_mpu_send(s, value);
+        break;
+    case R_MPU_LOST:
+        s->lost = 0;
+        break;
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + addr, true);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-mpu: write access to unknown register 0x"
+                      TARGET_FMT_plx "\n", addr);
+        return;
+    }
+    digic_mpu_update_irq(s);
+}
+
+static const MemoryRegionOps digic_mpu_ops = {
+    .read = digic_mpu_read,
+    .write = digic_mpu_write,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_LITTLE_ENDIAN,
+};
+
+#ifdef CONFIG_POSIX
+static void digic_mpu_init_ring(QemuShmRing *r, uint32_t data_offset)
+{
+    r->size = DIGIC_MPU_RING_SIZE;
+    r->data_offset = data_offset;
+    r->version = QEMU_SHM_RING_VERSION;
+    smp_wmb();
+    qatomic_set(&r->magic, QEMU_SHM_RING_MAGIC);
+}
+
+static bool digic_mpu_shm_open(DigicMpuState *s, Error **errp)
+{
+    void *ptr;
+    int fd;
+
+    fd = qemu_open_old(s->path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "cannot create %s", s->path);
+        return false;
+    }
+    if (ftruncate(fd, DIGIC_MPU_SHM_SIZE) < 0) {
+        error_setg_errno(errp, errno, "cannot resize %s", s->path);
+        close(fd);
+        return false;
+    }
+    ptr = mmap(NULL, DIGIC_MPU_SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        error_setg_errno(errp, errno, "cannot map %s", s->path);
+        return false;
+    }
+
+    s->shm = ptr;
+    s->to_mpu = ptr;
+    s->from_mpu = ptr + DIGIC_MPU_RING_FROM_OFFSET;
+    /* QEMU waits for the first message from the start */
+    s->from_mpu->waiting = 1;
+    digic_mpu_init_ring(s->to_mpu, DIGIC_MPU_TO_DATA_OFFSET);
+    digic_mpu_init_ring(s->from_mpu, DIGIC_MPU_FROM_DATA_OFFSET);
+    return true;
+}
+#else
+static bool digic_mpu_shm_open(DigicMpuState *s, Error **errp)
+{
+    error_setg(errp, "digic-mpu shared memory not supported on this host");
+    return false;
+}
+#endif
+
+static void digic_mpu_realize(DeviceState *dev, Error **errp)
+{
+    DigicMpuState *s = DIGIC_MPU(dev);
+
+    if (!s->path) {
+        if (s->notify_fd >= 0 || s->kick_fd >= 0) {
+            error_setg(errp, "digic-mpu file descriptors require 'path'");
+        }
+        return;
+    }
+    if (!digic_mpu_shm_open(s, errp)) {
+        return;
+    }
+    if (s->kick_fd >= 0) {
+        qemu_set_fd_handler(s->kick_fd, digic_mpu_kick, NULL, s);
+    }
+}
+
+static void digic_mpu_unrealize(DeviceState *dev)
+{
+    DigicMpuState *s = DIGIC_MPU(dev);
+
+    if (s->kick_fd >= 0) {
+        qemu_set_fd_handler(s->kick_fd, NULL, NULL, NULL);
+        close(s->kick_fd);
+    }
+    if (s->notify_fd >= 0) {
+        close(s->notify_fd);
+    }
+#ifdef CONFIG_POSIX
+    if (s->shm) {
+        munmap(s->shm, DIGIC_MPU_SHM_SIZE);
+    }
+#endif
+}
+
+static void digic_mpu_reset(DeviceState *dev)
+{
+    DigicMpuState *s = DIGIC_MPU(dev);
+
+    /* Messages in the rings are the MPU's business */
+    s->irq_en = 0;
+    s->lost = 0;
+    s->rx_len = 0;
+    digic_mpu_fetch(s);
+    digic_mpu_update_irq(s);
+}
+
+static void digic_mpu_init(Object *obj)
+{
+    DigicMpuState *s = DIGIC_MPU(obj);
+
+    memory_region_init_io(&s->regs_region, obj, &digic_mpu_ops, s,
+                          TYPE_DIGIC_MPU, DIGIC_MPU_REGS_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->regs_region);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+}
+
+static bool digic_mpu_rx_len_valid(void *opaque, int version_id)
+{
+    DigicMpuState *s = opaque;
+
+    return s->rx_len <= DIGIC_MPU_MSG_MAX;
+}
+
+static const VMStateDescription vmstate_digic_mpu = {
+    .name = "digic-mpu",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(irq_en, DigicMpuState),
+        VMSTATE_UINT32(lost, DigicMpuState),
+        VMSTATE_UINT32(rx_len, DigicMpuState),
+        VMSTATE_VALIDATE("rx_len within the message size",
+                         digic_mpu_rx_len_valid),
+        VMSTATE_UINT8_ARRAY(rx_msg, DigicMpuState, DIGIC_MPU_MSG_MAX),
+        VMSTATE_UINT8_ARRAY(tx_msg, DigicMpuState, DIGIC_MPU_MSG_MAX),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property digic_mpu_properties[] = {
+    /* File shared with the process emulating the MPU */
+    DEFINE_PROP_STRING("path", DigicMpuState, path),
+    /* Written to when the MPU waits for a message, e.g. an eventfd */
+    DEFINE_PROP_INT32("notify-fd", DigicMpuState, notify_fd, -1),
+    /* Written to by the MPU when QEMU waits for a message */
+    DEFINE_PROP_INT32("kick-fd", DigicMpuState, kick_fd, -1),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void digic_mpu_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = digic_mpu_realize;
+    dc->unrealize = digic_mpu_unrealize;
+    dc->reset = digic_mpu_reset;
+    dc->vmsd = &vmstate_digic_mpu;
+    device_class_set_props(dc, digic_mpu_properties);
+}
+
+static const TypeInfo digic_mpu_info = {
+    .name = TYPE_DIGIC_MPU,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DigicMpuState),
+    .instance_init = digic_mpu_init,
+    .class_init = digic_mpu_class_init,
+};
+
+static void digic_mpu_register_types(void)
+{
+    type_register_static(&digic_mpu_info);
+}
+
+type_init(digic_mpu_register_types)
@@ -31,7 +31,9 @@
 #include "net/announce.h"
 #include "hw/virtio/virtio-bus.h"
 #include "qapi/error.h"
+#include "qapi/qapi-commands-net.h"
 #include "qapi/qapi-events-net.h"
+#include "qapi/type-helpers.h"
 #include "hw/qdev-properties.h"
 #include "qapi/qapi-types-migration.h"
 #include "qapi/qapi-events-migration.h"
@@ -359,6 +361,26 @@ static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
+/* Interrupt the guest for the packets received since the last time */
+static void virtio_net_rx_notify(VirtIONetQueue *q)
+{
+    if (q->rx_notify_timer) {
+        timer_del(q->rx_notify_timer);
+    }
+    q->rx_pending = 0;
+    q->stats.rx_notifies++;
+    virtio_notify(VIRTIO_DEVICE(q->n), q->rx_vq);
+}
+
+static void virtio_net_rx_notify_timer(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+
+    if (q->rx_pending) {
+        virtio_net_rx_notify(q);
+    }
+}
+
 static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
@@ -386,6 +408,16 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             qemu_flush_queued_packets(ncs);
         }
 
+        if (!queue_started && q->rx_pending) {
+            if (queue_status & VIRTIO_CONFIG_S_DRIVER_OK) {
+                /* Do not sit on a coalesced interrupt while stopped */
+                virtio_net_rx_notify(q);
+            } else {
+                timer_del(q->rx_notify_timer);
+                q->rx_pending = 0;
+            }
+        }
+
         if (!q->tx_waiting) {
             continue;
         }
@@ -564,6 +596,10 @@ static void virtio_net_reset(VirtIODevice *vdev)
             qemu_flush_or_purge_queued_packets(nc->peer, true);
             assert(!virtio_net_get_subqueue(nc)->async_tx.elem);
         }
+        if (n->vqs[i].rx_notify_timer) {
+            timer_del(n->vqs[i].rx_notify_timer);
+        }
+        n->vqs[i].rx_pending = 0;
     }
 }
 
@@ -1754,6 +1790,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
 
     /* hdr_len refers to the header we supply to the guest */
     if (!virtio_net_has_buffers(q, size + n->guest_hdr_len - n->host_hdr_len)) {
+        q->stats.rx_no_buffers++;
+        if (q->rx_pending) {
+            /* The guest refills the ring once it sees what it got */
+            virtio_net_rx_notify(q);
+        }
         return 0;
     }
 
@@ -1856,7 +1897,18 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+
+    q->stats.rx_packets++;
+    q->stats.rx_bytes += size - n->host_hdr_len;
+    q->rx_pending++;
+    if (!q->rx_notify_timer ||
+        q->rx_pending == n->net_conf.rx_coalesce_frames) {
+        virtio_net_rx_notify(q);
+    } else if (q->rx_pending == 1) {
+        timer_mod(q->rx_notify_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  n->net_conf.rx_coalesce_usecs * SCALE_US);
+    }
 
     return size;
 
@@ -2489,6 +2541,7 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
+    q->stats.tx_notifies++;
     virtio_notify(vdev, q->tx_vq);
 
     g_free(q->async_tx.elem);
@@ -2499,12 +2552,25 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+static int32_t virtio_net_flush_tx_queue(VirtIONetQueue *q);
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
+{
+    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    int32_t ret = virtio_net_flush_tx_queue(q);
+
+    /* Let the backend write out the whole burst at once */
+    qemu_net_flush_tx(qemu_get_subqueue(q->n->nic, queue_index));
+    return ret;
+}
+
+static int32_t virtio_net_flush_tx_queue(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     VirtQueueElement *elem;
     int32_t num_packets = 0;
+    int pushed = 0;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
@@ -2574,23 +2640,35 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
             out_sg = sg;
         }
 
+        q->stats.tx_packets++;
+        q->stats.tx_bytes += iov_size(out_sg, out_num) - n->host_hdr_len;
         ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
                                       out_sg, out_num, virtio_net_tx_complete);
         if (ret == 0) {
             virtio_queue_set_notification(q->tx_vq, 0);
             q->async_tx.elem = elem;
-            return -EBUSY;
+            num_packets = -EBUSY;
+            break;
         }
 
 drop:
         virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
         g_free(elem);
+        pushed++;
 
         if (++num_packets >= n->tx_burst) {
             break;
         }
     }
+
+    /*
+     * One interrupt for the whole burst; with event-idx virtio_notify()
+     * also skips it if the guest has not asked for one yet.
+     */
+    if (pushed) {
+        q->stats.tx_notifies++;
+        virtio_notify(vdev, q->tx_vq);
+    }
     return num_packets;
 }
 
@@ -2740,6 +2818,12 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_bh = qemu_bh_new(virtio_net_tx_bh, &n->vqs[index]);
     }
 
+    if (n->net_conf.rx_coalesce_usecs) {
+        n->vqs[index].rx_notify_timer =
+            timer_new_ns(QEMU_CLOCK_VIRTUAL, virtio_net_rx_notify_timer,
+                         &n->vqs[index]);
+    }
+
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
 }
@@ -2761,6 +2845,11 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
         q->tx_bh = NULL;
     }
     q->tx_waiting = 0;
+    if (q->rx_notify_timer) {
+        timer_free(q->rx_notify_timer);
+        q->rx_notify_timer = NULL;
+    }
+    q->rx_pending = 0;
     virtio_del_queue(vdev, index * 2 + 1);
 }
 
@@ -3412,6 +3501,12 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (n->net_conf.rx_coalesce_frames && !n->net_conf.rx_coalesce_usecs) {
+        error_setg(errp, "'rx-coalesce-frames' requires 'rx-coalesce-usecs'");
+        virtio_cleanup(vdev);
+        return;
+    }
+
     n->max_ncs = MAX(n->nic_conf.peers.queues, 1);
 
     /*
@@ -3675,6 +3770,10 @@ static Property virtio_net_properties[] = {
     DEFINE_PROP_UINT32("x-txtimer", VirtIONet, net_conf.txtimer,
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
+    DEFINE_PROP_UINT32("rx-coalesce-usecs", VirtIONet,
+                       net_conf.rx_coalesce_usecs, 0),
+    DEFINE_PROP_UINT32("rx-coalesce-frames", VirtIONet,
+                       net_conf.rx_coalesce_frames, 0),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
@@ -3714,6 +3813,48 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->primary_unplug_pending = primary_unplug_pending;
 }
 
+static int virtio_net_stats_foreach(Object *obj, void *opaque)
+{
+    VirtIONet *n = (VirtIONet *)object_dynamic_cast(obj, TYPE_VIRTIO_NET);
+    GString *buf = opaque;
+    g_autofree char *path = NULL;
+    int i;
+
+    if (!n || !DEVICE(n)->realized) {
+        return 0;
+    }
+
+    path = object_get_canonical_path(obj);
+    g_string_append_printf(buf, "%s:\n", path);
+    g_string_append_printf(buf, "%5s %12s %16s %10s %12s %12s %16s %12s\n",
+                           "queue", "rx-packets", "rx-bytes", "rx-nobuf",
+                           "rx-irqs", "tx-packets", "tx-bytes", "tx-irqs");
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        VirtIONetQueueStats *st = &n->vqs[i].stats;
+
+        g_string_append_printf(buf, "%5d %12" PRIu64 " %16" PRIu64
+                               " %10" PRIu64 " %12" PRIu64 " %12" PRIu64
+                               " %16" PRIu64 " %12" PRIu64 "\n",
+                               i, st->rx_packets, st->rx_bytes,
+                               st->rx_no_buffers, st->rx_notifies,
+                               st->tx_packets, st->tx_bytes, st->tx_notifies);
+    }
+    return 0;
+}
+
+HumanReadableText *qmp_x_query_virtio_net(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    object_child_foreach_recursive(object_get_root(),
+                                   virtio_net_stats_foreach, buf);
+    if (!buf->len) {
+        error_setg(errp, "No virtio-net device");
+        return NULL;
+    }
+    return human_readable_text_from_str(buf);
+}
+
 static const TypeInfo virtio_net_info = {
     .name = TYPE_VIRTIO_NET,
     .parent = TYPE_VIRTIO_DEVICE,
@@ -35,6 +35,7 @@
  *              mdts=<N[optional]>,vsl=<N[optional]>, \
  *              zoned.zasl=<N[optional]>, \
  *              zoned.auto_transition=<on|off[optional]>, \
+ *              dbbuf-poll-us=<N[optional]>, \
  *              subsys=<subsys_id>
  *      -device nvme-ns,drive=<drive_id>,bus=<bus_name>,nsid=<nsid>,\
  *              zoned=<true|false[optional]>, \
@@ -106,6 +107,14 @@
  *   transitioned to zone state closed for resource management purposes.
  *   Defaults to 'on'.
  *
+ * - `dbbuf-poll-us`
+ *   Once the host has set up shadow doorbells with the Doorbell Buffer Config
+ *   command, keep looking at the shadow tail of an I/O submission queue for
+ *   this many microseconds after the last command was fetched from it. The
+ *   event index is not updated meanwhile, so the host submits new commands
+ *   without writing the doorbell register. The default value is 0 (i.e. the
+ *   host rings the doorbell each time the queue has been drained).
+ *
  * nvme namespace device parameters
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * - `shared`
@@ -175,6 +184,7 @@
 #define NVME_TEMPERATURE_CRITICAL 0x175
 #define NVME_NUM_FW_SLOTS 1
 #define NVME_DEFAULT_MAX_ZA_SIZE (128 * KiB)
+#define NVME_SQ_POLL_INTERVAL_NS (10 * SCALE_US)
 
 #define NVME_GUEST_ERR(trace, fmt, ...) \
     do { \
@@ -220,6 +230,7 @@ static const uint32_t nvme_cse_acs[256] = {
     [NVME_ADM_CMD_GET_FEATURES]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_ASYNC_EV_REQ]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_NS_ATTACHMENT]    = NVME_CMD_EFF_CSUPP | NVME_CMD_EFF_NIC,
+    [NVME_ADM_CMD_DBBUF_CONFIG]     = NVME_CMD_EFF_CSUPP,
     [NVME_ADM_CMD_FORMAT_NVM]       = NVME_CMD_EFF_CSUPP | NVME_CMD_EFF_LBCC,
 };
 
@@ -437,6 +448,52 @@ static uint8_t nvme_sq_empty(NvmeSQueue *sq)
     return sq->head == sq->tail;
 }
 
+static void nvme_dbbuf_write(NvmeCtrl *n, hwaddr addr, uint32_t val)
+{
+    uint32_t v = cpu_to_le32(val);
+
+    pci_dma_write(&n->parent_obj, addr, &v, sizeof(v));
+}
+
+/* Values beyond the queue size are ignored, like doorbell writes are */
+static bool nvme_dbbuf_read(NvmeCtrl *n, hwaddr addr, uint32_t size,
+                            uint32_t *val)
+{
+    uint32_t v;
+
+    if (pci_dma_read(&n->parent_obj, addr, &v, sizeof(v))) {
+        return false;
+    }
+
+    v = le32_to_cpu(v);
+    if (v >= size) {
+        return false;
+    }
+
+    *val = v;
+    return true;
+}
+
+static void nvme_update_sq_tail(NvmeSQueue *sq)
+{
+    nvme_dbbuf_read(sq->ctrl, sq->db_addr, sq->size, &sq->tail);
+}
+
+static void nvme_update_sq_eventidx(NvmeSQueue *sq)
+{
+    nvme_dbbuf_write(sq->ctrl, sq->ei_addr, sq->tail);
+}
+
+static void nvme_update_cq_head(NvmeCQueue *cq)
+{
+    nvme_dbbuf_read(cq->ctrl, cq->db_addr, cq->size, &cq->head);
+}
+
+static void nvme_update_cq_eventidx(NvmeCQueue *cq)
+{
+    nvme_dbbuf_write(cq->ctrl, cq->ei_addr, cq->head);
+}
+
 static void nvme_irq_check(NvmeCtrl *n)
 {
     uint32_t intms = ldl_le_p(&n->bar.intms);
@@ -1270,9 +1327,14 @@ static void nvme_post_cqes(void *opaque)
     NvmeCQueue *cq = opaque;
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
-    bool pending = cq->head != cq->tail;
+    bool pending;
     int ret;
 
+    if (n->dbbuf_enabled) {
+        nvme_update_cq_head(cq);
+    }
+    pending = cq->head != cq->tail;
+
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
         NvmeSQueue *sq;
         hwaddr addr;
@@ -1299,6 +1361,22 @@ static void nvme_post_cqes(void *opaque)
         nvme_sg_unmap(&req->sg);
         QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
     }
+
+    /*
+     * The head only reaches the shadow doorbell as long as the event index
+     * lags behind it.  Have the host write the doorbell register when it is
+     * needed: to learn about free entries of a full queue, and to deassert
+     * a pin-based interrupt.
+     */
+    if (n->dbbuf_enabled &&
+        (nvme_cq_full(cq) || !msix_enabled(&n->parent_obj))) {
+        nvme_update_cq_eventidx(cq);
+        nvme_update_cq_head(cq);
+        if (!nvme_cq_full(cq) && !QTAILQ_EMPTY(&cq->req_list)) {
+            timer_mod(cq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
+        }
+    }
+
     if (cq->tail != cq->head) {
         if (cq->irq_enabled && !pending) {
             n->cq_pending++;
@@ -3990,6 +4068,7 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     sq->size = size;
     sq->cqid = cqid;
     sq->head = sq->tail = 0;
+    sq->poll_end = 0;
     sq->io_req = g_new0(NvmeRequest, sq->size);
 
     QTAILQ_INIT(&sq->req_list);
@@ -4000,6 +4079,11 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     }
     sq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_process_sq, sq);
 
+    if (n->dbbuf_enabled) {
+        sq->db_addr = n->dbbuf_dbs + (sqid << 3);
+        sq->ei_addr = n->dbbuf_eis + (sqid << 3);
+    }
+
     assert(n->cq[cqid]);
     cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
@@ -4359,6 +4443,10 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     cq->head = cq->tail = 0;
     QTAILQ_INIT(&cq->req_list);
     QTAILQ_INIT(&cq->sq_list);
+    if (n->dbbuf_enabled) {
+        cq->db_addr = n->dbbuf_dbs + (cqid << 3) + (1 << 2);
+        cq->ei_addr = n->dbbuf_eis + (cqid << 3) + (1 << 2);
+    }
     n->cq[cqid] = cq;
     cq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_post_cqes, cq);
 }
@@ -5469,6 +5557,46 @@ out:
     return status;
 }
 
+static uint16_t nvme_dbbuf_config(NvmeCtrl *n, const NvmeRequest *req)
+{
+    uint64_t dbs_addr = le64_to_cpu(req->cmd.dptr.prp1);
+    uint64_t eis_addr = le64_to_cpu(req->cmd.dptr.prp2);
+    int i;
+
+    trace_pci_nvme_dbbuf_config(dbs_addr, eis_addr);
+
+    /* Both buffers are one memory page */
+    if ((dbs_addr | eis_addr) & (n->page_size - 1)) {
+        return NVME_INVALID_FIELD | NVME_DNR;
+    }
+
+    n->dbbuf_dbs = dbs_addr;
+    n->dbbuf_eis = eis_addr;
+    n->dbbuf_enabled = true;
+
+    /* Same layout as the doorbell registers, with a stride of 4 bytes */
+    for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
+        NvmeSQueue *sq = n->sq[i];
+        NvmeCQueue *cq = n->cq[i];
+
+        if (sq) {
+            sq->db_addr = dbs_addr + (i << 3);
+            sq->ei_addr = eis_addr + (i << 3);
+            nvme_dbbuf_write(n, sq->db_addr, sq->tail);
+            nvme_update_sq_eventidx(sq);
+        }
+
+        if (cq) {
+            cq->db_addr = dbs_addr + (i << 3) + (1 << 2);
+            cq->ei_addr = eis_addr + (i << 3) + (1 << 2);
+            nvme_dbbuf_write(n, cq->db_addr, cq->head);
+            nvme_update_cq_eventidx(cq);
+        }
+    }
+
+    return NVME_SUCCESS;
+}
+
 static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
 {
     trace_pci_nvme_admin_cmd(nvme_cid(req), nvme_sqid(req), req->cmd.opcode,
@@ -5513,6 +5641,8 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
         return nvme_ns_attachment(n, req);
     case NVME_ADM_CMD_FORMAT_NVM:
         return nvme_format(n, req);
+    case NVME_ADM_CMD_DBBUF_CONFIG:
+        return nvme_dbbuf_config(n, req);
     default:
         assert(false);
     }
@@ -5520,6 +5650,39 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
     return NVME_INVALID_OPCODE | NVME_DNR;
 }
 
+/*
+ * Called when a submission queue with shadow doorbells has nothing left
+ * to process.  While polling an I/O queue, the event index is left behind
+ * the tail, so the host only updates the shadow doorbell when it submits,
+ * and the queue is looked at again every NVME_SQ_POLL_INTERVAL_NS.
+ * Otherwise the event index is brought up to the tail, so the next
+ * submission writes the doorbell register again.
+ */
+static void nvme_sq_idle(NvmeSQueue *sq, bool processed)
+{
+    NvmeCtrl *n = sq->ctrl;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (sq->sqid && n->params.dbbuf_poll_us) {
+        if (processed) {
+            sq->poll_end = now + n->params.dbbuf_poll_us * SCALE_US;
+        }
+
+        if (now < sq->poll_end) {
+            timer_mod(sq->timer, now + NVME_SQ_POLL_INTERVAL_NS);
+            return;
+        }
+    }
+
+    nvme_update_sq_eventidx(sq);
+
+    /* Catch a submission that raced with the event index update */
+    nvme_update_sq_tail(sq);
+    if (!(nvme_sq_empty(sq) || QTAILQ_EMPTY(&sq->req_list))) {
+        timer_mod(sq->timer, now + 500);
+    }
+}
+
 static void nvme_process_sq(void *opaque)
 {
     NvmeSQueue *sq = opaque;
@@ -5530,6 +5693,11 @@ static void nvme_process_sq(void *opaque)
     hwaddr addr;
     NvmeCmd cmd;
     NvmeRequest *req;
+    bool processed = false;
+
+    if (n->dbbuf_enabled) {
+        nvme_update_sq_tail(sq);
+    }
 
     while (!(nvme_sq_empty(sq) || QTAILQ_EMPTY(&sq->req_list))) {
         addr = sq->dma_addr + sq->head * n->sqe_size;
@@ -5537,9 +5705,10 @@ static void nvme_process_sq(void *opaque)
             trace_pci_nvme_err_addr_read(addr);
             trace_pci_nvme_err_cfs();
             stl_le_p(&n->bar.csts, NVME_CSTS_FAILED);
-            break;
+            return;
         }
         nvme_inc_sq_head(sq);
+        processed = true;
 
         req = QTAILQ_FIRST(&sq->req_list);
         QTAILQ_REMOVE(&sq->req_list, req, entry);
@@ -5554,6 +5723,14 @@ static void nvme_process_sq(void *opaque)
             req->status = status;
             nvme_enqueue_req_completion(cq, req);
         }
+
+        if (n->dbbuf_enabled && nvme_sq_empty(sq)) {
+            nvme_update_sq_tail(sq);
+        }
+    }
+
+    if (n->dbbuf_enabled) {
+        nvme_sq_idle(sq, processed);
     }
 }
 
@@ -5591,6 +5768,10 @@ static void nvme_ctrl_reset(NvmeCtrl *n)
     n->aer_queued = 0;
     n->outstanding_aers = 0;
     n->qs_created = false;
+
+    n->dbbuf_dbs = 0;
+    n->dbbuf_eis = 0;
+    n->dbbuf_enabled = false;
 }
 
 static void nvme_ctrl_shutdown(NvmeCtrl *n)
@@ -6100,6 +6281,9 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         start_sqs = nvme_cq_full(cq) ? 1 : 0;
         cq->head = new_head;
+        if (!qid && n->dbbuf_enabled) {
+            nvme_dbbuf_write(n, cq->db_addr, cq->head);
+        }
         if (start_sqs) {
             NvmeSQueue *sq;
             QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
@@ -6157,6 +6341,13 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
         trace_pci_nvme_mmio_doorbell_sq(sq->sqid, new_tail);
 
         sq->tail = new_tail;
+        if (!qid && n->dbbuf_enabled) {
+            /*
+             * The host need not update the shadow doorbell of the admin
+             * queue; keep it current so that it is never read back stale.
+             */
+            nvme_dbbuf_write(n, sq->db_addr, sq->tail);
+        }
         timer_mod(sq->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + 500);
     }
 }
@@ -6434,7 +6625,8 @@ static void nvme_init_ctrl(NvmeCtrl *n, PCIDevice *pci_dev)
 
     id->mdts = n->params.mdts;
     id->ver = cpu_to_le32(NVME_SPEC_VER);
-    id->oacs = cpu_to_le16(NVME_OACS_NS_MGMT | NVME_OACS_FORMAT);
+    id->oacs = cpu_to_le16(NVME_OACS_NS_MGMT | NVME_OACS_FORMAT |
+                           NVME_OACS_DBBUF);
     id->cntrltype = 0x1;
 
     /*
@@ -6622,6 +6814,7 @@ static Property nvme_props[] = {
     DEFINE_PROP_UINT8("vsl", NvmeCtrl, params.vsl, 7),
     DEFINE_PROP_BOOL("use-intel-id", NvmeCtrl, params.use_intel_id, false),
     DEFINE_PROP_BOOL("legacy-cmb", NvmeCtrl, params.legacy_cmb, false),
+    DEFINE_PROP_UINT32("dbbuf-poll-us", NvmeCtrl, params.dbbuf_poll_us, 0),
     DEFINE_PROP_UINT8("zoned.zasl", NvmeCtrl, params.zasl, 0),
     DEFINE_PROP_BOOL("zoned.auto_transition", NvmeCtrl,
                      params.auto_transition_zones, true),
@@ -122,8 +122,13 @@ void sdbus_write_data(SDBus *sdbus, const void *buf, size_t length)
 
     if (card) {
         SDCardClass *sc = SD_CARD_GET_CLASS(card);
+        size_t i = 0;
 
-        for (size_t i = 0; i < length; i++) {
+        if (sc->write_data) {
+            i = sc->write_data(card, data, length);
+            trace_sdbus_write_data(sdbus_name(sdbus), i);
+        }
+        for (; i < length; i++) {
             trace_sdbus_write(sdbus_name(sdbus), data[i]);
             sc->write_byte(card, data[i]);
         }
@@ -152,14 +157,67 @@ void sdbus_read_data(SDBus *sdbus, void *buf, size_t length)
 
     if (card) {
         SDCardClass *sc = SD_CARD_GET_CLASS(card);
+        size_t i = 0;
 
-        for (size_t i = 0; i < length; i++) {
+        if (sc->read_data) {
+            i = sc->read_data(card, data, length);
+            trace_sdbus_read_data(sdbus_name(sdbus), i);
+        }
+        for (; i < length; i++) {
             data[i] = sc->read_byte(card);
             trace_sdbus_read(sdbus_name(sdbus), data[i]);
         }
     }
 }
 
+/*
+ * Transfer between the card and guest memory, mapped when possible.
+ * Whatever cannot be mapped goes through a small bounce buffer.
+ */
+static void sdbus_transfer_dma(SDBus *sdbus, AddressSpace *as,
+                               dma_addr_t addr, size_t length,
+                               DMADirection dir)
+{
+    uint8_t bounce[512];
+
+    while (length) {
+        dma_addr_t len = length;
+        void *buf = dma_memory_map(as, addr, &len, dir);
+
+        if (!buf) {
+            len = MIN(length, sizeof(bounce));
+            if (dir == DMA_DIRECTION_TO_DEVICE) {
+                dma_memory_read(as, addr, bounce, len);
+                sdbus_write_data(sdbus, bounce, len);
+            } else {
+                sdbus_read_data(sdbus, bounce, len);
+                dma_memory_write(as, addr, bounce, len);
+            }
+        } else {
+            if (dir == DMA_DIRECTION_TO_DEVICE) {
+                sdbus_write_data(sdbus, buf, len);
+            } else {
+                sdbus_read_data(sdbus, buf, len);
+            }
+            dma_memory_unmap(as, buf, len, dir, len);
+        }
+        addr += len;
+        length -= len;
+    }
+}
+
+void sdbus_write_data_dma(SDBus *sdbus, AddressSpace *as, dma_addr_t addr,
+                          size_t length)
+{
+    sdbus_transfer_dma(sdbus, as, addr, length, DMA_DIRECTION_TO_DEVICE);
+}
+
+void sdbus_read_data_dma(SDBus *sdbus, AddressSpace *as, dma_addr_t addr,
+                         size_t length)
+{
+    sdbus_transfer_dma(sdbus, as, addr, length, DMA_DIRECTION_FROM_DEVICE);
+}
+
 bool sdbus_receive_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
@@ -0,0 +1,355 @@
+/*
+ * QEMU model of the Canon DIGIC SD host controller.
+ *
+ * The controller sends a command to the card when the guest writes its
+ * CMD register, then moves the data that goes with it either through
+ * the DATA register or, with DIGIC_SDHOST_CMD_DMA, by DMA of BLKCNT
+ * blocks of BLKSIZE bytes at DMA_ADDR.  A DMA transfer is done as one
+ * multi-block request to the card, straight to or from guest memory,
+ * and completes before the CMD write returns; the DATA_DONE status bit
+ * and the interrupt then signal it.
+ *
+ * Only the registers that the SD stack of the firmware needs to issue
+ * commands and transfer blocks are modelled.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/sd/digic-sdhost.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "migration/vmstate.h"
+#include "exec/address-spaces.h"
+#include "trace.h"
+
+/* CMD register */
+#define DIGIC_SDHOST_CMD_INDEX_MASK     0x3f
+#define DIGIC_SDHOST_CMD_RSP_SHORT      (1 << 8)
+#define DIGIC_SDHOST_CMD_RSP_LONG       (1 << 9)
+#define DIGIC_SDHOST_CMD_DATA           (1 << 10)
+#define DIGIC_SDHOST_CMD_WRITE          (1 << 11)
+#define DIGIC_SDHOST_CMD_DMA            (1 << 12)
+
+/* STATUS register; the low bits are cleared by writing 1 */
+#define DIGIC_SDHOST_ST_CMD_DONE        (1 << 0)
+#define DIGIC_SDHOST_ST_DATA_DONE       (1 << 1)
+#define DIGIC_SDHOST_ST_CMD_ERROR       (1 << 2)
+#define DIGIC_SDHOST_ST_DATA_ERROR      (1 << 3)
+#define DIGIC_SDHOST_ST_IRQ_MASK        0xf
+#define DIGIC_SDHOST_ST_INSERTED        (1 << 8)
+#define DIGIC_SDHOST_ST_READONLY        (1 << 9)
+#define DIGIC_SDHOST_ST_TX_READY        (1 << 10)
+#define DIGIC_SDHOST_ST_RX_READY        (1 << 11)
+
+#define DIGIC_SDHOST_BLKSIZE_MAX        4096
+
+static void digic_sdhost_update_irq(DigicSDHostState *s)
+{
+    uint32_t irq = s->status & s->irq_en & DIGIC_SDHOST_ST_IRQ_MASK;
+
+    trace_digic_sdhost_update_irq(irq);
+    qemu_set_irq(s->irq, !!irq);
+}
+
+static void digic_sdhost_do_dma(DigicSDHostState *s)
+{
+    uint64_t len = (uint64_t)s->blksize * s->blkcnt;
+
+    trace_digic_sdhost_dma(s->dma_addr, len,
+                           !!(s->cmd & DIGIC_SDHOST_CMD_WRITE));
+    if (s->cmd & DIGIC_SDHOST_CMD_WRITE) {
+        sdbus_write_data_dma(&s->sdbus, &s->dma_as, s->dma_addr, len);
+    } else {
+        sdbus_read_data_dma(&s->sdbus, &s->dma_as, s->dma_addr, len);
+    }
+    s->dma_addr += len;
+    s->blkcnt = 0;
+    s->status |= DIGIC_SDHOST_ST_DATA_DONE;
+}
+
+static void digic_sdhost_send_command(DigicSDHostState *s)
+{
+    SDRequest request;
+    uint8_t rsp[16];
+    int rlen;
+
+    request.cmd = s->cmd & DIGIC_SDHOST_CMD_INDEX_MASK;
+    request.arg = s->arg;
+    trace_digic_sdhost_command(request.cmd, request.arg);
+
+    s->status &= ~DIGIC_SDHOST_ST_IRQ_MASK;
+    s->data_left = 0;
+    rlen = sdbus_do_command(&s->sdbus, &request, rsp);
+
+    if ((s->cmd & DIGIC_SDHOST_CMD_RSP_LONG) && rlen == 16) {
+        s->resp[0] = ldl_be_p(&rsp[12]);
+        s->resp[1] = ldl_be_p(&rsp[8]);
+        s->resp[2] = ldl_be_p(&rsp[4]);
+        s->resp[3] = ldl_be_p(&rsp[0]);
+    } else if ((s->cmd & DIGIC_SDHOST_CMD_RSP_SHORT) && rlen == 4) {
+        s->resp[0] = ldl_be_p(&rsp[0]);
+        s->resp[1] = s->resp[2] = s->resp[3] = 0;
+    } else if (s->cmd & (DIGIC_SDHOST_CMD_RSP_SHORT |
+                         DIGIC_SDHOST_CMD_RSP_LONG)) {
+        s->status |= DIGIC_SDHOST_ST_CMD_ERROR;
+        if (s->cmd & DIGIC_SDHOST_CMD_DATA) {
+            s->status |= DIGIC_SDHOST_ST_DATA_ERROR;
+        }
+        goto done;
+    }
+    s->status |= DIGIC_SDHOST_ST_CMD_DONE;
+
+    if (s->cmd & DIGIC_SDHOST_CMD_DATA) {
+        if (s->cmd & DIGIC_SDHOST_CMD_DMA) {
+            digic_sdhost_do_dma(s);
+        } else {
+            s->data_left = s->blksize * s->blkcnt;
+        }
+    }
+
+done:
+    digic_sdhost_update_irq(s);
+}
+
+static uint32_t digic_sdhost_read_status(DigicSDHostState *s)
+{
+    uint32_t status = s->status;
+
+    if (sdbus_get_inserted(&s->sdbus)) {
+        status |= DIGIC_SDHOST_ST_INSERTED;
+    }
+    if (sdbus_get_readonly(&s->sdbus)) {
+        status |= DIGIC_SDHOST_ST_READONLY;
+    }
+    if (s->data_left && sdbus_receive_ready(&s->sdbus)) {
+        status |= DIGIC_SDHOST_ST_TX_READY;
+    }
+    if (s->data_left && sdbus_data_ready(&s->sdbus)) {
+        status |= DIGIC_SDHOST_ST_RX_READY;
+    }
+    return status;
+}
+
+/* A PIO access moves the next (up to) 4 bytes of the transfer */
+static void digic_sdhost_pio_done(DigicSDHostState *s, uint32_t len)
+{
+    s->data_left -= len;
+    if (!s->data_left) {
+        s->blkcnt = 0;
+        s->status |= DIGIC_SDHOST_ST_DATA_DONE;
+        digic_sdhost_update_irq(s);
+    }
+}
+
+static uint64_t digic_sdhost_read(void *opaque, hwaddr addr, unsigned size)
+{
+    DigicSDHostState *s = opaque;
+    uint64_t ret = 0;
+    uint8_t buf[4] = { 0 };
+    uint32_t len;
+
+    addr >>= 2;
+
+    switch (addr) {
+    case R_SDHOST_CMD:
+        ret = s->cmd;
+        break;
+    case R_SDHOST_ARG:
+        ret = s->arg;
+        break;
+    case R_SDHOST_STATUS:
+        ret = digic_sdhost_read_status(s);
+        break;
+    case R_SDHOST_IRQ_EN:
+        ret = s->irq_en;
+        break;
+    case R_SDHOST_RESP0 ... R_SDHOST_RESP3:
+        ret = s->resp[addr - R_SDHOST_RESP0];
+        break;
+    case R_SDHOST_BLKSIZE:
+        ret = s->blksize;
+        break;
+    case R_SDHOST_BLKCNT:
+        ret = s->blkcnt;
+        break;
+    case R_SDHOST_DMA_ADDR:
+        ret = s->dma_addr;
+        break;
+    case R_SDHOST_DATA:
+        if (!s->data_left || (s->cmd & DIGIC_SDHOST_CMD_WRITE)) {
+            break;
+        }
+        len = MIN(s->data_left, sizeof(buf));
+        sdbus_read_data(&s->sdbus, buf, len);
+        ret = ldl_le_p(buf);
+        digic_sdhost_pio_done(s, len);
+        break;
+
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), false);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-sdhost: read access to unknown register 0x%"
+                      HWADDR_PRIx "\n", addr << 2);
+    }
+
+    trace_digic_sdhost_read(addr << 2, ret);
+    return ret;
+}
+
+static void digic_sdhost_write(void *opaque, hwaddr addr, uint64_t value,
+                               unsigned size)
+{
+    DigicSDHostState *s = opaque;
+    uint8_t buf[4];
+    uint32_t len;
+
+    trace_digic_sdhost_write(addr, value);
+    addr >>= 2;
+
+    switch (addr) {
+    case R_SDHOST_CMD:
+        s->cmd = value;
+        digic_sdhost_send_command(s);
+        break;
+    case R_SDHOST_ARG:
+        s->arg = value;
+        break;
+    case R_SDHOST_STATUS:
+        s->status &= ~(value & DIGIC_SDHOST_ST_IRQ_MASK);
+        digic_sdhost_update_irq(s);
+        break;
+    case R_SDHOST_IRQ_EN:
+        s->irq_en = value & DIGIC_SDHOST_ST_IRQ_MASK;
+        digic_sdhost_update_irq(s);
+        break;
+    case R_SDHOST_BLKSIZE:
+        if (value > DIGIC_SDHOST_BLKSIZE_MAX) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "digic-sdhost: block size %" PRIu64 " too large\n",
+                          value);
+            value = DIGIC_SDHOST_BLKSIZE_MAX;
+        }
+        s->blksize = value;
+        break;
+    case R_SDHOST_BLKCNT:
+        s->blkcnt = value & 0xffff;
+        break;
+    case R_SDHOST_DMA_ADDR:
+        s->dma_addr = value;
+        break;
+    case R_SDHOST_DATA:
+        if (!s->data_left || !(s->cmd & DIGIC_SDHOST_CMD_WRITE)) {
+            break;
+        }
+        len = MIN(s->data_left, sizeof(buf));
+        stl_le_p(buf, value);
+        sdbus_write_data(&s->sdbus, buf, len);
+        digic_sdhost_pio_done(s, len);
+        break;
+
+    default:
+        digic_mmio_stats_record(s->regs_region.addr + (addr << 2), true);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-sdhost: write access to unknown register 0x%"
+                      HWADDR_PRIx "\n", addr << 2);
+    }
+}
+
+static const MemoryRegionOps digic_sdhost_ops = {
+    .read = digic_sdhost_read,
+    .write = digic_sdhost_write,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+static void digic_sdhost_reset(DeviceState *dev)
+{
+    DigicSDHostState *s = DIGIC_SDHOST(dev);
+
+    s->cmd = 0;
+    s->arg = 0;
+    s->status = 0;
+    s->irq_en = 0;
+    memset(s->resp, 0, sizeof(s->resp));
+    s->blksize = 512;
+    s->blkcnt = 0;
+    s->dma_addr = 0;
+    s->data_left = 0;
+}
+
+static const VMStateDescription vmstate_digic_sdhost = {
+    .name = TYPE_DIGIC_SDHOST,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(cmd, DigicSDHostState),
+        VMSTATE_UINT32(arg, DigicSDHostState),
+        VMSTATE_UINT32(status, DigicSDHostState),
+        VMSTATE_UINT32(irq_en, DigicSDHostState),
+        VMSTATE_UINT32_ARRAY(resp, DigicSDHostState, 4),
+        VMSTATE_UINT32(blksize, DigicSDHostState),
+        VMSTATE_UINT32(blkcnt, DigicSDHostState),
+        VMSTATE_UINT32(dma_addr, DigicSDHostState),
+        VMSTATE_UINT32(data_left, DigicSDHostState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void digic_sdhost_init(Object *obj)
+{
+    DigicSDHostState *s = DIGIC_SDHOST(obj);
+
+    qbus_init(&s->sdbus, sizeof(s->sdbus), TYPE_SD_BUS, DEVICE(s), "sd-bus");
+
+    memory_region_init_io(&s->regs_region, obj, &digic_sdhost_ops, s,
+                          TYPE_DIGIC_SDHOST, 0x100);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->regs_region);
+    sysbus_init_irq(SYS_BUS_DEVICE(s), &s->irq);
+}
+
+static void digic_sdhost_realize(DeviceState *dev, Error **errp)
+{
+    DigicSDHostState *s = DIGIC_SDHOST(dev);
+
+    address_space_init(&s->dma_as, s->dma_mr ?: get_system_memory(),
+                       "digic-sdhost-dma");
+}
+
+static Property digic_sdhost_properties[] = {
+    DEFINE_PROP_LINK("dma", DigicSDHostState, dma_mr, TYPE_MEMORY_REGION,
+                     MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void digic_sdhost_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = digic_sdhost_realize;
+    dc->reset = digic_sdhost_reset;
+    dc->vmsd = &vmstate_digic_sdhost;
+    device_class_set_props(dc, digic_sdhost_properties);
+}
+
+static const TypeInfo digic_sdhost_info = {
+    .name          = TYPE_DIGIC_SDHOST,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DigicSDHostState),
+    .instance_init = digic_sdhost_init,
+    .class_init    = digic_sdhost_class_init,
+};
+
+static void digic_sdhost_register_types(void)
+{
+    type_register_static(&digic_sdhost_info);
+}
+
+type_init(digic_sdhost_register_types)
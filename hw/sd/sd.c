@@ -36,6 +36,7 @@
 #include "hw/irq.h"
 #include "hw/registerfields.h"
 #include "sysemu/block-backend.h"
+#include "block/aio-wait.h"
 #include "hw/sd/sd.h"
 #include "hw/sd/sdcard_legacy.h"
 #include "migration/vmstate.h"
@@ -109,6 +110,7 @@ struct SDState {
     uint8_t spec_version;
     BlockBackend *blk;
     bool spi;
+    bool aio;
 
     /* Runtime changeables */
 
@@ -135,6 +137,13 @@ struct SDState {
     uint64_t data_start;
     uint32_t data_offset;
     uint8_t data[512];
+    /* Block request in flight on sd->data, in async mode */
+    QEMUIOVector aio_qiov;
+    bool aio_busy;
+    /* sd->data holds (or will hold) the next block to read */
+    bool aio_loaded;
+    /* State to enter once the request in flight completes a write */
+    int32_t aio_state;
     qemu_irq readonly_cb;
     qemu_irq inserted_cb;
     QEMUTimer *ocr_power_timer;
@@ -542,6 +551,8 @@ static inline uint64_t sd_addr_to_wpnum(uint64_t addr)
     return addr >> (HWBLOCK_SHIFT + SECTOR_SHIFT + WPGROUP_SHIFT);
 }
 
+static void sd_aio_wait(SDState *sd);
+
 static void sd_reset(DeviceState *dev)
 {
     SDState *sd = SD_CARD(dev);
@@ -549,6 +560,8 @@ static void sd_reset(DeviceState *dev)
     uint64_t sect;
 
     trace_sdcard_reset();
+    sd_aio_wait(sd);
+    sd->aio_loaded = false;
     if (sd->blk) {
         blk_get_geometry(sd->blk, &sect);
     } else {
@@ -646,6 +659,16 @@ static const VMStateDescription sd_ocr_vmstate = {
     },
 };
 
+static int sd_vmstate_pre_save(void *opaque)
+{
+    SDState *sd = opaque;
+
+    /* Requests in flight are not migrated, nor is the block they read */
+    sd_aio_wait(sd);
+
+    return 0;
+}
+
 static int sd_vmstate_pre_load(void *opaque)
 {
     SDState *sd = opaque;
@@ -664,6 +687,7 @@ static const VMStateDescription sd_vmstate = {
     .version_id = 2,
     .minimum_version_id = 2,
     .pre_load = sd_vmstate_pre_load,
+    .pre_save = sd_vmstate_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(mode, SDState),
         VMSTATE_INT32(state, SDState),
@@ -748,14 +772,84 @@ static void sd_blk_read(SDState *sd, uint64_t addr, uint32_t len)
     }
 }
 
+/*
+ * In async mode ("x-aio"), block requests run while the guest does, on
+ * sd->data.  The card is not data-ready or receive-ready until they
+ * complete; and a write leaves it in the programming state until then,
+ * as real cards do.  Anything that needs sd->data or the final state
+ * first waits for the request with sd_aio_wait().
+ */
+static void sd_aio_cb(void *opaque, int ret)
+{
+    SDState *sd = opaque;
+
+    if (ret < 0) {
+        fprintf(stderr, "sd_aio_cb: I/O error on host side\n");
+    }
+    trace_sdcard_aio_done(ret);
+    sd->aio_busy = false;
+    if (sd->state == sd_programming_state) {
+        sd->state = sd->aio_state;
+    }
+}
+
+static void sd_aio_wait(SDState *sd)
+{
+    if (sd->aio_busy) {
+        AIO_WAIT_WHILE(blk_get_aio_context(sd->blk), sd->aio_busy);
+    }
+}
+
+/* Start reading the next block in async mode, for sd_aio_take_block() */
+static void sd_aio_read_block(SDState *sd, uint64_t addr, uint32_t len)
+{
+    if (!sd->aio || addr + len > sd->size) {
+        return;
+    }
+
+    trace_sdcard_read_block(addr, len);
+    assert(!sd->aio_busy);
+    qemu_iovec_init_buf(&sd->aio_qiov, sd->data, len);
+    sd->aio_busy = true;
+    sd->aio_loaded = true;
+    blk_aio_preadv(sd->blk, addr, &sd->aio_qiov, 0, sd_aio_cb, sd);
+}
+
+/* Whether sd->data holds the block that sd_aio_read_block() read */
+static bool sd_aio_take_block(SDState *sd)
+{
+    bool loaded = sd->aio_loaded;
+
+    sd_aio_wait(sd);
+    sd->aio_loaded = false;
+    return loaded;
+}
+
 static void sd_blk_write(SDState *sd, uint64_t addr, uint32_t len)
 {
     trace_sdcard_write_block(addr, len);
+    if (sd->blk && sd->aio) {
+        assert(!sd->aio_busy);
+        qemu_iovec_init_buf(&sd->aio_qiov, sd->data, len);
+        sd->aio_busy = true;
+        blk_aio_pwritev(sd->blk, addr, &sd->aio_qiov, 0, sd_aio_cb, sd);
+        return;
+    }
     if (!sd->blk || blk_pwrite(sd->blk, addr, sd->data, len, 0) < 0) {
         fprintf(stderr, "sd_blk_write: write error on host side\n");
     }
 }
 
+/* Leave the programming state, once the write completes in async mode */
+static void sd_blk_write_done(SDState *sd, enum SDCardStates state)
+{
+    if (sd->aio_busy) {
+        sd->aio_state = state;
+    } else {
+        sd->state = state;
+    }
+}
+
 #define BLK_READ_BLOCK(a, len)  sd_blk_read(sd, a, len)
 #define BLK_WRITE_BLOCK(a, len) sd_blk_write(sd, a, len)
 #define APP_READ_BLOCK(a, len)  memset(sd->data, 0xec, len)
@@ -1245,6 +1339,8 @@ static sd_rsp_type_t sd_normal_command(SDState *sd, SDRequest req)
             sd->state = sd_sendingdata_state;
             sd->data_start = addr;
             sd->data_offset = 0;
+            sd_aio_read_block(sd, addr,
+                              (sd->ocr & (1 << 30)) ? 512 : sd->blk_len);
             return sd_r1;
 
         default:
@@ -1724,6 +1820,12 @@ int sd_do_command(SDState *sd, SDRequest *req,
         req->cmd &= 0x3f;
     }
 
+    /* SEND_STATUS may poll for the end of programming */
+    if (req->cmd != 13 || sd->expecting_acmd) {
+        sd_aio_wait(sd);
+        sd->aio_loaded = false;
+    }
+
     if (sd->card_status & CARD_IS_LOCKED) {
         if (!cmd_valid_while_locked(sd, req->cmd)) {
             sd->card_status |= ILLEGAL_COMMAND;
@@ -1818,6 +1920,9 @@ void sd_write_byte(SDState *sd, uint8_t value)
     if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable)
         return;
 
+    /* For controllers that do not wait for sd_receive_ready() */
+    sd_aio_wait(sd);
+
     if (sd->state != sd_receivingdata_state) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: not in Receiving-Data state\n", __func__);
@@ -1840,7 +1945,7 @@ void sd_write_byte(SDState *sd, uint8_t value)
             sd->blk_written ++;
             sd->csd[14] |= 0x40;
             /* Bzzzzzzztt .... Operation complete.  */
-            sd->state = sd_transfer_state;
+            sd_blk_write_done(sd, sd_transfer_state);
         }
         break;
 
@@ -1872,12 +1977,12 @@ void sd_write_byte(SDState *sd, uint8_t value)
             if (sd->multi_blk_cnt != 0) {
                 if (--sd->multi_blk_cnt == 0) {
                     /* Stop! */
-                    sd->state = sd_transfer_state;
+                    sd_blk_write_done(sd, sd_transfer_state);
                     break;
                 }
             }
 
-            sd->state = sd_receivingdata_state;
+            sd_blk_write_done(sd, sd_receivingdata_state);
         }
         break;
 
@@ -1949,6 +2054,70 @@ void sd_write_byte(SDState *sd, uint8_t value)
     }
 }
 
+/*
+ * Write as many whole blocks of a CMD24 or CMD25 transfer as @length
+ * holds, straight from @buf with a single request.  Returns the number
+ * of bytes written, which may be 0; sd_write_byte() handles the rest,
+ * and any error the card has to report.
+ */
+static size_t sd_write_data(SDState *sd, const void *buf, size_t length)
+{
+    uint64_t nblocks;
+    uint64_t n;
+
+    sd_aio_wait(sd);
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->state != sd_receivingdata_state || sd->data_offset != 0 ||
+        (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        return 0;
+    }
+
+    switch (sd->current_cmd) {
+    case 24:    /* CMD24:  WRITE_SINGLE_BLOCK */
+        nblocks = 1;
+        break;
+    case 25:    /* CMD25:  WRITE_MULTIPLE_BLOCK */
+        nblocks = sd->multi_blk_cnt ? sd->multi_blk_cnt : UINT32_MAX;
+        break;
+    default:
+        return 0;
+    }
+    nblocks = MIN(nblocks, length / sd->blk_len);
+
+    /* Stop before the first block that sd_write_byte() would reject */
+    for (n = 0; n < nblocks; n++) {
+        uint64_t addr = sd->data_start + n * sd->blk_len;
+
+        if (addr + sd->blk_len > sd->size ||
+            (sd->size <= SDSC_MAX_CAPACITY && sd_wp_addr(sd, addr))) {
+            break;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    /* TODO: Check CRC before committing */
+    sd->state = sd_programming_state;
+    trace_sdcard_write_block(sd->data_start, n * sd->blk_len);
+    if (blk_pwrite(sd->blk, sd->data_start, buf, n * sd->blk_len, 0) < 0) {
+        fprintf(stderr, "sd_write_data: write error on host side\n");
+    }
+    sd->blk_written += n;
+    sd->csd[14] |= 0x40;
+    /* Bzzzzzzztt .... Operation complete.  */
+    sd->state = sd_transfer_state;
+
+    if (sd->current_cmd == 25) {
+        sd->data_start += n * sd->blk_len;
+        if (sd->multi_blk_cnt == 0 || (sd->multi_blk_cnt -= n) != 0) {
+            sd->state = sd_receivingdata_state;
+        }
+    }
+
+    return n * sd->blk_len;
+}
+
 #define SD_TUNING_BLOCK_SIZE    64
 
 static const uint8_t sd_tuning_block_pattern[SD_TUNING_BLOCK_SIZE] = {
@@ -2010,7 +2179,7 @@ uint8_t sd_read_byte(SDState *sd)
         break;
 
     case 17:	/* CMD17:  READ_SINGLE_BLOCK */
-        if (sd->data_offset == 0)
+        if (sd->data_offset == 0 && !sd_aio_take_block(sd))
             BLK_READ_BLOCK(sd->data_start, io_len);
         ret = sd->data[sd->data_offset ++];
 
@@ -2024,7 +2193,9 @@ uint8_t sd_read_byte(SDState *sd)
                                   sd->data_start, io_len)) {
                 return 0x00;
             }
-            BLK_READ_BLOCK(sd->data_start, io_len);
+            if (!sd_aio_take_block(sd)) {
+                BLK_READ_BLOCK(sd->data_start, io_len);
+            }
         }
         ret = sd->data[sd->data_offset ++];
 
@@ -2039,6 +2210,7 @@ uint8_t sd_read_byte(SDState *sd)
                     break;
                 }
             }
+            sd_aio_read_block(sd, sd->data_start, io_len);
         }
         break;
 
@@ -2087,14 +2259,76 @@ uint8_t sd_read_byte(SDState *sd)
     return ret;
 }
 
+/*
+ * Read as many whole blocks of a CMD17 or CMD18 transfer as @length
+ * holds, straight into @buf with a single request.  Returns the number
+ * of bytes read, which may be 0; sd_read_byte() handles the rest, and
+ * any error the card has to report.
+ */
+static size_t sd_read_data(SDState *sd, void *buf, size_t length)
+{
+    uint32_t io_len;
+    uint64_t nblocks;
+
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->state != sd_sendingdata_state || sd->data_offset != 0 ||
+        (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        return 0;
+    }
+
+    io_len = (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+    switch (sd->current_cmd) {
+    case 17:    /* CMD17:  READ_SINGLE_BLOCK */
+        nblocks = 1;
+        break;
+    case 18:    /* CMD18:  READ_MULTIPLE_BLOCK */
+        nblocks = sd->multi_blk_cnt ? sd->multi_blk_cnt : UINT32_MAX;
+        /* Stop before the first block that sd_read_byte() would reject */
+        if (sd->data_start > sd->size) {
+            return 0;
+        }
+        nblocks = MIN(nblocks, (sd->size - sd->data_start) / io_len);
+        break;
+    default:
+        return 0;
+    }
+    nblocks = MIN(nblocks, length / io_len);
+    if (nblocks == 0) {
+        return 0;
+    }
+
+    /* This reads the block that may have been read ahead again */
+    sd_aio_take_block(sd);
+    trace_sdcard_read_block(sd->data_start, nblocks * io_len);
+    if (blk_pread(sd->blk, sd->data_start, buf, nblocks * io_len) < 0) {
+        fprintf(stderr, "sd_read_data: read error on host side\n");
+    }
+
+    if (sd->current_cmd == 17) {
+        sd->state = sd_transfer_state;
+    } else {
+        sd->data_start += nblocks * io_len;
+        if (sd->multi_blk_cnt != 0) {
+            sd->multi_blk_cnt -= nblocks;
+            if (sd->multi_blk_cnt == 0) {
+                sd->state = sd_transfer_state;
+                return nblocks * io_len;
+            }
+        }
+        sd_aio_read_block(sd, sd->data_start, io_len);
+    }
+
+    return nblocks * io_len;
+}
+
 static bool sd_receive_ready(SDState *sd)
 {
-    return sd->state == sd_receivingdata_state;
+    return sd->state == sd_receivingdata_state && !sd->aio_busy;
 }
 
 static bool sd_data_ready(SDState *sd)
 {
-    return sd->state == sd_sendingdata_state;
+    return sd->state == sd_sendingdata_state && !sd->aio_busy;
 }
 
 void sd_enable(SDState *sd, bool enable)
@@ -2181,6 +2415,8 @@ static Property sd_properties[] = {
      * board to ensure that ssi transfers only occur when the chip select
      * is asserted.  */
     DEFINE_PROP_BOOL("spi", SDState, spi, false),
+    /* Do not block the vCPU on block accesses; see sd_aio_cb() */
+    DEFINE_PROP_BOOL("x-aio", SDState, aio, false),
     DEFINE_PROP_END_OF_LIST()
 };
 
@@ -2202,6 +2438,8 @@ static void sd_class_init(ObjectClass *klass, void *data)
     sc->do_command = sd_do_command;
     sc->write_byte = sd_write_byte;
     sc->read_byte = sd_read_byte;
+    sc->write_data = sd_write_data;
+    sc->read_data = sd_read_data;
     sc->receive_ready = sd_receive_ready;
     sc->data_ready = sd_data_ready;
     sc->enable = sd_enable;
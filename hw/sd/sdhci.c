@@ -577,6 +577,24 @@ static void sdhci_write_dataport(SDHCIState *s, uint32_t value, unsigned size)
  * Single DMA data transfer
  */
 
+/*
+ * Number of whole blocks that a multi block SDMA transfer can move in one
+ * go: all of them, but for the blocks past the next boundary interrupt.
+ */
+static uint32_t sdhci_sdma_whole_blocks(SDHCIState *s, bool page_aligned,
+                                        uint32_t boundary_count)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+
+    if (!block_size) {
+        return 0;
+    }
+    if (page_aligned) {
+        return MIN(s->blkcnt, boundary_count / block_size);
+    }
+    return s->blkcnt;
+}
+
 /* Multi block SDMA transfer */
 static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
 {
@@ -603,6 +621,20 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
         s->prnsts |= SDHC_DOING_READ;
         while (s->blkcnt) {
             if (s->data_count == 0) {
+                uint32_t n = sdhci_sdma_whole_blocks(s, page_aligned,
+                                                     boundary_count);
+
+                if (n) {
+                    sdbus_read_data_dma(&s->sdbus, s->dma_as, s->sdmasysad,
+                                        n * block_size);
+                    s->sdmasysad += n * block_size;
+                    boundary_count -= n * block_size;
+                    s->blkcnt -= n;
+                    if (page_aligned && boundary_count == 0) {
+                        break;
+                    }
+                    continue;
+                }
                 sdbus_read_data(&s->sdbus, s->fifo_buffer, block_size);
             }
             begin = s->data_count;
@@ -629,6 +661,22 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
     } else {
         s->prnsts |= SDHC_DOING_WRITE;
         while (s->blkcnt) {
+            if (s->data_count == 0) {
+                uint32_t n = sdhci_sdma_whole_blocks(s, page_aligned,
+                                                     boundary_count);
+
+                if (n) {
+                    sdbus_write_data_dma(&s->sdbus, s->dma_as, s->sdmasysad,
+                                         n * block_size);
+                    s->sdmasysad += n * block_size;
+                    boundary_count -= n * block_size;
+                    s->blkcnt -= n;
+                    if (page_aligned && boundary_count == 0) {
+                        break;
+                    }
+                    continue;
+                }
+            }
             begin = s->data_count;
             if (((boundary_count + begin) < block_size) && page_aligned) {
                 s->data_count = boundary_count + begin;
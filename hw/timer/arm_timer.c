@@ -16,9 +16,16 @@
 #include "hw/qdev-properties.h"
 #include "qemu/module.h"
 #include "qemu/log.h"
+#include "qemu/thread.h"
 #include "qom/object.h"
 
-/* Common timer implementation.  */
+/*
+ * Common timer implementation.
+ *
+ * The registers are read without the BQL, see memory_region_set_lock();
+ * the ptimer callbacks and the writes hold both the BQL and the lock of
+ * the containing device.
+ */
 
 #define TIMER_CTRL_ONESHOT      (1 << 0)
 #define TIMER_CTRL_32BIT        (1 << 1)
@@ -172,7 +179,7 @@ static const VMStateDescription vmstate_arm_timer = {
     }
 };
 
-static arm_timer_state *arm_timer_init(uint32_t freq)
+static arm_timer_state *arm_timer_init(uint32_t freq, QemuMutex *lock)
 {
     arm_timer_state *s;
 
@@ -181,6 +188,7 @@ static arm_timer_state *arm_timer_init(uint32_t freq)
     s->control = TIMER_CTRL_IE;
 
     s->timer = ptimer_init(arm_timer_tick, s, PTIMER_POLICY_DEFAULT);
+    ptimer_set_lock(s->timer, lock);
     vmstate_register(NULL, VMSTATE_INSTANCE_ID_ANY, &vmstate_arm_timer, s);
     return s;
 }
@@ -198,6 +206,7 @@ struct SP804State {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    QemuMutex lock;
     arm_timer_state *timer[2];
     uint32_t freq0, freq1;
     int level[2];
@@ -293,18 +302,27 @@ static void sp804_init(Object *obj)
     SP804State *s = SP804(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
+    qemu_mutex_init(&s->lock);
     sysbus_init_irq(sbd, &s->irq);
     memory_region_init_io(&s->iomem, obj, &sp804_ops, s,
                           "sp804", 0x1000);
+    memory_region_set_lock(&s->iomem, &s->lock);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
+static void sp804_finalize(Object *obj)
+{
+    SP804State *s = SP804(obj);
+
+    qemu_mutex_destroy(&s->lock);
+}
+
 static void sp804_realize(DeviceState *dev, Error **errp)
 {
     SP804State *s = SP804(dev);
 
-    s->timer[0] = arm_timer_init(s->freq0);
-    s->timer[1] = arm_timer_init(s->freq1);
+    s->timer[0] = arm_timer_init(s->freq0, &s->lock);
+    s->timer[1] = arm_timer_init(s->freq1, &s->lock);
     s->timer[0]->irq = qemu_allocate_irq(sp804_set_irq, s, 0);
     s->timer[1]->irq = qemu_allocate_irq(sp804_set_irq, s, 1);
 }
@@ -318,6 +336,7 @@ struct icp_pit_state {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    QemuMutex lock;
     arm_timer_state *timer[3];
 };
 
@@ -363,11 +382,12 @@ static void icp_pit_init(Object *obj)
     icp_pit_state *s = INTEGRATOR_PIT(obj);
     SysBusDevice *dev = SYS_BUS_DEVICE(obj);
 
+    qemu_mutex_init(&s->lock);
     /* Timer 0 runs at the system clock speed (40MHz).  */
-    s->timer[0] = arm_timer_init(40000000);
+    s->timer[0] = arm_timer_init(40000000, &s->lock);
     /* The other two timers run at 1MHz.  */
-    s->timer[1] = arm_timer_init(1000000);
-    s->timer[2] = arm_timer_init(1000000);
+    s->timer[1] = arm_timer_init(1000000, &s->lock);
+    s->timer[2] = arm_timer_init(1000000, &s->lock);
 
     sysbus_init_irq(dev, &s->timer[0]->irq);
     sysbus_init_irq(dev, &s->timer[1]->irq);
@@ -375,16 +395,25 @@ static void icp_pit_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &icp_pit_ops, s,
                           "icp_pit", 0x1000);
+    memory_region_set_lock(&s->iomem, &s->lock);
     sysbus_init_mmio(dev, &s->iomem);
     /* This device has no state to save/restore.  The component timers will
        save themselves.  */
 }
 
+static void icp_pit_finalize(Object *obj)
+{
+    icp_pit_state *s = INTEGRATOR_PIT(obj);
+
+    qemu_mutex_destroy(&s->lock);
+}
+
 static const TypeInfo icp_pit_info = {
     .name          = TYPE_INTEGRATOR_PIT,
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(icp_pit_state),
     .instance_init = icp_pit_init,
+    .instance_finalize = icp_pit_finalize,
 };
 
 static Property sp804_properties[] = {
@@ -407,6 +436,7 @@ static const TypeInfo sp804_info = {
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(SP804State),
     .instance_init = sp804_init,
+    .instance_finalize = sp804_finalize,
     .class_init    = sp804_class_init,
 };
 
@@ -0,0 +1,151 @@
+/*
+ * QEMU model of the Canon DIGIC clock.
+ *
+ * Firmware calibrates its delay loops against the timers and the
+ * free-running microsecond counter, so they must all agree, and never
+ * go backwards or jump, whatever the virtual clock does: it may count
+ * instructions with icount, warp over idle time, or start over when a
+ * checkpoint is restored.  This block owns the time of the SoC, which
+ * they all derive their values from when they are read.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "hw/timer/digic-clock.h"
+#include "hw/misc/digic-mmio-stats.h"
+#include "migration/vmstate.h"
+#include "qemu/bitops.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+
+int64_t digic_clock_get_ns(DigicClockState *s)
+{
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + (s ? s->offset : 0);
+}
+
+int64_t digic_clock_to_virtual(DigicClockState *s, int64_t ns)
+{
+    return ns - (s ? s->offset : 0);
+}
+
+static uint64_t digic_clock_read(void *opaque, hwaddr offset, unsigned size)
+{
+    DigicClockState *s = opaque;
+
+    switch (offset) {
+    case DIGIC_CLOCK_VALUE:
+        return extract64(digic_clock_get_ns(s) / SCALE_US, 0,
+                         DIGIC_CLOCK_VALUE_BITS);
+
+    default:
+        digic_mmio_stats_record(s->iomem.addr + offset, false);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-clock: read access to unknown register 0x"
+                      TARGET_FMT_plx "\n", offset);
+        return 0;
+    }
+}
+
+static void digic_clock_write(void *opaque, hwaddr offset, uint64_t value,
+                              unsigned size)
+{
+    DigicClockState *s = opaque;
+
+    switch (offset) {
+    case DIGIC_CLOCK_VALUE:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "digic-clock: write to the read-only counter\n");
+        break;
+
+    default:
+        digic_mmio_stats_record(s->iomem.addr + offset, true);
+        qemu_log_mask(LOG_UNIMP,
+                      "digic-clock: write access to unknown register 0x"
+                      TARGET_FMT_plx "\n", offset);
+    }
+}
+
+static const MemoryRegionOps digic_clock_ops = {
+    .read = digic_clock_read,
+    .write = digic_clock_write,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .endianness = DEVICE_NATIVE_ENDIAN,
+};
+
+/*
+ * Like the timers, the clock migrates its time rather than that of the
+ * virtual clock it follows, so that it carries on against the fresh
+ * virtual clock of a machine started from a checkpoint.
+ */
+static int digic_clock_pre_save(void *opaque)
+{
+    DigicClockState *s = opaque;
+
+    s->saved_ns = digic_clock_get_ns(s);
+    return 0;
+}
+
+static int digic_clock_post_load(void *opaque, int version_id)
+{
+    DigicClockState *s = opaque;
+
+    s->offset = s->saved_ns - qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    return 0;
+}
+
+static const VMStateDescription vmstate_digic_clock = {
+    .name = "digic-clock",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_save = digic_clock_pre_save,
+    .post_load = digic_clock_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_INT64(saved_ns, DigicClockState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void digic_clock_init(Object *obj)
+{
+    DigicClockState *s = DIGIC_CLOCK(obj);
+
+    memory_region_init_io(&s->iomem, obj, &digic_clock_ops, s,
+                          TYPE_DIGIC_CLOCK, 0x100);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+}
+
+static void digic_clock_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->vmsd = &vmstate_digic_clock;
+}
+
+static const TypeInfo digic_clock_info = {
+    .name = TYPE_DIGIC_CLOCK,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DigicClockState),
+    .instance_init = digic_clock_init,
+    .class_init = digic_clock_class_init,
+};
+
+static void digic_clock_register_types(void)
+{
+    type_register_static(&digic_clock_info);
+}
+
+type_init(digic_clock_register_types)
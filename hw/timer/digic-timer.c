@@ -28,34 +28,174 @@
 
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
-#include "hw/ptimer.h"
+#include "hw/core/cpu.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "qapi/error.h"
 #include "qemu/module.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
 
 #include "hw/timer/digic-timer.h"
+#include "hw/misc/digic-mmio-stats.h"
 #include "migration/vmstate.h"
+#include "trace.h"
 
-static const VMStateDescription vmstate_digic_timer = {
-    .name = "digic.timer",
-    .version_id = 1,
-    .minimum_version_id = 1,
-    .fields = (VMStateField[]) {
-        VMSTATE_PTIMER(ptimer, DigicTimerState),
-        VMSTATE_UINT32(control, DigicTimerState),
-        VMSTATE_UINT32(relvalue, DigicTimerState),
-        VMSTATE_END_OF_LIST()
+/*
+ * FIXME: there is no documentation on Digic timer
+ * frequency setup so let it always run at 1 MHz
+ */
+#define DIGIC_TIMER_FREQ_HZ     (1 * 1000 * 1000)
+#define DIGIC_TIMER_PERIOD_NS   (NANOSECONDS_PER_SECOND / DIGIC_TIMER_FREQ_HZ)
+
+/* VALUE reads closer than this in virtual time belong to the same loop */
+#define DIGIC_TIMER_POLL_WINDOW_NS  (10 * SCALE_US)
+
+/*
+ * The counter value is derived from the time of the SoC whenever the
+ * guest reads it; a QEMU timer only runs to raise the interrupt when
+ * the counter rolls over.
+ */
+static uint32_t digic_timer_get_count(DigicTimerState *s)
+{
+    int64_t ticks;
+
+    if (!s->running || s->relvalue == 0) {
+        return s->value;
     }
-};
 
-static void digic_timer_reset(DeviceState *dev)
+    ticks = (digic_clock_get_ns(s->clock) - s->load_time) /
+            DIGIC_TIMER_PERIOD_NS;
+    return s->relvalue - ticks % s->relvalue;
+}
+
+/*
+ * Make the running counter hold @value now.
+ */
+static void digic_timer_set_count(DigicTimerState *s, uint32_t value)
 {
-    DigicTimerState *s = DIGIC_TIMER(dev);
+    s->value = value;
+    if (s->relvalue) {
+        s->load_time = digic_clock_get_ns(s->clock) -
+            (int64_t)(s->relvalue - MIN(value, s->relvalue)) *
+            DIGIC_TIMER_PERIOD_NS;
+    }
+}
+
+/*
+ * Restart counting down from RELVALUE.
+ */
+static void digic_timer_load(DigicTimerState *s)
+{
+    s->value = s->relvalue;
+    s->load_time = digic_clock_get_ns(s->clock);
+}
+
+/*
+ * Arm irq_timer for the next time the counter goes back to RELVALUE.
+ */
+static void digic_timer_update_irq_timer(DigicTimerState *s)
+{
+    int64_t period, now;
+
+    if (!s->running || s->relvalue == 0) {
+        timer_del(s->irq_timer);
+        return;
+    }
+
+    period = (int64_t)s->relvalue * DIGIC_TIMER_PERIOD_NS;
+    now = digic_clock_get_ns(s->clock);
+    timer_mod(s->irq_timer,
+              digic_clock_to_virtual(s->clock, now + period -
+                                     (now - s->load_time) % period));
+}
+
+static void digic_timer_tick(void *opaque)
+{
+    DigicTimerState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    digic_timer_update_irq_timer(s);
+    qemu_mutex_unlock(&s->lock);
+
+    qemu_irq_pulse(s->irq);
+}
+
+static void digic_timer_poll_wakeup_locked(DigicTimerState *s)
+{
+    CPUState *cpu = s->poll_cpu;
+
+    if (cpu) {
+        s->poll_cpu = NULL;
+        cpu->halted = 0;
+        qemu_cpu_kick(cpu);
+    }
+}
+
+static void digic_timer_poll_wakeup(void *opaque)
+{
+    DigicTimerState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    digic_timer_poll_wakeup_locked(s);
+    qemu_mutex_unlock(&s->lock);
+}
+
+/*
+ * DryOS waits for hardware by polling VALUE rather than with WFI.  The
+ * counter only depends on the time of the SoC, so once a vCPU has read it
+ * "poll-threshold" times in a row, halt the vCPU for "poll-sleep-us"
+ * instead of letting it spin.  As with WFI, a pending interrupt wakes
+ * it up early, and with -icount sleep=off the virtual clock warps over
+ * the break instead of waiting for it.
+ */
+static void digic_timer_poll(DigicTimerState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    if (!s->poll_threshold || !current_cpu) {
+        return;
+    }
+
+    if (now - s->poll_last > DIGIC_TIMER_POLL_WINDOW_NS) {
+        s->poll_count = 0;
+    }
+    s->poll_last = now;
+    if (++s->poll_count < s->poll_threshold) {
+        return;
+    }
+
+    /* The halt state of the vCPU is checked under the BQL */
+    memory_region_take_bql(&s->iomem);
+    trace_digic_timer_poll_idle(s->iomem.addr, s->poll_sleep_us);
+    s->poll_count = 0;
+    s->poll_cpu = current_cpu;
+    current_cpu->halted = 1;
+    cpu_exit(current_cpu);
+    timer_mod(s->poll_timer, now + s->poll_sleep_us * SCALE_US);
+}
+
+static void digic_timer_reset_locked(DigicTimerState *s)
+{
+    s->poll_count = 0;
+    timer_del(s->poll_timer);
+    digic_timer_poll_wakeup_locked(s);
 
-    ptimer_transaction_begin(s->ptimer);
-    ptimer_stop(s->ptimer);
-    ptimer_transaction_commit(s->ptimer);
+    /* Stopping freezes the counter at its current value. */
+    s->value = digic_timer_get_count(s);
+    s->running = false;
     s->control = 0;
     s->relvalue = 0;
+    timer_del(s->irq_timer);
+}
+
+static void digic_timer_reset(DeviceState *dev)
+{
+    DigicTimerState *s = DIGIC_TIMER(dev);
+
+    qemu_mutex_lock(&s->lock);
+    digic_timer_reset_locked(s);
+    qemu_mutex_unlock(&s->lock);
 }
 
 static uint64_t digic_timer_read(void *opaque, hwaddr offset, unsigned size)
@@ -71,14 +211,20 @@ static uint64_t digic_timer_read(void *opaque, hwaddr offset, unsigned size)
         ret = s->relvalue;
         break;
     case DIGIC_TIMER_VALUE:
-        ret = ptimer_get_count(s->ptimer) & 0xffff;
-        break;
+        ret = digic_timer_get_count(s) & 0xffff;
+        digic_timer_poll(s);
+        /* Don't reset the poll count */
+        return ret;
     default:
+        /* The statistics are global state */
+        memory_region_take_bql(&s->iomem);
+        digic_mmio_stats_record(s->iomem.addr + offset, false);
         qemu_log_mask(LOG_UNIMP,
                       "digic-timer: read access to unknown register 0x"
                       TARGET_FMT_plx "\n", offset);
     }
 
+    s->poll_count = 0;
     return ret;
 }
 
@@ -87,39 +233,87 @@ static void digic_timer_write(void *opaque, hwaddr offset,
 {
     DigicTimerState *s = opaque;
 
+    s->poll_count = 0;
+
     switch (offset) {
     case DIGIC_TIMER_CONTROL:
         if (value & DIGIC_TIMER_CONTROL_RST) {
-            digic_timer_reset((DeviceState *)s);
+            digic_timer_reset_locked(s);
             break;
         }
 
-        ptimer_transaction_begin(s->ptimer);
-        if (value & DIGIC_TIMER_CONTROL_EN) {
-            ptimer_run(s->ptimer, 0);
+        if ((value & DIGIC_TIMER_CONTROL_EN) && !s->running) {
+            /* Resume counting down from the frozen value. */
+            s->running = true;
+            digic_timer_set_count(s, s->value);
+            digic_timer_update_irq_timer(s);
         }
 
         s->control = (uint32_t)value;
-        ptimer_transaction_commit(s->ptimer);
         break;
 
     case DIGIC_TIMER_RELVALUE:
         s->relvalue = extract32(value, 0, 16);
-        ptimer_transaction_begin(s->ptimer);
-        ptimer_set_limit(s->ptimer, s->relvalue, 1);
-        ptimer_transaction_commit(s->ptimer);
+        digic_timer_load(s);
+        digic_timer_update_irq_timer(s);
         break;
 
     case DIGIC_TIMER_VALUE:
         break;
 
     default:
+        digic_mmio_stats_record(s->iomem.addr + offset, true);
         qemu_log_mask(LOG_UNIMP,
-                      "digic-timer: read access to unknown register 0x"
+                      "digic-timer: write access to unknown register 0x"
                       TARGET_FMT_plx "\n", offset);
     }
 }
 
+/*
+ * Only the counter value is migrated, not the time it was loaded at, so
+ * that the state can also be restored against a different virtual clock
+ * (see the canon-a1100 "checkpoint" option).
+ */
+static int digic_timer_pre_save(void *opaque)
+{
+    DigicTimerState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    /* The wakeup timer isn't migrated; don't leave the vCPU halted. */
+    timer_del(s->poll_timer);
+    digic_timer_poll_wakeup_locked(s);
+
+    s->value = digic_timer_get_count(s);
+    qemu_mutex_unlock(&s->lock);
+    return 0;
+}
+
+static int digic_timer_post_load(void *opaque, int version_id)
+{
+    DigicTimerState *s = opaque;
+
+    if (s->running) {
+        digic_timer_set_count(s, s->value);
+    }
+    digic_timer_update_irq_timer(s);
+    return 0;
+}
+
+static const VMStateDescription vmstate_digic_timer = {
+    .name = "digic.timer",
+    .version_id = 2,
+    .minimum_version_id = 2,
+    .pre_save = digic_timer_pre_save,
+    .post_load = digic_timer_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(control, DigicTimerState),
+        VMSTATE_UINT32(relvalue, DigicTimerState),
+        VMSTATE_BOOL(running, DigicTimerState),
+        VMSTATE_UINT32(value, DigicTimerState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const MemoryRegionOps digic_timer_ops = {
     .read = digic_timer_read,
     .write = digic_timer_write,
@@ -130,42 +324,58 @@ static const MemoryRegionOps digic_timer_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
-static void digic_timer_tick(void *opaque)
-{
-    /* Nothing to do on timer rollover */
-}
-
 static void digic_timer_init(Object *obj)
 {
     DigicTimerState *s = DIGIC_TIMER(obj);
 
-    s->ptimer = ptimer_init(digic_timer_tick, NULL, PTIMER_POLICY_DEFAULT);
-
-    /*
-     * FIXME: there is no documentation on Digic timer
-     * frequency setup so let it always run at 1 MHz
-     */
-    ptimer_transaction_begin(s->ptimer);
-    ptimer_set_freq(s->ptimer, 1 * 1000 * 1000);
-    ptimer_transaction_commit(s->ptimer);
-
+    qemu_mutex_init(&s->lock);
     memory_region_init_io(&s->iomem, OBJECT(s), &digic_timer_ops, s,
                           TYPE_DIGIC_TIMER, 0x100);
+    memory_region_set_lock(&s->iomem, &s->lock);
     sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
 }
 
 static void digic_timer_finalize(Object *obj)
 {
     DigicTimerState *s = DIGIC_TIMER(obj);
 
-    ptimer_free(s->ptimer);
+    qemu_mutex_destroy(&s->lock);
+}
+
+static void digic_timer_realize(DeviceState *dev, Error **errp)
+{
+    DigicTimerState *s = DIGIC_TIMER(dev);
+
+    s->poll_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, digic_timer_poll_wakeup,
+                                 s);
+    s->irq_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, digic_timer_tick, s);
 }
 
+static void digic_timer_unrealize(DeviceState *dev)
+{
+    DigicTimerState *s = DIGIC_TIMER(dev);
+
+    timer_free(s->poll_timer);
+    timer_free(s->irq_timer);
+}
+
+static Property digic_timer_properties[] = {
+    DEFINE_PROP_UINT32("poll-threshold", DigicTimerState, poll_threshold, 0),
+    DEFINE_PROP_UINT32("poll-sleep-us", DigicTimerState, poll_sleep_us, 100),
+    DEFINE_PROP_LINK("clock", DigicTimerState, clock, TYPE_DIGIC_CLOCK,
+                     DigicClockState *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void digic_timer_class_init(ObjectClass *klass, void *class_data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
+    dc->realize = digic_timer_realize;
+    dc->unrealize = digic_timer_unrealize;
     dc->reset = digic_timer_reset;
+    device_class_set_props(dc, digic_timer_properties);
     dc->vmsd = &vmstate_digic_timer;
 }
 
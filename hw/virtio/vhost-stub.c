@@ -7,6 +7,11 @@ bool vhost_has_free_slot(void)
     return true;
 }
 
+bool vhost_has_started_dev(void)
+{
+    return false;
+}
+
 bool vhost_user_init(VhostUserState *user, CharBackend *chr, Error **errp)
 {
     return false;
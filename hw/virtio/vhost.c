@@ -60,6 +60,18 @@ bool vhost_has_free_slot(void)
     return slots_limit > used_memslots;
 }
 
+bool vhost_has_started_dev(void)
+{
+    struct vhost_dev *hdev;
+
+    QLIST_FOREACH(hdev, &vhost_devices, entry) {
+        if (hdev->started) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void vhost_dev_sync_region(struct vhost_dev *dev,
                                   MemoryRegionSection *section,
                                   uint64_t mfirst, uint64_t mlast,
@@ -447,7 +459,8 @@ static bool vhost_section(struct vhost_dev *dev, MemoryRegionSection *section)
          * executable memory that has already been translated.
          */
         handled_dirty = (1 << DIRTY_MEMORY_MIGRATION) |
-            (1 << DIRTY_MEMORY_CODE);
+            (1 << DIRTY_MEMORY_CODE) | (1 << DIRTY_MEMORY_RECLAIM) |
+            (1 << DIRTY_MEMORY_ROM);
 
         if (dirty_mask & ~handled_dirty) {
             trace_vhost_reject_section(mr->name, 1);
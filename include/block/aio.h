@@ -20,6 +20,7 @@
 #include "qemu/coroutine.h"
 #include "qemu/queue.h"
 #include "qemu/event_notifier.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
 
@@ -232,8 +233,14 @@ struct AioContext {
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
 
+    /* Polling statistics, read by query-iothreads from other threads */
+    Stat64 poll_time_ns;    /* time spent busy polling */
+    Stat64 poll_hits;       /* handlers that made progress while polled */
+    Stat64 poll_dropped;    /* handlers no longer polled for a low hit rate */
+
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
+    int io_uring_sqpoll_cpu; /* host CPU of the io_uring SQ threads, or -1 */
 
     /*
      * List of handlers participating in userspace polling.  Protected by
@@ -767,4 +774,17 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
                                 Error **errp);
 
+/**
+ * aio_context_set_io_uring_sqpoll:
+ * @ctx: the aio context
+ * @cpu: host CPU to run the kernel submission threads of the io_uring
+ *       rings of @ctx on, or -1 to submit with system calls
+ *
+ * With a CPU, the rings are created with IORING_SETUP_SQPOLL, so that
+ * submitting requests needs no system call.  This must be called before
+ * @ctx runs anything; the fd monitoring ring is created again.
+ */
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, int64_t cpu,
+                                     Error **errp);
+
 #endif
@@ -478,6 +478,8 @@ int bdrv_amend_options(BlockDriverState *bs_new, QemuOpts *opts,
                        BlockDriverAmendStatusCB *status_cb, void *cb_opaque,
                        bool force,
                        Error **errp);
+int bdrv_dedupe(BlockDriverState *bs, BlockDriverAmendStatusCB *status_cb,
+                void *cb_opaque, int64_t *shared, Error **errp);
 
 /* check if a named node can be replaced when doing drive-mirror */
 BlockDriverState *check_to_replace_node(BlockDriverState *parent_bs,
@@ -524,6 +526,26 @@ int bdrv_block_status(BlockDriverState *bs, int64_t offset,
 int bdrv_block_status_above(BlockDriverState *bs, BlockDriverState *base,
                             int64_t offset, int64_t bytes, int64_t *pnum,
                             int64_t *map, BlockDriverState **file);
+
+/* One extent filled by bdrv_block_status_above_batch() */
+typedef struct BlockStatusExtent {
+    int64_t offset;
+    int64_t bytes;
+    int ret;                    /* BDRV_BLOCK_* flags */
+    int64_t map;                /* with BDRV_BLOCK_OFFSET_VALID */
+    BlockDriverState *file;
+} BlockStatusExtent;
+
+int coroutine_fn
+bdrv_co_block_status_above_batch(BlockDriverState *bs, BlockDriverState *base,
+                                 bool include_base, bool want_zero,
+                                 int64_t offset, int64_t bytes,
+                                 BlockStatusExtent *extents, int nb_extents);
+int generated_co_wrapper
+bdrv_block_status_above_batch(BlockDriverState *bs, BlockDriverState *base,
+                              bool include_base, bool want_zero,
+                              int64_t offset, int64_t bytes,
+                              BlockStatusExtent *extents, int nb_extents);
 int bdrv_is_allocated(BlockDriverState *bs, int64_t offset, int64_t bytes,
                       int64_t *pnum);
 int bdrv_is_allocated_above(BlockDriverState *top, BlockDriverState *base,
@@ -194,6 +194,14 @@ struct BlockDriver {
                               bool force,
                               Error **errp);
 
+    /*
+     * Makes the clusters with the same contents share their storage.
+     * *shared is set to the number of clusters that were freed.
+     */
+    int (*bdrv_dedupe)(BlockDriverState *bs,
+                       BlockDriverAmendStatusCB *status_cb,
+                       void *cb_opaque, int64_t *shared, Error **errp);
+
     int (*bdrv_make_empty)(BlockDriverState *bs);
 
     /*
@@ -367,6 +375,17 @@ struct BlockDriver {
         bool want_zero, int64_t offset, int64_t bytes, int64_t *pnum,
         int64_t *map, BlockDriverState **file);
 
+    /*
+     * Optional, for drivers that can cheaply answer for many extents at
+     * once: like bdrv_co_block_status, but fills up to @nb_extents
+     * consecutive extents starting at @offset, and returns how many.
+     * Each extent's ret, map and file are what bdrv_co_block_status
+     * would return for it.  The same alignment rules apply.
+     */
+    int coroutine_fn (*bdrv_co_block_status_batch)(BlockDriverState *bs,
+        bool want_zero, int64_t offset, int64_t bytes,
+        BlockStatusExtent *extents, int nb_extents);
+
     /*
      * This informs the driver that we are no longer interested in the result
      * of in-flight requests, so don't waste the time if possible.
@@ -9,6 +9,8 @@ typedef int BackendChangeHandler(void *opaque);
 
 /* This is the backend as seen by frontend, the actual backend is
  * Chardev */
+typedef struct CharFeCoalesce CharFeCoalesce;
+
 struct CharBackend {
     Chardev *chr;
     IOEventHandler *chr_event;
@@ -18,6 +20,8 @@ struct CharBackend {
     void *opaque;
     int tag;
     int fe_open;
+    /* Output not yet passed to the chardev, with "coalesce=on" */
+    CharFeCoalesce *coalesce;
 };
 
 /**
@@ -226,6 +230,18 @@ int qemu_chr_fe_write(CharBackend *be, const uint8_t *buf, int len);
  */
 int qemu_chr_fe_write_all(CharBackend *be, const uint8_t *buf, int len);
 
+/**
+ * qemu_chr_fe_flush:
+ *
+ * Pass to the back end the output that the front end wrote but that is
+ * still held back because the chardev has "coalesce=on".  This happens
+ * by itself within a millisecond if the back end takes it; front ends
+ * that need the output out sooner, for example when resetting or being
+ * removed, call this.  Like qemu_chr_fe_write_all(), it waits for the
+ * back end to take everything.  This function is thread-safe.
+ */
+void qemu_chr_fe_flush(CharBackend *be);
+
 /**
  * qemu_chr_fe_read_all:
  * @buf: the data buffer
@@ -0,0 +1,48 @@
+/*
+ * Shared memory ring buffer chardev: layout of the ring file
+ *
+ * This header is meant to be usable by external tools as well.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef CHARDEV_SHM_RING_H
+#define CHARDEV_SHM_RING_H
+
+#define QEMU_SHM_RING_MAGIC     0x52485351 /* "QSHR" */
+#define QEMU_SHM_RING_VERSION   1
+
+/*
+ * The file starts with this header, and the @size bytes of the ring
+ * follow at @data_offset.  QEMU is the only writer and there must be a
+ * single reader.  @prod and @cons are free-running byte counts, so that
+ * the ring holds @prod - @cons bytes starting at @cons % @size; they
+ * are in cache lines of their own.
+ *
+ * QEMU copies the data in and then stores @prod with release semantics.
+ * The reader loads @prod with acquire semantics, consumes the data, and
+ * stores @cons with release semantics.  When the ring is full, QEMU
+ * drops what does not fit and adds it to @lost.
+ *
+ * A reader that wants to sleep sets @waiting to 1, issues a full memory
+ * barrier and checks @prod once more before blocking on the file
+ * descriptor given to QEMU with "fd".  Whenever it finds @waiting set
+ * after a write, QEMU clears it and writes an 8-byte 1 to that file
+ * descriptor, which can be an eventfd or the write end of a pipe.  The
+ * other writes make no system call.
+ */
+typedef struct QemuShmRing {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t data_offset;
+    uint32_t waiting;
+    uint32_t lost;
+    uint32_t reserved[10];
+    uint32_t prod;
+    uint32_t reserved_prod[15];
+    uint32_t cons;
+    uint32_t reserved_cons[15];
+} QemuShmRing;
+
+#endif /* CHARDEV_SHM_RING_H */
@@ -0,0 +1,59 @@
+/*
+ * Primitives for emulating the AES and SHA instructions of guest CPUs
+ *
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ */
+
+#ifndef QEMU_CRYPTO_INSN_H
+#define QEMU_CRYPTO_INSN_H
+
+/*
+ * Each vector is a uint64_t[2] in the layout of a 128-bit register of
+ * the Arm Cryptographic Extension: byte n, or 32-bit element n, of the
+ * register is at the same bits of v[n / 8] or v[n / 2] as in a little
+ * endian host's memory.  The output may overlap the inputs.  The best
+ * implementation the host CPU supports is picked at startup; they all
+ * give the same result.
+ */
+
+/*
+ * AESE, or AESD if @decrypt: AddRoundKey of @rm to @rn, then ShiftRows
+ * and SubBytes, or their inverses.
+ */
+void crypto_insn_aese(uint64_t *rd, const uint64_t *rn, const uint64_t *rm,
+                      bool decrypt);
+
+/* AESMC, or AESIMC if @decrypt: MixColumns or InvMixColumns */
+void crypto_insn_aesmc(uint64_t *rd, const uint64_t *rm, bool decrypt);
+
+typedef enum CryptoInsnSha1Fn {
+    CRYPTO_INSN_SHA1_CHOOSE,    /* SHA1C */
+    CRYPTO_INSN_SHA1_PARITY,    /* SHA1P */
+    CRYPTO_INSN_SHA1_MAJORITY,  /* SHA1M */
+} CryptoInsnSha1Fn;
+
+/*
+ * SHA1C, SHA1P or SHA1M: four rounds of SHA-1 with the logical function
+ * @fn on @abcd and @e, using the four elements of @wk, which already
+ * include the round constant.
+ */
+void crypto_insn_sha1(uint64_t *abcd, uint32_t e, const uint64_t *wk,
+                      CryptoInsnSha1Fn fn);
+
+/*
+ * SHA256H and SHA256H2: four rounds of SHA-256 on @abcd and @efgh, using
+ * the four elements of @wk, which already include the round constants.
+ * Both halves of the state are updated.
+ */
+void crypto_insn_sha256(uint64_t *abcd, uint64_t *efgh, const uint64_t *wk);
+
+/*
+ * Switch to the next slower implementation, for tests and benchmarks.
+ * Returns false once the portable C one is in use.
+ */
+bool crypto_insn_next_accel(void);
+
+/* Name of the implementation in use */
+const char *crypto_insn_accel_name(void);
+
+#endif /* QEMU_CRYPTO_INSN_H */
@@ -304,6 +304,31 @@ qcrypto_tls_session_get_handshake_status(QCryptoTLSSession *sess);
 int qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
                                      Error **errp);
 
+/**
+ * qcrypto_tls_session_enable_ktls_send:
+ * @sess: the TLS session object
+ * @fd: the socket the session runs on
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * If the credentials of @sess have the "ktls" property set,
+ * hand the keys used to send data over to the kernel TLS
+ * support of @fd, so that plain data written to @fd goes out
+ * encrypted.  This must be called once the handshake has
+ * completed and before any payload is sent.
+ *
+ * On success, payload must be written to @fd directly and
+ * qcrypto_tls_session_write() must no longer be called;
+ * reads keep going through qcrypto_tls_session_read().
+ *
+ * Returns: 1 if the kernel now encrypts the data sent, 0 if
+ * the credentials do not ask for it, or -1 if it is not
+ * possible for this session, in which case the session is
+ * unchanged and can still be used as before.
+ */
+int qcrypto_tls_session_enable_ktls_send(QCryptoTLSSession *sess,
+                                         int fd,
+                                         Error **errp);
+
 /**
  * qcrypto_tls_session_get_peer_name:
  * @sess: the TLS session object
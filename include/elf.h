@@ -513,6 +513,10 @@ typedef struct {
 #define HWCAP_VFPD32            (1 << 19)       /* set if VFP has 32 regs */
 #define HWCAP_LPAE              (1 << 20)
 
+/* Bits present in AT_HWCAP for AArch64.  */
+
+#define HWCAP_AARCH64_ATOMICS   (1 << 8)
+
 /* Bits present in AT_HWCAP for PowerPC.  */
 
 #define PPC_FEATURE_32                  0x80000000
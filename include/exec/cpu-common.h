@@ -45,8 +45,10 @@ typedef uintptr_t ram_addr_t;
 /* memory API */
 
 void qemu_ram_remap(ram_addr_t addr, ram_addr_t length);
+int qemu_ram_replace_fd(RAMBlock *block, int fd, Error **errp);
 /* This should not be used by devices.  */
 ram_addr_t qemu_ram_addr_from_host(void *ptr);
+ram_addr_t qemu_ram_code_addr_from_host(void *ptr);
 RAMBlock *qemu_ram_block_by_name(const char *name);
 RAMBlock *qemu_ram_block_from_host(void *ptr, bool round_offset,
                                    ram_addr_t *offset);
@@ -76,8 +76,13 @@ typedef uint64_t target_ulong;
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 
-/* use a fully associative victim tlb of 8 entries */
+/* Default number of victim tlb entries, see -accel tcg,victim-tlb=N */
 #define CPU_VTLB_SIZE 8
+#define CPU_VTLB_WAYS 4
+#define CPU_VTLB_MAX_SIZE 4096
+
+/* Entries in the per-vCPU cache of recently used MMIO sections */
+#define CPU_IO_CACHE_BITS 3
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -150,6 +155,19 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+/*
+ * A recently used MMIO page, as resolved by iotlb_to_section().  Valid
+ * until the next full TLB flush, which is also what a change of the
+ * memory map does to the CPUIOTLBEntry it was looked up from.
+ */
+typedef struct CPUIOCacheEntry {
+    hwaddr iotlb;                   /* CPUIOTLBEntry.addr, or -1 */
+    bool secure;                    /* CPUIOTLBEntry.attrs.secure */
+    /* Access sizes memory_region_dispatch_*_direct() can do, by is_write */
+    uint8_t direct[2];
+    MemoryRegionSection *section;
+} CPUIOCacheEntry;
+
 /*
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
@@ -168,13 +186,29 @@ typedef struct CPUTLBDesc {
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
-    size_t vindex;
-    /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUIOTLBEntry viotlb[CPU_VTLB_SIZE];
+    /*
+     * The tlb victim table, in two parts: vtlb_sets sets of CPU_VTLB_WAYS
+     * entries, indexed by virtual page number, with a tree pseudo-LRU
+     * state per set in vplru.
+     */
+    size_t vtlb_sets;
+    uint8_t *vplru;
+    CPUTLBEntry *vtable;
+    CPUIOTLBEntry *viotlb;
     /* The iotlb.  */
     CPUIOTLBEntry *iotlb;
+    /*
+     * Statistics, written by the owner vCPU and read atomically by
+     * x-query-tlb.  Hits in the fast path are not counted.
+     */
+    struct {
+        size_t miss;        /* fast path misses */
+        size_t victim_hit;  /* ... resolved by the victim tlb */
+        size_t fill;        /* entries installed by tlb_set_page */
+        size_t flush;
+        size_t grow;
+        size_t shrink;
+    } stats;
 } CPUTLBDesc;
 
 /*
@@ -208,6 +242,18 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /*
+     * Page flushes queued by tlb_flush_page_bits_by_mmuidx_batched(),
+     * merged into one range; batch_len is 0 when none are queued.
+     * Only accessed by the owner vCPU.
+     */
+    target_ulong batch_addr;
+    target_ulong batch_len;
+    uint16_t batch_idxmap;
+    uint8_t batch_bits;
+    bool batch_all_cpus;
+    /* Only accessed by the owner vCPU. */
+    CPUIOCacheEntry io_cache[1 << CPU_IO_CACHE_BITS];
 } CPUTLBCommon;
 
 /*
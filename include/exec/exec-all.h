@@ -286,6 +286,27 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                uint16_t idxmap,
                                                unsigned bits);
 
+/**
+ * tlb_flush_page_bits_by_mmuidx_batched
+ * @cpu: CPU whose TLB should be flushed; must be the current vCPU
+ * @addr: virtual address of the page to be flushed
+ * @idxmap: bitmap of mmu indexes to flush
+ * @bits: number of significant bits in address
+ * @all_cpus: flush all vCPUs, as tlb_flush_range_by_mmuidx_all_cpus_synced
+ *
+ * Queue a flush of the page at @addr.  Pages queued one after the other
+ * with the same @idxmap, @bits and @all_cpus, in ascending or descending
+ * order, are merged and flushed with a single range flush when the
+ * batch is committed.  That happens when a page cannot be merged, when
+ * the vCPU goes back to the main loop, and when the front end calls
+ * tlb_flush_batch_commit(), which it must do before the guest can rely
+ * on the flush having completed (e.g. at a barrier).
+ */
+void tlb_flush_page_bits_by_mmuidx_batched(CPUState *cpu, target_ulong addr,
+                                           uint16_t idxmap, unsigned bits,
+                                           bool all_cpus);
+void tlb_flush_batch_commit(CPUState *cpu);
+
 /**
  * tlb_set_page_with_attrs:
  * @cpu: CPU to add this TLB entry for
@@ -408,6 +429,16 @@ static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                              unsigned bits)
 {
 }
+static inline void tlb_flush_page_bits_by_mmuidx_batched(CPUState *cpu,
+                                                         target_ulong addr,
+                                                         uint16_t idxmap,
+                                                         unsigned bits,
+                                                         bool all_cpus)
+{
+}
+static inline void tlb_flush_batch_commit(CPUState *cpu)
+{
+}
 #endif
 /**
  * probe_access:
@@ -504,6 +535,10 @@ struct TranslationBlock {
 #define CF_INVALID       0x00040000 /* TB is stale. Set with @jmp_lock held */
 #define CF_PARALLEL      0x00080000 /* Generate code for a parallel context */
 #define CF_NOIRQ         0x00100000 /* Generate an uninterruptible TB */
+#define CF_SUPERBLOCK    0x00200000 /* Translate through direct branches;
+                                       never stored in tb->cflags */
+#define CF_NO_ST_FWD     0x00400000 /* No store-to-load forwarding, because
+                                       watchpoints are inserted */
 #define CF_CLUSTER_MASK  0xff000000 /* Top 8 bits are cluster ID */
 #define CF_CLUSTER_SHIFT 24
 
@@ -560,6 +595,50 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Exits of this TB that went through the main loop or the lookup
+     * helper instead of a direct jump; only counted with
+     * -accel tcg,chain-stats=on.
+     */
+    struct {
+        uint32_t unchained;     /* direct exit, not chained (yet) */
+        uint32_t unchainable;   /* ... to a TB that can't be chained to */
+        uint32_t indirect;      /* goto_ptr through helper_lookup_tb_ptr */
+        uint32_t indirect_miss; /* ... that had to return to the main loop */
+    } exit_stats;
+
+    /*
+     * Last target of the goto_ptr exit of this TB, for front ends that use
+     * tcg_gen_lookup_and_goto_ptr_cached().  Only valid for @cpu while its
+     * tb_jmp_cache_gen is still @gen; unused with CF_PARALLEL.
+     */
+    struct {
+        TranslationBlock *tb;
+        CPUState *cpu;
+        uint64_t gen;
+        uint32_t hits;
+        uint32_t misses;
+    } jmp_ic;
+
+    /*
+     * Dispatches of this TB from the main loop and the lookup helpers,
+     * while it is a candidate for -accel tcg,superblock-threshold=N.
+     */
+    uint32_t exec_count;
+    bool superblock;           /* translated with CF_SUPERBLOCK */
+
+    /*
+     * Generation of the -accel tcg,coverage=FILE bitmap in which this TB
+     * was last marked as executed, or 0.
+     */
+    uint32_t coverage_gen;
+
+    /*
+     * Guest destinations of the goto_tb exits, or -1 if unknown; the
+     * front end fills them in for -accel tcg,spec-translate=on.
+     */
+    target_ulong jmp_pc[2];
 };
 
 /* Hide the qatomic_read to make code a little easier on the eyes */
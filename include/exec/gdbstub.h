@@ -57,6 +57,16 @@ void gdb_set_stop_cpu(CPUState *cpu);
  */
 void gdb_exit(int code);
 
+/**
+ * gdb_breakpoint_hit: check the conditions of a gdb breakpoint
+ * @cpu: the CPU that reached the breakpoint
+ * @pc: the address of the breakpoint
+ *
+ * Returns: true if the breakpoint at @pc has no condition or if one of
+ * its conditions holds, that is, if @cpu should stop.
+ */
+bool gdb_breakpoint_hit(CPUState *cpu, vaddr pc);
+
 #ifdef CONFIG_USER_ONLY
 /**
  * gdb_handlesig: yield control to gdb
@@ -84,6 +94,34 @@ void gdb_register_coprocessor(CPUState *cpu,
                               gdb_get_reg_cb get_reg, gdb_set_reg_cb set_reg,
                               int num_regs, const char *xml, int g_pos);
 
+/**
+ * gdb_read_register() - read a register of @cpu
+ * @cpu: the CPU
+ * @buf: the array the value is appended to, in target byte order
+ * @reg: the register number, as the gdbstub numbers it
+ *
+ * Returns: the size of the register, or 0 if @reg does not exist.
+ */
+int gdb_read_register(CPUState *cpu, GByteArray *buf, int reg);
+
+typedef struct GDBRegDesc {
+    int gdb_reg;                /* number for gdb_read_register() */
+    const char *name;           /* as in the XML description */
+    const char *feature_name;   /* the XML feature holding the register */
+} GDBRegDesc;
+
+/**
+ * gdb_get_register_list() - list the registers of @cpu
+ * @cpu: the CPU
+ *
+ * The list is built from the XML descriptions of the core registers and
+ * of each set added by gdb_register_coprocessor().  The strings are
+ * interned and are never freed.
+ *
+ * Returns: a GArray of GDBRegDesc, which the caller frees.
+ */
+GArray *gdb_get_register_list(CPUState *cpu);
+
 /*
  * The GDB remote protocol transfers values in target byte order. As
  * the gdbstub may be batching up several register values we always
@@ -15,15 +15,14 @@
  */
 static inline void log_cpu_state(CPUState *cpu, int flags)
 {
-    QemuLogFile *logfile;
+    FILE *logfile;
 
     if (qemu_log_enabled()) {
-        rcu_read_lock();
-        logfile = qatomic_rcu_read(&qemu_logfile);
+        logfile = qemu_log_lock();
         if (logfile) {
-            cpu_dump_state(cpu, logfile->fd, flags);
+            cpu_dump_state(cpu, logfile, flags);
         }
-        rcu_read_unlock();
+        qemu_log_unlock(logfile);
     }
 }
 
@@ -47,24 +46,22 @@ static inline void log_cpu_state_mask(int mask, CPUState *cpu, int flags)
 static inline void log_target_disas(CPUState *cpu, target_ulong start,
                                     target_ulong len)
 {
-    QemuLogFile *logfile;
-    rcu_read_lock();
-    logfile = qatomic_rcu_read(&qemu_logfile);
+    FILE *logfile = qemu_log_lock();
+
     if (logfile) {
-        target_disas(logfile->fd, cpu, start, len);
+        target_disas(logfile, cpu, start, len);
     }
-    rcu_read_unlock();
+    qemu_log_unlock(logfile);
 }
 
 static inline void log_disas(const void *code, unsigned long size)
 {
-    QemuLogFile *logfile;
-    rcu_read_lock();
-    logfile = qatomic_rcu_read(&qemu_logfile);
+    FILE *logfile = qemu_log_lock();
+
     if (logfile) {
-        disas(logfile->fd, code, size);
+        disas(logfile, code, size);
     }
-    rcu_read_unlock();
+    qemu_log_unlock(logfile);
 }
 
 #if defined(CONFIG_USER_ONLY)
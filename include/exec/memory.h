@@ -27,6 +27,7 @@
 #include "qemu/notify.h"
 #include "qom/object.h"
 #include "qemu/rcu.h"
+#include "qemu/stats64.h"
 
 #define RAM_ADDR_INVALID (~(ram_addr_t)0)
 
@@ -69,7 +70,13 @@ static inline void fuzz_dma_read_cb(size_t addr,
 /* Dirty tracking enabled because measuring dirty rate */
 #define GLOBAL_DIRTY_DIRTY_RATE (1U << 1)
 
-#define GLOBAL_DIRTY_MASK  (0x3)
+/* Dirty tracking enabled because of an in-memory snapshot */
+#define GLOBAL_DIRTY_SNAPSHOT   (1U << 2)
+
+/* Dirty tracking enabled because of a vCPU dirty page rate limit */
+#define GLOBAL_DIRTY_LIMIT      (1U << 3)
+
+#define GLOBAL_DIRTY_MASK  (0xf)
 
 extern unsigned int global_dirty_tracking;
 
@@ -737,6 +744,7 @@ struct MemoryRegion {
 
     const MemoryRegionOps *ops;
     void *opaque;
+    QemuMutex *lock;
     MemoryRegion *container;
     Int128 size;
     hwaddr addr;
@@ -757,6 +765,14 @@ struct MemoryRegion {
     unsigned ioeventfd_nb;
     MemoryRegionIoeventfd *ioeventfds;
     RamDiscardManager *rdm; /* Only for RAM */
+
+    /* Dispatches to @ops, counted while memory_region_stats_enabled */
+    struct {
+        Stat64 reads;
+        Stat64 writes;
+        Stat64 read_ns;         /* host time spent in the read callbacks */
+        Stat64 write_ns;
+    } stats;
 };
 
 struct IOMMUMemoryRegion {
@@ -1561,6 +1577,38 @@ void memory_region_init_rom_device(MemoryRegion *mr,
                                    uint64_t size,
                                    Error **errp);
 
+#ifdef CONFIG_POSIX
+/**
+ * memory_region_init_rom_device_from_fd:  Initialize a ROM memory region
+ *                                         backed by a private file mapping.
+ *
+ * Like memory_region_init_rom_device(), but the RAM side of the region is
+ * a MAP_PRIVATE mapping of @fd instead of anonymous memory.  The initial
+ * contents are those of the file, pages are shared through the host page
+ * cache and only become private copies once written.  The file is never
+ * modified.  @owner must be a DeviceState; the RAM is registered for
+ * migration with vmstate_register_ram().
+ *
+ * @mr: the #MemoryRegion to be initialized.
+ * @owner: the object that tracks the region's reference count
+ * @ops: callbacks for write access handling (must not be NULL).
+ * @opaque: passed to the read and write callbacks of the @ops structure.
+ * @name: Region name, becomes part of RAMBlock name used in migration stream
+ *        must be unique within any device
+ * @size: size of the region; the file must be at least this large.
+ * @fd: the fd to mmap, which may be opened read-only.  On success it is
+ *      owned by the region and closed when the region is destroyed.
+ * @errp: pointer to Error*, to store an error if it happens.
+ */
+void memory_region_init_rom_device_from_fd(MemoryRegion *mr,
+                                           Object *owner,
+                                           const MemoryRegionOps *ops,
+                                           void *opaque,
+                                           const char *name,
+                                           uint64_t size,
+                                           int fd,
+                                           Error **errp);
+#endif
 
 /**
  * memory_region_owner: get a memory region's owner.
@@ -2001,6 +2049,23 @@ bool memory_region_snapshot_get_dirty(MemoryRegion *mr,
                                       DirtyBitmapSnapshot *snap,
                                       hwaddr addr, hwaddr size);
 
+/**
+ * memory_region_test_and_clear_dirty: Check whether a range of pages is
+ *                                     dirty and mark it as clean, for a
+ *                                     specified client.
+ *
+ * Unlike memory_region_snapshot_and_clear_dirty(), only the pages in the
+ * range are cleared, and the dirty log is not synced from the accelerator
+ * first; this is meant for clients that only TCG feeds.
+ *
+ * @mr: the region being queried.
+ * @addr: the start of the subrange being queried.
+ * @size: the size of the subrange being queried.
+ * @client: the user of the logging information.
+ */
+bool memory_region_test_and_clear_dirty(MemoryRegion *mr, hwaddr addr,
+                                        hwaddr size, unsigned client);
+
 /**
  * memory_region_reset_dirty: Mark a range of pages as clean, for a specified
  *                            client.
@@ -2034,6 +2099,36 @@ void memory_region_reset_dirty(MemoryRegion *mr, hwaddr addr,
  */
 void memory_region_flush_rom_device(MemoryRegion *mr, hwaddr addr, hwaddr size);
 
+/**
+ * memory_region_share_code: Reuse translated code across ROM devices with
+ *                           identical contents.
+ *
+ * TCG looks translated code up by RAM address, so ROM devices holding the
+ * same image each get their own translation.  After this call, TBs for a
+ * page of @mr are looked up as if the code came from the same page of
+ * @source, until the page is modified with memory_region_unshare_code().
+ * @source is only used as a key and is never executed from; it must have
+ * the same size as @mr and the same contents as @mr initially has.
+ *
+ * @mr: the ROM device.
+ * @source: a RAM region holding the pristine image.
+ */
+void memory_region_share_code(MemoryRegion *mr, MemoryRegion *source);
+
+/**
+ * memory_region_unshare_code: Stop sharing translated code for a range.
+ *
+ * The ROM device must call this before modifying pages of its contents
+ * that may be shared with memory_region_share_code().  It does nothing
+ * for other regions.
+ *
+ * @mr: the ROM device.
+ * @addr: the start, relative to the start of the region, of the range
+ *        being modified.
+ * @size: the size, in bytes, of the range being modified.
+ */
+void memory_region_unshare_code(MemoryRegion *mr, hwaddr addr, hwaddr size);
+
 /**
  * memory_region_set_readonly: Turn a memory region read-only (or read-write)
  *
@@ -2132,6 +2227,39 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_set_lock: Protect the accesses to a region with a device lock
+ *
+ * Every access to @mr is dispatched with @lock held.  TCG vCPUs then read
+ * the region without taking the BQL, so that guests polling a timer or a
+ * status register from several vCPUs do not serialize on it.  Writes still
+ * take the BQL, before @lock.
+ *
+ * The read callbacks may thus only touch state protected by @lock, and
+ * must call memory_region_take_bql() before doing anything that needs the
+ * BQL, such as updating an interrupt line.  Code that changes the state of
+ * the device from outside the MMIO callbacks, for example timer or
+ * character device callbacks, must take @lock too.
+ *
+ * Must be called before @mr is mapped.
+ *
+ * @mr: the memory region to be updated.
+ * @lock: the lock protecting the device state.
+ */
+void memory_region_set_lock(MemoryRegion *mr, QemuMutex *lock);
+
+/**
+ * memory_region_take_bql: Make sure a read callback runs with the BQL
+ *
+ * For read callbacks of a region with a lock (see memory_region_set_lock()).
+ * If the BQL is not held yet, the region lock is released, the BQL taken
+ * and the region lock taken again, so the device state may have changed in
+ * the meanwhile.  The BQL is released after the access completes.
+ *
+ * @mr: the memory region being accessed.
+ */
+void memory_region_take_bql(MemoryRegion *mr);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -2375,6 +2503,17 @@ MemoryRegionSection memory_region_find(MemoryRegion *mr,
  */
 void memory_global_dirty_log_sync(void);
 
+/**
+ * memory_region_dirty_log_sync: synchronize the dirty log for a region
+ *
+ * Synchronizes the dirty page log for the parts of the address spaces
+ * that map @mr, or for all of them with the listeners that cannot sync
+ * less than that, such as the KVM dirty ring.
+ *
+ * @mr: the memory region to synchronize
+ */
+void memory_region_dirty_log_sync(MemoryRegion *mr);
+
 /**
  * memory_global_dirty_log_sync: synchronize the dirty log for all memory
  *
@@ -2431,7 +2570,34 @@ void memory_global_dirty_log_start(unsigned int flags);
  */
 void memory_global_dirty_log_stop(unsigned int flags);
 
-void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled);
+void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled,
+                bool stats);
+
+extern bool memory_region_stats_enabled;
+
+/**
+ * memory_region_stats_enable: start or stop counting MMIO dispatches
+ *
+ * While enabled, memory_region_dispatch_read() and
+ * memory_region_dispatch_write() count the accesses to each MemoryRegion
+ * and the host time spent in its callbacks.
+ *
+ * @enable: whether to count
+ */
+void memory_region_stats_enable(bool enable);
+
+/**
+ * memory_region_stats_reset: clear the counters of all memory regions
+ */
+void memory_region_stats_reset(void);
+
+/**
+ * memory_region_stats_format: list the regions with the most MMIO time
+ *
+ * Returns: a table of the regions that were accessed, the most
+ * expensive first
+ */
+GString *memory_region_stats_format(void);
 
 /**
  * memory_region_dispatch_read: perform a read directly to the specified
@@ -2464,6 +2630,55 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          MemOp op,
                                          MemTxAttrs attrs);
 
+/**
+ * memory_region_direct_access_sizes: find the accesses to a
+ * MemoryRegion that need no checking or splitting.
+ *
+ * Returns a bitmap with bit N set if every aligned access of 1 << N
+ * bytes to @mr is accepted by memory_region_access_valid() and is
+ * handed to its ops in one call, so that it can be performed with
+ * memory_region_dispatch_read_direct() or
+ * memory_region_dispatch_write_direct().
+ *
+ * @mr: #MemoryRegion to check
+ * @is_write: whether the accesses are writes
+ */
+unsigned memory_region_direct_access_sizes(MemoryRegion *mr, bool is_write);
+
+/**
+ * memory_region_dispatch_read_direct: like memory_region_dispatch_read(),
+ * for an aligned access whose size memory_region_direct_access_sizes()
+ * allows.
+ *
+ * @mr: #MemoryRegion to access
+ * @addr: address within that region
+ * @pval: pointer to uint64_t which the data is written to
+ * @op: size, sign, and endianness of the memory operation
+ * @attrs: memory transaction attributes to use for the access
+ */
+MemTxResult memory_region_dispatch_read_direct(MemoryRegion *mr,
+                                               hwaddr addr,
+                                               uint64_t *pval,
+                                               MemOp op,
+                                               MemTxAttrs attrs);
+
+/**
+ * memory_region_dispatch_write_direct: like memory_region_dispatch_write(),
+ * for an aligned access whose size memory_region_direct_access_sizes()
+ * allows.
+ *
+ * @mr: #MemoryRegion to access
+ * @addr: address within that region
+ * @data: data to write
+ * @op: size, sign, and endianness of the memory operation
+ * @attrs: memory transaction attributes to use for the access
+ */
+MemTxResult memory_region_dispatch_write_direct(MemoryRegion *mr,
+                                                hwaddr addr,
+                                                uint64_t data,
+                                                MemOp op,
+                                                MemTxAttrs attrs);
+
 /**
  * address_space_init: initializes an address space
  *
@@ -0,0 +1,28 @@
+/*
+ * Report the code TCG generates to the Linux perf tool
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef EXEC_PERF_MAP_H
+#define EXEC_PERF_MAP_H
+
+/**
+ * perf_map_enable() - write /tmp/perf-PID.map
+ *
+ * Describe each translation block in the map file that perf report
+ * reads for JIT code.  Call before the first translation.
+ */
+void perf_map_enable(void);
+
+/**
+ * perf_jitdump_enable() - write /tmp/jit-PID.dump
+ *
+ * Record each translation block, with a timestamp and a copy of its
+ * host code, for perf inject --jit.  Unlike the map file, this remains
+ * accurate when the translation buffer is flushed and reused.  Call
+ * before the first translation.
+ */
+void perf_jitdump_enable(void);
+
+#endif /* EXEC_PERF_MAP_H */
@@ -95,6 +95,9 @@ static inline unsigned long int ramblock_recv_bitmap_offset(void *host_addr,
 
 bool ramblock_is_pmem(RAMBlock *rb);
 
+/* Number of target pages below the end of the highest RAMBlock */
+unsigned long last_ram_page(void);
+
 long qemu_minrampagesize(void);
 long qemu_maxrampagesize(void);
 
@@ -138,6 +141,9 @@ int qemu_ram_resize(RAMBlock *block, ram_addr_t newsize, Error **errp);
 
 void qemu_ram_msync(RAMBlock *block, ram_addr_t start, ram_addr_t length);
 
+/* Discard zeroed guest pages every @interval_ms, see ram-reclaim.c */
+void ram_zero_reclaim_start(uint32_t interval_ms);
+
 /* Clear whole block of mem */
 static inline void qemu_ram_block_writeback(RAMBlock *block)
 {
@@ -240,7 +246,10 @@ static inline bool cpu_physical_memory_is_clean(ram_addr_t addr)
     bool code = cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_CODE);
     bool migration =
         cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_MIGRATION);
-    return !(vga && code && migration);
+    bool reclaim =
+        cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_RECLAIM);
+    bool rom = cpu_physical_memory_get_dirty_flag(addr, DIRTY_MEMORY_ROM);
+    return !(vga && code && migration && reclaim && rom);
 }
 
 static inline uint8_t cpu_physical_memory_range_includes_clean(ram_addr_t start,
@@ -261,6 +270,14 @@ static inline uint8_t cpu_physical_memory_range_includes_clean(ram_addr_t start,
         !cpu_physical_memory_all_dirty(start, length, DIRTY_MEMORY_MIGRATION)) {
         ret |= (1 << DIRTY_MEMORY_MIGRATION);
     }
+    if (mask & (1 << DIRTY_MEMORY_RECLAIM) &&
+        !cpu_physical_memory_all_dirty(start, length, DIRTY_MEMORY_RECLAIM)) {
+        ret |= (1 << DIRTY_MEMORY_RECLAIM);
+    }
+    if (mask & (1 << DIRTY_MEMORY_ROM) &&
+        !cpu_physical_memory_all_dirty(start, length, DIRTY_MEMORY_ROM)) {
+        ret |= (1 << DIRTY_MEMORY_ROM);
+    }
     return ret;
 }
 
@@ -322,6 +339,14 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
                 bitmap_set_atomic(blocks[DIRTY_MEMORY_CODE]->blocks[idx],
                                   offset, next - page);
             }
+            if (unlikely(mask & (1 << DIRTY_MEMORY_RECLAIM))) {
+                bitmap_set_atomic(blocks[DIRTY_MEMORY_RECLAIM]->blocks[idx],
+                                  offset, next - page);
+            }
+            if (unlikely(mask & (1 << DIRTY_MEMORY_ROM))) {
+                bitmap_set_atomic(blocks[DIRTY_MEMORY_ROM]->blocks[idx],
+                                  offset, next - page);
+            }
 
             page = next;
             idx++;
@@ -444,6 +469,8 @@ static inline void cpu_physical_memory_clear_dirty_range(ram_addr_t start,
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_MIGRATION);
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_VGA);
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_CODE);
+    cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_RECLAIM);
+    cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_ROM);
 }
 
 
@@ -60,6 +60,15 @@ struct RAMBlock {
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
 
+    /*
+     * With the hot-pages-last migration capability, how often each
+     * region of guest pages was written after being sent: halved at
+     * each bitmap sync and raised if the sync found it written again.
+     */
+    uint8_t *dirty_heat;
+    /* dirty_sync_count of the last sync of bmap with the dirty log */
+    uint64_t bmap_sync;
+
     /*
      * RAM block length that corresponds to the used_length on the migration
      * source (after RAM block sizes were synchronized). Especially, after
@@ -69,6 +78,17 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * Block whose translated code is reused for the pages of this block
+     * that have not been modified since (see memory_region_share_code()).
+     * Protected by the iothread lock.
+     */
+    struct RAMBlock *code_source;
+    /* bitmap of the target pages that no longer match code_source */
+    unsigned long *code_diverged;
+    /* bitmap of the pages discarded because they were zero */
+    unsigned long *zero_reclaimed;
 };
 #endif
 #endif
@@ -11,7 +11,9 @@ typedef struct RAMBlockNotifier RAMBlockNotifier;
 #define DIRTY_MEMORY_VGA       0
 #define DIRTY_MEMORY_CODE      1
 #define DIRTY_MEMORY_MIGRATION 2
-#define DIRTY_MEMORY_NUM       3        /* num of dirty bits */
+#define DIRTY_MEMORY_RECLAIM   3        /* TCG only, see ram-reclaim.c */
+#define DIRTY_MEMORY_ROM       4        /* TCG only, see hw/core/loader.c */
+#define DIRTY_MEMORY_NUM       5        /* num of dirty bits */
 
 /* The dirty memory bitmap is split into fixed-size blocks to allow growth
  * under RCU.  The bitmap for a block can be accessed as follows:
@@ -71,6 +73,8 @@ struct RAMBlockNotifier {
                               size_t max_size);
     void (*ram_block_resized)(RAMBlockNotifier *n, void *host, size_t old_size,
                               size_t new_size);
+    /* New memory was mapped at the same address, replacing the old pages */
+    void (*ram_block_remapped)(RAMBlockNotifier *n, void *host, size_t size);
     QLIST_ENTRY(RAMBlockNotifier) next;
 };
 
@@ -79,7 +83,9 @@ void ram_block_notifier_remove(RAMBlockNotifier *n);
 void ram_block_notify_add(void *host, size_t size, size_t max_size);
 void ram_block_notify_remove(void *host, size_t size, size_t max_size);
 void ram_block_notify_resize(void *host, size_t old_size, size_t new_size);
+void ram_block_notify_remap(void *host, size_t size);
 
 GString *ram_block_format(void);
+GString *ram_block_backing_format(void);
 
 #endif /* RAMLIST_H */
@@ -19,8 +19,15 @@
 #define HW_ARM_DIGIC_H
 
 #include "cpu.h"
+#include "hw/cpu/cluster.h"
+#include "hw/intc/digic-intc.h"
+#include "hw/timer/digic-clock.h"
 #include "hw/timer/digic-timer.h"
 #include "hw/char/digic-uart.h"
+#include "hw/sd/digic-sdhost.h"
+#include "hw/display/digic-lcd.h"
+#include "hw/dma/digic-edmac.h"
+#include "hw/misc/digic-mpu.h"
 #include "qom/object.h"
 
 #define TYPE_DIGIC "digic"
@@ -34,10 +41,58 @@ struct DigicState {
     DeviceState parent_obj;
     /*< public >*/
 
+    /* The second core, if any, is in cluster @cluster_id + 1 */
+    uint32_t cluster_id;
+    CPUClusterState cluster;
     ARMCPU cpu;
 
+    /*
+     * Optional second core, of any ARM model; it has a cluster of its
+     * own because cores of different models can't share translations.
+     */
+    char *cpu2_type;
+    CPUClusterState cpu2_cluster;
+    ARMCPU *cpu2;
+
+    DigicIntcState intc;
+    DigicClockState clock;
     DigicTimerState timer[DIGIC4_NB_TIMERS];
     DigicUartState uart;
+    DigicSDHostState sdhost;
+    DigicLcdState lcd;
+    DigicEdmacState edmac;
+    DigicMpuState mpu;
+    MemoryRegion unimp;
+
+    /* Address space of the SoC; the system memory if not set */
+    MemoryRegion *memory;
+    AddressSpace as;
+
+    uint64_t intc_base;
+    uint64_t clock_base;
+    uint64_t timer_base;
+    uint64_t uart_base;
+    uint64_t sdhost_base;
+    uint64_t lcd_base;
+    uint64_t edmac_base;
+    uint64_t mpu_base;
 };
 
+/* digic_checkpoint.c */
+#define DIGIC_CHECKPOINT_RAM    ".ram"
+#define DIGIC_CHECKPOINT_FLASH  ".flash"
+#define DIGIC_CHECKPOINT_STATE  ".state"
+
+/*
+ * Write the checkpoint files for @prefix.  The VM must be stopped.
+ */
+bool digic_checkpoint_save(DigicState *s, MemoryRegion *ram,
+                           MemoryRegion *flash, const char *prefix,
+                           Error **errp);
+/*
+ * Restore the CPU and device state from the checkpoint @prefix.  RAM and
+ * flash contents are not loaded; the board maps their images instead.
+ */
+bool digic_checkpoint_load(DigicState *s, const char *prefix, Error **errp);
+
 #endif /* HW_ARM_DIGIC_H */
@@ -215,6 +215,10 @@ typedef struct {
  *    purposes only.
  *    Applies only to default memory backend, i.e., explicit memory backend
  *    wasn't used.
+ * @small_footprint:
+ *    Default of the "small-footprint" machine property.  Set by boards
+ *    whose guests have little RAM, so that the per-process overheads of
+ *    the accelerator are sized after guest RAM instead of host RAM.
  */
 struct MachineClass {
     /*< private >*/
@@ -268,6 +272,7 @@ struct MachineClass {
     bool nvdimm_supported;
     bool numa_mem_supported;
     bool auto_enable_numa;
+    bool small_footprint;
     SMPCompatProps smp_props;
     const char *default_ram_id;
 
@@ -326,6 +331,7 @@ struct MachineState {
     int phandle_start;
     char *dt_compatible;
     bool dump_guest_core;
+    bool small_footprint;
     bool mem_merge;
     bool usb;
     bool usb_disabled;
@@ -20,6 +20,7 @@
 
 #include "hw/sysbus.h"
 #include "chardev/char-fe.h"
+#include "qemu/fifo8.h"
 #include "qom/object.h"
 
 #define TYPE_DIGIC_UART "digic-uart"
@@ -39,9 +40,19 @@ struct DigicUartState {
 
     MemoryRegion regs_region;
     CharBackend chr;
+    /* Raised while received data is ready */
+    qemu_irq irq;
 
     uint32_t reg_rx;
     uint32_t reg_st;
+
+    /* FIFO mode, enabled when fifo_depth is non-zero */
+    uint32_t fifo_depth;
+    Fifo8 rx_fifo;
+    uint8_t *tx_fifo;
+    uint32_t tx_count;
+    QEMUTimer *flush_timer;
+    guint watch_tag;
 };
 
 #endif /* HW_CHAR_DIGIC_UART_H */
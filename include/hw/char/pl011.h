@@ -31,6 +31,8 @@ struct PL011State {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    /* Protects the registers, which are read without the BQL */
+    QemuMutex lock;
     uint32_t readbuff;
     uint32_t flags;
     uint32_t lcr;
@@ -223,8 +223,13 @@ struct kvm_run;
 struct hax_vcpu_state;
 struct hvf_vcpu_state;
 
-#define TB_JMP_CACHE_BITS 12
+/*
+ * Size and associativity of tb_jmp_cache, chosen at configure time.  The
+ * entries of a set are adjacent, see tb_jmp_cache_set() in tb-hash.h.
+ */
+#define TB_JMP_CACHE_BITS CONFIG_TB_JMP_CACHE_BITS
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_WAYS CONFIG_TB_JMP_CACHE_WAYS
 
 /* work queue */
 
@@ -274,6 +279,14 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @lockstep_done: Instructions run in the current lockstep quantum.
+ * @lockstep_interrupt: Interrupts raised by other threads during the
+ * quantum, delivered at the barrier.
+ * @lockstep_arrived: The vCPU waits at the lockstep barrier.
+ * @rr_slice: Time slice of the vCPU in the round-robin TCG thread, in ns,
+ * or 0 if the slices are all TCG_KICK_PERIOD.
+ * @rr_exit_pc: Guest PC when cpu_exec() last returned, if @rr_slice.
+ * @rr_expired_pc: Guest PC at the end of the last slice that ran out.
  * @can_do_io: Nonzero if memory-mapped IO is safe. Deterministic execution
  * requires that IO only be performed on the last instruction of a TB
  * so that interrupts take effect immediately.
@@ -340,6 +353,12 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t lockstep_done;
+    int lockstep_interrupt;
+    bool lockstep_arrived;
+    int64_t rr_slice;
+    vaddr rr_exit_pc;
+    vaddr rr_expired_pc;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
 
@@ -356,6 +375,8 @@ struct CPUState {
 
     /* Accessed in parallel; all accesses must be atomic */
     TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* Bumped whenever entries are dropped from tb_jmp_cache */
+    uint64_t tb_jmp_cache_gen;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -367,6 +388,8 @@ struct CPUState {
 
     QTAILQ_HEAD(, CPUWatchpoint) watchpoints;
     CPUWatchpoint *watchpoint_hit;
+    /* CPUWatchpointPage by page address, see softmmu/physmem.c */
+    GHashTable *watchpoint_pages;
 
     void *opaque;
 
@@ -439,6 +462,7 @@ static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
     for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         qatomic_set(&cpu->tb_jmp_cache[i], NULL);
     }
+    cpu->tb_jmp_cache_gen++;
 }
 
 /**
@@ -991,6 +1015,8 @@ void cpu_check_watchpoint(CPUState *cpu, vaddr addr, vaddr len,
  *
  * Return the watchpoint flags that apply to [addr, addr+len).
  * If no watchpoint is registered for the range, the result is 0.
+ * Watchpoints are matched with a granule of 1/64th of a page, so the
+ * result may include those of watchpoints a few bytes away.
  */
 int cpu_watchpoint_address_matches(CPUState *cpu, vaddr addr, vaddr len);
 #endif
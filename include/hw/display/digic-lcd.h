@@ -0,0 +1,56 @@
+/*
+ * Canon DIGIC LCD controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_DISPLAY_DIGIC_LCD_H
+#define HW_DISPLAY_DIGIC_LCD_H
+
+#include "hw/sysbus.h"
+#include "ui/console.h"
+#include "qom/object.h"
+
+#define TYPE_DIGIC_LCD "digic-lcd"
+OBJECT_DECLARE_SIMPLE_TYPE(DigicLcdState, DIGIC_LCD)
+
+#define DIGIC_LCD_PALETTE_SIZE 256
+
+enum {
+    R_LCD_CTRL = 0x00,
+    R_LCD_BMP_ADDR = (0x04 >> 2),
+    R_LCD_BMP_PITCH = (0x08 >> 2),
+    R_LCD_YUV_ADDR = (0x0c >> 2),
+    R_LCD_YUV_PITCH = (0x10 >> 2),
+    R_LCD_PALETTE = (0x400 >> 2),
+    R_LCD_MAX = R_LCD_PALETTE + DIGIC_LCD_PALETTE_SIZE
+};
+
+struct DigicLcdState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion regs_region;
+    QemuConsole *con;
+
+    /* Memory the buffers are scanned out from */
+    MemoryRegion *dma_mr;
+    MemoryRegionSection bmp_section;
+    MemoryRegionSection yuv_section;
+    /* Rows that need composing again, set from the dirty bitmaps */
+    unsigned long *dirty_rows;
+    bool invalidate;
+
+    uint32_t width;
+    uint32_t height;
+
+    uint32_t ctrl;
+    uint32_t bmp_addr;
+    uint32_t bmp_pitch;
+    uint32_t yuv_addr;
+    uint32_t yuv_pitch;
+    uint32_t palette[DIGIC_LCD_PALETTE_SIZE];
+};
+
+#endif /* HW_DISPLAY_DIGIC_LCD_H */
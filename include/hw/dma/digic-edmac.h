@@ -0,0 +1,75 @@
+/*
+ * Canon DIGIC EDMAC engine declarations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef HW_DMA_DIGIC_EDMAC_H
+#define HW_DMA_DIGIC_EDMAC_H
+
+#include "hw/sysbus.h"
+#include "exec/memory.h"
+#include "qom/object.h"
+
+#define TYPE_DIGIC_EDMAC "digic-edmac"
+OBJECT_DECLARE_SIMPLE_TYPE(DigicEdmacState, DIGIC_EDMAC)
+
+#define DIGIC_EDMAC_NB_CHANNELS     16
+#define DIGIC_EDMAC_CHANNEL_STRIDE  0x100
+
+/* Registers of each channel */
+enum {
+    R_EDMAC_CTRL = 0x00,
+    R_EDMAC_STATUS = (0x04 >> 2),
+    R_EDMAC_SRC = (0x08 >> 2),
+    R_EDMAC_DST = (0x0c >> 2),
+    R_EDMAC_XSIZE = (0x10 >> 2),
+    R_EDMAC_YSIZE = (0x14 >> 2),
+    R_EDMAC_SRC_PITCH = (0x18 >> 2),
+    R_EDMAC_DST_PITCH = (0x1c >> 2),
+    R_EDMAC_MAX
+};
+
+typedef struct DigicEdmacChannel {
+    DigicEdmacState *edmac;
+    qemu_irq irq;
+    /* Completes the transfer in progress */
+    QEMUTimer *timer;
+
+    uint32_t ctrl;
+    uint32_t status;
+    uint32_t src;
+    uint32_t dst;
+    uint32_t xsize;
+    uint32_t ysize;
+    uint32_t src_pitch;
+    uint32_t dst_pitch;
+} DigicEdmacChannel;
+
+struct DigicEdmacState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion regs_region;
+
+    /* Memory the channels copy from and to */
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+
+    /* Transfer rate in virtual time; 0 completes transfers at once */
+    uint32_t bytes_per_us;
+
+    DigicEdmacChannel ch[DIGIC_EDMAC_NB_CHANNELS];
+};
+
+#endif /* HW_DMA_DIGIC_EDMAC_H */
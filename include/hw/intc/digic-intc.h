@@ -0,0 +1,57 @@
+/*
+ * Canon DIGIC interrupt controller declarations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef HW_INTC_DIGIC_INTC_H
+#define HW_INTC_DIGIC_INTC_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_DIGIC_INTC "digic-intc"
+OBJECT_DECLARE_SIMPLE_TYPE(DigicIntcState, DIGIC_INTC)
+
+#define DIGIC_INTC_NB_IRQS      128
+#define DIGIC_INTC_NB_WORDS     (DIGIC_INTC_NB_IRQS / 32)
+
+/* Value of R_INTC_ID when no enabled interrupt is pending */
+#define DIGIC_INTC_ID_NONE      0xffffffff
+
+enum {
+    R_INTC_ID = 0x00,
+    R_INTC_ENABLE = (0x04 >> 2),
+    R_INTC_DISABLE = (0x08 >> 2),
+    R_INTC_ACK = (0x0c >> 2),
+    R_INTC_PENDING0 = (0x10 >> 2),
+    R_INTC_ENABLED0 = (0x20 >> 2),
+    R_INTC_MAX = R_INTC_ENABLED0 + DIGIC_INTC_NB_WORDS
+};
+
+struct DigicIntcState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion regs_region;
+    qemu_irq irq;
+
+    /* Line levels, rising edges not yet acknowledged, and enable bits */
+    uint32_t level[DIGIC_INTC_NB_WORDS];
+    uint32_t latched[DIGIC_INTC_NB_WORDS];
+    uint32_t enabled[DIGIC_INTC_NB_WORDS];
+    /* Highest-priority enabled pending interrupt, or DIGIC_INTC_ID_NONE */
+    uint32_t active;
+};
+
+#endif /* HW_INTC_DIGIC_INTC_H */
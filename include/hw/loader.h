@@ -171,6 +171,20 @@ ssize_t load_elf(const char *filename,
                  uint64_t *highaddr, uint32_t *pflags, int big_endian,
                  int elf_machine, int clear_lsb, int data_swab);
 
+/** load_symbol_map:
+ * @filename: Path of the symbol map
+ * @errp: Populated with an error in failure cases
+ *
+ * Register the symbols listed in @filename for the logs and plugins, for
+ * images such as raw firmware dumps that carry no symbol table.  Each
+ * line of the map is a hexadecimal address, an optional hexadecimal size
+ * and a name; blank lines and lines starting with '#' are ignored.  A
+ * symbol without a size extends to the next one.
+ *
+ * Returns: true on success, false with @errp set otherwise.
+ */
+bool load_symbol_map(const char *filename, Error **errp);
+
 /** load_elf_hdr:
  * @filename: Path of ELF file
  * @hdr: Buffer to populate with header data. Header data will not be
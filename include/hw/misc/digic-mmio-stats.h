@@ -0,0 +1,20 @@
+/*
+ * Access counters for unmodelled Canon DIGIC registers.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_MISC_DIGIC_MMIO_STATS_H
+#define HW_MISC_DIGIC_MMIO_STATS_H
+
+#include "exec/hwaddr.h"
+
+/*
+ * Count a guest access to the unmodelled register at guest physical
+ * address @addr.  This is cheap enough to be called on every access,
+ * unlike formatting a LOG_UNIMP message; the counters are reported by
+ * the "info digic-mmio" monitor command.
+ */
+void digic_mmio_stats_record(hwaddr addr, bool is_write);
+
+#endif /* HW_MISC_DIGIC_MMIO_STATS_H */
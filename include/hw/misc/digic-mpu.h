@@ -0,0 +1,83 @@
+/*
+ * Canon DIGIC MPU message channel declarations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef HW_MISC_DIGIC_MPU_H
+#define HW_MISC_DIGIC_MPU_H
+
+#include "hw/sysbus.h"
+#include "chardev/shm-ring.h"
+#include "qom/object.h"
+
+#define TYPE_DIGIC_MPU "digic-mpu"
+OBJECT_DECLARE_SIMPLE_TYPE(DigicMpuState, DIGIC_MPU)
+
+#define DIGIC_MPU_MSG_MAX       256
+
+/*
+ * Layout of the file shared with the process emulating the MPU: the
+ * header of the ring to the MPU at offset 0, the header of the ring
+ * from the MPU at DIGIC_MPU_RING_FROM_OFFSET, and their data where
+ * the headers' data_offset say.  QEMU chooses these offsets and ignores
+ * any change the MPU makes to them.  Each ring follows the protocol of
+ * chardev/shm-ring.h; QEMU is the producer of the first one and the
+ * consumer of the second one.
+ *
+ * The rings carry whole messages, each one a little-endian 16-bit
+ * length followed by that many bytes, at most DIGIC_MPU_MSG_MAX.  A
+ * producer only publishes a message once all of it is in the ring.
+ */
+#define DIGIC_MPU_RING_FROM_OFFSET  4096
+#define DIGIC_MPU_RING_SIZE         16384
+
+enum {
+    R_MPU_STATUS = 0x00,
+    R_MPU_IRQ_EN = (0x04 >> 2),
+    R_MPU_RX_LEN = (0x08 >> 2),
+    R_MPU_RX_POP = (0x0c >> 2),
+    R_MPU_TX_SEND = (0x10 >> 2),
+    R_MPU_LOST = (0x14 >> 2),
+    R_MPU_MAX
+};
+
+/* Message windows */
+#define DIGIC_MPU_RX_WINDOW     0x100
+#define DIGIC_MPU_TX_WINDOW     0x200
+#define DIGIC_MPU_REGS_SIZE     0x300
+
+struct DigicMpuState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion regs_region;
+    qemu_irq irq;
+
+    char *path;
+    int32_t notify_fd;
+    int32_t kick_fd;
+    QemuShmRing *to_mpu;
+    QemuShmRing *from_mpu;
+    void *shm;
+
+    uint32_t irq_en;
+    /* Messages not sent because the ring to the MPU was full */
+    uint32_t lost;
+    /* Message being read by the firmware, valid if rx_len is not zero */
+    uint32_t rx_len;
+    uint8_t rx_msg[DIGIC_MPU_MSG_MAX];
+    uint8_t tx_msg[DIGIC_MPU_MSG_MAX];
+};
+
+#endif /* HW_MISC_DIGIC_MPU_H */
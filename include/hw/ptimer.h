@@ -129,6 +129,18 @@ ptimer_state *ptimer_init(ptimer_cb callback,
  */
 void ptimer_free(ptimer_state *s);
 
+/**
+ * ptimer_set_lock - Take a device lock when the ptimer expires
+ * @s: ptimer to configure
+ * @lock: the lock protecting the device that owns the ptimer
+ *
+ * For devices whose MMIO region uses memory_region_set_lock(): the
+ * expiry handler then updates the ptimer state and runs the callback
+ * with @lock held, so that it is safe to call ptimer_get_count() from
+ * a read callback that only holds @lock.
+ */
+void ptimer_set_lock(ptimer_state *s, QemuMutex *lock);
+
 /**
  * ptimer_transaction_begin() - Start a ptimer modification transaction
  *
@@ -91,6 +91,19 @@ struct RegisterInfo {
 DECLARE_INSTANCE_CHECKER(RegisterInfo, REGISTER,
                          TYPE_REGISTER)
 
+/*
+ * Entry of the dispatch table of a RegisterInfoArray.  The flags say
+ * which accesses can skip the masks and hooks that the register does
+ * not use.
+ */
+#define REGISTER_DISPATCH_FAST_READ     (1 << 0)
+#define REGISTER_DISPATCH_FAST_WRITE    (1 << 1)
+
+typedef struct RegisterDispatch {
+    RegisterInfo *reg;
+    unsigned flags;
+} RegisterDispatch;
+
 /**
  * This structure is used to group all of the individual registers which are
  * modeled using the RegisterInfo structure.
@@ -99,6 +112,10 @@ DECLARE_INSTANCE_CHECKER(RegisterInfo, REGISTER,
  *
  * @num_elements is the number of elements in the array r
  *
+ * @dispatch: the registers indexed by their address shifted right by
+ * @data_shift, built by register_init_block*() for register_read_memory()
+ * and register_write_memory(); @nb_dispatch entries
+ *
  * @mem: optional Memory region for the register
  */
 
@@ -108,6 +125,10 @@ struct RegisterInfoArray {
     int num_elements;
     RegisterInfo **r;
 
+    RegisterDispatch *dispatch;
+    uint64_t nb_dispatch;
+    int data_shift;
+
     bool debug;
     const char *prefix;
 };
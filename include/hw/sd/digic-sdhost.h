@@ -0,0 +1,56 @@
+/*
+ * Canon DIGIC SD host controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_SD_DIGIC_SDHOST_H
+#define HW_SD_DIGIC_SDHOST_H
+
+#include "hw/sysbus.h"
+#include "hw/sd/sd.h"
+#include "qom/object.h"
+
+#define TYPE_DIGIC_SDHOST "digic-sdhost"
+OBJECT_DECLARE_SIMPLE_TYPE(DigicSDHostState, DIGIC_SDHOST)
+
+enum {
+    R_SDHOST_CMD = 0x00,
+    R_SDHOST_ARG = (0x04 >> 2),
+    R_SDHOST_STATUS = (0x08 >> 2),
+    R_SDHOST_IRQ_EN = (0x0c >> 2),
+    R_SDHOST_RESP0 = (0x10 >> 2),
+    R_SDHOST_RESP3 = (0x1c >> 2),
+    R_SDHOST_BLKSIZE = (0x20 >> 2),
+    R_SDHOST_BLKCNT = (0x24 >> 2),
+    R_SDHOST_DMA_ADDR = (0x28 >> 2),
+    R_SDHOST_DATA = (0x2c >> 2),
+    R_SDHOST_MAX
+};
+
+struct DigicSDHostState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    SDBus sdbus;
+    MemoryRegion regs_region;
+    qemu_irq irq;
+
+    /* Memory the controller DMAs to and from */
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+
+    uint32_t cmd;
+    uint32_t arg;
+    uint32_t status;
+    uint32_t irq_en;
+    uint32_t resp[4];
+    uint32_t blksize;
+    uint32_t blkcnt;
+    uint32_t dma_addr;
+    /* Bytes left in the current PIO transfer */
+    uint32_t data_left;
+};
+
+#endif /* HW_SD_DIGIC_SDHOST_H */
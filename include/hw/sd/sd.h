@@ -32,6 +32,7 @@
 
 #include "hw/qdev-core.h"
 #include "qom/object.h"
+#include "sysemu/dma.h"
 
 #define OUT_OF_RANGE            (1 << 31)
 #define ADDRESS_ERROR           (1 << 30)
@@ -116,6 +117,30 @@ struct SDCardClass {
      * Return: byte value read
      */
     uint8_t (*read_byte)(SDState *sd);
+    /**
+     * Write whole blocks to a SD card.
+     * @sd: card
+     * @buf: data to write
+     * @length: number of bytes available in @buf
+     *
+     * Optional.  Write as many whole blocks of the current transfer as
+     * @length holds, as @write_byte would but with a single request.
+     *
+     * Return: number of bytes written, possibly 0
+     */
+    size_t (*write_data)(SDState *sd, const void *buf, size_t length);
+    /**
+     * Read whole blocks from a SD card.
+     * @sd: card
+     * @buf: buffer to read data into
+     * @length: size of @buf
+     *
+     * Optional.  Read as many whole blocks of the current transfer as
+     * @length holds, as @read_byte would but with a single request.
+     *
+     * Return: number of bytes read, possibly 0
+     */
+    size_t (*read_data)(SDState *sd, void *buf, size_t length);
     bool (*receive_ready)(SDState *sd);
     bool (*data_ready)(SDState *sd);
     void (*set_voltage)(SDState *sd, uint16_t millivolts);
@@ -188,6 +213,30 @@ void sdbus_write_data(SDBus *sdbus, const void *buf, size_t length);
  * Read multiple bytes of data on the data lines of a SD bus.
  */
 void sdbus_read_data(SDBus *sdbus, void *buf, size_t length);
+/**
+ * Write data from guest memory to a SD bus.
+ * @sdbus: bus
+ * @as: address space to read the data from
+ * @addr: guest address of the data
+ * @length: number of bytes to write
+ *
+ * Like sdbus_write_data(), but without a copy through a controller
+ * buffer when @addr can be mapped.
+ */
+void sdbus_write_data_dma(SDBus *sdbus, AddressSpace *as, dma_addr_t addr,
+                          size_t length);
+/**
+ * Read data from a SD bus to guest memory.
+ * @sdbus: bus
+ * @as: address space to write the data to
+ * @addr: guest address to read the data into
+ * @length: number of bytes to read
+ *
+ * Like sdbus_read_data(), but without a copy through a controller
+ * buffer when @addr can be mapped.
+ */
+void sdbus_read_data_dma(SDBus *sdbus, AddressSpace *as, dma_addr_t addr,
+                         size_t length);
 bool sdbus_receive_ready(SDBus *sd);
 bool sdbus_data_ready(SDBus *sd);
 bool sdbus_get_inserted(SDBus *sd);
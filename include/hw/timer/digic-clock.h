@@ -0,0 +1,57 @@
+/*
+ * Canon DIGIC clock declarations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#ifndef HW_TIMER_DIGIC_CLOCK_H
+#define HW_TIMER_DIGIC_CLOCK_H
+
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_DIGIC_CLOCK "digic-clock"
+OBJECT_DECLARE_SIMPLE_TYPE(DigicClockState, DIGIC_CLOCK)
+
+/* Free-running microsecond counter */
+#define DIGIC_CLOCK_VALUE       0x14
+#define DIGIC_CLOCK_VALUE_BITS  20
+
+struct DigicClockState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+
+    /* Time of the SoC minus QEMU_CLOCK_VIRTUAL */
+    int64_t offset;
+    /* Time of the SoC when last migrated */
+    int64_t saved_ns;
+};
+
+/*
+ * Time of the SoC, in ns, that all DIGIC counters are derived from:
+ * QEMU_CLOCK_VIRTUAL, hence a count of instructions with icount,
+ * carrying on from where it was when the state of @s was saved.  It
+ * only reads clocks, so it can be called without the BQL.  A NULL @s
+ * stands for QEMU_CLOCK_VIRTUAL itself.
+ */
+int64_t digic_clock_get_ns(DigicClockState *s);
+
+/*
+ * QEMU_CLOCK_VIRTUAL time at which the time of @s is @ns, to arm
+ * QEMU timers with.
+ */
+int64_t digic_clock_to_virtual(DigicClockState *s, int64_t ns);
+
+#endif /* HW_TIMER_DIGIC_CLOCK_H */
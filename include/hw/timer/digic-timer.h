@@ -19,7 +19,7 @@
 #define HW_TIMER_DIGIC_TIMER_H
 
 #include "hw/sysbus.h"
-#include "hw/ptimer.h"
+#include "hw/timer/digic-clock.h"
 #include "qom/object.h"
 
 #define TYPE_DIGIC_TIMER "digic-timer"
@@ -37,10 +37,29 @@ struct DigicTimerState {
     /*< public >*/
 
     MemoryRegion iomem;
-    ptimer_state *ptimer;
+    /* Protects the registers, which are read without the BQL */
+    QemuMutex lock;
+    qemu_irq irq;
+    /* Fires at each rollover of the counter, to pulse irq */
+    QEMUTimer *irq_timer;
+    /* Time source of the SoC; QEMU_CLOCK_VIRTUAL if not set */
+    DigicClockState *clock;
 
     uint32_t control;
     uint32_t relvalue;
+    bool running;
+    /* Counter value while the timer is stopped, or when last migrated. */
+    uint32_t value;
+    /* Time of @clock at which the counter last held RELVALUE. */
+    int64_t load_time;
+
+    /* Busy-wait detection, see digic_timer_poll() */
+    uint32_t poll_threshold;
+    uint32_t poll_sleep_us;
+    uint32_t poll_count;
+    int64_t poll_last;
+    CPUState *poll_cpu;
+    QEMUTimer *poll_timer;
 };
 
 #endif /* HW_TIMER_DIGIC_TIMER_H */
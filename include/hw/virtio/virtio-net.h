@@ -39,6 +39,8 @@ typedef struct virtio_net_conf
 {
     uint32_t txtimer;
     int32_t txburst;
+    uint32_t rx_coalesce_usecs;
+    uint32_t rx_coalesce_frames;
     char *tx;
     uint16_t rx_queue_size;
     uint16_t tx_queue_size;
@@ -142,6 +144,17 @@ typedef struct VirtioNetRssData {
     uint16_t default_queue;
 } VirtioNetRssData;
 
+/* Per-queue counters, shown by "info virtio-net" */
+typedef struct VirtIONetQueueStats {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    uint64_t rx_no_buffers;
+    uint64_t rx_notifies;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_notifies;
+} VirtIONetQueueStats;
+
 typedef struct VirtIONetQueue {
     VirtQueue *rx_vq;
     VirtQueue *tx_vq;
@@ -151,6 +164,10 @@ typedef struct VirtIONetQueue {
     struct {
         VirtQueueElement *elem;
     } async_tx;
+    /* Interrupt coalescing, only with rx-coalesce-usecs */
+    QEMUTimer *rx_notify_timer;
+    uint32_t rx_pending;
+    VirtIONetQueueStats stats;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
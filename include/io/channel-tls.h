@@ -48,6 +48,8 @@ struct QIOChannelTLS {
     QIOChannel *master;
     QCryptoTLSSession *session;
     QIOChannelShutdown shutdown;
+    /* The kernel encrypts what is written to the master socket */
+    bool ktls_send;
 };
 
 /**
@@ -186,6 +186,13 @@ struct VMStateDescription {
     LoadStateHandler *load_state_old;
     int (*pre_load)(void *opaque);
     int (*post_load)(void *opaque, int version_id);
+    /*
+     * post_load neither needs the BQL nor looks at other devices, so
+     * that with the parallel-device-load capability, it can run on
+     * another thread, while the destination loads the next sections
+     * that also set this.
+     */
+    bool post_load_independent;
     int (*pre_save)(void *opaque);
     int (*post_save)(void *opaque);
     bool (*needed)(void *opaque);
@@ -1167,6 +1174,9 @@ extern const VMStateInfo vmstate_info_qlist;
 
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id);
+int vmstate_load_state_no_post_load(QEMUFile *f,
+                                    const VMStateDescription *vmsd,
+                                    void *opaque, int version_id);
 int vmstate_save_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, JSONWriter *vmdesc);
 int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
@@ -16,6 +16,7 @@
 
 #include "monitor/monitor.h"
 #include "qemu/queue.h"
+#include "qemu/stats64.h"
 
 typedef void (QmpCommandFunc)(QDict *, QObject **, Error **);
 
@@ -37,6 +38,10 @@ typedef struct QmpCommand
     QTAILQ_ENTRY(QmpCommand) node;
     bool enabled;
     const char *disable_reason;
+    /* Execution statistics, updated by qmp_dispatch() */
+    Stat64 calls;
+    Stat64 total_ns;
+    Stat64 max_ns;
 } QmpCommand;
 
 typedef QTAILQ_HEAD(QmpCommandList, QmpCommand) QmpCommandList;
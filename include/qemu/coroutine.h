@@ -122,6 +122,23 @@ bool qemu_in_coroutine(void);
  */
 bool qemu_coroutine_entered(Coroutine *co);
 
+/**
+ * Increase the number of coroutines kept in the pools, for users that
+ * keep up to @additional_pool_size more requests in flight
+ */
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
+
+/**
+ * Undo qemu_coroutine_inc_pool_size()
+ */
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size);
+
+/**
+ * Format how many coroutines were created, how many of them came from
+ * the pool, and how many stacks are allocated
+ */
+GString *qemu_coroutine_stats_format(void);
+
 /**
  * Provides a mutex that can be used to synchronise coroutines
  */
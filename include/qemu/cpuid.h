@@ -31,6 +31,9 @@
 #ifndef bit_MOVBE
 #define bit_MOVBE       (1 << 22)
 #endif
+#ifndef bit_AES
+#define bit_AES         (1 << 25)
+#endif
 #ifndef bit_OSXSAVE
 #define bit_OSXSAVE     (1 << 27)
 #endif
@@ -48,9 +51,15 @@
 #ifndef bit_AVX512F
 #define bit_AVX512F        (1 << 16)
 #endif
+#ifndef bit_AVX512BW
+#define bit_AVX512BW       (1 << 30)
+#endif
 #ifndef bit_BMI2
 #define bit_BMI2        (1 << 8)
 #endif
+#ifndef bit_SHA
+#define bit_SHA         (1 << 29)
+#endif
 
 /* Leaf 0x80000001, %ecx */
 #ifndef bit_LZCNT
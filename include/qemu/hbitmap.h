@@ -349,4 +349,12 @@ bool hbitmap_next_dirty_area(const HBitmap *hb, int64_t start, int64_t end,
  */
 int64_t hbitmap_iter_next(HBitmapIter *hbi);
 
+/**
+ * hbitmap_test_next_accel:
+ *
+ * For tests and benchmarks: stop using the vector kernels in use and
+ * fall back to the next best ones.  Return false if there is none.
+ */
+bool hbitmap_test_next_accel(void);
+
 #endif
@@ -64,6 +64,8 @@ static inline bool qemu_log_separate(void)
 #define CPU_LOG_PLUGIN     (1 << 18)
 /* LOG_STRACE is used for user-mode strace logging. */
 #define LOG_STRACE         (1 << 19)
+#define LOG_STARTUP        (1 << 20)
+#define LOG_ASYNC          (1 << 21)
 
 /* Lock output for a series of related logs.  Since this is not needed
  * for a single qemu_log / qemu_log_mask / qemu_log_mask_and_addr, we
@@ -71,14 +73,30 @@ static inline bool qemu_log_separate(void)
  * qemu_loglevel is never set when qemu_logfile is unset.
  */
 
+/*
+ * With LOG_ASYNC, the stream of the calling thread instead of the log
+ * file; NULL if it can't be created.
+ */
+FILE *qemu_log_async_lock(void);
+/* Returns false if @fd is not the stream of the calling thread */
+bool qemu_log_async_unlock(FILE *fd);
+
 static inline FILE *qemu_log_lock(void)
 {
     QemuLogFile *logfile;
     rcu_read_lock();
     logfile = qatomic_rcu_read(&qemu_logfile);
     if (logfile) {
-        qemu_flockfile(logfile->fd);
-        return logfile->fd;
+        FILE *fd = NULL;
+
+        if (unlikely(qemu_loglevel_mask(LOG_ASYNC))) {
+            fd = qemu_log_async_lock();
+        }
+        if (!fd) {
+            fd = logfile->fd;
+            qemu_flockfile(fd);
+        }
+        return fd;
     } else {
         return NULL;
     }
@@ -86,7 +104,7 @@ static inline FILE *qemu_log_lock(void)
 
 static inline void qemu_log_unlock(FILE *fd)
 {
-    if (fd) {
+    if (fd && !qemu_log_async_unlock(fd)) {
         qemu_funlockfile(fd);
     }
     rcu_read_unlock();
@@ -99,14 +117,12 @@ static inline void qemu_log_unlock(FILE *fd)
 static inline void GCC_FMT_ATTR(1, 0)
 qemu_log_vprintf(const char *fmt, va_list va)
 {
-    QemuLogFile *logfile;
+    FILE *fd = qemu_log_lock();
 
-    rcu_read_lock();
-    logfile = qatomic_rcu_read(&qemu_logfile);
-    if (logfile) {
-        vfprintf(logfile->fd, fmt, va);
+    if (fd) {
+        vfprintf(fd, fmt, va);
     }
-    rcu_read_unlock();
+    qemu_log_unlock(fd);
 }
 
 /* log only if a bit is set on the current loglevel mask:
@@ -161,6 +177,8 @@ void qemu_print_log_usage(FILE *f);
 
 /* fflush() the log file */
 void qemu_log_flush(void);
+/* Log @fmt, with the time since QEMU started, if "startup" is enabled */
+void GCC_FMT_ATTR(1, 2) qemu_log_startup(const char *fmt, ...);
 /* Close the log file */
 void qemu_log_close(void);
 
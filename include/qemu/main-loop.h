@@ -314,4 +314,37 @@ typedef struct MainLoopPoll {
 void main_loop_poll_add_notifier(Notifier *notify);
 void main_loop_poll_remove_notifier(Notifier *notify);
 
+typedef enum {
+    MAIN_LOOP_CB_BH,
+    MAIN_LOOP_CB_FD,
+    MAIN_LOOP_CB_TIMER,
+    MAIN_LOOP_CB__MAX,
+} MainLoopCallbackType;
+
+/**
+ * main_loop_cb_begin: Start timing a callback
+ *
+ * Returns a timestamp to pass to main_loop_cb_end(), or 0 if the caller
+ * does not run in the main loop thread and nothing is measured.
+ */
+int64_t main_loop_cb_begin(void);
+
+/**
+ * main_loop_cb_end: Account a callback timed with main_loop_cb_begin()
+ * @type: the kind of callback
+ * @fn: the function that was run
+ * @name: a name for the callback, or NULL to use the symbol of @fn
+ * @start: the value returned by main_loop_cb_begin()
+ *
+ * Adds the time taken by the callback to the histogram for @type, and
+ * remembers it as a slow callback if it took more than
+ * MAIN_LOOP_SLOW_CB_NS.  Both are reported by x-query-main-loop.
+ */
+void main_loop_cb_end(MainLoopCallbackType type, const void *fn,
+                      const char *name, int64_t start);
+
+#define MAIN_LOOP_SLOW_CB_NS    (10 * SCALE_MS)
+
+GString *main_loop_stats_format(void);
+
 #endif
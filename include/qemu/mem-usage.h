@@ -0,0 +1,26 @@
+/*
+ * Memory accounting per subsystem
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_MEM_USAGE_H
+#define QEMU_MEM_USAGE_H
+
+#include "qapi/qapi-types-machine.h"
+
+/*
+ * The big allocators of a subsystem call these when they allocate and
+ * free memory, so that "query-memory-usage" can tell where the memory
+ * of the process goes.  They are thread-safe and cheap enough to be
+ * called for each allocation, but are meant for large or numerous
+ * objects, not for every g_malloc().
+ */
+void mem_usage_add(MemoryUsageSubsystem subsys, uint64_t bytes);
+void mem_usage_sub(MemoryUsageSubsystem subsys, uint64_t bytes);
+
+/* Bytes currently allocated on behalf of @subsys */
+uint64_t mem_usage_get(MemoryUsageSubsystem subsys);
+
+#endif
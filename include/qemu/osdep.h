@@ -385,6 +385,7 @@ void *qemu_anon_ram_alloc(size_t size, uint64_t *align, bool shared,
                           bool noreserve);
 void qemu_vfree(void *ptr);
 void qemu_anon_ram_free(void *ptr, size_t size);
+size_t qemu_thp_size(void);
 
 /*
  * It's an analog of GLIB's g_autoptr_cleanup_generic_gfree(), used to define
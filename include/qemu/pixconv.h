@@ -0,0 +1,51 @@
+/*
+ * Pixel format conversion for display device models
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_PIXCONV_H
+#define QEMU_PIXCONV_H
+
+/*
+ * Each function converts a row of @n pixels from @src, in guest memory
+ * order, to 32-bit host pixels as rgb_to_pixel32() builds them.  They
+ * suit the drawfn of framebuffer_update_display() when the surface is
+ * 32 bits per pixel.  The best implementation the host CPU supports is
+ * picked at startup; they all give the same result.
+ *
+ * With @bgr, the guest format has red and blue swapped: the high bits
+ * of RGB565, or the first byte of RGB888 and RGBX8888, hold blue.
+ */
+
+/* Little-endian 16-bit pixels, red in bits 15-11, blue in bits 4-0 */
+void pixconv_rgb565(uint32_t *dst, const uint8_t *src, int n, bool bgr);
+
+/* 3 bytes per pixel: red, green, blue */
+void pixconv_rgb888(uint32_t *dst, const uint8_t *src, int n, bool bgr);
+
+/* 4 bytes per pixel: red, green, blue, ignored */
+void pixconv_rgbx8888(uint32_t *dst, const uint8_t *src, int n, bool bgr);
+
+/* 8-bit indexes into @palette, whose entries are host pixels */
+void pixconv_pal8(uint32_t *dst, const uint8_t *src, int n,
+                  const uint32_t *palette);
+
+/*
+ * YUV 4:2:2, as U, Y0, V, Y1 for each pair of pixels; @n must be even.
+ * The chroma is centered on 0 with @signed_chroma, on 128 otherwise.
+ * BT.601 full range.
+ */
+void pixconv_uyvy(uint32_t *dst, const uint8_t *src, int n,
+                  bool signed_chroma);
+
+/*
+ * Switch to the next slower implementation, for tests and benchmarks.
+ * Returns false once the portable C one is in use.
+ */
+bool pixconv_next_accel(void);
+
+/* Name of the implementation in use */
+const char *pixconv_accel_name(void);
+
+#endif /* QEMU_PIXCONV_H */
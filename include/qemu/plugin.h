@@ -87,7 +87,10 @@ enum plugin_dyn_cb_type {
 
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
+    PLUGIN_CB_REGULAR_R,    /* needs the guest registers in env */
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
+    PLUGIN_CB_MEM_RING,
     PLUGIN_N_CB_SUBTYPES,
 };
 
@@ -107,10 +110,60 @@ struct qemu_plugin_dyn_cb {
         struct {
             enum qemu_plugin_op op;
             uint64_t imm;
+            /* distance between the entries of two vCPUs, 0 if global */
+            size_t stride;
         } inline_insn;
+        /*
+         * add @imm to the counter at @ptr, and call f.vcpu_udata once it
+         * reaches @period, resetting it first if @reset
+         */
+        struct {
+            void *ptr;
+            size_t stride;
+            uint64_t imm;
+            uint64_t period;
+            bool reset;
+        } cond;
     };
 };
 
+struct qemu_plugin_scoreboard {
+    void *data;
+    size_t element_size;
+    size_t stride;          /* element_size rounded up to a cache line */
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/*
+ * Records that one instruction may append inline after the check at its
+ * start found room.  Beyond that, the ring wraps over its oldest records.
+ */
+#define PLUGIN_MEM_RING_SLACK 64
+
+struct qemu_plugin_mem_ring {
+    /* a struct plugin_mem_ring_head, then the records, for each vCPU */
+    struct qemu_plugin_scoreboard *score;
+    size_t size;            /* records per vCPU, a power of 2 */
+    qemu_plugin_vcpu_mem_ring_cb_t cb;
+    void *userdata;
+};
+
+struct plugin_mem_ring_head {
+    uint64_t head;          /* records appended since the last drain */
+    uint64_t reserved;
+    qemu_plugin_mem_record records[];
+};
+
+/*
+ * The generated code only updates the low 32 bits of @head, which the
+ * drains keep far below 2^32.
+ */
+#ifdef HOST_WORDS_BIGENDIAN
+#define PLUGIN_MEM_RING_HEAD_LO 4
+#else
+#define PLUGIN_MEM_RING_HEAD_LO 0
+#endif
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
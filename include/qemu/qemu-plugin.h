@@ -50,7 +50,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -217,8 +217,9 @@ struct qemu_plugin_insn;
  * @QEMU_PLUGIN_CB_R_REGS: callback reads the CPU's regs
  * @QEMU_PLUGIN_CB_RW_REGS: callback reads and writes the CPU's regs
  *
- * Note: currently unused, plugins cannot read or change system
- * register state.
+ * Registers can be read with qemu_plugin_read_register() from the
+ * callbacks declared with QEMU_PLUGIN_CB_R_REGS; plugins cannot change
+ * them, so QEMU_PLUGIN_CB_RW_REGS is treated the same way.
  */
 enum qemu_plugin_cb_flags {
     QEMU_PLUGIN_CB_NO_REGS,
@@ -299,6 +300,105 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * struct qemu_plugin_scoreboard - per-vCPU storage for inline ops
+ *
+ * A scoreboard holds one entry of a plugin-defined size for each vCPU.
+ * The entries are padded to the host cache line size, so that inline
+ * ops from different vCPUs never contend over the same line.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - a uint64_t member of each scoreboard entry
+ *
+ * @score: the scoreboard holding the entries
+ * @offset: the offset of the member in an entry
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * qemu_plugin_scoreboard_new() - allocate a new scoreboard
+ * @element_size: size of the entry kept for each vCPU
+ *
+ * The entries are zeroed, including those of vCPUs created later.
+ */
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: the scoreboard
+ *
+ * No generated code may refer to @score any more, e.g. free it from the
+ * atexit callback.
+ */
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get the entry of a vCPU
+ * @score: the scoreboard
+ * @vcpu_index: the vCPU
+ *
+ * Returns: the address of the entry, which stays valid until the next
+ * vCPU is created.
+ */
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_get() - read the member of a vCPU's entry
+ * @entry: the member
+ * @vcpu_index: the vCPU
+ */
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_sum() - sum the member over the entries of all vCPUs
+ * @entry: the member
+ */
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard member to apply the op to
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies to
+ * the entry of the executing vCPU, so that the results are exact with
+ * several vCPUs.
+ */
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_sampled_cb() - sampled tb execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @entry: the scoreboard member counting the executions of each vCPU
+ * @period: the number of executions per call
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_cb(), but @cb is only called
+ * on every @period-th execution by a vCPU.  The executions in between
+ * only increment @entry inline, which is reset to 0 when @cb is called.
+ */
+void qemu_plugin_register_vcpu_tb_exec_sampled_cb(
+    struct qemu_plugin_tb *tb,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -313,6 +413,28 @@ void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             enum qemu_plugin_cb_flags flags,
                                             void *userdata);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_sampled_cb() - sampled insn execution cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @entry: the scoreboard member counting the executions of each vCPU
+ * @period: the number of executions per call
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_cb(), but @cb is only called
+ * on every @period-th execution by a vCPU, see
+ * qemu_plugin_register_vcpu_tb_exec_sampled_cb().  Sharing @entry among
+ * instructions samples one executed instruction in @period.
+ */
+void qemu_plugin_register_vcpu_insn_exec_sampled_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_inline() - insn execution inline op
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -327,6 +449,22 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: the scoreboard member to apply the op to
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but the op applies
+ * to the entry of the executing vCPU.
+ */
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -496,6 +634,68 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * typedef qemu_plugin_mem_record - a memory access recorded in a ring
+ * @vaddr: the virtual address of the access
+ * @info: the access, for the qemu_plugin_mem_* query helpers
+ *
+ * qemu_plugin_get_hwaddr() cannot be used on a record, since by the time
+ * the ring is drained the TLB may no longer map @vaddr.
+ */
+typedef struct {
+    uint64_t vaddr;
+    qemu_plugin_meminfo_t info;
+    uint32_t reserved;
+} qemu_plugin_mem_record;
+
+typedef void
+(*qemu_plugin_vcpu_mem_ring_cb_t)(unsigned int vcpu_index,
+                                  const qemu_plugin_mem_record *records,
+                                  size_t n, void *userdata);
+
+/**
+ * struct qemu_plugin_mem_ring - per-vCPU rings of memory access records
+ */
+struct qemu_plugin_mem_ring;
+
+/**
+ * qemu_plugin_mem_ring_new() - allocate memory access rings
+ * @n_records: the size of the ring of each vCPU
+ * @cb: callback function draining a ring
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The accesses registered with qemu_plugin_register_vcpu_mem_ring() are
+ * appended inline to the ring of the vCPU that does them, and @cb is
+ * called to consume them when the ring is nearly full, at the start of
+ * an instruction of the same vCPU, and from qemu_plugin_mem_ring_drain().
+ * Nothing calls @cb at exit: drain the rings from the atexit callback.
+ */
+struct qemu_plugin_mem_ring *
+qemu_plugin_mem_ring_new(size_t n_records, qemu_plugin_vcpu_mem_ring_cb_t cb,
+                         void *userdata);
+
+/**
+ * qemu_plugin_register_vcpu_mem_ring() - record memory accesses in a ring
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @rw: monitor reads, writes or both
+ * @ring: where to record the accesses
+ *
+ * A batched alternative to qemu_plugin_register_vcpu_mem_cb(): the cost
+ * of calling into the plugin is paid once per drained ring instead of
+ * once per access.
+ */
+void qemu_plugin_register_vcpu_mem_ring(struct qemu_plugin_insn *insn,
+                                        enum qemu_plugin_mem_rw rw,
+                                        struct qemu_plugin_mem_ring *ring);
+
+/**
+ * qemu_plugin_mem_ring_drain() - drain the rings of all vCPUs
+ * @ring: the rings
+ *
+ * Must not race with the vCPUs, e.g. call it from the atexit callback.
+ */
+void qemu_plugin_mem_ring_drain(struct qemu_plugin_mem_ring *ring);
+
 
 
 typedef void
@@ -534,6 +734,55 @@ char *qemu_plugin_insn_disas(const struct qemu_plugin_insn *insn);
  */
 const char *qemu_plugin_insn_symbol(const struct qemu_plugin_insn *insn);
 
+/** struct qemu_plugin_register - Opaque handle for a guest register */
+struct qemu_plugin_register;
+
+/**
+ * qemu_plugin_find_register() - look up a register of a vCPU
+ * @vcpu_index: the vCPU
+ * @name: the register name, as in the gdb XML description of the target
+ *
+ * The names are matched ignoring case, e.g. "pc", "sp" and "lr" on Arm.
+ * Look the registers up once, e.g. from the vCPU init callback.
+ *
+ * Returns: a handle for qemu_plugin_read_register(), or NULL if the
+ * vCPU has no register called @name.
+ */
+struct qemu_plugin_register *
+qemu_plugin_find_register(unsigned int vcpu_index, const char *name);
+
+/**
+ * qemu_plugin_read_register() - read a register of the current vCPU
+ * @reg: a handle from qemu_plugin_find_register()
+ * @buf: where to copy the value, in target byte order
+ * @size: the size of @buf
+ *
+ * Only valid from a tb or insn exec callback (plain or sampled) that was
+ * registered with QEMU_PLUGIN_CB_R_REGS or QEMU_PLUGIN_CB_RW_REGS; the
+ * registers are read, never written.  The program counter is only
+ * updated at the start of a TB: from an insn callback, use
+ * qemu_plugin_insn_vaddr() instead.
+ *
+ * Returns: the size of the register, of which at most @size bytes are
+ * copied, 0 if @reg is not valid, or -1 outside of a vCPU callback.
+ */
+int qemu_plugin_read_register(struct qemu_plugin_register *reg,
+                              void *buf, size_t size);
+
+/**
+ * qemu_plugin_read_memory_vaddr() - read guest memory of the current vCPU
+ * @addr: the guest virtual address
+ * @buf: where to copy the data
+ * @len: the number of bytes to read
+ *
+ * The access goes through the page tables of the vCPU the way a
+ * debugger's does: it neither faults nor triggers watchpoints.  Only
+ * valid from a vCPU callback.
+ *
+ * Returns: true if the whole range could be read.
+ */
+bool qemu_plugin_read_memory_vaddr(uint64_t addr, void *buf, size_t len);
+
 /**
  * qemu_plugin_vcpu_for_each() - iterate over the existing vCPU
  * @id: plugin ID
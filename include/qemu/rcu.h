@@ -195,6 +195,11 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC(RCUReadAuto, rcu_read_auto_unlock)
 void rcu_add_force_rcu_notifier(Notifier *n);
 void rcu_remove_force_rcu_notifier(Notifier *n);
 
+/*
+ * Format the grace period latencies and the call_rcu() backlog.
+ */
+GString *rcu_stats_format(void);
+
 #ifdef __cplusplus
 }
 #endif
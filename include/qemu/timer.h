@@ -86,7 +86,11 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
+    /* Links in the pairing heap of the timer list */
+    QEMUTimer *child;
     QEMUTimer *next;
+    QEMUTimer *prev;
+    uint64_t seq;
     int attributes;
     int scale;
 };
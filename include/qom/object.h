@@ -137,6 +137,11 @@ struct ObjectClass
     ObjectUnparent *unparent;
 
     GHashTable *properties;
+    /*
+     * The properties of the class and of all its ancestors, filled in
+     * once class_init has run; NULL while the class is being initialized.
+     */
+    GHashTable *all_properties;
 };
 
 /**
@@ -989,6 +994,14 @@ GSList *object_class_get_list(const char *implements_type,
 GSList *object_class_get_list_sorted(const char *implements_type,
                               bool include_abstract);
 
+/**
+ * object_class_init_stats:
+ * @count: Return location for the number of classes initialized so far.
+ * @time_us: Return location for the time spent in their class_init
+ * functions, in microseconds; only measured with "-d startup".
+ */
+void object_class_init_stats(unsigned *count, int64_t *time_us);
+
 /**
  * object_ref:
  * @obj: the object
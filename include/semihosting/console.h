@@ -53,6 +53,18 @@ void qemu_semihosting_console_outc(CPUArchState *env, target_ulong c);
  */
 target_ulong qemu_semihosting_console_inc(CPUArchState *env);
 
+/**
+ * qemu_semihosting_console_flush:
+ *
+ * Write out the characters that qemu_semihosting_console_outc() has
+ * buffered.  Any other console output flushes them first, as does
+ * stopping the VM, and they are never kept for more than a few
+ * milliseconds.  Call it before exiting QEMU from a vCPU.
+ *
+ * Returns: nothing
+ */
+void qemu_semihosting_console_flush(void);
+
 /**
  * qemu_semihosting_log_out:
  * @s: pointer to string
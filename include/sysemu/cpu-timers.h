@@ -37,6 +37,15 @@ extern int use_icount;
  */
 void icount_update(CPUState *cpu);
 
+/*
+ * Set when the TCG vCPUs run in lockstep quanta (lockstep-quantum
+ * accel property).  Each vCPU then counts its instructions in
+ * cpu->lockstep_done, and global time moves by a whole quantum in
+ * icount_lockstep_advance(), while all the vCPUs are at the barrier.
+ */
+extern bool icount_lockstep;
+void icount_lockstep_advance(int64_t insns);
+
 /* get raw icount value */
 int64_t icount_get_raw(void);
 
@@ -0,0 +1,36 @@
+/*
+ * Per-vCPU dirty page rate limit
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_DIRTYLIMIT_H
+#define SYSEMU_DIRTYLIMIT_H
+
+/*
+ * Length of a dirty page rate measurement by the dirty limit, in
+ * milliseconds.  The throttle of each limited vCPU is adjusted once
+ * per period.
+ */
+#define DIRTYLIMIT_CALC_PERIOD_MS   1000
+
+/**
+ * dirtylimit_vcpu_execute:
+ * @cpu: the vCPU whose dirty ring just filled up
+ *
+ * Sleep for the time the dirty limit of @cpu currently asks for, if
+ * it has one.  Called by the vCPU thread, without the BQL, every time
+ * the KVM dirty ring of @cpu is full; this is what slows down a vCPU
+ * that dirties memory faster than its limit, and only that vCPU.
+ */
+void dirtylimit_vcpu_execute(CPUState *cpu);
+
+/**
+ * dirtylimit_in_service:
+ *
+ * Returns: %true if at least one vCPU has a dirty page rate limit.
+ */
+bool dirtylimit_in_service(void);
+
+#endif /* SYSEMU_DIRTYLIMIT_H */
@@ -40,6 +40,7 @@ struct IOThread {
 
     /* AioContext AIO engine parameters */
     int64_t aio_max_batch;
+    int64_t io_uring_sqpoll_cpu;
 };
 typedef struct IOThread IOThread;
 
@@ -830,6 +830,17 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr_cached() - likewise, remembering the target
+ * @tb: the TB being translated
+ *
+ * Like tcg_gen_lookup_and_goto_ptr(), but the last target found from this
+ * exit is kept in @tb and checked before the per-CPU jump cache.  Meant for
+ * computed branches that usually go to the same place, such as function
+ * returns.  A TB may use it for at most one of its exits.
+ */
+void tcg_gen_lookup_and_goto_ptr_cached(const TranslationBlock *tb);
+
 static inline void tcg_gen_plugin_cb_start(unsigned from, unsigned type,
                                            unsigned wr)
 {
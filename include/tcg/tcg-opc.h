@@ -213,6 +213,26 @@ DEF(qemu_st8_i32, 0, TLADDR_ARGS + 1, 1,
     TCG_OPF_CALL_CLOBBER | TCG_OPF_SIDE_EFFECTS |
     IMPL(TCG_TARGET_HAS_qemu_st8_i32))
 
+/*
+ * Guest atomic operations in host byte order, for the backends that
+ * have a fast path for them; only 64-bit hosts do.  cmpxchg takes the
+ * address, the expected and the new value, atomic takes the address and
+ * the operand, then the MemOpIdx and the TCGAtomicOp.  Both return the
+ * previous contents of memory.
+ */
+DEF(qemu_cmpxchg_i32, 1, TLADDR_ARGS + 2, 1,
+    TCG_OPF_CALL_CLOBBER | TCG_OPF_SIDE_EFFECTS |
+    IMPL(TCG_TARGET_HAS_qemu_atomic))
+DEF(qemu_cmpxchg_i64, 1, TLADDR_ARGS + 2, 1,
+    TCG_OPF_CALL_CLOBBER | TCG_OPF_SIDE_EFFECTS | TCG_OPF_64BIT |
+    IMPL(TCG_TARGET_HAS_qemu_atomic))
+DEF(qemu_atomic_i32, 1, TLADDR_ARGS + 1, 2,
+    TCG_OPF_CALL_CLOBBER | TCG_OPF_SIDE_EFFECTS |
+    IMPL(TCG_TARGET_HAS_qemu_atomic))
+DEF(qemu_atomic_i64, 1, TLADDR_ARGS + 1, 2,
+    TCG_OPF_CALL_CLOBBER | TCG_OPF_SIDE_EFFECTS | TCG_OPF_64BIT |
+    IMPL(TCG_TARGET_HAS_qemu_atomic))
+
 /* Host vector support.  */
 
 #define IMPLVEC  TCG_OPF_VECTOR | IMPL(TCG_TARGET_MAYBE_vec)
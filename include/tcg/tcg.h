@@ -254,12 +254,28 @@ struct TCGRelocation {
     int type;
 };
 
+/* Where the forward branches to a label left a global.  */
+typedef struct TCGLabelGlobal {
+    int reg;        /* -1 if not in a host register on every branch */
+    uint32_t gen;   /* TCGContext.global_gen at the time of the branches */
+} TCGLabelGlobal;
+
 typedef struct TCGLabel TCGLabel;
 struct TCGLabel {
     unsigned present : 1;
     unsigned has_value : 1;
     unsigned id : 14;
     unsigned refs : 16;
+    /*
+     * Liveness: set_label was seen, and a branch follows it; the state
+     * of the globals at the label.
+     */
+    bool la_seen;
+    bool backward;
+    uint8_t *la_state;
+    /* Register allocator: the forward branches seen so far.  */
+    unsigned nb_fwd;
+    TCGLabelGlobal *fwd;
     union {
         uintptr_t value;
         const tcg_insn_unit *value_ptr;
@@ -420,6 +436,23 @@ enum {
     TCG_BSWAP_OS = 4,
 };
 
+/*
+ * Operation performed by the qemu_atomic opcodes, which return the
+ * previous contents of memory.
+ */
+typedef enum TCGAtomicOp {
+    TCG_ATOMIC_ADD,
+    TCG_ATOMIC_AND,
+    TCG_ATOMIC_OR,
+    TCG_ATOMIC_XOR,
+    TCG_ATOMIC_SMIN,
+    TCG_ATOMIC_UMIN,
+    TCG_ATOMIC_SMAX,
+    TCG_ATOMIC_UMAX,
+    TCG_ATOMIC_XCHG,
+    TCG_ATOMIC_NB
+} TCGAtomicOp;
+
 typedef enum TCGTempVal {
     TEMP_VAL_DEAD,
     TEMP_VAL_REG,
@@ -451,6 +484,8 @@ typedef struct TCGTemp {
     unsigned int mem_coherent:1;
     unsigned int mem_allocated:1;
     unsigned int temp_allocated:1;
+    /* Guest memory relative to this global is RAM; see tcg_set_fwd_base. */
+    unsigned int fwd_base:1;
 
     int64_t val;
     struct TCGTemp *mem_base;
@@ -579,6 +614,9 @@ struct TCGContext {
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
 
+    /* Don't forward guest stores to loads, for CF_NO_ST_FWD */
+    bool no_st_fwd;
+
     /* These structures are private to tcg-target.c.inc.  */
 #ifdef TCG_TARGET_NEED_LDST_LABELS
     QSIMPLEQ_HEAD(, TCGLabelQemuLdst) ldst_labels;
@@ -614,6 +652,12 @@ struct TCGContext {
        It does not take into account fixed registers */
     TCGTemp *reg_to_temp[TCG_TARGET_NB_REGS];
 
+    /*
+     * Count of the writes to each global, for tcg_keep_globals: NULL
+     * if it is off.
+     */
+    uint32_t *global_gen;
+
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     target_ulong gen_insn_data[TCG_MAX_INSNS][TARGET_INSN_START_WORDS];
 
@@ -629,6 +673,7 @@ static inline bool temp_readonly(TCGTemp *ts)
 extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
+extern bool tcg_keep_globals;
 extern TCGv_env cpu_env;
 
 bool in_code_gen_buffer(const void *p);
@@ -801,9 +846,15 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+ssize_t tcg_region_reclaim(void (*invalidate)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
+void tcg_region_dump_info(GString *buf);
+
+bool tcg_region_set_hugepages(const char *name);
+const char *tcg_region_get_hugepages(void);
+void tcg_region_set_numa_node(int node);
 
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
@@ -830,7 +881,7 @@ static inline void *tcg_malloc(int size)
     }
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus);
+void tcg_init(size_t tb_size, int splitwx, unsigned max_threads);
 void tcg_register_thread(void);
 void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
@@ -873,6 +924,22 @@ static inline TCGv_i32 tcg_global_mem_new_i32(TCGv_ptr reg, intptr_t offset,
     return temp_tcgv_i32(t);
 }
 
+/**
+ * tcg_set_fwd_base() - allow store-to-load forwarding relative to a global
+ * @v: the global, typically the guest stack pointer
+ *
+ * Tell tcg_optimize() that guest accesses to a constant offset from @v
+ * are to ordinary RAM, so that a qemu_ld reading back what a qemu_st in
+ * the same basic block wrote may use the stored value instead.  Do not
+ * use this for registers that commonly point at device memory.  TBs for
+ * a CPU with watchpoints are translated with CF_NO_ST_FWD, which turns
+ * the forwarding off so that read watchpoints still trigger.
+ */
+static inline void tcg_set_fwd_base(TCGv_i32 v)
+{
+    tcgv_i32_temp(v)->fwd_base = 1;
+}
+
 static inline TCGv_i32 tcg_temp_new_i32(void)
 {
     TCGTemp *t = tcg_temp_new_internal(TCG_TYPE_I32, false);
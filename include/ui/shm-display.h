@@ -0,0 +1,40 @@
+/*
+ * Shared memory display: layout of the exported framebuffer files
+ *
+ * This header is meant to be usable by external tools as well.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef UI_SHM_DISPLAY_H
+#define UI_SHM_DISPLAY_H
+
+#define QEMU_SHM_FB_MAGIC       0x42465351 /* "QSFB" */
+#define QEMU_SHM_FB_VERSION     1
+
+/*
+ * Each file starts with this header.  The pixels follow at @data_offset,
+ * @height rows of @stride bytes, in the pixman format @format (for
+ * example PIXMAN_x8r8g8b8, in host byte order).
+ *
+ * @damage works as a sequence lock: it is odd while QEMU updates the
+ * file, header included, and even once the update is complete.  A
+ * reader copies or checks a frame only between two reads of the same
+ * even value, and only needs to look again once it has changed.  The
+ * file can grow when the geometry changes, so readers should map it
+ * again when @size is bigger than their mapping.
+ */
+typedef struct QemuShmFb {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t damage;
+    uint32_t size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
+    uint32_t data_offset;
+    uint32_t reserved[7];
+} QemuShmFb;
+
+#endif /* UI_SHM_DISPLAY_H */
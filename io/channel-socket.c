@@ -27,6 +27,14 @@
 #include "trace.h"
 #include "qapi/clone-visitor.h"
 
+#ifdef CONFIG_LINUX
+#include <linux/errqueue.h>
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#define QEMU_MSG_ZEROCOPY
+#endif
+#endif
+
 #define SOCKET_MAX_FDS 16
 
 SocketAddress *
@@ -154,6 +162,17 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
         return -1;
     }
 
+#ifdef QEMU_MSG_ZEROCOPY
+    {
+        int v = 1;
+
+        if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) == 0) {
+            qio_channel_set_feature(QIO_CHANNEL(ioc),
+                                    QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+        }
+    }
+#endif
+
     return 0;
 }
 
@@ -525,6 +544,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
                                          size_t niov,
                                          int *fds,
                                          size_t nfds,
+                                         int flags,
                                          Error **errp)
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
@@ -533,6 +553,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     char control[CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS)];
     size_t fdsize = sizeof(int) * nfds;
     struct cmsghdr *cmsg;
+    int sflags = 0;
 
     memset(control, 0, CMSG_SPACE(sizeof(int) * SOCKET_MAX_FDS));
 
@@ -557,8 +578,14 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
         memcpy(CMSG_DATA(cmsg), fds, fdsize);
     }
 
+#ifdef QEMU_MSG_ZEROCOPY
+    if (flags & QIO_CHANNEL_WRITE_FLAG_ZERO_COPY) {
+        sflags = MSG_ZEROCOPY;
+    }
+#endif
+
  retry:
-    ret = sendmsg(sioc->fd, &msg, 0);
+    ret = sendmsg(sioc->fd, &msg, sflags);
     if (ret <= 0) {
         if (errno == EAGAIN) {
             return QIO_CHANNEL_ERR_BLOCK;
@@ -566,12 +593,90 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
         if (errno == EINTR) {
             goto retry;
         }
+        if (errno == ENOBUFS && sflags) {
+            error_setg_errno(errp, errno,
+                             "Unable to lock memory for zero copy writes");
+            return -1;
+        }
         error_setg_errno(errp, errno,
                          "Unable to write to socket");
         return -1;
     }
+    if (sflags) {
+        /* Each sendmsg() gets its own completion */
+        sioc->zero_copy_queued++;
+    }
+    return ret;
+}
+
+#ifdef QEMU_MSG_ZEROCOPY
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp)
+{
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+    struct msghdr msg = { NULL, };
+    struct sock_extended_err *serr;
+    struct cmsghdr *cmsg;
+    int ret = 1;
+
+    if (sioc->zero_copy_sent == sioc->zero_copy_queued) {
+        return 0;
+    }
+
+    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        memset(control, 0, sizeof(control));
+
+        if (recvmsg(sioc->fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EAGAIN) {
+                /* The completions come as errors on the socket */
+                qio_channel_wait(ioc, G_IO_ERR);
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            error_setg_errno(errp, errno,
+                             "Unable to read socket error queue");
+            return -1;
+        }
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg ||
+            !((cmsg->cmsg_level == SOL_IP &&
+               cmsg->cmsg_type == IP_RECVERR) ||
+              (cmsg->cmsg_level == SOL_IPV6 &&
+               cmsg->cmsg_type == IPV6_RECVERR))) {
+            error_setg_errno(errp, EPROTO,
+                             "Unexpected message in socket error queue");
+            return -1;
+        }
+
+        serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+        if (serr->ee_errno != 0) {
+            error_setg_errno(errp, serr->ee_errno, "Error on socket");
+            return -1;
+        }
+        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+            error_setg_errno(errp, EPROTO,
+                             "Unexpected error origin %d on socket",
+                             serr->ee_origin);
+            return -1;
+        }
+
+        /* The completions of sendmsg() calls ee_info to ee_data */
+        sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+
+        if (serr->ee_code != SO_EE_CODE_ZEROCOPY_COPIED) {
+            ret = 0;
+        }
+    }
+
     return ret;
 }
+#endif /* QEMU_MSG_ZEROCOPY */
 #else /* WIN32 */
 static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
                                         const struct iovec *iov,
@@ -620,6 +725,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
                                          size_t niov,
                                          int *fds,
                                          size_t nfds,
+                                         int flags,
                                          Error **errp)
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
@@ -787,6 +893,9 @@ static void qio_channel_socket_class_init(ObjectClass *klass,
     ioc_klass->io_set_delay = qio_channel_socket_set_delay;
     ioc_klass->io_create_watch = qio_channel_socket_create_watch;
     ioc_klass->io_set_aio_fd_handler = qio_channel_socket_set_aio_fd_handler;
+#ifdef QEMU_MSG_ZEROCOPY
+    ioc_klass->io_flush = qio_channel_socket_flush;
+#endif
 }
 
 static const TypeInfo qio_channel_socket_info = {
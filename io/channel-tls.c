@@ -21,7 +21,9 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "qemu/error-report.h"
 #include "io/channel-tls.h"
+#include "io/channel-socket.h"
 #include "trace.h"
 #include "qemu/atomic.h"
 
@@ -152,6 +154,31 @@ static gboolean qio_channel_tls_handshake_io(QIOChannel *ioc,
                                              GIOCondition condition,
                                              gpointer user_data);
 
+/*
+ * Let the kernel encrypt what we send, if the credentials ask for it.
+ * Failing that is not fatal, gnutls keeps doing the work.
+ */
+static void qio_channel_tls_enable_ktls(QIOChannelTLS *ioc)
+{
+    Error *err = NULL;
+    int fd = -1;
+    int ret;
+
+    if (object_dynamic_cast(OBJECT(ioc->master), TYPE_QIO_CHANNEL_SOCKET)) {
+        fd = QIO_CHANNEL_SOCKET(ioc->master)->fd;
+    }
+
+    ret = qcrypto_tls_session_enable_ktls_send(ioc->session, fd, &err);
+    if (ret > 0) {
+        trace_qio_channel_tls_ktls_send(ioc);
+        ioc->ktls_send = true;
+    } else if (ret < 0) {
+        warn_report_once("%s, TLS data will be encrypted by QEMU",
+                         error_get_pretty(err));
+        error_free(err);
+    }
+}
+
 static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
                                            QIOTask *task,
                                            GMainContext *context)
@@ -175,6 +202,7 @@ static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
             qio_task_set_error(task, err);
         } else {
             trace_qio_channel_tls_credentials_allow(ioc);
+            qio_channel_tls_enable_ktls(ioc);
         }
         qio_task_complete(task);
     } else {
@@ -301,12 +329,18 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
                                       size_t niov,
                                       int *fds,
                                       size_t nfds,
+                                      int flags,
                                       Error **errp)
 {
     QIOChannelTLS *tioc = QIO_CHANNEL_TLS(ioc);
     size_t i;
     ssize_t done = 0;
 
+    if (tioc->ktls_send) {
+        return qio_channel_writev_full(tioc->master, iov, niov, NULL, 0,
+                                       flags, errp);
+    }
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_write(tioc->session,
                                                 iov[i].iov_base,
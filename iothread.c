@@ -106,6 +106,7 @@ static void iothread_instance_init(Object *obj)
     IOThread *iothread = IOTHREAD(obj);
 
     iothread->poll_max_ns = IOTHREAD_POLL_MAX_NS_DEFAULT;
+    iothread->io_uring_sqpoll_cpu = -1;
     iothread->thread_id = -1;
     qemu_sem_init(&iothread->init_done_sem, 0);
     /* By default, we don't run gcontext */
@@ -168,6 +169,13 @@ static void iothread_set_aio_context_params(IOThread *iothread, Error **errp)
     aio_context_set_aio_params(iothread->ctx,
                                iothread->aio_max_batch,
                                errp);
+    if (*errp) {
+        return;
+    }
+
+    aio_context_set_io_uring_sqpoll(iothread->ctx,
+                                    iothread->io_uring_sqpoll_cpu,
+                                    errp);
 }
 
 static void iothread_complete(UserCreatable *obj, Error **errp)
@@ -313,6 +321,36 @@ static void iothread_set_aio_param(Object *obj, Visitor *v,
     }
 }
 
+static void iothread_get_io_uring_sqpoll_cpu(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+
+    visit_type_int64(v, name, &iothread->io_uring_sqpoll_cpu, errp);
+}
+
+static void iothread_set_io_uring_sqpoll_cpu(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    int64_t value;
+
+    if (!visit_type_int64(v, name, &value, errp)) {
+        return;
+    }
+
+    /* The rings are created with their SQ thread */
+    if (iothread->ctx) {
+        error_setg(errp, "%s cannot be changed once the iothread runs", name);
+        return;
+    }
+    if (value < -1 || value >= INT_MAX) {
+        error_setg(errp, "%s value must be in range [-1, %d)", name, INT_MAX);
+        return;
+    }
+    iothread->io_uring_sqpoll_cpu = value;
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     UserCreatableClass *ucc = USER_CREATABLE_CLASS(klass);
@@ -334,6 +372,10 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_aio_param,
                               iothread_set_aio_param,
                               NULL, &aio_max_batch_info);
+    object_class_property_add(klass, "x-io-uring-sqpoll-cpu", "int",
+                              iothread_get_io_uring_sqpoll_cpu,
+                              iothread_set_io_uring_sqpoll_cpu,
+                              NULL, NULL);
 }
 
 static const TypeInfo iothread_info = {
@@ -384,6 +426,9 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->aio_max_batch;
+    info->poll_time_ns = stat64_get(&iothread->ctx->poll_time_ns);
+    info->poll_hits = stat64_get(&iothread->ctx->poll_hits);
+    info->poll_dropped = stat64_get(&iothread->ctx->poll_dropped);
 
     QAPI_LIST_APPEND(*tail, info);
     return 0;
@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation, or (at your option) any
+ * later version. See the COPYING file in the top-level directory.
+ */
+
+#ifndef AARCH64_TARGET_VDSO_H
+#define AARCH64_TARGET_VDSO_H
+
+/*
+ * Code of the vDSO that load_vdso() builds, reading VdsoData through
+ * CNTVCT_EL0.  Clocks other than CLOCK_REALTIME and CLOCK_MONOTONIC,
+ * and gettimeofday() with a timezone, use the system call.
+ */
+static const uint32_t target_vdso_code[] = {
+    /* __kernel_clock_gettime */
+    0x7100041f,  /* 000: cmp w0, #1 */
+    0x540000e8,  /* 004: b.hi 0x20 */
+    0xaa1e03ec,  /* 008: mov x12, x30 */
+    0x94000017,  /* 00c: bl 0x68 */
+    0xaa0c03fe,  /* 010: mov x30, x12 */
+    0xa9001424,  /* 014: stp x4, x5, [x1] */
+    0x52800000,  /* 018: mov w0, #0 */
+    0xd65f03c0,  /* 01c: ret */
+    0xd2800e28,  /* 020: mov x8, #113 */
+    0xd4000001,  /* 024: svc #0 */
+    0xd65f03c0,  /* 028: ret */
+    /* __kernel_gettimeofday */
+    0xb5000181,  /* 02c: cbnz x1, 0x5c */
+    0xb4000160,  /* 030: cbz x0, 0x5c */
+    0xaa0003eb,  /* 034: mov x11, x0 */
+    0x52800000,  /* 038: mov w0, #0 */
+    0xaa1e03ec,  /* 03c: mov x12, x30 */
+    0x9400000a,  /* 040: bl 0x68 */
+    0xaa0c03fe,  /* 044: mov x30, x12 */
+    0xd2807d06,  /* 048: mov x6, #1000 */
+    0x9ac608a5,  /* 04c: udiv x5, x5, x6 */
+    0xa9001564,  /* 050: stp x4, x5, [x11] */
+    0x52800000,  /* 054: mov w0, #0 */
+    0xd65f03c0,  /* 058: ret */
+    0xd2801528,  /* 05c: mov x8, #169 */
+    0xd4000001,  /* 060: svc #0 */
+    0xd65f03c0,  /* 064: ret */
+    0x10000303,  /* 068: adr x3, 0xc8 */
+    0x980002e2,  /* 06c: ldrsw x2, 0xc8 */
+    0x8b020063,  /* 070: add x3, x3, x2 */
+    0x8b205069,  /* 074: add x9, x3, w0, uxtw #4 */
+    0xb9400066,  /* 078: ldr w6, [x3] */
+    0x3707ffe6,  /* 07c: tbnz w6, #0, 0x78 */
+    0xd50339bf,  /* 080: dmb ishld */
+    0xb9400467,  /* 084: ldr w7, [x3, #4] */
+    0xf9400468,  /* 088: ldr x8, [x3, #8] */
+    0xf9400924,  /* 08c: ldr x4, [x9, #16] */
+    0xb9401925,  /* 090: ldr w5, [x9, #24] */
+    0xd53be042,  /* 094: mrs x2, CNTVCT_EL0 */
+    0xd50339bf,  /* 098: dmb ishld */
+    0xb940006a,  /* 09c: ldr w10, [x3] */
+    0x6b0a00df,  /* 0a0: cmp w6, w10 */
+    0x54fffea1,  /* 0a4: b.ne 0x78 */
+    0xcb080042,  /* 0a8: sub x2, x2, x8 */
+    0x9b071445,  /* 0ac: madd x5, x2, x7, x5 */
+    0xd2994006,  /* 0b0: mov x6, #51712 */
+    0xf2a77346,  /* 0b4: movk x6, #15258, lsl #16 */
+    0x9ac608a7,  /* 0b8: udiv x7, x5, x6 */
+    0x9b0694e5,  /* 0bc: msub x5, x7, x6, x5 */
+    0x8b070084,  /* 0c0: add x4, x4, x7 */
+    0xd65f03c0,  /* 0c4: ret */
+    0x00000000,  /* 0c8: offset of the data page from here */
+};
+
+/* Index in target_vdso_code of the offset of the data page */
+#define TARGET_VDSO_DATA_OFFSET (0xc8 / 4)
+
+#define TARGET_VDSO_FLAGS       0
+
+static const VdsoSymbol target_vdso_symbols[] = {
+    { "__kernel_clock_gettime", 0x000, 0x02c },
+    { "__kernel_gettimeofday",  0x02c, 0x03c },
+};
+
+static inline bool target_vdso_supported(CPUArchState *env)
+{
+    return true;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation, or (at your option) any
+ * later version. See the COPYING file in the top-level directory.
+ */
+
+#ifndef ARM_TARGET_VDSO_H
+#define ARM_TARGET_VDSO_H
+
+/*
+ * A32 code of the vDSO that load_vdso() builds, reading VdsoData
+ * through CNTVCT.  Clocks other than CLOCK_REALTIME and
+ * CLOCK_MONOTONIC, gettimeofday() with a timezone, and readings when
+ * the data was not refreshed for two seconds use the system call.
+ */
+static const uint32_t target_vdso_code[] = {
+    /* __vdso_clock_gettime64 */
+    0xe3500001,  /* 000: cmp r0, #1 */
+    0x8a00000b,  /* 004: bhi 0x38 */
+    0xe92d4ff0,  /* 008: push {r4, r5, r6, r7, r8, r9, r10, r11, lr} */
+    0xeb000038,  /* 00c: bl 0xf4 */
+    0xe35c0000,  /* 010: cmp r12, #0 */
+    0x1a000006,  /* 014: bne 0x34 */
+    0xe5812000,  /* 018: str r2, [r1] */
+    0xe5813004,  /* 01c: str r3, [r1, #4] */
+    0xe5819008,  /* 020: str r9, [r1, #8] */
+    0xe3a03000,  /* 024: mov r3, #0 */
+    0xe581300c,  /* 028: str r3, [r1, #12] */
+    0xe3a00000,  /* 02c: mov r0, #0 */
+    0xe8bd8ff0,  /* 030: pop {r4, r5, r6, r7, r8, r9, r10, r11, pc} */
+    0xe8bd4ff0,  /* 034: pop {r4, r5, r6, r7, r8, r9, r10, r11, lr} */
+    0xe52d7004,  /* 038: str r7, [sp, #-4]! */
+    0xe3007193,  /* 03c: movw r7, #403 */
+    0xef000000,  /* 040: svc #0 */
+    0xe49d7004,  /* 044: ldr r7, [sp], #4 */
+    0xe12fff1e,  /* 048: bx lr */
+    /* __vdso_clock_gettime */
+    0xe3500001,  /* 04c: cmp r0, #1 */
+    0x8a000008,  /* 050: bhi 0x78 */
+    0xe92d4ff0,  /* 054: push {r4, r5, r6, r7, r8, r9, r10, r11, lr} */
+    0xeb000025,  /* 058: bl 0xf4 */
+    0xe35c0000,  /* 05c: cmp r12, #0 */
+    0x1a000003,  /* 060: bne 0x74 */
+    0xe5812000,  /* 064: str r2, [r1] */
+    0xe5819004,  /* 068: str r9, [r1, #4] */
+    0xe3a00000,  /* 06c: mov r0, #0 */
+    0xe8bd8ff0,  /* 070: pop {r4, r5, r6, r7, r8, r9, r10, r11, pc} */
+    0xe8bd4ff0,  /* 074: pop {r4, r5, r6, r7, r8, r9, r10, r11, lr} */
+    0xe52d7004,  /* 078: str r7, [sp, #-4]! */
+    0xe3007107,  /* 07c: movw r7, #263 */
+    0xef000000,  /* 080: svc #0 */
+    0xe49d7004,  /* 084: ldr r7, [sp], #4 */
+    0xe12fff1e,  /* 088: bx lr */
+    /* __vdso_gettimeofday */
+    0xe3500000,  /* 08c: cmp r0, #0 */
+    0x0a000012,  /* 090: beq 0xe0 */
+    0xe3510000,  /* 094: cmp r1, #0 */
+    0x1a000010,  /* 098: bne 0xe0 */
+    0xe92d4ff0,  /* 09c: push {r4, r5, r6, r7, r8, r9, r10, r11, lr} */
+    0xe1a01000,  /* 0a0: mov r1, r0 */
+    0xe3a00000,  /* 0a4: mov r0, #0 */
+    0xeb000011,  /* 0a8: bl 0xf4 */
+    0xe1a00001,  /* 0ac: mov r0, r1 */
+    0xe3a01000,  /* 0b0: mov r1, #0 */
+    0xe35c0000,  /* 0b4: cmp r12, #0 */
+    0x1a000007,  /* 0b8: bne 0xdc */
+    0xe3046dd3,  /* 0bc: movw r6, #19923 */
+    0xe3416062,  /* 0c0: movt r6, #4194 */
+    0xe0876699,  /* 0c4: umull r6, r7, r9, r6 */
+    0xe1a07327,  /* 0c8: lsr r7, r7, #6 */
+    0xe5802000,  /* 0cc: str r2, [r0] */
+    0xe5807004,  /* 0d0: str r7, [r0, #4] */
+    0xe3a00000,  /* 0d4: mov r0, #0 */
+    0xe8bd8ff0,  /* 0d8: pop {r4, r5, r6, r7, r8, r9, r10, r11, pc} */
+    0xe8bd4ff0,  /* 0dc: pop {r4, r5, r6, r7, r8, r9, r10, r11, lr} */
+    0xe52d7004,  /* 0e0: str r7, [sp, #-4]! */
+    0xe3a0704e,  /* 0e4: mov r7, #78 */
+    0xef000000,  /* 0e8: svc #0 */
+    0xe49d7004,  /* 0ec: ldr r7, [sp], #4 */
+    0xe12fff1e,  /* 0f0: bx lr */
+    /*
+     * time: r3:r2, r9 = seconds, nanoseconds of clock r0; r12 is
+     * non-zero if the data is too old for 32-bit arithmetic
+     */
+    0xe28fc078,  /* 0f4: adr r12, 0x174 */
+    0xe59f2074,  /* 0f8: ldr r2, 0x174 */
+    0xe08cc002,  /* 0fc: add r12, r12, r2 */
+    0xe59c4000,  /* 100: ldr r4, [r12] */
+    0xe3140001,  /* 104: tst r4, #1 */
+    0x1afffffc,  /* 108: bne 0x100 */
+    0xf57ff05b,  /* 10c: dmb ish */
+    0xe08c8200,  /* 110: add r8, r12, r0, lsl #4 */
+    0xe1c821d0,  /* 114: ldrd r2, r3, [r8, #16] */
+    0xe5989018,  /* 118: ldr r9, [r8, #24] */
+    0xe1cc60d8,  /* 11c: ldrd r6, r7, [r12, #8] */
+    0xe59c5004,  /* 120: ldr r5, [r12, #4] */
+    0xec5a8f1e,  /* 124: mrrc p15, #1, r8, r10, c14 */
+    0xf57ff05b,  /* 128: dmb ish */
+    0xe59cb000,  /* 12c: ldr r11, [r12] */
+    0xe154000b,  /* 130: cmp r4, r11 */
+    0x1afffff1,  /* 134: bne 0x100 */
+    0xe0588006,  /* 138: subs r8, r8, r6 */
+    0xe0caa007,  /* 13c: sbc r10, r10, r7 */
+    0xe0876598,  /* 140: umull r6, r7, r8, r5 */
+    0xe027759a,  /* 144: mla r7, r10, r5, r7 */
+    0xe197cfa6,  /* 148: orrs r12, r7, r6, lsr #31 */
+    0x112fff1e,  /* 14c: bxne lr */
+    0xe0899006,  /* 150: add r9, r9, r6 */
+    0xe30c6a00,  /* 154: movw r6, #51712 */
+    0xe3436b9a,  /* 158: movt r6, #15258 */
+    0xe1590006,  /* 15c: cmp r9, r6 */
+    0x312fff1e,  /* 160: bxlo lr */
+    0xe0499006,  /* 164: sub r9, r9, r6 */
+    0xe2922001,  /* 168: adds r2, r2, #1 */
+    0xe2a33000,  /* 16c: adc r3, r3, #0 */
+    0xeafffff9,  /* 170: b 0x15c */
+    0x00000000,  /* 174: offset of the data page from here */
+};
+
+/* Index in target_vdso_code of the offset of the data page */
+#define TARGET_VDSO_DATA_OFFSET (0x174 / 4)
+
+#define TARGET_VDSO_FLAGS       EF_ARM_EABI_VER5
+
+static const VdsoSymbol target_vdso_symbols[] = {
+    { "__vdso_clock_gettime64", 0x000, 0x04c },
+    { "__vdso_clock_gettime",   0x04c, 0x040 },
+    { "__vdso_gettimeofday",    0x08c, 0x068 },
+};
+
+/* The code needs the generic timer, and so ARMv7 */
+static inline bool target_vdso_supported(CPUArchState *env)
+{
+    return arm_feature(env, ARM_FEATURE_GENERIC_TIMER);
+}
+
+#endif
@@ -17,6 +17,9 @@
 #include "qemu/guest-random.h"
 #include "qemu/units.h"
 #include "qemu/selfmap.h"
+#include "qemu/memfd.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "target_signal.h"
 
@@ -677,6 +680,10 @@ static uint32_t get_elf_hwcap2(void)
 #undef GET_FEATURE_ID
 
 #endif /* not TARGET_AARCH64 */
+
+#ifndef TARGET_WORDS_BIGENDIAN
+#define VDSO_HEADER "target_vdso.h"
+#endif
 #endif /* TARGET_ARM */
 
 #ifdef TARGET_SPARC
@@ -2061,6 +2068,9 @@ static abi_ulong create_elf_tables(abi_ulong p, int argc, int envc,
 #ifdef ELF_HWCAP2
     size += 2;
 #endif
+    if (info->vdso) {
+        size += 2;
+    }
     info->auxv_len = size * n;
 
     size += envc + argc + 2;
@@ -2131,6 +2141,9 @@ static abi_ulong create_elf_tables(abi_ulong p, int argc, int envc,
     if (u_platform) {
         NEW_AUX_ENT(AT_PLATFORM, u_platform);
     }
+    if (info->vdso) {
+        NEW_AUX_ENT(AT_SYSINFO_EHDR, info->vdso);
+    }
     NEW_AUX_ENT (AT_NULL, 0);
 #undef NEW_AUX_ENT
 
@@ -3171,6 +3184,348 @@ uint32_t get_elf_eflags(int fd)
     return ehdr.e_flags;
 }
 
+#ifdef VDSO_HEADER
+/*
+ * Emulated vDSO: a small ELF image with the clock functions of the
+ * target's vDSO, mapped right after a page of time data that a host
+ * thread keeps up to date, so that guest clock reads are plain loads
+ * and a read of the virtual counter instead of a system call.  The
+ * counter is based on the host's CLOCK_MONOTONIC in linux-user.
+ *
+ * The data page is a seqlock: seq is odd while the other fields are
+ * being updated.  All fields are in target byte order.
+ */
+typedef struct VdsoTime {
+    uint64_t sec;
+    uint32_t nsec;
+    uint32_t pad;
+} VdsoTime;
+
+typedef struct VdsoData {
+    uint32_t seq;
+    uint32_t period_ns;
+    /* Counter value at the time of the bases */
+    uint64_t cycle_last;
+    /* Indexed by clock id: CLOCK_REALTIME, CLOCK_MONOTONIC */
+    VdsoTime base[2];
+} VdsoData;
+
+typedef struct VdsoSymbol {
+    const char *name;
+    uint32_t offset;
+    uint32_t size;
+} VdsoSymbol;
+
+#include VDSO_HEADER
+
+#define VDSO_UPDATE_MS      1000
+#define VDSO_SONAME         "linux-vdso.so.1"
+
+enum {
+    VDSO_SEC_HASH = 1,
+    VDSO_SEC_DYNSYM,
+    VDSO_SEC_DYNSTR,
+    VDSO_SEC_TEXT,
+    VDSO_SEC_DYNAMIC,
+    VDSO_SEC_SHSTRTAB,
+    VDSO_NB_SECS,
+};
+
+static const char * const vdso_sec_names[VDSO_NB_SECS] = {
+    [VDSO_SEC_HASH] = ".hash",
+    [VDSO_SEC_DYNSYM] = ".dynsym",
+    [VDSO_SEC_DYNSTR] = ".dynstr",
+    [VDSO_SEC_TEXT] = ".text",
+    [VDSO_SEC_DYNAMIC] = ".dynamic",
+    [VDSO_SEC_SHSTRTAB] = ".shstrtab",
+};
+
+static VdsoData *vdso_data;
+static uint32_t vdso_seq;
+static uint32_t vdso_period_ns;
+
+static void vdso_set_time(VdsoTime *t, int64_t ns)
+{
+    t->sec = tswap64(ns / NANOSECONDS_PER_SECOND);
+    t->nsec = tswap32(ns % NANOSECONDS_PER_SECOND);
+}
+
+static void vdso_update(void)
+{
+    int64_t mono = get_clock();
+    uint64_t cycles = mono / vdso_period_ns;
+    /* The monotonic time the guest computes for this counter value */
+    int64_t now = cycles * vdso_period_ns;
+    struct timespec real;
+
+    clock_gettime(CLOCK_REALTIME, &real);
+
+    qatomic_set(&vdso_data->seq, tswap32(++vdso_seq));
+    smp_wmb();
+    vdso_data->period_ns = tswap32(vdso_period_ns);
+    vdso_data->cycle_last = tswap64(cycles);
+    vdso_set_time(&vdso_data->base[CLOCK_REALTIME],
+                  real.tv_sec * NANOSECONDS_PER_SECOND + real.tv_nsec -
+                  (mono - now));
+    vdso_set_time(&vdso_data->base[CLOCK_MONOTONIC], now);
+    smp_wmb();
+    qatomic_set(&vdso_data->seq, tswap32(++vdso_seq));
+}
+
+/*
+ * The bases only need to follow steps of the host's wall clock, but
+ * the 32-bit code also needs them to be recent.
+ */
+static void *vdso_update_thread(void *opaque)
+{
+    for (;;) {
+        g_usleep(VDSO_UPDATE_MS * 1000);
+        vdso_update();
+    }
+    return NULL;
+}
+
+/* Reserve @len bytes of @buf after *@used, aligned to @align */
+static size_t vdso_alloc(size_t *used, size_t size, size_t len, size_t align)
+{
+    size_t ofs = ROUND_UP(*used, align);
+
+    assert(ofs + len <= size);
+    *used = ofs + len;
+    return ofs;
+}
+
+/*
+ * Build the vDSO image in @buf, linked at address 0 like the kernel's,
+ * for the data page to be @data_size bytes before it.
+ */
+static void vdso_build(uint8_t *buf, size_t size, size_t data_size)
+{
+    const int nsyms = ARRAY_SIZE(target_vdso_symbols) + 1;
+    GString *dynstr = g_string_new("");
+    GString *shstrtab = g_string_new("");
+    uint32_t st_name[ARRAY_SIZE(target_vdso_symbols) + 1];
+    uint32_t sh_name[VDSO_NB_SECS];
+    uint32_t soname;
+    struct elfhdr *ehdr;
+    struct elf_phdr *phdr;
+    struct elf_shdr *shdr;
+    struct elf_sym *sym;
+    ElfW(Dyn) *dyn;
+    uint32_t *hash;
+    size_t used = 0;
+    size_t o_phdr, o_hash, o_sym, o_str, o_text, o_dyn, o_shstr, o_shdr;
+    int i;
+
+    /* Both string tables start with the empty string */
+    g_string_append_len(dynstr, "", 1);
+    for (i = 1; i < nsyms; i++) {
+        st_name[i] = dynstr->len;
+        g_string_append_len(dynstr, target_vdso_symbols[i - 1].name,
+                            strlen(target_vdso_symbols[i - 1].name) + 1);
+    }
+    soname = dynstr->len;
+    g_string_append_len(dynstr, VDSO_SONAME, sizeof(VDSO_SONAME));
+    g_string_append_len(shstrtab, "", 1);
+    for (i = 1; i < VDSO_NB_SECS; i++) {
+        sh_name[i] = shstrtab->len;
+        g_string_append_len(shstrtab, vdso_sec_names[i],
+                            strlen(vdso_sec_names[i]) + 1);
+    }
+
+    vdso_alloc(&used, size, sizeof(*ehdr), 1);
+    o_phdr = vdso_alloc(&used, size, 2 * sizeof(*phdr), sizeof(abi_ulong));
+    o_hash = vdso_alloc(&used, size, (3 + nsyms) * sizeof(*hash), 4);
+    o_sym = vdso_alloc(&used, size, nsyms * sizeof(*sym), sizeof(abi_ulong));
+    o_str = vdso_alloc(&used, size, dynstr->len, 1);
+    o_text = vdso_alloc(&used, size, sizeof(target_vdso_code), 16);
+    o_dyn = vdso_alloc(&used, size, 7 * sizeof(*dyn), sizeof(abi_ulong));
+    o_shstr = vdso_alloc(&used, size, shstrtab->len, 1);
+    o_shdr = vdso_alloc(&used, size, VDSO_NB_SECS * sizeof(*shdr),
+                        sizeof(abi_ulong));
+
+    ehdr = (struct elfhdr *)buf;
+    ehdr->e_ident[EI_MAG0] = ELFMAG0;
+    ehdr->e_ident[EI_MAG1] = ELFMAG1;
+    ehdr->e_ident[EI_MAG2] = ELFMAG2;
+    ehdr->e_ident[EI_MAG3] = ELFMAG3;
+    ehdr->e_ident[EI_CLASS] = ELF_CLASS;
+    ehdr->e_ident[EI_DATA] = ELF_DATA;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = ELF_ARCH;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_phoff = o_phdr;
+    ehdr->e_shoff = o_shdr;
+    ehdr->e_flags = TARGET_VDSO_FLAGS;
+    ehdr->e_ehsize = sizeof(*ehdr);
+    ehdr->e_phentsize = sizeof(*phdr);
+    ehdr->e_phnum = 2;
+    ehdr->e_shentsize = sizeof(*shdr);
+    ehdr->e_shnum = VDSO_NB_SECS;
+    ehdr->e_shstrndx = VDSO_SEC_SHSTRTAB;
+    bswap_ehdr(ehdr);
+
+    phdr = (struct elf_phdr *)(buf + o_phdr);
+    phdr[0].p_type = PT_LOAD;
+    phdr[0].p_flags = PF_R | PF_X;
+    phdr[0].p_filesz = phdr[0].p_memsz = used;
+    phdr[0].p_align = TARGET_PAGE_SIZE;
+    phdr[1].p_type = PT_DYNAMIC;
+    phdr[1].p_flags = PF_R;
+    phdr[1].p_offset = phdr[1].p_vaddr = phdr[1].p_paddr = o_dyn;
+    phdr[1].p_filesz = phdr[1].p_memsz = 7 * sizeof(*dyn);
+    phdr[1].p_align = sizeof(abi_ulong);
+    bswap_phdr(phdr, 2);
+
+    /* A single bucket chaining all symbols */
+    hash = (uint32_t *)(buf + o_hash);
+    hash[0] = tswap32(1);
+    hash[1] = tswap32(nsyms);
+    hash[2] = tswap32(1);
+    for (i = 0; i < nsyms; i++) {
+        hash[3 + i] = tswap32(i && i + 1 < nsyms ? i + 1 : 0);
+    }
+
+    sym = (struct elf_sym *)(buf + o_sym);
+    for (i = 1; i < nsyms; i++) {
+        const VdsoSymbol *s = &target_vdso_symbols[i - 1];
+
+        sym[i].st_name = st_name[i];
+        sym[i].st_value = o_text + s->offset;
+        sym[i].st_size = s->size;
+        sym[i].st_info = ELF_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym[i].st_shndx = VDSO_SEC_TEXT;
+        bswap_sym(&sym[i]);
+    }
+
+    memcpy(buf + o_str, dynstr->str, dynstr->len);
+
+    /* Instructions are little-endian for both A32 and A64 */
+    for (i = 0; i < ARRAY_SIZE(target_vdso_code); i++) {
+        stl_le_p(buf + o_text + i * 4, target_vdso_code[i]);
+    }
+    stl_le_p(buf + o_text + TARGET_VDSO_DATA_OFFSET * 4,
+             -(data_size + o_text + TARGET_VDSO_DATA_OFFSET * 4));
+
+    dyn = (ElfW(Dyn) *)(buf + o_dyn);
+    dyn[0].d_tag = tswapal(DT_HASH);
+    dyn[0].d_un.d_ptr = tswapal(o_hash);
+    dyn[1].d_tag = tswapal(DT_STRTAB);
+    dyn[1].d_un.d_ptr = tswapal(o_str);
+    dyn[2].d_tag = tswapal(DT_SYMTAB);
+    dyn[2].d_un.d_ptr = tswapal(o_sym);
+    dyn[3].d_tag = tswapal(DT_STRSZ);
+    dyn[3].d_un.d_val = tswapal(dynstr->len);
+    dyn[4].d_tag = tswapal(DT_SYMENT);
+    dyn[4].d_un.d_val = tswapal(sizeof(*sym));
+    dyn[5].d_tag = tswapal(DT_SONAME);
+    dyn[5].d_un.d_val = tswapal(soname);
+    dyn[6].d_tag = tswapal(DT_NULL);
+
+    memcpy(buf + o_shstr, shstrtab->str, shstrtab->len);
+
+    shdr = (struct elf_shdr *)(buf + o_shdr);
+    shdr[VDSO_SEC_HASH] = (struct elf_shdr) {
+        .sh_type = SHT_HASH, .sh_flags = SHF_ALLOC,
+        .sh_addr = o_hash, .sh_offset = o_hash,
+        .sh_size = (3 + nsyms) * sizeof(*hash),
+        .sh_link = VDSO_SEC_DYNSYM,
+        .sh_addralign = 4, .sh_entsize = sizeof(*hash),
+    };
+    shdr[VDSO_SEC_DYNSYM] = (struct elf_shdr) {
+        .sh_type = SHT_DYNSYM, .sh_flags = SHF_ALLOC,
+        .sh_addr = o_sym, .sh_offset = o_sym,
+        .sh_size = nsyms * sizeof(*sym),
+        .sh_link = VDSO_SEC_DYNSTR, .sh_info = 1,
+        .sh_addralign = sizeof(abi_ulong), .sh_entsize = sizeof(*sym),
+    };
+    shdr[VDSO_SEC_DYNSTR] = (struct elf_shdr) {
+        .sh_type = SHT_STRTAB, .sh_flags = SHF_ALLOC,
+        .sh_addr = o_str, .sh_offset = o_str, .sh_size = dynstr->len,
+        .sh_addralign = 1,
+    };
+    shdr[VDSO_SEC_TEXT] = (struct elf_shdr) {
+        .sh_type = SHT_PROGBITS, .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+        .sh_addr = o_text, .sh_offset = o_text,
+        .sh_size = sizeof(target_vdso_code),
+        .sh_addralign = 16,
+    };
+    shdr[VDSO_SEC_DYNAMIC] = (struct elf_shdr) {
+        .sh_type = SHT_DYNAMIC, .sh_flags = SHF_ALLOC,
+        .sh_addr = o_dyn, .sh_offset = o_dyn, .sh_size = 7 * sizeof(*dyn),
+        .sh_link = VDSO_SEC_DYNSTR,
+        .sh_addralign = sizeof(abi_ulong), .sh_entsize = sizeof(*dyn),
+    };
+    shdr[VDSO_SEC_SHSTRTAB] = (struct elf_shdr) {
+        .sh_type = SHT_STRTAB,
+        .sh_offset = o_shstr, .sh_size = shstrtab->len,
+        .sh_addralign = 1,
+    };
+    for (i = 1; i < VDSO_NB_SECS; i++) {
+        shdr[i].sh_name = sh_name[i];
+    }
+    bswap_shdr(shdr, VDSO_NB_SECS);
+
+    g_string_free(dynstr, true);
+    g_string_free(shstrtab, true);
+}
+
+/*
+ * Map the data page and the vDSO image after it.  Returns the address
+ * of the image for AT_SYSINFO_EHDR, or 0 if the guest has no vDSO.
+ */
+static abi_ulong load_vdso(void)
+{
+    CPUArchState *env = thread_cpu->env_ptr;
+    size_t page_size = MAX(TARGET_PAGE_SIZE, qemu_host_page_size);
+    QemuThread thread;
+    abi_ulong base;
+    int fd;
+
+    QEMU_BUILD_BUG_ON(offsetof(VdsoData, base) != 16 ||
+                      sizeof(VdsoTime) != 16);
+
+    if (!target_vdso_supported(env)) {
+        return 0;
+    }
+
+    /* A second, writable mapping of the data page for the host */
+    vdso_data = qemu_memfd_alloc("qemu-vdso", page_size, 0, &fd, NULL);
+    if (!vdso_data) {
+        return 0;
+    }
+
+    base = target_mmap(0, 2 * page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == -1) {
+        goto fail;
+    }
+    /* MAP_SHARED, so that forked children see the updates too */
+    if (target_mmap(base, page_size, PROT_READ, MAP_SHARED | MAP_FIXED,
+                    fd, 0) == -1) {
+        target_munmap(base, 2 * page_size);
+        goto fail;
+    }
+    close(fd);
+
+    vdso_build(g2h_untagged(base + page_size), page_size, page_size);
+    target_mprotect(base + page_size, page_size, PROT_READ | PROT_EXEC);
+
+    vdso_period_ns = gt_cntfrq_period_ns(env_archcpu(env));
+    vdso_update();
+    qemu_thread_create(&thread, "vdso-time", vdso_update_thread, NULL,
+                       QEMU_THREAD_DETACHED);
+
+    return base + page_size;
+
+fail:
+    qemu_memfd_free(vdso_data, page_size, fd);
+    vdso_data = NULL;
+    return 0;
+}
+#endif /* VDSO_HEADER */
+
 int load_elf_binary(struct linux_binprm *bprm, struct image_info *info)
 {
     struct image_info interp_info;
@@ -3249,8 +3604,12 @@ int load_elf_binary(struct linux_binprm *bprm, struct image_info *info)
 #endif
     }
 
+#ifdef VDSO_HEADER
+    info->vdso = load_vdso();
+#endif
+
     /*
-     * TODO: load a vdso, which would also contain the signal trampolines.
+     * TODO: put the signal trampolines in the vdso, where there is one.
      * Otherwise, allocate a private page to hold them.
      */
     if (TARGET_ARCH_HAS_SIGTRAMP_PAGE) {
@@ -67,6 +67,8 @@ static inline bool host_signal_write(siginfo_t *info, ucontext_t *uc)
         || (insn & 0xbfdf0000) == 0x0d000000   /* C3.3.3 */
         || (insn & 0xbfc00000) == 0x0d800000   /* C3.3.4 */
         || (insn & 0x3f400000) == 0x08000000   /* C3.3.6 */
+        || (insn & 0x3fa07c00) == 0x08a07c00   /* CAS* */
+        || (insn & 0x3f200c00) == 0x38200000   /* LD<op>*, SWP* */
         || (insn & 0x3bc00000) == 0x39000000   /* C3.3.13 */
         || (insn & 0x3fc00000) == 0x3d800000   /* ... 128bit */
         /* Ignore bits 10, 11 & 21, controlling indexing.  */
@@ -48,6 +48,8 @@ struct image_info {
         uint32_t        elf_flags;
         int             personality;
         abi_ulong       alignment;
+        /* Address of the vDSO image, 0 if there is none */
+        abi_ulong       vdso;
 
         /* The fields below are used in FDPIC mode.  */
         abi_ulong       loadmap_addr;
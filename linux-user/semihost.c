@@ -49,6 +49,11 @@ void qemu_semihosting_console_outc(CPUArchState *env, target_ulong addr)
     }
 }
 
+void qemu_semihosting_console_flush(void)
+{
+    /* Console output is not buffered in linux-user */
+}
+
 /*
  * For linux-user we can safely block. However as we want to return as
  * soon as a character is read we need to tweak the termio to disable
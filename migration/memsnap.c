@@ -0,0 +1,267 @@
+/*
+ * In-memory VM snapshot
+ *
+ * A single snapshot kept in host memory, meant for loops that return to
+ * the same state over and over, as a fuzzer does.  Saving it copies
+ * guest RAM once, and the device state into a buffer; from then on the
+ * migration dirty bitmap tracks the guest pages that were written.
+ * Restoring copies back those pages only, then loads the device state,
+ * so that its cost grows with the memory the guest wrote rather than
+ * with the size of the guest.
+ *
+ * Disks are not part of the snapshot; use snapshot=on on the drives or
+ * a read-only image if the guest writes to them.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qmp/qdict.h"
+#include "cpu.h"
+#include "exec/ramblock.h"
+#include "exec/ram_addr.h"
+#include "exec/target_page.h"
+#include "io/channel-buffer.h"
+#include "migration/blocker.h"
+#include "migration/misc.h"
+#include "monitor/hmp.h"
+#include "monitor/monitor.h"
+#include "qemu/error-report.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/timer.h"
+#include "sysemu/cpus.h"
+#include "sysemu/runstate.h"
+#include "sysemu/tcg.h"
+#include "qemu-file-channel.h"
+#include "qemu-file.h"
+#include "ram.h"
+#include "savevm.h"
+#include "trace.h"
+
+typedef struct MemSnapBlock {
+    RAMBlock *rb;
+    ram_addr_t length;
+    void *data;
+} MemSnapBlock;
+
+typedef struct MemSnap {
+    GArray *blocks;         /* of MemSnapBlock */
+    uint8_t *devices;       /* device state, as saved by savevm */
+    size_t devices_size;
+    Error *blocker;
+} MemSnap;
+
+static MemSnap *memsnap;
+
+static void memsnap_free(MemSnap *snap)
+{
+    guint i;
+
+    for (i = 0; i < snap->blocks->len; i++) {
+        qemu_vfree(g_array_index(snap->blocks, MemSnapBlock, i).data);
+    }
+    g_array_free(snap->blocks, true);
+    g_free(snap->devices);
+    if (snap->blocker) {
+        migrate_del_blocker(snap->blocker);
+        error_free(snap->blocker);
+    }
+    g_free(snap);
+}
+
+/* Clear the dirty bits of @rb, returning them */
+static DirtyBitmapSnapshot *memsnap_clear_dirty(RAMBlock *rb)
+{
+    return memory_region_snapshot_and_clear_dirty(rb->mr, 0, rb->used_length,
+                                                  DIRTY_MEMORY_MIGRATION);
+}
+
+static bool memsnap_save_devices(MemSnap *snap, Error **errp)
+{
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(4096);
+    QEMUFile *f = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+    int ret;
+
+    ret = qemu_save_device_state(f);
+    qemu_fflush(f);
+    if (ret >= 0) {
+        snap->devices = g_memdup(bioc->data, bioc->usage);
+        snap->devices_size = bioc->usage;
+    }
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "could not save the device state");
+        return false;
+    }
+    return true;
+}
+
+static bool memsnap_load_devices(MemSnap *snap, Error **errp)
+{
+    QIOChannelBuffer *bioc = qio_channel_buffer_new(0);
+    QEMUFile *f;
+    int ret = -EINVAL;
+
+    /* The buffer is freed when the channel is closed */
+    bioc->data = g_memdup(snap->devices, snap->devices_size);
+    bioc->capacity = bioc->usage = snap->devices_size;
+    f = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+
+    if (qemu_get_be32(f) == QEMU_VM_FILE_MAGIC &&
+        qemu_get_be32(f) == QEMU_VM_FILE_VERSION) {
+        ret = qemu_load_device_state(f);
+    }
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    if (ret < 0) {
+        error_setg(errp, "could not load the device state");
+        return false;
+    }
+    return true;
+}
+
+void qmp_x_memsnap_save(Error **errp)
+{
+    bool running = runstate_is_running();
+    MemSnap *snap;
+    RAMBlock *rb;
+
+    if (!migration_is_idle()) {
+        error_setg(errp, "cannot take an in-memory snapshot "
+                   "while migrating");
+        return;
+    }
+
+    snap = g_new0(MemSnap, 1);
+    snap->blocks = g_array_new(false, false, sizeof(MemSnapBlock));
+    error_setg(&snap->blocker, "the in-memory snapshot uses the migration "
+               "dirty bitmap, drop it with x-memsnap-drop first");
+
+    if (running) {
+        vm_stop(RUN_STATE_SAVE_VM);
+    }
+    if (memsnap) {
+        memsnap_free(memsnap);
+        memsnap = NULL;
+    } else {
+        memory_global_dirty_log_start(GLOBAL_DIRTY_SNAPSHOT);
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+            MemSnapBlock b = {
+                .rb = rb,
+                .length = rb->used_length,
+                .data = qemu_memalign(qemu_real_host_page_size,
+                                      rb->used_length),
+            };
+
+            g_free(memsnap_clear_dirty(rb));
+            memcpy(b.data, rb->host, b.length);
+            g_array_append_val(snap->blocks, b);
+        }
+    }
+
+    if (!memsnap_save_devices(snap, errp) ||
+        migrate_add_blocker_internal(snap->blocker, errp) < 0) {
+        error_free(snap->blocker);
+        snap->blocker = NULL;
+        memsnap_free(snap);
+        memory_global_dirty_log_stop(GLOBAL_DIRTY_SNAPSHOT);
+    } else {
+        memsnap = snap;
+        trace_memsnap_save(snap->blocks->len, snap->devices_size);
+    }
+
+    if (running) {
+        vm_start();
+    }
+}
+
+void qmp_x_memsnap_restore(Error **errp)
+{
+    bool running = runstate_is_running();
+    size_t page_size = qemu_target_page_size();
+    int64_t start = get_clock();
+    uint64_t pages = 0;
+    guint i;
+
+    if (!memsnap) {
+        error_setg(errp, "no in-memory snapshot, take one with "
+                   "x-memsnap-save");
+        return;
+    }
+
+    /* RAM resized or unplugged since the snapshot */
+    for (i = 0; i < memsnap->blocks->len; i++) {
+        MemSnapBlock *b = &g_array_index(memsnap->blocks, MemSnapBlock, i);
+
+        if (b->rb->used_length != b->length) {
+            error_setg(errp, "RAM block '%s' changed size since the snapshot",
+                       b->rb->idstr);
+            return;
+        }
+    }
+
+    if (running) {
+        vm_stop(RUN_STATE_RESTORE_VM);
+    }
+
+    for (i = 0; i < memsnap->blocks->len; i++) {
+        MemSnapBlock *b = &g_array_index(memsnap->blocks, MemSnapBlock, i);
+        g_autofree DirtyBitmapSnapshot *dirty = memsnap_clear_dirty(b->rb);
+        ram_addr_t offset;
+
+        for (offset = 0; offset < b->length; offset += page_size) {
+            if (!memory_region_snapshot_get_dirty(b->rb->mr, dirty, offset,
+                                                  page_size)) {
+                continue;
+            }
+            memcpy(b->rb->host + offset, b->data + offset, page_size);
+            /* the guest may have run code that it wrote to the page */
+            if (tcg_enabled()) {
+                tb_invalidate_phys_range(b->rb->offset + offset,
+                                         b->rb->offset + offset + page_size);
+            }
+            pages++;
+        }
+    }
+
+    if (memsnap_load_devices(memsnap, errp)) {
+        trace_memsnap_restore(pages, get_clock() - start);
+        if (running) {
+            vm_start();
+        }
+    }
+}
+
+void qmp_x_memsnap_drop(Error **errp)
+{
+    if (!memsnap) {
+        error_setg(errp, "no in-memory snapshot");
+        return;
+    }
+    memsnap_free(memsnap);
+    memsnap = NULL;
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_SNAPSHOT);
+}
+
+void hmp_memsnap(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_str(qdict, "op");
+    Error *err = NULL;
+
+    if (!strcmp(op, "save")) {
+        qmp_x_memsnap_save(&err);
+    } else if (!strcmp(op, "restore")) {
+        qmp_x_memsnap_restore(&err);
+    } else if (!strcmp(op, "drop")) {
+        qmp_x_memsnap_drop(&err);
+    } else {
+        monitor_printf(mon, "expected save, restore or drop\n");
+    }
+    hmp_handle_error(mon, err);
+}
@@ -128,6 +128,7 @@ enum mig_rp_message_type {
     MIG_RP_MSG_REQ_PAGES,    /* data (start: be64, len: be32) */
     MIG_RP_MSG_RECV_BITMAP,  /* send recved_bitmap back to source */
     MIG_RP_MSG_RESUME_ACK,   /* tell source that we are ready to resume */
+    MIG_RP_MSG_PREFETCH_PAGES, /* data (start: be64, len: be32, id: string) */
 
     MIG_RP_MSG_MAX
 };
@@ -162,7 +163,8 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_COMPRESS,
     MIGRATION_CAPABILITY_XBZRLE,
     MIGRATION_CAPABILITY_X_COLO,
-    MIGRATION_CAPABILITY_VALIDATE_UUID);
+    MIGRATION_CAPABILITY_VALIDATE_UUID,
+    MIGRATION_CAPABILITY_DEDUP);
 
 /* When we add fault tolerance, we could have several
    migrations at once.  For now we don't need to add
@@ -391,6 +393,33 @@ int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
     return migrate_send_rp_message(mis, msg_type, msglen, bufc);
 }
 
+/*
+ * Ask the source for pages that are not needed yet, which it sends once
+ * no page requested with migrate_send_rp_req_pages() is waiting.  Unlike
+ * those requests, these always name the RAMBlock and leave last_rb alone.
+ *   rb: the RAMBlock to request the pages in
+ *   start: Address offset within the RB
+ *   len: Length in bytes required - must be a multiple of pagesize
+ */
+int migrate_send_rp_prefetch_pages(MigrationIncomingState *mis,
+                                   RAMBlock *rb, ram_addr_t start,
+                                   uint32_t len)
+{
+    uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
+    const char *rbname = qemu_ram_get_idstr(rb);
+    int rbname_len = strlen(rbname);
+
+    assert(rbname_len < 256);
+
+    stq_be_p(bufc, start);
+    stl_be_p(bufc + 8, len);
+    bufc[12] = rbname_len;
+    memcpy(bufc + 13, rbname, rbname_len);
+
+    return migrate_send_rp_message(mis, MIG_RP_MSG_PREFETCH_PAGES,
+                                   13 + rbname_len, bufc);
+}
+
 int migrate_send_rp_req_pages(MigrationIncomingState *mis,
                               RAMBlock *rb, ram_addr_t start, uint64_t haddr)
 {
@@ -1006,6 +1035,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->page_size = qemu_target_page_size();
     info->ram->multifd_bytes = ram_counters.multifd_bytes;
     info->ram->pages_per_second = s->pages_per_second;
+    info->ram->deduplicated = ram_counters.deduplicated;
 
     if (migrate_use_xbzrle()) {
         info->has_xbzrle_cache = true;
@@ -1105,6 +1135,8 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         populate_vfio_info(info);
+        info->sections = qemu_savevm_section_stats();
+        info->has_sections = !!info->sections;
         break;
     case MIGRATION_STATUS_FAILED:
         info->has_status = true;
@@ -1242,6 +1274,48 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_DEDUP]) {
+        if (cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_X_COLO]) {
+            error_setg(errp, "Dedup is not compatible with xbzrle, "
+                       "compress or x-colo");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_LOCAL_RAM] &&
+        (cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+         cap_list[MIGRATION_CAPABILITY_X_IGNORE_SHARED])) {
+        error_setg(errp, "Local-ram is not compatible with postcopy-ram "
+                   "or x-ignore-shared");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH] &&
+        !cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+        error_setg(errp, "Postcopy-prefetch requires postcopy-ram");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_HOT_PAGES_LAST] &&
+        cap_list[MIGRATION_CAPABILITY_COMPRESS]) {
+        error_setg(errp, "Hot-pages-last is not compatible with compress");
+        return false;
+    }
+
+#ifdef CONFIG_LINUX
+    if (cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND] &&
+        (!cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+         cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+         cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+         cap_list[MIGRATION_CAPABILITY_DEDUP])) {
+        error_setg(errp, "Zero-copy-send requires multifd, and is not "
+                   "compatible with xbzrle, compress or dedup");
+        return false;
+    }
+#endif
+
     /* incoming side only */
     if (runstate_check(RUN_STATE_INMIGRATE) &&
         !migrate_multifd_is_allowed() &&
@@ -1280,6 +1354,8 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        info->sections = qemu_savevm_section_stats();
+        info->has_sections = !!info->sections;
         break;
     }
     info->status = mis->state;
@@ -2603,6 +2679,91 @@ bool migrate_background_snapshot(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT];
 }
 
+bool migrate_parallel_snapshot(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_PARALLEL_SNAPSHOT];
+}
+
+bool migrate_use_dedup(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DEDUP];
+}
+
+bool migrate_use_zero_copy_send(void)
+{
+#ifdef CONFIG_LINUX
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_ZERO_COPY_SEND];
+#else
+    return false;
+#endif
+}
+
+bool migrate_hot_pages_last(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_HOT_PAGES_LAST];
+}
+
+bool migrate_incremental_dirty_sync(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_INCREMENTAL_DIRTY_SYNC];
+}
+
+bool migrate_postcopy_prefetch(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREFETCH];
+}
+
+bool migrate_local_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_LOCAL_RAM];
+}
+
+bool migrate_parallel_device_load(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_PARALLEL_DEVICE_LOAD];
+}
+
+bool migrate_lazy_snapshot_load(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_LAZY_SNAPSHOT_LOAD];
+}
+
 /* migration thread support */
 /*
  * Something bad happened to the RP stream, mark an error
@@ -2624,6 +2785,7 @@ static struct rp_cmd_args {
     [MIG_RP_MSG_REQ_PAGES_ID]   = { .len = -1, .name = "REQ_PAGES_ID" },
     [MIG_RP_MSG_RECV_BITMAP]    = { .len = -1, .name = "RECV_BITMAP" },
     [MIG_RP_MSG_RESUME_ACK]     = { .len =  4, .name = "RESUME_ACK" },
+    [MIG_RP_MSG_PREFETCH_PAGES] = { .len = -1, .name = "PREFETCH_PAGES" },
     [MIG_RP_MSG_MAX]            = { .len = -1, .name = "MAX" },
 };
 
@@ -2633,11 +2795,13 @@ static struct rp_cmd_args {
  * and we don't need to send pages that have already been sent.
  */
 static void migrate_handle_rp_req_pages(MigrationState *ms, const char* rbname,
-                                       ram_addr_t start, size_t len)
+                                       ram_addr_t start, size_t len,
+                                       bool prefetch)
 {
     long our_host_ps = qemu_real_host_page_size;
+    int ret;
 
-    trace_migrate_handle_rp_req_pages(rbname, start, len);
+    trace_migrate_handle_rp_req_pages(rbname, start, len, prefetch);
 
     /*
      * Since we currently insist on matching page sizes, just sanity check
@@ -2651,7 +2815,12 @@ static void migrate_handle_rp_req_pages(MigrationState *ms, const char* rbname,
         return;
     }
 
-    if (ram_save_queue_pages(rbname, start, len)) {
+    if (prefetch) {
+        ret = ram_save_queue_prefetch(rbname, start, len);
+    } else {
+        ret = ram_save_queue_pages(rbname, start, len);
+    }
+    if (ret) {
         mark_source_rp_bad(ms);
     }
 }
@@ -2801,10 +2970,11 @@ retry:
         case MIG_RP_MSG_REQ_PAGES:
             start = ldq_be_p(buf);
             len = ldl_be_p(buf + 8);
-            migrate_handle_rp_req_pages(ms, NULL, start, len);
+            migrate_handle_rp_req_pages(ms, NULL, start, len, false);
             break;
 
         case MIG_RP_MSG_REQ_PAGES_ID:
+        case MIG_RP_MSG_PREFETCH_PAGES:
             expected_len = 12 + 1; /* header + termination */
 
             if (header_len >= expected_len) {
@@ -2816,12 +2986,15 @@ retry:
                 expected_len += tmp32;
             }
             if (header_len != expected_len) {
-                error_report("RP: Req_Page_id with length %d expecting %zd",
+                error_report("RP: %s with length %d expecting %zd",
+                             rp_cmd_args[header_type].name,
                              header_len, expected_len);
                 mark_source_rp_bad(ms);
                 goto out;
             }
-            migrate_handle_rp_req_pages(ms, (char *)&buf[13], start, len);
+            migrate_handle_rp_req_pages(ms, (char *)&buf[13], start, len,
+                                        header_type ==
+                                        MIG_RP_MSG_PREFETCH_PAGES);
             break;
 
         case MIG_RP_MSG_RECV_BITMAP:
@@ -4146,6 +4319,14 @@ static Property migration_properties[] = {
                       decompress_error_check, true),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
+    DEFINE_PROP_UINT32("x-dedup-index-entries", MigrationState,
+                      dedup_index_entries, DEDUP_INDEX_ENTRIES_DEFAULT),
+    DEFINE_PROP_BOOL("x-multifd-lz4-adaptive", MigrationState,
+                     multifd_lz4_adaptive, true),
+    DEFINE_PROP_UINT32("x-postcopy-prefetch-pages", MigrationState,
+                      postcopy_prefetch_pages, 8),
+    DEFINE_PROP_UINT8("x-parallel-device-load-threads", MigrationState,
+                      parallel_device_load_threads, 4),
 
     /* Migration parameters */
     DEFINE_PROP_UINT8("x-compress-level", MigrationState,
@@ -4227,6 +4408,26 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
+    DEFINE_PROP_MIG_CAP("x-parallel-snapshot",
+            MIGRATION_CAPABILITY_PARALLEL_SNAPSHOT),
+    DEFINE_PROP_MIG_CAP("x-lazy-snapshot-load",
+            MIGRATION_CAPABILITY_LAZY_SNAPSHOT_LOAD),
+    DEFINE_PROP_MIG_CAP("x-dedup", MIGRATION_CAPABILITY_DEDUP),
+#ifdef CONFIG_LINUX
+    DEFINE_PROP_MIG_CAP("x-zero-copy-send",
+                        MIGRATION_CAPABILITY_ZERO_COPY_SEND),
+#endif
+    DEFINE_PROP_MIG_CAP("x-hot-pages-last",
+                        MIGRATION_CAPABILITY_HOT_PAGES_LAST),
+    DEFINE_PROP_MIG_CAP("x-incremental-dirty-sync",
+                        MIGRATION_CAPABILITY_INCREMENTAL_DIRTY_SYNC),
+    DEFINE_PROP_MIG_CAP("x-postcopy-prefetch",
+                        MIGRATION_CAPABILITY_POSTCOPY_PREFETCH),
+    DEFINE_PROP_MIG_CAP("x-local-ram", MIGRATION_CAPABILITY_LOCAL_RAM),
+    DEFINE_PROP_MIG_CAP("x-parallel-device-load",
+                        MIGRATION_CAPABILITY_PARALLEL_DEVICE_LOAD),
+    DEFINE_PROP_STRING("x-snapshot-ram-file", MigrationState,
+                       snapshot_ram_file),
 
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -39,12 +39,25 @@ struct PostcopyBlocktimeContext;
  * default value to use if no one specified.
  */
 #define CLEAR_BITMAP_SHIFT_DEFAULT        18
+/* 64K entries of the dedup index, about 4MB */
+#define DEDUP_INDEX_ENTRIES_DEFAULT        (1 << 16)
 /*
  * 1<<31=2G pages -> 8T chunk when page size is 4K.  This should be
  * big enough and make sure we won't overflow easily.
  */
 #define CLEAR_BITMAP_SHIFT_MAX            31
 
+/* Faults that postcopy-prefetch predicts from, in the fault thread */
+typedef struct PostcopyPrefetch {
+    RAMBlock *rb;               /* of the faults below */
+    ram_addr_t fault[2];        /* the two previous faults, newest first */
+    int nr_faults;
+    int64_t stride;             /* between the last three faults, if any */
+    /* Faults in [start, end) found their next pages asked for already */
+    ram_addr_t start;
+    ram_addr_t end;
+} PostcopyPrefetch;
+
 /* State for the incoming migration */
 struct MigrationIncomingState {
     QEMUFile *from_src_file;
@@ -81,6 +94,8 @@ struct MigrationIncomingState {
     QemuMutex rp_mutex;    /* We send replies from multiple threads */
     /* RAMBlock of last request sent to source */
     RAMBlock *last_rb;
+    /* Recent faults, for the postcopy-prefetch capability */
+    PostcopyPrefetch prefetch;
     void     *postcopy_tmp_page;
     void     *postcopy_tmp_zero_page;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
@@ -292,10 +307,34 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Entries of the index of the pages sent with the dedup
+     * capability, rounded down to a power of 2.
+     */
+    uint32_t dedup_index_entries;
+
+    /*
+     * Whether each multifd channel with lz4 compression sends its
+     * packets uncompressed while compression would slow it down.
+     */
+    bool multifd_lz4_adaptive;
+
+    /*
+     * Host pages after each faulted page that the destination asks for
+     * with the postcopy-prefetch capability.
+     */
+    uint32_t postcopy_prefetch_pages;
+
+    /* Threads that run post_load hooks with parallel-device-load */
+    uint8_t parallel_device_load_threads;
+
     /*
      * This save hostname when out-going migration starts
      */
     char *hostname;
+
+    /* File for the guest RAM of parallel snapshots, from the property */
+    char *snapshot_ram_file;
 };
 
 void migrate_set_state(int *state, int old_state, int new_state);
@@ -358,6 +397,15 @@ int migrate_decompress_threads(void);
 bool migrate_use_events(void);
 bool migrate_postcopy_blocktime(void);
 bool migrate_background_snapshot(void);
+bool migrate_parallel_snapshot(void);
+bool migrate_lazy_snapshot_load(void);
+bool migrate_use_dedup(void);
+bool migrate_use_zero_copy_send(void);
+bool migrate_hot_pages_last(void);
+bool migrate_incremental_dirty_sync(void);
+bool migrate_postcopy_prefetch(void);
+bool migrate_local_ram(void);
+bool migrate_parallel_device_load(void);
 
 /* Sending on the return path - generic and then for each message type */
 void migrate_send_rp_shut(MigrationIncomingState *mis,
@@ -368,6 +416,9 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
                               ram_addr_t start, uint64_t haddr);
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
                                       RAMBlock *rb, ram_addr_t start);
+int migrate_send_rp_prefetch_pages(MigrationIncomingState *mis,
+                                   RAMBlock *rb, ram_addr_t start,
+                                   uint32_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
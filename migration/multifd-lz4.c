@@ -0,0 +1,353 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * Each page is compressed on its own, and goes on the wire as its
+ * big-endian compressed size followed by the compressed data.  A page
+ * that does not compress is sent as is, with its size as the page size.
+ *
+ * lz4 only pays off if it compresses faster than the link writes the
+ * bytes it saves, which fast links and incompressible guest memory both
+ * defeat.  So, unless x-multifd-lz4-adaptive is off, each channel times
+ * its compression and its writes, and sends uncompressed packets, with
+ * the MULTIFD_FLAG_NOCOMP flag, while compression would slow it down.
+ * It then tries again, after twice as many packets each time it fails.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/bswap.h"
+#include "qemu/rcu.h"
+#include "qemu/timer.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/* Most uncompressed packets between two tries of compression */
+#define LZ4_BACKOFF_MAX 256
+
+struct lz4_data {
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+    /* whether to stop compressing when it does not pay off */
+    bool adaptive;
+    /* whether the current packet is compressed */
+    bool compressed;
+    /* packets left to send uncompressed */
+    uint32_t skip;
+    /* packets to send uncompressed the next time compression fails */
+    uint32_t backoff;
+    /* recent statistics, halved on each packet that is compressed */
+    uint64_t in_bytes;
+    uint64_t out_bytes;
+    uint64_t compress_ns;
+    uint64_t wire_bytes;
+    uint64_t wire_ns;
+};
+
+/* Multifd lz4 compression */
+
+static uint32_t lz4_buff_len(void)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+
+    /* We will never have more than page_count pages */
+    return page_count * (sizeof(uint32_t) + qemu_target_page_size());
+}
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with lz4 compression.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->zbuff_len = lz4_buff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
+        return -1;
+    }
+    z->adaptive = migrate_get_current()->multifd_lz4_adaptive;
+    z->backoff = 1;
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Close the channel and return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare data to be able to send
+ *
+ * Create a compressed buffer with all the pages that we are going to
+ * send, unless this packet goes uncompressed.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct iovec *iov = p->pages->iov;
+    struct lz4_data *z = p->data;
+    uint32_t page_size = qemu_target_page_size();
+    uint32_t pos = 0;
+    int64_t start;
+    uint32_t i;
+
+    if (z->skip) {
+        z->skip--;
+        z->compressed = false;
+        p->next_packet_size = used * page_size;
+        p->flags |= MULTIFD_FLAG_NOCOMP;
+        return 0;
+    }
+
+    start = get_clock();
+    for (i = 0; i < used; i++) {
+        uint8_t *dst = z->zbuff + pos + sizeof(uint32_t);
+        int ret;
+
+        /* Fails when the page does not fit in less than its size */
+        ret = LZ4_compress_default(iov[i].iov_base, (char *)dst,
+                                   iov[i].iov_len, iov[i].iov_len - 1);
+        if (ret <= 0) {
+            memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+            ret = iov[i].iov_len;
+        }
+        stl_be_p(z->zbuff + pos, ret);
+        pos += sizeof(uint32_t) + ret;
+    }
+    z->compress_ns += get_clock() - start;
+    z->in_bytes += used * page_size;
+    z->out_bytes += pos;
+    z->compressed = true;
+
+    p->next_packet_size = pos;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/*
+ * Compression pays off if it takes less time than writing the bytes
+ * that it saves, at the rate the channel writes
+ */
+static void lz4_adapt(MultiFDSendParams *p)
+{
+    struct lz4_data *z = p->data;
+    uint64_t saved_ns = 0;
+
+    if (z->out_bytes < z->in_bytes && z->wire_bytes) {
+        saved_ns = (z->in_bytes - z->out_bytes) * z->wire_ns / z->wire_bytes;
+    }
+
+    if (z->compress_ns < saved_ns) {
+        z->backoff = 1;
+    } else {
+        z->skip = z->backoff;
+        z->backoff = MIN(z->backoff * 2, LZ4_BACKOFF_MAX);
+    }
+    trace_multifd_lz4_adapt(p->id, z->compress_ns, saved_ns, z->skip);
+
+    z->in_bytes /= 2;
+    z->out_bytes /= 2;
+    z->compress_ns /= 2;
+    z->wire_bytes /= 2;
+    z->wire_ns /= 2;
+}
+
+/**
+ * lz4_send_write: do the actual write of the data
+ *
+ * Do the actual write of the compressed buffer, or of the pages if
+ * this packet goes uncompressed.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    int64_t start = get_clock();
+    int ret;
+
+    if (z->compressed) {
+        ret = qio_channel_write_all(p->c, (void *)z->zbuff,
+                                    p->next_packet_size, errp);
+    } else {
+        ret = qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    z->wire_ns += get_clock() - start;
+    z->wire_bytes += p->next_packet_size;
+    if (z->adaptive && z->compressed) {
+        lz4_adapt(p);
+    }
+    return 0;
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the compressed buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    z->zbuff_len = lz4_buff_len();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return the memory of the compressed buffer.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages, or read the pages directly if the packet is uncompressed.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    uint32_t pos = 0;
+    uint32_t i;
+    int ret;
+
+    if (flags == MULTIFD_FLAG_NOCOMP) {
+        return qio_channel_readv_all(p->c, p->pages->iov, used, errp);
+    }
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > z->zbuff_len) {
+        error_setg(errp, "multifd %d: packet size received %u is larger "
+                   "than %u", p->id, in_size, z->zbuff_len);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < used; i++) {
+        struct iovec *iov = &p->pages->iov[i];
+        uint32_t len;
+
+        if (in_size - pos < sizeof(uint32_t)) {
+            break;
+        }
+        len = ldl_be_p(z->zbuff + pos);
+        pos += sizeof(uint32_t);
+        if (len > in_size - pos || len > iov->iov_len) {
+            break;
+        }
+
+        if (len == iov->iov_len) {
+            memcpy(iov->iov_base, z->zbuff + pos, len);
+        } else if (LZ4_decompress_safe((char *)z->zbuff + pos, iov->iov_base,
+                                       len, iov->iov_len) != iov->iov_len) {
+            error_setg(errp, "multifd %d: could not decompress page %u",
+                       p->id, i);
+            return -1;
+        }
+        pos += len;
+    }
+    if (i != used || pos != in_size) {
+        error_setg(errp, "multifd %d: packet size received %u does not "
+                   "match its %u pages", p->id, in_size, used);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
@@ -105,7 +105,13 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
  */
 static int nocomp_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
-    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    int flags = 0;
+
+    if (migrate_use_zero_copy_send()) {
+        flags |= QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+    }
+    return qio_channel_writev_full_all(p->c, p->pages->iov, used, NULL, 0,
+                                       flags, errp);
 }
 
 /**
@@ -632,6 +638,14 @@ static void *multifd_send_thread(void *opaque)
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
+    if (migrate_use_zero_copy_send() &&
+        !qio_channel_has_feature(p->c, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        error_setg(&local_err, "multifd %d: channel does not support "
+                   "zero copy", p->id);
+        ret = -1;
+        goto out;
+    }
+
     if (multifd_send_initial_packet(p, &local_err) < 0) {
         ret = -1;
         goto out;
@@ -684,6 +698,19 @@ static void *multifd_send_thread(void *opaque)
                 }
             }
 
+            /*
+             * The kernel may still read pages sent with zero copy.  A
+             * page redirtied meanwhile is sent again after the next
+             * bitmap sync, which comes after a sync packet: wait for
+             * the earlier copy to be out, so that the destination
+             * cannot see it after the newer one from another channel.
+             */
+            if ((flags & MULTIFD_FLAG_SYNC) &&
+                qio_channel_flush(p->c, &local_err) < 0) {
+                ret = -1;
+                break;
+            }
+
             qemu_mutex_lock(&p->mutex);
             p->pending_job--;
             qemu_mutex_unlock(&p->mutex);
@@ -895,6 +922,14 @@ int multifd_save_setup(Error **errp)
     }
 
     s = migrate_get_current();
+    if (migrate_use_zero_copy_send() &&
+        (migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE ||
+         (s->parameters.tls_creds && *s->parameters.tls_creds))) {
+        error_setg(errp, "zero-copy-send works only without multifd "
+                   "compression and without TLS");
+        return -1;
+    }
+
     thread_count = migrate_multifd_channels();
     multifd_send_state = g_malloc0(sizeof(*multifd_send_state));
     multifd_send_state->params = g_new0(MultiFDSendParams, thread_count);
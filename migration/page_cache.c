@@ -17,6 +17,7 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/mem-usage.h"
 #include "page_cache.h"
 #include "trace.h"
 
@@ -83,6 +84,8 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
         cache->page_cache[i].it_age = 0;
         cache->page_cache[i].it_addr = -1;
     }
+    mem_usage_add(MEMORY_USAGE_SUBSYSTEM_MIGRATION,
+                  cache->max_num_items * sizeof(*cache->page_cache));
 
     return cache;
 }
@@ -98,6 +101,9 @@ void cache_fini(PageCache *cache)
         g_free(cache->page_cache[i].it_data);
     }
 
+    mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_MIGRATION,
+                  cache->max_num_items * sizeof(*cache->page_cache) +
+                  cache->num_items * cache->page_size);
     g_free(cache->page_cache);
     cache->page_cache = NULL;
     g_free(cache);
@@ -164,6 +170,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
             return -1;
         }
         cache->num_items++;
+        mem_usage_add(MEMORY_USAGE_SUBSYSTEM_MIGRATION, cache->page_size);
     }
 
     memcpy(it->it_data, pdata, cache->page_size);
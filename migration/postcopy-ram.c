@@ -671,9 +671,109 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
     return ret;
 }
 
+/*
+ * With the postcopy-prefetch capability, each fault also asks for the
+ * pages that the guest is likely to touch next: those that follow the
+ * faulted page, and, if the last three faults in a RAMBlock were the
+ * same distance apart, the next POSTCOPY_PREFETCH_STRIDES pages at that
+ * distance.  The source sends them once no faulted page is waiting.
+ */
+#define POSTCOPY_PREFETCH_STRIDES 4
+
+/* Ask for the pages of [@start, @end) that are not there yet */
+static int postcopy_prefetch_range(MigrationIncomingState *mis, RAMBlock *rb,
+                                   ram_addr_t start, ram_addr_t end)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t run = start;
+    ram_addr_t addr;
+    int ret;
+
+    /* The length of a request is 32 bits on the wire */
+    end = MIN(end, start + QEMU_ALIGN_DOWN(UINT32_MAX, pagesize));
+
+    for (addr = start; addr <= end; addr += pagesize) {
+        if (addr < end && !ramblock_recv_bitmap_test_byte_offset(rb, addr) &&
+            !ramblock_page_is_discarded(rb, addr)) {
+            continue;
+        }
+        if (run < addr) {
+            trace_postcopy_prefetch_pages(qemu_ram_get_idstr(rb), run,
+                                          addr - run);
+            ret = migrate_send_rp_prefetch_pages(mis, rb, run, addr - run);
+            if (ret) {
+                return ret;
+            }
+        }
+        run = addr + pagesize;
+    }
+    return 0;
+}
+
+static int postcopy_prefetch(MigrationIncomingState *mis, RAMBlock *rb,
+                             ram_addr_t start)
+{
+    PostcopyPrefetch *pf = &mis->prefetch;
+    size_t pagesize = qemu_ram_pagesize(rb);
+    ram_addr_t window = (ram_addr_t)pagesize *
+                        migrate_get_current()->postcopy_prefetch_pages;
+    ram_addr_t from = start + pagesize;
+    ram_addr_t to = MIN(from + window, rb->used_length);
+    int64_t stride = 0;
+    int ret = 0;
+    int i;
+
+    if (rb != pf->rb) {
+        pf->rb = rb;
+        pf->nr_faults = 0;
+        pf->stride = 0;
+        pf->start = pf->end = 0;
+    }
+
+    /* The pages after the fault, but for those asked for already */
+    if (start >= pf->start && start < pf->end) {
+        from = MAX(from, pf->end);
+    }
+    if (from < to) {
+        ret = postcopy_prefetch_range(mis, rb, from, to);
+        pf->start = start;
+        pf->end = to;
+    }
+
+    if (pf->nr_faults == 2) {
+        stride = (int64_t)(start - pf->fault[0]);
+        /* Strides within the window are prefetched already */
+        if (stride != (int64_t)(pf->fault[0] - pf->fault[1]) ||
+            (stride >= 0 && (ram_addr_t)stride <= window)) {
+            stride = 0;
+        }
+    }
+    if (stride) {
+        /* When the stride held already, only the furthest page is new */
+        for (i = pf->stride == stride ? POSTCOPY_PREFETCH_STRIDES : 1;
+             !ret && i <= POSTCOPY_PREFETCH_STRIDES; i++) {
+            int64_t addr = (int64_t)start + i * stride;
+
+            if (addr < 0 || (ram_addr_t)addr >= rb->used_length) {
+                break;
+            }
+            ret = postcopy_prefetch_range(mis, rb, addr, addr + pagesize);
+        }
+    }
+    pf->stride = stride;
+    trace_postcopy_prefetch(qemu_ram_get_idstr(rb), start, stride);
+
+    pf->fault[1] = pf->fault[0];
+    pf->fault[0] = start;
+    pf->nr_faults = MIN(pf->nr_faults + 1, 2);
+    return ret;
+}
+
 static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
                                  ram_addr_t start, uint64_t haddr)
 {
+    int ret;
+
     void *aligned = (void *)(uintptr_t)ROUND_DOWN(haddr, qemu_ram_pagesize(rb));
 
     /*
@@ -691,7 +791,11 @@ static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
         return received ? 0 : postcopy_place_page_zero(mis, aligned, rb);
     }
 
-    return migrate_send_rp_req_pages(mis, rb, start, haddr);
+    ret = migrate_send_rp_req_pages(mis, rb, start, haddr);
+    if (!ret && migrate_postcopy_prefetch()) {
+        ret = postcopy_prefetch(mis, rb, start);
+    }
+    return ret;
 }
 
 /*
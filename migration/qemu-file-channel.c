@@ -29,6 +29,7 @@
 #include "io/channel-tls.h"
 #include "qemu/iov.h"
 #include "qemu/yank.h"
+#include "qapi/error.h"
 #include "yank_functions.h"
 
 
@@ -74,17 +75,25 @@ static ssize_t channel_writev_buffer(void *opaque,
 }
 
 
-static ssize_t channel_get_buffer(void *opaque,
-                                  uint8_t *buf,
-                                  int64_t pos,
-                                  size_t size,
-                                  Error **errp)
+static ssize_t channel_get_buffer_fds(void *opaque,
+                                      uint8_t *buf,
+                                      int64_t pos,
+                                      size_t size,
+                                      int **fds,
+                                      size_t *nfds,
+                                      Error **errp)
 {
     QIOChannel *ioc = QIO_CHANNEL(opaque);
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
     ssize_t ret;
 
+    if (!qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS)) {
+        fds = NULL;
+        nfds = NULL;
+    }
+
     do {
-        ret = qio_channel_read(ioc, (char *)buf, size, errp);
+        ret = qio_channel_readv_full(ioc, &iov, 1, fds, nfds, errp);
         if (ret < 0) {
             if (ret == QIO_CHANNEL_ERR_BLOCK) {
                 if (qemu_in_coroutine()) {
@@ -102,6 +111,23 @@ static ssize_t channel_get_buffer(void *opaque,
 }
 
 
+static int channel_put_fd(void *opaque, int fd, Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    uint8_t byte = 0;
+    struct iovec iov = { .iov_base = &byte, .iov_len = 1 };
+
+    if (!qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS)) {
+        error_setg(errp, "Channel does not support file descriptor passing");
+        return -ENOTSUP;
+    }
+    if (qio_channel_writev_full_all(ioc, &iov, 1, &fd, 1, 0, errp) < 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
+
 static int channel_close(void *opaque, Error **errp)
 {
     int ret;
@@ -164,7 +190,7 @@ static QEMUFile *channel_get_output_return_path(void *opaque)
 }
 
 static const QEMUFileOps channel_input_ops = {
-    .get_buffer = channel_get_buffer,
+    .get_buffer_fds = channel_get_buffer_fds,
     .close = channel_close,
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
@@ -174,6 +200,7 @@ static const QEMUFileOps channel_input_ops = {
 
 static const QEMUFileOps channel_output_ops = {
     .writev_buffer = channel_writev_buffer,
+    .put_fd = channel_put_fd,
     .close = channel_close,
     .shut_down = channel_shutdown,
     .set_blocking = channel_set_blocking,
@@ -25,6 +25,7 @@
 #include <zlib.h>
 #include "qemu/error-report.h"
 #include "qemu/iov.h"
+#include "qemu/mem-usage.h"
 #include "migration.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -57,6 +58,10 @@ struct QEMUFile {
     bool shutdown;
     /* Whether opaque points to a QIOChannel */
     bool has_ioc;
+
+    /* File descriptors received, not yet taken by qemu_file_get_fd() */
+    int *fds;
+    size_t nfds;
 };
 
 /*
@@ -108,6 +113,7 @@ QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops, bool has_ioc)
     QEMUFile *f;
 
     f = g_new0(QEMUFile, 1);
+    mem_usage_add(MEMORY_USAGE_SUBSYSTEM_MIGRATION, sizeof(*f));
 
     f->opaque = opaque;
     f->ops = ops;
@@ -348,8 +354,23 @@ static ssize_t qemu_fill_buffer(QEMUFile *f)
         return 0;
     }
 
-    len = f->ops->get_buffer(f->opaque, f->buf + pending, f->pos,
-                             IO_BUF_SIZE - pending, &local_error);
+    if (f->ops->get_buffer_fds) {
+        int *fds = NULL;
+        size_t nfds = 0;
+
+        len = f->ops->get_buffer_fds(f->opaque, f->buf + pending, f->pos,
+                                     IO_BUF_SIZE - pending, &fds, &nfds,
+                                     &local_error);
+        if (nfds) {
+            f->fds = g_renew(int, f->fds, f->nfds + nfds);
+            memcpy(f->fds + f->nfds, fds, nfds * sizeof(int));
+            f->nfds += nfds;
+        }
+        g_free(fds);
+    } else {
+        len = f->ops->get_buffer(f->opaque, f->buf + pending, f->pos,
+                                 IO_BUF_SIZE - pending, &local_error);
+    }
     if (len > 0) {
         f->buf_size += len;
         f->pos += len;
@@ -396,6 +417,11 @@ int qemu_fclose(QEMUFile *f)
         ret = f->last_error;
     }
     error_free(f->last_error_obj);
+    while (f->nfds) {
+        close(f->fds[--f->nfds]);
+    }
+    g_free(f->fds);
+    mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_MIGRATION, sizeof(*f));
     g_free(f);
     trace_qemu_file_fclose();
     return ret;
@@ -652,6 +678,11 @@ int64_t qemu_ftell_fast(QEMUFile *f)
     int64_t ret = f->pos;
     int i;
 
+    /* When reading, pos is where the buffer ends */
+    if (!qemu_file_is_writable(f)) {
+        return ret - f->buf_size + f->buf_index;
+    }
+
     for (i = 0; i < f->iovcnt; i++) {
         ret += f->iov[i].iov_len;
     }
@@ -855,6 +886,65 @@ void qemu_file_set_blocking(QEMUFile *f, bool block)
     }
 }
 
+/*
+ * Pass @fd to the other end of @f, which takes it with qemu_file_get_fd()
+ * at the same point of the stream.  Only some files, like those on a
+ * UNIX socket, can do so.
+ *
+ * Returns 0 on success, or a negative errno value.
+ */
+int qemu_file_put_fd(QEMUFile *f, int fd)
+{
+    Error *local_error = NULL;
+    int ret;
+
+    if (!f->ops->put_fd) {
+        qemu_file_set_error(f, -ENOTSUP);
+        return -ENOTSUP;
+    }
+
+    qemu_fflush(f);
+    ret = qemu_file_get_error(f);
+    if (ret) {
+        return ret;
+    }
+
+    ret = f->ops->put_fd(f->opaque, fd, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, ret, local_error);
+        return ret;
+    }
+    f->pos++;
+    f->bytes_xfer++;
+    return 0;
+}
+
+/*
+ * Take the file descriptor that the other end passed with
+ * qemu_file_put_fd() at this point of the stream.
+ *
+ * Returns the file descriptor, which the caller must close, or a
+ * negative errno value.
+ */
+int qemu_file_get_fd(QEMUFile *f)
+{
+    int fd;
+
+    /* The fd came with this byte, if not before */
+    qemu_get_byte(f);
+    if (qemu_file_get_error(f)) {
+        return qemu_file_get_error(f);
+    }
+    if (!f->nfds) {
+        qemu_file_set_error(f, -EINVAL);
+        return -EINVAL;
+    }
+
+    fd = f->fds[0];
+    memmove(f->fds, f->fds + 1, --f->nfds * sizeof(int));
+    return fd;
+}
+
 /*
  * Return the ioc object if it's a migration channel.  Note: it can return NULL
  * for callers passing in a non-migration qemufile.  E.g. see qemu_fopen_bdrv()
@@ -37,6 +37,20 @@ typedef ssize_t (QEMUFileGetBufferFunc)(void *opaque, uint8_t *buf,
                                         int64_t pos, size_t size,
                                         Error **errp);
 
+/* Read a chunk of data like QEMUFileGetBufferFunc, and the file
+ * descriptors passed with it, if any, in a new array of *nfds elements
+ * at *fds.
+ */
+typedef ssize_t (QEMUFileGetBufferFdsFunc)(void *opaque, uint8_t *buf,
+                                           int64_t pos, size_t size,
+                                           int **fds, size_t *nfds,
+                                           Error **errp);
+
+/* Pass a file descriptor to the other end with a single byte of data.
+ * Returns 0 on success, or a negative errno value.
+ */
+typedef int (QEMUFilePutFdFunc)(void *opaque, int fd, Error **errp);
+
 /* Close a file
  *
  * Return negative error number on error, 0 or positive value on success.
@@ -111,6 +125,8 @@ typedef struct QEMUFileOps {
     QEMUFileWritevBufferFunc *writev_buffer;
     QEMURetPathFunc *get_return_path;
     QEMUFileShutdownFunc *shut_down;
+    QEMUFileGetBufferFdsFunc *get_buffer_fds;
+    QEMUFilePutFdFunc *put_fd;
 } QEMUFileOps;
 
 typedef struct QEMUFileHooks {
@@ -162,6 +178,8 @@ int qemu_file_shutdown(QEMUFile *f);
 QEMUFile *qemu_file_get_return_path(QEMUFile *f);
 void qemu_fflush(QEMUFile *f);
 void qemu_file_set_blocking(QEMUFile *f, bool block);
+int qemu_file_put_fd(QEMUFile *f, int fd);
+int qemu_file_get_fd(QEMUFile *f);
 
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags);
 void ram_control_after_iterate(QEMUFile *f, uint64_t flags);
@@ -51,12 +51,14 @@
 #include "migration/colo.h"
 #include "block.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
 #include "sysemu/runstate.h"
 
 #include "hw/boards.h" /* for machine_dump_guest_core() */
+#include "crypto/hash.h"
 
 #if defined(__linux__)
 #include "qemu/userfaultfd.h"
@@ -80,6 +82,8 @@
 #define RAM_SAVE_FLAG_XBZRLE   0x40
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
+/* Followed by the offset of an identical page, flagged as a page header */
+#define RAM_SAVE_FLAG_DEDUP            0x200
 
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
@@ -165,10 +169,17 @@ out:
     return ret;
 }
 
+/* Whether the local-ram capability passes @block rather than copying it */
+static bool ramblock_is_local(RAMBlock *block)
+{
+    return qemu_ram_is_shared(block) && block->fd >= 0;
+}
+
 bool ramblock_is_ignored(RAMBlock *block)
 {
     return !qemu_ram_is_migratable(block) ||
-           (migrate_ignore_shared() && qemu_ram_is_shared(block));
+           (migrate_ignore_shared() && qemu_ram_is_shared(block)) ||
+           (migrate_local_ram() && ramblock_is_local(block));
 }
 
 #undef RAMBLOCK_FOREACH
@@ -299,7 +310,34 @@ struct RAMSrcPageRequest {
     QSIMPLEQ_ENTRY(RAMSrcPageRequest) next_req;
 };
 
+/* Most queued prefetch requests, see ram_save_queue_prefetch() */
+#define RAM_PREFETCH_QUEUE_MAX 1024
+
 /* State of RAM for migration */
+/*
+ * Index of the pages sent with the dedup capability, by the hash of
+ * their content.  The destination still holds what was sent for a page
+ * until the page is sent again, which drops it from the index.  Each
+ * entry is also found from its page through by_page, so that it is
+ * dropped in that case; when two pages share a slot of by_page, the
+ * entry of the older one is dropped instead.
+ */
+#define DEDUP_HASH_LEN 32
+
+typedef struct DedupEntry {
+    uint8_t hash[DEDUP_HASH_LEN];
+    RAMBlock *block;            /* NULL if the entry is free */
+    ram_addr_t offset;
+    /* dirty_sync_count when the page was sent */
+    uint64_t sync;
+} DedupEntry;
+
+typedef struct DedupIndex {
+    DedupEntry *entries;
+    uint32_t *by_page;          /* index of the entry + 1, or 0 */
+    uint32_t mask;
+} DedupIndex;
+
 struct RAMState {
     /* QEMUFile used for this migration */
     QEMUFile *f;
@@ -352,6 +390,17 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /* Predicted pages, sent when src_page_requests is empty */
+    QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_prefetch_requests;
+    unsigned int src_prefetch_count;
+    /* Pages sent, with the dedup capability */
+    DedupIndex *dedup;
+    /* Send the hot regions too, once none of the cold ones are dirty */
+    bool send_hot;
+    /* Blocks yet to sync in the current incremental-dirty-sync pass */
+    unsigned int unsynced_blocks;
+    /* The last of them synced since ram_save_pending() last looked */
+    bool sync_fresh;
 };
 typedef struct RAMState RAMState;
 
@@ -979,11 +1028,58 @@ bool ramblock_page_is_discarded(RAMBlock *rb, ram_addr_t start)
     return false;
 }
 
+/*
+ * Regions of 1 << DIRTY_HEAT_SHIFT target pages, whose heat is raised
+ * by DIRTY_HEAT_SYNC at each sync that finds them written since they
+ * were sent.  A region is hot from DIRTY_HEAT_HOT, that is if it was
+ * written again at one of the last two syncs.
+ */
+#define DIRTY_HEAT_SHIFT 9
+#define DIRTY_HEAT_SYNC  128
+#define DIRTY_HEAT_HOT   64
+
+/* Sync @rb region by region, to tell which ones are written again */
+static uint64_t ramblock_sync_dirty_heat(RAMBlock *rb)
+{
+    ram_addr_t region = (ram_addr_t)TARGET_PAGE_SIZE << DIRTY_HEAT_SHIFT;
+    uint64_t new_dirty_pages = 0;
+    unsigned long hot = 0, i = 0;
+    ram_addr_t start;
+
+    for (start = 0; start < rb->used_length; start += region, i++) {
+        uint64_t pages = cpu_physical_memory_sync_dirty_bitmap(rb, start,
+                                MIN(region, rb->used_length - start));
+
+        rb->dirty_heat[i] = rb->dirty_heat[i] / 2 +
+                            (pages ? DIRTY_HEAT_SYNC : 0);
+        hot += rb->dirty_heat[i] >= DIRTY_HEAT_HOT;
+        new_dirty_pages += pages;
+    }
+    trace_ramblock_sync_dirty_heat(rb->idstr, hot, i);
+
+    return new_dirty_pages;
+}
+
+/* Whether to send the cold dirty pages before @page */
+static bool ramblock_page_is_hot(RAMState *rs, RAMBlock *rb,
+                                 unsigned long page)
+{
+    return rb->dirty_heat && !rs->send_hot && !migration_in_postcopy() &&
+           rb->dirty_heat[page >> DIRTY_HEAT_SHIFT] >= DIRTY_HEAT_HOT;
+}
+
 /* Called with RCU critical section */
 static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 {
-    uint64_t new_dirty_pages =
-        cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length);
+    uint64_t new_dirty_pages;
+
+    if (rb->dirty_heat) {
+        new_dirty_pages = ramblock_sync_dirty_heat(rb);
+    } else {
+        new_dirty_pages =
+            cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length);
+    }
+    rb->bmap_sync = ram_counters.dirty_sync_count;
 
     rs->migration_dirty_pages += new_dirty_pages;
     rs->num_dirty_pages_period += new_dirty_pages;
@@ -1079,8 +1175,11 @@ static void migration_trigger_throttle(RAMState *rs)
 
     /* During block migration the auto-converge logic incorrectly detects
      * that ram migration makes no progress. Avoid this by disabling the
-     * throttling logic during the bulk phase of block migration. */
-    if (migrate_auto_converge() && !blk_mig_bulk_active()) {
+     * throttling logic during the bulk phase of block migration.
+     * vCPU dirty limits already slow down the vCPUs that keep
+     * migration from converging, don't throttle the others on top. */
+    if (migrate_auto_converge() && !blk_mig_bulk_active() &&
+        !dirtylimit_in_service()) {
         /* The following detection logic can be refined later. For now:
            Check to see if the ratio between dirtied bytes and the approx.
            amount of bytes that just got transferred since the last time
@@ -1097,7 +1196,12 @@ static void migration_trigger_throttle(RAMState *rs)
     }
 }
 
-static void migration_bitmap_sync(RAMState *rs)
+/*
+ * With @incremental, only start a pass of the incremental-dirty-sync
+ * capability: each RAMBlock takes in its dirty log when the search for
+ * dirty pages gets to it, see ramblock_sync_dirty_log().
+ */
+static void migration_bitmap_sync(RAMState *rs, bool incremental)
 {
     RAMBlock *block;
     int64_t end_time;
@@ -1109,18 +1213,38 @@ static void migration_bitmap_sync(RAMState *rs)
     }
 
     trace_migration_bitmap_sync_start();
-    memory_global_dirty_log_sync();
+    if (!incremental) {
+        memory_global_dirty_log_sync();
+    }
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
+        rs->unsynced_blocks = 0;
         RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
+            if (incremental) {
+                rs->unsynced_blocks++;
+            } else {
+                ramblock_sync_dirty_bitmap(rs, block);
+            }
         }
         ram_counters.remaining = ram_bytes_remaining();
     }
+
+    /*
+     * The hot regions go once a scan from the start of RAM found no
+     * cold dirty pages left, so that they have as little time as
+     * possible to be written again before the next sync.
+     */
+    if (migrate_hot_pages_last()) {
+        rs->last_seen_block = QLIST_FIRST_RCU(&ram_list.blocks);
+        rs->last_page = 0;
+        rs->send_hot = false;
+    }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
-    memory_global_after_dirty_log_sync();
+    if (!incremental) {
+        memory_global_after_dirty_log_sync();
+    }
     trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
@@ -1143,7 +1267,44 @@ static void migration_bitmap_sync(RAMState *rs)
     }
 }
 
-static void migration_bitmap_sync_precopy(RAMState *rs)
+/*
+ * Take in the dirty log of @rb, unless it did in the current pass of
+ * the incremental-dirty-sync capability.
+ *
+ * Called from the search for dirty pages, with the bitmap mutex and in
+ * RCU critical section.  The BQL is only taken for this block, and the
+ * pages found in the blocks before can go meanwhile, so that the sync
+ * no longer stops the sending nor the guest for the whole of RAM.
+ */
+static void ramblock_sync_dirty_log(RAMState *rs, RAMBlock *rb)
+{
+    if (!rs->unsynced_blocks || ramblock_is_ignored(rb) ||
+        rb->bmap_sync == ram_counters.dirty_sync_count) {
+        return;
+    }
+
+    /* The BQL comes before the bitmap mutex */
+    qemu_mutex_unlock(&rs->bitmap_mutex);
+    qemu_mutex_lock_iothread();
+    memory_region_dirty_log_sync(rb->mr);
+
+    qemu_mutex_lock(&rs->bitmap_mutex);
+    ramblock_sync_dirty_bitmap(rs, rb);
+    if (!--rs->unsynced_blocks) {
+        rs->sync_fresh = true;
+    }
+    ram_counters.remaining = ram_bytes_remaining();
+    qemu_mutex_unlock(&rs->bitmap_mutex);
+
+    /* With TCG, this drops the BQL to wait for the vCPUs */
+    memory_global_after_dirty_log_sync();
+    qemu_mutex_unlock_iothread();
+    qemu_mutex_lock(&rs->bitmap_mutex);
+
+    trace_ramblock_sync_dirty_log(rb->idstr, rs->unsynced_blocks);
+}
+
+static void migration_bitmap_sync_precopy(RAMState *rs, bool incremental)
 {
     Error *local_err = NULL;
 
@@ -1156,7 +1317,7 @@ static void migration_bitmap_sync_precopy(RAMState *rs)
         local_err = NULL;
     }
 
-    migration_bitmap_sync(rs);
+    migration_bitmap_sync(rs, incremental);
 
     if (precopy_notify(PRECOPY_NOTIFY_AFTER_BITMAP_SYNC, &local_err)) {
         error_report_err(local_err);
@@ -1284,6 +1445,140 @@ static int save_normal_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
     return 1;
 }
 
+static DedupIndex *dedup_index_new(uint32_t entries)
+{
+    DedupIndex *idx = g_new0(DedupIndex, 1);
+
+    entries = pow2floor(MAX(entries, 1));
+    idx->entries = g_new0(DedupEntry, entries);
+    idx->by_page = g_new0(uint32_t, entries);
+    idx->mask = entries - 1;
+    return idx;
+}
+
+static void dedup_index_free(DedupIndex *idx)
+{
+    if (idx) {
+        g_free(idx->entries);
+        g_free(idx->by_page);
+        g_free(idx);
+    }
+}
+
+static uint32_t dedup_page_slot(DedupIndex *idx, RAMBlock *block,
+                                ram_addr_t offset)
+{
+    return ((block->offset + offset) >> TARGET_PAGE_BITS) & idx->mask;
+}
+
+static uint32_t dedup_hash_slot(DedupIndex *idx, const uint8_t *hash)
+{
+    return ldl_he_p(hash) & idx->mask;
+}
+
+static void dedup_drop(DedupIndex *idx, uint32_t e)
+{
+    DedupEntry *de = &idx->entries[e];
+    uint32_t slot;
+
+    if (!de->block) {
+        return;
+    }
+    slot = dedup_page_slot(idx, de->block, de->offset);
+    if (idx->by_page[slot] == e + 1) {
+        idx->by_page[slot] = 0;
+    }
+    de->block = NULL;
+}
+
+/* The page is being sent again, the destination will not keep it as is */
+static void dedup_forget(DedupIndex *idx, RAMBlock *block, ram_addr_t offset)
+{
+    uint32_t e = idx->by_page[dedup_page_slot(idx, block, offset)];
+
+    if (e && idx->entries[e - 1].block == block &&
+        idx->entries[e - 1].offset == offset) {
+        dedup_drop(idx, e - 1);
+    }
+}
+
+static void dedup_insert(DedupIndex *idx, const uint8_t *hash,
+                         RAMBlock *block, ram_addr_t offset)
+{
+    uint32_t e = dedup_hash_slot(idx, hash);
+    uint32_t slot = dedup_page_slot(idx, block, offset);
+    DedupEntry *de = &idx->entries[e];
+
+    dedup_drop(idx, e);
+    if (idx->by_page[slot]) {
+        dedup_drop(idx, idx->by_page[slot] - 1);
+    }
+    memcpy(de->hash, hash, DEDUP_HASH_LEN);
+    de->block = block;
+    de->offset = offset;
+    de->sync = ram_counters.dirty_sync_count;
+    idx->by_page[slot] = e + 1;
+}
+
+static bool dedup_hash(RAMBlock *block, ram_addr_t offset, uint8_t *hash)
+{
+    size_t len = DEDUP_HASH_LEN;
+
+    return qcrypto_hash_bytes(QCRYPTO_HASH_ALG_SHA256,
+                              (const char *)block->host + offset,
+                              TARGET_PAGE_SIZE, &hash, &len, NULL) == 0;
+}
+
+/*
+ * Find a page that the destination holds with content @hash.  The page
+ * was hashed from guest memory, possibly while the guest or a multifd
+ * thread was still at it, so that it only matches once a bitmap sync
+ * found it clean since.  That sync comes after the multifd sync that
+ * ended the iteration in which it was sent, so the destination has it.
+ */
+static DedupEntry *dedup_find(DedupIndex *idx, const uint8_t *hash)
+{
+    DedupEntry *de = &idx->entries[dedup_hash_slot(idx, hash)];
+
+    if (!de->block || memcmp(de->hash, hash, DEDUP_HASH_LEN) ||
+        de->sync == ram_counters.dirty_sync_count ||
+        test_bit(de->offset >> TARGET_PAGE_BITS, de->block->bmap)) {
+        return NULL;
+    }
+    return de;
+}
+
+/**
+ * save_dedup_page: send the page as a reference to an identical page
+ *
+ * Returns the number of pages written, or -1 if the destination holds no
+ * identical page.
+ *
+ * @rs: current RAM state
+ * @block: block that contains the page we want to send
+ * @offset: offset inside the block for the page
+ * @hash: hash of the page
+ */
+static int save_dedup_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
+                           const uint8_t *hash)
+{
+    DedupEntry *de = dedup_find(rs->dedup, hash);
+    size_t len;
+
+    if (!de) {
+        return -1;
+    }
+
+    len = save_page_header(rs, rs->f, block, offset | RAM_SAVE_FLAG_DEDUP);
+    /* The reference is another page header, without flags */
+    len += save_page_header(rs, rs->f, de->block, de->offset);
+    trace_save_dedup_page(block->idstr, offset, de->block->idstr, de->offset);
+
+    ram_counters.deduplicated++;
+    ram_counters.transferred += len;
+    return 1;
+}
+
 /**
  * ram_save_page: send the given page to the stream
  *
@@ -1479,6 +1774,7 @@ retry:
  */
 static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
 {
+    ramblock_sync_dirty_log(rs, pss->block);
     pss->page = migration_bitmap_find_dirty(rs, pss->block, pss->page);
     if (pss->complete_round && pss->block == rs->last_seen_block &&
         pss->page >= rs->last_page) {
@@ -1514,10 +1810,17 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
             if (migrate_use_xbzrle()) {
                 rs->xbzrle_enabled = true;
             }
+            /* The cold pages are sent, now the hot ones */
+            rs->send_hot = true;
         }
         /* Didn't find anything this time, but try again on the new block */
         *again = true;
         return false;
+    } else if (ramblock_page_is_hot(rs, pss->block, pss->page)) {
+        /* Skip the region, which the next scan will send */
+        pss->page = ROUND_UP(pss->page + 1, 1UL << DIRTY_HEAT_SHIFT);
+        *again = true;
+        return false;
     } else {
         /* Can go around again, but... */
         *again = true;
@@ -1539,15 +1842,16 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
 static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 {
     RAMBlock *block = NULL;
+    struct RAMSrcPageRequest *entry;
 
-    if (QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests)) {
+    if (QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests) &&
+        QSIMPLEQ_EMPTY_ATOMIC(&rs->src_prefetch_requests)) {
         return NULL;
     }
 
     QEMU_LOCK_GUARD(&rs->src_page_req_mutex);
     if (!QSIMPLEQ_EMPTY(&rs->src_page_requests)) {
-        struct RAMSrcPageRequest *entry =
-                                QSIMPLEQ_FIRST(&rs->src_page_requests);
+        entry = QSIMPLEQ_FIRST(&rs->src_page_requests);
         block = entry->rb;
         *offset = entry->offset;
 
@@ -1560,6 +1864,20 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
             g_free(entry);
             migration_consume_urgent_request();
         }
+    } else if (!QSIMPLEQ_EMPTY(&rs->src_prefetch_requests)) {
+        entry = QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
+        block = entry->rb;
+        *offset = entry->offset;
+
+        if (entry->len > TARGET_PAGE_SIZE) {
+            entry->len -= TARGET_PAGE_SIZE;
+            entry->offset += TARGET_PAGE_SIZE;
+        } else {
+            memory_region_unref(block->mr);
+            QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+            g_free(entry);
+            rs->src_prefetch_count--;
+        }
     }
 
     return block;
@@ -2008,6 +2326,13 @@ static void migration_page_queue_free(RAMState *rs)
         QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
         g_free(mspr);
     }
+    QSIMPLEQ_FOREACH_SAFE(mspr, &rs->src_prefetch_requests, next_req,
+                          next_mspr) {
+        memory_region_unref(mspr->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(mspr);
+    }
+    rs->src_prefetch_count = 0;
 }
 
 /**
@@ -2075,6 +2400,63 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
     return 0;
 }
 
+/**
+ * ram_save_queue_prefetch: queue pages that the destination predicts
+ *
+ * A request from the postcopy destination with the postcopy-prefetch
+ * capability.  Such pages are sent when no ram_save_queue_pages()
+ * request is waiting, and the oldest are dropped once there are more
+ * than RAM_PREFETCH_QUEUE_MAX requests, as the least likely to still
+ * be useful.
+ *
+ * Returns zero on success or negative on error
+ *
+ * @rbname: Name of the RAMBLock of the request
+ * @start: starting address from the start of the RAMBlock
+ * @len: length (in bytes) to send
+ */
+int ram_save_queue_prefetch(const char *rbname, ram_addr_t start,
+                            ram_addr_t len)
+{
+    struct RAMSrcPageRequest *entry;
+    RAMBlock *ramblock;
+    RAMState *rs = ram_state;
+
+    RCU_READ_LOCK_GUARD();
+
+    /* Unlike ram_save_queue_pages(), this leaves last_req_rb alone */
+    ramblock = qemu_ram_block_by_name(rbname);
+    if (!ramblock) {
+        error_report("%s no block '%s'", __func__, rbname);
+        return -1;
+    }
+    trace_ram_save_queue_prefetch(ramblock->idstr, start, len);
+    if (!offset_in_ramblock(ramblock, start + len - 1)) {
+        error_report("%s request overrun start=" RAM_ADDR_FMT " len="
+                     RAM_ADDR_FMT " blocklen=" RAM_ADDR_FMT,
+                     __func__, start, len, ramblock->used_length);
+        return -1;
+    }
+
+    entry = g_new0(struct RAMSrcPageRequest, 1);
+    entry->rb = ramblock;
+    entry->offset = start;
+    entry->len = len;
+
+    memory_region_ref(ramblock->mr);
+    QEMU_LOCK_GUARD(&rs->src_page_req_mutex);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_prefetch_requests, entry, next_req);
+    if (++rs->src_prefetch_count > RAM_PREFETCH_QUEUE_MAX) {
+        entry = QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
+        memory_region_unref(entry->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(entry);
+        rs->src_prefetch_count--;
+    }
+
+    return 0;
+}
+
 static bool save_page_use_compression(RAMState *rs)
 {
     if (!migrate_use_compression()) {
@@ -2141,8 +2523,14 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    uint8_t hash[DEDUP_HASH_LEN];
+    bool hashed = false;
     int res;
 
+    if (rs->dedup) {
+        dedup_forget(rs->dedup, block, offset);
+    }
+
     if (control_save_page(rs, block, offset, &res)) {
         return res;
     }
@@ -2165,6 +2553,16 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return res;
     }
 
+    /* The destination is running in postcopy */
+    if (rs->dedup && !migration_in_postcopy() &&
+        dedup_hash(block, offset, hash)) {
+        res = save_dedup_page(rs, block, offset, hash);
+        if (res > 0) {
+            return res;
+        }
+        hashed = true;
+    }
+
     /*
      * Do not use multifd for:
      * 1. Compression as the first page in the new block should be posted out
@@ -2173,10 +2571,15 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
      */
     if (!save_page_use_compression(rs) && migrate_use_multifd()
         && !migration_in_postcopy()) {
-        return ram_save_multifd_page(rs, block, offset);
+        res = ram_save_multifd_page(rs, block, offset);
+    } else {
+        res = ram_save_page(rs, pss, last_stage);
     }
 
-    return ram_save_page(rs, pss, last_stage);
+    if (hashed && res > 0) {
+        dedup_insert(rs->dedup, hash, block, offset);
+    }
+    return res;
 }
 
 /**
@@ -2271,6 +2674,10 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
     pss.page = rs->last_page;
     pss.complete_round = false;
 
+    if (last_stage) {
+        rs->send_hot = true;
+    }
+
     if (!pss.block) {
         pss.block = QLIST_FIRST_RCU(&ram_list.blocks);
     }
@@ -2347,6 +2754,7 @@ static void ram_state_cleanup(RAMState **rsp)
 {
     if (*rsp) {
         migration_page_queue_free(*rsp);
+        dedup_index_free((*rsp)->dedup);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
         g_free(*rsp);
@@ -2395,6 +2803,8 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->dirty_heat);
+        block->dirty_heat = NULL;
     }
 
     xbzrle_cleanup();
@@ -2661,7 +3071,7 @@ int ram_postcopy_send_discard_bitmap(MigrationState *ms)
     RCU_READ_LOCK_GUARD();
 
     /* This should be our last sync, the src is now paused */
-    migration_bitmap_sync(rs);
+    migration_bitmap_sync(rs, false);
 
     /* Easiest way to make sure we don't resume in the middle of a host-page */
     rs->last_seen_block = NULL;
@@ -2788,6 +3198,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    QSIMPLEQ_INIT(&(*rsp)->src_prefetch_requests);
 
     /*
      * Count the total number of pages used by ram blocks not including any
@@ -2797,6 +3208,11 @@ static int ram_state_init(RAMState **rsp)
     (*rsp)->migration_dirty_pages = ram_bytes_total() >> TARGET_PAGE_BITS;
     ram_state_reset(*rsp);
 
+    if (migrate_use_dedup()) {
+        (*rsp)->dedup =
+            dedup_index_new(migrate_get_current()->dedup_index_entries);
+    }
+
     return 0;
 }
 
@@ -2835,6 +3251,11 @@ static void ram_list_init_bitmaps(void)
             bitmap_set(block->bmap, 0, pages);
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
+            if (migrate_hot_pages_last()) {
+                unsigned long regions = DIV_ROUND_UP(pages,
+                                                     1UL << DIRTY_HEAT_SHIFT);
+                block->dirty_heat = g_new0(uint8_t, regions);
+            }
         }
     }
 }
@@ -2863,7 +3284,7 @@ static void ram_init_bitmaps(RAMState *rs)
         /* We don't use dirty log with background snapshots */
         if (!migrate_background_snapshot()) {
             memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION);
-            migration_bitmap_sync_precopy(rs);
+            migration_bitmap_sync_precopy(rs, false);
         }
     }
     qemu_mutex_unlock_ramlist();
@@ -2993,6 +3414,16 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     RAMState **rsp = opaque;
     RAMBlock *block;
 
+    if (migrate_local_ram()) {
+        QIOChannel *ioc = qemu_file_get_ioc(f);
+
+        if (!ioc ||
+            !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS)) {
+            error_report("local-ram requires a migration over a UNIX socket");
+            return -1;
+        }
+    }
+
     if (compress_threads_save_setup()) {
         return -1;
     }
@@ -3020,6 +3451,15 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_local_ram()) {
+                qemu_put_byte(f, ramblock_is_local(block));
+                if (ramblock_is_local(block) &&
+                    qemu_file_put_fd(f, block->fd) < 0) {
+                    error_report("Failed to pass the memory of block %s",
+                                 block->idstr);
+                    return -1;
+                }
+            }
         }
     }
 
@@ -3167,7 +3607,7 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
 
     WITH_RCU_READ_LOCK_GUARD() {
         if (!migration_in_postcopy()) {
-            migration_bitmap_sync_precopy(rs);
+            migration_bitmap_sync_precopy(rs, false);
         }
 
         ram_control_before_iterate(f, RAM_CONTROL_FINISH);
@@ -3210,17 +3650,29 @@ static void ram_save_pending(QEMUFile *f, void *opaque, uint64_t max_size,
     RAMState **temp = opaque;
     RAMState *rs = *temp;
     uint64_t remaining_size;
+    bool sync_fresh = rs->sync_fresh;
 
     remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
+    rs->sync_fresh = false;
 
+    /*
+     * An incremental-dirty-sync pass counts as a sync once all of RAM
+     * took in the dirty log; until then, keep iterating.
+     */
     if (!migration_in_postcopy() &&
-        remaining_size < max_size) {
-        qemu_mutex_lock_iothread();
-        WITH_RCU_READ_LOCK_GUARD() {
-            migration_bitmap_sync_precopy(rs);
+        remaining_size < max_size && !sync_fresh) {
+        if (!rs->unsynced_blocks) {
+            qemu_mutex_lock_iothread();
+            WITH_RCU_READ_LOCK_GUARD() {
+                migration_bitmap_sync_precopy(rs,
+                                              migrate_incremental_dirty_sync());
+            }
+            qemu_mutex_unlock_iothread();
+            remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
+        }
+        if (rs->unsynced_blocks) {
+            remaining_size = MAX(remaining_size, max_size);
         }
-        qemu_mutex_unlock_iothread();
-        remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
     }
 
     if (migrate_postcopy_ram()) {
@@ -3317,6 +3769,30 @@ static inline void *host_from_ram_block_offset(RAMBlock *block,
     return block->host + offset;
 }
 
+/* Copy to @host the page that a RAM_SAVE_FLAG_DEDUP page refers to */
+static int load_dedup(QEMUFile *f, void *host)
+{
+    ram_addr_t addr = qemu_get_be64(f);
+    int flags = addr & ~TARGET_PAGE_MASK;
+    RAMBlock *block = NULL;
+    void *src = NULL;
+
+    addr &= TARGET_PAGE_MASK;
+    if (!(flags & ~RAM_SAVE_FLAG_CONTINUE)) {
+        block = ram_block_from_stream(f, flags);
+    }
+    if (block) {
+        src = host_from_ram_block_offset(block, addr);
+    }
+    if (!src) {
+        error_report("Illegal RAM offset " RAM_ADDR_FMT
+                     " for a deduplicated page", addr);
+        return -EINVAL;
+    }
+    memcpy(host, src, TARGET_PAGE_SIZE);
+    return 0;
+}
+
 static void *host_page_from_ram_block_offset(RAMBlock *block,
                                              ram_addr_t offset)
 {
@@ -3957,6 +4433,40 @@ void colo_flush_ram_cache(void)
     qemu_mutex_unlock(&ram_state->bitmap_mutex);
 }
 
+/**
+ * ram_load_local_block: map the memory that the source passed for a block
+ *
+ * With the local-ram capability, the source passes the file descriptor
+ * of the shared memory of @block, which replaces our own.
+ *
+ * Returns 0 for success or -errno in case of error
+ *
+ * @f: QEMUFile where to receive the data
+ * @block: RAM block whose memory is passed
+ */
+static int ram_load_local_block(QEMUFile *f, RAMBlock *block)
+{
+    Error *local_err = NULL;
+    int fd = qemu_file_get_fd(f);
+
+    if (fd < 0) {
+        error_report("Missing the memory of block %s", block->idstr);
+        return fd;
+    }
+    if (!ramblock_is_local(block)) {
+        error_report("Block %s is not backed by shared memory here",
+                     block->idstr);
+        close(fd);
+        return -EINVAL;
+    }
+    if (qemu_ram_replace_fd(block, fd, &local_err)) {
+        error_report_err(local_err);
+        return -EINVAL;
+    }
+    trace_ram_load_local_block(block->idstr);
+    return 0;
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -4006,7 +4516,8 @@ static int ram_load_precopy(QEMUFile *f)
         }
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
-                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
+                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE |
+                     RAM_SAVE_FLAG_DEDUP)) {
             RAMBlock *block = ram_block_from_stream(f, flags);
 
             host = host_from_ram_block_offset(block, addr);
@@ -4096,6 +4607,9 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (migrate_local_ram() && qemu_get_byte(f) && !ret) {
+                        ret = ram_load_local_block(f, block);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -4135,6 +4649,9 @@ static int ram_load_precopy(QEMUFile *f)
                 break;
             }
             break;
+        case RAM_SAVE_FLAG_DEDUP:
+            ret = load_dedup(f, host);
+            break;
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
             multifd_recv_sync_main();
@@ -39,6 +39,7 @@
 #include "qemu-file-channel.h"
 #include "qemu-file.h"
 #include "savevm.h"
+#include "snapshot-ram.h"
 #include "postcopy-ram.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-migration.h"
@@ -130,14 +131,21 @@ static struct mig_cmd_args {
 /***********************************************************/
 /* savevm/loadvm support */
 
+/* The VM state of a block device, from @base on */
+typedef struct BdrvVMStateFile {
+    BlockDriverState *bs;
+    int64_t base;
+} BdrvVMStateFile;
+
 static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
                                    int64_t pos, Error **errp)
 {
+    BdrvVMStateFile *vf = opaque;
     int ret;
     QEMUIOVector qiov;
 
     qemu_iovec_init_external(&qiov, iov, iovcnt);
-    ret = bdrv_writev_vmstate(opaque, &qiov, pos);
+    ret = bdrv_writev_vmstate(vf->bs, &qiov, vf->base + pos);
     if (ret < 0) {
         return ret;
     }
@@ -148,12 +156,18 @@ static ssize_t block_writev_buffer(void *opaque, struct iovec *iov, int iovcnt,
 static ssize_t block_get_buffer(void *opaque, uint8_t *buf, int64_t pos,
                                 size_t size, Error **errp)
 {
-    return bdrv_load_vmstate(opaque, buf, pos, size);
+    BdrvVMStateFile *vf = opaque;
+
+    return bdrv_load_vmstate(vf->bs, buf, vf->base + pos, size);
 }
 
 static int bdrv_fclose(void *opaque, Error **errp)
 {
-    return bdrv_flush(opaque);
+    BdrvVMStateFile *vf = opaque;
+    int ret = bdrv_flush(vf->bs);
+
+    g_free(vf);
+    return ret;
 }
 
 static const QEMUFileOps bdrv_read_ops = {
@@ -166,12 +180,17 @@ static const QEMUFileOps bdrv_write_ops = {
     .close          = bdrv_fclose
 };
 
-static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable)
+static QEMUFile *qemu_fopen_bdrv(BlockDriverState *bs, int is_writable,
+                                 int64_t base)
 {
+    BdrvVMStateFile *vf = g_new(BdrvVMStateFile, 1);
+
+    vf->bs = bs;
+    vf->base = base;
     if (is_writable) {
-        return qemu_fopen_ops(bs, &bdrv_write_ops, false);
+        return qemu_fopen_ops(vf, &bdrv_write_ops, false);
     }
-    return qemu_fopen_ops(bs, &bdrv_read_ops, false);
+    return qemu_fopen_ops(vf, &bdrv_read_ops, false);
 }
 
 
@@ -249,6 +268,10 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    /* Bytes and time of the section in the last completion or load */
+    uint64_t stats_bytes;
+    int64_t stats_ns;
+    bool stats_valid;
 } SaveStateEntry;
 
 typedef struct SaveState {
@@ -902,9 +925,175 @@ void vmstate_unregister(VMStateIf *obj, const VMStateDescription *vmsd,
     }
 }
 
+/*
+ * With the parallel-device-load capability, the post_load hooks of the
+ * sections that set post_load_independent run on a pool of threads,
+ * while the next sections load.  Any other section, command or the end
+ * of the stream waits for them first.
+ */
+typedef struct LoadvmPostLoad {
+    SaveStateEntry *se;
+    int version_id;
+    QSIMPLEQ_ENTRY(LoadvmPostLoad) next;
+} LoadvmPostLoad;
+
+static struct {
+    QemuThread *threads;
+    int nr_threads;
+    QemuMutex lock;
+    /* Signalled when a hook is queued, or the threads must quit */
+    QemuCond work_cond;
+    /* Signalled when no hook is pending anymore */
+    QemuCond done_cond;
+    QSIMPLEQ_HEAD(, LoadvmPostLoad) queue;
+    /* Hooks queued or running */
+    unsigned int pending;
+    /* Error of the first hook that failed since the last wait */
+    int ret;
+    bool quit;
+} loadvm_post_load;
+
+static void *loadvm_post_load_thread(void *opaque)
+{
+    rcu_register_thread();
+
+    qemu_mutex_lock(&loadvm_post_load.lock);
+    while (true) {
+        LoadvmPostLoad *work;
+        SaveStateEntry *se;
+        int ret;
+
+        while (QSIMPLEQ_EMPTY(&loadvm_post_load.queue) &&
+               !loadvm_post_load.quit) {
+            qemu_cond_wait(&loadvm_post_load.work_cond,
+                           &loadvm_post_load.lock);
+        }
+        work = QSIMPLEQ_FIRST(&loadvm_post_load.queue);
+        if (!work) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&loadvm_post_load.queue, next);
+        qemu_mutex_unlock(&loadvm_post_load.lock);
+
+        se = work->se;
+        ret = se->vmsd->post_load(se->opaque, work->version_id);
+        trace_loadvm_post_load_parallel(se->idstr, ret);
+        if (ret) {
+            error_report("error while loading state for instance 0x%"PRIx32
+                         " of device '%s'", se->instance_id, se->idstr);
+        }
+        g_free(work);
+
+        qemu_mutex_lock(&loadvm_post_load.lock);
+        if (ret && !loadvm_post_load.ret) {
+            loadvm_post_load.ret = ret;
+        }
+        if (!--loadvm_post_load.pending) {
+            qemu_cond_broadcast(&loadvm_post_load.done_cond);
+        }
+    }
+    qemu_mutex_unlock(&loadvm_post_load.lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void loadvm_post_load_queue(SaveStateEntry *se)
+{
+    LoadvmPostLoad *work = g_new0(LoadvmPostLoad, 1);
+    int i;
+
+    if (!loadvm_post_load.threads) {
+        loadvm_post_load.nr_threads =
+            MAX(migrate_get_current()->parallel_device_load_threads, 1);
+        qemu_mutex_init(&loadvm_post_load.lock);
+        qemu_cond_init(&loadvm_post_load.work_cond);
+        qemu_cond_init(&loadvm_post_load.done_cond);
+        QSIMPLEQ_INIT(&loadvm_post_load.queue);
+        loadvm_post_load.quit = false;
+        loadvm_post_load.threads = g_new0(QemuThread,
+                                          loadvm_post_load.nr_threads);
+        for (i = 0; i < loadvm_post_load.nr_threads; i++) {
+            qemu_thread_create(&loadvm_post_load.threads[i],
+                               "loadvm/post_load", loadvm_post_load_thread,
+                               NULL, QEMU_THREAD_JOINABLE);
+        }
+    }
+
+    work->se = se;
+    work->version_id = se->load_version_id;
+
+    qemu_mutex_lock(&loadvm_post_load.lock);
+    QSIMPLEQ_INSERT_TAIL(&loadvm_post_load.queue, work, next);
+    loadvm_post_load.pending++;
+    qemu_cond_signal(&loadvm_post_load.work_cond);
+    qemu_mutex_unlock(&loadvm_post_load.lock);
+}
+
+/* Returns the first error of the hooks that ran, or 0 */
+static int loadvm_post_load_wait(void)
+{
+    int ret;
+
+    if (!loadvm_post_load.threads) {
+        return 0;
+    }
+
+    qemu_mutex_lock(&loadvm_post_load.lock);
+    while (loadvm_post_load.pending) {
+        qemu_cond_wait(&loadvm_post_load.done_cond, &loadvm_post_load.lock);
+    }
+    ret = loadvm_post_load.ret;
+    loadvm_post_load.ret = 0;
+    qemu_mutex_unlock(&loadvm_post_load.lock);
+
+    return ret;
+}
+
+static void loadvm_post_load_cleanup(void)
+{
+    int i;
+
+    if (!loadvm_post_load.threads) {
+        return;
+    }
+
+    loadvm_post_load_wait();
+    qemu_mutex_lock(&loadvm_post_load.lock);
+    loadvm_post_load.quit = true;
+    qemu_cond_broadcast(&loadvm_post_load.work_cond);
+    qemu_mutex_unlock(&loadvm_post_load.lock);
+
+    for (i = 0; i < loadvm_post_load.nr_threads; i++) {
+        qemu_thread_join(&loadvm_post_load.threads[i]);
+    }
+    g_free(loadvm_post_load.threads);
+    loadvm_post_load.threads = NULL;
+    qemu_cond_destroy(&loadvm_post_load.done_cond);
+    qemu_cond_destroy(&loadvm_post_load.work_cond);
+    qemu_mutex_destroy(&loadvm_post_load.lock);
+}
+
 static int vmstate_load(QEMUFile *f, SaveStateEntry *se)
 {
+    int ret;
+
     trace_vmstate_load(se->idstr, se->vmsd ? se->vmsd->name : "(old)");
+    if (migrate_parallel_device_load() && se->vmsd &&
+        se->vmsd->post_load && se->vmsd->post_load_independent) {
+        ret = vmstate_load_state_no_post_load(f, se->vmsd, se->opaque,
+                                              se->load_version_id);
+        if (!ret) {
+            loadvm_post_load_queue(se);
+        }
+        return ret;
+    }
+
+    /* This section may depend on any device loaded before */
+    ret = loadvm_post_load_wait();
+    if (ret) {
+        return ret;
+    }
     if (!se->vmsd) {         /* Old style */
         return se->ops->load_state(f, se->opaque, se->load_version_id);
     }
@@ -1359,9 +1548,55 @@ void qemu_savevm_state_complete_postcopy(QEMUFile *f)
     qemu_fflush(f);
 }
 
+static void savevm_section_stats_reset(void)
+{
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->stats_bytes = 0;
+        se->stats_ns = 0;
+        se->stats_valid = false;
+    }
+}
+
+/* Account what @f went through since @start_pos at @start_ns to @se */
+static void savevm_section_stats_add(SaveStateEntry *se, QEMUFile *f,
+                                     int64_t start_pos, int64_t start_ns)
+{
+    se->stats_bytes += qemu_ftell_fast(f) - start_pos;
+    se->stats_ns += qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns;
+    se->stats_valid = true;
+}
+
+/*
+ * The sections saved once the guest stopped, or loaded as full or end
+ * sections, by the last migration, in stream order.
+ */
+MigrationSectionStatsList *qemu_savevm_section_stats(void)
+{
+    MigrationSectionStatsList *head = NULL, **tail = &head;
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        MigrationSectionStats *stats;
+
+        if (!se->stats_valid) {
+            continue;
+        }
+        stats = g_new0(MigrationSectionStats, 1);
+        stats->name = g_strdup(se->idstr);
+        stats->instance_id = se->instance_id;
+        stats->bytes = se->stats_bytes;
+        stats->time = se->stats_ns / SCALE_US;
+        QAPI_LIST_APPEND(tail, stats);
+    }
+    return head;
+}
+
 static
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
+    int64_t start_pos, start_ns;
     SaveStateEntry *se;
     int ret;
 
@@ -1380,11 +1615,14 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
         }
         trace_savevm_section_start(se->idstr, se->section_id);
 
+        start_pos = qemu_ftell_fast(f);
+        start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
         save_section_header(f, se, QEMU_VM_SECTION_END);
 
         ret = se->ops->save_live_complete_precopy(f, se->opaque);
         trace_savevm_section_end(se->idstr, se->section_id, ret);
         save_section_footer(f, se);
+        savevm_section_stats_add(se, f, start_pos, start_ns);
         if (ret < 0) {
             qemu_file_set_error(f, ret);
             return -1;
@@ -1399,6 +1637,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool inactivate_disks)
 {
     g_autoptr(JSONWriter) vmdesc = NULL;
+    int64_t start_pos, start_ns;
     int vmdesc_len;
     SaveStateEntry *se;
     int ret;
@@ -1423,6 +1662,8 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         json_writer_str(vmdesc, "name", se->idstr);
         json_writer_int64(vmdesc, "instance_id", se->instance_id);
 
+        start_pos = qemu_ftell_fast(f);
+        start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
         save_section_header(f, se, QEMU_VM_SECTION_FULL);
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
@@ -1431,6 +1672,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         }
         trace_savevm_section_end(se->idstr, se->section_id, 0);
         save_section_footer(f, se);
+        savevm_section_stats_add(se, f, start_pos, start_ns);
 
         json_writer_end_object(vmdesc);
     }
@@ -1478,6 +1720,7 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     trace_savevm_state_complete_precopy();
 
     cpu_synchronize_all_states();
+    savevm_section_stats_reset();
 
     if (!in_postcopy || iterable_only) {
         ret = qemu_savevm_state_complete_precopy_iterable(f, in_postcopy);
@@ -2381,8 +2624,12 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
 }
 
 static int
-qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
+qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
+                               uint8_t section_type)
 {
+    /* Includes the section type, already read */
+    int64_t start_pos = qemu_ftell_fast(f) - 1;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     uint32_t instance_id, version_id, section_id;
     SaveStateEntry *se;
     char idstr[256];
@@ -2441,13 +2688,20 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
     if (!check_section_footer(f, se)) {
         return -EINVAL;
     }
+    if (section_type == QEMU_VM_SECTION_FULL) {
+        savevm_section_stats_add(se, f, start_pos, start_ns);
+    }
 
     return 0;
 }
 
 static int
-qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis)
+qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis,
+                             uint8_t section_type)
 {
+    /* Includes the section type, already read */
+    int64_t start_pos = qemu_ftell_fast(f) - 1;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     uint32_t section_id;
     SaveStateEntry *se;
     int ret;
@@ -2481,6 +2735,9 @@ qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis)
     if (!check_section_footer(f, se)) {
         return -EINVAL;
     }
+    if (section_type == QEMU_VM_SECTION_END) {
+        savevm_section_stats_add(se, f, start_pos, start_ns);
+    }
 
     return 0;
 }
@@ -2609,6 +2866,7 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
 int qemu_loadvm_state_main(QEMUFile *f, MigrationIncomingState *mis)
 {
     uint8_t section_type;
+    int post_load_ret;
     int ret = 0;
 
 retry:
@@ -2624,19 +2882,24 @@ retry:
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
-            ret = qemu_loadvm_section_start_full(f, mis);
+            ret = qemu_loadvm_section_start_full(f, mis, section_type);
             if (ret < 0) {
                 goto out;
             }
             break;
         case QEMU_VM_SECTION_PART:
         case QEMU_VM_SECTION_END:
-            ret = qemu_loadvm_section_part_end(f, mis);
+            ret = qemu_loadvm_section_part_end(f, mis, section_type);
             if (ret < 0) {
                 goto out;
             }
             break;
         case QEMU_VM_COMMAND:
+            /* Commands may resume the guest, or look at its devices */
+            ret = loadvm_post_load_wait();
+            if (ret < 0) {
+                goto out;
+            }
             ret = loadvm_process_command(f);
             trace_qemu_loadvm_state_section_command(ret);
             if ((ret < 0) || (ret == LOADVM_QUIT)) {
@@ -2654,6 +2917,10 @@ retry:
     }
 
 out:
+    post_load_ret = loadvm_post_load_wait();
+    if (ret >= 0 && post_load_ret < 0) {
+        ret = post_load_ret;
+    }
     if (ret < 0) {
         qemu_file_set_error(f, ret);
 
@@ -2702,8 +2969,10 @@ int qemu_loadvm_state(QEMUFile *f)
     }
 
     cpu_synchronize_all_pre_loadvm();
+    savevm_section_stats_reset();
 
     ret = qemu_loadvm_state_main(f, mis);
+    loadvm_post_load_cleanup();
     qemu_event_set(&mis->main_thread_load_event);
 
     trace_qemu_loadvm_state_post_main(ret);
@@ -2774,6 +3043,70 @@ int qemu_load_device_state(QEMUFile *f)
     return 0;
 }
 
+/*
+ * Guest RAM goes in parallel at the beginning of the VM state, see
+ * snapshot-ram.c, and the device state after it.
+ */
+static int qemu_savevm_state_parallel(BlockDriverState *bs,
+                                      uint64_t *vm_state_size, Error **errp)
+{
+    MigrationState *ms = migrate_get_current();
+    int64_t base;
+    QEMUFile *f;
+    int ret, ret2;
+
+    if (migration_is_running(ms->state)) {
+        error_setg(errp, QERR_MIGRATION_ACTIVE);
+        return -EINVAL;
+    }
+
+    ret = snapshot_ram_save(bs, &base, errp);
+    if (ret < 0) {
+        return ret;
+    }
+    f = qemu_fopen_bdrv(bs, 1, base);
+    ret = qemu_save_device_state(f);
+    *vm_state_size = base + qemu_ftell(f);
+    ret2 = qemu_fclose(f);
+    if (ret == 0) {
+        ret = ret2;
+    }
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Error while writing VM state");
+    }
+    return ret;
+}
+
+static int qemu_loadvm_state_parallel(BlockDriverState *bs,
+                                      MigrationIncomingState *mis)
+{
+    Error *local_err = NULL;
+    int64_t base;
+    QEMUFile *f;
+    int ret;
+
+    if (qemu_savevm_state_blocked(&local_err)) {
+        error_report_err(local_err);
+        return -EINVAL;
+    }
+
+    cpu_synchronize_all_pre_loadvm();
+    ret = snapshot_ram_load(bs, &base, &local_err);
+    if (ret < 0) {
+        error_report_err(local_err);
+        return ret;
+    }
+
+    f = qemu_fopen_bdrv(bs, 0, base);
+    mis->from_src_file = f;
+    if (qemu_get_be32(f) != QEMU_VM_FILE_MAGIC ||
+        qemu_get_be32(f) != QEMU_VM_FILE_VERSION) {
+        error_report("Unexpected device state in the snapshot");
+        return -EINVAL;
+    }
+    return qemu_load_device_state(f);
+}
+
 bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
                   bool has_devices, strList *devices, Error **errp)
 {
@@ -2860,20 +3193,27 @@ bool save_snapshot(const char *name, bool overwrite, const char *vmstate,
     }
 
     /* save the VM state */
-    f = qemu_fopen_bdrv(bs, 1);
-    if (!f) {
-        error_setg(errp, "Could not open VM state file");
-        goto the_end;
-    }
-    ret = qemu_savevm_state(f, errp);
-    vm_state_size = qemu_ftell(f);
-    ret2 = qemu_fclose(f);
-    if (ret < 0) {
-        goto the_end;
-    }
-    if (ret2 < 0) {
-        ret = ret2;
-        goto the_end;
+    if (migrate_parallel_snapshot()) {
+        ret = qemu_savevm_state_parallel(bs, &vm_state_size, errp);
+        if (ret < 0) {
+            goto the_end;
+        }
+    } else {
+        f = qemu_fopen_bdrv(bs, 1, 0);
+        if (!f) {
+            error_setg(errp, "Could not open VM state file");
+            goto the_end;
+        }
+        ret = qemu_savevm_state(f, errp);
+        vm_state_size = qemu_ftell(f);
+        ret2 = qemu_fclose(f);
+        if (ret < 0) {
+            goto the_end;
+        }
+        if (ret2 < 0) {
+            ret = ret2;
+            goto the_end;
+        }
     }
 
     /* The bdrv_all_create_snapshot() call that follows acquires the AioContext
@@ -3044,21 +3384,20 @@ bool load_snapshot(const char *name, const char *vmstate,
     }
 
     /* restore the VM state */
-    f = qemu_fopen_bdrv(bs_vm_state, 0);
-    if (!f) {
-        error_setg(errp, "Could not open VM state file");
-        goto err_drain;
-    }
-
     qemu_system_reset(SHUTDOWN_CAUSE_NONE);
-    mis->from_src_file = f;
 
     if (!yank_register_instance(MIGRATION_YANK_INSTANCE, errp)) {
         ret = -EINVAL;
         goto err_drain;
     }
     aio_context_acquire(aio_context);
-    ret = qemu_loadvm_state(f);
+    if (snapshot_ram_present(bs_vm_state)) {
+        ret = qemu_loadvm_state_parallel(bs_vm_state, mis);
+    } else {
+        f = qemu_fopen_bdrv(bs_vm_state, 0, 0);
+        mis->from_src_file = f;
+        ret = qemu_loadvm_state(f);
+    }
     migration_incoming_state_destroy();
     aio_context_release(aio_context);
 
@@ -0,0 +1,774 @@
+/*
+ * Guest RAM of a snapshot, written and read in parallel
+ *
+ * The savevm stream goes through one QEMUFile, and ram_save_page()
+ * handles guest RAM one target page at a time, so taking a snapshot of
+ * a large guest keeps one host CPU busy for a long time.  With the
+ * parallel-snapshot capability, RAM is instead stored as an image of
+ * each RAM block at a fixed place in the VM state, ahead of the
+ * device state:
+ *
+ *   header | bitmaps | RAM block 0 | RAM block 1 | ... | device state
+ *
+ * Each RAM block is split in chunks, and the bitmap of the block tells
+ * which chunks hold data; the others are zero and are not written.
+ * multifd-channels threads look for the zero chunks, and as many
+ * coroutines write the other chunks concurrently, straight from guest
+ * memory.  Loading does the same in reverse, clearing the zero chunks
+ * from threads while coroutines read the others into guest memory.
+ *
+ * The RAM blocks can also go to a file of their own, named by the
+ * x-snapshot-ram-file property of the migration object, which the
+ * threads then read and write directly.  The VM state keeps the header,
+ * with the name and UUID of the file.  Only such a snapshot can be
+ * loaded lazily, see below.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "block/block.h"
+#include "exec/cpu-common.h"
+#include "exec/ramblock.h"
+#include "qemu/bitmap.h"
+#include "qemu/coroutine.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "qemu/uuid.h"
+#include "migration.h"
+#include "ram.h"
+#include "snapshot-ram.h"
+#include "trace.h"
+
+#if defined(__linux__)
+#include "qemu/userfaultfd.h"
+#endif /* defined(__linux__) */
+
+/* Alignment of the RAM blocks and of the device state */
+#define SNAPSHOT_RAM_ALIGN      (1 * MiB)
+/* Largest I/O request of a coroutine */
+#define SNAPSHOT_RAM_IO_MAX     (8 * MiB)
+
+typedef struct SnapshotRAMBlock {
+    RAMBlock *rb;
+    uint64_t length;
+    uint64_t offset;            /* in the VM state or the RAM file */
+    uint64_t first_chunk;
+    uint64_t nr_chunks;
+    unsigned long *bitmap;      /* chunks that are not zero */
+} SnapshotRAMBlock;
+
+typedef struct SnapshotRAM {
+    BlockDriverState *bs;
+    bool load;
+    GArray *blocks;             /* of SnapshotRAMBlock */
+    uint64_t nr_chunks;
+    uint64_t header_size;
+    uint64_t end;
+
+    /* RAM file, or -1 if the RAM blocks are in the VM state */
+    int fd;
+    char *file;
+    QemuUUID uuid;
+
+    unsigned long next_chunk;   /* next chunk for a thread or coroutine */
+    int active;                 /* coroutines still running */
+    int ret;
+} SnapshotRAM;
+
+static void snapshot_ram_free(SnapshotRAM *s)
+{
+    guint i;
+
+    for (i = 0; i < s->blocks->len; i++) {
+        g_free(g_array_index(s->blocks, SnapshotRAMBlock, i).bitmap);
+    }
+    g_array_free(s->blocks, true);
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+    g_free(s->file);
+}
+
+static void snapshot_ram_add_block(SnapshotRAM *s, RAMBlock *rb,
+                                   uint64_t length)
+{
+    SnapshotRAMBlock b = {
+        .rb = rb,
+        .length = length,
+        .first_chunk = s->nr_chunks,
+        .nr_chunks = DIV_ROUND_UP(length, SNAPSHOT_RAM_CHUNK),
+    };
+
+    b.bitmap = bitmap_new(b.nr_chunks);
+    s->nr_chunks += b.nr_chunks;
+    g_array_append_val(s->blocks, b);
+}
+
+/* Size of the bitmap of @b in the VM state */
+static size_t snapshot_ram_bitmap_size(SnapshotRAMBlock *b)
+{
+    return BITS_TO_LONGS(b->nr_chunks) * sizeof(unsigned long);
+}
+
+/* Place the bitmaps, the RAM blocks and the device state */
+static void snapshot_ram_layout(SnapshotRAM *s, uint64_t header_size)
+{
+    uint64_t offset;
+    guint i;
+
+    for (i = 0; i < s->blocks->len; i++) {
+        header_size += snapshot_ram_bitmap_size(
+            &g_array_index(s->blocks, SnapshotRAMBlock, i));
+    }
+    s->header_size = header_size;
+
+    /* The RAM file starts with its own header */
+    offset = s->fd >= 0 ? SNAPSHOT_RAM_ALIGN
+                        : ROUND_UP(header_size, SNAPSHOT_RAM_ALIGN);
+    for (i = 0; i < s->blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s->blocks, SnapshotRAMBlock, i);
+
+        b->offset = offset;
+        offset = ROUND_UP(offset + b->length, SNAPSHOT_RAM_ALIGN);
+    }
+    s->end = s->fd >= 0 ? ROUND_UP(header_size, SNAPSHOT_RAM_ALIGN) : offset;
+}
+
+static SnapshotRAMBlock *snapshot_ram_find_chunk(SnapshotRAM *s,
+                                                 uint64_t chunk)
+{
+    guint i;
+
+    for (i = 0; i < s->blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s->blocks, SnapshotRAMBlock, i);
+
+        if (chunk < b->first_chunk + b->nr_chunks) {
+            return b;
+        }
+    }
+    g_assert_not_reached();
+}
+
+static void snapshot_ram_set_error(SnapshotRAM *s, int ret)
+{
+    qatomic_cmpxchg(&s->ret, 0, ret);
+}
+
+/*
+ * Threads: when saving, find the chunks that hold data; when loading,
+ * clear those that were zero.  Guest memory that is zero already is
+ * only read, so that untouched guest pages stay unallocated.  With a
+ * RAM file, the threads also write or read the chunks that hold data.
+ */
+static void *snapshot_ram_scan_thread(void *opaque)
+{
+    SnapshotRAM *s = opaque;
+    unsigned long chunk;
+
+    while ((chunk = qatomic_fetch_inc(&s->next_chunk)) < s->nr_chunks) {
+        SnapshotRAMBlock *b = snapshot_ram_find_chunk(s, chunk);
+        uint64_t i = chunk - b->first_chunk;
+        uint64_t offset = i * SNAPSHOT_RAM_CHUNK;
+        uint64_t len = MIN(SNAPSHOT_RAM_CHUNK, b->length - offset);
+        uint8_t *p = b->rb->host + offset;
+
+        if (!s->load) {
+            if (buffer_is_zero(p, len)) {
+                continue;
+            }
+            set_bit_atomic(i, b->bitmap);
+            if (s->fd >= 0 &&
+                pwrite(s->fd, p, len, b->offset + offset) != len) {
+                snapshot_ram_set_error(s, errno ? -errno : -EIO);
+            }
+        } else if (!test_bit(i, b->bitmap)) {
+            if (!buffer_is_zero(p, len)) {
+                memset(p, 0, len);
+            }
+        } else if (s->fd >= 0 &&
+                   pread(s->fd, p, len, b->offset + offset) != len) {
+            snapshot_ram_set_error(s, errno ? -errno : -EIO);
+        }
+    }
+    return NULL;
+}
+
+static int snapshot_ram_scan(SnapshotRAM *s)
+{
+    int n = migrate_multifd_channels();
+    QemuThread *threads = g_new(QemuThread, n);
+    int i;
+
+    s->next_chunk = 0;
+    s->ret = 0;
+    for (i = 0; i < n; i++) {
+        qemu_thread_create(&threads[i], "snapshot ram",
+                           snapshot_ram_scan_thread, s, QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < n; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+    g_free(threads);
+    return s->ret;
+}
+
+/* Coroutines: read or write each run of chunks that hold data */
+static void coroutine_fn snapshot_ram_io_co(void *opaque)
+{
+    SnapshotRAM *s = opaque;
+
+    while (s->ret == 0 && s->next_chunk < s->nr_chunks) {
+        SnapshotRAMBlock *b = snapshot_ram_find_chunk(s, s->next_chunk);
+        uint64_t first, last, offset, len;
+        QEMUIOVector qiov;
+        int ret;
+
+        first = find_next_bit(b->bitmap, b->nr_chunks,
+                              s->next_chunk - b->first_chunk);
+        if (first == b->nr_chunks) {
+            s->next_chunk = b->first_chunk + b->nr_chunks;
+            continue;
+        }
+        last = find_next_zero_bit(b->bitmap,
+                                  MIN(b->nr_chunks,
+                                      first + SNAPSHOT_RAM_IO_MAX /
+                                              SNAPSHOT_RAM_CHUNK),
+                                  first);
+        /* claimed before yielding, so no other coroutine takes it */
+        s->next_chunk = b->first_chunk + last;
+
+        offset = first * SNAPSHOT_RAM_CHUNK;
+        len = MIN(last * SNAPSHOT_RAM_CHUNK, b->length) - offset;
+        qemu_iovec_init_buf(&qiov, b->rb->host + offset, len);
+        if (s->load) {
+            ret = bdrv_readv_vmstate(s->bs, &qiov, b->offset + offset);
+        } else {
+            ret = bdrv_writev_vmstate(s->bs, &qiov, b->offset + offset);
+        }
+        if (ret < 0 && s->ret == 0) {
+            s->ret = ret;
+        }
+    }
+    s->active--;
+}
+
+static int snapshot_ram_io(SnapshotRAM *s)
+{
+    int n = migrate_multifd_channels();
+    int i;
+
+    if (s->fd >= 0) {
+        /* done by the threads */
+        return 0;
+    }
+
+    s->next_chunk = 0;
+    s->active = n;
+    s->ret = 0;
+    for (i = 0; i < n; i++) {
+        bdrv_coroutine_enter(s->bs,
+                             qemu_coroutine_create(snapshot_ram_io_co, s));
+    }
+    BDRV_POLL_WHILE(s->bs, s->active > 0);
+    return s->ret;
+}
+
+/*
+ * Lazy loading
+ *
+ * With the lazy-snapshot-load capability, guest RAM is emptied and
+ * registered with userfaultfd, and loading the snapshot goes on with
+ * the device state right away.  A fault thread fills each chunk the
+ * first time the guest or QEMU touches it, while multifd-channels
+ * prefetch threads fill the others in order.  Everything is read from
+ * the RAM file with pread(): the block layer can only be used from the
+ * main loop, which may itself be waiting for a page.
+ */
+#if defined(__linux__)
+
+enum {
+    CHUNK_MISSING,
+    CHUNK_FILLING,
+    CHUNK_PRESENT,
+};
+
+typedef struct SnapshotRAMLazy {
+    SnapshotRAM s;
+    int uffd;
+    uint8_t *state;             /* CHUNK_* for each chunk */
+    uint64_t present;           /* number of CHUNK_PRESENT chunks */
+    int nr_threads;
+    QemuThread *prefetch;
+    QemuThread fault_thread;
+    int64_t start;
+} SnapshotRAMLazy;
+
+static SnapshotRAMLazy *snapshot_ram_lazy;
+
+/* Called from the fault thread and the prefetch threads */
+static void snapshot_ram_lazy_fill(SnapshotRAMLazy *l, uint64_t chunk,
+                                   uint8_t *buf)
+{
+    SnapshotRAM *s = &l->s;
+    SnapshotRAMBlock *b = snapshot_ram_find_chunk(s, chunk);
+    uint64_t i = chunk - b->first_chunk;
+    uint64_t offset = i * SNAPSHOT_RAM_CHUNK;
+    uint64_t len = MIN(SNAPSHOT_RAM_CHUNK, b->length - offset);
+    uint8_t *p = b->rb->host + offset;
+
+    if (qatomic_cmpxchg(&l->state[chunk], CHUNK_MISSING, CHUNK_FILLING) !=
+        CHUNK_MISSING) {
+        /* whoever fills it wakes up the threads waiting for it */
+        return;
+    }
+
+    if (!test_bit(i, b->bitmap)) {
+        uffd_zero_page(l->uffd, p, len, false);
+    } else if (pread(s->fd, buf, len, b->offset + offset) == len) {
+        uffd_copy_page(l->uffd, p, buf, len, false);
+    } else {
+        error_report("snapshot: could not read guest RAM at 0x%" PRIx64
+                     " of '%s': %s", b->offset + offset, s->file,
+                     strerror(errno));
+        abort();
+    }
+    qatomic_set(&l->state[chunk], CHUNK_PRESENT);
+    qatomic_inc(&l->present);
+}
+
+static void *snapshot_ram_prefetch_thread(void *opaque)
+{
+    SnapshotRAMLazy *l = opaque;
+    g_autofree uint8_t *buf = qemu_memalign(qemu_real_host_page_size,
+                                            SNAPSHOT_RAM_CHUNK);
+    unsigned long chunk;
+
+    while ((chunk = qatomic_fetch_inc(&l->s.next_chunk)) < l->s.nr_chunks) {
+        snapshot_ram_lazy_fill(l, chunk, buf);
+    }
+    return NULL;
+}
+
+static void snapshot_ram_lazy_fault(SnapshotRAMLazy *l, uint64_t addr,
+                                    uint8_t *buf)
+{
+    SnapshotRAM *s = &l->s;
+    uint64_t page = QEMU_ALIGN_DOWN(addr, qemu_real_host_page_size);
+    guint i;
+
+    for (i = 0; i < s->blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s->blocks, SnapshotRAMBlock, i);
+        uintptr_t host = (uintptr_t)b->rb->host;
+
+        if (addr < host || addr >= host + b->length) {
+            continue;
+        }
+        trace_snapshot_ram_lazy_fault(b->rb->idstr, addr - host);
+        if (qatomic_read(&l->state[b->first_chunk +
+                                   (addr - host) / SNAPSHOT_RAM_CHUNK]) ==
+            CHUNK_PRESENT) {
+            /* discarded since, by the balloon for example */
+            uffd_zero_page(l->uffd, (void *)(uintptr_t)page,
+                           qemu_real_host_page_size, false);
+        } else {
+            snapshot_ram_lazy_fill(l, b->first_chunk +
+                                   (addr - host) / SNAPSHOT_RAM_CHUNK, buf);
+        }
+        return;
+    }
+}
+
+static void *snapshot_ram_fault_thread(void *opaque)
+{
+    SnapshotRAMLazy *l = opaque;
+    g_autofree uint8_t *buf = qemu_memalign(qemu_real_host_page_size,
+                                            SNAPSHOT_RAM_CHUNK);
+    struct uffd_msg msgs[16];
+    int i, n;
+
+    while (qatomic_read(&l->present) < l->s.nr_chunks) {
+        if (!uffd_poll_events(l->uffd, 100)) {
+            continue;
+        }
+        n = uffd_read_events(l->uffd, msgs, ARRAY_SIZE(msgs));
+        for (i = 0; i < n; i++) {
+            if (msgs[i].event == UFFD_EVENT_PAGEFAULT) {
+                snapshot_ram_lazy_fault(l, msgs[i].arg.pagefault.address,
+                                        buf);
+            }
+        }
+    }
+
+    for (i = 0; i < l->nr_threads; i++) {
+        qemu_thread_join(&l->prefetch[i]);
+    }
+    for (i = 0; i < (int)l->s.blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(l->s.blocks, SnapshotRAMBlock, i);
+
+        uffd_unregister_memory(l->uffd, b->rb->host, b->length);
+    }
+    uffd_close_fd(l->uffd);
+    trace_snapshot_ram_lazy_done(get_clock() - l->start);
+    return NULL;
+}
+
+/* Wait for the previous lazy load to complete */
+static void snapshot_ram_lazy_wait(void)
+{
+    SnapshotRAMLazy *l = snapshot_ram_lazy;
+
+    if (!l) {
+        return;
+    }
+    qemu_thread_join(&l->fault_thread);
+    snapshot_ram_free(&l->s);
+    g_free(l->state);
+    g_free(l->prefetch);
+    g_free(l);
+    snapshot_ram_lazy = NULL;
+}
+
+/*
+ * Hand @s over to the lazy loading threads.  Returns false, leaving @s
+ * untouched, if the RAM blocks cannot be loaded lazily.
+ */
+static bool snapshot_ram_lazy_start(SnapshotRAM *s)
+{
+    SnapshotRAMLazy *l;
+    uint64_t ioctls, needed = BIT(_UFFDIO_COPY) | BIT(_UFFDIO_ZEROPAGE);
+    int uffd;
+    guint i;
+
+    for (i = 0; i < s->blocks->len; i++) {
+        RAMBlock *rb = g_array_index(s->blocks, SnapshotRAMBlock, i).rb;
+
+        if (rb->page_size != qemu_real_host_page_size) {
+            warn_report("snapshot: RAM block '%s' uses huge pages, "
+                        "loading the snapshot eagerly", rb->idstr);
+            return false;
+        }
+    }
+    uffd = uffd_create_fd(0, true);
+    if (uffd < 0) {
+        warn_report("snapshot: no userfaultfd, loading the snapshot eagerly");
+        return false;
+    }
+
+    for (i = 0; i < s->blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s->blocks, SnapshotRAMBlock, i);
+
+        if (ram_block_discard_range(b->rb, 0, b->length) ||
+            uffd_register_memory(uffd, b->rb->host, b->length,
+                                 UFFDIO_REGISTER_MODE_MISSING, &ioctls) ||
+            (ioctls & needed) != needed) {
+            warn_report("snapshot: cannot register RAM block '%s' with "
+                        "userfaultfd, loading the snapshot eagerly",
+                        b->rb->idstr);
+            /* the blocks that were discarded are loaded again */
+            uffd_close_fd(uffd);
+            return false;
+        }
+    }
+
+    l = g_new0(SnapshotRAMLazy, 1);
+    l->s = *s;
+    l->s.next_chunk = 0;
+    l->uffd = uffd;
+    l->state = g_new0(uint8_t, s->nr_chunks);
+    l->nr_threads = migrate_multifd_channels();
+    l->prefetch = g_new(QemuThread, l->nr_threads);
+    l->start = get_clock();
+    snapshot_ram_lazy = l;
+
+    qemu_thread_create(&l->fault_thread, "snapshot fault",
+                       snapshot_ram_fault_thread, l, QEMU_THREAD_JOINABLE);
+    for (i = 0; i < l->nr_threads; i++) {
+        qemu_thread_create(&l->prefetch[i], "snapshot prefetch",
+                           snapshot_ram_prefetch_thread, l,
+                           QEMU_THREAD_JOINABLE);
+    }
+    return true;
+}
+
+#else /* !defined(__linux__) */
+
+static void snapshot_ram_lazy_wait(void)
+{
+}
+
+static bool snapshot_ram_lazy_start(SnapshotRAM *s)
+{
+    warn_report("snapshot: lazy loading needs userfaultfd, "
+                "loading the snapshot eagerly");
+    return false;
+}
+
+#endif /* defined(__linux__) */
+
+static int snapshot_ram_file_create(SnapshotRAM *s, const char *file,
+                                    Error **errp)
+{
+    SnapshotRAMFileHeader fh;
+
+    s->fd = qemu_create(file, O_WRONLY | O_TRUNC, 0600, errp);
+    if (s->fd < 0) {
+        return -EIO;
+    }
+    s->file = g_strdup(file);
+    qemu_uuid_generate(&s->uuid);
+    memcpy(fh.magic, SNAPSHOT_RAM_FILE_MAGIC, sizeof(fh.magic));
+    fh.uuid = s->uuid;
+    if (pwrite(s->fd, &fh, sizeof(fh), 0) != sizeof(fh)) {
+        error_setg_errno(errp, errno, "could not write '%s'", file);
+        return -EIO;
+    }
+    return 0;
+}
+
+static int snapshot_ram_file_open(SnapshotRAM *s, const char *file,
+                                  const QemuUUID *uuid, Error **errp)
+{
+    SnapshotRAMFileHeader fh;
+
+    s->fd = qemu_open(file, O_RDONLY, errp);
+    if (s->fd < 0) {
+        return -EIO;
+    }
+    s->file = g_strdup(file);
+    if (pread(s->fd, &fh, sizeof(fh), 0) != sizeof(fh) ||
+        memcmp(fh.magic, SNAPSHOT_RAM_FILE_MAGIC, sizeof(fh.magic)) ||
+        !qemu_uuid_is_equal(&fh.uuid, uuid)) {
+        error_setg(errp, "'%s' does not hold the RAM of this snapshot", file);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+int snapshot_ram_save(BlockDriverState *bs, int64_t *end, Error **errp)
+{
+    SnapshotRAM s = { .bs = bs, .fd = -1 };
+    const char *file = migrate_get_current()->snapshot_ram_file;
+    g_autofree uint8_t *header = NULL;
+    SnapshotRAMHeader *h;
+    uint64_t header_size = sizeof(SnapshotRAMHeader);
+    size_t pos;
+    RAMBlock *rb;
+    guint i;
+    int ret;
+
+    /* RAM is read below, and may still be missing */
+    snapshot_ram_lazy_wait();
+
+    s.blocks = g_array_new(false, false, sizeof(SnapshotRAMBlock));
+    if (file) {
+        ret = snapshot_ram_file_create(&s, file, errp);
+        if (ret < 0) {
+            goto out;
+        }
+        header_size += strlen(file);
+    }
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+            snapshot_ram_add_block(&s, rb, rb->used_length);
+            header_size += sizeof(SnapshotRAMHeaderBlock) + strlen(rb->idstr);
+        }
+    }
+    snapshot_ram_layout(&s, header_size);
+
+    ret = snapshot_ram_scan(&s);
+    if (ret == 0) {
+        ret = snapshot_ram_io(&s);
+    }
+    if (ret == 0 && s.fd >= 0 && fdatasync(s.fd)) {
+        ret = -errno;
+    }
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "could not write guest RAM");
+        goto out;
+    }
+
+    header = g_malloc0(s.header_size);
+    h = (SnapshotRAMHeader *)header;
+    memcpy(h->magic, SNAPSHOT_RAM_MAGIC, sizeof(h->magic));
+    h->version = cpu_to_be32(SNAPSHOT_RAM_VERSION);
+    h->nr_blocks = cpu_to_be32(s.blocks->len);
+    h->chunk_size = cpu_to_be64(SNAPSHOT_RAM_CHUNK);
+    h->header_size = cpu_to_be64(s.header_size);
+    h->end = cpu_to_be64(s.end);
+    pos = sizeof(*h);
+    if (file) {
+        h->file_uuid = s.uuid;
+        h->file_len = cpu_to_be16(strlen(file));
+        memcpy(header + pos, file, strlen(file));
+        pos += strlen(file);
+    }
+    for (i = 0; i < s.blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s.blocks, SnapshotRAMBlock, i);
+        SnapshotRAMHeaderBlock *hb = (SnapshotRAMHeaderBlock *)(header + pos);
+
+        hb->length = cpu_to_be64(b->length);
+        hb->offset = cpu_to_be64(b->offset);
+        hb->idlen = strlen(b->rb->idstr);
+        pos += sizeof(*hb);
+        memcpy(header + pos, b->rb->idstr, hb->idlen);
+        pos += hb->idlen;
+    }
+    for (i = 0; i < s.blocks->len; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s.blocks, SnapshotRAMBlock, i);
+
+        bitmap_to_le((unsigned long *)(header + pos), b->bitmap, b->nr_chunks);
+        pos += snapshot_ram_bitmap_size(b);
+    }
+    assert(pos == s.header_size);
+
+    ret = bdrv_save_vmstate(bs, header, 0, s.header_size);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "could not write the RAM header");
+        goto out;
+    }
+    trace_snapshot_ram_save(s.blocks->len, s.end);
+    *end = s.end;
+
+ out:
+    snapshot_ram_free(&s);
+    return ret < 0 ? ret : 0;
+}
+
+bool snapshot_ram_present(BlockDriverState *bs)
+{
+    char magic[8];
+
+    return bdrv_load_vmstate(bs, (uint8_t *)magic, 0, sizeof(magic)) >= 0 &&
+           !memcmp(magic, SNAPSHOT_RAM_MAGIC, sizeof(magic));
+}
+
+int snapshot_ram_load(BlockDriverState *bs, int64_t *end, Error **errp)
+{
+    SnapshotRAM s = { .bs = bs, .load = true, .fd = -1 };
+    g_autofree uint8_t *header = NULL;
+    SnapshotRAMHeader h;
+    uint32_t nr_blocks;
+    size_t size, pos;
+    guint i;
+    int ret;
+
+    /* The threads of the previous load would write over this one */
+    snapshot_ram_lazy_wait();
+
+    s.blocks = g_array_new(false, false, sizeof(SnapshotRAMBlock));
+
+    ret = bdrv_load_vmstate(bs, (uint8_t *)&h, 0, sizeof(h));
+    if (ret < 0) {
+        goto io_error;
+    }
+    nr_blocks = be32_to_cpu(h.nr_blocks);
+    if (be32_to_cpu(h.version) != SNAPSHOT_RAM_VERSION ||
+        be64_to_cpu(h.chunk_size) != SNAPSHOT_RAM_CHUNK) {
+        error_setg(errp, "unsupported snapshot RAM layout");
+        ret = -EINVAL;
+        goto out;
+    }
+    size = be64_to_cpu(h.header_size);
+    if (size < sizeof(h) || size > INT_MAX) {
+        goto bad_header;
+    }
+    header = g_malloc(size);
+    ret = bdrv_load_vmstate(bs, header, 0, size);
+    if (ret < 0) {
+        goto io_error;
+    }
+
+    pos = sizeof(h);
+    if (h.file_len) {
+        g_autofree char *file = NULL;
+        uint16_t len = be16_to_cpu(h.file_len);
+
+        if (pos + len > size) {
+            goto bad_header;
+        }
+        file = g_strndup((char *)header + pos, len);
+        pos += len;
+        ret = snapshot_ram_file_open(&s, file, &h.file_uuid, errp);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+    for (i = 0; i < nr_blocks; i++) {
+        SnapshotRAMHeaderBlock hb;
+        char idstr[256];
+        RAMBlock *rb;
+        uint64_t length;
+
+        if (pos + sizeof(hb) > size) {
+            goto bad_header;
+        }
+        memcpy(&hb, header + pos, sizeof(hb));
+        pos += sizeof(hb);
+        if (pos + hb.idlen > size) {
+            goto bad_header;
+        }
+        memcpy(idstr, header + pos, hb.idlen);
+        idstr[hb.idlen] = '\0';
+        pos += hb.idlen;
+
+        length = be64_to_cpu(hb.length);
+        rb = qemu_ram_block_by_name(idstr);
+        if (!rb || !qemu_ram_is_migratable(rb) || rb->used_length != length) {
+            error_setg(errp, "RAM block '%s' is missing or has a different "
+                       "size", idstr);
+            ret = -EINVAL;
+            goto out;
+        }
+        snapshot_ram_add_block(&s, rb, length);
+        g_array_index(s.blocks, SnapshotRAMBlock, i).offset =
+            be64_to_cpu(hb.offset);
+    }
+    for (i = 0; i < nr_blocks; i++) {
+        SnapshotRAMBlock *b = &g_array_index(s.blocks, SnapshotRAMBlock, i);
+
+        if (pos + snapshot_ram_bitmap_size(b) > size) {
+            goto bad_header;
+        }
+        bitmap_from_le(b->bitmap, (unsigned long *)(header + pos),
+                       b->nr_chunks);
+        pos += snapshot_ram_bitmap_size(b);
+    }
+    *end = be64_to_cpu(h.end);
+
+    if (migrate_lazy_snapshot_load()) {
+        if (s.fd < 0) {
+            warn_report("snapshot: lazy loading needs the RAM in a file of "
+                        "its own, loading the snapshot eagerly");
+        } else if (snapshot_ram_lazy_start(&s)) {
+            trace_snapshot_ram_load(nr_blocks, *end);
+            /* the RAM blocks belong to the lazy loading threads now */
+            return 0;
+        }
+    }
+
+    ret = snapshot_ram_scan(&s);
+    if (ret == 0) {
+        ret = snapshot_ram_io(&s);
+    }
+    if (ret < 0) {
+        goto io_error;
+    }
+    trace_snapshot_ram_load(nr_blocks, *end);
+    goto out;
+
+ bad_header:
+    error_setg(errp, "corrupted snapshot RAM header");
+    ret = -EINVAL;
+    goto out;
+ io_error:
+    error_setg_errno(errp, -ret, "could not read guest RAM");
+ out:
+    snapshot_ram_free(&s);
+    return ret < 0 ? ret : 0;
+}
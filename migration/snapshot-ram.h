@@ -0,0 +1,72 @@
+/*
+ * Guest RAM of a snapshot, written and read in parallel
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef MIGRATION_SNAPSHOT_RAM_H
+#define MIGRATION_SNAPSHOT_RAM_H
+
+#include "qemu/units.h"
+#include "qemu/uuid.h"
+
+/*
+ * Layout of the VM state: a SnapshotRAMHeader, the name of the RAM
+ * file if any, then, for each RAM block, a SnapshotRAMHeaderBlock and
+ * its id, and finally the bitmap of each block, in little-endian longs.
+ * The bitmaps have one bit per chunk, set for the chunks that are not
+ * zero.  The other fields are big-endian.
+ */
+#define SNAPSHOT_RAM_MAGIC      "QEVMPRAM"
+#define SNAPSHOT_RAM_FILE_MAGIC "QEMURAMF"
+#define SNAPSHOT_RAM_VERSION    2
+#define SNAPSHOT_RAM_CHUNK      (64 * KiB)
+
+typedef struct QEMU_PACKED SnapshotRAMHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nr_blocks;
+    uint64_t chunk_size;
+    uint64_t header_size;       /* with the block list and bitmaps */
+    uint64_t end;               /* where the device state starts */
+    QemuUUID file_uuid;         /* of the RAM file, if any */
+    uint16_t file_len;          /* length of its name, 0 if none */
+} SnapshotRAMHeader;
+
+typedef struct QEMU_PACKED SnapshotRAMHeaderBlock {
+    uint64_t length;
+    uint64_t offset;            /* in the VM state or the RAM file */
+    uint8_t idlen;
+} SnapshotRAMHeaderBlock;
+
+/* Header of the RAM file, which takes its first MiB */
+typedef struct QEMU_PACKED SnapshotRAMFileHeader {
+    char magic[8];
+    QemuUUID uuid;
+} SnapshotRAMFileHeader;
+
+/**
+ * snapshot_ram_save:
+ *
+ * Write guest RAM at the beginning of the VM state of @bs.  The VM must
+ * be stopped.  The device state, without RAM, goes at *@end.
+ *
+ * Returns 0 on success, or a negative errno.
+ */
+int snapshot_ram_save(BlockDriverState *bs, int64_t *end, Error **errp);
+
+/* Whether the VM state of @bs was written by snapshot_ram_save() */
+bool snapshot_ram_present(BlockDriverState *bs);
+
+/**
+ * snapshot_ram_load:
+ *
+ * Load guest RAM saved by snapshot_ram_save(), setting *@end to where
+ * the device state starts.  With the lazy-snapshot-load capability,
+ * guest RAM may still be filling in the background on return.
+ *
+ * Returns 0 on success, or a negative errno.
+ */
+int snapshot_ram_load(BlockDriverState *bs, int64_t *end, Error **errp);
+
+#endif
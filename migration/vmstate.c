@@ -18,6 +18,7 @@
 #include "qemu-file.h"
 #include "qemu/bitops.h"
 #include "qemu/error-report.h"
+#include "qemu/thread.h"
 #include "trace.h"
 
 static int vmstate_subsection_save(QEMUFile *f, const VMStateDescription *vmsd,
@@ -75,8 +76,270 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
-int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
-                       void *opaque, int version_id)
+static int vmstate_load_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              int version_id)
+{
+    int ret = 0;
+
+    trace_vmstate_load_state_field(vmsd->name, field->name);
+    if ((field->field_exists &&
+         field->field_exists(opaque, version_id)) ||
+        (!field->field_exists &&
+         field->version_id <= version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+
+        vmstate_handle_alloc(first_elem, field, opaque);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                curr_elem = *(void **)curr_elem;
+            }
+            if (!curr_elem && size) {
+                /* if null pointer check placeholder and do not follow */
+                assert(field->flags & VMS_ARRAY_OF_POINTER);
+                ret = vmstate_info_nullptr.get(f, curr_elem, size, NULL);
+            } else if (field->flags & VMS_STRUCT) {
+                ret = vmstate_load_state(f, field->vmsd, curr_elem,
+                                         field->vmsd->version_id);
+            } else if (field->flags & VMS_VSTRUCT) {
+                ret = vmstate_load_state(f, field->vmsd, curr_elem,
+                                         field->struct_version_id);
+            } else {
+                ret = field->info->get(f, curr_elem, size, field);
+            }
+            if (ret >= 0) {
+                ret = qemu_file_get_error(f);
+            }
+            if (ret < 0) {
+                qemu_file_set_error(f, ret);
+                error_report("Failed to load %s:%s", vmsd->name,
+                             field->name);
+                trace_vmstate_load_field_error(field->name, ret);
+                return ret;
+            }
+        }
+    } else if (field->flags & VMS_MUST_EXIST) {
+        error_report("Input validation failed: %s/%s",
+                     vmsd->name, field->name);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Copy plans
+ *
+ * Interpreting the fields of a description one by one costs a few
+ * indirect calls and flag checks per field.  The first time a
+ * description is saved or loaded, its fields are compiled into a plan
+ * that turns runs of plain scalars and byte buffers into single
+ * operations: contiguous byte fields become one buffer copy, contiguous
+ * integers of the same width one loop of big-endian conversions (or a
+ * buffer copy on big-endian hosts).  The other fields are kept as they
+ * are and interpreted.  A plan only holds for the current version of
+ * the description, the one all saves use; loads of other versions are
+ * interpreted.
+ */
+typedef enum VMStatePlanKind {
+    VMSTATE_PLAN_FIELD,
+    VMSTATE_PLAN_BYTES,
+    VMSTATE_PLAN_BE16,
+    VMSTATE_PLAN_BE32,
+    VMSTATE_PLAN_BE64,
+} VMStatePlanKind;
+
+typedef struct VMStatePlanOp {
+    VMStatePlanKind kind;
+    /* First field of the run, for errors, or the field to interpret */
+    const VMStateField *field;
+    size_t offset;
+    /* Bytes for VMSTATE_PLAN_BYTES, integers for VMSTATE_PLAN_BE* */
+    size_t count;
+} VMStatePlanOp;
+
+typedef struct VMStatePlan {
+    int nb_ops;
+    VMStatePlanOp ops[];
+} VMStatePlan;
+
+static GHashTable *vmstate_plans;
+static QemuSpin vmstate_plans_lock;
+
+static VMStatePlanKind vmstate_plan_kind(const VMStateDescription *vmsd,
+                                         const VMStateField *field)
+{
+    const VMStateInfo *info = field->info;
+
+    if (field->field_exists || field->version_id > vmsd->version_id ||
+        (field->flags & ~(VMS_SINGLE | VMS_ARRAY | VMS_BUFFER))) {
+        return VMSTATE_PLAN_FIELD;
+    }
+    if (info == &vmstate_info_buffer ||
+        info == &vmstate_info_uint8 || info == &vmstate_info_int8) {
+        return VMSTATE_PLAN_BYTES;
+    }
+#ifdef HOST_WORDS_BIGENDIAN
+    if (info == &vmstate_info_uint16 || info == &vmstate_info_int16 ||
+        info == &vmstate_info_uint32 || info == &vmstate_info_int32 ||
+        info == &vmstate_info_uint64 || info == &vmstate_info_int64) {
+        return VMSTATE_PLAN_BYTES;
+    }
+#else
+    if (info == &vmstate_info_uint16 || info == &vmstate_info_int16) {
+        return VMSTATE_PLAN_BE16;
+    }
+    if (info == &vmstate_info_uint32 || info == &vmstate_info_int32) {
+        return VMSTATE_PLAN_BE32;
+    }
+    if (info == &vmstate_info_uint64 || info == &vmstate_info_int64) {
+        return VMSTATE_PLAN_BE64;
+    }
+#endif
+    return VMSTATE_PLAN_FIELD;
+}
+
+static size_t vmstate_plan_unit(VMStatePlanKind kind)
+{
+    switch (kind) {
+    case VMSTATE_PLAN_BE16:
+        return 2;
+    case VMSTATE_PLAN_BE32:
+        return 4;
+    case VMSTATE_PLAN_BE64:
+        return 8;
+    default:
+        return 1;
+    }
+}
+
+static VMStatePlan *vmstate_plan_compile(const VMStateDescription *vmsd)
+{
+    const VMStateField *field;
+    VMStatePlan *plan;
+    int n = 0;
+
+    for (field = vmsd->fields; field->name; field++) {
+        n++;
+    }
+    plan = g_malloc(sizeof(*plan) + n * sizeof(plan->ops[0]));
+    plan->nb_ops = 0;
+
+    for (field = vmsd->fields; field->name; field++) {
+        VMStatePlanKind kind = vmstate_plan_kind(vmsd, field);
+        VMStatePlanOp *last = plan->nb_ops ? &plan->ops[plan->nb_ops - 1]
+                                           : NULL;
+        size_t unit = vmstate_plan_unit(kind);
+        size_t bytes, count;
+
+        if (kind == VMSTATE_PLAN_FIELD) {
+            plan->ops[plan->nb_ops++] = (VMStatePlanOp) {
+                .kind = kind,
+                .field = field,
+            };
+            continue;
+        }
+
+        bytes = field->size * (field->flags & VMS_ARRAY ? field->num : 1);
+        if (!bytes) {
+            continue;
+        }
+        assert(kind == VMSTATE_PLAN_BYTES || field->size == unit);
+        count = bytes / unit;
+        if (last && last->kind == kind &&
+            last->offset + last->count * unit == field->offset) {
+            last->count += count;
+        } else {
+            plan->ops[plan->nb_ops++] = (VMStatePlanOp) {
+                .kind = kind,
+                .field = field,
+                .offset = field->offset,
+                .count = count,
+            };
+        }
+    }
+
+    trace_vmstate_plan_compile(vmsd->name, n, plan->nb_ops);
+    return plan;
+}
+
+static const VMStatePlan *vmstate_get_plan(const VMStateDescription *vmsd)
+{
+    VMStatePlan *plan;
+
+    qemu_spin_lock(&vmstate_plans_lock);
+    if (!vmstate_plans) {
+        vmstate_plans = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    }
+    plan = g_hash_table_lookup(vmstate_plans, vmsd);
+    if (!plan) {
+        plan = vmstate_plan_compile(vmsd);
+        g_hash_table_insert(vmstate_plans, (gpointer)vmsd, plan);
+    }
+    qemu_spin_unlock(&vmstate_plans_lock);
+
+    return plan;
+}
+
+static int vmstate_plan_load(QEMUFile *f, const VMStateDescription *vmsd,
+                             const VMStatePlan *plan, void *opaque)
+{
+    int i, ret;
+
+    for (i = 0; i < plan->nb_ops; i++) {
+        const VMStatePlanOp *op = &plan->ops[i];
+        void *p = opaque + op->offset;
+        size_t j;
+
+        switch (op->kind) {
+        case VMSTATE_PLAN_FIELD:
+            ret = vmstate_load_field(f, vmsd, op->field, opaque,
+                                     vmsd->version_id);
+            if (ret < 0) {
+                return ret;
+            }
+            continue;
+        case VMSTATE_PLAN_BYTES:
+            qemu_get_buffer(f, p, op->count);
+            break;
+        case VMSTATE_PLAN_BE16:
+            for (j = 0; j < op->count; j++) {
+                qemu_get_be16s(f, (uint16_t *)p + j);
+            }
+            break;
+        case VMSTATE_PLAN_BE32:
+            for (j = 0; j < op->count; j++) {
+                qemu_get_be32s(f, (uint32_t *)p + j);
+            }
+            break;
+        case VMSTATE_PLAN_BE64:
+            for (j = 0; j < op->count; j++) {
+                qemu_get_be64s(f, (uint64_t *)p + j);
+            }
+            break;
+        }
+
+        ret = qemu_file_get_error(f);
+        if (ret < 0) {
+            error_report("Failed to load %s:%s", vmsd->name, op->field->name);
+            trace_vmstate_load_field_error(op->field->name, ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static int vmstate_load_state_common(QEMUFile *f,
+                                     const VMStateDescription *vmsd,
+                                     void *opaque, int version_id,
+                                     bool post_load)
 {
     const VMStateField *field = vmsd->fields;
     int ret = 0;
@@ -108,69 +371,44 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             return ret;
         }
     }
-    while (field->name) {
-        trace_vmstate_load_state_field(vmsd->name, field->name);
-        if ((field->field_exists &&
-             field->field_exists(opaque, version_id)) ||
-            (!field->field_exists &&
-             field->version_id <= version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-
-            vmstate_handle_alloc(first_elem, field, opaque);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    curr_elem = *(void **)curr_elem;
-                }
-                if (!curr_elem && size) {
-                    /* if null pointer check placeholder and do not follow */
-                    assert(field->flags & VMS_ARRAY_OF_POINTER);
-                    ret = vmstate_info_nullptr.get(f, curr_elem, size, NULL);
-                } else if (field->flags & VMS_STRUCT) {
-                    ret = vmstate_load_state(f, field->vmsd, curr_elem,
-                                             field->vmsd->version_id);
-                } else if (field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_load_state(f, field->vmsd, curr_elem,
-                                             field->struct_version_id);
-                } else {
-                    ret = field->info->get(f, curr_elem, size, field);
-                }
-                if (ret >= 0) {
-                    ret = qemu_file_get_error(f);
-                }
-                if (ret < 0) {
-                    qemu_file_set_error(f, ret);
-                    error_report("Failed to load %s:%s", vmsd->name,
-                                 field->name);
-                    trace_vmstate_load_field_error(field->name, ret);
-                    return ret;
-                }
+    if (version_id == vmsd->version_id) {
+        ret = vmstate_plan_load(f, vmsd, vmstate_get_plan(vmsd), opaque);
+        if (ret < 0) {
+            return ret;
+        }
+    } else {
+        for (; field->name; field++) {
+            ret = vmstate_load_field(f, vmsd, field, opaque, version_id);
+            if (ret < 0) {
+                return ret;
             }
-        } else if (field->flags & VMS_MUST_EXIST) {
-            error_report("Input validation failed: %s/%s",
-                         vmsd->name, field->name);
-            return -1;
         }
-        field++;
     }
     ret = vmstate_subsection_load(f, vmsd, opaque);
     if (ret != 0) {
         return ret;
     }
-    if (vmsd->post_load) {
+    if (vmsd->post_load && post_load) {
         ret = vmsd->post_load(opaque, version_id);
     }
     trace_vmstate_load_state_end(vmsd->name, "end", ret);
     return ret;
 }
 
+int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
+                       void *opaque, int version_id)
+{
+    return vmstate_load_state_common(f, vmsd, opaque, version_id, true);
+}
+
+/* Leaves the caller to run the post_load hook of @vmsd, if any */
+int vmstate_load_state_no_post_load(QEMUFile *f,
+                                    const VMStateDescription *vmsd,
+                                    void *opaque, int version_id)
+{
+    return vmstate_load_state_common(f, vmsd, opaque, version_id, false);
+}
+
 static int vmfield_name_num(const VMStateField *start,
                             const VMStateField *search)
 {
@@ -323,6 +561,117 @@ int vmstate_save_state(QEMUFile *f, const VMStateDescription *vmsd,
     return vmstate_save_state_v(f, vmsd, opaque, vmdesc_id, vmsd->version_id);
 }
 
+static int vmstate_save_field(QEMUFile *f, const VMStateDescription *vmsd,
+                              const VMStateField *field, void *opaque,
+                              JSONWriter *vmdesc, int version_id)
+{
+    int ret = 0;
+
+    if ((field->field_exists &&
+         field->field_exists(opaque, version_id)) ||
+        (!field->field_exists &&
+         field->version_id <= version_id)) {
+        void *first_elem = opaque + field->offset;
+        int i, n_elems = vmstate_n_elems(opaque, field);
+        int size = vmstate_size(opaque, field);
+        int64_t old_offset, written_bytes;
+        JSONWriter *vmdesc_loop = vmdesc;
+
+        trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
+        if (field->flags & VMS_POINTER) {
+            first_elem = *(void **)first_elem;
+            assert(first_elem || !n_elems || !size);
+        }
+        for (i = 0; i < n_elems; i++) {
+            void *curr_elem = first_elem + size * i;
+
+            vmsd_desc_field_start(vmsd, vmdesc_loop, field, i, n_elems);
+            old_offset = qemu_ftell_fast(f);
+            if (field->flags & VMS_ARRAY_OF_POINTER) {
+                assert(curr_elem);
+                curr_elem = *(void **)curr_elem;
+            }
+            if (!curr_elem && size) {
+                /* if null pointer write placeholder and do not follow */
+                assert(field->flags & VMS_ARRAY_OF_POINTER);
+                ret = vmstate_info_nullptr.put(f, curr_elem, size, NULL,
+                                               NULL);
+            } else if (field->flags & VMS_STRUCT) {
+                ret = vmstate_save_state(f, field->vmsd, curr_elem,
+                                         vmdesc_loop);
+            } else if (field->flags & VMS_VSTRUCT) {
+                ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
+                                           vmdesc_loop,
+                                           field->struct_version_id);
+            } else {
+                ret = field->info->put(f, curr_elem, size, field,
+                                 vmdesc_loop);
+            }
+            if (ret) {
+                error_report("Save of field %s/%s failed",
+                             vmsd->name, field->name);
+                return ret;
+            }
+
+            written_bytes = qemu_ftell_fast(f) - old_offset;
+            vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
+
+            /* Compressed arrays only care about the first element */
+            if (vmdesc_loop && vmsd_can_compress(field)) {
+                vmdesc_loop = NULL;
+            }
+        }
+    } else {
+        if (field->flags & VMS_MUST_EXIST) {
+            error_report("Output state validation failed: %s/%s",
+                    vmsd->name, field->name);
+            assert(!(field->flags & VMS_MUST_EXIST));
+        }
+    }
+    return 0;
+}
+
+static int vmstate_plan_save(QEMUFile *f, const VMStateDescription *vmsd,
+                             const VMStatePlan *plan, void *opaque)
+{
+    int i, ret;
+
+    for (i = 0; i < plan->nb_ops; i++) {
+        const VMStatePlanOp *op = &plan->ops[i];
+        void *p = opaque + op->offset;
+        size_t j;
+
+        switch (op->kind) {
+        case VMSTATE_PLAN_FIELD:
+            ret = vmstate_save_field(f, vmsd, op->field, opaque, NULL,
+                                     vmsd->version_id);
+            if (ret) {
+                return ret;
+            }
+            break;
+        case VMSTATE_PLAN_BYTES:
+            qemu_put_buffer(f, p, op->count);
+            break;
+        case VMSTATE_PLAN_BE16:
+            for (j = 0; j < op->count; j++) {
+                qemu_put_be16s(f, (uint16_t *)p + j);
+            }
+            break;
+        case VMSTATE_PLAN_BE32:
+            for (j = 0; j < op->count; j++) {
+                qemu_put_be32s(f, (uint32_t *)p + j);
+            }
+            break;
+        case VMSTATE_PLAN_BE64:
+            for (j = 0; j < op->count; j++) {
+                qemu_put_be64s(f, (uint64_t *)p + j);
+            }
+            break;
+        }
+    }
+    return 0;
+}
+
 int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                          void *opaque, JSONWriter *vmdesc, int version_id)
 {
@@ -346,72 +695,20 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
         json_writer_start_array(vmdesc, "fields");
     }
 
-    while (field->name) {
-        if ((field->field_exists &&
-             field->field_exists(opaque, version_id)) ||
-            (!field->field_exists &&
-             field->version_id <= version_id)) {
-            void *first_elem = opaque + field->offset;
-            int i, n_elems = vmstate_n_elems(opaque, field);
-            int size = vmstate_size(opaque, field);
-            int64_t old_offset, written_bytes;
-            JSONWriter *vmdesc_loop = vmdesc;
-
-            trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
-            if (field->flags & VMS_POINTER) {
-                first_elem = *(void **)first_elem;
-                assert(first_elem || !n_elems || !size);
-            }
-            for (i = 0; i < n_elems; i++) {
-                void *curr_elem = first_elem + size * i;
-
-                vmsd_desc_field_start(vmsd, vmdesc_loop, field, i, n_elems);
-                old_offset = qemu_ftell_fast(f);
-                if (field->flags & VMS_ARRAY_OF_POINTER) {
-                    assert(curr_elem);
-                    curr_elem = *(void **)curr_elem;
-                }
-                if (!curr_elem && size) {
-                    /* if null pointer write placeholder and do not follow */
-                    assert(field->flags & VMS_ARRAY_OF_POINTER);
-                    ret = vmstate_info_nullptr.put(f, curr_elem, size, NULL,
-                                                   NULL);
-                } else if (field->flags & VMS_STRUCT) {
-                    ret = vmstate_save_state(f, field->vmsd, curr_elem,
-                                             vmdesc_loop);
-                } else if (field->flags & VMS_VSTRUCT) {
-                    ret = vmstate_save_state_v(f, field->vmsd, curr_elem,
-                                               vmdesc_loop,
-                                               field->struct_version_id);
-                } else {
-                    ret = field->info->put(f, curr_elem, size, field,
-                                     vmdesc_loop);
-                }
-                if (ret) {
-                    error_report("Save of field %s/%s failed",
-                                 vmsd->name, field->name);
-                    if (vmsd->post_save) {
-                        vmsd->post_save(opaque);
-                    }
-                    return ret;
-                }
-
-                written_bytes = qemu_ftell_fast(f) - old_offset;
-                vmsd_desc_field_end(vmsd, vmdesc_loop, field, written_bytes, i);
-
-                /* Compressed arrays only care about the first element */
-                if (vmdesc_loop && vmsd_can_compress(field)) {
-                    vmdesc_loop = NULL;
-                }
-            }
-        } else {
-            if (field->flags & VMS_MUST_EXIST) {
-                error_report("Output state validation failed: %s/%s",
-                        vmsd->name, field->name);
-                assert(!(field->flags & VMS_MUST_EXIST));
-            }
+    if (!vmdesc && version_id == vmsd->version_id) {
+        /* Plans write no JSON description, callers wanting one interpret */
+        ret = vmstate_plan_save(f, vmsd, vmstate_get_plan(vmsd), opaque);
+    } else {
+        for (; field->name && !ret; field++) {
+            ret = vmstate_save_field(f, vmsd, field, opaque, vmdesc,
+                                     version_id);
+        }
+    }
+    if (ret) {
+        if (vmsd->post_save) {
+            vmsd->post_save(opaque);
         }
-        field++;
+        return ret;
     }
 
     if (vmdesc) {
@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,17 +25,14 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
     long res;
     uint8_t *nzrun_start = NULL;
 
-    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
-               sizeof(long)));
-
     while (i < slen) {
         /* overflow */
         if (d + 2 > dlen) {
@@ -126,6 +124,266 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX2_OPT) || defined(CONFIG_AVX512F_OPT) || \
+    defined(__aarch64__)
+/*
+ * The vector encoders compare 64 bytes at a time into a mask, with a bit
+ * set for each byte that did not change, then follow the runs by
+ * counting the bits of the mask.  Their output is the same as that of
+ * xbzrle_encode_buffer_int(), including when it overflows.
+ */
+static uint64_t eq_mask_int(const uint8_t *a, const uint8_t *b, int n)
+{
+    uint64_t m = 0;
+    int k;
+
+    for (k = 0; k < n; k++) {
+        m |= (uint64_t)(a[k] == b[k]) << k;
+    }
+    return m;
+}
+
+static inline int QEMU_ALWAYS_INLINE
+encode_masks(uint8_t *old_buf, uint8_t *new_buf, int slen,
+             uint8_t *dst, int dlen,
+             uint64_t (*eq_mask)(const uint8_t *, const uint8_t *))
+{
+    uint32_t zrun_len = 0, nzrun_len = 0;
+    int d = 0, i, nzrun_start = 0;
+    bool zrun = true;
+
+    /* overflow */
+    if (slen && d + 2 > dlen) {
+        return -1;
+    }
+
+    for (i = 0; i < slen; i += 64) {
+        int n = MIN(64, slen - i);
+        uint64_t m = n == 64 ? eq_mask(old_buf + i, new_buf + i)
+                             : eq_mask_int(old_buf + i, new_buf + i, n);
+        int pos = 0;
+
+        for (;;) {
+            /* the bits where the current run ends */
+            uint64_t ends = (zrun ? ~m : m) >> pos;
+            int len = ends ? MIN(ctz64(ends), n - pos) : n - pos;
+
+            pos += len;
+            if (zrun) {
+                zrun_len += len;
+            } else {
+                nzrun_len += len;
+            }
+            if (pos == n) {
+                break;
+            }
+
+            if (zrun) {
+                d += uleb128_encode_small(dst + d, zrun_len);
+                zrun_len = 0;
+                nzrun_start = i + pos;
+            } else {
+                d += uleb128_encode_small(dst + d, nzrun_len);
+                if (d + nzrun_len > dlen) {
+                    return -1;
+                }
+                memcpy(dst + d, new_buf + nzrun_start, nzrun_len);
+                d += nzrun_len;
+                nzrun_len = 0;
+            }
+            /* overflow, before the next run */
+            if (d + 2 > dlen) {
+                return -1;
+            }
+            zrun = !zrun;
+        }
+    }
+
+    if (zrun) {
+        /* buffer unchanged, or skip last zero run */
+        return zrun_len == slen ? 0 : d;
+    }
+    d += uleb128_encode_small(dst + d, nzrun_len);
+    if (d + nzrun_len > dlen) {
+        return -1;
+    }
+    memcpy(dst + d, new_buf + nzrun_start, nzrun_len);
+    return d + nzrun_len;
+}
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline uint64_t QEMU_ALWAYS_INLINE
+eq_mask_avx2(const uint8_t *a, const uint8_t *b)
+{
+    __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)a),
+                                   _mm256_loadu_si256((__m256i *)b));
+    __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(a + 32)),
+                                   _mm256_loadu_si256((__m256i *)(b + 32)));
+
+    return (uint32_t)_mm256_movemask_epi8(lo) |
+           (uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32;
+}
+
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return encode_masks(old_buf, new_buf, slen, dst, dlen, eq_mask_avx2);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+/*
+ * Byte compares into a mask need AVX512BW, that any compiler which
+ * passes the AVX512F check of configure knows about.
+ */
+#ifdef CONFIG_AVX512F_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#include <immintrin.h>
+
+static inline uint64_t QEMU_ALWAYS_INLINE
+eq_mask_avx512(const uint8_t *a, const uint8_t *b)
+{
+    return _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(a),
+                                  _mm512_loadu_si512(b));
+}
+
+static int xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                       int slen, uint8_t *dst, int dlen)
+{
+    return encode_masks(old_buf, new_buf, slen, dst, dlen, eq_mask_avx512);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512F_OPT */
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+
+static inline uint64_t QEMU_ALWAYS_INLINE
+eq_mask_neon(const uint8_t *a, const uint8_t *b)
+{
+    static const uint8_t bits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+    };
+    uint8x16_t bit = vld1q_u8(bits);
+    uint8x16_t t0 = vandq_u8(vceqq_u8(vld1q_u8(a), vld1q_u8(b)), bit);
+    uint8x16_t t1 = vandq_u8(vceqq_u8(vld1q_u8(a + 16),
+                                      vld1q_u8(b + 16)), bit);
+    uint8x16_t t2 = vandq_u8(vceqq_u8(vld1q_u8(a + 32),
+                                      vld1q_u8(b + 32)), bit);
+    uint8x16_t t3 = vandq_u8(vceqq_u8(vld1q_u8(a + 48),
+                                      vld1q_u8(b + 48)), bit);
+
+    /* Add up the bits of each group of 8 bytes into one byte */
+    t0 = vpaddq_u8(vpaddq_u8(t0, t1), vpaddq_u8(t2, t3));
+    t0 = vpaddq_u8(t0, t0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(t0), 0);
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return encode_masks(old_buf, new_buf, slen, dst, dlen, eq_mask_neon);
+}
+#endif /* __aarch64__ */
+
+/*
+ * As in util/bufferiszero.c, the most preferred ISA must have the least
+ * significant bit, for xbzrle_encode_next_accel().
+ */
+#define CACHE_AVX512BW 1
+#define CACHE_AVX2     2
+#define CACHE_NEON     4
+
+static unsigned cpuid_cache;
+static int (*encode_accel)(uint8_t *, uint8_t *, int, uint8_t *, int) =
+    xbzrle_encode_buffer_int;
+
+static void init_accel(unsigned cache)
+{
+    encode_accel = xbzrle_encode_buffer_int;
+#ifdef __aarch64__
+    if (cache & CACHE_NEON) {
+        encode_accel = xbzrle_encode_buffer_neon;
+    }
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        encode_accel = xbzrle_encode_buffer_avx2;
+    }
+#endif
+#ifdef CONFIG_AVX512F_OPT
+    if (cache & CACHE_AVX512BW) {
+        encode_accel = xbzrle_encode_buffer_avx512;
+    }
+#endif
+}
+
+#if defined(CONFIG_AVX512F_OPT) || defined(CONFIG_AVX2_OPT)
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+            /* OPMASK and ZMM state enabled by OS, as in bufferiszero.c */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512F) &&
+                (b & bit_AVX512BW)) {
+                cache |= CACHE_AVX512BW;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#elif defined(__aarch64__)
+/* Advanced SIMD is part of the base aarch64 architecture */
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    cpuid_cache = CACHE_NEON;
+    init_accel(cpuid_cache);
+}
+#endif
+
+bool xbzrle_encode_next_accel(void)
+{
+    /* If no bits set, we just tested xbzrle_encode_buffer_int */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
+               sizeof(long)));
+
+    return encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
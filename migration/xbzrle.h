@@ -18,4 +18,10 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen);
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
+
+/*
+ * Switch the encoder to its next accelerated implementation, for tests
+ * and benchmarks.  Returns false once back to the generic one.
+ */
+bool xbzrle_encode_next_accel(void);
 #endif
@@ -52,6 +52,7 @@
 #include "ui/console.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "exec/memory.h"
 #include "hw/intc/intc.h"
 #include "migration/snapshot.h"
 #include "migration/misc.h"
@@ -274,6 +275,10 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->skipped);
         monitor_printf(mon, "normal: %" PRIu64 " pages\n",
                        info->ram->normal);
+        if (info->ram->deduplicated) {
+            monitor_printf(mon, "deduplicated: %" PRIu64 " pages\n",
+                           info->ram->deduplicated);
+        }
         monitor_printf(mon, "normal bytes: %" PRIu64 " kbytes\n",
                        info->ram->normal_bytes >> 10);
         monitor_printf(mon, "dirty sync count: %" PRIu64 "\n",
@@ -921,6 +926,29 @@ void hmp_sync_profile(Monitor *mon, const QDict *qdict)
     }
 }
 
+void hmp_mtree_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+
+    if (op == NULL) {
+        monitor_printf(mon, "mtree-stats is %s\n",
+                       memory_region_stats_enabled ? "on" : "off");
+        return;
+    }
+    if (!strcmp(op, "on")) {
+        memory_region_stats_enable(true);
+    } else if (!strcmp(op, "off")) {
+        memory_region_stats_enable(false);
+    } else if (!strcmp(op, "reset")) {
+        memory_region_stats_reset();
+    } else {
+        Error *err = NULL;
+
+        error_setg(&err, QERR_INVALID_PARAMETER, op);
+        hmp_handle_error(mon, err);
+    }
+}
+
 void hmp_system_reset(Monitor *mon, const QDict *qdict)
 {
     qmp_system_reset(NULL);
@@ -1837,6 +1865,11 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
         monitor_printf(mon, "  aio-max-batch=%" PRId64 "\n",
                        value->aio_max_batch);
+        monitor_printf(mon, "  poll-time-ns=%" PRId64 "\n",
+                       value->poll_time_ns);
+        monitor_printf(mon, "  poll-hits=%" PRId64 "\n", value->poll_hits);
+        monitor_printf(mon, "  poll-dropped=%" PRId64 "\n",
+                       value->poll_dropped);
     }
 
     qapi_free_IOThreadInfoList(info_list);
@@ -2148,6 +2181,21 @@ void hmp_info_vm_generation_id(Monitor *mon, const QDict *qdict)
     qapi_free_GuidInfo(info);
 }
 
+void hmp_info_memory_usage(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+    MemoryUsageInfoList *info = qmp_query_memory_usage(&err);
+    MemoryUsageInfoList *entry;
+
+    for (entry = info; entry; entry = entry->next) {
+        monitor_printf(mon, "%-16s %" PRIu64 "\n",
+                       MemoryUsageSubsystem_str(entry->value->subsystem),
+                       entry->value->bytes);
+    }
+    qapi_free_MemoryUsageInfoList(info);
+    hmp_handle_error(mon, err);
+}
+
 void hmp_info_memory_size_summary(Monitor *mon, const QDict *qdict)
 {
     Error *err = NULL;
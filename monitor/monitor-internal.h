@@ -151,6 +151,12 @@ typedef struct {
     QemuMutex qmp_queue_lock;
     /* Input queue that holds all the parsed QMP requests */
     GQueue *qmp_requests;
+    /*
+     * With @use_io_thread, everything written goes through this queue
+     * and is written out in order by @qmp_respond_bh in the I/O thread
+     */
+    GQueue *qmp_responses;
+    QEMUBH *qmp_respond_bh;
 } MonitorQMP;
 
 /**
@@ -182,6 +188,7 @@ void monitor_list_append(Monitor *mon);
 void monitor_fdsets_cleanup(void);
 
 void qmp_send_response(MonitorQMP *mon, const QDict *rsp);
+void monitor_qmp_flush_responses(MonitorQMP *mon);
 void monitor_data_destroy_qmp(MonitorQMP *mon);
 void coroutine_fn monitor_qmp_dispatcher_co(void *data);
 
@@ -664,6 +664,11 @@ void monitor_cleanup(void)
         QTAILQ_REMOVE(&mon_list, mon, entry);
         /* Permit QAPI event emission from character frontend release */
         qemu_mutex_unlock(&monitor_lock);
+        if (monitor_is_qmp(mon)) {
+            /* What the stopped I/O thread did not write out yet */
+            monitor_qmp_flush_responses(container_of(mon, MonitorQMP,
+                                                     common));
+        }
         monitor_flush(mon);
         monitor_data_destroy(mon);
         qemu_mutex_lock(&monitor_lock);
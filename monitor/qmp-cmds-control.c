@@ -33,6 +33,7 @@
 #include "qapi/qapi-emit-events.h"
 #include "qapi/qapi-introspect.h"
 #include "qapi/qapi-visit-introspect.h"
+#include "qapi/type-helpers.h"
 #include "qapi/qobject-input-visitor.h"
 
 /*
@@ -134,6 +135,50 @@ CommandInfoList *qmp_query_commands(Error **errp)
     return list;
 }
 
+static void qmp_stats_cb(const QmpCommand *cmd, void *opaque)
+{
+    GPtrArray *cmds = opaque;
+
+    if (stat64_get(&cmd->calls)) {
+        g_ptr_array_add(cmds, (gpointer)cmd);
+    }
+}
+
+static gint qmp_stats_cmp(gconstpointer a, gconstpointer b)
+{
+    const QmpCommand *ca = *(const QmpCommand **)a;
+    const QmpCommand *cb = *(const QmpCommand **)b;
+    uint64_t ta = stat64_get(&ca->total_ns);
+    uint64_t tb = stat64_get(&cb->total_ns);
+
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+HumanReadableText *qmp_x_query_qmp_stats(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+    g_autoptr(GPtrArray) cmds = g_ptr_array_new();
+    guint i;
+
+    qmp_for_each_command(&qmp_commands, qmp_stats_cb, cmds);
+    g_ptr_array_sort(cmds, qmp_stats_cmp);
+
+    g_string_append_printf(buf, "%-32s %10s %12s %10s %10s\n", "command",
+                           "calls", "total (ms)", "avg (us)", "max (us)");
+    for (i = 0; i < cmds->len; i++) {
+        const QmpCommand *cmd = g_ptr_array_index(cmds, i);
+        uint64_t calls = stat64_get(&cmd->calls);
+        uint64_t total = stat64_get(&cmd->total_ns);
+
+        g_string_append_printf(buf, "%-32s %10" PRIu64 " %12.3f %10.1f"
+                               " %10.1f\n", cmd->name, calls, total / 1e6,
+                               total / 1e3 / calls,
+                               stat64_get(&cmd->max_ns) / 1e3);
+    }
+
+    return human_readable_text_from_str(buf);
+}
+
 static void *split_off_generic_list(void *list,
                                     bool (*splitp)(void *elt),
                                     void **part)
@@ -17,6 +17,10 @@
 #include "qemu-common.h"
 #include "qemu/cutils.h"
 #include "qemu/option.h"
+#include "qemu/coroutine.h"
+#include "qemu/rcu.h"
+#include "qemu/main-loop.h"
+#include "qemu/mem-usage.h"
 #include "monitor/monitor.h"
 #include "sysemu/sysemu.h"
 #include "qemu/config-file.h"
@@ -38,6 +42,7 @@
 #include "qapi/qapi-commands-ui.h"
 #include "qapi/type-helpers.h"
 #include "qapi/qmp/qerror.h"
+#include "exec/memory.h"
 #include "exec/ramlist.h"
 #include "hw/mem/memory-device.h"
 #include "hw/acpi/acpi_dev_interface.h"
@@ -338,6 +343,22 @@ MemoryInfo *qmp_query_memory_size_summary(Error **errp)
     return mem_info;
 }
 
+MemoryUsageInfoList *qmp_query_memory_usage(Error **errp)
+{
+    MemoryUsageInfoList *head = NULL, **tail = &head;
+    MemoryUsageSubsystem i;
+
+    for (i = 0; i < MEMORY_USAGE_SUBSYSTEM__MAX; i++) {
+        MemoryUsageInfo *info = g_new0(MemoryUsageInfo, 1);
+
+        info->subsystem = i;
+        info->bytes = mem_usage_get(i);
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
+
 void qmp_display_reload(DisplayReloadOptions *arg, Error **errp)
 {
     switch (arg->type) {
@@ -424,6 +445,41 @@ HumanReadableText *qmp_x_query_ramblock(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+HumanReadableText *qmp_x_query_ram_backing(Error **errp)
+{
+    g_autoptr(GString) buf = ram_block_backing_format();
+
+    return human_readable_text_from_str(buf);
+}
+
+HumanReadableText *qmp_x_query_mtree_stats(Error **errp)
+{
+    g_autoptr(GString) buf = memory_region_stats_format();
+
+    return human_readable_text_from_str(buf);
+}
+
+HumanReadableText *qmp_x_query_coroutines(Error **errp)
+{
+    g_autoptr(GString) buf = qemu_coroutine_stats_format();
+
+    return human_readable_text_from_str(buf);
+}
+
+HumanReadableText *qmp_x_query_rcu(Error **errp)
+{
+    g_autoptr(GString) buf = rcu_stats_format();
+
+    return human_readable_text_from_str(buf);
+}
+
+HumanReadableText *qmp_x_query_main_loop(Error **errp)
+{
+    g_autoptr(GString) buf = main_loop_stats_format();
+
+    return human_readable_text_from_str(buf);
+}
+
 static int qmp_x_query_irq_foreach(Object *obj, void *opaque)
 {
     InterruptStatsProvider *intc;
@@ -105,31 +105,113 @@ static void monitor_qmp_cleanup_queue_and_resume(MonitorQMP *mon)
 
 }
 
-void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
-{
-    const QObject *data = QOBJECT(rsp);
+/*
+ * An entry of mon->qmp_responses: a command reply still to be
+ * converted to JSON, or anything else already converted.
+ */
+typedef struct QMPResponse {
+    QDict *rsp;
     GString *json;
+} QMPResponse;
+
+static GString *qmp_response_to_json(MonitorQMP *mon, const QDict *rsp)
+{
+    GString *json = qobject_to_json_pretty(QOBJECT(rsp), mon->pretty);
 
-    json = qobject_to_json_pretty(data, mon->pretty);
     assert(json != NULL);
     trace_monitor_qmp_respond(mon, json->str);
-
     g_string_append_c(json, '\n');
-    monitor_puts(&mon->common, json->str);
+    return json;
+}
+
+static void monitor_qmp_queue_response(MonitorQMP *mon, QDict *rsp,
+                                       GString *json)
+{
+    QMPResponse *resp = g_new(QMPResponse, 1);
+
+    resp->rsp = rsp;
+    resp->json = json;
+    WITH_QEMU_LOCK_GUARD(&mon->qmp_queue_lock) {
+        g_queue_push_tail(mon->qmp_responses, resp);
+    }
+    qemu_bh_schedule(mon->qmp_respond_bh);
+}
+
+/*
+ * Write out the queued output of @mon.  Runs in the monitor I/O thread,
+ * or in the main thread once that is stopped.
+ */
+void monitor_qmp_flush_responses(MonitorQMP *mon)
+{
+    QMPResponse *resp;
+
+    for (;;) {
+        WITH_QEMU_LOCK_GUARD(&mon->qmp_queue_lock) {
+            resp = g_queue_pop_head(mon->qmp_responses);
+        }
+        if (!resp) {
+            return;
+        }
+        if (!resp->json) {
+            resp->json = qmp_response_to_json(mon, resp->rsp);
+            qobject_unref(resp->rsp);
+        }
+        monitor_puts(&mon->common, resp->json->str);
+        g_string_free(resp->json, true);
+        g_free(resp);
+    }
+}
 
+static void monitor_qmp_respond_bh(void *opaque)
+{
+    monitor_qmp_flush_responses(opaque);
+}
+
+void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
+{
+    GString *json = qmp_response_to_json(mon, rsp);
+
+    if (mon->common.use_io_thread) {
+        /* Stay in order with the replies that are still queued */
+        monitor_qmp_queue_response(mon, NULL, json);
+        return;
+    }
+    monitor_puts(&mon->common, json->str);
     g_string_free(json, true);
 }
 
 /*
- * Emit QMP response @rsp to @mon.
+ * Emit QMP response @rsp to @mon, taking ownership of it.
  * Null @rsp can only happen for commands with QCO_NO_SUCCESS_RESP.
  * Nothing is emitted then.
  */
 static void monitor_qmp_respond(MonitorQMP *mon, QDict *rsp)
 {
-    if (rsp) {
+    QObject *id;
+
+    if (!rsp) {
+        return;
+    }
+    if (!mon->common.use_io_thread) {
         qmp_send_response(mon, rsp);
+        qobject_unref(rsp);
+        return;
+    }
+
+    /*
+     * Let the I/O thread convert the reply to JSON, so that a large one
+     * does not hold up the main loop.  Reference counts are not atomic,
+     * so it must be the only owner: the reply is built from scratch,
+     * except for "id", which is still shared with the request.
+     */
+    id = qdict_get(rsp, "id");
+    if (id) {
+        g_autoptr(GString) id_json = qobject_to_json(id);
+
+        qdict_put_obj(rsp, "id", qobject_from_json(id_json->str,
+                                                   &error_abort));
     }
+    monitor_qmp_queue_response(mon, rsp, NULL);
 }
 
 /*
@@ -157,7 +239,6 @@ static void monitor_qmp_dispatch(MonitorQMP *mon, QObject *req)
     }
 
     monitor_qmp_respond(mon, rsp);
-    qobject_unref(rsp);
 }
 
 /*
@@ -322,7 +403,6 @@ void coroutine_fn monitor_qmp_dispatcher_co(void *data)
             rsp = qmp_error_response(req_obj->err);
             req_obj->err = NULL;
             monitor_qmp_respond(mon, rsp);
-            qobject_unref(rsp);
         }
 
         if (!oob_enabled) {
@@ -479,6 +559,19 @@ void monitor_data_destroy_qmp(MonitorQMP *mon)
     qemu_mutex_destroy(&mon->qmp_queue_lock);
     monitor_qmp_cleanup_req_queue_locked(mon);
     g_queue_free(mon->qmp_requests);
+    while (!g_queue_is_empty(mon->qmp_responses)) {
+        QMPResponse *resp = g_queue_pop_head(mon->qmp_responses);
+
+        qobject_unref(resp->rsp);
+        if (resp->json) {
+            g_string_free(resp->json, true);
+        }
+        g_free(resp);
+    }
+    g_queue_free(mon->qmp_responses);
+    if (mon->qmp_respond_bh) {
+        qemu_bh_delete(mon->qmp_respond_bh);
+    }
 }
 
 static void monitor_qmp_setup_handlers_bh(void *opaque)
@@ -513,9 +606,13 @@ void monitor_init_qmp(Chardev *chr, bool pretty, Error **errp)
 
     qemu_mutex_init(&mon->qmp_queue_lock);
     mon->qmp_requests = g_queue_new();
+    mon->qmp_responses = g_queue_new();
 
     json_message_parser_init(&mon->parser, handle_qmp_command, mon, NULL);
     if (mon->common.use_io_thread) {
+        mon->qmp_respond_bh =
+            aio_bh_new(iothread_get_aio_context(mon_iothread),
+                       monitor_qmp_respond_bh, mon);
         /*
          * Make sure the old iowatch is gone.  It's possible when
          * e.g. the chardev is in client mode, with wait=on.
@@ -1642,7 +1642,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     int64_t size;
     uint64_t perm, shared_perm;
     bool readonly = !exp_args->writable;
-    bool shared = !exp_args->writable;
+    bool multi_conn;
     strList *bitmaps;
     size_t i;
     int ret;
@@ -1693,11 +1693,22 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     exp->description = g_strdup(arg->description);
     exp->nbdflags = (NBD_FLAG_HAS_FLAGS | NBD_FLAG_SEND_FLUSH |
                      NBD_FLAG_SEND_FUA | NBD_FLAG_SEND_CACHE);
+
+    /*
+     * All connections share exp->common.blk, so a flush on one of them
+     * covers the writes completed on the others, as multi-conn requires.
+     */
+    if (arg->has_multi_conn && arg->multi_conn != ON_OFF_AUTO_AUTO) {
+        multi_conn = arg->multi_conn == ON_OFF_AUTO_ON;
+    } else {
+        multi_conn = readonly;
+    }
+    if (multi_conn) {
+        exp->nbdflags |= NBD_FLAG_CAN_MULTI_CONN;
+    }
+
     if (readonly) {
         exp->nbdflags |= NBD_FLAG_READ_ONLY;
-        if (shared) {
-            exp->nbdflags |= NBD_FLAG_CAN_MULTI_CONN;
-        }
     } else {
         exp->nbdflags |= (NBD_FLAG_SEND_TRIM | NBD_FLAG_SEND_WRITE_ZEROES |
                           NBD_FLAG_SEND_FAST_ZERO);
@@ -1971,9 +1982,13 @@ static int coroutine_fn nbd_co_send_structured_error(NBDClient *client,
     return nbd_co_send_iov(client, iov, 1 + !!iov[1].iov_len, errp);
 }
 
+/* Extents looked up at once by nbd_co_send_sparse_read() */
+#define NBD_SPARSE_READ_EXTENTS 16
+
 /* Do a sparse read and send the structured reply to the client.
- * Returns -errno if sending fails. bdrv_block_status_above() failure is
- * reported to the client, at which point this function succeeds.
+ * Returns -errno if sending fails. bdrv_block_status_above_batch() failure
+ * is reported to the client, at which point this function succeeds.
+ * Consecutive data extents are read and sent as a single chunk.
  */
 static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
                                                 uint64_t handle,
@@ -1984,57 +1999,75 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
 {
     int ret = 0;
     NBDExport *exp = client->exp;
+    BlockStatusExtent extents[NBD_SPARSE_READ_EXTENTS];
     size_t progress = 0;
 
     while (progress < size) {
-        int64_t pnum;
-        int status = bdrv_block_status_above(blk_bs(exp->common.blk), NULL,
-                                             offset + progress,
-                                             size - progress, &pnum, NULL,
-                                             NULL);
-        bool final;
-
-        if (status < 0) {
+        int i, count;
+
+        count = bdrv_co_block_status_above_batch(blk_bs(exp->common.blk),
+                                                 NULL, false, true,
+                                                 offset + progress,
+                                                 size - progress, extents,
+                                                 ARRAY_SIZE(extents));
+        if (count < 0) {
             char *msg = g_strdup_printf("unable to check for holes: %s",
-                                        strerror(-status));
+                                        strerror(-count));
 
-            ret = nbd_co_send_structured_error(client, handle, -status, msg,
+            ret = nbd_co_send_structured_error(client, handle, -count, msg,
                                                errp);
             g_free(msg);
             return ret;
         }
-        assert(pnum && pnum <= size - progress);
-        final = progress + pnum == size;
-        if (status & BDRV_BLOCK_ZERO) {
-            NBDStructuredReadHole chunk;
-            struct iovec iov[] = {
-                {.iov_base = &chunk, .iov_len = sizeof(chunk)},
-            };
-
-            trace_nbd_co_send_structured_read_hole(handle, offset + progress,
-                                                   pnum);
-            set_be_chunk(&chunk.h, final ? NBD_REPLY_FLAG_DONE : 0,
-                         NBD_REPLY_TYPE_OFFSET_HOLE,
-                         handle, sizeof(chunk) - sizeof(chunk.h));
-            stq_be_p(&chunk.offset, offset + progress);
-            stl_be_p(&chunk.length, pnum);
-            ret = nbd_co_send_iov(client, iov, 1, errp);
-        } else {
-            ret = blk_pread(exp->common.blk, offset + progress,
-                            data + progress, pnum);
-            if (ret < 0) {
-                error_setg_errno(errp, -ret, "reading from file failed");
-                break;
+        assert(count > 0);
+
+        for (i = 0; i < count; i++) {
+            int64_t pnum = extents[i].bytes;
+            bool zero = extents[i].ret & BDRV_BLOCK_ZERO;
+            bool final;
+
+            /* Only the last extent may run into what the next query sees */
+            while (!zero && i + 1 < count &&
+                   !(extents[i + 1].ret & BDRV_BLOCK_ZERO)) {
+                pnum += extents[++i].bytes;
+            }
+            assert(pnum && pnum <= size - progress);
+            final = progress + pnum == size;
+
+            if (zero) {
+                NBDStructuredReadHole chunk;
+                struct iovec iov[] = {
+                    {.iov_base = &chunk, .iov_len = sizeof(chunk)},
+                };
+
+                trace_nbd_co_send_structured_read_hole(handle,
+                                                       offset + progress,
+                                                       pnum);
+                set_be_chunk(&chunk.h, final ? NBD_REPLY_FLAG_DONE : 0,
+                             NBD_REPLY_TYPE_OFFSET_HOLE,
+                             handle, sizeof(chunk) - sizeof(chunk.h));
+                stq_be_p(&chunk.offset, offset + progress);
+                stl_be_p(&chunk.length, pnum);
+                ret = nbd_co_send_iov(client, iov, 1, errp);
+            } else {
+                ret = blk_co_pread(exp->common.blk, offset + progress, pnum,
+                                   data + progress, 0);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "reading from file failed");
+                    return ret;
+                }
+                /* Sent straight from @data, without a copy */
+                ret = nbd_co_send_structured_read(client, handle,
+                                                  offset + progress,
+                                                  data + progress, pnum,
+                                                  final, errp);
             }
-            ret = nbd_co_send_structured_read(client, handle, offset + progress,
-                                              data + progress, pnum, final,
-                                              errp);
-        }
 
-        if (ret < 0) {
-            break;
+            if (ret < 0) {
+                return ret;
+            }
+            progress += pnum;
         }
-        progress += pnum;
     }
     return ret;
 }
@@ -0,0 +1,440 @@
+/*
+ * AF_XDP network backend.
+ *
+ * Each queue of the netdev is an AF_XDP socket bound to one queue of a
+ * host network interface.  Packets are copied between the guest and a
+ * UMEM area shared with the kernel; the NIC itself works in zero-copy
+ * mode if its driver supports it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <net/if.h>
+#include <xdp/xsk.h>
+
+#include "clients.h"
+#include "net/net.h"
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+
+/* Number of descriptors moved in one go between the rings and QEMU */
+#define AF_XDP_BATCH_SIZE 64
+
+typedef struct AFXDPState {
+    NetClientState       nc;
+
+    struct xsk_socket    *xsk;
+    struct xsk_ring_cons rx;
+    struct xsk_ring_prod tx;
+    struct xsk_ring_cons cq;
+    struct xsk_ring_prod fq;
+
+    char                 ifname[IFNAMSIZ];
+    bool                 read_poll;
+    bool                 write_poll;
+    /* Tx descriptors submitted since the kernel was last kicked */
+    uint32_t             pending_tx;
+
+    /* Free UMEM frames, used as a LIFO stack */
+    uint64_t             *pool;
+    uint32_t             n_pool;
+    char                 *buffer;
+    struct xsk_umem      *umem;
+} AFXDPState;
+
+static void af_xdp_send(void *opaque);
+static void af_xdp_writable(void *opaque);
+
+/* Set the event-loop handlers for the af-xdp backend. */
+static void af_xdp_update_fd_handler(AFXDPState *s)
+{
+    if (!s->xsk) {
+        /* Still setting up the UMEM */
+        return;
+    }
+    qemu_set_fd_handler(xsk_socket__fd(s->xsk),
+                        s->read_poll ? af_xdp_send : NULL,
+                        s->write_poll ? af_xdp_writable : NULL,
+                        s);
+}
+
+/* Update the read handler. */
+static void af_xdp_read_poll(AFXDPState *s, bool enable)
+{
+    if (s->read_poll != enable) {
+        s->read_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+/* Update the write handler. */
+static void af_xdp_write_poll(AFXDPState *s, bool enable)
+{
+    if (s->write_poll != enable) {
+        s->write_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+static void af_xdp_poll(NetClientState *nc, bool enable)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    if (s->read_poll != enable || s->write_poll != enable) {
+        s->write_poll = enable;
+        s->read_poll  = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+/* Return the frames of the packets the kernel has sent to the pool. */
+static void af_xdp_complete_tx(AFXDPState *s)
+{
+    uint32_t idx = 0;
+    uint32_t done, i;
+
+    done = xsk_ring_cons__peek(&s->cq, XSK_RING_CONS__DEFAULT_NUM_DESCS, &idx);
+    for (i = 0; i < done; i++) {
+        s->pool[s->n_pool++] = *xsk_ring_cons__comp_addr(&s->cq, idx++);
+    }
+    if (done) {
+        xsk_ring_cons__release(&s->cq, done);
+    }
+}
+
+/*
+ * Start transmission of everything submitted so far.  This is a system
+ * call, so it is done once per burst rather than once per packet.
+ */
+static void af_xdp_kick_tx(AFXDPState *s)
+{
+    if (!s->pending_tx) {
+        return;
+    }
+    s->pending_tx = 0;
+    if (xsk_ring_prod__needs_wakeup(&s->tx)) {
+        sendto(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+}
+
+static void af_xdp_flush_tx(NetClientState *nc)
+{
+    af_xdp_kick_tx(DO_UPCAST(AFXDPState, nc, nc));
+}
+
+/*
+ * The fd_write() callback, invoked if the fd is marked as writable
+ * after a poll; polling for POLLOUT also kicks the kernel.
+ */
+static void af_xdp_writable(void *opaque)
+{
+    AFXDPState *s = opaque;
+
+    af_xdp_write_poll(s, false);
+    af_xdp_complete_tx(s);
+    qemu_flush_queued_packets(&s->nc);
+    af_xdp_kick_tx(s);
+}
+
+static ssize_t af_xdp_receive(NetClientState *nc,
+                              const uint8_t *buf, size_t size)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    struct xdp_desc *desc;
+    uint32_t idx;
+
+    if (size > XSK_UMEM__DEFAULT_FRAME_SIZE) {
+        /* Does not fit in a frame, drop it like a too long packet */
+        return size;
+    }
+
+    if (!s->n_pool) {
+        af_xdp_complete_tx(s);
+    }
+    if (!s->n_pool || !xsk_ring_prod__reserve(&s->tx, 1, &idx)) {
+        /*
+         * Out of frames or Tx ring full: keep the packet queued and wait
+         * for the kernel to make progress.
+         */
+        af_xdp_kick_tx(s);
+        af_xdp_write_poll(s, true);
+        return 0;
+    }
+
+    desc = xsk_ring_prod__tx_desc(&s->tx, idx);
+    desc->addr = s->pool[--s->n_pool];
+    desc->len = size;
+    memcpy(xsk_umem__get_data(s->buffer, desc->addr), buf, size);
+    xsk_ring_prod__submit(&s->tx, 1);
+
+    /*
+     * Kick the kernel when the burst is over (see af_xdp_flush_tx), or as
+     * soon as a batch is ready for front ends that never say so.
+     */
+    if (++s->pending_tx >= AF_XDP_BATCH_SIZE) {
+        af_xdp_kick_tx(s);
+    } else if (s->pending_tx == 1) {
+        af_xdp_write_poll(s, true);
+    }
+
+    return size;
+}
+
+/* Give up to @n free frames to the kernel for reception. */
+static void af_xdp_fq_refill(AFXDPState *s, uint32_t n)
+{
+    uint32_t i, idx = 0;
+
+    /* Keep one frame for Tx, just in case. */
+    if (s->n_pool < n + 1) {
+        n = s->n_pool ? s->n_pool - 1 : 0;
+    }
+    if (!n || !xsk_ring_prod__reserve(&s->fq, n, &idx)) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        *xsk_ring_prod__fill_addr(&s->fq, idx++) = s->pool[--s->n_pool];
+    }
+    xsk_ring_prod__submit(&s->fq, n);
+
+    if (xsk_ring_prod__needs_wakeup(&s->fq)) {
+        /* Reception stalled for lack of frames, poll() wakes it up. */
+        af_xdp_read_poll(s, true);
+    }
+}
+
+/*
+ * Complete a previous send (backend --> guest) and enable the fd_read
+ * callback.
+ */
+static void af_xdp_send_completed(NetClientState *nc, ssize_t len)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    af_xdp_read_poll(s, true);
+}
+
+static void af_xdp_send(void *opaque)
+{
+    AFXDPState *s = opaque;
+    uint32_t i, n_rx, idx = 0;
+
+    n_rx = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
+    if (!n_rx) {
+        return;
+    }
+
+    for (i = 0; i < n_rx; i++) {
+        const struct xdp_desc *desc = xsk_ring_cons__rx_desc(&s->rx, idx++);
+        struct iovec iov = {
+            .iov_base = xsk_umem__get_data(s->buffer, desc->addr),
+            .iov_len = desc->len,
+        };
+
+        /* The net queue copies what it cannot deliver right away */
+        s->pool[s->n_pool++] = desc->addr;
+
+        if (!qemu_sendv_packet_async(&s->nc, &iov, 1,
+                                     af_xdp_send_completed)) {
+            /*
+             * The peer does not receive anymore.  Packet is queued, stop
+             * reading from the backend until af_xdp_send_completed().
+             */
+            af_xdp_read_poll(s, false);
+
+            /* Give back the descriptors that were not looked at */
+            xsk_ring_cons__cancel(&s->rx, n_rx - i - 1);
+            n_rx = i + 1;
+            break;
+        }
+    }
+
+    xsk_ring_cons__release(&s->rx, n_rx);
+    af_xdp_fq_refill(s, AF_XDP_BATCH_SIZE);
+}
+
+/* Flush and close. */
+static void af_xdp_cleanup(NetClientState *nc)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    qemu_purge_queued_packets(nc);
+
+    af_xdp_poll(nc, false);
+
+    /* libxdp removes its default program when the last socket goes */
+    xsk_socket__delete(s->xsk);
+    s->xsk = NULL;
+    xsk_umem__delete(s->umem);
+    s->umem = NULL;
+    qemu_vfree(s->buffer);
+    s->buffer = NULL;
+    g_free(s->pool);
+    s->pool = NULL;
+}
+
+static int af_xdp_umem_create(AFXDPState *s, Error **errp)
+{
+    struct xsk_umem_config config = {
+        .fill_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+        .comp_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+        .frame_size = XSK_UMEM__DEFAULT_FRAME_SIZE,
+        .frame_headroom = 0,
+    };
+    uint64_t n_descs, size, i;
+    int ret;
+
+    /* Enough frames for all four rings to be full at the same time */
+    n_descs = (XSK_RING_PROD__DEFAULT_NUM_DESCS +
+               XSK_RING_CONS__DEFAULT_NUM_DESCS) * 2;
+    size = n_descs * XSK_UMEM__DEFAULT_FRAME_SIZE;
+
+    s->buffer = qemu_memalign(qemu_real_host_page_size, size);
+    memset(s->buffer, 0, size);
+
+    ret = xsk_umem__create(&s->umem, s->buffer, size, &s->fq, &s->cq,
+                           &config);
+    if (ret) {
+        qemu_vfree(s->buffer);
+        s->buffer = NULL;
+        error_setg_errno(errp, -ret, "failed to create UMEM for %s queue %d",
+                         s->ifname, s->nc.queue_index);
+        return -1;
+    }
+
+    /* Frame 0 ends up at the top of the stack */
+    s->pool = g_new(uint64_t, n_descs);
+    for (i = 0; i < n_descs; i++) {
+        s->pool[i] = (n_descs - 1 - i) * XSK_UMEM__DEFAULT_FRAME_SIZE;
+    }
+    s->n_pool = n_descs;
+
+    af_xdp_fq_refill(s, XSK_RING_PROD__DEFAULT_NUM_DESCS);
+    return 0;
+}
+
+static int af_xdp_socket_create(AFXDPState *s,
+                                const NetdevAFXDPOptions *opts, Error **errp)
+{
+    struct xsk_socket_config cfg = {
+        .rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+        .tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+        .libxdp_flags = 0,
+        .bind_flags = XDP_USE_NEED_WAKEUP,
+        .xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST,
+    };
+    int queue_id = s->nc.queue_index;
+    int ret;
+
+    if (opts->has_start_queue) {
+        queue_id += opts->start_queue;
+    }
+
+    /* Without either flag the kernel uses zero-copy if the driver can */
+    if (opts->has_force_copy && opts->force_copy) {
+        cfg.bind_flags |= XDP_COPY;
+    }
+
+    if (opts->has_mode) {
+        cfg.xdp_flags |= opts->mode == AFXDP_MODE_NATIVE ?
+                         XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+        ret = xsk_socket__create(&s->xsk, s->ifname, queue_id, s->umem,
+                                 &s->rx, &s->tx, &cfg);
+    } else {
+        /* Native mode if the driver supports XDP, generic otherwise */
+        cfg.xdp_flags |= XDP_FLAGS_DRV_MODE;
+        ret = xsk_socket__create(&s->xsk, s->ifname, queue_id, s->umem,
+                                 &s->rx, &s->tx, &cfg);
+        if (ret) {
+            cfg.xdp_flags &= ~XDP_FLAGS_DRV_MODE;
+            cfg.xdp_flags |= XDP_FLAGS_SKB_MODE;
+            ret = xsk_socket__create(&s->xsk, s->ifname, queue_id, s->umem,
+                                     &s->rx, &s->tx, &cfg);
+        }
+    }
+
+    if (ret) {
+        error_setg_errno(errp, -ret,
+                         "failed to create AF_XDP socket for %s queue %d",
+                         s->ifname, queue_id);
+        return -1;
+    }
+    return 0;
+}
+
+/* NetClientInfo methods */
+static NetClientInfo net_af_xdp_info = {
+    .type = NET_CLIENT_DRIVER_AF_XDP,
+    .size = sizeof(AFXDPState),
+    .receive = af_xdp_receive,
+    .poll = af_xdp_poll,
+    .cleanup = af_xdp_cleanup,
+    .flush_tx = af_xdp_flush_tx,
+};
+
+/*
+ * The exported init function
+ *
+ * ... -netdev af-xdp,ifname="..."
+ */
+int net_init_af_xdp(const Netdev *netdev,
+                    const char *name, NetClientState *peer, Error **errp)
+{
+    const NetdevAFXDPOptions *opts = &netdev->u.af_xdp;
+    NetClientState *nc, *nc0 = NULL;
+    unsigned int ifindex;
+    int64_t i, queues;
+    AFXDPState *s;
+
+    ifindex = if_nametoindex(opts->ifname);
+    if (!ifindex) {
+        error_setg_errno(errp, errno, "failed to get ifindex for '%s'",
+                         opts->ifname);
+        return -1;
+    }
+
+    queues = opts->has_queues ? opts->queues : 1;
+    if (queues < 1) {
+        error_setg(errp, "invalid number of queues (%" PRIi64 ") for '%s'",
+                   queues, opts->ifname);
+        return -1;
+    }
+    if (opts->has_start_queue && opts->start_queue < 0) {
+        error_setg(errp, "invalid start-queue (%" PRIi64 ") for '%s'",
+                   opts->start_queue, opts->ifname);
+        return -1;
+    }
+
+    for (i = 0; i < queues; i++) {
+        nc = qemu_new_net_client(&net_af_xdp_info, peer, "af-xdp", name);
+        nc->queue_index = i;
+        if (!nc0) {
+            nc0 = nc;
+        }
+
+        s = DO_UPCAST(AFXDPState, nc, nc);
+        pstrcpy(s->ifname, sizeof(s->ifname), opts->ifname);
+        snprintf(nc->info_str, sizeof(nc->info_str), "af-xdp: ifname=%s",
+                 s->ifname);
+
+        if (af_xdp_umem_create(s, errp) ||
+            af_xdp_socket_create(s, opts, errp)) {
+            goto err;
+        }
+        /* Initially only poll for reads. */
+        s->read_poll = true;
+        af_xdp_update_fd_handler(s);
+    }
+
+    return 0;
+
+err:
+    /* This deletes all the queues, which share the same name */
+    qemu_del_net_client(nc0);
+    return -1;
+}
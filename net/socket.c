@@ -33,6 +33,25 @@
 #include "qemu/sockets.h"
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
+
+#ifdef CONFIG_SENDMMSG
+/*
+ * SOCK_DGRAM packets are copied into a batch and sent with a single
+ * sendmmsg() at the end of the burst, or when the batch is full.
+ */
+#define NET_SOCKET_BATCH        32
+#define NET_SOCKET_BATCH_BYTES  (64 * KiB)
+
+typedef struct NetSocketBatch {
+    QEMUBH *bh;
+    int count;
+    size_t used;
+    struct mmsghdr msgs[NET_SOCKET_BATCH];
+    struct iovec iov[NET_SOCKET_BATCH];
+    uint8_t buf[NET_SOCKET_BATCH_BYTES];
+} NetSocketBatch;
+#endif
 
 typedef struct NetSocketState {
     NetClientState nc;
@@ -44,10 +63,14 @@ typedef struct NetSocketState {
     IOHandler *send_fn;           /* differs between SOCK_STREAM/SOCK_DGRAM */
     bool read_poll;               /* waiting to receive data? */
     bool write_poll;              /* waiting to transmit data? */
+#ifdef CONFIG_SENDMMSG
+    NetSocketBatch *batch;        /* only SOCK_DGRAM */
+#endif
 } NetSocketState;
 
 static void net_socket_accept(void *opaque);
 static void net_socket_writable(void *opaque);
+static bool net_socket_flush_batch(NetSocketState *s);
 
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
@@ -75,7 +98,9 @@ static void net_socket_writable(void *opaque)
 
     net_socket_write_poll(s, false);
 
-    qemu_flush_queued_packets(&s->nc);
+    if (net_socket_flush_batch(s)) {
+        qemu_flush_queued_packets(&s->nc);
+    }
 }
 
 static ssize_t net_socket_receive(NetClientState *nc, const uint8_t *buf, size_t size)
@@ -113,11 +138,117 @@ static ssize_t net_socket_receive(NetClientState *nc, const uint8_t *buf, size_t
     return size;
 }
 
+#ifdef CONFIG_SENDMMSG
+/*
+ * Send the batched packets.  Returns false if some are left because the
+ * socket is full; it is then polled for writing and the batch is sent
+ * again once it is writable.
+ */
+static bool net_socket_flush_batch(NetSocketState *s)
+{
+    NetSocketBatch *b = s->batch;
+    int done = 0, ret;
+
+    if (!b || !b->count) {
+        return true;
+    }
+    qemu_bh_cancel(b->bh);
+
+    while (done < b->count) {
+        ret = sendmmsg(s->fd, b->msgs + done, b->count - done, 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0 && errno == EAGAIN) {
+            break;
+        }
+        /* Like a failed sendto, drop the packet sendmmsg stopped at */
+        done += ret < 0 ? 1 : ret;
+    }
+
+    if (done < b->count) {
+        b->count -= done;
+        memmove(b->msgs, b->msgs + done, b->count * sizeof(b->msgs[0]));
+        memmove(b->iov, b->iov + done, b->count * sizeof(b->iov[0]));
+        for (ret = 0; ret < b->count; ret++) {
+            b->msgs[ret].msg_hdr.msg_iov = &b->iov[ret];
+        }
+        net_socket_write_poll(s, true);
+        return false;
+    }
+    b->count = 0;
+    b->used = 0;
+    return true;
+}
+
+static void net_socket_flush_bh(void *opaque)
+{
+    net_socket_flush_batch(opaque);
+}
+
+static void net_socket_flush_tx(NetClientState *nc)
+{
+    net_socket_flush_batch(DO_UPCAST(NetSocketState, nc, nc));
+}
+
+/* Returns false if the packet has to be sent on its own */
+static bool net_socket_batch_dgram(NetSocketState *s, const uint8_t *buf,
+                                   size_t size)
+{
+    NetSocketBatch *b = s->batch;
+    struct msghdr *hdr;
+
+    if (!b || size > NET_SOCKET_BATCH_BYTES) {
+        return false;
+    }
+    if ((b->count == NET_SOCKET_BATCH ||
+         b->used + size > NET_SOCKET_BATCH_BYTES) &&
+        !net_socket_flush_batch(s)) {
+        return false;
+    }
+
+    memcpy(b->buf + b->used, buf, size);
+    b->iov[b->count].iov_base = b->buf + b->used;
+    b->iov[b->count].iov_len = size;
+    hdr = &b->msgs[b->count].msg_hdr;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->msg_iov = &b->iov[b->count];
+    hdr->msg_iovlen = 1;
+    if (s->dgram_dst.sin_family != AF_UNIX) {
+        hdr->msg_name = &s->dgram_dst;
+        hdr->msg_namelen = sizeof(s->dgram_dst);
+    }
+    b->used += size;
+    if (b->count++ == 0) {
+        qemu_bh_schedule(b->bh);
+    }
+    return true;
+}
+#else
+static bool net_socket_flush_batch(NetSocketState *s)
+{
+    return true;
+}
+#endif
+
 static ssize_t net_socket_receive_dgram(NetClientState *nc, const uint8_t *buf, size_t size)
 {
     NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
     ssize_t ret;
 
+#ifdef CONFIG_SENDMMSG
+    if (s->batch && s->batch->count && s->write_poll) {
+        /* Keep the order; the net queue holds on to this one meanwhile */
+        return 0;
+    }
+    if (net_socket_batch_dgram(s, buf, size)) {
+        return size;
+    }
+    if (!net_socket_flush_batch(s)) {
+        return 0;
+    }
+#endif
+
     do {
         if (s->dgram_dst.sin_family != AF_UNIX) {
             ret = qemu_sendto(s->fd, buf, size, 0,
@@ -310,6 +441,7 @@ static void net_socket_cleanup(NetClientState *nc)
 {
     NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
     if (s->fd != -1) {
+        net_socket_flush_batch(s);
         net_socket_read_poll(s, false);
         net_socket_write_poll(s, false);
         close(s->fd);
@@ -320,6 +452,13 @@ static void net_socket_cleanup(NetClientState *nc)
         closesocket(s->listen_fd);
         s->listen_fd = -1;
     }
+#ifdef CONFIG_SENDMMSG
+    if (s->batch) {
+        qemu_bh_delete(s->batch->bh);
+        g_free(s->batch);
+        s->batch = NULL;
+    }
+#endif
 }
 
 static NetClientInfo net_dgram_socket_info = {
@@ -327,6 +466,9 @@ static NetClientInfo net_dgram_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
     .cleanup = net_socket_cleanup,
+#ifdef CONFIG_SENDMMSG
+    .flush_tx = net_socket_flush_tx,
+#endif
 };
 
 static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
@@ -384,6 +526,10 @@ static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
     s->send_fn = net_socket_send_dgram;
     net_socket_rs_init(&s->rs, net_socket_rs_finalize, false);
     net_socket_read_poll(s, true);
+#ifdef CONFIG_SENDMMSG
+    s->batch = g_new0(NetSocketBatch, 1);
+    s->batch->bh = qemu_bh_new(net_socket_flush_bh, s);
+#endif
 
     /* mcast: save bound address as dst */
     if (is_connected && mcast != NULL) {
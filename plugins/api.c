@@ -40,6 +40,7 @@
 #include "exec/exec-all.h"
 #include "exec/ram_addr.h"
 #include "disas/disas.h"
+#include "exec/gdbstub.h"
 #include "plugin.h"
 #ifndef CONFIG_USER_ONLY
 #include "qemu/plugin-memory.h"
@@ -83,17 +84,46 @@ void qemu_plugin_register_vcpu_tb_exec_cb(struct qemu_plugin_tb *tb,
                                           void *udata)
 {
     if (!tb->mem_only) {
-        plugin_register_dyn_cb__udata(&tb->cbs[PLUGIN_CB_REGULAR],
+        plugin_register_dyn_cb__udata(&tb->cbs[plugin_udata_cb_subtype(flags)],
                                       cb, flags, udata);
     }
 }
 
+void qemu_plugin_register_vcpu_tb_exec_sampled_cb(
+    struct qemu_plugin_tb *tb,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *udata)
+{
+    if (!tb->mem_only) {
+        plugin_register_dyn_cond_cb__udata(&tb->cbs[PLUGIN_CB_COND], cb, flags,
+                                           entry.score->data + entry.offset,
+                                           entry.score->stride, period, udata);
+    }
+}
+
 void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm)
 {
     if (!tb->mem_only) {
-        plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op, ptr, imm);
+        plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op, ptr,
+                                  0, imm);
+    }
+}
+
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm)
+{
+    if (!tb->mem_only) {
+        plugin_register_inline_op(&tb->cbs[PLUGIN_CB_INLINE], 0, op,
+                                  entry.score->data + entry.offset,
+                                  entry.score->stride, imm);
     }
 }
 
@@ -103,18 +133,49 @@ void qemu_plugin_register_vcpu_insn_exec_cb(struct qemu_plugin_insn *insn,
                                             void *udata)
 {
     if (!insn->mem_only) {
-        plugin_register_dyn_cb__udata(&insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_REGULAR],
+        enum plugin_dyn_cb_subtype type = plugin_udata_cb_subtype(flags);
+
+        plugin_register_dyn_cb__udata(&insn->cbs[PLUGIN_CB_INSN][type],
                                       cb, flags, udata);
     }
 }
 
+void qemu_plugin_register_vcpu_insn_exec_sampled_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *udata)
+{
+    if (!insn->mem_only) {
+        plugin_register_dyn_cond_cb__udata(
+            &insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND], cb, flags,
+            entry.score->data + entry.offset, entry.score->stride,
+            period, udata);
+    }
+}
+
 void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm)
 {
     if (!insn->mem_only) {
         plugin_register_inline_op(&insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE],
-                                  0, op, ptr, imm);
+                                  0, op, ptr, 0, imm);
+    }
+}
+
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm)
+{
+    if (!insn->mem_only) {
+        plugin_register_inline_op(&insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_INLINE],
+                                  0, op, entry.score->data + entry.offset,
+                                  entry.score->stride, imm);
     }
 }
 
@@ -139,7 +200,32 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           uint64_t imm)
 {
     plugin_register_inline_op(&insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE],
-                              rw, op, ptr, imm);
+                              rw, op, ptr, 0, imm);
+}
+
+struct qemu_plugin_mem_ring *
+qemu_plugin_mem_ring_new(size_t n_records, qemu_plugin_vcpu_mem_ring_cb_t cb,
+                         void *userdata)
+{
+    return plugin_mem_ring_new(n_records, cb, userdata);
+}
+
+void qemu_plugin_register_vcpu_mem_ring(struct qemu_plugin_insn *insn,
+                                        enum qemu_plugin_mem_rw rw,
+                                        struct qemu_plugin_mem_ring *ring)
+{
+    plugin_register_mem_ring(&insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_MEM_RING],
+                             &insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND],
+                             rw, ring);
+}
+
+void qemu_plugin_mem_ring_drain(struct qemu_plugin_mem_ring *ring)
+{
+    size_t i, n = plugin_scoreboard_alloc_size();
+
+    for (i = 0; i < n; i++) {
+        plugin_mem_ring_drain(i, ring);
+    }
 }
 
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
@@ -238,6 +324,66 @@ const char *qemu_plugin_insn_symbol(const struct qemu_plugin_insn *insn)
     return sym[0] != 0 ? sym : NULL;
 }
 
+/*
+ * Register access
+ *
+ * The registers are the ones the gdbstub describes, and a handle is
+ * the gdbstub register number plus one so that it is never NULL.
+ */
+
+struct qemu_plugin_register *
+qemu_plugin_find_register(unsigned int vcpu_index, const char *name)
+{
+    CPUState *cpu = qemu_get_cpu(vcpu_index);
+    g_autoptr(GArray) regs = NULL;
+    int i;
+
+    if (!cpu) {
+        return NULL;
+    }
+    regs = gdb_get_register_list(cpu);
+    for (i = 0; i < regs->len; i++) {
+        GDBRegDesc *desc = &g_array_index(regs, GDBRegDesc, i);
+
+        if (!g_ascii_strcasecmp(desc->name, name)) {
+            return GINT_TO_POINTER(desc->gdb_reg + 1);
+        }
+    }
+    return NULL;
+}
+
+int qemu_plugin_read_register(struct qemu_plugin_register *reg,
+                              void *buf, size_t size)
+{
+    static __thread GByteArray *val;
+    CPUState *cpu = current_cpu;
+    int len;
+
+    if (!cpu) {
+        return -1;
+    }
+    if (!reg) {
+        return 0;
+    }
+    if (!val) {
+        val = g_byte_array_new();
+    }
+    g_byte_array_set_size(val, 0);
+    len = gdb_read_register(cpu, val, GPOINTER_TO_INT(reg) - 1);
+    memcpy(buf, val->data, MIN(size, len));
+    return len;
+}
+
+bool qemu_plugin_read_memory_vaddr(uint64_t addr, void *buf, size_t len)
+{
+    CPUState *cpu = current_cpu;
+
+    if (!cpu) {
+        return false;
+    }
+    return cpu_memory_rw_debug(cpu, addr, buf, len, false) == 0;
+}
+
 /*
  * The memory queries allow the plugin to query information about a
  * memory access.
@@ -379,6 +525,44 @@ int qemu_plugin_n_max_vcpus(void)
 #endif
 }
 
+/*
+ * Scoreboards
+ */
+
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size)
+{
+    return plugin_scoreboard_new(element_size);
+}
+
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    plugin_scoreboard_free(score);
+}
+
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < plugin_scoreboard_alloc_size());
+    return score->data + vcpu_index * score->stride;
+}
+
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index)
+{
+    return *(uint64_t *)(qemu_plugin_scoreboard_find(entry.score, vcpu_index) +
+                         entry.offset);
+}
+
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry)
+{
+    size_t i, n = plugin_scoreboard_alloc_size();
+    uint64_t total = 0;
+
+    for (i = 0; i < n; i++) {
+        total += qemu_plugin_u64_get(entry, i);
+    }
+    return total;
+}
+
 /*
  * Plugin output
  */
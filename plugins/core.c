@@ -210,10 +210,112 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/* Number of vCPU entries to allocate before any vCPU is created */
+static size_t plugin_scoreboard_min_size(void)
+{
+    int n = qemu_plugin_n_max_vcpus();
+
+    return n > 0 ? n : 1;
+}
+
+static void *plugin_scoreboard_alloc(const struct qemu_plugin_scoreboard *score,
+                                     size_t n)
+{
+    void *data = qemu_memalign(qemu_dcache_linesize, score->stride * n);
+
+    memset(data, 0, score->stride * n);
+    return data;
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score;
+
+    score = g_new0(struct qemu_plugin_scoreboard, 1);
+    score->element_size = element_size;
+    score->stride = ROUND_UP(MAX(element_size, 1), qemu_dcache_linesize);
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    plugin.scoreboard_alloc_size = MAX(plugin.scoreboard_alloc_size,
+                                       plugin_scoreboard_min_size());
+    score->data = plugin_scoreboard_alloc(score, plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    QEMU_LOCK_GUARD(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_vfree(score->data);
+    g_free(score);
+}
+
+size_t plugin_scoreboard_alloc_size(void)
+{
+    return qatomic_read(&plugin.scoreboard_alloc_size);
+}
+
+/*
+ * Make room for @cpu in the scoreboards.  Only user mode, whose number of
+ * vCPUs is unbounded, ever gets here with scoreboards to move; it creates
+ * vCPUs from the thread of another vCPU, outside of cpu_exec.
+ *
+ * The other vCPUs may need plugin.lock before they can leave cpu_exec, so
+ * the lock is not held while waiting for them in start_exclusive().
+ */
+static void plugin_grow_scoreboards(CPUState *cpu)
+{
+    struct qemu_plugin_scoreboard *score;
+    size_t old_size, new_size;
+    bool moved = false;
+
+    if (cpu->cpu_index < plugin_scoreboard_alloc_size()) {
+        return;
+    }
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (QLIST_EMPTY(&plugin.scoreboards)) {
+        old_size = plugin.scoreboard_alloc_size;
+        new_size = MAX(MAX(cpu->cpu_index + 1, old_size * 2),
+                       plugin_scoreboard_min_size());
+        qatomic_set(&plugin.scoreboard_alloc_size, new_size);
+        qemu_rec_mutex_unlock(&plugin.lock);
+        return;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_assert(current_cpu);
+    start_exclusive();
+    qemu_rec_mutex_lock(&plugin.lock);
+    /* another vCPU may have grown them, or started a scoreboard, meanwhile */
+    old_size = plugin.scoreboard_alloc_size;
+    if (cpu->cpu_index >= old_size) {
+        new_size = MAX(MAX(cpu->cpu_index + 1, old_size * 2),
+                       plugin_scoreboard_min_size());
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            void *data = plugin_scoreboard_alloc(score, new_size);
+
+            memcpy(data, score->data, score->stride * old_size);
+            qemu_vfree(score->data);
+            score->data = data;
+            moved = true;
+        }
+        qatomic_set(&plugin.scoreboard_alloc_size, new_size);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+    if (moved) {
+        /* drop the code that still points to the old arrays */
+        tb_flush(current_cpu);
+    }
+    end_exclusive();
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_grow_scoreboards(cpu);
     qemu_rec_mutex_lock(&plugin.lock);
     plugin_cpu_update__locked(&cpu->cpu_index, NULL, NULL);
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
@@ -282,7 +384,7 @@ static struct qemu_plugin_dyn_cb *plugin_get_dyn_cb(GArray **arr)
 void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_mem_rw rw,
                                enum qemu_plugin_op op, void *ptr,
-                               uint64_t imm)
+                               size_t stride, uint64_t imm)
 {
     struct qemu_plugin_dyn_cb *dyn_cb;
 
@@ -292,6 +394,7 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->rw = rw;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
+    dyn_cb->inline_insn.stride = stride;
 }
 
 void plugin_register_dyn_cb__udata(GArray **arr,
@@ -301,10 +404,109 @@ void plugin_register_dyn_cb__udata(GArray **arr,
 {
     struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
 
+    dyn_cb->userp = udata;
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = plugin_udata_cb_subtype(flags);
+}
+
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        void *ptr, size_t stride,
+                                        uint64_t period, void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
     dyn_cb->userp = udata;
     /* Note flags are discarded as unused. */
     dyn_cb->f.vcpu_udata = cb;
-    dyn_cb->type = PLUGIN_CB_REGULAR;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.ptr = ptr;
+    dyn_cb->cond.stride = stride;
+    dyn_cb->cond.imm = 1;
+    dyn_cb->cond.period = period;
+    dyn_cb->cond.reset = true;
+}
+
+struct qemu_plugin_mem_ring *
+plugin_mem_ring_new(size_t n_records, qemu_plugin_vcpu_mem_ring_cb_t cb,
+                    void *userdata)
+{
+    struct qemu_plugin_mem_ring *ring = g_new0(struct qemu_plugin_mem_ring, 1);
+
+    ring->size = pow2ceil(MAX(n_records, 2 * PLUGIN_MEM_RING_SLACK));
+    ring->score = plugin_scoreboard_new(sizeof(struct plugin_mem_ring_head) +
+                                        ring->size *
+                                        sizeof(qemu_plugin_mem_record));
+    ring->cb = cb;
+    ring->userdata = userdata;
+    return ring;
+}
+
+/* Hand the records of @cpu_index in the ring @udata to the plugin */
+void plugin_mem_ring_drain(unsigned int cpu_index, void *udata)
+{
+    struct qemu_plugin_mem_ring *ring = udata;
+    struct plugin_mem_ring_head *h;
+    size_t n;
+
+    h = ring->score->data + cpu_index * ring->score->stride;
+    n = MIN(h->head, ring->size);
+    if (n) {
+        ring->cb(cpu_index, h->records, n, ring->userdata);
+    }
+    h->head = 0;
+}
+
+/* The slow path, for the accesses made by helpers */
+static void plugin_mem_ring_append(struct qemu_plugin_mem_ring *ring,
+                                   unsigned int cpu_index, uint64_t vaddr,
+                                   qemu_plugin_meminfo_t info)
+{
+    struct plugin_mem_ring_head *h;
+    qemu_plugin_mem_record *r;
+
+    h = ring->score->data + cpu_index * ring->score->stride;
+    r = &h->records[h->head++ & (ring->size - 1)];
+    r->vaddr = vaddr;
+    r->info = info;
+    if (h->head >= ring->size - PLUGIN_MEM_RING_SLACK) {
+        plugin_mem_ring_drain(cpu_index, ring);
+    }
+}
+
+/*
+ * The accesses of the instruction append to the ring inline, and a check
+ * at its start drains the ring if it may not have room for them.
+ */
+void plugin_register_mem_ring(GArray **mem_arr, GArray **cond_arr,
+                              enum qemu_plugin_mem_rw rw,
+                              struct qemu_plugin_mem_ring *ring)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(mem_arr);
+    size_t i;
+
+    dyn_cb->userp = ring;
+    dyn_cb->type = PLUGIN_CB_MEM_RING;
+    dyn_cb->rw = rw;
+
+    for (i = 0; *cond_arr && i < (*cond_arr)->len; i++) {
+        dyn_cb = &g_array_index(*cond_arr, struct qemu_plugin_dyn_cb, i);
+        if (dyn_cb->f.vcpu_udata == plugin_mem_ring_drain &&
+            dyn_cb->userp == ring) {
+            return;
+        }
+    }
+    dyn_cb = plugin_get_dyn_cb(cond_arr);
+    dyn_cb->userp = ring;
+    dyn_cb->f.vcpu_udata = plugin_mem_ring_drain;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.ptr = ring->score->data +
+                       offsetof(struct plugin_mem_ring_head, head);
+    dyn_cb->cond.stride = ring->score->stride;
+    dyn_cb->cond.imm = 0;
+    dyn_cb->cond.period = ring->size - PLUGIN_MEM_RING_SLACK;
+    dyn_cb->cond.reset = false;
 }
 
 void plugin_register_vcpu_mem_cb(GArray **arr,
@@ -432,9 +634,9 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, unsigned int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    uint64_t *val = cb->userp + cpu_index * cb->inline_insn.stride;
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
@@ -467,7 +669,11 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
+            break;
+        case PLUGIN_CB_MEM_RING:
+            plugin_mem_ring_append(cb->userp, cpu->cpu_index, vaddr,
+                                   make_plugin_meminfo(oi, rw));
             break;
         default:
             g_assert_not_reached();
@@ -552,6 +758,7 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QTAILQ_INIT(&plugin.ctxs);
+    QLIST_INIT(&plugin.scoreboards);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
     atexit(qemu_plugin_atexit_cb);
@@ -44,6 +44,13 @@ struct qemu_plugin_state {
      * the code cache is flushed.
      */
     struct qht dyn_cb_arr_ht;
+    /*
+     * Scoreboards and the number of vCPU entries each of them has room
+     * for.  Generated code embeds their addresses, so they only move with
+     * all vCPUs stopped and the code cache flushed.
+     */
+    QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    size_t scoreboard_alloc_size;
 };
 
 
@@ -67,7 +74,7 @@ struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id);
 void plugin_register_inline_op(GArray **arr,
                                enum qemu_plugin_mem_rw rw,
                                enum qemu_plugin_op op, void *ptr,
-                               uint64_t imm);
+                               size_t stride, uint64_t imm);
 
 void plugin_reset_uninstall(qemu_plugin_id_t id,
                             qemu_plugin_simple_cb_t cb,
@@ -83,18 +90,52 @@ void
 plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
                          void *func, void *udata);
 
+/*
+ * Callbacks that look at the registers need the TCG globals synced back
+ * to env before they run; the others are left without that cost.
+ */
+static inline enum plugin_dyn_cb_subtype
+plugin_udata_cb_subtype(enum qemu_plugin_cb_flags flags)
+{
+    return flags == QEMU_PLUGIN_CB_NO_REGS ? PLUGIN_CB_REGULAR
+                                           : PLUGIN_CB_REGULAR_R;
+}
+
 void
 plugin_register_dyn_cb__udata(GArray **arr,
                               qemu_plugin_vcpu_udata_cb_t cb,
                               enum qemu_plugin_cb_flags flags, void *udata);
 
 
+void
+plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                   qemu_plugin_vcpu_udata_cb_t cb,
+                                   enum qemu_plugin_cb_flags flags,
+                                   void *ptr, size_t stride, uint64_t period,
+                                   void *udata);
+
+void plugin_register_mem_ring(GArray **mem_arr, GArray **cond_arr,
+                              enum qemu_plugin_mem_rw rw,
+                              struct qemu_plugin_mem_ring *ring);
+
+struct qemu_plugin_mem_ring *
+plugin_mem_ring_new(size_t n_records, qemu_plugin_vcpu_mem_ring_cb_t cb,
+                    void *userdata);
+
+void plugin_mem_ring_drain(unsigned int cpu_index, void *udata);
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb);
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, unsigned int cpu_index);
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+size_t plugin_scoreboard_alloc_size(void);
 
 #endif /* _PLUGIN_INTERNAL_H_ */
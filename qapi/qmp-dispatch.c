@@ -25,6 +25,7 @@
 #include "qapi/qmp/qbool.h"
 #include "qemu/coroutine.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 
 Visitor *qobject_input_visitor_new_qmp(QObject *obj)
 {
@@ -131,6 +132,19 @@ static void do_qmp_dispatch_bh(void *opaque)
     aio_co_wake(data->co);
 }
 
+/*
+ * The statistics are the only part of a registered command that changes
+ * after startup; out-of-band commands update them concurrently.
+ */
+static void qmp_command_account(const QmpCommand *cmd, int64_t ns)
+{
+    QmpCommand *c = (QmpCommand *)cmd;
+
+    stat64_add(&c->calls, 1);
+    stat64_add(&c->total_ns, ns);
+    stat64_max(&c->max_ns, ns);
+}
+
 /*
  * Runs outside of coroutine context for OOB commands, but in coroutine
  * context for everything else.
@@ -147,6 +161,7 @@ QDict *qmp_dispatch(const QmpCommandList *cmds, QObject *request,
     QObject *id;
     QObject *ret = NULL;
     QDict *rsp = NULL;
+    int64_t start;
 
     dict = qobject_to(QDict, request);
     if (!dict) {
@@ -206,6 +221,7 @@ QDict *qmp_dispatch(const QmpCommandList *cmds, QObject *request,
 
     assert(!(oob && qemu_in_coroutine()));
     assert(monitor_cur() == NULL);
+    start = get_clock();
     if (!!(cmd->options & QCO_COROUTINE) == qemu_in_coroutine()) {
         monitor_set_cur(qemu_coroutine_self(), cur_mon);
         cmd->fn(args, &ret, &err);
@@ -237,6 +253,7 @@ QDict *qmp_dispatch(const QmpCommandList *cmds, QObject *request,
                                 &data);
         qemu_coroutine_yield();
     }
+    qmp_command_account(cmd, get_clock() - start);
     qobject_unref(args);
     if (err) {
         /* or assert(!ret) after reviewing all handlers: */
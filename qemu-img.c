@@ -41,6 +41,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu/sockets.h"
+#include "qemu/timer.h"
 #include "qemu/units.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/block-backend.h"
@@ -51,6 +52,8 @@
 #include "trace/control.h"
 #include "qemu/throttle.h"
 #include "block/throttle-groups.h"
+#include "qemu/bitmap.h"
+#include "migration/snapshot-ram.h"
 
 #define QEMU_IMG_VERSION "qemu-img version " QEMU_FULL_VERSION \
                           "\n" QEMU_COPYRIGHT "\n"
@@ -83,6 +86,7 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_STATS = 278,
 };
 
 typedef enum OutputFormat {
@@ -1638,6 +1642,7 @@ typedef struct ImgConvertState {
     BlockBackend *target;
     bool has_zero_init;
     bool compressed;
+    bool compress_part;         /* target compresses requests in parallel */
     bool target_is_new;
     bool target_has_backing;
     int64_t target_backing_sectors; /* negative if unknown */
@@ -1655,6 +1660,13 @@ typedef struct ImgConvertState {
     int64_t wait_sector_num[MAX_COROUTINES];
     CoMutex lock;
     int ret;
+
+    /* Per-stage statistics, for --stats */
+    int64_t read_bytes;
+    int64_t read_ns;
+    int64_t zero_bytes;
+    int64_t write_bytes;
+    int64_t write_ns;
 } ImgConvertState;
 
 static void convert_select_part(ImgConvertState *s, int64_t sector_num,
@@ -1829,6 +1841,30 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
 }
 
 
+/*
+ * Return how many sectors from @buf, up to @nb_sectors, are in whole
+ * clusters that are all zero, or all not zero, like the first one, and
+ * set *@zero accordingly.
+ */
+static int convert_compressed_run(ImgConvertState *s, const uint8_t *buf,
+                                  int nb_sectors, bool *zero)
+{
+    int run = 0;
+
+    *zero = buffer_is_zero(buf, MIN(s->cluster_sectors, nb_sectors) *
+                                BDRV_SECTOR_SIZE);
+    while (run < nb_sectors) {
+        int n = MIN(s->cluster_sectors, nb_sectors - run);
+
+        if (run && buffer_is_zero(buf + run * BDRV_SECTOR_SIZE,
+                                  n * BDRV_SECTOR_SIZE) != *zero) {
+            break;
+        }
+        run += n;
+    }
+    return run;
+}
+
 static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                          int nb_sectors, uint8_t *buf,
                                          enum ImgConvertBlockStatus status)
@@ -1838,6 +1874,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
     while (nb_sectors > 0) {
         int n = nb_sectors;
         BdrvRequestFlags flags = s->compressed ? BDRV_REQ_WRITE_COMPRESSED : 0;
+        bool zero = false;
 
         switch (status) {
         case BLK_BACKING_FILE:
@@ -1852,25 +1889,29 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
              * is real non-zero data, we must write it. Otherwise we can treat
              * it as zero sectors.
              * Compressed clusters need to be written as a whole, so in that
-             * case we can only save the write if the buffer is completely
-             * zeroed. */
+             * case we can only save the write of clusters that are
+             * completely zeroed. */
+            if (s->compressed && s->min_sparse) {
+                n = convert_compressed_run(s, buf, n, &zero);
+            }
             if (!s->min_sparse ||
                 (!s->compressed &&
                  is_allocated_sectors_min(buf, n, &n, s->min_sparse,
                                           sector_num, s->alignment)) ||
-                (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
+                (s->compressed && !zero))
             {
                 ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
                                     n << BDRV_SECTOR_BITS, buf, flags);
                 if (ret < 0) {
                     return ret;
                 }
+                s->write_bytes += (int64_t)n * BDRV_SECTOR_SIZE;
                 break;
             }
             /* fall-through */
 
         case BLK_ZERO:
+            s->zero_bytes += (int64_t)n * BDRV_SECTOR_SIZE;
             if (s->has_zero_init) {
                 assert(!s->target_has_backing);
                 break;
@@ -1979,7 +2020,11 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
 retry:
         copy_range = s->copy_range && s->status == BLK_DATA;
         if (status == BLK_DATA && !copy_range) {
+            int64_t start = get_clock();
+
             ret = convert_co_read(s, sector_num, n, buf);
+            s->read_ns += get_clock() - start;
+            s->read_bytes += (int64_t)n * BDRV_SECTOR_SIZE;
             if (ret < 0) {
                 error_report("error while reading at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
@@ -2000,15 +2045,19 @@ retry:
         }
 
         if (s->ret == -EINPROGRESS) {
+            int64_t start = get_clock();
+
             if (copy_range) {
                 ret = convert_co_copy_range(s, sector_num, n);
                 if (ret) {
                     s->copy_range = false;
                     goto retry;
                 }
+                s->write_bytes += (int64_t)n * BDRV_SECTOR_SIZE;
             } else {
                 ret = convert_co_write(s, sector_num, n, buf, status);
             }
+            s->write_ns += get_clock() - start;
             if (ret < 0) {
                 error_report("error while writing at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
@@ -2055,13 +2104,19 @@ static int convert_do_copy(ImgConvertState *s)
     }
 
     /* Allocate buffer for copied data. For compressed images, only one cluster
-     * can be copied at a time. */
+     * can be copied at a time, unless the target compresses the clusters of
+     * a request in parallel. */
     if (s->compressed) {
         if (s->cluster_sectors <= 0 || s->cluster_sectors > s->buf_sectors) {
             error_report("invalid cluster size");
             return -EINVAL;
         }
-        s->buf_sectors = s->cluster_sectors;
+        if (s->compress_part) {
+            s->buf_sectors = QEMU_ALIGN_DOWN(s->buf_sectors,
+                                             s->cluster_sectors);
+        } else {
+            s->buf_sectors = s->cluster_sectors;
+        }
     }
 
     while (sector_num < s->total_sectors) {
@@ -2102,6 +2157,33 @@ static int convert_do_copy(ImgConvertState *s)
     return s->ret;
 }
 
+static void convert_print_stage(const char *stage, int64_t bytes,
+                                int64_t busy_ns, int64_t elapsed_ns,
+                                long num_coroutines)
+{
+    g_autofree char *size = size_to_str(bytes);
+
+    printf("%-6s %10s, %8.2f MiB/s, coroutines busy %5.1f%%\n", stage, size,
+           elapsed_ns ? (double)bytes / MiB * NANOSECONDS_PER_SECOND /
+                        elapsed_ns : 0,
+           elapsed_ns ? 100.0 * busy_ns / elapsed_ns / num_coroutines : 0);
+}
+
+/*
+ * With --stats, show the throughput of each stage, and how much of the time the
+ * copy coroutines spent in it, so that the slow one stands out
+ */
+static void convert_print_stats(ImgConvertState *s, int64_t elapsed_ns)
+{
+    g_autofree char *zero = size_to_str(s->zero_bytes);
+
+    convert_print_stage("read", s->read_bytes, s->read_ns, elapsed_ns,
+                        s->num_coroutines);
+    printf("%-6s %10s\n", "zero", zero);
+    convert_print_stage(s->compressed ? "comp" : "write", s->write_bytes,
+                        s->write_ns, elapsed_ns, s->num_coroutines);
+}
+
 /* Check that bitmaps can be copied, or output an error */
 static int convert_check_bitmaps(BlockDriverState *src, bool skip_broken)
 {
@@ -2201,6 +2283,8 @@ static int img_convert(int argc, char **argv)
     bool bitmaps = false;
     bool skip_broken = false;
     int64_t rate_limit = 0;
+    bool stats = false;
+    int64_t convert_start, convert_ns = -1;
 
     ImgConvertState s = (ImgConvertState) {
         /* Need at least 4k of zeros for sparse detection */
@@ -2222,6 +2306,7 @@ static int img_convert(int argc, char **argv)
             {"target-is-zero", no_argument, 0, OPTION_TARGET_IS_ZERO},
             {"bitmaps", no_argument, 0, OPTION_BITMAPS},
             {"skip-broken-bitmaps", no_argument, 0, OPTION_SKIP_BROKEN},
+            {"stats", no_argument, 0, OPTION_STATS},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:CcF:o:l:S:pt:T:qnm:WUr:",
@@ -2356,6 +2441,9 @@ static int img_convert(int argc, char **argv)
         case OPTION_SKIP_BROKEN:
             skip_broken = true;
             break;
+        case OPTION_STATS:
+            stats = true;
+            break;
         }
     }
 
@@ -2671,6 +2759,7 @@ static int img_convert(int argc, char **argv)
         ret = -1;
         goto out;
     }
+    s.compress_part = !!out_bs->drv->bdrv_co_pwritev_compressed_part;
 
     /* increase bufsectors from the default 4096 (2M) if opt_transfer
      * or discard_alignment of the out_bs is greater. Limit to
@@ -2728,7 +2817,11 @@ static int img_convert(int argc, char **argv)
         set_rate_limit(s.target, rate_limit);
     }
 
+    convert_start = get_clock();
     ret = convert_do_copy(&s);
+    if (stats && !s.quiet && ret == 0) {
+        convert_ns = get_clock() - convert_start;
+    }
 
     /* Now copy the bitmaps */
     if (bitmaps && ret == 0) {
@@ -2740,6 +2833,9 @@ out:
         qemu_progress_print(100, 0);
     }
     qemu_progress_end();
+    if (!ret && convert_ns >= 0) {
+        convert_print_stats(&s, convert_ns);
+    }
     qemu_opts_del(opts);
     qemu_opts_free(create_opts);
     qobject_unref(open_opts);
@@ -3052,8 +3148,48 @@ static int dump_map_entry(OutputFormat output_format, MapEntry *e,
     return 0;
 }
 
-static int get_block_status(BlockDriverState *bs, int64_t offset,
-                            int64_t bytes, MapEntry *e)
+#define MAP_STATUS_EXTENTS 256
+
+/* Block status of the top image, queried for many extents at once */
+typedef struct MapStatus {
+    BlockStatusExtent extents[MAP_STATUS_EXTENTS];
+    int count;
+    int index;
+} MapStatus;
+
+static int map_top_status(BlockDriverState *bs, MapStatus *status,
+                          int64_t offset, int64_t bytes, int64_t *pnum,
+                          int64_t *map, BlockDriverState **file)
+{
+    BlockStatusExtent *e;
+    int ret;
+
+    for (; status->index < status->count; status->index++) {
+        e = &status->extents[status->index];
+        if (offset >= e->offset && offset < e->offset + e->bytes) {
+            goto found;
+        }
+    }
+
+    ret = bdrv_block_status_above_batch(bs, bdrv_filter_or_cow_bs(bs), false,
+                                        true, offset, bytes, status->extents,
+                                        MAP_STATUS_EXTENTS);
+    status->count = MAX(ret, 0);
+    status->index = 0;
+    if (ret <= 0) {
+        return ret < 0 ? ret : -EIO;
+    }
+    e = &status->extents[0];
+
+found:
+    *pnum = MIN(bytes, e->offset + e->bytes - offset);
+    *map = e->map + (offset - e->offset);
+    *file = e->file;
+    return e->ret;
+}
+
+static int get_block_status(BlockDriverState *bs, MapStatus *status,
+                            int64_t offset, int64_t bytes, MapEntry *e)
 {
     int ret;
     int depth;
@@ -3068,9 +3204,9 @@ static int get_block_status(BlockDriverState *bs, int64_t offset,
      */
 
     depth = 0;
+    bs = bdrv_skip_filters(bs);
+    ret = map_top_status(bs, status, offset, bytes, &bytes, &map, &file);
     for (;;) {
-        bs = bdrv_skip_filters(bs);
-        ret = bdrv_block_status(bs, offset, bytes, &bytes, &map, &file);
         if (ret < 0) {
             return ret;
         }
@@ -3085,6 +3221,8 @@ static int get_block_status(BlockDriverState *bs, int64_t offset,
         }
 
         depth++;
+        bs = bdrv_skip_filters(bs);
+        ret = bdrv_block_status(bs, offset, bytes, &bytes, &map, &file);
     }
 
     has_offset = !!(ret & BDRV_BLOCK_OFFSET_VALID);
@@ -3141,6 +3279,7 @@ static int img_map(int argc, char **argv)
     const char *filename, *fmt, *output;
     int64_t length;
     MapEntry curr = { .length = 0 }, next;
+    g_autofree MapStatus *status = g_new0(MapStatus, 1);
     int ret = 0;
     bool image_opts = false;
     bool force_share = false;
@@ -3246,7 +3385,7 @@ static int img_map(int argc, char **argv)
         int64_t offset = curr.start + curr.length;
         int64_t n = length - offset;
 
-        ret = get_block_status(bs, offset, n, &next);
+        ret = get_block_status(bs, status, offset, n, &next);
         if (ret < 0) {
             error_report("Could not read file metadata: %s", strerror(-ret));
             goto out;
@@ -3434,6 +3573,360 @@ static int img_snapshot(int argc, char **argv)
     return 0;
 }
 
+/*
+ * Guest RAM of a snapshot taken with the parallel-snapshot capability,
+ * read from the VM state or from the RAM file.
+ */
+#define SNAPSHOT_DIFF_BUF_SIZE (8 * MiB)
+
+typedef struct SnapshotDiffBlock {
+    char idstr[256];
+    uint64_t length;
+    uint64_t offset;
+    uint64_t nr_chunks;
+    unsigned long *bitmap;
+} SnapshotDiffBlock;
+
+typedef struct SnapshotDiffRAM {
+    BlockBackend *blk;
+    const char *name;
+    int fd;
+    uint32_t nr_blocks;
+    SnapshotDiffBlock *blocks;
+} SnapshotDiffRAM;
+
+static void snapshot_diff_close(SnapshotDiffRAM *r)
+{
+    uint32_t i;
+
+    for (i = 0; i < r->nr_blocks; i++) {
+        g_free(r->blocks[i].bitmap);
+    }
+    g_free(r->blocks);
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    blk_unref(r->blk);
+}
+
+static int snapshot_diff_open(SnapshotDiffRAM *r, bool image_opts,
+                              const char *filename, const char *fmt,
+                              bool force_share, const char *name)
+{
+    g_autofree uint8_t *header = NULL;
+    SnapshotRAMHeader h;
+    Error *err = NULL;
+    size_t size, pos;
+    uint32_t i;
+
+    r->name = name;
+    r->fd = -1;
+    r->blk = img_open(image_opts, filename, fmt, 0, false, false,
+                      force_share);
+    if (!r->blk) {
+        return -1;
+    }
+    bdrv_snapshot_load_tmp_by_id_or_name(blk_bs(r->blk), name, &err);
+    if (err) {
+        error_reportf_err(err, "Failed to load snapshot '%s': ", name);
+        return -1;
+    }
+
+    if (blk_load_vmstate(r->blk, (uint8_t *)&h, 0, sizeof(h)) < 0 ||
+        memcmp(h.magic, SNAPSHOT_RAM_MAGIC, sizeof(h.magic))) {
+        error_report("Snapshot '%s' was not taken with the "
+                     "parallel-snapshot capability", name);
+        return -1;
+    }
+    if (be32_to_cpu(h.version) != SNAPSHOT_RAM_VERSION ||
+        be64_to_cpu(h.chunk_size) != SNAPSHOT_RAM_CHUNK) {
+        error_report("Snapshot '%s' has an unsupported RAM layout", name);
+        return -1;
+    }
+    size = be64_to_cpu(h.header_size);
+    if (size < sizeof(h) || size > INT_MAX) {
+        goto bad_header;
+    }
+    header = g_malloc(size);
+    if (blk_load_vmstate(r->blk, header, 0, size) < 0) {
+        error_report("Could not read the RAM header of snapshot '%s'", name);
+        return -1;
+    }
+
+    pos = sizeof(h);
+    if (h.file_len) {
+        g_autofree char *file = NULL;
+        uint16_t len = be16_to_cpu(h.file_len);
+        SnapshotRAMFileHeader fh;
+
+        if (pos + len > size) {
+            goto bad_header;
+        }
+        file = g_strndup((char *)header + pos, len);
+        pos += len;
+        r->fd = qemu_open(file, O_RDONLY, &err);
+        if (r->fd < 0) {
+            error_reportf_err(err, "Snapshot '%s': ", name);
+            return -1;
+        }
+        if (pread(r->fd, &fh, sizeof(fh), 0) != sizeof(fh) ||
+            memcmp(fh.magic, SNAPSHOT_RAM_FILE_MAGIC, sizeof(fh.magic)) ||
+            !qemu_uuid_is_equal(&fh.uuid, &h.file_uuid)) {
+            error_report("'%s' does not hold the RAM of snapshot '%s'",
+                         file, name);
+            return -1;
+        }
+    }
+
+    r->nr_blocks = be32_to_cpu(h.nr_blocks);
+    r->blocks = g_new0(SnapshotDiffBlock, r->nr_blocks);
+    for (i = 0; i < r->nr_blocks; i++) {
+        SnapshotDiffBlock *b = &r->blocks[i];
+        SnapshotRAMHeaderBlock hb;
+
+        if (pos + sizeof(hb) > size) {
+            goto bad_header;
+        }
+        memcpy(&hb, header + pos, sizeof(hb));
+        pos += sizeof(hb);
+        if (pos + hb.idlen > size) {
+            goto bad_header;
+        }
+        memcpy(b->idstr, header + pos, hb.idlen);
+        pos += hb.idlen;
+        b->length = be64_to_cpu(hb.length);
+        b->offset = be64_to_cpu(hb.offset);
+        b->nr_chunks = DIV_ROUND_UP(b->length, SNAPSHOT_RAM_CHUNK);
+        b->bitmap = bitmap_new(b->nr_chunks);
+    }
+    for (i = 0; i < r->nr_blocks; i++) {
+        SnapshotDiffBlock *b = &r->blocks[i];
+        size_t bitmap_size = BITS_TO_LONGS(b->nr_chunks) * sizeof(long);
+
+        if (pos + bitmap_size > size) {
+            goto bad_header;
+        }
+        bitmap_from_le(b->bitmap, (unsigned long *)(header + pos),
+                       b->nr_chunks);
+        pos += bitmap_size;
+    }
+    return 0;
+
+bad_header:
+    error_report("Snapshot '%s' has a corrupted RAM header", name);
+    return -1;
+}
+
+static SnapshotDiffBlock *snapshot_diff_find(SnapshotDiffRAM *r,
+                                             const char *idstr)
+{
+    uint32_t i;
+
+    for (i = 0; i < r->nr_blocks; i++) {
+        if (!strcmp(r->blocks[i].idstr, idstr)) {
+            return &r->blocks[i];
+        }
+    }
+    return NULL;
+}
+
+/* Read [@offset, @offset + @len) of @b, which starts on a chunk */
+static int snapshot_diff_read(SnapshotDiffRAM *r, SnapshotDiffBlock *b,
+                              uint64_t offset, uint8_t *buf, size_t len)
+{
+    uint64_t chunk = offset / SNAPSHOT_RAM_CHUNK;
+    uint64_t last = DIV_ROUND_UP(offset + len, SNAPSHOT_RAM_CHUNK);
+    uint64_t i;
+
+    if (find_next_bit(b->bitmap, last, chunk) == last) {
+        memset(buf, 0, len);
+        return 0;
+    }
+    if (r->fd >= 0) {
+        if (pread(r->fd, buf, len, b->offset + offset) != len) {
+            return -1;
+        }
+    } else if (blk_load_vmstate(r->blk, buf, b->offset + offset, len) < 0) {
+        return -1;
+    }
+    /* zero chunks are not written, whatever the image holds there */
+    for (i = chunk; i < last; i++) {
+        if (!test_bit(i, b->bitmap)) {
+            size_t start = (i - chunk) * SNAPSHOT_RAM_CHUNK;
+
+            memset(buf + start, 0, MIN(SNAPSHOT_RAM_CHUNK, len - start));
+        }
+    }
+    return 0;
+}
+
+static void snapshot_diff_print(const char *idstr, uint64_t start,
+                                uint64_t end)
+{
+    printf("%-24s 0x%016" PRIx64 " 0x%016" PRIx64 "\n",
+           idstr, start, end - start);
+}
+
+/* Print the ranges of @b1 and @b2 that differ; returns 1 if any does */
+static int snapshot_diff_block(SnapshotDiffRAM *r1, SnapshotDiffBlock *b1,
+                               SnapshotDiffRAM *r2, SnapshotDiffBlock *b2,
+                               uint64_t granularity, uint8_t *buf1,
+                               uint8_t *buf2)
+{
+    uint64_t offset, pos, len;
+    uint64_t start = 0, end = 0;    /* differing range being built */
+    int ret = 0;
+
+    for (offset = 0; offset < b1->length; offset += SNAPSHOT_DIFF_BUF_SIZE) {
+        len = MIN(SNAPSHOT_DIFF_BUF_SIZE, b1->length - offset);
+        if (snapshot_diff_read(r1, b1, offset, buf1, len) < 0 ||
+            snapshot_diff_read(r2, b2, offset, buf2, len) < 0) {
+            error_report("Could not read RAM block '%s'", b1->idstr);
+            return 2;
+        }
+        for (pos = 0; pos < len; pos += granularity) {
+            uint64_t l = MIN(granularity, len - pos);
+
+            if (!memcmp(buf1 + pos, buf2 + pos, l)) {
+                continue;
+            }
+            ret = 1;
+            if (end != offset + pos) {
+                if (end) {
+                    snapshot_diff_print(b1->idstr, start, end);
+                }
+                start = offset + pos;
+            }
+            end = offset + pos + l;
+        }
+    }
+    if (end) {
+        snapshot_diff_print(b1->idstr, start, end);
+    }
+    return ret;
+}
+
+static int img_snapshot_diff(int argc, char **argv)
+{
+    const char *fmt = NULL, *filename, *name1, *name2;
+    SnapshotDiffRAM r1 = { .fd = -1 }, r2 = { .fd = -1 };
+    uint8_t *buf1 = NULL, *buf2 = NULL;
+    uint64_t granularity = 4 * KiB;
+    bool image_opts = false;
+    bool force_share = false;
+    int c, ret = 0, r;      /* 0 same, 1 different, 2 error */
+    uint32_t i;
+
+    for (;;) {
+        static const struct option long_options[] = {
+            {"help", no_argument, 0, 'h'},
+            {"object", required_argument, 0, OPTION_OBJECT},
+            {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
+            {"force-share", no_argument, 0, 'U'},
+            {"granularity", required_argument, 0, 'g'},
+            {0, 0, 0, 0}
+        };
+        c = getopt_long(argc, argv, ":hf:g:U", long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case ':':
+            missing_argument(argv[optind - 1]);
+            break;
+        case '?':
+            unrecognized_option(argv[optind - 1]);
+            break;
+        case 'h':
+            help();
+            break;
+        case 'f':
+            fmt = optarg;
+            break;
+        case 'g':
+            if (qemu_strtosz(optarg, NULL, &granularity) ||
+                !is_power_of_2(granularity) ||
+                granularity > SNAPSHOT_RAM_CHUNK) {
+                error_report("Invalid granularity '%s', it must be a power "
+                             "of 2 up to 64 KiB", optarg);
+                return 2;
+            }
+            break;
+        case 'U':
+            force_share = true;
+            break;
+        case OPTION_OBJECT:
+            {
+                Error *local_err = NULL;
+
+                if (!user_creatable_add_from_str(optarg, &local_err)) {
+                    if (local_err) {
+                        error_report_err(local_err);
+                        exit(2);
+                    } else {
+                        /* Help was printed */
+                        exit(EXIT_SUCCESS);
+                    }
+                }
+                break;
+            }
+        case OPTION_IMAGE_OPTS:
+            image_opts = true;
+            break;
+        }
+    }
+
+    if (optind != argc - 3) {
+        error_exit("Expecting an image file name and two snapshot names");
+    }
+    filename = argv[optind++];
+    name1 = argv[optind++];
+    name2 = argv[optind++];
+
+    /* The image is opened twice, read-only, to load both snapshots */
+    if (snapshot_diff_open(&r1, image_opts, filename, fmt, force_share,
+                           name1) < 0 ||
+        snapshot_diff_open(&r2, image_opts, filename, fmt, force_share,
+                           name2) < 0) {
+        ret = 2;
+        goto out;
+    }
+
+    buf1 = blk_blockalign(r1.blk, SNAPSHOT_DIFF_BUF_SIZE);
+    buf2 = blk_blockalign(r2.blk, SNAPSHOT_DIFF_BUF_SIZE);
+    for (i = 0; i < r1.nr_blocks && ret < 2; i++) {
+        SnapshotDiffBlock *b1 = &r1.blocks[i];
+        SnapshotDiffBlock *b2 = snapshot_diff_find(&r2, b1->idstr);
+
+        if (!b2 || b2->length != b1->length) {
+            printf("%-24s only in %s\n", b1->idstr, name1);
+            ret = 1;
+            continue;
+        }
+        r = snapshot_diff_block(&r1, b1, &r2, b2, granularity, buf1, buf2);
+        ret = MAX(ret, r);
+    }
+    for (i = 0; i < r2.nr_blocks && ret < 2; i++) {
+        SnapshotDiffBlock *b1 = snapshot_diff_find(&r1, r2.blocks[i].idstr);
+
+        if (!b1 || b1->length != r2.blocks[i].length) {
+            printf("%-24s only in %s\n", r2.blocks[i].idstr, name2);
+            ret = 1;
+        }
+    }
+
+out:
+    qemu_vfree(buf1);
+    qemu_vfree(buf2);
+    if (r1.blk) {
+        snapshot_diff_close(&r1);
+    }
+    if (r2.blk) {
+        snapshot_diff_close(&r2);
+    }
+    return ret;
+}
+
 static int img_rebase(int argc, char **argv)
 {
     BlockBackend *blk = NULL, *blk_old_backing = NULL, *blk_new_backing = NULL;
@@ -4233,6 +4726,111 @@ out_no_progress:
     return 0;
 }
 
+static int img_dedupe(int argc, char **argv)
+{
+    Error *err = NULL;
+    int c, ret = 0;
+    const char *fmt = NULL, *filename, *cache;
+    int flags;
+    bool writethrough;
+    bool quiet = false, progress = false;
+    BlockBackend *blk = NULL;
+    BlockDriverState *bs;
+    bool image_opts = false;
+    int64_t shared = 0;
+
+    cache = BDRV_DEFAULT_CACHE;
+    for (;;) {
+        static const struct option long_options[] = {
+            {"help", no_argument, 0, 'h'},
+            {"object", required_argument, 0, OPTION_OBJECT},
+            {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
+            {0, 0, 0, 0}
+        };
+        c = getopt_long(argc, argv, ":hf:t:pq",
+                        long_options, NULL);
+        if (c == -1) {
+            break;
+        }
+
+        switch (c) {
+        case ':':
+            missing_argument(argv[optind - 1]);
+            break;
+        case '?':
+            unrecognized_option(argv[optind - 1]);
+            break;
+        case 'h':
+            help();
+            break;
+        case 'f':
+            fmt = optarg;
+            break;
+        case 't':
+            cache = optarg;
+            break;
+        case 'p':
+            progress = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        case OPTION_OBJECT:
+            user_creatable_process_cmdline(optarg);
+            break;
+        case OPTION_IMAGE_OPTS:
+            image_opts = true;
+            break;
+        }
+    }
+
+    if (optind != argc - 1) {
+        error_exit("Expecting one image file name");
+    }
+    filename = argv[optind];
+
+    if (quiet) {
+        progress = false;
+    }
+
+    flags = BDRV_O_RDWR;
+    ret = bdrv_parse_cache_mode(cache, &flags, &writethrough);
+    if (ret < 0) {
+        error_report("Invalid cache option: %s", cache);
+        return 1;
+    }
+
+    blk = img_open(image_opts, filename, fmt, flags, writethrough, quiet,
+                   false);
+    if (!blk) {
+        return 1;
+    }
+    bs = blk_bs(blk);
+
+    qemu_progress_init(progress, 1.0);
+    qemu_progress_print(0.f, 0);
+    ret = bdrv_dedupe(bs, &amend_status_cb, NULL, &shared, &err);
+    qemu_progress_print(100.f, 0);
+    qemu_progress_end();
+    if (ret < 0) {
+        error_report_err(err);
+        goto out;
+    }
+
+    if (!quiet) {
+        BlockDriverInfo bdi = { 0 };
+        g_autofree char *size = NULL;
+
+        bdrv_get_info(bs, &bdi);
+        size = size_to_str(shared * bdi.cluster_size);
+        printf("%" PRId64 " duplicate clusters (%s) freed.\n", shared, size);
+    }
+
+out:
+    blk_unref(blk);
+    return ret < 0;
+}
+
 typedef struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
@@ -69,6 +69,7 @@
 #define QEMU_NBD_OPT_TLSAUTHZ      264
 #define QEMU_NBD_OPT_PID_FILE      265
 #define QEMU_NBD_OPT_SELINUX_LABEL 266
+#define QEMU_NBD_OPT_MULTI_CONN    267
 
 #define MBR_SIZE 512
 
@@ -100,6 +101,8 @@ static void usage(const char *name)
 "                            (default '"SOCKET_PATH"')\n"
 "  -e, --shared=NUM          device can be shared by NUM clients (default '1')\n"
 "  -t, --persistent          don't exit on the last connection\n"
+"      --multi-conn          let clients use several connections, even when\n"
+"                            writable\n"
 "  -v, --verbose             display extra debugging information\n"
 "  -x, --export-name=NAME    expose export by name (default is empty string)\n"
 "  -D, --description=TEXT    export a human-readable description\n"
@@ -537,6 +540,7 @@ int main(int argc, char **argv)
         { "shared", required_argument, NULL, 'e' },
         { "format", required_argument, NULL, 'f' },
         { "persistent", no_argument, NULL, 't' },
+        { "multi-conn", no_argument, NULL, QEMU_NBD_OPT_MULTI_CONN },
         { "verbose", no_argument, NULL, 'v' },
         { "object", required_argument, NULL, QEMU_NBD_OPT_OBJECT },
         { "export-name", required_argument, NULL, 'x' },
@@ -567,6 +571,7 @@ int main(int argc, char **argv)
     const char *export_description = NULL;
     strList *bitmaps = NULL;
     bool alloc_depth = false;
+    bool multi_conn = false;
     const char *tlscredsid = NULL;
     bool imageOpts = false;
     bool writethrough = false; /* Client will flush as needed. */
@@ -759,6 +764,9 @@ int main(int argc, char **argv)
         case QEMU_NBD_OPT_FORK:
             fork_process = true;
             break;
+        case QEMU_NBD_OPT_MULTI_CONN:
+            multi_conn = true;
+            break;
         case 'L':
             list = true;
             break;
@@ -1094,6 +1102,8 @@ int main(int argc, char **argv)
             .bitmaps              = bitmaps,
             .has_allocation_depth = alloc_depth,
             .allocation_depth     = alloc_depth,
+            .has_multi_conn       = multi_conn,
+            .multi_conn           = ON_OFF_AUTO_ON,
         },
     };
     blk_exp_add(export_opts, &error_fatal);
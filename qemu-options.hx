@@ -29,6 +29,7 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                supported accelerators are kvm, xen, hax, hvf, nvmm, whpx or tcg (default: tcg)\n"
     "                vmport=on|off|auto controls emulation of vmport (default: auto)\n"
     "                dump-guest-core=on|off include guest memory in a core dump (default=on)\n"
+    "                small-footprint=on|off size TCG caches after guest RAM (default depends on machine)\n"
     "                mem-merge=on|off controls memory merge support (default: on)\n"
     "                aes-key-wrap=on|off controls support for AES key wrapping (default=on)\n"
     "                dea-key-wrap=on|off controls support for DEA key wrapping (default=on)\n"
@@ -71,6 +72,13 @@ SRST
     ``dump-guest-core=on|off``
         Include guest memory in a core dump. The default is on.
 
+    ``small-footprint=on|off``
+        Size the TCG translation block cache and the TLBs after guest RAM
+        rather than host RAM, and report the resident set size of QEMU
+        once it has started.  This lets many small guests share a host.
+        An explicit ``tb-size`` still takes precedence.  The default is
+        on for boards with little RAM, such as ``canon-a1100``.
+
     ``mem-merge=on|off``
         Enables or disables memory merge support. This feature, when
         supported by the host, de-duplicates identical memory pages
@@ -150,7 +158,23 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
+    "                chain-stats=on|off (count unchained TCG block exits)\n"
+    "                perf-map=on|off (describe TCG code in /tmp/perf-PID.map)\n"
+    "                jitdump=on|off (record TCG code for perf inject --jit)\n"
+    "                keep-globals=on|off (keep TCG globals in registers across forward branches)\n"
+    "                spec-translate=on|off (translate TCG branch targets in the background)\n"
+    "                rr-adaptive=on|off (adapt the single-threaded TCG time slices to each vCPU)\n"
+    "                superblock-threshold=n (retranslate hot TCG blocks as superblocks)\n"
+    "                tlb-resize=dynamic|grow-only|fixed (TCG softmmu TLB resize policy)\n"
+    "                victim-tlb=n (TCG softmmu victim TLB entries)\n"
+    "                tb-cache=file (remember TCG translations across runs)\n"
+    "                coverage=file (map a TCG block coverage bitmap from file)\n"
+    "                coverage-bits=n (size of the coverage bitmap, default 65536)\n"
+    "                lockstep-quantum=n (run MTTCG with icount in quanta of n insns)\n"
+    "                zero-reclaim=ms (discard zeroed guest pages every ms milliseconds)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                code-hugepages=off|thp|hugetlb (host pages for the TCG block cache)\n"
+    "                code-numa-node=n (host NUMA node for the TCG block cache)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -185,6 +209,141 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``code-hugepages=off|thp|hugetlb``
+        Choose the host pages behind the TCG translation block cache.
+        With a large ``tb-size``, running the translated code misses in
+        the host iTLB unless it sits on huge pages.  ``thp``, the
+        default, asks for transparent hugepages; ``hugetlb`` takes the
+        cache from the default-sized hugetlbfs pool, without guard
+        pages between its regions, and falls back to ``thp`` with a
+        warning if the pool is too small.  ``info jit`` shows how much
+        of the cache is on huge pages.
+
+    ``code-numa-node=n``
+        Allocate the TCG translation block cache from host NUMA node
+        ``n``, preferably, which should be the one the vCPU threads are
+        pinned to.  The default, -1, lets the host decide.
+
+    ``chain-stats=on|off``
+        Count, for each TCG translation block, the exits that go back to
+        the main loop or through the indirect jump lookup helper rather
+        than straight to the next block.  ``info tb-chains`` lists the
+        worst offenders.  Off by default, as it slows down indirect jumps.
+
+    ``perf-map=on|off``
+        Write a line to ``/tmp/perf-<pid>.map`` for each TCG translation
+        block, naming it after its guest PC and, when the guest ELF has
+        symbols, the guest function.  ``perf report`` then attributes
+        the samples in translated code to the guest code.  The file has
+        no notion of time, so once the translation buffer fills up and
+        is reused, samples may be attributed to a block it held before.
+
+    ``jitdump=on|off``
+        Write ``/tmp/jit-<pid>.dump``, which records each translation
+        block with a timestamp and a copy of its host code.  Record with
+        ``perf record -k 1`` and run ``perf inject --jit`` on the result:
+        each sample is then matched with the block in place at the time,
+        even across buffer flushes.
+
+    ``keep-globals=on|off``
+        Let the TCG register allocator keep guest registers and other
+        TCG globals in host registers at a label that is only reached
+        by forward branches within the translation block, when every
+        path leaves them in the same host register.  Without it, they
+        are loaded again from memory after every label, which front
+        ends such as 32-bit Arm's emit for each conditionally executed
+        instruction.  On by default; turning it off can help debug TCG
+        back ends.
+
+    ``superblock-threshold=n``
+        After a TCG translation block has been looked up ``n`` times by
+        the main loop or the indirect jump helper, translate it again
+        as a superblock that carries on through the block's forward
+        unconditional direct branches within the same page, instead of
+        ending at the first one.  Only the 32-bit Arm front end forms
+        superblocks so far.  The default, 0, disables this.
+
+    ``tb-cache=file``
+        At exit, write the list of TCG translation blocks in use to
+        ``file``, along with a checksum of the guest page each came
+        from; if ``file`` exists at startup, read it back.  Then, the
+        first time the guest runs code from a page whose contents match
+        the checksum, the blocks recorded for that page are translated
+        all at once.  Only the block list is kept, not the generated
+        host code, and the file is ignored by a different QEMU build.
+        System emulation only.
+
+    ``spec-translate=on|off``
+        Start a thread that translates the direct branch targets and the
+        fall-through of each newly translated TCG block, so that the
+        vCPU finds them already translated.  The thread borrows the
+        state of the vCPU, so it only runs while the vCPUs are idle, and
+        only with ``thread=single``.  System emulation only; off by
+        default.
+
+    ``rr-adaptive=on|off``
+        With ``thread=single``, skip the halted vCPUs that have nothing
+        to do, and give each vCPU a time slice of its own: the slice of
+        a vCPU that keeps running out at the same place, as when it
+        polls for another core, is halved down to 1/32 of the default,
+        and that of a vCPU doing anything else grows back.  This keeps
+        a mostly idle core of a multi-core board from taking half of
+        the emulation time.  Not used with icount; off by default.
+
+    ``tlb-resize=dynamic|grow-only|fixed``
+        Choose how the softmmu TLB of each MMU index is resized when it
+        is flushed.  ``dynamic``, the default, grows it when it is more
+        than 70% used and shrinks it after 100ms below 30% use.
+        ``grow-only`` never shrinks it, which suits guests that keep a
+        single working set and rarely flush; ``fixed`` keeps the initial
+        size.  ``info tlb-stats`` shows the effect.  System emulation
+        only.
+
+    ``victim-tlb=n``
+        Number of entries, per MMU index, of the second-level TLB that
+        keeps the translations evicted from the softmmu TLB, so that a
+        later access to them does not have to walk the guest page tables
+        or MPU again.  It is 4-way set-associative with pseudo-LRU
+        replacement; ``n`` must be a power of 2 between 4 and 4096, and
+        defaults to 8.  System emulation only.
+
+    ``coverage=file``
+        Map ``file`` shared and use it as a bitmap of the guest code
+        that ran: the bit for a TCG translation block is set the first
+        time it runs, after which the block runs at full speed.  The
+        block at ``pc`` sets the bit given by the top ``log2(n)`` bits
+        of the 64-bit product ``pc * 0x9e3779b97f4a7c15``, bit 0 being
+        the least significant bit of the first byte.  The ``x-coverage-dump`` and
+        ``x-coverage-reset`` QMP commands save and clear it.  System
+        emulation only.
+
+    ``coverage-bits=n``
+        Number of bits of the coverage bitmap, a power of 2; the
+        default is 65536.
+
+    ``lockstep-quantum=n``
+        Run the vCPUs of ``thread=multi`` with ``-icount shift=N``, each
+        on its own thread, in quanta of n instructions. After its
+        quantum, a vCPU waits for the others; virtual time then moves
+        by n instructions, the timers that are due run, and the
+        interrupts raised for other vCPUs during the quantum are
+        delivered, before the next quantum starts. The run is
+        deterministic as long as the vCPUs do not race on the same
+        guest memory within a quantum. Smaller quanta make interrupts
+        more timely, larger ones synchronize less often. When every
+        vCPU is halted, virtual time skips to the next timer. It is not
+        compatible with record/replay or ``shift=auto``; 0, the
+        default, disables it.
+
+    ``zero-reclaim=ms``
+        Every ms milliseconds, look for guest pages that were not written
+        since the previous look and are all zeroes, and give the host
+        memory behind them back to the host, so that idle guests shrink
+        even if they never free memory through a balloon. The vCPUs are
+        paused while the pages are checked. Scans are skipped during
+        migration and when RAM discards are disabled, e.g. by VFIO; 0,
+        the default, disables it.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -201,7 +360,10 @@ SRST
         could be a good initial value if you have no idea which is the best.
         Set this value to 0 to disable the feature.  By default, this feature
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
-        record dirty pages in a bitmap.
+        record dirty pages in a bitmap.  On arm64 hosts the dirty ring
+        needs a kernel that supports it (Linux 6.1 or newer); pages that
+        the vGIC ITS dirties are then collected from a backup bitmap once
+        the guest is stopped.
 
 ERST
 
@@ -1862,6 +2024,9 @@ DEF("display", HAS_ARG, QEMU_OPTION_display,
 #endif
 #if defined(CONFIG_OPENGL)
     "-display egl-headless[,rendernode=<file>]\n"
+#endif
+#if defined(CONFIG_POSIX)
+    "-display shm[,path=<prefix>][,adaptive-refresh=on|off]\n"
 #endif
     "-display none\n"
     "                select display backend type\n"
@@ -1941,6 +2106,22 @@ SRST
         graphical display, this display needs to be paired with either
         VNC or SPICE displays.
 
+    ``shm[,path=<prefix>][,adaptive-refresh=on|off]``
+        Export each graphic console to a shared memory file named
+        ``<prefix>N``, where N is the console index.  The default prefix
+        is ``/dev/shm/qemu-<pid>-fb``.  Each file starts with a header
+        giving the frame geometry, its pixel format and a damage
+        counter, followed by the pixels.  The ``query-shm-display`` QMP
+        command lists the files.  Other programs can map them to check
+        frames without a screendump, and only need to look again when
+        the damage counter changes.  This is meant for test harnesses
+        and other headless tools.
+
+        ``adaptive-refresh=on|off`` : Poll the display devices less and
+        less often, down to every 3 seconds, while the screen does not
+        change, and go back to the normal rate on the next update.  This
+        option is accepted by all display types.
+
     ``vnc=<display>``
         Start a VNC server on display <display>
 
@@ -2360,6 +2541,12 @@ SRST
         depending on its encoding settings. Enabling this option can
         save a lot of bandwidth at the expense of quality.
 
+        It also makes the Open H.264 encoding available, when QEMU is
+        built with libx264.  Clients that prefer it get every update
+        as a video frame of the whole screen, which suits constantly
+        changing content such as video.  The quality level that the
+        client asks for sets the constant rate factor.
+
     ``non-adaptive=on|off``
         Disable adaptive encodings. Adaptive encodings are enabled by
         default. An adaptive encoding will try to detect frequently
@@ -2398,6 +2585,21 @@ SRST
     ``power-control=on|off``
         Permit the remote client to issue shutdown, reboot or reset power
         control requests.
+
+    ``encode-threads=n``
+        Encode framebuffer updates with n threads (default 1).  Each
+        update is split in horizontal stripes that are encoded in
+        parallel, which helps large displays.  Every stripe starts new
+        compression streams, so updates get slightly bigger with the
+        tight and zrle encodings.  The zlib encoding is always done by
+        a single thread.  The threads are shared by all VNC displays.
+
+    ``compare=on|off``
+        Compare the areas the display device updates with what was
+        already sent, and only send the parts that really changed
+        (default on).  Turn it off when the display device reports
+        precise dirty rectangles, since the comparison then only costs
+        CPU time.
 ERST
 
 ARCHHEADING(, QEMU_ARCH_I386)
@@ -2670,6 +2872,12 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m]\n"
+    "                attach to queues m..m+n-1 of the host network interface 'name'\n"
+    "                with AF_XDP sockets, using the XDP program attach mode 'mode'\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2694,6 +2902,9 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -3137,6 +3348,25 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m]``
+    Connect to the host network interface ifname with AF_XDP sockets,
+    one per queue. An XDP program redirects the packets received on
+    queues m to m+n-1 of the interface to the sockets, so the interface
+    should be configured (for example with ``ethtool -N``) to steer the
+    guest's traffic to those queues. ``mode`` selects how the program is
+    attached: ``native`` needs driver support and allows zero-copy,
+    ``skb`` works with any interface; by default native mode is used
+    when available. Zero-copy is used when the driver supports it,
+    unless ``force-copy=on``.
+
+    Example:
+
+    .. parsed-literal::
+
+        # steer the guest's traffic to queue 1 of eth0
+        ethtool -N eth0 flow-type ether dst 52:54:00:12:34:56 action 1
+        |qemu_system| linux.img -nic af-xdp,ifname=eth0,start-queue=1
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -3213,7 +3443,7 @@ DEF("chardev", HAS_ARG, QEMU_OPTION_chardev,
     "-chardev msmouse,id=id[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
     "-chardev vc,id=id[[,width=width][,height=height]][[,cols=cols][,rows=rows]]\n"
     "         [,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
-    "-chardev ringbuf,id=id[,size=size][,logfile=PATH][,logappend=on|off]\n"
+    "-chardev ringbuf,id=id[,size=size][,path=path[,fd=fd]][,logfile=PATH][,logappend=on|off]\n"
     "-chardev file,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
     "-chardev pipe,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
 #ifdef _WIN32
@@ -3312,6 +3542,12 @@ The general form of a character device option is:
     ``logappend`` option controls whether the log file will be truncated
     or appended to when opened.
 
+    Every backend also supports ``coalesce=on``, which holds back what
+    the front end writes until a newline, until 256 bytes have
+    accumulated, or for at most 1 ms, and then passes it on in one
+    write.  It suits UARTs that write their output a byte at a time.
+    It has no effect with record/replay.
+
 The available backends are:
 
 ``-chardev null,id=id``
@@ -3415,10 +3651,18 @@ The available backends are:
     ``cols`` and ``rows`` specify that the console be sized to fit a
     text console with the given dimensions.
 
-``-chardev ringbuf,id=id[,size=size]``
+``-chardev ringbuf,id=id[,size=size][,path=path[,fd=fd]]``
     Create a ring buffer with fixed size ``size``. size must be a power
     of two and defaults to ``64K``.
 
+    With ``path``, the ring is created in that file, normally on tmpfs,
+    for another process to map and read, and output that does not fit
+    is dropped rather than overwriting older output.  Writes to it make
+    no system call, except to wake up the reader when it asked for it;
+    ``fd`` is then an inherited eventfd, or the write end of a pipe,
+    that the reader waits on.  The layout and protocol are described
+    in ``include/chardev/shm-ring.h``.
+
 ``-chardev file,id=id,path=path``
     Log all traffic received from the guest to a file.
 
@@ -4036,6 +4280,13 @@ SRST
 ``-d item1[,...]``
     Enable logging of specified items. Use '-d help' for a list of log
     items.
+
+    With the ``async`` item, each thread formats its log into a buffer
+    of its own and a separate thread writes the buffers to the log
+    file, so that heavy logging such as ``-d exec,cpu`` does not stall
+    the vCPUs on file I/O and the lines logged together by a vCPU stay
+    together.  The log of different threads is then only ordered by
+    chunks of about 64 KiB.
 ERST
 
 DEF("D", HAS_ARG, QEMU_OPTION_D, \
@@ -4226,13 +4477,13 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>][,rrsnapshot-period=N[,rrsnapshot-keep=K]][,rrcompress=on|off]]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
     "                or disable real time cpu sleeping, and optionally enable\n" \
     "                record-and-replay mode\n", QEMU_ARCH_ALL)
 SRST
-``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
+``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot][,rrsnapshot-period=N[,rrsnapshot-keep=K]][,rrcompress=on|off]]``
     Enable virtual instruction counter. The virtual cpu will execute one
     instruction every 2^N ns of virtual time. If ``auto`` is specified
     then the virtual cpu speed will be automatically adjusted to keep
@@ -4274,6 +4525,13 @@ SRST
     name. In record mode, a new VM snapshot with the given name is created
     at the start of execution recording. In replay mode this option
     specifies the snapshot name used to load the initial VM state.
+    ``rrsnapshot-period=N`` makes recording take a VM snapshot named
+    ``replay-auto-<icount>`` every N instructions, so that reverse
+    debugging can restart from a nearby point of the replay instead of
+    from the initial snapshot. Only the last K of them are kept if
+    ``rrsnapshot-keep=K`` is given.
+    ``rrcompress=on`` compresses the log with zstd while recording; a
+    compressed log is recognized as such when it is replayed.
 ERST
 
 DEF("watchdog", HAS_ARG, QEMU_OPTION_watchdog, \
@@ -4842,7 +5100,7 @@ SRST
         recommended that a persistent set of parameters be generated up
         front and saved.
 
-    ``-object tls-creds-x509,id=id,endpoint=endpoint,dir=/path/to/cred/dir,priority=priority,verify-peer=on|off,passwordid=id``
+    ``-object tls-creds-x509,id=id,endpoint=endpoint,dir=/path/to/cred/dir,priority=priority,verify-peer=on|off,passwordid=id,ktls=on|off``
         Creates a TLS anonymous credentials object, which can be used to
         provide TLS support on network backends. The ``id`` parameter is
         a unique ID which network backends will use to access the
@@ -4886,6 +5144,15 @@ SRST
         string as described at
         https://gnutls.org/manual/html_node/Priority-Strings.html.
 
+        If ``ktls`` is enabled (default off), the data sent by network
+        backends running over a TCP socket is encrypted by the kernel
+        TLS support of Linux, or by the NIC if it offloads TLS, once
+        the handshake is completed. This needs a TLS 1.2 or 1.3 session
+        with an AES-GCM cipher; otherwise QEMU warns and does the
+        encryption itself. Received data is always decrypted by gnutls.
+        The same property applies to ``tls-creds-anon`` and
+        ``tls-creds-psk``.
+
     ``-object tls-cipher-suites,id=id,priority=priority``
         Creates a TLS cipher suites object, which can be used to control
         the TLS cipher/protocol algorithms that applications are permitted
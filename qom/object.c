@@ -33,6 +33,9 @@
 #include "qapi/qmp/qnum.h"
 #include "qapi/qmp/qstring.h"
 #include "qemu/error-report.h"
+#include "qemu/log.h"
+#include "qemu/mem-usage.h"
+#include "qemu/thread.h"
 
 #define MAX_INTERFACES 32
 
@@ -282,6 +285,55 @@ static void object_property_free(gpointer data)
     g_free(prop);
 }
 
+/* Classes initialized so far, and the time spent in class_init for -d */
+static unsigned class_init_count;
+static int64_t class_init_time_us;
+
+/*
+ * Fill klass->all_properties from the parent's index and the class's
+ * own properties.  Parents are initialized first, so their index is
+ * complete by then.  Ancestors take precedence, as in the walk that
+ * object_class_property_find() does before the index exists.
+ */
+static void object_class_index_properties(ObjectClass *klass)
+{
+    ObjectClass *parent = object_class_get_parent(klass);
+    GHashTable *all = g_hash_table_new(g_str_hash, g_str_equal);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init(&iter, klass->properties);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_hash_table_insert(all, key, value);
+    }
+    if (parent) {
+        g_hash_table_iter_init(&iter, parent->all_properties);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            g_hash_table_insert(all, key, value);
+        }
+    }
+    klass->all_properties = all;
+}
+
+typedef struct ClassPropertyIndexData {
+    TypeImpl *type;
+    ObjectProperty *prop;
+} ClassPropertyIndexData;
+
+static void object_class_index_add_tramp(gpointer key, gpointer value,
+                                         gpointer opaque)
+{
+    ClassPropertyIndexData *data = opaque;
+    TypeImpl *ti = value;
+
+    /* Replaces a subclass's own property of that name, like the walk */
+    if (ti->class && ti->class->all_properties &&
+        type_is_ancestor(ti, data->type)) {
+        g_hash_table_insert(ti->class->all_properties, data->prop->name,
+                            data->prop);
+    }
+}
+
 static void type_initialize(TypeImpl *ti)
 {
     TypeImpl *parent;
@@ -318,6 +370,7 @@ static void type_initialize(TypeImpl *ti)
         g_assert(parent->instance_size <= ti->instance_size);
         memcpy(ti->class, parent->class, parent->class_size);
         ti->class->interfaces = NULL;
+        ti->class->all_properties = NULL;
 
         for (e = parent->class->interfaces; e; e = e->next) {
             InterfaceClass *iface = e->data;
@@ -362,8 +415,25 @@ static void type_initialize(TypeImpl *ti)
     }
 
     if (ti->class_init) {
+        int64_t start = 0;
+
+        if (qemu_loglevel_mask(LOG_STARTUP)) {
+            start = g_get_monotonic_time();
+        }
         ti->class_init(ti->class, ti->class_data);
+        if (start) {
+            class_init_time_us += g_get_monotonic_time() - start;
+        }
     }
+    class_init_count++;
+
+    object_class_index_properties(ti->class);
+}
+
+void object_class_init_stats(unsigned *count, int64_t *time_us)
+{
+    *count = class_init_count;
+    *time_us = class_init_time_us;
 }
 
 static void object_init_with_type(Object *obj, TypeImpl *ti)
@@ -690,6 +760,7 @@ static void object_finalize(void *data)
     g_assert(obj->ref == 0);
     g_assert(obj->parent == NULL);
     if (obj->free) {
+        mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_QOM, ti->instance_size);
         obj->free(obj);
     }
 }
@@ -732,6 +803,7 @@ static Object *object_new_with_type(Type type)
 
     object_initialize_with_type(obj, size, type);
     obj->free = obj_free;
+    mem_usage_add(MEMORY_USAGE_SUBSYSTEM_QOM, size);
 
     return obj;
 }
@@ -1058,8 +1130,35 @@ typedef struct OCFData
     const char *implements_type;
     bool include_abstract;
     void *opaque;
+    TypeImpl *target;
 } OCFData;
 
+/*
+ * Whether @type is or implements @target, like object_class_dynamic_cast
+ * but without initializing the class.  This lets object_class_foreach
+ * leave alone the many types that a lookup by parent or interface is
+ * not interested in, so that their class_init only runs if the machine
+ * ends up using them.
+ */
+static bool type_implements(TypeImpl *type, TypeImpl *target)
+{
+    for (; type; type = type_get_parent(type)) {
+        int i;
+
+        if (type == target) {
+            return true;
+        }
+        for (i = 0; i < type->num_interfaces; i++) {
+            TypeImpl *iface = type_get_by_name(type->interfaces[i].typename);
+
+            if (iface && type_is_ancestor(iface, target)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static void object_class_foreach_tramp(gpointer key, gpointer value,
                                        gpointer opaque)
 {
@@ -1067,6 +1166,11 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
     TypeImpl *type = value;
     ObjectClass *k;
 
+    if (data->implements_type &&
+        (!data->target || !type_implements(type, data->target))) {
+        return;
+    }
+
     type_initialize(type);
     k = type->class;
 
@@ -1088,6 +1192,9 @@ void object_class_foreach(void (*fn)(ObjectClass *klass, void *opaque),
 {
     OCFData data = { fn, implements_type, include_abstract, opaque };
 
+    if (implements_type) {
+        data.target = type_get_by_name(implements_type);
+    }
     enumerating_types = true;
     g_hash_table_foreach(type_table_get(), object_class_foreach_tramp, &data);
     enumerating_types = false;
@@ -1275,6 +1382,20 @@ object_class_property_add(ObjectClass *klass,
 
     g_hash_table_insert(klass->properties, prop->name, prop);
 
+    if (klass->all_properties) {
+        /*
+         * Added after class_init: the indexes of the class and of the
+         * subclasses initialized so far need it too.
+         */
+        ClassPropertyIndexData data = {
+            .type = klass->type,
+            .prop = prop,
+        };
+
+        g_hash_table_foreach(type_table_get(), object_class_index_add_tramp,
+                             &data);
+    }
+
     return prop;
 }
 
@@ -1333,6 +1454,10 @@ ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name)
 {
     ObjectClass *parent_klass;
 
+    if (klass->all_properties) {
+        return g_hash_table_lookup(klass->all_properties, name);
+    }
+
     parent_klass = object_class_get_parent(klass);
     if (parent_klass) {
         ObjectProperty *prop =
@@ -1718,11 +1843,35 @@ static Object *object_resolve_child_property(Object *parent, void *opaque,
     return opaque;
 }
 
+/*
+ * Objects found by absolute path through child properties only, keyed
+ * by their canonical path.  Links can be retargeted at any time and
+ * are never cached; removing any child empties the whole cache, and
+ * bumps the generation so that a walk racing with the removal does
+ * not insert what it found.
+ */
+static struct {
+    QemuSpin lock;
+    GHashTable *objects;
+    unsigned generation;
+} path_cache;
+
+static void object_path_cache_flush(void)
+{
+    qemu_spin_lock(&path_cache.lock);
+    path_cache.generation++;
+    if (path_cache.objects) {
+        g_hash_table_remove_all(path_cache.objects);
+    }
+    qemu_spin_unlock(&path_cache.lock);
+}
+
 static void object_finalize_child_property(Object *obj, const char *name,
                                            void *opaque)
 {
     Object *child = opaque;
 
+    object_path_cache_flush();
     if (child->class->unparent) {
         (child->class->unparent)(child);
     }
@@ -2114,6 +2263,72 @@ static Object *object_resolve_partial_path(Object *parent,
     return obj;
 }
 
+/* object_resolve_abs_path() from the root, through the path cache */
+static Object *object_resolve_root_path(char **parts, const char *typename)
+{
+    g_autoptr(GString) key = g_string_new(NULL);
+    Object *obj = object_get_root();
+    bool cacheable = true;
+    unsigned generation;
+    char **part;
+
+    for (part = parts; *part; part++) {
+        if (**part) {
+            g_string_append_c(key, '/');
+            g_string_append(key, *part);
+        }
+    }
+    if (!key->len) {
+        return object_dynamic_cast(obj, typename);
+    }
+
+    qemu_spin_lock(&path_cache.lock);
+    generation = path_cache.generation;
+    if (path_cache.objects) {
+        Object *found = g_hash_table_lookup(path_cache.objects, key->str);
+
+        if (found) {
+            qemu_spin_unlock(&path_cache.lock);
+            return object_dynamic_cast(found, typename);
+        }
+    }
+    qemu_spin_unlock(&path_cache.lock);
+
+    for (part = parts; *part; part++) {
+        ObjectProperty *prop;
+
+        if (!**part) {
+            continue;
+        }
+        prop = object_property_find(obj, *part);
+        if (!prop || !prop->resolve) {
+            return NULL;
+        }
+        cacheable &= object_property_is_child(prop);
+        obj = prop->resolve(obj, prop->opaque, *part);
+        if (!obj) {
+            return NULL;
+        }
+    }
+
+    if (cacheable) {
+        qemu_spin_lock(&path_cache.lock);
+        if (path_cache.generation == generation) {
+            if (!path_cache.objects) {
+                path_cache.objects = g_hash_table_new_full(g_str_hash,
+                                                           g_str_equal,
+                                                           g_free, NULL);
+            }
+            g_hash_table_insert(path_cache.objects,
+                                g_string_free(g_steal_pointer(&key), false),
+                                obj);
+        }
+        qemu_spin_unlock(&path_cache.lock);
+    }
+
+    return object_dynamic_cast(obj, typename);
+}
+
 Object *object_resolve_path_type(const char *path, const char *typename,
                                  bool *ambiguousp)
 {
@@ -2131,7 +2346,7 @@ Object *object_resolve_path_type(const char *path, const char *typename,
             *ambiguousp = ambiguous;
         }
     } else {
-        obj = object_resolve_abs_path(object_get_root(), parts + 1, typename);
+        obj = object_resolve_root_path(parts + 1, typename);
     }
 
     g_strfreev(parts);
@@ -2149,8 +2364,7 @@ Object *object_resolve_path_at(Object *parent, const char *path)
     g_auto(GStrv) parts = g_strsplit(path, "/", 0);
 
     if (*path == '/') {
-        return object_resolve_abs_path(object_get_root(), parts + 1,
-                                       TYPE_OBJECT);
+        return object_resolve_root_path(parts + 1, TYPE_OBJECT);
     }
     return object_resolve_abs_path(parent, parts, TYPE_OBJECT);
 }
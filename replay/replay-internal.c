@@ -13,6 +13,7 @@
 #include "sysemu/replay.h"
 #include "sysemu/runstate.h"
 #include "replay-internal.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 
@@ -26,17 +27,8 @@ static QemuMutex lock;
 static QemuCond mutex_cond;
 static unsigned long mutex_head, mutex_tail;
 
-/* File for replay writing */
-static bool write_error;
-FILE *replay_file;
-
-static void replay_write_error(void)
-{
-    if (!write_error) {
-        error_report("replay write error");
-        write_error = true;
-    }
-}
+/* Log being recorded or replayed */
+ReplayLog *replay_file;
 
 static void replay_read_error(void)
 {
@@ -44,15 +36,25 @@ static void replay_read_error(void)
     exit(1);
 }
 
-void replay_put_byte(uint8_t byte)
+static void replay_put(const void *buf, size_t size)
 {
     if (replay_file) {
-        if (putc(byte, replay_file) == EOF) {
-            replay_write_error();
-        }
+        replay_log_write(replay_file, buf, size);
     }
 }
 
+static void replay_get(void *buf, size_t size)
+{
+    if (!replay_log_read(replay_file, buf, size)) {
+        replay_read_error();
+    }
+}
+
+void replay_put_byte(uint8_t byte)
+{
+    replay_put(&byte, 1);
+}
+
 void replay_put_event(uint8_t event)
 {
     assert(event < EVENT_COUNT);
@@ -62,29 +64,33 @@ void replay_put_event(uint8_t event)
 
 void replay_put_word(uint16_t word)
 {
-    replay_put_byte(word >> 8);
-    replay_put_byte(word);
+    uint8_t buf[2];
+
+    stw_be_p(buf, word);
+    replay_put(buf, sizeof(buf));
 }
 
 void replay_put_dword(uint32_t dword)
 {
-    replay_put_word(dword >> 16);
-    replay_put_word(dword);
+    uint8_t buf[4];
+
+    stl_be_p(buf, dword);
+    replay_put(buf, sizeof(buf));
 }
 
 void replay_put_qword(int64_t qword)
 {
-    replay_put_dword(qword >> 32);
-    replay_put_dword(qword);
+    uint8_t buf[8];
+
+    stq_be_p(buf, qword);
+    replay_put(buf, sizeof(buf));
 }
 
 void replay_put_array(const uint8_t *buf, size_t size)
 {
     if (replay_file) {
         replay_put_dword(size);
-        if (fwrite(buf, 1, size, replay_file) != size) {
-            replay_write_error();
-        }
+        replay_put(buf, size);
     }
 }
 
@@ -92,55 +98,49 @@ uint8_t replay_get_byte(void)
 {
     uint8_t byte = 0;
     if (replay_file) {
-        int r = getc(replay_file);
-        if (r == EOF) {
-            replay_read_error();
-        }
-        byte = r;
+        replay_get(&byte, 1);
     }
     return byte;
 }
 
 uint16_t replay_get_word(void)
 {
-    uint16_t word = 0;
-    if (replay_file) {
-        word = replay_get_byte();
-        word = (word << 8) + replay_get_byte();
-    }
+    uint8_t buf[2];
 
-    return word;
+    if (!replay_file) {
+        return 0;
+    }
+    replay_get(buf, sizeof(buf));
+    return lduw_be_p(buf);
 }
 
 uint32_t replay_get_dword(void)
 {
-    uint32_t dword = 0;
-    if (replay_file) {
-        dword = replay_get_word();
-        dword = (dword << 16) + replay_get_word();
-    }
+    uint8_t buf[4];
 
-    return dword;
+    if (!replay_file) {
+        return 0;
+    }
+    replay_get(buf, sizeof(buf));
+    return ldl_be_p(buf);
 }
 
 int64_t replay_get_qword(void)
 {
-    int64_t qword = 0;
-    if (replay_file) {
-        qword = replay_get_dword();
-        qword = (qword << 32) + replay_get_dword();
-    }
+    uint8_t buf[8];
 
-    return qword;
+    if (!replay_file) {
+        return 0;
+    }
+    replay_get(buf, sizeof(buf));
+    return ldq_be_p(buf);
 }
 
 void replay_get_array(uint8_t *buf, size_t *size)
 {
     if (replay_file) {
         *size = replay_get_dword();
-        if (fread(buf, 1, *size, replay_file) != *size) {
-            replay_read_error();
-        }
+        replay_get(buf, *size);
     }
 }
 
@@ -149,20 +149,18 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size)
     if (replay_file) {
         *size = replay_get_dword();
         *buf = g_malloc(*size);
-        if (fread(*buf, 1, *size, replay_file) != *size) {
-            replay_read_error();
-        }
+        replay_get(*buf, *size);
     }
 }
 
 void replay_check_error(void)
 {
     if (replay_file) {
-        if (feof(replay_file)) {
+        if (replay_log_eof(replay_file)) {
             error_report("replay file is over");
             qemu_system_vmstop_request_prepare();
             qemu_system_vmstop_request(RUN_STATE_PAUSED);
-        } else if (ferror(replay_file)) {
+        } else if (replay_log_error(replay_file)) {
             error_report("replay file is over or something goes wrong");
             qemu_system_vmstop_request_prepare();
             qemu_system_vmstop_request(RUN_STATE_INTERNAL_ERROR);
@@ -252,6 +250,7 @@ void replay_advance_current_icount(uint64_t current_icount)
             replay_put_event(EVENT_INSTRUCTION);
             replay_put_dword(diff);
             replay_state.current_icount += diff;
+            replay_auto_snapshot_check();
         }
     } else if (replay_mode == REPLAY_MODE_PLAY) {
         if (diff > 0) {
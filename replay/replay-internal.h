@@ -92,13 +92,44 @@ typedef struct ReplayState {
 } ReplayState;
 extern ReplayState replay_state;
 
-/* File for replay writing */
-extern FILE *replay_file;
+/* Log being recorded or replayed */
+typedef struct ReplayLog ReplayLog;
+extern ReplayLog *replay_file;
+/* Instructions between automatic snapshots while recording, or 0 */
+extern uint64_t replay_snapshot_period;
+/* Number of automatic snapshots to keep, or 0 to keep them all */
+extern unsigned replay_snapshot_keep;
 /* Instruction count of the replay breakpoint */
 extern uint64_t replay_break_icount;
 /* Timer for the replay breakpoint callback */
 extern QEMUTimer *replay_break_timer;
 
+/* Block-buffered log file, see replay-log.c */
+
+/**
+ * replay_log_open:
+ *
+ * Open @fname for recording if @write is true, for replaying otherwise.
+ * The first @header_size bytes of the log are set aside for a header
+ * that is written by replay_log_close(), once the recording is
+ * complete.  When replaying, whether the log is compressed comes from
+ * the file itself and @compress is ignored.
+ */
+ReplayLog *replay_log_open(const char *fname, bool write, bool compress,
+                           size_t header_size, Error **errp);
+/* Flush the log and, when recording, write @header to it */
+void replay_log_close(ReplayLog *log, const uint8_t *header);
+void replay_log_write(ReplayLog *log, const void *buf, size_t size);
+/* Returns false at the end of the log or on error */
+bool replay_log_read(ReplayLog *log, void *buf, size_t size);
+/* The header read by replay_log_open() */
+const uint8_t *replay_log_header(ReplayLog *log);
+/* Position in the log, counting the header as in an uncompressed log */
+uint64_t replay_log_tell(ReplayLog *log);
+void replay_log_seek(ReplayLog *log, uint64_t offset);
+bool replay_log_eof(ReplayLog *log);
+bool replay_log_error(ReplayLog *log);
+
 void replay_put_byte(uint8_t byte);
 void replay_put_event(uint8_t event);
 void replay_put_word(uint16_t word);
@@ -194,5 +225,7 @@ void *replay_event_net_load(void);
    Should be called before virtual devices initialization
    to make cached timers available for post_load functions. */
 void replay_vmstate_register(void);
+/* Schedules an automatic snapshot once the period has elapsed */
+void replay_auto_snapshot_check(void);
 
 #endif
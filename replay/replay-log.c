@@ -0,0 +1,488 @@
+/*
+ * replay-log.c
+ *
+ * Block-buffered access to the record/replay log
+ *
+ * Events are appended to an in-memory block; full blocks are handed to
+ * a thread that writes them out, so the vCPU does not wait for the disk
+ * and the producer only blocks when REPLAY_LOG_QUEUE_MAX blocks are in
+ * flight.  A log recorded without compression is byte for byte the
+ * same as before.
+ *
+ * With compression, each block is a separate zstd frame behind a small
+ * header that gives its offset in the uncompressed stream.  Opening the
+ * log for replay reads these headers into an index, so that loading a
+ * snapshot can seek to the block that holds its position:
+ *
+ *   "QEMURRZ1" | log header | { be64 offset, be32 len, be32 stored,
+ *                               stored bytes } ...
+ *
+ * A block whose stored length equals its length was kept uncompressed.
+ * Offsets count the log header, so they are the same as in an
+ * uncompressed log and the saved file_offset of a snapshot works with
+ * either.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "replay-internal.h"
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+#define REPLAY_LOG_MAGIC        "QEMURRZ1"
+#define REPLAY_LOG_MAGIC_SIZE   8
+#define REPLAY_LOG_BLOCK_SIZE   (1 * MiB)
+/* Blocks waiting for the writer thread before the producer waits */
+#define REPLAY_LOG_QUEUE_MAX    8
+#define REPLAY_LOG_ZSTD_LEVEL   3
+
+typedef struct ReplayLogBlock {
+    uint64_t offset;                /* in the uncompressed stream */
+    size_t len;
+    QSIMPLEQ_ENTRY(ReplayLogBlock) next;
+    uint8_t data[REPLAY_LOG_BLOCK_SIZE];
+} ReplayLogBlock;
+
+typedef struct ReplayLogIndex {
+    uint64_t offset;
+    uint64_t file_offset;           /* of the stored bytes */
+    uint32_t len;
+    uint32_t stored;
+} ReplayLogIndex;
+
+struct ReplayLog {
+    int fd;
+    bool write;
+    bool compress;
+    size_t header_size;
+    uint8_t *header;
+
+    /* Block being filled or read, and the position in it */
+    ReplayLogBlock *cur;
+    size_t pos;
+    bool error;
+    bool eof;
+
+    /* Recording: the writer thread and its queue */
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    QSIMPLEQ_HEAD(, ReplayLogBlock) queue;
+    unsigned queued;
+    bool closing;
+
+    /* Replaying a compressed log: one entry per block */
+    GArray *index;
+    guint cur_index;
+};
+
+static ReplayLogBlock *replay_log_block_new(uint64_t offset)
+{
+    ReplayLogBlock *b = g_new(ReplayLogBlock, 1);
+
+    b->offset = offset;
+    b->len = 0;
+    return b;
+}
+
+static void replay_log_write_block(ReplayLog *log, ReplayLogBlock *b,
+                                   uint8_t *zbuf, size_t zsize)
+{
+    uint8_t hdr[16];
+    const uint8_t *data = b->data;
+    size_t stored = b->len;
+
+    if (!log->compress) {
+        if (pwrite(log->fd, b->data, b->len, b->offset) != b->len) {
+            goto fail;
+        }
+        return;
+    }
+
+#ifdef CONFIG_ZSTD
+    {
+        size_t z = ZSTD_compress(zbuf, zsize, b->data, b->len,
+                                 REPLAY_LOG_ZSTD_LEVEL);
+
+        if (!ZSTD_isError(z) && z < b->len) {
+            data = zbuf;
+            stored = z;
+        }
+    }
+#endif
+    stq_be_p(hdr, b->offset);
+    stl_be_p(hdr + 8, b->len);
+    stl_be_p(hdr + 12, stored);
+    if (qemu_write_full(log->fd, hdr, sizeof(hdr)) != sizeof(hdr) ||
+        qemu_write_full(log->fd, data, stored) != stored) {
+        goto fail;
+    }
+    return;
+
+ fail:
+    if (!log->error) {
+        error_report("replay write error: %s", strerror(errno));
+        log->error = true;
+    }
+}
+
+static void *replay_log_writer(void *opaque)
+{
+    ReplayLog *log = opaque;
+    size_t zsize = 0;
+    g_autofree uint8_t *zbuf = NULL;
+    ReplayLogBlock *b;
+
+#ifdef CONFIG_ZSTD
+    if (log->compress) {
+        zsize = ZSTD_compressBound(REPLAY_LOG_BLOCK_SIZE);
+        zbuf = g_malloc(zsize);
+    }
+#endif
+
+    qemu_mutex_lock(&log->lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&log->queue) && !log->closing) {
+            qemu_cond_wait(&log->cond, &log->lock);
+        }
+        b = QSIMPLEQ_FIRST(&log->queue);
+        if (!b) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&log->queue, next);
+        qemu_mutex_unlock(&log->lock);
+
+        replay_log_write_block(log, b, zbuf, zsize);
+        g_free(b);
+
+        qemu_mutex_lock(&log->lock);
+        log->queued--;
+        qemu_cond_broadcast(&log->cond);
+    }
+    qemu_mutex_unlock(&log->lock);
+    return NULL;
+}
+
+static void replay_log_queue(ReplayLog *log)
+{
+    ReplayLogBlock *b = log->cur;
+
+    b->len = log->pos;
+    log->cur = replay_log_block_new(b->offset + b->len);
+    log->pos = 0;
+
+    qemu_mutex_lock(&log->lock);
+    while (log->queued >= REPLAY_LOG_QUEUE_MAX) {
+        qemu_cond_wait(&log->cond, &log->lock);
+    }
+    QSIMPLEQ_INSERT_TAIL(&log->queue, b, next);
+    log->queued++;
+    qemu_cond_broadcast(&log->cond);
+    qemu_mutex_unlock(&log->lock);
+}
+
+void replay_log_write(ReplayLog *log, const void *buf, size_t size)
+{
+    const uint8_t *p = buf;
+
+    assert(log->write);
+    while (size) {
+        size_t n = MIN(size, REPLAY_LOG_BLOCK_SIZE - log->pos);
+
+        memcpy(log->cur->data + log->pos, p, n);
+        log->pos += n;
+        p += n;
+        size -= n;
+        if (log->pos == REPLAY_LOG_BLOCK_SIZE) {
+            replay_log_queue(log);
+        }
+    }
+}
+
+/* Build the index of a compressed log from its block headers */
+static bool replay_log_read_index(ReplayLog *log, Error **errp)
+{
+    uint64_t file_offset = REPLAY_LOG_MAGIC_SIZE + log->header_size;
+    uint64_t offset = log->header_size;
+    uint8_t hdr[16];
+    ssize_t r;
+
+    log->index = g_array_new(false, false, sizeof(ReplayLogIndex));
+    while ((r = pread(log->fd, hdr, sizeof(hdr), file_offset)) > 0) {
+        ReplayLogIndex e = {
+            .offset = ldq_be_p(hdr),
+            .file_offset = file_offset + sizeof(hdr),
+            .len = ldl_be_p(hdr + 8),
+            .stored = ldl_be_p(hdr + 12),
+        };
+
+        if (r != sizeof(hdr) || e.offset != offset ||
+            e.len > REPLAY_LOG_BLOCK_SIZE || e.stored > e.len) {
+            /* A recording that was cut short; keep what is complete */
+            warn_report("replay: ignoring the truncated end of the log");
+            break;
+        }
+        g_array_append_val(log->index, e);
+        offset += e.len;
+        file_offset = e.file_offset + e.stored;
+    }
+    if (r < 0) {
+        error_setg_errno(errp, errno, "could not read the replay log");
+        return false;
+    }
+    return true;
+}
+
+/* Load the block that holds @offset into log->cur */
+static bool replay_log_load(ReplayLog *log, uint64_t offset)
+{
+    ReplayLogBlock *b = log->cur;
+    ssize_t r;
+
+    if (!log->compress) {
+        r = pread(log->fd, b->data, REPLAY_LOG_BLOCK_SIZE, offset);
+        if (r <= 0) {
+            log->error |= r < 0;
+            return false;
+        }
+        b->offset = offset;
+        b->len = r;
+        log->pos = 0;
+        return true;
+    }
+
+    /* Usually the next block, otherwise look it up */
+    if (log->cur_index >= log->index->len ||
+        g_array_index(log->index, ReplayLogIndex,
+                      log->cur_index).offset != offset) {
+        guint lo = 0, hi = log->index->len;
+
+        while (lo < hi) {
+            guint mid = (lo + hi) / 2;
+            ReplayLogIndex *e = &g_array_index(log->index, ReplayLogIndex,
+                                               mid);
+
+            if (offset < e->offset) {
+                hi = mid;
+            } else if (offset >= e->offset + e->len) {
+                lo = mid + 1;
+            } else {
+                lo = mid;
+                break;
+            }
+        }
+        if (lo >= log->index->len) {
+            return false;
+        }
+        log->cur_index = lo;
+    }
+
+    {
+        ReplayLogIndex *e = &g_array_index(log->index, ReplayLogIndex,
+                                           log->cur_index);
+
+        if (e->stored == e->len) {
+            r = pread(log->fd, b->data, e->len, e->file_offset);
+            if (r != e->len) {
+                log->error = true;
+                return false;
+            }
+        } else {
+#ifdef CONFIG_ZSTD
+            g_autofree uint8_t *zbuf = g_malloc(e->stored);
+            size_t z;
+
+            if (pread(log->fd, zbuf, e->stored, e->file_offset) != e->stored) {
+                log->error = true;
+                return false;
+            }
+            z = ZSTD_decompress(b->data, REPLAY_LOG_BLOCK_SIZE,
+                                zbuf, e->stored);
+            if (ZSTD_isError(z) || z != e->len) {
+                log->error = true;
+                return false;
+            }
+#else
+            g_assert_not_reached();
+#endif
+        }
+        b->offset = e->offset;
+        b->len = e->len;
+        log->pos = offset - e->offset;
+        log->cur_index++;
+    }
+    return true;
+}
+
+bool replay_log_read(ReplayLog *log, void *buf, size_t size)
+{
+    uint8_t *p = buf;
+
+    assert(!log->write);
+    while (size) {
+        size_t n;
+
+        if (log->pos == log->cur->len &&
+            !replay_log_load(log, log->cur->offset + log->cur->len)) {
+            log->eof = !log->error;
+            return false;
+        }
+        n = MIN(size, log->cur->len - log->pos);
+        memcpy(p, log->cur->data + log->pos, n);
+        log->pos += n;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+uint64_t replay_log_tell(ReplayLog *log)
+{
+    return log->cur->offset + log->pos;
+}
+
+void replay_log_seek(ReplayLog *log, uint64_t offset)
+{
+    assert(!log->write);
+    log->eof = false;
+    if (offset >= log->cur->offset &&
+        offset <= log->cur->offset + log->cur->len) {
+        log->pos = offset - log->cur->offset;
+        return;
+    }
+    /* An empty block at @offset, loaded by the next read */
+    log->cur->offset = offset;
+    log->cur->len = 0;
+    log->pos = 0;
+}
+
+bool replay_log_eof(ReplayLog *log)
+{
+    return log->eof;
+}
+
+bool replay_log_error(ReplayLog *log)
+{
+    return log->error;
+}
+
+const uint8_t *replay_log_header(ReplayLog *log)
+{
+    return log->header;
+}
+
+ReplayLog *replay_log_open(const char *fname, bool write, bool compress,
+                           size_t header_size, Error **errp)
+{
+    ReplayLog *log;
+    char magic[REPLAY_LOG_MAGIC_SIZE];
+    int fd;
+
+#ifndef CONFIG_ZSTD
+    if (compress) {
+        error_setg(errp, "replay log compression needs zstd support");
+        return NULL;
+    }
+#endif
+    if (write) {
+        fd = qemu_create(fname, O_WRONLY | O_TRUNC | O_BINARY, 0666, errp);
+    } else {
+        fd = qemu_open(fname, O_RDONLY | O_BINARY, errp);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+
+    log = g_new0(ReplayLog, 1);
+    log->fd = fd;
+    log->write = write;
+    log->header_size = header_size;
+    log->header = g_malloc0(header_size);
+    log->cur = replay_log_block_new(header_size);
+
+    if (write) {
+        log->compress = compress;
+        if (compress &&
+            (qemu_write_full(fd, REPLAY_LOG_MAGIC, REPLAY_LOG_MAGIC_SIZE) !=
+             REPLAY_LOG_MAGIC_SIZE ||
+             lseek(fd, REPLAY_LOG_MAGIC_SIZE + header_size, SEEK_SET) < 0)) {
+            error_setg_errno(errp, errno, "could not write the replay log");
+            goto fail;
+        }
+        qemu_mutex_init(&log->lock);
+        qemu_cond_init(&log->cond);
+        QSIMPLEQ_INIT(&log->queue);
+        qemu_thread_create(&log->thread, "replay log", replay_log_writer,
+                           log, QEMU_THREAD_JOINABLE);
+        return log;
+    }
+
+    if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+        !memcmp(magic, REPLAY_LOG_MAGIC, sizeof(magic))) {
+#ifndef CONFIG_ZSTD
+        error_setg(errp, "the replay log is compressed, "
+                   "which needs zstd support");
+        goto fail;
+#endif
+        log->compress = true;
+    }
+    if (pread(fd, log->header, header_size,
+              log->compress ? REPLAY_LOG_MAGIC_SIZE : 0) != header_size) {
+        error_setg(errp, "the replay log is too short");
+        goto fail;
+    }
+    if (log->compress && !replay_log_read_index(log, errp)) {
+        goto fail;
+    }
+    return log;
+
+ fail:
+    if (log->index) {
+        g_array_free(log->index, true);
+    }
+    g_free(log->cur);
+    g_free(log->header);
+    g_free(log);
+    close(fd);
+    return NULL;
+}
+
+void replay_log_close(ReplayLog *log, const uint8_t *header)
+{
+    if (log->write) {
+        if (log->pos) {
+            replay_log_queue(log);
+        }
+        qemu_mutex_lock(&log->lock);
+        log->closing = true;
+        qemu_cond_broadcast(&log->cond);
+        qemu_mutex_unlock(&log->lock);
+        qemu_thread_join(&log->thread);
+        qemu_cond_destroy(&log->cond);
+        qemu_mutex_destroy(&log->lock);
+
+        /* Written last, so that an interrupted recording is rejected */
+        if (pwrite(log->fd, header, log->header_size,
+                   log->compress ? REPLAY_LOG_MAGIC_SIZE : 0) !=
+            log->header_size) {
+            error_report("replay write error: %s", strerror(errno));
+        }
+    }
+    if (log->index) {
+        g_array_free(log->index, true);
+    }
+    close(log->fd);
+    g_free(log->cur);
+    g_free(log->header);
+    g_free(log);
+}
@@ -16,13 +16,14 @@
 #include "monitor/monitor.h"
 #include "qapi/qmp/qstring.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
 #include "migration/vmstate.h"
 #include "migration/snapshot.h"
 
 static int replay_pre_save(void *opaque)
 {
     ReplayState *state = opaque;
-    state->file_offset = ftell(replay_file);
+    state->file_offset = replay_log_tell(replay_file);
 
     return 0;
 }
@@ -31,7 +32,7 @@ static int replay_post_load(void *opaque, int version_id)
 {
     ReplayState *state = opaque;
     if (replay_mode == REPLAY_MODE_PLAY) {
-        fseek(replay_file, state->file_offset, SEEK_SET);
+        replay_log_seek(replay_file, state->file_offset);
         /* If this was a vmstate, saved in recording mode,
            we need to initialize replay data fields. */
         replay_fetch_data_kind();
@@ -71,6 +72,58 @@ void replay_vmstate_register(void)
     vmstate_register(NULL, 0, &vmstate_replay, &replay_state);
 }
 
+/* Automatic snapshots, every replay_snapshot_period instructions */
+uint64_t replay_snapshot_period;
+unsigned replay_snapshot_keep;
+static uint64_t replay_snapshot_next;
+static QEMUTimer *replay_snapshot_timer;
+static GQueue replay_snapshot_names = G_QUEUE_INIT;
+
+static void replay_auto_snapshot(void *opaque)
+{
+    uint64_t icount = replay_get_current_icount();
+    g_autofree char *name = NULL;
+    Error *err = NULL;
+
+    if (!replay_can_snapshot()) {
+        /* wait for the pending events to be written */
+        timer_mod_ns(replay_snapshot_timer,
+                     qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + SCALE_MS);
+        return;
+    }
+
+    name = g_strdup_printf("replay-auto-%" PRIu64, icount);
+    if (!save_snapshot(name, true, NULL, false, NULL, &err)) {
+        error_report_err(err);
+        warn_report("Disabling the automatic snapshots of the replay");
+        replay_snapshot_next = 0;
+        return;
+    }
+    g_queue_push_tail(&replay_snapshot_names, g_steal_pointer(&name));
+
+    while (replay_snapshot_keep &&
+           g_queue_get_length(&replay_snapshot_names) > replay_snapshot_keep) {
+        g_autofree char *old = g_queue_pop_head(&replay_snapshot_names);
+
+        if (!delete_snapshot(old, false, NULL, &err)) {
+            error_report_err(err);
+            err = NULL;
+        }
+    }
+    replay_snapshot_next = icount + replay_snapshot_period;
+}
+
+void replay_auto_snapshot_check(void)
+{
+    if (replay_snapshot_next &&
+        replay_state.current_icount >= replay_snapshot_next &&
+        !timer_pending(replay_snapshot_timer)) {
+        /* Cannot make the snapshot from the vCPU thread */
+        timer_mod_ns(replay_snapshot_timer,
+                     qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
+    }
+}
+
 void replay_vmstate_init(void)
 {
     Error *err = NULL;
@@ -91,6 +144,13 @@ void replay_vmstate_init(void)
             }
         }
     }
+
+    if (replay_mode == REPLAY_MODE_RECORD && replay_snapshot_period) {
+        replay_snapshot_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                             replay_auto_snapshot, NULL);
+        replay_snapshot_next = replay_get_current_icount() +
+                               replay_snapshot_period;
+    }
 }
 
 bool replay_can_snapshot(void)
@@ -17,6 +17,7 @@
 #include "replay-internal.h"
 #include "qemu/main-loop.h"
 #include "qemu/option.h"
+#include "qemu/bswap.h"
 #include "sysemu/cpus.h"
 #include "qemu/error-report.h"
 
@@ -240,28 +241,23 @@ bool replay_has_checkpoint(void)
     return res;
 }
 
-static void replay_enable(const char *fname, int mode)
+static void replay_enable(const char *fname, int mode, bool compress)
 {
-    const char *fmode = NULL;
+    Error *err = NULL;
+
     assert(!replay_file);
 
-    switch (mode) {
-    case REPLAY_MODE_RECORD:
-        fmode = "wb";
-        break;
-    case REPLAY_MODE_PLAY:
-        fmode = "rb";
-        break;
-    default:
+    if (mode != REPLAY_MODE_RECORD && mode != REPLAY_MODE_PLAY) {
         fprintf(stderr, "Replay: internal error: invalid replay mode\n");
         exit(1);
     }
 
     atexit(replay_finish);
 
-    replay_file = fopen(fname, fmode);
+    replay_file = replay_log_open(fname, mode == REPLAY_MODE_RECORD,
+                                  compress, HEADER_SIZE, &err);
     if (replay_file == NULL) {
-        fprintf(stderr, "Replay: open %s: %s\n", fname, strerror(errno));
+        error_reportf_err(err, "Replay: open %s: ", fname);
         exit(1);
     }
 
@@ -274,17 +270,13 @@ static void replay_enable(const char *fname, int mode)
     replay_state.current_icount = 0;
     replay_state.has_unread_data = 0;
 
-    /* skip file header for RECORD and check it for PLAY */
-    if (replay_mode == REPLAY_MODE_RECORD) {
-        fseek(replay_file, HEADER_SIZE, SEEK_SET);
-    } else if (replay_mode == REPLAY_MODE_PLAY) {
-        unsigned int version = replay_get_dword();
+    /* the log starts after the header, check it for PLAY */
+    if (replay_mode == REPLAY_MODE_PLAY) {
+        unsigned int version = ldl_be_p(replay_log_header(replay_file));
         if (version != REPLAY_VERSION) {
             fprintf(stderr, "Replay: invalid input log file version\n");
             exit(1);
         }
-        /* go to the beginning */
-        fseek(replay_file, HEADER_SIZE, SEEK_SET);
         replay_fetch_data_kind();
     }
 
@@ -325,8 +317,10 @@ void replay_configure(QemuOpts *opts)
     }
 
     replay_snapshot = g_strdup(qemu_opt_get(opts, "rrsnapshot"));
+    replay_snapshot_period = qemu_opt_get_number(opts, "rrsnapshot-period", 0);
+    replay_snapshot_keep = qemu_opt_get_number(opts, "rrsnapshot-keep", 0);
     replay_vmstate_register();
-    replay_enable(fname, mode);
+    replay_enable(fname, mode, qemu_opt_get_bool(opts, "rrcompress", false));
 
 out:
     loc_pop(&loc);
@@ -362,6 +356,8 @@ void replay_finish(void)
 
     /* finalize the file */
     if (replay_file) {
+        uint8_t header[HEADER_SIZE] = { 0 };
+
         if (replay_mode == REPLAY_MODE_RECORD) {
             /*
              * Can't do it in the signal handler, therefore
@@ -371,12 +367,10 @@ void replay_finish(void)
             /* write end event */
             replay_put_event(EVENT_END);
 
-            /* write header */
-            fseek(replay_file, 0, SEEK_SET);
-            replay_put_dword(REPLAY_VERSION);
+            stl_be_p(header, REPLAY_VERSION);
         }
 
-        fclose(replay_file);
+        replay_log_close(replay_file, header);
         replay_file = NULL;
     }
     if (replay_filename) {
@@ -13,15 +13,25 @@ meson_options_help() {
   printf "%s\n" '                           jemalloc/system/tcmalloc)'
   printf "%s\n" '  --enable-slirp[=CHOICE]  Whether and how to find the slirp library'
   printf "%s\n" '                           (choices: auto/disabled/enabled/internal/system)'
+  printf "%s\n" '  --enable-tb-jmp-cache-bits=CHOICE'
+  printf "%s\n" '                           log2 of the number of entries of the per-vCPU TB'
+  printf "%s\n" '                           jump cache [12] (choices: 12/13/14/15/16)'
+  printf "%s\n" '  --enable-tb-jmp-cache-ways=CHOICE'
+  printf "%s\n" '                           associativity of the per-vCPU TB jump cache [1]'
+  printf "%s\n" '                           (choices: 1/2/4)'
   printf "%s\n" '  --enable-tcg-interpreter TCG with bytecode interpreter (slow)'
   printf "%s\n" '  --enable-trace-backends=CHOICE'
   printf "%s\n" '                           Set available tracing backends [log] (choices:'
-  printf "%s\n" '                           dtrace/ftrace/log/nop/simple/syslog/ust)'
+  printf "%s\n" '                           dtrace/ftrace/log/nop/ring/simple/syslog/ust)'
+  printf "%s\n" '  --enable-trace-static-keys=CHOICE'
+  printf "%s\n" '                           Trace event groups whose trace points are patched'
+  printf "%s\n" '                           in at runtime []'
   printf "%s\n" ''
   printf "%s\n" 'Optional features, enabled with --enable-FEATURE and'
   printf "%s\n" 'disabled with --disable-FEATURE, default is enabled if available'
   printf "%s\n" '(unless built with --without-default-features):'
   printf "%s\n" ''
+  printf "%s\n" '  af-xdp          AF_XDP network backend support'
   printf "%s\n" '  alsa            ALSA sound support'
   printf "%s\n" '  attr            attr/xattr support'
   printf "%s\n" '  auth-pam        PAM access control'
@@ -59,6 +69,7 @@ meson_options_help() {
   printf "%s\n" '  linux-aio       Linux AIO support'
   printf "%s\n" '  linux-io-uring  Linux io_uring support'
   printf "%s\n" '  lzfse           lzfse support for DMG images'
+  printf "%s\n" '  lz4             lz4 compression support for multifd migration'
   printf "%s\n" '  lzo             lzo compression support'
   printf "%s\n" '  malloc-trim     enable libc malloc_trim() for memory optimization'
   printf "%s\n" '  mpath           Multipath persistent reservation passthrough'
@@ -88,6 +99,7 @@ meson_options_help() {
   printf "%s\n" '  virtfs          virtio-9p support'
   printf "%s\n" '  virtiofsd       build virtiofs daemon (virtiofsd)'
   printf "%s\n" '  vnc             VNC server'
+  printf "%s\n" '  vnc-h264        H.264 video encoding for VNC server'
   printf "%s\n" '  vnc-jpeg        JPEG lossy compression for VNC server'
   printf "%s\n" '  vnc-png         PNG compression for VNC server'
   printf "%s\n" '  vnc-sasl        SASL authentication for VNC server'
@@ -101,6 +113,8 @@ meson_options_help() {
 }
 _meson_option_parse() {
   case $1 in
+    --enable-af-xdp) printf "%s" -Daf_xdp=enabled ;;
+    --disable-af-xdp) printf "%s" -Daf_xdp=disabled ;;
     --enable-alsa) printf "%s" -Dalsa=enabled ;;
     --disable-alsa) printf "%s" -Dalsa=disabled ;;
     --enable-attr) printf "%s" -Dattr=enabled ;;
@@ -189,6 +203,8 @@ _meson_option_parse() {
     --disable-linux-io-uring) printf "%s" -Dlinux_io_uring=disabled ;;
     --enable-lzfse) printf "%s" -Dlzfse=enabled ;;
     --disable-lzfse) printf "%s" -Dlzfse=disabled ;;
+    --enable-lz4) printf "%s" -Dlz4=enabled ;;
+    --disable-lz4) printf "%s" -Dlz4=disabled ;;
     --enable-lzo) printf "%s" -Dlzo=enabled ;;
     --disable-lzo) printf "%s" -Dlzo=disabled ;;
     --enable-malloc=*) quote_sh "-Dmalloc=$2" ;;
@@ -231,11 +247,14 @@ _meson_option_parse() {
     --disable-spice) printf "%s" -Dspice=disabled ;;
     --enable-spice-protocol) printf "%s" -Dspice_protocol=enabled ;;
     --disable-spice-protocol) printf "%s" -Dspice_protocol=disabled ;;
+    --enable-tb-jmp-cache-bits=*) quote_sh "-Dtb_jmp_cache_bits=$2" ;;
+    --enable-tb-jmp-cache-ways=*) quote_sh "-Dtb_jmp_cache_ways=$2" ;;
     --enable-tcg) printf "%s" -Dtcg=enabled ;;
     --disable-tcg) printf "%s" -Dtcg=disabled ;;
     --enable-tcg-interpreter) printf "%s" -Dtcg_interpreter=true ;;
     --disable-tcg-interpreter) printf "%s" -Dtcg_interpreter=false ;;
     --enable-trace-backends=*) quote_sh "-Dtrace_backends=$2" ;;
+    --enable-trace-static-keys=*) quote_sh "-Dtrace_static_keys=$2" ;;
     --enable-u2f) printf "%s" -Du2f=enabled ;;
     --disable-u2f) printf "%s" -Du2f=disabled ;;
     --enable-usb-redir) printf "%s" -Dusb_redir=enabled ;;
@@ -252,6 +271,8 @@ _meson_option_parse() {
     --disable-virtiofsd) printf "%s" -Dvirtiofsd=disabled ;;
     --enable-vnc) printf "%s" -Dvnc=enabled ;;
     --disable-vnc) printf "%s" -Dvnc=disabled ;;
+    --enable-vnc-h264) printf "%s" -Dvnc_h264=enabled ;;
+    --disable-vnc-h264) printf "%s" -Dvnc_h264=disabled ;;
     --enable-vnc-jpeg) printf "%s" -Dvnc_jpeg=enabled ;;
     --disable-vnc-jpeg) printf "%s" -Dvnc_jpeg=disabled ;;
     --enable-vnc-png) printf "%s" -Dvnc_png=enabled ;;
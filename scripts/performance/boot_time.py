@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+
+#  Measure how long a system emulator takes to boot a firmware, that is
+#  until a given string shows up on the serial console, and compare
+#  several QEMU binaries.
+#
+#  Syntax:
+#  boot_time.py [-h] [-n <runs>] [-p <pattern>] -- <firmware> \
+#               <qemu executable> [<qemu executable> ...]
+#
+#  [-h] - Print the script arguments help message.
+#  [-n] - Number of boots per binary, the best time is reported.
+#       - If this flag is not specified, the tool defaults to 5.
+#  [-p] - Console output that marks the end of the boot.
+#       - If this flag is not specified, the tool defaults to the
+#         barebox prompt of the canon-a1100 firmware.
+#  [-m] - Machine type, defaults to canon-a1100.
+#
+#  Example of usage, comparing two TCI builds on the barebox firmware of
+#  https://www.qemu-advent-calendar.org/2018/download/day18.tar.xz:
+#  boot_time.py -- day18/barebox.canon-a1100.bin \
+#      build-switch/qemu-system-arm build/qemu-system-arm
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import subprocess
+import sys
+import time
+
+
+def boot_once(qemu, machine, firmware, pattern):
+    """
+    Boot firmware once and return the time until pattern was printed,
+    or None if QEMU exited before that.
+    """
+    start = time.monotonic()
+    proc = subprocess.Popen([qemu, "-M", machine, "-bios", firmware,
+                             "-display", "none", "-monitor", "none",
+                             "-serial", "stdio"],
+                            stdin=subprocess.DEVNULL,
+                            stdout=subprocess.PIPE,
+                            stderr=subprocess.DEVNULL)
+    output = b""
+    elapsed = None
+    while True:
+        data = proc.stdout.read1(4096)
+        if not data:
+            break
+        output += data
+        if pattern in output:
+            elapsed = time.monotonic() - start
+            break
+    proc.kill()
+    proc.wait()
+    return elapsed
+
+
+parser = argparse.ArgumentParser(
+    usage='boot_time.py [-h] [-n <runs>] [-p <pattern>] [-m <machine>] -- '
+          '<firmware> <qemu executable> [<qemu executable> ...]')
+
+parser.add_argument('-n', dest='runs', type=int, default=5,
+                    help='Number of boots per binary.')
+parser.add_argument('-p', dest='pattern', type=str,
+                    default='running /env/bin/init',
+                    help='Console output that marks the end of the boot.')
+parser.add_argument('-m', dest='machine', type=str, default='canon-a1100',
+                    help='Machine type.')
+parser.add_argument('firmware', type=str, help=argparse.SUPPRESS)
+parser.add_argument('qemu', type=str, nargs='+', help=argparse.SUPPRESS)
+
+args = parser.parse_args()
+
+# Print table header
+print('{:>10}  {:>10}  {}\n{}  {}  {}'.format('Best (s)', 'Mean (s)',
+                                              'Binary',
+                                              '-' * 10, '-' * 10, '-' * 30))
+
+for qemu in args.qemu:
+    times = []
+    for _ in range(args.runs):
+        elapsed = boot_once(qemu, args.machine, args.firmware,
+                            args.pattern.encode())
+        if elapsed is None:
+            sys.exit("{} exited before the end of the boot".format(qemu))
+        times.append(elapsed)
+    print('{:>10.3f}  {:>10.3f}  {}'.format(min(times),
+                                            sum(times) / len(times), qemu))
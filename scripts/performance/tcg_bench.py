@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+
+#  Time the TCG benchmark payloads of tests/tcg/arm/bench and report
+#  the guest MIPS of each, one JSON object per line, so that runs on
+#  different commits can be collected and compared.
+#
+#  Syntax:
+#  tcg_bench.py [-h] [-n <runs>] -p <libinsn.so> -- \
+#               <qemu-system-arm> <payload> [<payload> ...]
+#
+#  [-h] - Print the script arguments help message.
+#  [-n] - Number of timed runs per payload, the best time is reported.
+#       - If this flag is not specified, the tool defaults to 5.
+#  [-p] - The insn plugin of tests/plugin, used for one more run of
+#         each payload that counts its guest instructions.
+#
+#  Example of usage, with the payloads built by "make check-tcg":
+#  tcg_bench.py -p build/tests/plugin/libinsn.so -- \
+#      build/qemu-system-arm build/tests/tcg/arm-softmmu/bench-*
+#
+#  Output, one line per payload:
+#  {"bench": "bench-int", "insns": 320000011, "seconds": 0.412,
+#   "mips": 776.7, "qemu": "build/qemu-system-arm"}
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+
+def qemu_command(qemu, payload):
+    return [qemu, "-M", "virt", "-cpu", "cortex-a15", "-display", "none",
+            "-monitor", "none", "-serial", "none", "-semihosting",
+            "-kernel", payload]
+
+
+def count_insns(qemu, plugin, payload):
+    """
+    Run payload once under the insn plugin and return the number of
+    guest instructions it executed.
+    """
+    proc = subprocess.run(qemu_command(qemu, payload) +
+                          ["-plugin", plugin, "-d", "plugin"],
+                          stdin=subprocess.DEVNULL,
+                          stdout=subprocess.DEVNULL,
+                          stderr=subprocess.PIPE,
+                          check=False)
+    match = re.search(rb"insns: (\d+)", proc.stderr)
+    if proc.returncode != 0 or match is None:
+        sys.exit("{} failed under the insn plugin".format(payload))
+    return int(match.group(1))
+
+
+def time_run(qemu, payload):
+    start = time.monotonic()
+    proc = subprocess.run(qemu_command(qemu, payload),
+                          stdin=subprocess.DEVNULL,
+                          stdout=subprocess.DEVNULL,
+                          stderr=subprocess.DEVNULL,
+                          check=False)
+    elapsed = time.monotonic() - start
+    if proc.returncode != 0:
+        sys.exit("{} exited with status {}".format(payload, proc.returncode))
+    return elapsed
+
+
+parser = argparse.ArgumentParser(
+    usage='tcg_bench.py [-h] [-n <runs>] -p <libinsn.so> -- '
+          '<qemu-system-arm> <payload> [<payload> ...]')
+
+parser.add_argument('-n', dest='runs', type=int, default=5,
+                    help='Number of timed runs per payload.')
+parser.add_argument('-p', dest='plugin', type=str, required=True,
+                    help='Path to the insn plugin of tests/plugin.')
+parser.add_argument('qemu', type=str, help=argparse.SUPPRESS)
+parser.add_argument('payloads', type=str, nargs='+', help=argparse.SUPPRESS)
+
+args = parser.parse_args()
+
+for payload in args.payloads:
+    insns = count_insns(args.qemu, args.plugin, payload)
+    best = min(time_run(args.qemu, payload) for _ in range(args.runs))
+    print(json.dumps({"bench": os.path.basename(payload),
+                      "insns": insns,
+                      "seconds": round(best, 3),
+                      "mips": round(insns / best / 1e6, 1),
+                      "qemu": args.qemu}))
+    sys.stdout.flush()
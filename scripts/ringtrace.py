@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# Pretty-printer for ring trace backend binary trace files
+#
+# The file holds chunks of records from one thread each; they are merged
+# back into a single stream ordered by timestamp.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# For help see docs/devel/tracing.rst
+
+import heapq
+import struct
+import sys
+from tracetool import read_events
+from tracetool.backend.simple import is_string
+
+header_magic = 0x51454d5552494e47
+header_version = 1
+
+chunk_mapping = 0
+chunk_events = 1
+chunk_dropped = 2
+
+header_fmt = '=QQ'
+chunk_fmt = '=IIII'
+record_fmt = '=IIQ'
+
+def read_struct(fobj, fmt):
+    size = struct.calcsize(fmt)
+    data = fobj.read(size)
+    if len(data) != size:
+        return None
+    return struct.unpack(fmt, data)
+
+def decode_record(edict, idtoname, tid, data):
+    """Decode one record into a tuple (timestamp, tid, name, args)."""
+    event_id, length, timestamp = struct.unpack_from(record_fmt, data)
+    name = idtoname[event_id]
+    try:
+        event = edict[name]
+    except KeyError as e:
+        sys.stderr.write('%s event is logged but is not declared ' \
+                         'in the trace events file, try using ' \
+                         'trace-events-all instead.\n' % str(e))
+        sys.exit(1)
+
+    off = struct.calcsize(record_fmt)
+    args = []
+    for type_, name in event.args:
+        if is_string(type_):
+            (slen,) = struct.unpack_from('=L', data, off)
+            args.append(data[off + 4:off + 4 + slen].decode(errors='replace'))
+            off += 4 + slen
+        else:
+            (value,) = struct.unpack_from('=Q', data, off)
+            args.append(value)
+            off += 8
+    return (timestamp, tid, event, args)
+
+def read_threads(edict, fobj):
+    """Split the file into a list of records per thread, each in the order
+       the thread emitted them."""
+    header = read_struct(fobj, header_fmt)
+    if header is None or header[0] != header_magic:
+        raise ValueError('Not a valid ring trace file!')
+    if header[1] != header_version:
+        raise ValueError('Ring trace format %d not supported!' % header[1])
+
+    idtoname = {}
+    threads = {}
+    while True:
+        chunk = read_struct(fobj, chunk_fmt)
+        if chunk is None:
+            break
+        type_, length, tid, _ = chunk
+        payload = fobj.read(length)
+        if type_ == chunk_mapping:
+            (event_id, nlen) = struct.unpack_from('=QL', payload)
+            idtoname[event_id] = payload[12:12 + nlen].decode()
+            continue
+
+        records = threads.setdefault(tid, [])
+        if type_ == chunk_dropped:
+            (count,) = struct.unpack_from('=Q', payload)
+            # keep the place of the loss in the thread's stream
+            ts = records[-1][0] if records else 0
+            records.append((ts, tid, None, [count]))
+        elif type_ == chunk_events:
+            off = 0
+            while off < length:
+                (_, rlen, _) = struct.unpack_from(record_fmt, payload, off)
+                records.append(decode_record(edict, idtoname, tid,
+                                             payload[off:off + rlen]))
+                off += rlen
+    return threads.values()
+
+def main():
+    if len(sys.argv) != 3:
+        sys.stderr.write('usage: %s <trace-events> <trace-file>\n' %
+                         sys.argv[0])
+        sys.exit(1)
+
+    events = read_events(open(sys.argv[1], 'r'), sys.argv[1])
+    edict = dict((event.name, event) for event in events)
+    with open(sys.argv[2], 'rb') as fobj:
+        threads = read_threads(edict, fobj)
+
+    last_timestamp = None
+    for timestamp, tid, event, args in heapq.merge(*threads,
+                                                   key=lambda r: r[0]):
+        if last_timestamp is None:
+            last_timestamp = timestamp
+        delta_ns = timestamp - last_timestamp
+        last_timestamp = timestamp
+
+        if event is None:
+            print('dropped %0.3f tid=%d num_events_dropped=%d' %
+                  (delta_ns / 1000.0, tid, args[0]))
+            continue
+        fields = [event.name, '%0.3f' % (delta_ns / 1000.0), 'tid=%d' % tid]
+        for (type_, name), value in zip(event.args, args):
+            if is_string(type_):
+                fields.append('%s=%s' % (name, value))
+            else:
+                fields.append('%s=0x%x' % (name, value))
+        print(' '.join(fields))
+
+if __name__ == '__main__':
+    main()
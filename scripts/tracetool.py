@@ -48,6 +48,7 @@ def error_opt(msg = None):
     --target-type <type>     QEMU emulator target type ('system' or 'user').
     --target-name <name>     QEMU emulator target name.
     --group <name>           Name of the event group
+    --static-keys            Patch the group's trace points in at runtime.
     --probe-prefix <prefix>  Prefix for dtrace probe names
                              (default: qemu-<target-type>-<target-name>).\
 """ % {
@@ -66,7 +67,7 @@ def main(args):
     _SCRIPT = args[0]
 
     long_opts = ["backends=", "format=", "help", "list-backends",
-                 "check-backends", "group="]
+                 "check-backends", "group=", "static-keys"]
     long_opts += ["binary=", "target-type=", "target-name=", "probe-prefix="]
 
     try:
@@ -78,6 +79,7 @@ def main(args):
     arg_backends = []
     arg_format = ""
     arg_group = None
+    static_keys = False
     binary = None
     target_type = None
     target_name = None
@@ -90,6 +92,8 @@ def main(args):
             arg_backends = arg.split(",")
         elif opt == "--group":
             arg_group = arg
+        elif opt == "--static-keys":
+            static_keys = True
         elif opt == "--format":
             arg_format = arg
 
@@ -146,7 +150,8 @@ def main(args):
 
     try:
         tracetool.generate(events, arg_group, arg_format, arg_backends,
-                           binary=binary, probe_prefix=probe_prefix)
+                           binary=binary, probe_prefix=probe_prefix,
+                           static_keys=static_keys)
     except tracetool.TracetoolError as e:
         error_opt(str(e))
 
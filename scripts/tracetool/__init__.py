@@ -62,6 +62,10 @@ def out(*lines, **kwargs):
 
     out_fobj.writelines("\n".join(output) + "\n")
 
+# Whether the trace points of the group are compiled to a patchable nop,
+# see trace/static-key.h
+STATIC_KEYS = False
+
 # We only want to allow standard C types or fixed sized
 # integer types. We don't want QEMU specific types
 # as we can't assume trace backends can resolve all the
@@ -472,7 +476,7 @@ def try_import(mod_name, attr_name=None, attr_default=None):
 
 
 def generate(events, group, format, backends,
-             binary=None, probe_prefix=None):
+             binary=None, probe_prefix=None, static_keys=False):
     """Generate the output for the given (format, backends) pair.
 
     Parameters
@@ -489,6 +493,8 @@ def generate(events, group, format, backends,
         See tracetool.backend.dtrace.BINARY.
     probe_prefix : str or None
         See tracetool.backend.dtrace.PROBEPREFIX.
+    static_keys : bool
+        See tracetool.STATIC_KEYS.
     """
     # fix strange python error (UnboundLocalError tracetool)
     import tracetool
@@ -509,5 +515,6 @@ def generate(events, group, format, backends,
     import tracetool.backend.dtrace
     tracetool.backend.dtrace.BINARY = binary
     tracetool.backend.dtrace.PROBEPREFIX = probe_prefix
+    tracetool.STATIC_KEYS = static_keys
 
     tracetool.format.generate(events, format, backend, group)
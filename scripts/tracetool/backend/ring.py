@@ -0,0 +1,97 @@
+# -*- coding: utf-8 -*-
+
+"""
+Per-thread ring built-in backend.
+"""
+
+__copyright__  = "Copyright 2021, The QEMU Project Developers"
+__license__    = "GPL version 2 or (at your option) any later version"
+
+__maintainer__ = "Stefan Hajnoczi"
+__email__      = "stefanha@redhat.com"
+
+
+from tracetool import out
+from tracetool.backend.simple import is_string
+
+
+PUBLIC = True
+
+
+def generate_h_begin(events, group):
+    for event in events:
+        out('void _ring_%(api)s(%(args)s);',
+            api=event.api(),
+            args=event.args)
+    out('')
+
+
+def generate_h(event, group):
+    out('    _ring_%(api)s(%(args)s);',
+        api=event.api(),
+        args=", ".join(event.args.names()))
+
+
+def generate_h_backend_dstate(event, group):
+    out('    trace_event_get_state_dynamic_by_id(%(event_id)s) || \\',
+        event_id="TRACE_" + event.name.upper())
+
+
+def generate_c_begin(events, group):
+    out('#include "qemu/osdep.h"',
+        '#include "trace/control.h"',
+        '#include "trace/ring.h"',
+        '')
+
+
+def generate_c(event, group):
+    out('void _ring_%(api)s(%(args)s)',
+        '{',
+        '    TraceRingRecord rec;',
+        api=event.api(),
+        args=event.args)
+    sizes = []
+    for type_, name in event.args:
+        if is_string(type_):
+            out('    size_t arg%(name)s_len = %(name)s ? MIN(strlen(%(name)s), RING_TRACE_STRLEN) : 0;',
+                name=name)
+            sizes.append("4 + arg%s_len" % name)
+        else:
+            sizes.append("8")
+    sizestr = " + ".join(sizes)
+    if len(event.args) == 0:
+        sizestr = '0'
+
+    event_id = 'TRACE_' + event.name.upper()
+    if "vcpu" in event.properties:
+        # already checked on the generic format code
+        cond = "true"
+    else:
+        cond = "trace_event_get_state(%s)" % event_id
+
+    out('',
+        '    if (!%(cond)s) {',
+        '        return;',
+        '    }',
+        '',
+        '    if (!ring_record_start(&rec, %(event_obj)s.id, %(size_str)s)) {',
+        '        return; /* Ring full, event dropped */',
+        '    }',
+        cond=cond,
+        event_obj=event.api(event.QEMU_EVENT),
+        size_str=sizestr)
+
+    for type_, name in event.args:
+        if is_string(type_):
+            out('    ring_record_write_str(&rec, %(name)s, arg%(name)s_len);',
+                name=name)
+        elif type_.endswith('*'):
+            out('    ring_record_write_u64(&rec, (uintptr_t)(uint64_t *)%(name)s);',
+                name=name)
+        else:
+            out('    ring_record_write_u64(&rec, (uint64_t)%(name)s);',
+                name=name)
+
+    out('    ring_record_finish(&rec);',
+        '}',
+        '')
@@ -12,6 +12,7 @@
 __email__      = "stefanha@redhat.com"
 
 
+import tracetool
 from tracetool import out
 
 
@@ -59,10 +60,19 @@ def generate(events, backend, group):
         '};',
         '')
 
+    if tracetool.STATIC_KEYS:
+        # the section holds the keys of all the groups linked in this
+        # object, registering it more than once is harmless
+        out('TRACE_STATIC_KEYS_SECTION_DECLARE();',
+            '')
+
     out('static void trace_%(group)s_register_events(void)',
         '{',
         '    trace_event_register_group(%(group)s_trace_events);',
-        '}',
+        group = group.lower())
+    if tracetool.STATIC_KEYS:
+        out('    TRACE_STATIC_KEYS_SECTION_REGISTER();')
+    out('}',
         'trace_init(trace_%(group)s_register_events)',
         group = group.lower())
 
@@ -12,6 +12,7 @@
 __email__      = "stefanha@redhat.com"
 
 
+import tracetool
 from tracetool import out
 
 
@@ -82,6 +83,9 @@ def generate(events, backend, group):
                    % dict(
                        cpu=trace_cpu,
                        id=e.name.upper())
+        elif tracetool.STATIC_KEYS and "disable" not in e.properties:
+            # the backend still checks the dynamic state behind the branch
+            cond = "trace_event_static_branch(&%s)" % e.api(e.QEMU_EVENT)
         else:
             cond = "true"
 
@@ -540,8 +540,70 @@ static uint32_t host_closefn(CPUState *cs, GuestFD *gf)
     return set_swi_errno(cs, close(gf->hostfd));
 }
 
-static uint32_t host_writefn(CPUState *cs, GuestFD *gf,
-                             target_ulong buf, uint32_t len)
+#ifndef CONFIG_USER_ONLY
+#define SEMIHOST_MAX_IOV    64
+
+typedef struct SemihostIOV {
+    struct iovec iov[SEMIHOST_MAX_IOV];
+    AddressSpace *as[SEMIHOST_MAX_IOV];
+    int niov;
+    size_t len;
+} SemihostIOV;
+
+/*
+ * Map as much as SEMIHOST_MAX_IOV pages allow of the @len bytes of guest
+ * memory at @buf, one entry per page since virtually contiguous pages
+ * need not be physically contiguous.  RAM is mapped in place, so that
+ * the host read or write goes straight to guest memory.  Stops at the
+ * first page that cannot be mapped; v->niov is 0 if that is the first.
+ */
+static void semihost_map(CPUState *cs, SemihostIOV *v, target_ulong buf,
+                         uint32_t len, bool is_write)
+{
+    v->niov = 0;
+    v->len = 0;
+    while (len && v->niov < SEMIHOST_MAX_IOV) {
+        target_ulong page = buf & TARGET_PAGE_MASK;
+        hwaddr l = MIN(TARGET_PAGE_SIZE - (buf - page), len);
+        MemTxAttrs attrs;
+        hwaddr phys = cpu_get_phys_page_attrs_debug(cs, page, &attrs);
+        AddressSpace *as;
+        void *p;
+
+        if (phys == -1) {
+            break;
+        }
+        as = cpu_get_address_space(cs, cpu_asidx_from_attrs(cs, attrs));
+        p = address_space_map(as, phys + (buf - page), &l, is_write, attrs);
+        if (!p) {
+            break;
+        }
+        v->iov[v->niov].iov_base = p;
+        v->iov[v->niov].iov_len = l;
+        v->as[v->niov++] = as;
+        v->len += l;
+        buf += l;
+        len -= l;
+    }
+}
+
+/* Unmap @v, of which the first @done bytes were accessed */
+static void semihost_unmap(SemihostIOV *v, bool is_write, size_t done)
+{
+    int i;
+
+    for (i = 0; i < v->niov; i++) {
+        size_t l = MIN(done, v->iov[i].iov_len);
+
+        address_space_unmap(v->as[i], v->iov[i].iov_base, v->iov[i].iov_len,
+                            is_write, l);
+        done -= l;
+    }
+}
+#endif
+
+static uint32_t host_write_copy(CPUState *cs, GuestFD *gf,
+                                target_ulong buf, uint32_t len)
 {
     CPUArchState *env = cs->env_ptr;
     uint32_t ret;
@@ -560,8 +622,41 @@ static uint32_t host_writefn(CPUState *cs, GuestFD *gf,
     return len - ret;
 }
 
-static uint32_t host_readfn(CPUState *cs, GuestFD *gf,
-                            target_ulong buf, uint32_t len)
+static uint32_t host_writefn(CPUState *cs, GuestFD *gf,
+                             target_ulong buf, uint32_t len)
+{
+    /* The console may have buffered output for the same host file */
+    qemu_semihosting_console_flush();
+#ifndef CONFIG_USER_ONLY
+    while (len) {
+        SemihostIOV v;
+        ssize_t ret;
+
+        semihost_map(cs, &v, buf, len, false);
+        if (!v.niov) {
+            break;
+        }
+        ret = writev(gf->hostfd, v.iov, v.niov);
+        set_swi_errno(cs, ret);
+        semihost_unmap(&v, false, MAX(ret, 0));
+        if (ret < 0) {
+            return len;
+        }
+        buf += ret;
+        len -= ret;
+        if ((size_t)ret < v.len) {
+            return len;
+        }
+    }
+    if (!len) {
+        return 0;
+    }
+#endif
+    return host_write_copy(cs, gf, buf, len);
+}
+
+static uint32_t host_read_copy(CPUState *cs, GuestFD *gf,
+                               target_ulong buf, uint32_t len)
 {
     CPUArchState *env = cs->env_ptr;
     uint32_t ret;
@@ -582,6 +677,40 @@ static uint32_t host_readfn(CPUState *cs, GuestFD *gf,
     return len - ret;
 }
 
+static uint32_t host_readfn(CPUState *cs, GuestFD *gf,
+                            target_ulong buf, uint32_t len)
+{
+#ifndef CONFIG_USER_ONLY
+    while (len) {
+        SemihostIOV v;
+        ssize_t ret;
+
+        semihost_map(cs, &v, buf, len, true);
+        if (!v.niov) {
+            break;
+        }
+        do {
+            ret = readv(gf->hostfd, v.iov, v.niov);
+        } while (ret == -1 && errno == EINTR);
+        set_swi_errno(cs, ret);
+        semihost_unmap(&v, true, MAX(ret, 0));
+        if (ret < 0) {
+            return len;
+        }
+        buf += ret;
+        len -= ret;
+        /* Stop at end of file, or when a pipe or tty has no more yet */
+        if ((size_t)ret < v.len) {
+            return len;
+        }
+    }
+    if (!len) {
+        return 0;
+    }
+#endif
+    return host_read_copy(cs, gf, buf, len);
+}
+
 static uint32_t host_isattyfn(CPUState *cs, GuestFD *gf)
 {
     return isatty(gf->hostfd);
@@ -1253,6 +1382,7 @@ target_ulong do_common_semihosting(CPUState *cs)
              */
             ret = (args == ADP_Stopped_ApplicationExit) ? 0 : 1;
         }
+        qemu_semihosting_console_flush();
         gdb_exit(ret);
         exit(ret);
     case TARGET_SYS_ELAPSED:
@@ -26,8 +26,27 @@
 #include "qemu/main-loop.h"
 #include "qapi/error.h"
 #include "qemu/fifo8.h"
+#include "qemu/timer.h"
+#include "sysemu/runstate.h"
 
-int qemu_semihosting_log_out(const char *s, int len)
+#define OUTBUF_SIZE         1024
+/* How long a partial line may wait in the output buffer */
+#define OUTBUF_FLUSH_MS     20
+
+/*
+ * Output of SYS_WRITEC, kept until a newline, a full buffer or any
+ * other console access so that guests printing one character per
+ * call do not cost a host write each.  Protected by the BQL.
+ */
+typedef struct SemihostingOutBuf {
+    char                buf[OUTBUF_SIZE];
+    int                 len;
+    QEMUTimer           *timer;
+} SemihostingOutBuf;
+
+static SemihostingOutBuf outbuf;
+
+static int semihosting_write(const char *s, int len)
 {
     Chardev *chardev = semihosting_get_chardev();
     if (chardev) {
@@ -37,29 +56,90 @@ int qemu_semihosting_log_out(const char *s, int len)
     }
 }
 
+void qemu_semihosting_console_flush(void)
+{
+    if (outbuf.len) {
+        semihosting_write(outbuf.buf, outbuf.len);
+        outbuf.len = 0;
+    }
+    if (outbuf.timer) {
+        timer_del(outbuf.timer);
+    }
+}
+
+static void outbuf_timer_cb(void *opaque)
+{
+    qemu_semihosting_console_flush();
+}
+
+/*
+ * vCPUs can only add output while the VM runs.  Flushing when it stops
+ * also covers shutdown, which stops the VM before the chardevs go away.
+ */
+static void outbuf_vm_change_state(void *opaque, bool running,
+                                   RunState state)
+{
+    if (!running) {
+        qemu_semihosting_console_flush();
+    }
+}
+
+static void outbuf_putc(uint8_t c)
+{
+    if (!outbuf.timer) {
+        outbuf.timer = timer_new_ms(QEMU_CLOCK_REALTIME, outbuf_timer_cb,
+                                    NULL);
+        qemu_add_vm_change_state_handler(outbuf_vm_change_state, NULL);
+    }
+
+    outbuf.buf[outbuf.len++] = c;
+    if (c == '\n' || outbuf.len == OUTBUF_SIZE) {
+        qemu_semihosting_console_flush();
+    } else if (!timer_pending(outbuf.timer)) {
+        timer_mod(outbuf.timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  OUTBUF_FLUSH_MS);
+    }
+}
+
+int qemu_semihosting_log_out(const char *s, int len)
+{
+    qemu_semihosting_console_flush();
+    return semihosting_write(s, len);
+}
+
 /*
  * A re-implementation of lock_user_string that we can use locally
  * instead of relying on softmmu-semi. Hopefully we can deprecate that
  * in time. Copy string until we find a 0 or address error.
+ *
+ * The string is read in chunks that stop at page boundaries, so that
+ * a string ending just before an unmapped page is still accepted.
  */
 static GString *copy_user_string(CPUArchState *env, target_ulong addr)
 {
     CPUState *cpu = env_cpu(env);
     GString *s = g_string_sized_new(128);
-    uint8_t c;
+    uint8_t chunk[256];
 
-    do {
-        if (cpu_memory_rw_debug(cpu, addr++, &c, 1, 0) == 0) {
-            if (c) {
-                s = g_string_append_c(s, c);
-            }
-        } else {
+    for (;;) {
+        size_t len = MIN(sizeof(chunk),
+                         TARGET_PAGE_SIZE - (addr & ~TARGET_PAGE_MASK));
+        uint8_t *end;
+
+        if (cpu_memory_rw_debug(cpu, addr, chunk, len, 0) != 0) {
             qemu_log_mask(LOG_GUEST_ERROR,
                           "%s: passed inaccessible address " TARGET_FMT_lx,
                           __func__, addr);
             break;
         }
-    } while (c!=0);
+        end = memchr(chunk, 0, len);
+        if (end) {
+            g_string_append_len(s, (const char *) chunk, end - chunk);
+            break;
+        }
+        g_string_append_len(s, (const char *) chunk, len);
+        addr += len;
+    }
 
     return s;
 }
@@ -77,10 +157,11 @@ int qemu_semihosting_console_outs(CPUArchState *env, target_ulong addr)
     GString *s = copy_user_string(env, addr);
     int out = s->len;
 
+    qemu_semihosting_console_flush();
     if (use_gdb_syscalls()) {
         gdb_do_syscall(semihosting_cb, "write,2,%x,%x", addr, s->len);
     } else {
-        out = qemu_semihosting_log_out(s->str, s->len);
+        out = semihosting_write(s->str, s->len);
     }
 
     g_string_free(s, true);
@@ -94,9 +175,10 @@ void qemu_semihosting_console_outc(CPUArchState *env, target_ulong addr)
 
     if (cpu_memory_rw_debug(cpu, addr, &c, 1, 0) == 0) {
         if (use_gdb_syscalls()) {
+            qemu_semihosting_console_flush();
             gdb_do_syscall(semihosting_cb, "write,2,%x,%x", addr, 1);
         } else {
-            qemu_semihosting_log_out((const char *) &c, 1);
+            outbuf_putc(c);
         }
     } else {
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -151,6 +233,8 @@ target_ulong qemu_semihosting_console_inc(CPUArchState *env)
     SemihostingConsole *c = &console;
     g_assert(qemu_mutex_iothread_locked());
     g_assert(current_cpu);
+    /* A prompt must be visible before we wait for the answer */
+    qemu_semihosting_console_flush();
     if (fifo8_is_empty(&c->fifo)) {
         c->sleeping_cpus = g_slist_prepend(c->sleeping_cpus, current_cpu);
         current_cpu->halted = 1;
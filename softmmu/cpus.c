@@ -33,8 +33,13 @@
 #include "exec/gdbstub.h"
 #include "sysemu/hw_accel.h"
 #include "exec/exec-all.h"
+#include "exec/address-spaces.h"
 #include "qemu/thread.h"
+#include "qemu/units.h"
 #include "qemu/plugin.h"
+#include "qemu/coroutine.h"
+#include "qemu/main-loop.h"
+#include "qemu/sockets.h"
 #include "sysemu/cpus.h"
 #include "qemu/guest-random.h"
 #include "hw/nmi.h"
@@ -773,34 +778,157 @@ exit:
     fclose(f);
 }
 
+/* Largest piece of guest memory mapped and transferred in one go */
+#define PMEM_CHUNK_SIZE (64 * MiB)
+
+typedef struct PMemWait {
+    Coroutine *co;
+    int fd;
+} PMemWait;
+
+static void pmem_fd_ready(void *opaque)
+{
+    PMemWait *w = opaque;
+
+    aio_set_fd_handler(qemu_get_aio_context(), w->fd, false,
+                       NULL, NULL, NULL, NULL);
+    aio_co_wake(w->co);
+}
+
+/*
+ * Sleep until @fd can take more data (or has more data if @readable),
+ * letting the main loop run meanwhile.
+ */
+static void coroutine_fn pmem_wait_fd(int fd, bool readable)
+{
+    PMemWait w = { .co = qemu_coroutine_self(), .fd = fd };
+
+    aio_set_fd_handler(qemu_get_aio_context(), fd, false,
+                       readable ? pmem_fd_ready : NULL,
+                       readable ? NULL : pmem_fd_ready, NULL, &w);
+    qemu_coroutine_yield();
+}
+
+/*
+ * Copy @size bytes of guest physical memory at @addr to @fd, or from @fd
+ * if @to_guest.  RAM is mapped and goes straight between the guest and
+ * the fd; anything else, or RAM that cannot be mapped right now, takes
+ * the slow path through a bounce buffer.
+ *
+ * When called from a coroutine, @fd is put in non-blocking mode and the
+ * coroutine yields whenever the fd is not ready, so that a slow reader
+ * or writer on the other end does not stall the main loop.  Nothing stays
+ * mapped while the coroutine sleeps.
+ */
+static void pmem_transfer(int fd, hwaddr addr, uint64_t size, bool to_guest,
+                          Error **errp)
+{
+    bool in_co = qemu_in_coroutine();
+    uint8_t buf[4096];
+
+    if (in_co) {
+        qemu_set_nonblock(fd);
+    }
+
+    while (size) {
+        hwaddr len = MIN(size, PMEM_CHUNK_SIZE);
+        void *p = address_space_map(&address_space_memory, addr, &len,
+                                    to_guest, MEMTXATTRS_UNSPECIFIED);
+        ssize_t ret;
+
+        if (!p) {
+            len = MIN(size, sizeof(buf));
+            if (!to_guest) {
+                address_space_read(&address_space_memory, addr,
+                                   MEMTXATTRS_UNSPECIFIED, buf, len);
+            }
+        }
+
+        do {
+            if (to_guest) {
+                ret = read(fd, p ? p : buf, len);
+            } else {
+                ret = write(fd, p ? p : buf, len);
+            }
+        } while (ret < 0 && errno == EINTR);
+
+        if (p) {
+            address_space_unmap(&address_space_memory, p, len, to_guest,
+                                ret > 0 ? ret : 0);
+        } else if (to_guest && ret > 0) {
+            address_space_write(&address_space_memory, addr,
+                                MEMTXATTRS_UNSPECIFIED, buf, ret);
+        }
+
+        if (ret < 0 && in_co && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pmem_wait_fd(fd, to_guest);
+            continue;
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, errno, "Cannot transfer guest memory");
+            return;
+        }
+        if (ret == 0) {
+            if (to_guest) {
+                error_setg(errp, "Unexpected end of file, %" PRIu64
+                           " bytes were not written", size);
+            } else {
+                error_setg(errp, "Cannot transfer guest memory");
+            }
+            return;
+        }
+        addr += ret;
+        size -= ret;
+    }
+}
+
 void qmp_pmemsave(int64_t addr, int64_t size, const char *filename,
                   Error **errp)
 {
-    FILE *f;
-    uint32_t l;
-    uint8_t buf[1024];
+    int fd;
 
-    f = fopen(filename, "wb");
-    if (!f) {
-        error_setg_file_open(errp, errno, filename);
+    fd = qemu_create(filename, O_WRONLY | O_TRUNC | O_BINARY, 0666, errp);
+    if (fd < 0) {
         return;
     }
+    pmem_transfer(fd, addr, size, false, errp);
+    qemu_close(fd);
+}
 
-    while (size != 0) {
-        l = sizeof(buf);
-        if (l > size)
-            l = size;
-        cpu_physical_memory_read(addr, buf, l);
-        if (fwrite(buf, 1, l, f) != l) {
-            error_setg(errp, QERR_IO_ERROR);
-            goto exit;
-        }
-        addr += l;
-        size -= l;
+void coroutine_fn qmp_pmem_read(int64_t addr, int64_t size,
+                                const char *fdname, Error **errp)
+{
+    int fd;
+
+    if (size < 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "size",
+                   "a non-negative size");
+        return;
     }
+    fd = monitor_get_fd(monitor_cur(), fdname, errp);
+    if (fd < 0) {
+        return;
+    }
+    pmem_transfer(fd, addr, size, false, errp);
+    close(fd);
+}
 
-exit:
-    fclose(f);
+void coroutine_fn qmp_pmem_write(int64_t addr, int64_t size,
+                                 const char *fdname, Error **errp)
+{
+    int fd;
+
+    if (size < 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "size",
+                   "a non-negative size");
+        return;
+    }
+    fd = monitor_get_fd(monitor_cur(), fdname, errp);
+    if (fd < 0) {
+        return;
+    }
+    pmem_transfer(fd, addr, size, true, errp);
+    close(fd);
 }
 
 void qmp_inject_nmi(Error **errp)
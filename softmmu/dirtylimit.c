@@ -0,0 +1,341 @@
+/*
+ * Per-vCPU dirty page rate limit
+ *
+ * The migration auto-converge throttle slows down every vCPU by the
+ * same amount.  This instead measures the dirty page rate of each vCPU
+ * from the pages its KVM dirty ring collects, and only makes the vCPUs
+ * that have a limit sleep when their ring fills up.  Once per period
+ * the sleep of each limited vCPU is recomputed from the rate it just
+ * produced, so a vCPU dirtying less than its limit is never slowed
+ * down.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "hw/boards.h"
+#include "hw/core/cpu.h"
+#include "monitor/hmp.h"
+#include "monitor/monitor.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
+#include "trace.h"
+
+/* Longest sleep without looking whether the vCPU must stop */
+#define DIRTYLIMIT_SLEEP_SLICE_US   10000
+
+typedef struct VcpuDirtyLimit {
+    /* Limit in MB/s, 0 if the vCPU is not limited */
+    uint64_t quota;
+    /* Dirty page rate of the last period, in MB/s */
+    uint64_t rate;
+    /* cpu->dirty_pages at the start of the period */
+    uint64_t start_pages;
+    /* Sleep each time the dirty ring is full; read by the vCPU thread */
+    int64_t throttle_us;
+} VcpuDirtyLimit;
+
+/*
+ * Everything but throttle_us is protected by the BQL.  The
+ * measurement thread stops as soon as the generation it was started
+ * with changes.
+ */
+static struct {
+    VcpuDirtyLimit *vcpu;
+    int max_cpus;
+    int nr_limited;
+    unsigned int generation;
+} dirtylimit_state;
+
+bool dirtylimit_in_service(void)
+{
+    return dirtylimit_state.nr_limited > 0;
+}
+
+/* Time for the dirty ring of a vCPU to fill up at @rate MB/s */
+static int64_t dirtylimit_ring_full_us(uint64_t rate)
+{
+    uint64_t ring_bytes = (uint64_t)kvm_dirty_ring_size() *
+                          qemu_target_page_size();
+
+    return ring_bytes * G_USEC_PER_SEC / (MAX(rate, 1) << 20);
+}
+
+/*
+ * With the vCPU sleeping s after each ring full and dirtying at r, a
+ * ring takes F(r) = t + s to fill, where t is the time the vCPU needs
+ * to dirty a ring on its own.  Reaching the quota q takes a sleep of
+ * F(q) - t, i.e. s + F(q) - F(r), which is never more than F(q).
+ */
+static void dirtylimit_adjust_throttle(CPUState *cpu, VcpuDirtyLimit *limit)
+{
+    int64_t quota_us = dirtylimit_ring_full_us(limit->quota);
+    int64_t throttle_us = qatomic_read(&limit->throttle_us);
+
+    if (!limit->rate) {
+        /* Nothing was dirtied, the current sleep can't be judged */
+        return;
+    }
+
+    throttle_us += quota_us - dirtylimit_ring_full_us(limit->rate);
+    throttle_us = MIN(MAX(throttle_us, 0), quota_us);
+
+    trace_dirtylimit_adjust_throttle(cpu->cpu_index, limit->quota,
+                                     limit->rate, throttle_us);
+    qatomic_set(&limit->throttle_us, throttle_us);
+}
+
+/* Start a new period; called with the dirty rings just reaped */
+static void dirtylimit_record_start(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        dirtylimit_state.vcpu[cpu->cpu_index].start_pages = cpu->dirty_pages;
+    }
+}
+
+static void dirtylimit_update(int64_t period_ms)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimit *limit = &dirtylimit_state.vcpu[cpu->cpu_index];
+        uint64_t pages = cpu->dirty_pages - limit->start_pages;
+
+        limit->rate = ((pages * qemu_target_page_size()) >> 20) * 1000 /
+                      MAX(period_ms, 1);
+        trace_dirtylimit_vcpu_rate(cpu->cpu_index, limit->rate);
+        if (limit->quota) {
+            dirtylimit_adjust_throttle(cpu, limit);
+        }
+    }
+}
+
+static void *dirtylimit_calc_thread(void *opaque)
+{
+    unsigned int generation = (uintptr_t)opaque;
+    int64_t start_ms;
+
+    rcu_register_thread();
+    qemu_mutex_lock_iothread();
+
+    memory_global_dirty_log_sync();
+    dirtylimit_record_start();
+    start_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+
+    while (dirtylimit_state.generation == generation) {
+        int64_t now_ms;
+
+        qemu_mutex_unlock_iothread();
+        g_usleep(DIRTYLIMIT_CALC_PERIOD_MS * 1000);
+        qemu_mutex_lock_iothread();
+        if (dirtylimit_state.generation != generation) {
+            break;
+        }
+
+        /* Collect what is still in the dirty rings */
+        memory_global_dirty_log_sync();
+        if (dirtylimit_state.generation != generation) {
+            break;
+        }
+
+        now_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        dirtylimit_update(now_ms - start_ms);
+        dirtylimit_record_start();
+        start_ms = now_ms;
+    }
+
+    qemu_mutex_unlock_iothread();
+    rcu_unregister_thread();
+    return NULL;
+}
+
+void dirtylimit_vcpu_execute(CPUState *cpu)
+{
+    VcpuDirtyLimit *limit;
+    int64_t end_us;
+    int64_t sleep_us;
+
+    if (!qatomic_read(&dirtylimit_state.vcpu)) {
+        return;
+    }
+
+    limit = &dirtylimit_state.vcpu[cpu->cpu_index];
+    sleep_us = qatomic_read(&limit->throttle_us);
+    end_us = g_get_monotonic_time() + sleep_us;
+    while (sleep_us > 0 && !qatomic_read(&cpu->stop)) {
+        g_usleep(MIN(sleep_us, DIRTYLIMIT_SLEEP_SLICE_US));
+        sleep_us = end_us - g_get_monotonic_time();
+    }
+}
+
+static void dirtylimit_set_quota(VcpuDirtyLimit *limit, uint64_t quota)
+{
+    if (!limit->quota && quota) {
+        dirtylimit_state.nr_limited++;
+        if (dirtylimit_state.nr_limited == 1) {
+            QemuThread thread;
+
+            memory_global_dirty_log_start(GLOBAL_DIRTY_LIMIT);
+            dirtylimit_state.generation++;
+            qemu_thread_create(&thread, "dirtylimit", dirtylimit_calc_thread,
+                               (void *)(uintptr_t)dirtylimit_state.generation,
+                               QEMU_THREAD_DETACHED);
+        }
+    } else if (limit->quota && !quota) {
+        qatomic_set(&limit->throttle_us, 0);
+        dirtylimit_state.nr_limited--;
+        if (!dirtylimit_state.nr_limited) {
+            dirtylimit_state.generation++;
+            memory_global_dirty_log_stop(GLOBAL_DIRTY_LIMIT);
+        }
+    }
+    limit->quota = quota;
+}
+
+static bool dirtylimit_check(bool has_cpu_index, int64_t cpu_index,
+                             Error **errp)
+{
+    if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+        error_setg(errp, "dirty page rate limits need the KVM dirty ring "
+                   "(-accel kvm,dirty-ring-size=N)");
+        return false;
+    }
+
+    if (has_cpu_index && !qemu_get_cpu(cpu_index)) {
+        error_setg(errp, "no vCPU with index %" PRIi64, cpu_index);
+        return false;
+    }
+
+    if (!dirtylimit_state.vcpu) {
+        MachineState *ms = MACHINE(qdev_get_machine());
+
+        dirtylimit_state.max_cpus = ms->smp.max_cpus;
+        qatomic_set(&dirtylimit_state.vcpu,
+                    g_new0(VcpuDirtyLimit, dirtylimit_state.max_cpus));
+    }
+
+    return true;
+}
+
+void qmp_set_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                              uint64_t dirty_rate, Error **errp)
+{
+    CPUState *cpu;
+
+    if (!dirty_rate) {
+        error_setg(errp, "dirty-rate must be greater than zero, use "
+                   "cancel-vcpu-dirty-limit to remove a limit");
+        return;
+    }
+
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        if (!has_cpu_index || cpu->cpu_index == cpu_index) {
+            dirtylimit_set_quota(&dirtylimit_state.vcpu[cpu->cpu_index],
+                                 dirty_rate);
+        }
+    }
+}
+
+void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                                 Error **errp)
+{
+    CPUState *cpu;
+
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        if (!has_cpu_index || cpu->cpu_index == cpu_index) {
+            dirtylimit_set_quota(&dirtylimit_state.vcpu[cpu->cpu_index], 0);
+        }
+    }
+}
+
+DirtyLimitInfoList *qmp_query_vcpu_dirty_limit(Error **errp)
+{
+    DirtyLimitInfoList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    if (!dirtylimit_in_service()) {
+        return NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimit *limit = &dirtylimit_state.vcpu[cpu->cpu_index];
+        DirtyLimitInfo *info = g_new0(DirtyLimitInfo, 1);
+
+        info->cpu_index = cpu->cpu_index;
+        info->limit_rate = limit->quota;
+        info->current_rate = limit->rate;
+        info->throttle_us = qatomic_read(&limit->throttle_us);
+        QAPI_LIST_APPEND(tail, info);
+    }
+
+    return head;
+}
+
+void hmp_info_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    DirtyLimitInfoList *list, *info;
+
+    list = qmp_query_vcpu_dirty_limit(NULL);
+    if (!list) {
+        monitor_printf(mon, "No vCPU dirty page rate limit\n");
+        return;
+    }
+
+    for (info = list; info; info = info->next) {
+        monitor_printf(mon, "vcpu[%" PRIi64 "], limit rate: ",
+                       info->value->cpu_index);
+        if (info->value->limit_rate) {
+            monitor_printf(mon, "%" PRIu64 " (MB/s)", info->value->limit_rate);
+        } else {
+            monitor_printf(mon, "none");
+        }
+        monitor_printf(mon, ", current rate: %" PRIu64 " (MB/s), "
+                       "throttle: %" PRIi64 " us per ring full\n",
+                       info->value->current_rate, info->value->throttle_us);
+    }
+
+    qapi_free_DirtyLimitInfoList(list);
+}
+
+void hmp_set_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    int64_t dirty_rate = qdict_get_int(qdict, "dirty_rate");
+    int64_t cpu_index = qdict_get_try_int(qdict, "cpu_index", -1);
+    Error *err = NULL;
+
+    if (dirty_rate <= 0) {
+        monitor_printf(mon, "Incorrect dirty rate specified!\n");
+        return;
+    }
+
+    qmp_set_vcpu_dirty_limit(cpu_index != -1, cpu_index, dirty_rate, &err);
+    hmp_handle_error(mon, err);
+}
+
+void hmp_cancel_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
+{
+    int64_t cpu_index = qdict_get_try_int(qdict, "cpu_index", -1);
+    Error *err = NULL;
+
+    qmp_cancel_vcpu_dirty_limit(cpu_index != -1, cpu_index, &err);
+    hmp_handle_error(mon, err);
+}
@@ -58,6 +58,9 @@ static bool icount_sleep = true;
  */
 int use_icount;
 
+/* The vCPUs run in lockstep quanta, see tcg-accel-ops-lockstep.c */
+bool icount_lockstep;
+
 static void icount_enable_precise(void)
 {
     use_icount = 1;
@@ -89,6 +92,11 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (icount_lockstep) {
+        /* Global time only moves at the end of a quantum */
+        cpu->lockstep_done += executed;
+        return;
+    }
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
 }
@@ -107,6 +115,20 @@ void icount_update(CPUState *cpu)
                          &timers_state.vm_clock_lock);
 }
 
+/*
+ * End of a lockstep quantum: every vCPU is waiting at the barrier, and
+ * global time moves by @insns at once.
+ */
+void icount_lockstep_advance(int64_t insns)
+{
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    qatomic_set_i64(&timers_state.qemu_icount,
+                    timers_state.qemu_icount + insns);
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+}
+
 static int64_t icount_get_raw_locked(void)
 {
     CPUState *cpu = current_cpu;
@@ -118,6 +140,10 @@ static int64_t icount_get_raw_locked(void)
         }
         /* Take into account what has run */
         icount_update_locked(cpu);
+        if (icount_lockstep) {
+            return qatomic_read_i64(&timers_state.qemu_icount) +
+                cpu->lockstep_done;
+        }
     }
     /* The read is protected by the seqlock, but needs atomic64 to avoid UB */
     return qatomic_read_i64(&timers_state.qemu_icount);
@@ -298,8 +324,9 @@ void icount_start_warp_timer(void)
     /*
      * Nothing to do if the VM is stopped: QEMU_CLOCK_VIRTUAL timers
      * do not fire, so computing the deadline does not make sense.
+     * In lockstep, the barrier skips idle time itself.
      */
-    if (!runstate_is_running()) {
+    if (!runstate_is_running() || icount_lockstep) {
         return;
     }
 
@@ -393,7 +420,7 @@ void icount_start_warp_timer(void)
 
 void icount_account_warp_timer(void)
 {
-    if (!icount_sleep) {
+    if (!icount_sleep || icount_lockstep) {
         return;
     }
 
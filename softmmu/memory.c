@@ -22,6 +22,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/qemu-print.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 #include "trace.h"
 
@@ -38,6 +39,8 @@
 
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
+/* Only the romd_mode of some regions changed, see flatviews_update_romd() */
+static bool memory_region_romd_update_pending;
 static bool ioeventfd_update_pending;
 unsigned int global_dirty_tracking;
 
@@ -1023,6 +1026,81 @@ static void flatviews_reset(void)
     }
 }
 
+/*
+ * Return a copy of @old with romd_mode refreshed from its regions, or
+ * NULL if @old is still current.  Toggling romd_mode moves no range
+ * boundary: ranges only merge within one region, and they all share
+ * that region's romd_mode.  The dispatch tree does not depend on it
+ * either, so it is copied instead of being rebuilt.
+ */
+static FlatView *flatview_copy_romd(FlatView *old)
+{
+    FlatView *view;
+    unsigned i;
+
+    for (i = 0; i < old->nr; i++) {
+        if (old->ranges[i].romd_mode != old->ranges[i].mr->romd_mode) {
+            break;
+        }
+    }
+    if (i == old->nr) {
+        return NULL;
+    }
+
+    view = flatview_new(old->root);
+    view->nr = view->nr_allocated = old->nr;
+    view->ranges = g_memdup(old->ranges, old->nr * sizeof(FlatRange));
+    for (i = 0; i < view->nr; i++) {
+        memory_region_ref(view->ranges[i].mr);
+        view->ranges[i].romd_mode = view->ranges[i].mr->romd_mode;
+    }
+    view->dispatch = address_space_dispatch_copy(old->dispatch, view);
+    trace_flatview_copy_romd(view, old);
+
+    return view;
+}
+
+/*
+ * Like flatviews_reset(), when the only changes since the last commit
+ * are to the romd_mode of some regions.  Views that contain none of
+ * them are kept as they are, so their address spaces see no update.
+ */
+static void flatviews_update_romd(void)
+{
+    GHashTable *old_views = flat_views;
+    AddressSpace *as;
+
+    if (!old_views) {
+        flatviews_reset();
+        return;
+    }
+    flat_views = NULL;
+    flatviews_init();
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *old_view, *new_view;
+
+        if (g_hash_table_lookup(flat_views, physmr)) {
+            continue;
+        }
+
+        old_view = g_hash_table_lookup(old_views, physmr);
+        if (!old_view) {
+            generate_memory_topology(physmr);
+            continue;
+        }
+        new_view = flatview_copy_romd(old_view);
+        if (!new_view) {
+            new_view = old_view;
+            flatview_ref(new_view);
+        }
+        g_hash_table_replace(flat_views, physmr, new_view);
+    }
+
+    g_hash_table_unref(old_views);
+}
+
 static void address_space_set_flatview(AddressSpace *as)
 {
     FlatView *old_view = address_space_to_flatview(as);
@@ -1094,8 +1172,13 @@ void memory_region_transaction_commit(void)
 
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth) {
-        if (memory_region_update_pending) {
-            flatviews_reset();
+        if (memory_region_update_pending ||
+            memory_region_romd_update_pending) {
+            if (memory_region_update_pending) {
+                flatviews_reset();
+            } else {
+                flatviews_update_romd();
+            }
 
             MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
@@ -1104,6 +1187,7 @@ void memory_region_transaction_commit(void)
                 address_space_update_ioeventfds(as);
             }
             memory_region_update_pending = false;
+            memory_region_romd_update_pending = false;
             ioeventfd_update_pending = false;
             MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
         } else if (ioeventfd_update_pending) {
@@ -1412,6 +1496,44 @@ bool memory_region_access_valid(MemoryRegion *mr,
     return true;
 }
 
+bool memory_region_stats_enabled;
+
+/* Returns the start time of a dispatch to count, or 0 */
+static inline int64_t memory_region_stats_begin(void)
+{
+    return unlikely(qatomic_read(&memory_region_stats_enabled)) ?
+           get_clock() : 0;
+}
+
+static void memory_region_stats_end(MemoryRegion *mr, bool is_write,
+                                    int64_t start)
+{
+    if (likely(!start)) {
+        return;
+    }
+    if (is_write) {
+        stat64_add(&mr->stats.writes, 1);
+        stat64_add(&mr->stats.write_ns, get_clock() - start);
+    } else {
+        stat64_add(&mr->stats.reads, 1);
+        stat64_add(&mr->stats.read_ns, get_clock() - start);
+    }
+}
+
+static inline void memory_region_lock(MemoryRegion *mr)
+{
+    if (mr->lock) {
+        qemu_mutex_lock(mr->lock);
+    }
+}
+
+static inline void memory_region_unlock(MemoryRegion *mr)
+{
+    if (mr->lock) {
+        qemu_mutex_unlock(mr->lock);
+    }
+}
+
 static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
                                                 hwaddr addr,
                                                 uint64_t *pval,
@@ -1443,13 +1565,18 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
 {
     unsigned size = memop_size(op);
     MemTxResult r;
+    int64_t start;
 
     if (!memory_region_access_valid(mr, addr, size, false, attrs)) {
         *pval = unassigned_mem_read(mr, addr, size);
         return MEMTX_DECODE_ERROR;
     }
 
+    start = memory_region_stats_begin();
+    memory_region_lock(mr);
     r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    memory_region_unlock(mr);
+    memory_region_stats_end(mr, false, start);
     adjust_endianness(mr, pval, op);
     return r;
 }
@@ -1487,6 +1614,8 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          MemTxAttrs attrs)
 {
     unsigned size = memop_size(op);
+    MemTxResult r;
+    int64_t start;
 
     if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
         unassigned_mem_write(mr, addr, data, size);
@@ -1495,25 +1624,107 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
 
     adjust_endianness(mr, &data, op);
 
+    start = memory_region_stats_begin();
+    memory_region_lock(mr);
     if ((!kvm_eventfds_enabled()) &&
         memory_region_dispatch_write_eventfds(mr, addr, data, size, attrs)) {
-        return MEMTX_OK;
-    }
-
-    if (mr->ops->write) {
-        return access_with_adjusted_size(addr, &data, size,
-                                         mr->ops->impl.min_access_size,
-                                         mr->ops->impl.max_access_size,
-                                         memory_region_write_accessor, mr,
-                                         attrs);
+        r = MEMTX_OK;
+    } else if (mr->ops->write) {
+        r = access_with_adjusted_size(addr, &data, size,
+                                      mr->ops->impl.min_access_size,
+                                      mr->ops->impl.max_access_size,
+                                      memory_region_write_accessor, mr,
+                                      attrs);
     } else {
-        return
-            access_with_adjusted_size(addr, &data, size,
+        r = access_with_adjusted_size(addr, &data, size,
                                       mr->ops->impl.min_access_size,
                                       mr->ops->impl.max_access_size,
                                       memory_region_write_with_attrs_accessor,
                                       mr, attrs);
     }
+    memory_region_unlock(mr);
+    memory_region_stats_end(mr, true, start);
+    return r;
+}
+
+unsigned memory_region_direct_access_sizes(MemoryRegion *mr, bool is_write)
+{
+    const MemoryRegionOps *ops = mr->ops;
+    unsigned impl_min = ops->impl.min_access_size ?: 1;
+    unsigned impl_max = ops->impl.max_access_size ?: 4;
+    unsigned sizes = 0, size;
+
+    if (ops->valid.accepts) {
+        return 0;
+    }
+    if (is_write ? !ops->write && !ops->write_with_attrs
+                 : !ops->read && !ops->read_with_attrs) {
+        return 0;
+    }
+    for (size = impl_min; size <= MIN(impl_max, 8); size <<= 1) {
+        if (!ops->valid.max_access_size ||
+            (size >= ops->valid.min_access_size &&
+             size <= ops->valid.max_access_size)) {
+            sizes |= size;
+        }
+    }
+    return sizes;
+}
+
+MemTxResult memory_region_dispatch_read_direct(MemoryRegion *mr,
+                                               hwaddr addr,
+                                               uint64_t *pval,
+                                               MemOp op,
+                                               MemTxAttrs attrs)
+{
+    unsigned size = memop_size(op);
+    uint64_t mask = MAKE_64BIT_MASK(0, size * 8);
+    int64_t start = memory_region_stats_begin();
+    MemTxResult r;
+
+    *pval = 0;
+    memory_region_lock(mr);
+    if (mr->ops->read) {
+        r = memory_region_read_accessor(mr, addr, pval, size, 0, mask, attrs);
+    } else {
+        r = memory_region_read_with_attrs_accessor(mr, addr, pval, size, 0,
+                                                   mask, attrs);
+    }
+    memory_region_unlock(mr);
+    memory_region_stats_end(mr, false, start);
+    adjust_endianness(mr, pval, op);
+    return r;
+}
+
+MemTxResult memory_region_dispatch_write_direct(MemoryRegion *mr,
+                                                hwaddr addr,
+                                                uint64_t data,
+                                                MemOp op,
+                                                MemTxAttrs attrs)
+{
+    unsigned size = memop_size(op);
+    uint64_t mask = MAKE_64BIT_MASK(0, size * 8);
+    int64_t start;
+    MemTxResult r;
+
+    if (unlikely(mr->ioeventfd_nb)) {
+        /* Eventfds can be added without a change to the memory map */
+        return memory_region_dispatch_write(mr, addr, data, op, attrs);
+    }
+
+    adjust_endianness(mr, &data, op);
+    start = memory_region_stats_begin();
+    memory_region_lock(mr);
+    if (mr->ops->write) {
+        r = memory_region_write_accessor(mr, addr, &data, size, 0, mask,
+                                         attrs);
+    } else {
+        r = memory_region_write_with_attrs_accessor(mr, addr, &data, size,
+                                                    0, mask, attrs);
+    }
+    memory_region_unlock(mr);
+    memory_region_stats_end(mr, true, start);
+    return r;
 }
 
 void memory_region_init_io(MemoryRegion *mr,
@@ -1828,7 +2039,8 @@ uint8_t memory_region_get_dirty_log_mask(MemoryRegion *mr)
 
     if (tcg_enabled() && rb) {
         /* TCG only cares about dirty memory logging for RAM, not IOMMU.  */
-        mask |= (1 << DIRTY_MEMORY_CODE);
+        mask |= (1 << DIRTY_MEMORY_CODE) | (1 << DIRTY_MEMORY_RECLAIM) |
+                (1 << DIRTY_MEMORY_ROM);
     }
     return mask;
 }
@@ -2275,11 +2487,19 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        memory_region_romd_update_pending |= mr->enabled;
         memory_region_transaction_commit();
     }
 }
 
+bool memory_region_test_and_clear_dirty(MemoryRegion *mr, hwaddr addr,
+                                        hwaddr size, unsigned client)
+{
+    assert(mr->ram_block);
+    return cpu_physical_memory_test_and_clear_dirty(
+        memory_region_get_ram_addr(mr) + addr, size, client);
+}
+
 void memory_region_reset_dirty(MemoryRegion *mr, hwaddr addr,
                                hwaddr size, unsigned client)
 {
@@ -2424,6 +2644,21 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr)
     mr->flush_coalesced_mmio = true;
 }
 
+void memory_region_set_lock(MemoryRegion *mr, QemuMutex *lock)
+{
+    mr->lock = lock;
+}
+
+void memory_region_take_bql(MemoryRegion *mr)
+{
+    assert(mr->lock);
+    if (!qemu_mutex_iothread_locked()) {
+        qemu_mutex_unlock(mr->lock);
+        qemu_mutex_lock_iothread();
+        qemu_mutex_lock(mr->lock);
+    }
+}
+
 void memory_region_clear_flush_coalesced(MemoryRegion *mr)
 {
     qemu_flush_coalesced_mmio_buffer();
@@ -2764,6 +2999,11 @@ void memory_global_dirty_log_sync(void)
     memory_region_sync_dirty_bitmap(NULL);
 }
 
+void memory_region_dirty_log_sync(MemoryRegion *mr)
+{
+    memory_region_sync_dirty_bitmap(mr);
+}
+
 void memory_global_after_dirty_log_sync(void)
 {
     MEMORY_LISTENER_CALL_GLOBAL(log_global_after_sync, Forward);
@@ -3058,10 +3298,25 @@ static void mtree_print_mr_owner(const MemoryRegion *mr)
     }
 }
 
+static void mtree_print_mr_stats(const MemoryRegion *mr)
+{
+    uint64_t reads = stat64_get(&mr->stats.reads);
+    uint64_t writes = stat64_get(&mr->stats.writes);
+
+    if (reads) {
+        qemu_printf(" [reads %" PRIu64 ", avg %" PRIu64 " ns]", reads,
+                    stat64_get(&mr->stats.read_ns) / reads);
+    }
+    if (writes) {
+        qemu_printf(" [writes %" PRIu64 ", avg %" PRIu64 " ns]", writes,
+                    stat64_get(&mr->stats.write_ns) / writes);
+    }
+}
+
 static void mtree_print_mr(const MemoryRegion *mr, unsigned int level,
                            hwaddr base,
                            MemoryRegionListHead *alias_print_queue,
-                           bool owner, bool display_disabled)
+                           bool owner, bool display_disabled, bool stats)
 {
     MemoryRegionList *new_ml, *ml, *next_ml;
     MemoryRegionListHead submr_print_queue;
@@ -3138,6 +3393,9 @@ static void mtree_print_mr(const MemoryRegion *mr, unsigned int level,
             if (owner) {
                 mtree_print_mr_owner(mr);
             }
+            if (stats) {
+                mtree_print_mr_stats(mr);
+            }
             qemu_printf("\n");
         }
     }
@@ -3163,7 +3421,7 @@ static void mtree_print_mr(const MemoryRegion *mr, unsigned int level,
 
     QTAILQ_FOREACH(ml, &submr_print_queue, mrqueue) {
         mtree_print_mr(ml->mr, level + 1, cur_start,
-                       alias_print_queue, owner, display_disabled);
+                       alias_print_queue, owner, display_disabled, stats);
     }
 
     QTAILQ_FOREACH_SAFE(ml, &submr_print_queue, mrqueue, next_ml) {
@@ -3175,6 +3433,7 @@ struct FlatViewInfo {
     int counter;
     bool dispatch_tree;
     bool owner;
+    bool stats;
     AccelClass *ac;
 };
 
@@ -3238,6 +3497,9 @@ static void mtree_print_flatview(gpointer key, gpointer value,
         if (fvi->owner) {
             mtree_print_mr_owner(mr);
         }
+        if (fvi->stats) {
+            mtree_print_mr_stats(mr);
+        }
 
         if (fvi->ac) {
             for (i = 0; i < fv_address_spaces->len; ++i) {
@@ -3274,7 +3536,8 @@ static gboolean mtree_info_flatview_free(gpointer key, gpointer value,
     return true;
 }
 
-void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled)
+void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled,
+                bool stats)
 {
     MemoryRegionListHead ml_head;
     MemoryRegionList *ml, *ml2;
@@ -3286,6 +3549,7 @@ void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled)
             .counter = 0,
             .dispatch_tree = dispatch_tree,
             .owner = owner,
+            .stats = stats,
         };
         GArray *fv_address_spaces;
         GHashTable *views = g_hash_table_new(g_direct_hash, g_direct_equal);
@@ -3322,14 +3586,14 @@ void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled)
 
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         qemu_printf("address-space: %s\n", as->name);
-        mtree_print_mr(as->root, 1, 0, &ml_head, owner, disabled);
+        mtree_print_mr(as->root, 1, 0, &ml_head, owner, disabled, stats);
         qemu_printf("\n");
     }
 
     /* print aliased regions */
     QTAILQ_FOREACH(ml, &ml_head, mrqueue) {
         qemu_printf("memory-region: %s\n", memory_region_name(ml->mr));
-        mtree_print_mr(ml->mr, 1, 0, &ml_head, owner, disabled);
+        mtree_print_mr(ml->mr, 1, 0, &ml_head, owner, disabled, stats);
         qemu_printf("\n");
     }
 
@@ -3338,6 +3602,112 @@ void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled)
     }
 }
 
+void memory_region_stats_enable(bool enable)
+{
+    qatomic_set(&memory_region_stats_enabled, enable);
+}
+
+/* Add @mr, its subregions and the regions they alias to @regions */
+static void memory_region_stats_collect(MemoryRegion *mr, GHashTable *regions)
+{
+    MemoryRegion *submr;
+
+    if (!mr || !g_hash_table_add(regions, mr)) {
+        return;
+    }
+    memory_region_stats_collect(mr->alias, regions);
+    QTAILQ_FOREACH(submr, &mr->subregions, subregions_link) {
+        memory_region_stats_collect(submr, regions);
+    }
+}
+
+static GHashTable *memory_region_stats_regions(void)
+{
+    GHashTable *regions = g_hash_table_new(NULL, NULL);
+    AddressSpace *as;
+
+    QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+        memory_region_stats_collect(as->root, regions);
+    }
+    return regions;
+}
+
+void memory_region_stats_reset(void)
+{
+    g_autoptr(GHashTable) regions = memory_region_stats_regions();
+    GHashTableIter iter;
+    MemoryRegion *mr;
+
+    g_hash_table_iter_init(&iter, regions);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&mr, NULL)) {
+        stat64_init(&mr->stats.reads, 0);
+        stat64_init(&mr->stats.writes, 0);
+        stat64_init(&mr->stats.read_ns, 0);
+        stat64_init(&mr->stats.write_ns, 0);
+    }
+}
+
+static uint64_t memory_region_stats_ns(const MemoryRegion *mr)
+{
+    return stat64_get(&mr->stats.read_ns) + stat64_get(&mr->stats.write_ns);
+}
+
+static gint memory_region_stats_cmp(gconstpointer a, gconstpointer b)
+{
+    uint64_t ta = memory_region_stats_ns(*(MemoryRegion **)a);
+    uint64_t tb = memory_region_stats_ns(*(MemoryRegion **)b);
+
+    return ta > tb ? -1 : ta < tb;
+}
+
+GString *memory_region_stats_format(void)
+{
+    g_autoptr(GHashTable) regions = memory_region_stats_regions();
+    g_autoptr(GPtrArray) used = g_ptr_array_new();
+    GString *buf = g_string_new("");
+    GHashTableIter iter;
+    MemoryRegion *mr;
+    guint i;
+
+    g_hash_table_iter_init(&iter, regions);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&mr, NULL)) {
+        if (stat64_get(&mr->stats.reads) || stat64_get(&mr->stats.writes)) {
+            g_ptr_array_add(used, mr);
+        }
+    }
+    if (!used->len) {
+        g_string_append_printf(buf, "No MMIO accesses counted%s\n",
+                               memory_region_stats_enabled ? "" :
+                               " (use the HMP command 'mtree-stats on')");
+        return buf;
+    }
+    g_ptr_array_sort(used, memory_region_stats_cmp);
+
+    g_string_append_printf(buf, "%-32s %-24s %10s %8s %10s %8s %10s\n",
+                           "region", "owner", "reads", "avg ns",
+                           "writes", "avg ns", "total ms");
+    for (i = 0; i < used->len; i++) {
+        uint64_t reads, writes;
+
+        mr = g_ptr_array_index(used, i);
+        reads = stat64_get(&mr->stats.reads);
+        writes = stat64_get(&mr->stats.writes);
+        g_string_append_printf(buf, "%-32s %-24s %10" PRIu64 " %8" PRIu64
+                               " %10" PRIu64 " %8" PRIu64 " %10.3f\n",
+                               memory_region_name(mr),
+                               mr->owner ? object_get_typename(mr->owner)
+                                         : "-",
+                               reads,
+                               reads ? stat64_get(&mr->stats.read_ns) / reads
+                                     : 0,
+                               writes,
+                               writes ? stat64_get(&mr->stats.write_ns) /
+                                        writes : 0,
+                               memory_region_stats_ns(mr) / 1e6);
+    }
+    return buf;
+}
+
 void memory_region_init_ram(MemoryRegion *mr,
                             Object *owner,
                             const char *name,
@@ -3413,6 +3783,39 @@ void memory_region_init_rom_device(MemoryRegion *mr,
     vmstate_register_ram(mr, owner_dev);
 }
 
+#ifdef CONFIG_POSIX
+void memory_region_init_rom_device_from_fd(MemoryRegion *mr,
+                                           Object *owner,
+                                           const MemoryRegionOps *ops,
+                                           void *opaque,
+                                           const char *name,
+                                           uint64_t size,
+                                           int fd,
+                                           Error **errp)
+{
+    Error *err = NULL;
+    assert(ops);
+    memory_region_init(mr, owner, name, size);
+    mr->ops = ops;
+    mr->opaque = opaque;
+    mr->terminates = true;
+    mr->rom_device = true;
+    mr->destructor = memory_region_destructor_ram;
+    /*
+     * A private mapping of a file opened read-only: pages are shared with
+     * the host page cache until the device writes to them.
+     */
+    mr->ram_block = qemu_ram_alloc_from_fd(size, mr, 0, fd, 0, false, &err);
+    if (err) {
+        mr->size = int128_zero();
+        object_unparent(OBJECT(mr));
+        error_propagate(errp, err);
+        return;
+    }
+    vmstate_register_ram(mr, DEVICE(owner));
+}
+#endif
+
 /*
  * Support softmmu builds with CONFIG_FUZZ using a weak symbol and a stub for
  * the fuzz_dma_read_cb callback
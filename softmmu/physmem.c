@@ -53,6 +53,10 @@
 #include <linux/falloc.h>
 #endif
 
+#ifdef CONFIG_LINUX
+#include <sys/syscall.h>
+#endif
+
 #include "qemu/rcu_queue.h"
 #include "qemu/main-loop.h"
 #include "exec/translate-all.h"
@@ -767,6 +771,83 @@ AddressSpace *cpu_get_address_space(CPUState *cpu, int asidx)
     return cpu->cpu_ases[asidx].as;
 }
 
+/*
+ * Watched pages
+ *
+ * A watchpoint makes the TLB send every access to its pages through
+ * cpu_check_watchpoint().  So that accesses to the rest of a page are
+ * dismissed quickly, each page that holds watchpoints has a mask of
+ * the granules they cover, and the union of their flags.  Watchpoints
+ * that span too many pages are not worth it; then cpu->watchpoint_pages
+ * is NULL and the whole list is searched.
+ */
+#define WATCHPOINT_GRANULES     64
+#define WATCHPOINT_GRANULE      (TARGET_PAGE_SIZE / WATCHPOINT_GRANULES)
+#define WATCHPOINT_PAGES_MAX    64
+
+typedef struct CPUWatchpointPage {
+    vaddr page;
+    uint64_t granules;
+    int flags;
+} CPUWatchpointPage;
+
+/* Granules of the page of @start covered by [@start, @end] */
+static uint64_t watchpoint_granules(vaddr start, vaddr end)
+{
+    vaddr first = (start & ~TARGET_PAGE_MASK) / WATCHPOINT_GRANULE;
+    vaddr last = (end & ~TARGET_PAGE_MASK) / WATCHPOINT_GRANULE;
+
+    assert((start & TARGET_PAGE_MASK) == (end & TARGET_PAGE_MASK));
+    return MAKE_64BIT_MASK(first, last - first + 1);
+}
+
+static void cpu_watchpoint_update_pages(CPUState *cpu)
+{
+    CPUWatchpoint *wp;
+
+    if (cpu->watchpoint_pages) {
+        g_hash_table_destroy(cpu->watchpoint_pages);
+        cpu->watchpoint_pages = NULL;
+    }
+    QTAILQ_FOREACH(wp, &cpu->watchpoints, entry) {
+        vaddr end = wp->vaddr + wp->len - 1;
+
+        if (((end & TARGET_PAGE_MASK) - (wp->vaddr & TARGET_PAGE_MASK)) /
+            TARGET_PAGE_SIZE >= WATCHPOINT_PAGES_MAX) {
+            return;
+        }
+    }
+    if (QTAILQ_EMPTY(&cpu->watchpoints)) {
+        return;
+    }
+
+    cpu->watchpoint_pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                                  NULL, g_free);
+    QTAILQ_FOREACH(wp, &cpu->watchpoints, entry) {
+        vaddr end = wp->vaddr + wp->len - 1;
+        vaddr page = wp->vaddr & TARGET_PAGE_MASK;
+
+        for (;;) {
+            CPUWatchpointPage *p = g_hash_table_lookup(cpu->watchpoint_pages,
+                                                       &page);
+
+            if (!p) {
+                p = g_new0(CPUWatchpointPage, 1);
+                p->page = page;
+                g_hash_table_insert(cpu->watchpoint_pages, &p->page, p);
+            }
+            p->granules |= watchpoint_granules(MAX(wp->vaddr, page),
+                                               MIN(end, page +
+                                                   TARGET_PAGE_SIZE - 1));
+            p->flags |= wp->flags & ~BP_WATCHPOINT_HIT;
+            if (page == (end & TARGET_PAGE_MASK)) {
+                break;
+            }
+            page += TARGET_PAGE_SIZE;
+        }
+    }
+}
+
 /* Add a watchpoint.  */
 int cpu_watchpoint_insert(CPUState *cpu, vaddr addr, vaddr len,
                           int flags, CPUWatchpoint **watchpoint)
@@ -786,12 +867,22 @@ int cpu_watchpoint_insert(CPUState *cpu, vaddr addr, vaddr len,
     wp->len = len;
     wp->flags = flags;
 
+    /*
+     * TBs translated without watchpoints may forward stores to loads,
+     * and may be chained to from code that will keep running; drop them
+     * so that the CPU continues with CF_NO_ST_FWD ones.
+     */
+    if (QTAILQ_EMPTY(&cpu->watchpoints) && tcg_enabled()) {
+        tb_flush(cpu);
+    }
+
     /* keep all GDB-injected watchpoints in front */
     if (flags & BP_GDB) {
         QTAILQ_INSERT_HEAD(&cpu->watchpoints, wp, entry);
     } else {
         QTAILQ_INSERT_TAIL(&cpu->watchpoints, wp, entry);
     }
+    cpu_watchpoint_update_pages(cpu);
 
     in_page = -(addr | TARGET_PAGE_MASK);
     if (len <= in_page) {
@@ -825,6 +916,7 @@ int cpu_watchpoint_remove(CPUState *cpu, vaddr addr, vaddr len,
 void cpu_watchpoint_remove_by_ref(CPUState *cpu, CPUWatchpoint *watchpoint)
 {
     QTAILQ_REMOVE(&cpu->watchpoints, watchpoint, entry);
+    cpu_watchpoint_update_pages(cpu);
 
     tlb_flush_page(cpu, watchpoint->vaddr);
 
@@ -863,12 +955,50 @@ static inline bool watchpoint_address_matches(CPUWatchpoint *wp,
     return !(addr > wpend || wp->vaddr > addrend);
 }
 
+/*
+ * Return the flags of the watched pages that [addr, addr + len) touches
+ * in watched granules, or -1 if the watchpoints are not sorted by page.
+ */
+static int watchpoint_pages_match(CPUState *cpu, vaddr addr, vaddr len)
+{
+    vaddr end = addr + len - 1;
+    vaddr page = addr & TARGET_PAGE_MASK;
+    int ret = 0;
+
+    if (!cpu->watchpoint_pages) {
+        return -1;
+    }
+    for (;;) {
+        CPUWatchpointPage *p = g_hash_table_lookup(cpu->watchpoint_pages,
+                                                   &page);
+
+        if (p && (p->granules &
+                  watchpoint_granules(MAX(addr, page),
+                                      MIN(end, page + TARGET_PAGE_SIZE - 1)))) {
+            ret |= p->flags;
+        }
+        if (page == (end & TARGET_PAGE_MASK)) {
+            return ret;
+        }
+        page += TARGET_PAGE_SIZE;
+    }
+}
+
 /* Return flags for watchpoints that match addr + prot.  */
 int cpu_watchpoint_address_matches(CPUState *cpu, vaddr addr, vaddr len)
 {
     CPUWatchpoint *wp;
-    int ret = 0;
+    int ret;
+
+    if (QTAILQ_EMPTY(&cpu->watchpoints)) {
+        return 0;
+    }
+    ret = watchpoint_pages_match(cpu, addr, len);
+    if (ret >= 0) {
+        return ret;
+    }
 
+    ret = 0;
     QTAILQ_FOREACH(wp, &cpu->watchpoints, entry) {
         if (watchpoint_address_matches(wp, addr, len)) {
             ret |= wp->flags;
@@ -901,6 +1031,10 @@ void cpu_check_watchpoint(CPUState *cpu, vaddr addr, vaddr len,
         /* this is currently used only by ARM BE32 */
         addr = cc->tcg_ops->adjust_watchpoint_address(cpu, addr, len);
     }
+    /* Most accesses to a watched page are to its other granules */
+    if (!(watchpoint_pages_match(cpu, addr, len) & flags)) {
+        return;
+    }
     QTAILQ_FOREACH(wp, &cpu->watchpoints, entry) {
         if (watchpoint_address_matches(wp, addr, len)
             && (wp->flags & flags)) {
@@ -1318,6 +1452,166 @@ GString *ram_block_format(void)
     return buf;
 }
 
+#ifdef CONFIG_LINUX
+/*
+ * smaps fields that count towards the resident and the huge page backed
+ * part of a mapping, in kB.  hugetlbfs pages are not included in Rss,
+ * while transparent huge pages mapped by a PMD already are.
+ */
+static const struct {
+    const char *name;
+    bool resident;
+    bool huge;
+} ram_block_smaps_fields[] = {
+    { "Rss:", true, false },
+    { "Shared_Hugetlb:", true, true },
+    { "Private_Hugetlb:", true, true },
+    { "AnonHugePages:", false, true },
+    { "ShmemPmdMapped:", false, true },
+    { "FilePmdMapped:", false, true },
+};
+
+/* Add up the fields above over the mappings that overlap @block */
+static void ram_block_smaps(char **smaps, RAMBlock *block,
+                            uint64_t *resident, uint64_t *huge)
+{
+    uintptr_t start = (uintptr_t)block->host;
+    uintptr_t end = start + block->max_length;
+    bool inside = false;
+    int i, j;
+
+    *resident = *huge = 0;
+    for (i = 0; smaps[i]; i++) {
+        uint64_t lo, hi, kb;
+
+        if (sscanf(smaps[i], "%" SCNx64 "-%" SCNx64 " ", &lo, &hi) == 2) {
+            inside = lo < end && hi > start;
+            continue;
+        }
+        if (!inside) {
+            continue;
+        }
+        for (j = 0; j < ARRAY_SIZE(ram_block_smaps_fields); j++) {
+            const char *name = ram_block_smaps_fields[j].name;
+
+            if (g_str_has_prefix(smaps[i], name) &&
+                sscanf(smaps[i] + strlen(name), "%" SCNu64, &kb) == 1) {
+                if (ram_block_smaps_fields[j].resident) {
+                    *resident += kb << 10;
+                }
+                if (ram_block_smaps_fields[j].huge) {
+                    *huge += kb << 10;
+                }
+            }
+        }
+    }
+}
+
+#define RAM_BLOCK_NODE_SAMPLES  65536
+#define RAM_BLOCK_NODE_BATCH    1024
+
+/*
+ * Describe which host nodes the resident part of @block is on, from
+ * the node of one page in each chunk of it as reported by move_pages(2).
+ */
+static void ram_block_format_nodes(GString *buf, RAMBlock *block)
+{
+    size_t step = MAX(QEMU_VMALLOC_ALIGN, block->page_size);
+    g_autoptr(GArray) count = g_array_new(false, true, sizeof(unsigned));
+    void *pages[RAM_BLOCK_NODE_BATCH];
+    int status[RAM_BLOCK_NODE_BATCH];
+    unsigned resident = 0;
+    size_t offset = 0;
+    int i, n;
+
+    while (block->max_length / step > RAM_BLOCK_NODE_SAMPLES) {
+        step <<= 1;
+    }
+
+    while (offset < block->max_length) {
+        for (n = 0; n < RAM_BLOCK_NODE_BATCH && offset < block->max_length;
+             n++, offset += step) {
+            pages[n] = block->host + offset;
+        }
+        /* With no target nodes, move_pages only reports where pages are */
+        if (syscall(__NR_move_pages, 0, n, pages, NULL, status, 0) < 0) {
+            g_string_append(buf, "-");
+            return;
+        }
+        for (i = 0; i < n; i++) {
+            if (status[i] < 0) {
+                /* Not populated yet */
+                continue;
+            }
+            if (status[i] >= (int)count->len) {
+                g_array_set_size(count, status[i] + 1);
+            }
+            g_array_index(count, unsigned, status[i])++;
+            resident++;
+        }
+    }
+
+    if (!resident) {
+        g_string_append(buf, "unpopulated");
+        return;
+    }
+    for (i = 0; i < count->len; i++) {
+        unsigned c = g_array_index(count, unsigned, i);
+
+        if (c) {
+            g_string_append_printf(buf, "%s%d:%u%%", buf->len ? " " : "",
+                                   i, c * 100 / resident);
+        }
+    }
+}
+
+GString *ram_block_backing_format(void)
+{
+    g_autofree char *contents = NULL;
+    g_auto(GStrv) smaps = NULL;
+    GString *buf = g_string_new("");
+    RAMBlock *block;
+
+    if (!g_file_get_contents("/proc/self/smaps", &contents, NULL, NULL)) {
+        g_string_append(buf, "Cannot read /proc/self/smaps\n");
+        return buf;
+    }
+    smaps = g_strsplit(contents, "\n", -1);
+
+    RCU_READ_LOCK_GUARD();
+    g_string_append_printf(buf, "%24s %8s %10s %10s  %s\n",
+                           "Block Name", "PSize", "Resident", "Huge",
+                           "Host nodes");
+    RAMBLOCK_FOREACH(block) {
+        g_autofree char *psize = size_to_str(block->page_size);
+        g_autofree char *resident_str = NULL, *huge_str = NULL;
+        g_autoptr(GString) nodes = g_string_new("");
+        uint64_t resident, huge;
+
+        if (!block->host) {
+            g_string_append_printf(buf, "%24s %8s %10s %10s  -\n",
+                                   block->idstr, psize, "-", "-");
+            continue;
+        }
+        ram_block_smaps(smaps, block, &resident, &huge);
+        ram_block_format_nodes(nodes, block);
+        resident_str = size_to_str(resident);
+        huge_str = size_to_str(huge);
+        g_string_append_printf(buf, "%24s %8s %10s %10s  %s\n",
+                               block->idstr, psize, resident_str, huge_str,
+                               nodes->str);
+    }
+
+    return buf;
+}
+#else
+GString *ram_block_backing_format(void)
+{
+    return g_string_new("RAM backing information is only available on "
+                        "Linux hosts\n");
+}
+#endif
+
 #ifdef __linux__
 /*
  * FIXME TOCTTOU: this iterates over memory backends' mem-path, which
@@ -1664,7 +1958,7 @@ static ram_addr_t find_ram_offset(ram_addr_t size)
     return offset;
 }
 
-static unsigned long last_ram_page(void)
+unsigned long last_ram_page(void)
 {
     RAMBlock *block;
     ram_addr_t last = 0;
@@ -2211,6 +2505,8 @@ static void reclaim_ramblock(RAMBlock *block)
     } else {
         qemu_anon_ram_free(block->host, block->max_length);
     }
+    g_free(block->code_diverged);
+    g_free(block->zero_reclaimed);
     g_free(block);
 }
 
@@ -2272,10 +2568,62 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
                 }
                 memory_try_enable_merging(vaddr, length);
                 qemu_ram_setup_dump(vaddr, length);
+                ram_block_notify_remap(vaddr, length);
             }
         }
     }
 }
+
+/*
+ * Map @fd at the host address of @block, in place of its memory, and
+ * take the ownership of @fd.  @block must be backed by a shared file
+ * descriptor, and @fd must be at least as large as @block.
+ */
+int qemu_ram_replace_fd(RAMBlock *block, int fd, Error **errp)
+{
+    int flags = MAP_SHARED | MAP_FIXED;
+    struct stat st;
+    void *area;
+
+    assert(block->fd >= 0 && (block->flags & RAM_SHARED));
+
+    if (fstat(fd, &st) < 0) {
+        error_setg_errno(errp, errno, "Cannot stat the memory of block %s",
+                         block->idstr);
+        goto fail;
+    }
+    if (st.st_size < block->max_length) {
+        error_setg(errp, "Memory of block %s is smaller than its "
+                   RAM_ADDR_FMT " bytes", block->idstr, block->max_length);
+        goto fail;
+    }
+
+    flags |= block->flags & RAM_NORESERVE ? MAP_NORESERVE : 0;
+    area = mmap(block->host, block->max_length, PROT_READ | PROT_WRITE,
+                flags, fd, 0);
+    if (area != block->host) {
+        error_setg_errno(errp, errno, "Cannot map the memory of block %s",
+                         block->idstr);
+        goto fail;
+    }
+    memory_try_enable_merging(area, block->max_length);
+    qemu_ram_setup_dump(area, block->max_length);
+    ram_block_notify_remap(area, block->max_length);
+
+    close(block->fd);
+    block->fd = fd;
+    return 0;
+
+fail:
+    close(fd);
+    return -1;
+}
+#else
+int qemu_ram_replace_fd(RAMBlock *block, int fd, Error **errp)
+{
+    error_setg(errp, "Cannot replace the memory of block %s", block->idstr);
+    return -1;
+}
 #endif /* !_WIN32 */
 
 /* Return a host pointer to ram allocated with qemu_ram_alloc.
@@ -2447,6 +2795,73 @@ ram_addr_t qemu_ram_addr_from_host(void *ptr)
     return block->offset + offset;
 }
 
+/*
+ * Same as qemu_ram_addr_from_host(), but for the TB lookup: return the
+ * address in the code source of the block for the pages that still
+ * match it, so that all blocks sharing a source share their TBs.
+ */
+ram_addr_t qemu_ram_code_addr_from_host(void *ptr)
+{
+    RAMBlock *block;
+    ram_addr_t offset;
+
+    RCU_READ_LOCK_GUARD();
+    block = qemu_ram_block_from_host(ptr, false, &offset);
+    if (!block) {
+        return RAM_ADDR_INVALID;
+    }
+
+    if (block->code_source &&
+        !test_bit(offset >> TARGET_PAGE_BITS, block->code_diverged)) {
+        return block->code_source->offset + offset;
+    }
+    return block->offset + offset;
+}
+
+void memory_region_share_code(MemoryRegion *mr, MemoryRegion *source)
+{
+    RAMBlock *block = mr->ram_block;
+
+    assert(block && source->ram_block);
+    assert(mr->rom_device);
+    assert(memory_region_size(mr) == memory_region_size(source));
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    g_free(block->code_diverged);
+    block->code_diverged = bitmap_new(DIV_ROUND_UP(block->used_length,
+                                                    TARGET_PAGE_SIZE));
+    block->code_source = source->ram_block;
+}
+
+void memory_region_unshare_code(MemoryRegion *mr, hwaddr addr, hwaddr size)
+{
+    RAMBlock *block = mr->ram_block;
+    unsigned long page, end;
+
+    if (!block || !block->code_source || !size) {
+        return;
+    }
+
+    end = (addr + size - 1) >> TARGET_PAGE_BITS;
+    for (page = addr >> TARGET_PAGE_BITS; page <= end; page++) {
+        if (test_and_set_bit(page, block->code_diverged)) {
+            continue;
+        }
+        /*
+         * The TBs of the source page may be chained to by code that now
+         * has to reach our own copy; drop them for everyone.  Blocks
+         * that still match the source simply translate them again.
+         */
+        tb_invalidate_phys_range(block->code_source->offset +
+                                 (page << TARGET_PAGE_BITS),
+                                 block->code_source->offset +
+                                 ((page + 1) << TARGET_PAGE_BITS));
+    }
+}
+
 static MemTxResult flatview_read(FlatView *fv, hwaddr addr,
                                  MemTxAttrs attrs, void *buf, hwaddr len);
 static MemTxResult flatview_write(FlatView *fv, hwaddr addr, MemTxAttrs attrs,
@@ -2602,6 +3017,41 @@ void address_space_dispatch_free(AddressSpaceDispatch *d)
     g_free(d);
 }
 
+/*
+ * Duplicate @d for @fv, whose ranges are those of the view @d was built
+ * for, differing only in properties the dispatch tree does not record
+ * (romd_mode, for instance).  The sections are numbered alike, so the
+ * node tree and the subpage tables can be copied as they are.
+ */
+AddressSpaceDispatch *address_space_dispatch_copy(AddressSpaceDispatch *d,
+                                                  FlatView *fv)
+{
+    AddressSpaceDispatch *copy = g_new0(AddressSpaceDispatch, 1);
+    unsigned i;
+
+    copy->phys_map = d->phys_map;
+    copy->map.nodes_nb = copy->map.nodes_nb_alloc = d->map.nodes_nb;
+    copy->map.nodes = g_memdup(d->map.nodes,
+                               d->map.nodes_nb * sizeof(Node));
+
+    for (i = 0; i < d->map.sections_nb; i++) {
+        MemoryRegionSection section = d->map.sections[i];
+
+        section.fv = fv;
+        if (section.mr->subpage) {
+            subpage_t *old = container_of(section.mr, subpage_t, iomem);
+            subpage_t *new = subpage_init(fv, old->base);
+
+            memcpy(new->sub_section, old->sub_section,
+                   TARGET_PAGE_SIZE * sizeof(uint16_t));
+            section.mr = &new->iomem;
+        }
+        phys_section_add(&copy->map, &section);
+    }
+
+    return copy;
+}
+
 static void do_nothing(CPUState *cpu, run_on_cpu_data d)
 {
 }
@@ -2759,6 +3209,33 @@ static bool prepare_mmio_access(MemoryRegion *mr)
     return release_lock;
 }
 
+/*
+ * Extend a direct access to @l bytes at @addr1 in the RAM region @mr
+ * over the sections that follow it in @fv, for as long as they continue
+ * the same region contiguously, so that a DMA transfer split up by the
+ * memory map is done with a single copy and a single update of the
+ * dirty bitmap.  Returns the new length, at most @len.
+ *
+ * Called within RCU critical section.
+ */
+static hwaddr flatview_extend_ram_access(FlatView *fv, hwaddr addr,
+                                         hwaddr len, MemoryRegion *mr,
+                                         hwaddr addr1, hwaddr l,
+                                         bool is_write, MemTxAttrs attrs)
+{
+    while (l < len) {
+        hwaddr next_addr1, next_l = len - l;
+        MemoryRegion *next = flatview_translate(fv, addr + l, &next_addr1,
+                                                &next_l, is_write, attrs);
+
+        if (next != mr || next_addr1 != addr1 + l) {
+            break;
+        }
+        l += next_l;
+    }
+    return l;
+}
+
 /* Called within RCU critical section.  */
 static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
                                            MemTxAttrs attrs,
@@ -2783,6 +3260,8 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
                                                    size_memop(l), attrs);
         } else {
             /* RAM case */
+            l = flatview_extend_ram_access(fv, addr, len, mr, addr1, l,
+                                           true, attrs);
             ram_ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l, false);
             memcpy(ram_ptr, buf, l);
             invalidate_and_set_dirty(mr, addr1, l);
@@ -2848,6 +3327,8 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
             stn_he_p(buf, l, val);
         } else {
             /* RAM case */
+            l = flatview_extend_ram_access(fv, addr, len, mr, addr1, l,
+                                           false, attrs);
             ram_ptr = qemu_ram_ptr_length(mr->ram_block, addr1, &l, false);
             memcpy(buf, ram_ptr, l);
         }
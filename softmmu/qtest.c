@@ -36,6 +36,14 @@
 
 #define MAX_IRQ 256
 
+/* Operations of the "batch" command */
+enum {
+    QTEST_BATCH_READ = 0,
+    QTEST_BATCH_WRITE = 1,
+    QTEST_BATCH_CLOCK_STEP = 2,
+};
+#define QTEST_BATCH_OP_SIZE 24
+
 #define TYPE_QTEST "qtest"
 
 OBJECT_DECLARE_SIMPLE_TYPE(QTest, QTEST)
@@ -211,6 +219,24 @@ static void *qtest_server_send_opaque;
  * B64_DATA is an arbitrarily long base64 encoded string.
  * If the sizes do not match, the data will be truncated.
  *
+ * Batches:
+ * """"""""
+ *
+ * .. code-block:: none
+ *
+ *  > batch COUNT B64_OPS
+ *  < OK B64_RESULTS
+ *
+ * Run COUNT MMIO accesses and clock steps with a single round trip.
+ * B64_OPS is the base64 encoding of COUNT 24-byte operations, each one
+ * made of an operation byte (0 read, 1 write, 2 clock_step), an access
+ * size byte (1, 2, 4 or 8, ignored by clock_step), six zero bytes, then
+ * ADDR and VALUE as 64-bit little-endian integers.  A read or write
+ * behaves like ``readX ADDR`` or ``writeX ADDR VALUE``, a clock step like
+ * ``clock_step VALUE``.  B64_RESULTS is the base64 encoding of COUNT
+ * 64-bit little-endian integers: the value read, VALUE for a write, and
+ * the new clock for a clock step.
+ *
  * IRQ management:
  * """""""""""""""
  *
@@ -376,6 +402,137 @@ static void qtest_clock_warp(int64_t dest)
     qemu_clock_notify(QEMU_CLOCK_VIRTUAL);
 }
 
+static unsigned qtest_access_size(char suffix)
+{
+    switch (suffix) {
+    case 'b':
+        return 1;
+    case 'w':
+        return 2;
+    case 'l':
+        return 4;
+    case 'q':
+        return 8;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static void qtest_mmio_write(uint64_t addr, unsigned size, uint64_t value)
+{
+    if (size == 1) {
+        uint8_t data = value;
+        address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                            &data, 1);
+    } else if (size == 2) {
+        uint16_t data = value;
+        tswap16s(&data);
+        address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                            &data, 2);
+    } else if (size == 4) {
+        uint32_t data = value;
+        tswap32s(&data);
+        address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                            &data, 4);
+    } else if (size == 8) {
+        uint64_t data = value;
+        tswap64s(&data);
+        address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                            &data, 8);
+    }
+}
+
+static uint64_t qtest_mmio_read(uint64_t addr, unsigned size)
+{
+    uint64_t value = UINT64_C(-1);
+
+    if (size == 1) {
+        uint8_t data;
+        address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                           &data, 1);
+        value = data;
+    } else if (size == 2) {
+        uint16_t data;
+        address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                           &data, 2);
+        value = tswap16(data);
+    } else if (size == 4) {
+        uint32_t data;
+        address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                           &data, 4);
+        value = tswap32(data);
+    } else if (size == 8) {
+        address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
+                           &value, 8);
+        tswap64s(&value);
+    }
+    return value;
+}
+
+/*
+ * Run the operations of a "batch" command; see the protocol description
+ * at the top of this file for their encoding.
+ */
+static void qtest_process_batch(CharBackend *chr, uint64_t count,
+                                gchar *b64_ops)
+{
+    g_autofree uint64_t *results = NULL;
+    g_autofree gchar *b64_results = NULL;
+    uint8_t *ops;
+    gsize len;
+    uint64_t i;
+
+    ops = g_base64_decode_inplace(b64_ops, &len);
+    if (len != count * QTEST_BATCH_OP_SIZE) {
+        qtest_send_prefix(chr);
+        qtest_send(chr, "ERR invalid batch size\n");
+        return;
+    }
+
+    results = g_new0(uint64_t, count);
+    for (i = 0; i < count; i++) {
+        uint8_t *op = ops + i * QTEST_BATCH_OP_SIZE;
+        uint64_t addr = ldq_le_p(op + 8);
+        uint64_t value = ldq_le_p(op + 16);
+        unsigned size = op[1];
+
+        switch (op[0]) {
+        case QTEST_BATCH_READ:
+        case QTEST_BATCH_WRITE:
+            if (size != 1 && size != 2 && size != 4 && size != 8) {
+                qtest_send_prefix(chr);
+                qtest_sendf(chr, "ERR invalid access size %u\n", size);
+                return;
+            }
+            if (op[0] == QTEST_BATCH_READ) {
+                value = qtest_mmio_read(addr, size);
+            } else {
+                qtest_mmio_write(addr, size, value);
+            }
+            break;
+        case QTEST_BATCH_CLOCK_STEP:
+            if (!qtest_enabled()) {
+                qtest_send_prefix(chr);
+                qtest_send(chr, "FAIL clock_step needs qtest accel\n");
+                return;
+            }
+            qtest_clock_warp(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + value);
+            value = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+            break;
+        default:
+            qtest_send_prefix(chr);
+            qtest_sendf(chr, "ERR unknown batch operation %u\n", op[0]);
+            return;
+        }
+        stq_le_p(&results[i], value);
+    }
+
+    b64_results = g_base64_encode((uint8_t *)results,
+                                  count * sizeof(uint64_t));
+    qtest_send_prefix(chr);
+    qtest_sendf(chr, "OK %s\n", b64_results);
+}
+
 static void qtest_process_command(CharBackend *chr, gchar **words)
 {
     const gchar *command;
@@ -535,26 +692,7 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
         ret = qemu_strtou64(words[2], NULL, 0, &value);
         g_assert(ret == 0);
 
-        if (words[0][5] == 'b') {
-            uint8_t data = value;
-            address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                                &data, 1);
-        } else if (words[0][5] == 'w') {
-            uint16_t data = value;
-            tswap16s(&data);
-            address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                                &data, 2);
-        } else if (words[0][5] == 'l') {
-            uint32_t data = value;
-            tswap32s(&data);
-            address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                                &data, 4);
-        } else if (words[0][5] == 'q') {
-            uint64_t data = value;
-            tswap64s(&data);
-            address_space_write(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                                &data, 8);
-        }
+        qtest_mmio_write(addr, qtest_access_size(words[0][5]), value);
         qtest_send_prefix(chr);
         qtest_send(chr, "OK\n");
     } else if (strcmp(words[0], "readb") == 0 ||
@@ -562,33 +700,14 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
                strcmp(words[0], "readl") == 0 ||
                strcmp(words[0], "readq") == 0) {
         uint64_t addr;
-        uint64_t value = UINT64_C(-1);
+        uint64_t value;
         int ret;
 
         g_assert(words[1]);
         ret = qemu_strtou64(words[1], NULL, 0, &addr);
         g_assert(ret == 0);
 
-        if (words[0][4] == 'b') {
-            uint8_t data;
-            address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                               &data, 1);
-            value = data;
-        } else if (words[0][4] == 'w') {
-            uint16_t data;
-            address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                               &data, 2);
-            value = tswap16(data);
-        } else if (words[0][4] == 'l') {
-            uint32_t data;
-            address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                               &data, 4);
-            value = tswap32(data);
-        } else if (words[0][4] == 'q') {
-            address_space_read(first_cpu->as, addr, MEMTXATTRS_UNSPECIFIED,
-                               &value, 8);
-            tswap64s(&value);
-        }
+        value = qtest_mmio_read(addr, qtest_access_size(words[0][4]));
         qtest_send_prefix(chr);
         qtest_sendf(chr, "OK 0x%016" PRIx64 "\n", value);
     } else if (strcmp(words[0], "read") == 0) {
@@ -729,6 +848,14 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
 
         qtest_send_prefix(chr);
         qtest_send(chr, "OK\n");
+    } else if (strcmp(words[0], "batch") == 0) {
+        uint64_t count;
+        int ret;
+
+        g_assert(words[1] && words[2]);
+        ret = qemu_strtou64(words[1], NULL, 0, &count);
+        g_assert(ret == 0);
+        qtest_process_batch(chr, count, words[2]);
     } else if (strcmp(words[0], "endianness") == 0) {
         qtest_send_prefix(chr);
 #if defined(TARGET_WORDS_BIGENDIAN)
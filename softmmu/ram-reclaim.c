@@ -0,0 +1,135 @@
+/*
+ * Reclaim the host memory behind zeroed guest pages
+ *
+ * Guests that never give memory back, such as firmware, still leave
+ * much of their RAM zeroed.  Every interval, the host pages of guest RAM
+ * that were not written since the previous scan are checked, and the
+ * zero ones are discarded; reading them back yields zeroes again.  The
+ * DIRTY_MEMORY_RECLAIM dirty log tells which pages were written, and a
+ * page that was discarded is not checked again until it is written.
+ *
+ * The vCPUs are paused and the block layer is drained while a scan
+ * checks and discards pages, and the scan runs in the main loop with the
+ * iothread lock held, so that no write can land between the check and
+ * the discard.  The writes of vhost backends are not seen by the dirty
+ * log at all, so nothing is reclaimed while one is running.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/timer.h"
+#include "exec/memory.h"
+#include "exec/ramblock.h"
+#include "exec/ram_addr.h"
+#include "hw/virtio/vhost.h"
+#include "migration/misc.h"
+#include "sysemu/cpus.h"
+#include "sysemu/runstate.h"
+#include "trace.h"
+
+static QEMUTimer *reclaim_timer;
+static uint32_t reclaim_interval_ms;
+
+static bool ram_reclaim_discard(RAMBlock *rb, ram_addr_t start,
+                                ram_addr_t end)
+{
+    return start == end || !ram_block_discard_range(rb, start, end - start);
+}
+
+/*
+ * Discard the zero pages of @rb that were not written since the last
+ * scan.  Returns the number of pages discarded; *checked is increased
+ * by the number of pages compared against zero.
+ */
+static uint64_t ram_reclaim_block(RAMBlock *rb, uint64_t *checked)
+{
+    size_t page_size = rb->page_size;
+    g_autofree DirtyBitmapSnapshot *dirty = NULL;
+    ram_addr_t offset, run = 0;
+    uint64_t reclaimed = 0;
+    unsigned long page, first = 0;
+
+    if (!rb->zero_reclaimed) {
+        rb->zero_reclaimed = bitmap_new(rb->max_length / page_size);
+    }
+    dirty = memory_region_snapshot_and_clear_dirty(rb->mr, 0, rb->used_length,
+                                                   DIRTY_MEMORY_RECLAIM);
+
+    /* Discard runs of consecutive zero pages with one call */
+    for (offset = 0; offset < rb->used_length; offset += page_size) {
+        page = offset / page_size;
+
+        if (memory_region_snapshot_get_dirty(rb->mr, dirty, offset,
+                                             page_size)) {
+            clear_bit(page, rb->zero_reclaimed);
+        } else if (!test_bit(page, rb->zero_reclaimed)) {
+            (*checked)++;
+            if (buffer_is_zero(rb->host + offset, page_size)) {
+                if (!run) {
+                    first = page;
+                }
+                run += page_size;
+                continue;
+            }
+        }
+        if (run && ram_reclaim_discard(rb, first * page_size,
+                                       first * page_size + run)) {
+            bitmap_set(rb->zero_reclaimed, first, run / page_size);
+            reclaimed += run / page_size;
+        }
+        run = 0;
+    }
+    if (run && ram_reclaim_discard(rb, first * page_size,
+                                   first * page_size + run)) {
+        bitmap_set(rb->zero_reclaimed, first, run / page_size);
+        reclaimed += run / page_size;
+    }
+    return reclaimed;
+}
+
+static void ram_reclaim_tick(void *opaque)
+{
+    uint64_t checked = 0, reclaimed = 0;
+    int64_t start = get_clock();
+    RAMBlock *rb;
+
+    /*
+     * Migration copies guest RAM behind the back of the dirty log, and
+     * so may whoever disabled discards, and vhost backends.
+     */
+    if (runstate_is_running() && migration_is_idle() &&
+        !migration_in_incoming_postcopy() &&
+        !ram_block_discard_is_disabled() && !vhost_has_started_dev()) {
+        pause_all_vcpus();
+        /* Device reads into guest RAM complete before the check */
+        bdrv_drain_all_begin();
+        WITH_RCU_READ_LOCK_GUARD() {
+            RAMBLOCK_FOREACH(rb) {
+                if (qemu_ram_is_migratable(rb) && !qemu_ram_is_shared(rb)) {
+                    reclaimed += ram_reclaim_block(rb, &checked);
+                }
+            }
+        }
+        bdrv_drain_all_end();
+        resume_all_vcpus();
+        trace_ram_reclaim_scan(checked, reclaimed, get_clock() - start);
+    }
+
+    timer_mod(reclaim_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                             reclaim_interval_ms);
+}
+
+void ram_zero_reclaim_start(uint32_t interval_ms)
+{
+    assert(interval_ms && !reclaim_timer);
+    reclaim_interval_ms = interval_ms;
+    reclaim_timer = timer_new_ms(QEMU_CLOCK_REALTIME, ram_reclaim_tick, NULL);
+    timer_mod(reclaim_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                             reclaim_interval_ms);
+}
@@ -441,6 +441,15 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rrcompress",
+            .type = QEMU_OPT_BOOL,
+        }, {
+            .name = "rrsnapshot-period",
+            .type = QEMU_OPT_NUMBER,
+        }, {
+            .name = "rrsnapshot-keep",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -2636,6 +2645,23 @@ static void qemu_init_displays(void)
     }
 }
 
+/* Tell how much of the host a small-footprint guest costs after startup */
+static void qemu_report_footprint(void)
+{
+#ifdef CONFIG_LINUX
+    g_autofree char *statm = NULL;
+    unsigned long size, resident;
+
+    if (!g_file_get_contents("/proc/self/statm", &statm, NULL, NULL) ||
+        sscanf(statm, "%lu %lu", &size, &resident) != 2) {
+        return;
+    }
+    info_report("small-footprint: %lu KiB resident, %lu KiB virtual",
+                resident * (qemu_real_host_page_size / KiB),
+                size * (qemu_real_host_page_size / KiB));
+#endif
+}
+
 static void qemu_init_board(void)
 {
     MachineClass *machine_class = MACHINE_GET_CLASS(current_machine);
@@ -3776,6 +3802,10 @@ void qemu_init(int argc, char **argv, char **envp)
     }
     qemu_init_displays();
     accel_setup_post(current_machine);
+    if (current_machine->small_footprint &&
+        phase_check(PHASE_MACHINE_READY)) {
+        qemu_report_footprint();
+    }
     os_setup_post();
     resume_mux_open();
 }
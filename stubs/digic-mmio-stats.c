@@ -0,0 +1,15 @@
+/*
+ * Canon DIGIC MMIO access counter stubs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+
+HumanReadableText *qmp_x_query_digic_mmio(Error **errp)
+{
+    error_setg(errp, "Support for DIGIC machines not built-in");
+    return NULL;
+}
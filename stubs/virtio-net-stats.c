@@ -0,0 +1,15 @@
+/*
+ * virtio-net statistics stubs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-net.h"
+
+HumanReadableText *qmp_x_query_virtio_net(Error **errp)
+{
+    error_setg(errp, "Support for virtio-net not built-in");
+    return NULL;
+}
@@ -2000,6 +2000,7 @@ static Property arm_cpu_properties[] = {
                         mp_affinity, ARM64_AFFINITY_INVALID),
     DEFINE_PROP_INT32("node-id", ARMCPU, node_id, CPU_UNSET_NUMA_NODE_ID),
     DEFINE_PROP_INT32("core-count", ARMCPU, core_count, -1),
+    DEFINE_PROP_BOOL("x-copy-loops", ARMCPU, copy_loops, false),
     DEFINE_PROP_END_OF_LIST()
 };
 
@@ -687,6 +687,20 @@ typedef struct CPUARMState {
     struct CPUBreakpoint *cpu_breakpoint[16];
     struct CPUWatchpoint *cpu_watchpoint[16];
 
+    /*
+     * PMSAv5 MPU regions decoded from cp15, highest priority first.
+     * Rebuilt on the next lookup whenever @valid is cleared, i.e. when
+     * a region or access permission register is written.
+     */
+    struct {
+        bool valid;
+        int nr;
+        uint32_t base[8];
+        uint32_t mask[8];
+        uint8_t data_ap[8];
+        uint8_t insn_ap[8];
+    } pmsav5;
+
     /* Fields up to this point are cleared by a CPU reset */
     struct {} end_reset_fields;
 
@@ -996,6 +1010,9 @@ struct ARMCPU {
      */
     bool cfgend;
 
+    /* Run recognised A32 memcpy/memset loops in bulk (x-copy-loops) */
+    bool copy_loops;
+
     QLIST_HEAD(, ARMELChangeHook) pre_el_change_hooks;
     QLIST_HEAD(, ARMELChangeHook) el_change_hooks;
 
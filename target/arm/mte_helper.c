@@ -639,7 +639,7 @@ static void mte_check_fail(CPUARMState *env, uint32_t desc,
  * Return the number of successful tests.
  * Thus a return value < @count indicates a failure.
  *
- * A note about sizes: count is expected to be small.
+ * A note about sizes: count is usually small.
  *
  * The most common use will be LDP/STP of two integer registers,
  * which means 16 bytes of memory touching at most 2 tags, but
@@ -648,27 +648,46 @@ static void mte_check_fail(CPUARMState *env, uint32_t desc,
  * Using AdvSIMD LD/ST (multiple), one can access 64 bytes of memory,
  * touching at most 5 tags.  SVE LDR/STR (vector) with the default
  * vector length is also 64 bytes; the maximum architectural length
- * is 256 bytes touching at most 9 tags.
+ * is 256 bytes touching at most 9 tags.  SVE contiguous LD/ST check
+ * each run of active elements at once, up to 4 registers or 65 tags.
  *
- * The loop below uses 7 logical operations and 1 memory operation
- * per tag pair.  An implementation that loads an aligned word and
- * uses masking to ignore adjacent tags requires 18 logical operations
- * and thus does not begin to pay off until 6 tags.
- * Which, according to the survey above, is unlikely to be common.
+ * The byte loop below uses 7 logical operations and 1 memory operation
+ * per tag pair.  While at least 16 tags remain, a whole little-endian
+ * word of tags is compared at once instead; no masking is needed then,
+ * and the first mismatching nibble gives the number of successes.
  */
 static int checkN(uint8_t *mem, int odd, int cmp, int count)
 {
+    uint64_t cmp16 = cmp * 0x1111111111111111ull;
+    uint64_t diff16;
     int n = 0, diff;
 
     /* Replicate the test tag and compare.  */
     cmp *= 0x11;
-    diff = *mem++ ^ cmp;
 
     if (odd) {
-        goto start_odd;
+        /* Test the odd tag, to align on a tag pair. */
+        diff = *mem++ ^ cmp;
+        if (unlikely(diff & 0xf0)) {
+            return 0;
+        }
+        if (++n == count) {
+            return n;
+        }
     }
 
-    while (1) {
+    while (count - n >= 16) {
+        diff16 = ldq_le_p(mem) ^ cmp16;
+        if (unlikely(diff16)) {
+            return n + ctz64(diff16) / 4;
+        }
+        n += 16;
+        mem += 8;
+    }
+
+    while (n < count) {
+        diff = *mem++ ^ cmp;
+
         /* Test even tag. */
         if (unlikely((diff) & 0x0f)) {
             break;
@@ -677,16 +696,11 @@ static int checkN(uint8_t *mem, int odd, int cmp, int count)
             break;
         }
 
-    start_odd:
         /* Test odd tag. */
         if (unlikely((diff) & 0xf0)) {
             break;
         }
-        if (++n == count) {
-            break;
-        }
-
-        diff = *mem++ ^ cmp;
+        ++n;
     }
     return n;
 }
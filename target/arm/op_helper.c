@@ -18,6 +18,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
+#include "qemu/units.h"
 #include "cpu.h"
 #include "exec/helper-proto.h"
 #include "internals.h"
@@ -449,6 +450,218 @@ void HELPER(cpsr_write_eret)(CPUARMState *env, uint32_t val)
     qemu_mutex_unlock_iothread();
 }
 
+/*
+ * Block transfers of the registers in @list (which must not include
+ * the PC) from or to consecutive words starting at @addr.  If the block
+ * lies in one page of RAM, check the TLB once with probe_access() and
+ * then access host memory directly.  Otherwise, e.g. on a page crossing
+ * or for I/O, do one ordinary access per register.
+ */
+static void *block_host_addr(CPUARMState *env, uint32_t addr, int size,
+                             MMUAccessType access_type, MemOpIdx oi,
+                             uintptr_t ra)
+{
+    if ((addr & 3) || (addr & ~TARGET_PAGE_MASK) + size > TARGET_PAGE_SIZE) {
+        return NULL;
+    }
+    return probe_access(env, addr, size, access_type, get_mmuidx(oi), ra);
+}
+
+void HELPER(ldm)(CPUARMState *env, uint32_t addr, uint32_t list, uint32_t oi)
+{
+    uintptr_t ra = GETPC();
+    bool be = (get_memop(oi) & MO_BSWAP) == MO_BE;
+    uint8_t *host = block_host_addr(env, addr, ctpop32(list) * 4,
+                                    MMU_DATA_LOAD, oi, ra);
+    int i;
+
+    for (i = 0; i < 15; i++) {
+        if (!(list & (1 << i))) {
+            continue;
+        }
+        if (host) {
+            env->regs[i] = be ? ldl_be_p(host) : ldl_le_p(host);
+            qemu_plugin_vcpu_mem_cb(env_cpu(env), addr, oi, QEMU_PLUGIN_MEM_R);
+            host += 4;
+        } else if (be) {
+            env->regs[i] = cpu_ldl_be_mmu(env, addr, oi, ra);
+        } else {
+            env->regs[i] = cpu_ldl_le_mmu(env, addr, oi, ra);
+        }
+        addr += 4;
+    }
+}
+
+void HELPER(stm)(CPUARMState *env, uint32_t addr, uint32_t list, uint32_t oi)
+{
+    uintptr_t ra = GETPC();
+    bool be = (get_memop(oi) & MO_BSWAP) == MO_BE;
+    uint8_t *host = block_host_addr(env, addr, ctpop32(list) * 4,
+                                    MMU_DATA_STORE, oi, ra);
+    int i;
+
+    for (i = 0; i < 15; i++) {
+        if (!(list & (1 << i))) {
+            continue;
+        }
+        if (host) {
+            if (be) {
+                stl_be_p(host, env->regs[i]);
+            } else {
+                stl_le_p(host, env->regs[i]);
+            }
+            qemu_plugin_vcpu_mem_cb(env_cpu(env), addr, oi, QEMU_PLUGIN_MEM_W);
+            host += 4;
+        } else if (be) {
+            cpu_stl_be_mmu(env, addr, env->regs[i], oi, ra);
+        } else {
+            cpu_stl_le_mmu(env, addr, env->regs[i], oi, ra);
+        }
+        addr += 4;
+    }
+}
+
+/*
+ * Number of times the body of a copy loop ending in "subs rC, rC, #step;
+ * b<cond>" runs from the loop head with @count in rC, or 0 if unknown.
+ */
+static uint64_t copy_loop_iterations(uint32_t count, uint32_t step, int cond)
+{
+    switch (cond) {
+    case 0x1: /* NE */
+        return count && count % step == 0 ? count / step : 0;
+    case 0x2: /* CS */
+        return count / step + 1;
+    case 0x8: /* HI */
+        return count ? DIV_ROUND_UP((uint64_t)count, step) : 1;
+    case 0xa: /* GE */
+        return (int32_t)count >= 0 ? count / step + 1 : 1;
+    case 0xc: /* GT */
+        return (int32_t)count > 0 ? DIV_ROUND_UP((uint64_t)count, step) : 1;
+    }
+    return 0;
+}
+
+/* Bound the time spent in one call, for interrupt latency. */
+#define COPY_LOOP_MAX_BYTES (256 * KiB)
+
+/*
+ * Run all but the last iteration of a copy or fill loop recognised by
+ * the translator (see gen_copy_loop), as long as both the source and
+ * the destination are RAM that is already in the TLB.  The registers
+ * and flags are left as they would be at the loop head after the same
+ * number of iterations; the translated loop body runs the rest.
+ *
+ * @desc holds rS, rD and rC in bits [11:0], the branch condition in
+ * [15:12], fill (no rS) in bit 16, big-endian data in bit 17 and the
+ * MMU index in [27:20]; @list holds the transferred registers.
+ */
+void HELPER(copy_loop)(CPUARMState *env, uint32_t desc, uint32_t list,
+                       uint32_t step)
+{
+#ifndef CONFIG_USER_ONLY
+    int rs = extract32(desc, 0, 4);
+    int rd = extract32(desc, 4, 4);
+    int rc = extract32(desc, 8, 4);
+    bool fill = extract32(desc, 16, 1);
+    bool be = extract32(desc, 17, 1);
+    int mmu_idx = extract32(desc, 20, 8);
+    uint32_t chunk = ctpop32(list) * 4;
+    uint32_t src = env->regs[rs], dst = env->regs[rd], count = env->regs[rc];
+    uint64_t iters = copy_loop_iterations(count, step, extract32(desc, 12, 4));
+    uint64_t todo, done = 0;
+    uint8_t pattern[64], *last = NULL;
+    bool uniform = true;
+    uint32_t old;
+    int i, j;
+
+    if (iters <= 1 || (dst & 3) || (!fill && (src & 3))) {
+        return;
+    }
+    todo = MIN(iters - 1, COPY_LOOP_MAX_BYTES / chunk);
+
+    if (fill) {
+        for (i = j = 0; i < 15; i++) {
+            if (list & (1 << i)) {
+                if (be) {
+                    stl_be_p(pattern + j, env->regs[i]);
+                } else {
+                    stl_le_p(pattern + j, env->regs[i]);
+                }
+                j += 4;
+            }
+        }
+        for (j = 1; j < chunk; j++) {
+            uniform &= pattern[j] == pattern[0];
+        }
+    }
+
+    while (done < todo) {
+        uint64_t n = todo - done;
+        uint32_t len;
+        uint8_t *hdst, *hsrc;
+
+        n = MIN(n, (TARGET_PAGE_SIZE - (dst & ~TARGET_PAGE_MASK)) / chunk);
+        if (!fill) {
+            n = MIN(n, (TARGET_PAGE_SIZE - (src & ~TARGET_PAGE_MASK)) / chunk);
+        }
+        if (n == 0) {
+            /* This chunk crosses a page: leave it to the loop body. */
+            break;
+        }
+        len = n * chunk;
+
+        hdst = tlb_vaddr_to_host(env, dst, MMU_DATA_STORE, mmu_idx);
+        if (!hdst) {
+            break;
+        }
+        if (fill) {
+            if (uniform) {
+                memset(hdst, pattern[0], len);
+            } else {
+                for (j = 0; j < n; j++) {
+                    memcpy(hdst + j * chunk, pattern, chunk);
+                }
+            }
+        } else {
+            hsrc = tlb_vaddr_to_host(env, src, MMU_DATA_LOAD, mmu_idx);
+            /* A forward word copy only matches memmove if dst <= src. */
+            if (!hsrc || (hdst > hsrc && hdst < hsrc + len)) {
+                break;
+            }
+            memmove(hdst, hsrc, len);
+            src += len;
+        }
+        last = hdst + len - chunk;
+        dst += len;
+        done += n;
+    }
+
+    if (!done) {
+        return;
+    }
+
+    old = count - (done - 1) * step;
+    count -= done * step;
+    env->regs[rd] = dst;
+    env->regs[rc] = count;
+    if (!fill) {
+        env->regs[rs] = src;
+        for (i = 0; i < 15; i++) {
+            if (list & (1 << i)) {
+                env->regs[i] = be ? ldl_be_p(last) : ldl_le_p(last);
+                last += 4;
+            }
+        }
+    }
+
+    /* Flags as set by the last "subs rC, rC, #step". */
+    env->NF = env->ZF = count;
+    env->CF = old >= step;
+    env->VF = (old ^ step) & (old ^ count);
+#endif
+}
+
 /* Access to user mode registers from privileged modes.  */
 uint32_t HELPER(get_user_reg)(CPUARMState *env, uint32_t regno)
 {
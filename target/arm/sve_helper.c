@@ -152,6 +152,43 @@ static inline uint64_t expand_pred_s(uint8_t byte)
     return word[byte & 0x11];
 }
 
+/* Similarly for elements of 1 << ESZ bytes.  */
+static inline uint64_t expand_pred_esz(uint8_t byte, int esz)
+{
+    switch (esz) {
+    case MO_8:
+        return expand_pred_b(byte);
+    case MO_16:
+        return expand_pred_h(byte);
+    case MO_32:
+        return expand_pred_s(byte);
+    default:
+        return -(uint64_t)(byte & 1);
+    }
+}
+
+/*
+ * The bits of a 16-bit predicate chunk that govern elements of TYPE,
+ * i.e. 0xffff, 0x5555, 0x1111 or 0x0101.
+ */
+#define PRED_ACTIVE16(TYPE)  ((uint16_t)(0xffff / ((1 << sizeof(TYPE)) - 1)))
+
+/*
+ * Merge the 16 bytes at RES into VD under the predicate chunk PG,
+ * through a byte mask per 64-bit word instead of a test per element.
+ */
+static inline void merge_pred16(void *vd, const void *res, uint16_t pg,
+                                int esz)
+{
+    uint64_t *d = vd, r[2];
+    uint64_t m0 = expand_pred_esz(pg, esz);
+    uint64_t m1 = expand_pred_esz(pg >> 8, esz);
+
+    memcpy(r, res, 16);
+    d[0] = (r[0] & m0) | (d[0] & ~m0);
+    d[1] = (r[1] & m1) | (d[1] & ~m1);
+}
+
 #define LOGICAL_PPPP(NAME, FUNC) \
 void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc)  \
 {                                                                         \
@@ -199,20 +236,31 @@ LOGICAL_PPPP(sve_nand_pppp, DO_NAND)
  * extra care wrt byte/word ordering we could use gcc generic vectors
  * and do 16 bytes at a time.
  */
+/*
+ * Each 16 bytes with an active element are computed whole, with a
+ * fixed trip count the host compiler can vectorize, and merged under
+ * the predicate with merge_pred16.  The operations expanded here have
+ * no side effects, so computing the inactive elements is harmless.
+ * The elements of the vectors are permuted alike within the 16 bytes
+ * on big-endian hosts, so H is not needed.
+ */
 #define DO_ZPZZ(NAME, TYPE, H, OP)                                       \
 void HELPER(NAME)(void *vd, void *vn, void *vm, void *vg, uint32_t desc) \
 {                                                                       \
-    intptr_t i, opr_sz = simd_oprsz(desc);                              \
-    for (i = 0; i < opr_sz; ) {                                         \
+    intptr_t i, j, opr_sz = simd_oprsz(desc);                           \
+    for (i = 0; i < opr_sz; i += 16) {                                  \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));                 \
-        do {                                                            \
-            if (pg & 1) {                                               \
-                TYPE nn = *(TYPE *)(vn + H(i));                         \
-                TYPE mm = *(TYPE *)(vm + H(i));                         \
-                *(TYPE *)(vd + H(i)) = OP(nn, mm);                      \
-            }                                                           \
-            i += sizeof(TYPE), pg >>= sizeof(TYPE);                     \
-        } while (i & 15);                                               \
+        TYPE nn[16 / sizeof(TYPE)], mm[16 / sizeof(TYPE)];              \
+        TYPE dd[16 / sizeof(TYPE)];                                     \
+        if (!(pg & PRED_ACTIVE16(TYPE))) {                              \
+            continue;                                                   \
+        }                                                               \
+        memcpy(nn, vn + i, 16);                                         \
+        memcpy(mm, vm + i, 16);                                         \
+        for (j = 0; j < 16 / sizeof(TYPE); j++) {                       \
+            dd[j] = OP(nn[j], mm[j]);                                   \
+        }                                                               \
+        merge_pred16(vd + i, dd, pg, ctz32(sizeof(TYPE)));              \
     }                                                                   \
 }
 
@@ -846,20 +894,23 @@ DO_ZPZW(sve_lsl_zpzw_s, uint32_t, uint64_t, H1_4, DO_LSL)
 #undef DO_ZPZW
 
 /* Fully general two-operand expander, controlled by a predicate.
+ * As with DO_ZPZZ, 16 bytes are computed at a time and merged.
  */
 #define DO_ZPZ(NAME, TYPE, H, OP)                               \
 void HELPER(NAME)(void *vd, void *vn, void *vg, uint32_t desc)  \
 {                                                               \
-    intptr_t i, opr_sz = simd_oprsz(desc);                      \
-    for (i = 0; i < opr_sz; ) {                                 \
+    intptr_t i, j, opr_sz = simd_oprsz(desc);                   \
+    for (i = 0; i < opr_sz; i += 16) {                          \
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));         \
-        do {                                                    \
-            if (pg & 1) {                                       \
-                TYPE nn = *(TYPE *)(vn + H(i));                 \
-                *(TYPE *)(vd + H(i)) = OP(nn);                  \
-            }                                                   \
-            i += sizeof(TYPE), pg >>= sizeof(TYPE);             \
-        } while (i & 15);                                       \
+        TYPE nn[16 / sizeof(TYPE)], dd[16 / sizeof(TYPE)];      \
+        if (!(pg & PRED_ACTIVE16(TYPE))) {                      \
+            continue;                                           \
+        }                                                       \
+        memcpy(nn, vn + i, 16);                                 \
+        for (j = 0; j < 16 / sizeof(TYPE); j++) {               \
+            dd[j] = OP(nn[j]);                                  \
+        }                                                       \
+        merge_pred16(vd + i, dd, pg, ctz32(sizeof(TYPE)));      \
     }                                                           \
 }
 
@@ -5773,49 +5824,96 @@ static void sve_cont_ldst_watchpoints(SVEContLdSt *info, CPUARMState *env,
 #endif
 }
 
+/*
+ * Check the tags for the active elements from REG_OFF to REG_LAST,
+ * with one mte_check for each run of consecutive active elements
+ * rather than one per element; a fully active predicate takes a single
+ * check.  The first granule that fails is the same either way.
+ */
+static void sve_cont_ldst_mte_check1(CPUARMState *env, uint64_t *vg,
+                                     target_ulong addr, intptr_t reg_off,
+                                     intptr_t reg_last, intptr_t mem_off,
+                                     int esize, int msize, uint32_t mtedesc,
+                                     uintptr_t ra)
+{
+    intptr_t run_off = -1;
+
+    for (; reg_off <= reg_last; reg_off += esize, mem_off += msize) {
+        if ((vg[reg_off >> 6] >> (reg_off & 63)) & 1) {
+            if (run_off < 0) {
+                run_off = mem_off;
+            }
+        } else if (run_off >= 0) {
+            mte_check(env, FIELD_DP32(mtedesc, MTEDESC, SIZEM1,
+                                      mem_off - run_off - 1),
+                      addr + run_off, ra);
+            run_off = -1;
+        }
+    }
+    if (run_off >= 0) {
+        mte_check(env, FIELD_DP32(mtedesc, MTEDESC, SIZEM1,
+                                  mem_off - run_off - 1),
+                  addr + run_off, ra);
+    }
+}
+
 static void sve_cont_ldst_mte_check(SVEContLdSt *info, CPUARMState *env,
                                     uint64_t *vg, target_ulong addr, int esize,
                                     int msize, uint32_t mtedesc, uintptr_t ra)
 {
-    intptr_t mem_off, reg_off, reg_last;
+    intptr_t reg_last;
 
     /* Process the page only if MemAttr == Tagged. */
     if (arm_tlb_mte_tagged(&info->page[0].attrs)) {
-        mem_off = info->mem_off_first[0];
-        reg_off = info->reg_off_first[0];
         reg_last = info->reg_off_split;
         if (reg_last < 0) {
             reg_last = info->reg_off_last[0];
         }
+        sve_cont_ldst_mte_check1(env, vg, addr, info->reg_off_first[0],
+                                 reg_last, info->mem_off_first[0],
+                                 esize, msize, mtedesc, ra);
+    }
 
-        do {
-            uint64_t pg = vg[reg_off >> 6];
-            do {
-                if ((pg >> (reg_off & 63)) & 1) {
-                    mte_check(env, mtedesc, addr, ra);
-                }
-                reg_off += esize;
-                mem_off += msize;
-            } while (reg_off <= reg_last && (reg_off & 63));
-        } while (reg_off <= reg_last);
+    if (info->mem_off_first[1] >= 0 &&
+        arm_tlb_mte_tagged(&info->page[1].attrs)) {
+        sve_cont_ldst_mte_check1(env, vg, addr, info->reg_off_first[1],
+                                 info->reg_off_last[1],
+                                 info->mem_off_first[1],
+                                 esize, msize, mtedesc, ra);
     }
+}
 
-    mem_off = info->mem_off_first[1];
-    if (mem_off >= 0 && arm_tlb_mte_tagged(&info->page[1].attrs)) {
-        reg_off = info->reg_off_first[1];
-        reg_last = info->reg_off_last[1];
+/*
+ * Load the elements from REG_OFF to REG_LAST inclusive of a contiguous
+ * load of one register without extension, from host memory starting at
+ * HOST, with a single copy.  The inactive elements in between are read
+ * too and then zeroed through the predicate, which is fine as the range
+ * is within one page of RAM that has been probed.  The caller must check
+ * that REG_OFF <= REG_LAST.  Returns false when the register layout does
+ * not match memory, i.e. on big-endian hosts or for multi-byte elements
+ * of big-endian data (END is MO_LE or MO_BE), leaving it to the
+ * per-element loop.
+ */
+static inline bool sve_ld1_host_copy(void *vd, void *vg, void *host,
+                                     intptr_t reg_off, intptr_t reg_last,
+                                     int esz, MemOp end)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return false;
+#else
+    intptr_t reg_end = reg_last + (1 << esz);
+    intptr_t i;
 
-        do {
-            uint64_t pg = vg[reg_off >> 6];
-            do {
-                if ((pg >> (reg_off & 63)) & 1) {
-                    mte_check(env, mtedesc, addr, ra);
-                }
-                reg_off += esize;
-                mem_off += msize;
-            } while (reg_off & 63);
-        } while (reg_off <= reg_last);
+    if (esz != MO_8 && end != MO_LE) {
+        return false;
+    }
+    memcpy(vd + reg_off, host, reg_end - reg_off);
+    for (i = reg_off & ~7; i < reg_end; i += 8) {
+        *(uint64_t *)(vd + i) &= expand_pred_esz(*(uint8_t *)(vg + (i >> 3)),
+                                                 esz);
     }
+    return true;
+#endif
 }
 
 /*
@@ -5824,8 +5922,8 @@ static void sve_cont_ldst_mte_check(SVEContLdSt *info, CPUARMState *env,
 static inline QEMU_ALWAYS_INLINE
 void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
                uint32_t desc, const uintptr_t retaddr,
-               const int esz, const int msz, const int N, uint32_t mtedesc,
-               sve_ldst1_host_fn *host_fn,
+               const int esz, const int msz, const MemOp end, const int N,
+               uint32_t mtedesc, sve_ldst1_host_fn *host_fn,
                sve_ldst1_tlb_fn *tlb_fn)
 {
     const unsigned rd = simd_data(desc);
@@ -5915,6 +6013,12 @@ void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
     reg_last = info.reg_off_last[0];
     host = info.page[0].host;
 
+    if (N == 1 && esz == msz && reg_off <= reg_last &&
+        sve_ld1_host_copy(&env->vfp.zregs[rd], vg, host + mem_off,
+                          reg_off, reg_last, esz, end)) {
+        reg_off = reg_last + 1;
+    }
+
     while (reg_off <= reg_last) {
         uint64_t pg = vg[reg_off >> 6];
         do {
@@ -5948,6 +6052,12 @@ void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
         reg_last = info.reg_off_last[1];
         host = info.page[1].host;
 
+        if (N == 1 && esz == msz &&
+            sve_ld1_host_copy(&env->vfp.zregs[rd], vg, host + mem_off,
+                              reg_off, reg_last, esz, end)) {
+            return;
+        }
+
         do {
             uint64_t pg = vg[reg_off >> 6];
             do {
@@ -5967,7 +6077,7 @@ void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
 static inline QEMU_ALWAYS_INLINE
 void sve_ldN_r_mte(CPUARMState *env, uint64_t *vg, target_ulong addr,
                    uint32_t desc, const uintptr_t ra,
-                   const int esz, const int msz, const int N,
+                   const int esz, const int msz, const MemOp end, const int N,
                    sve_ldst1_host_fn *host_fn,
                    sve_ldst1_tlb_fn *tlb_fn)
 {
@@ -5983,20 +6093,21 @@ void sve_ldN_r_mte(CPUARMState *env, uint64_t *vg, target_ulong addr,
         mtedesc = 0;
     }
 
-    sve_ldN_r(env, vg, addr, desc, ra, esz, msz, N, mtedesc, host_fn, tlb_fn);
+    sve_ldN_r(env, vg, addr, desc, ra, esz, msz, end, N, mtedesc,
+              host_fn, tlb_fn);
 }
 
 #define DO_LD1_1(NAME, ESZ)                                             \
 void HELPER(sve_##NAME##_r)(CPUARMState *env, void *vg,                 \
                             target_ulong addr, uint32_t desc)           \
 {                                                                       \
-    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, MO_8, 1, 0,            \
+    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, MO_8, MO_LE, 1, 0,     \
               sve_##NAME##_host, sve_##NAME##_tlb);                     \
 }                                                                       \
 void HELPER(sve_##NAME##_r_mte)(CPUARMState *env, void *vg,             \
                                 target_ulong addr, uint32_t desc)       \
 {                                                                       \
-    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, MO_8, 1,           \
+    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, MO_8, MO_LE, 1,    \
                   sve_##NAME##_host, sve_##NAME##_tlb);                 \
 }
 
@@ -6004,25 +6115,25 @@ void HELPER(sve_##NAME##_r_mte)(CPUARMState *env, void *vg,             \
 void HELPER(sve_##NAME##_le_r)(CPUARMState *env, void *vg,              \
                                target_ulong addr, uint32_t desc)        \
 {                                                                       \
-    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, MSZ, 1, 0,             \
+    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_LE, 1, 0,      \
               sve_##NAME##_le_host, sve_##NAME##_le_tlb);               \
 }                                                                       \
 void HELPER(sve_##NAME##_be_r)(CPUARMState *env, void *vg,              \
                                target_ulong addr, uint32_t desc)        \
 {                                                                       \
-    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, MSZ, 1, 0,             \
+    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_BE, 1, 0,      \
               sve_##NAME##_be_host, sve_##NAME##_be_tlb);               \
 }                                                                       \
 void HELPER(sve_##NAME##_le_r_mte)(CPUARMState *env, void *vg,          \
                                    target_ulong addr, uint32_t desc)    \
 {                                                                       \
-    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, 1,            \
+    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_LE, 1,     \
                   sve_##NAME##_le_host, sve_##NAME##_le_tlb);           \
 }                                                                       \
 void HELPER(sve_##NAME##_be_r_mte)(CPUARMState *env, void *vg,          \
                                    target_ulong addr, uint32_t desc)    \
 {                                                                       \
-    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, 1,            \
+    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_BE, 1,     \
                   sve_##NAME##_be_host, sve_##NAME##_be_tlb);           \
 }
 
@@ -6053,13 +6164,13 @@ DO_LD1_2(ld1dd,  MO_64, MO_64)
 void HELPER(sve_ld##N##bb_r)(CPUARMState *env, void *vg,                \
                              target_ulong addr, uint32_t desc)          \
 {                                                                       \
-    sve_ldN_r(env, vg, addr, desc, GETPC(), MO_8, MO_8, N, 0,           \
+    sve_ldN_r(env, vg, addr, desc, GETPC(), MO_8, MO_8, MO_LE, N, 0,    \
               sve_ld1bb_host, sve_ld1bb_tlb);                           \
 }                                                                       \
 void HELPER(sve_ld##N##bb_r_mte)(CPUARMState *env, void *vg,            \
                                  target_ulong addr, uint32_t desc)      \
 {                                                                       \
-    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), MO_8, MO_8, N,          \
+    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), MO_8, MO_8, MO_LE, N,   \
                   sve_ld1bb_host, sve_ld1bb_tlb);                       \
 }
 
@@ -6067,25 +6178,25 @@ void HELPER(sve_ld##N##bb_r_mte)(CPUARMState *env, void *vg,            \
 void HELPER(sve_ld##N##SUFF##_le_r)(CPUARMState *env, void *vg,         \
                                     target_ulong addr, uint32_t desc)   \
 {                                                                       \
-    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, ESZ, N, 0,             \
+    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, ESZ, MO_LE, N, 0,      \
               sve_ld1##SUFF##_le_host, sve_ld1##SUFF##_le_tlb);         \
 }                                                                       \
 void HELPER(sve_ld##N##SUFF##_be_r)(CPUARMState *env, void *vg,         \
                                     target_ulong addr, uint32_t desc)   \
 {                                                                       \
-    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, ESZ, N, 0,             \
+    sve_ldN_r(env, vg, addr, desc, GETPC(), ESZ, ESZ, MO_BE, N, 0,      \
               sve_ld1##SUFF##_be_host, sve_ld1##SUFF##_be_tlb);         \
 }                                                                       \
 void HELPER(sve_ld##N##SUFF##_le_r_mte)(CPUARMState *env, void *vg,     \
                                         target_ulong addr, uint32_t desc) \
 {                                                                       \
-    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, ESZ, N,            \
+    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, ESZ, MO_LE, N,     \
                   sve_ld1##SUFF##_le_host, sve_ld1##SUFF##_le_tlb);     \
 }                                                                       \
 void HELPER(sve_ld##N##SUFF##_be_r_mte)(CPUARMState *env, void *vg,     \
                                         target_ulong addr, uint32_t desc) \
 {                                                                       \
-    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, ESZ, N,            \
+    sve_ldN_r_mte(env, vg, addr, desc, GETPC(), ESZ, ESZ, MO_BE, N,     \
                   sve_ld1##SUFF##_be_host, sve_ld1##SUFF##_be_tlb);     \
 }
 
@@ -6145,8 +6256,8 @@ static void record_fault(CPUARMState *env, uintptr_t i, uintptr_t oprsz)
 static inline QEMU_ALWAYS_INLINE
 void sve_ldnfff1_r(CPUARMState *env, void *vg, const target_ulong addr,
                    uint32_t desc, const uintptr_t retaddr, uint32_t mtedesc,
-                   const int esz, const int msz, const SVEContFault fault,
-                   sve_ldst1_host_fn *host_fn,
+                   const int esz, const int msz, const MemOp end,
+                   const SVEContFault fault, sve_ldst1_host_fn *host_fn,
                    sve_ldst1_tlb_fn *tlb_fn)
 {
     const unsigned rd = simd_data(desc);
@@ -6270,7 +6381,18 @@ void sve_ldnfff1_r(CPUARMState *env, void *vg, const target_ulong addr,
     reg_last = info.reg_off_last[0];
     host = info.page[0].host;
 
-    do {
+    /*
+     * Without watchpoints or MTE on the page no element can fault, so
+     * the per-element checks below are not needed.
+     */
+    if (!(flags & TLB_WATCHPOINT) && !mtedesc && esz == msz &&
+        reg_off <= reg_last &&
+        sve_ld1_host_copy(vd, vg, host + mem_off, reg_off, reg_last,
+                          esz, end)) {
+        reg_off = reg_last + 1;
+    }
+
+    while (reg_off <= reg_last) {
         uint64_t pg = *(uint64_t *)(vg + (reg_off >> 3));
         do {
             if ((pg >> (reg_off & 63)) & 1) {
@@ -6288,7 +6410,7 @@ void sve_ldnfff1_r(CPUARMState *env, void *vg, const target_ulong addr,
             reg_off += 1 << esz;
             mem_off += 1 << msz;
         } while (reg_off <= reg_last && (reg_off & 63));
-    } while (reg_off <= reg_last);
+    }
 
     /*
      * MemSingleNF is allowed to fail for any reason.  We have special
@@ -6323,8 +6445,8 @@ void sve_ldnfff1_r(CPUARMState *env, void *vg, const target_ulong addr,
 static inline QEMU_ALWAYS_INLINE
 void sve_ldnfff1_r_mte(CPUARMState *env, void *vg, target_ulong addr,
                        uint32_t desc, const uintptr_t retaddr,
-                       const int esz, const int msz, const SVEContFault fault,
-                       sve_ldst1_host_fn *host_fn,
+                       const int esz, const int msz, const MemOp end,
+                       const SVEContFault fault, sve_ldst1_host_fn *host_fn,
                        sve_ldst1_tlb_fn *tlb_fn)
 {
     uint32_t mtedesc = desc >> (SIMD_DATA_SHIFT + SVE_MTEDESC_SHIFT);
@@ -6340,83 +6462,95 @@ void sve_ldnfff1_r_mte(CPUARMState *env, void *vg, target_ulong addr,
     }
 
     sve_ldnfff1_r(env, vg, addr, desc, retaddr, mtedesc,
-                  esz, msz, fault, host_fn, tlb_fn);
+                  esz, msz, end, fault, host_fn, tlb_fn);
 }
 
 #define DO_LDFF1_LDNF1_1(PART, ESZ)                                     \
 void HELPER(sve_ldff1##PART##_r)(CPUARMState *env, void *vg,            \
                                  target_ulong addr, uint32_t desc)      \
 {                                                                       \
-    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MO_8, FAULT_FIRST, \
-                  sve_ld1##PART##_host, sve_ld1##PART##_tlb);           \
+    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MO_8, MO_LE,    \
+                  FAULT_FIRST, sve_ld1##PART##_host,                    \
+                  sve_ld1##PART##_tlb);                                 \
 }                                                                       \
 void HELPER(sve_ldnf1##PART##_r)(CPUARMState *env, void *vg,            \
                                  target_ulong addr, uint32_t desc)      \
 {                                                                       \
-    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MO_8, FAULT_NO, \
-                  sve_ld1##PART##_host, sve_ld1##PART##_tlb);           \
+    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MO_8, MO_LE,    \
+                  FAULT_NO, sve_ld1##PART##_host,                       \
+                  sve_ld1##PART##_tlb);                                 \
 }                                                                       \
 void HELPER(sve_ldff1##PART##_r_mte)(CPUARMState *env, void *vg,        \
                                      target_ulong addr, uint32_t desc)  \
 {                                                                       \
-    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MO_8, FAULT_FIRST, \
-                      sve_ld1##PART##_host, sve_ld1##PART##_tlb);       \
+    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MO_8, MO_LE,   \
+                      FAULT_FIRST, sve_ld1##PART##_host,                \
+                      sve_ld1##PART##_tlb);                             \
 }                                                                       \
 void HELPER(sve_ldnf1##PART##_r_mte)(CPUARMState *env, void *vg,        \
                                      target_ulong addr, uint32_t desc)  \
 {                                                                       \
-    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MO_8, FAULT_NO, \
-                  sve_ld1##PART##_host, sve_ld1##PART##_tlb);           \
+    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MO_8, MO_LE,   \
+                      FAULT_NO, sve_ld1##PART##_host,                   \
+                      sve_ld1##PART##_tlb);                             \
 }
 
 #define DO_LDFF1_LDNF1_2(PART, ESZ, MSZ)                                \
 void HELPER(sve_ldff1##PART##_le_r)(CPUARMState *env, void *vg,         \
                                     target_ulong addr, uint32_t desc)   \
 {                                                                       \
-    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, FAULT_FIRST, \
-                  sve_ld1##PART##_le_host, sve_ld1##PART##_le_tlb);     \
+    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, MO_LE,     \
+                  FAULT_FIRST, sve_ld1##PART##_le_host,                 \
+                  sve_ld1##PART##_le_tlb);                              \
 }                                                                       \
 void HELPER(sve_ldnf1##PART##_le_r)(CPUARMState *env, void *vg,         \
                                     target_ulong addr, uint32_t desc)   \
 {                                                                       \
-    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, FAULT_NO,  \
-                  sve_ld1##PART##_le_host, sve_ld1##PART##_le_tlb);     \
+    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, MO_LE,     \
+                  FAULT_NO, sve_ld1##PART##_le_host,                    \
+                  sve_ld1##PART##_le_tlb);                              \
 }                                                                       \
 void HELPER(sve_ldff1##PART##_be_r)(CPUARMState *env, void *vg,         \
                                     target_ulong addr, uint32_t desc)   \
 {                                                                       \
-    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, FAULT_FIRST, \
-                  sve_ld1##PART##_be_host, sve_ld1##PART##_be_tlb);     \
+    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, MO_BE,     \
+                  FAULT_FIRST, sve_ld1##PART##_be_host,                 \
+                  sve_ld1##PART##_be_tlb);                              \
 }                                                                       \
 void HELPER(sve_ldnf1##PART##_be_r)(CPUARMState *env, void *vg,         \
                                     target_ulong addr, uint32_t desc)   \
 {                                                                       \
-    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, FAULT_NO,  \
-                  sve_ld1##PART##_be_host, sve_ld1##PART##_be_tlb);     \
+    sve_ldnfff1_r(env, vg, addr, desc, GETPC(), 0, ESZ, MSZ, MO_BE,     \
+                  FAULT_NO, sve_ld1##PART##_be_host,                    \
+                  sve_ld1##PART##_be_tlb);                              \
 }                                                                       \
 void HELPER(sve_ldff1##PART##_le_r_mte)(CPUARMState *env, void *vg,     \
                                         target_ulong addr, uint32_t desc) \
 {                                                                       \
-    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, FAULT_FIRST, \
-                      sve_ld1##PART##_le_host, sve_ld1##PART##_le_tlb); \
+    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_LE,    \
+                      FAULT_FIRST, sve_ld1##PART##_le_host,             \
+                      sve_ld1##PART##_le_tlb);                          \
 }                                                                       \
 void HELPER(sve_ldnf1##PART##_le_r_mte)(CPUARMState *env, void *vg,     \
                                         target_ulong addr, uint32_t desc) \
 {                                                                       \
-    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, FAULT_NO, \
-                      sve_ld1##PART##_le_host, sve_ld1##PART##_le_tlb); \
+    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_LE,    \
+                      FAULT_NO, sve_ld1##PART##_le_host,                \
+                      sve_ld1##PART##_le_tlb);                          \
 }                                                                       \
 void HELPER(sve_ldff1##PART##_be_r_mte)(CPUARMState *env, void *vg,     \
                                         target_ulong addr, uint32_t desc) \
 {                                                                       \
-    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, FAULT_FIRST, \
-                      sve_ld1##PART##_be_host, sve_ld1##PART##_be_tlb); \
+    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_BE,    \
+                      FAULT_FIRST, sve_ld1##PART##_be_host,             \
+                      sve_ld1##PART##_be_tlb);                          \
 }                                                                       \
 void HELPER(sve_ldnf1##PART##_be_r_mte)(CPUARMState *env, void *vg,     \
                                         target_ulong addr, uint32_t desc) \
 {                                                                       \
-    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, FAULT_NO, \
-                      sve_ld1##PART##_be_host, sve_ld1##PART##_be_tlb); \
+    sve_ldnfff1_r_mte(env, vg, addr, desc, GETPC(), ESZ, MSZ, MO_BE,    \
+                      FAULT_NO, sve_ld1##PART##_be_host,                \
+                      sve_ld1##PART##_be_tlb);                          \
 }
 
 DO_LDFF1_LDNF1_1(bb,  MO_8)
@@ -1553,6 +1553,18 @@ static void handle_sync(DisasContext *s, uint32_t insn,
             break;
         }
         tcg_gen_mb(bar);
+#ifndef CONFIG_USER_ONLY
+        if (op2 == 4) {
+            /*
+             * Complete the TLB maintenance queued since the last DSB,
+             * and break the TB so that a broadcast flush has done its
+             * work on this vCPU too before the next insn.
+             */
+            gen_helper_tlb_batch_commit(cpu_env);
+            reset_btype(s);
+            gen_goto_tb(s, 0, s->base.pc_next);
+        }
+#endif
         return;
     case 6: /* ISB */
         /* We need to break the TB after this insn to execute
@@ -76,6 +76,8 @@ void arm_translate_init(void)
                                           offsetof(CPUARMState, regs[i]),
                                           regnames[i]);
     }
+    /* Spills and reloads through SP can be forwarded. */
+    tcg_set_fwd_base(cpu_R[13]);
     cpu_CF = tcg_global_mem_new_i32(cpu_env, offsetof(CPUARMState, CF), "CF");
     cpu_NF = tcg_global_mem_new_i32(cpu_env, offsetof(CPUARMState, NF), "NF");
     cpu_VF = tcg_global_mem_new_i32(cpu_env, offsetof(CPUARMState, VF), "VF");
@@ -2569,6 +2571,7 @@ static void gen_goto_tb(DisasContext *s, int n, target_ulong dest)
         tcg_gen_goto_tb(n);
         gen_set_pc_im(s, dest);
         tcg_gen_exit_tb(s->base.tb, n);
+        s->base.tb->jmp_pc[n] = dest;
     } else {
         gen_set_pc_im(s, dest);
         gen_goto_ptr();
@@ -2625,6 +2628,32 @@ static inline void gen_jmp(DisasContext *s, uint32_t dest)
     gen_jmp_tb(s, dest, 0);
 }
 
+/*
+ * When retranslating a hot TB with CF_SUPERBLOCK, carry on at the target
+ * of an unconditional direct branch instead of ending the TB.  Only go
+ * forward within the page, so that [pc_first, pc_next) still covers all
+ * of the code in the TB for invalidation purposes.
+ */
+static void gen_jmp_superblock(DisasContext *s, uint32_t dest)
+{
+    uint32_t page_end = s->page_start + TARGET_PAGE_SIZE;
+
+    if (!(tcg_ctx->tb_cflags & CF_SUPERBLOCK) ||
+        s->base.is_jmp != DISAS_NEXT || s->condjmp || s->condexec_mask ||
+        s->eci || s->ss_active ||
+        dest < s->base.pc_next || dest >= page_end) {
+        gen_jmp(s, dest);
+        return;
+    }
+
+    s->base.pc_next = dest;
+    if (!s->thumb) {
+        /* Keep within the page, as arm_tr_init_disas_context does. */
+        int bound = (page_end - dest) / 4;
+        s->base.max_insns = MIN(s->base.max_insns, s->base.num_insns + bound);
+    }
+}
+
 static inline void gen_mulxy(TCGv_i32 t0, TCGv_i32 t1, int x, int y)
 {
     if (x)
@@ -4754,6 +4783,12 @@ static void do_coproc_insn(DisasContext *s, int cpnum, int is64,
         /* Handle special cases first */
         switch (ri->type & ~(ARM_CP_FLAG_MASK & ~ARM_CP_SPECIAL)) {
         case ARM_CP_NOP:
+            /*
+             * Cache maintenance and the like: unless an access check was
+             * emitted above, this generates no code at all and the TB
+             * goes on, which matters for the pre-v7 cores whose whole c7
+             * space is one wildcard NOP.
+             */
             return;
         case ARM_CP_WFI:
             if (isread) {
@@ -8089,6 +8124,32 @@ static void op_addr_block_post(DisasContext *s, arg_ldst_block *a,
     }
 }
 
+/*
+ * Below this many registers, the inline TLB check for each word is
+ * cheaper than calling the ldm/stm helpers.
+ */
+#define BLOCK_HELPER_MIN_REGS 4
+
+/* Transfer a plain register list with the ldm/stm helpers. */
+static void gen_block_helper(DisasContext *s, TCGv_i32 addr, int list, int n,
+                             bool is_load)
+{
+    MemOp opc = finalize_memop(s, MO_UL | MO_ALIGN);
+    TCGv_i32 tlist = tcg_const_i32(list);
+    TCGv_i32 toi = tcg_const_i32(make_memop_idx(opc, get_mem_index(s)));
+
+    if (is_load) {
+        gen_helper_ldm(cpu_env, addr, tlist, toi);
+    } else {
+        gen_helper_stm(cpu_env, addr, tlist, toi);
+    }
+    tcg_temp_free_i32(toi);
+    tcg_temp_free_i32(tlist);
+
+    /* Leave addr at the last word, as the per-register loops do. */
+    tcg_gen_addi_i32(addr, addr, (n - 1) * 4);
+}
+
 static bool op_stm(DisasContext *s, arg_ldst_block *a, int min_n)
 {
     int i, j, n, list, mem_idx;
@@ -8116,6 +8177,13 @@ static bool op_stm(DisasContext *s, arg_ldst_block *a, int min_n)
     addr = op_addr_block_pre(s, a, n);
     mem_idx = get_mem_index(s);
 
+    if (n >= BLOCK_HELPER_MIN_REGS && !user && !(list & (1 << 15))) {
+        gen_block_helper(s, addr, list, n, false);
+        op_addr_block_post(s, a, addr, n);
+        clear_eci_state(s);
+        return true;
+    }
+
     for (i = j = 0; i < 16; i++) {
         if (!(list & (1 << i))) {
             continue;
@@ -8201,6 +8269,20 @@ static bool do_ldm(DisasContext *s, arg_ldst_block *a, int min_n)
     loaded_base = false;
     loaded_var = NULL;
 
+    /*
+     * The helper writes env->regs[] directly, so leave the PC, the
+     * base register and the M-profile SP (which store_reg masks) to
+     * the loop below.
+     */
+    if (n >= BLOCK_HELPER_MIN_REGS && !user && !exc_return &&
+        !(list & ((1 << 15) | (1 << a->rn))) &&
+        !(arm_dc_feature(s, ARM_FEATURE_M) && (list & (1 << 13)))) {
+        gen_block_helper(s, addr, list, n, true);
+        op_addr_block_post(s, a, addr, n);
+        clear_eci_state(s);
+        return true;
+    }
+
     for (i = j = 0; i < 16; i++) {
         if (!(list & (1 << i))) {
             continue;
@@ -8331,7 +8413,7 @@ static bool trans_CLRM(DisasContext *s, arg_CLRM *a)
 
 static bool trans_B(DisasContext *s, arg_i *a)
 {
-    gen_jmp(s, read_pc(s) + a->imm);
+    gen_jmp_superblock(s, read_pc(s) + a->imm);
     return true;
 }
 
@@ -8353,7 +8435,7 @@ static bool trans_B_cond_thumb(DisasContext *s, arg_ci *a)
 static bool trans_BL(DisasContext *s, arg_i *a)
 {
     tcg_gen_movi_i32(cpu_R[14], s->base.pc_next | s->thumb);
-    gen_jmp(s, read_pc(s) + a->imm);
+    gen_jmp_superblock(s, read_pc(s) + a->imm);
     return true;
 }
 
@@ -8930,12 +9012,27 @@ static bool trans_DSB(DisasContext *s, arg_DSB *a)
         return false;
     }
     tcg_gen_mb(TCG_MO_ALL | TCG_BAR_SC);
+#ifndef CONFIG_USER_ONLY
+    if (!arm_dc_feature(s, ARM_FEATURE_M)) {
+        /*
+         * Complete the TLB maintenance queued since the last DSB, and
+         * break the TB so that a broadcast flush has done its work on
+         * this vCPU too before the next insn.
+         */
+        gen_helper_tlb_batch_commit(cpu_env);
+        s->base.is_jmp = DISAS_TOO_MANY;
+    }
+#endif
     return true;
 }
 
 static bool trans_DMB(DisasContext *s, arg_DMB *a)
 {
-    return trans_DSB(s, NULL);
+    if (!ENABLE_ARCH_7 && !arm_dc_feature(s, ARM_FEATURE_M)) {
+        return false;
+    }
+    tcg_gen_mb(TCG_MO_ALL | TCG_BAR_SC);
+    return true;
 }
 
 static bool trans_ISB(DisasContext *s, arg_ISB *a)
@@ -9332,6 +9429,7 @@ static void arm_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
     uint32_t condexec, core_mmu_idx;
 
     dc->isar = &cpu->isar;
+    dc->copy_loops = cpu->copy_loops;
     dc->condjmp = 0;
 
     dc->aarch64 = 0;
@@ -9544,6 +9642,105 @@ static void arm_post_translate_insn(DisasContext *dc)
     translator_loop_temp_check(&dc->base);
 }
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * Match the A32 "ldmia rS!, {list}" / "ldrd rT, [rS], #8" transfer at
+ * the head of a copy loop, or the matching store form.
+ */
+static bool copy_loop_xfer(DisasContext *s, uint32_t insn, bool load,
+                           int *base, int *list)
+{
+    int rt = extract32(insn, 12, 4);
+
+    if (extract32(insn, 28, 4) != 0xe) {
+        return false;
+    }
+    if ((insn & 0x0ff00000) == (load ? 0x08b00000 : 0x08a00000)) {
+        *list = insn & 0xffff;
+    } else if ((insn & 0x0ff000f0) == (load ? 0x00c000d0 : 0x00c000f0) &&
+               ENABLE_ARCH_5TE && (insn & 0xf0f) == 8 &&
+               !(rt & 1) && rt < 14) {
+        *list = 3 << rt;
+    } else {
+        return false;
+    }
+    *base = extract32(insn, 16, 4);
+    return *list != 0;
+}
+
+/*
+ * With the x-copy-loops CPU property, recognise a TB that starts with
+ * one of
+ *
+ *   loop: ldmia rS!, {list}            loop: stmia rD!, {list}
+ *         stmia rD!, {list}                  subs  rC, rC, #step
+ *         subs  rC, rC, #step                b<cond> loop
+ *         b<cond> loop
+ *
+ * (or the LDRD/STRD post-indexed equivalents), with cond one of NE, CS,
+ * HI, GE and GT, and let helper_copy_loop run most of the iterations as
+ * a host memmove or memset before the body is executed normally.
+ */
+static void gen_copy_loop(DisasContext *s, CPUARMState *env)
+{
+    target_ulong pc = s->base.pc_first;
+    int i, n, src = 16, dst, cnt, cond, list, slist;
+    uint32_t insn[4], step, used, desc;
+    bool fill;
+
+    if (!s->copy_loops || s->ss_active ||
+        (tb_cflags(s->base.tb) & CF_USE_ICOUNT) ||
+        s->base.max_insns < ARRAY_SIZE(insn) ||
+        -(pc | TARGET_PAGE_MASK) < sizeof(insn)) {
+        return;
+    }
+    for (i = 0; i < ARRAY_SIZE(insn); i++) {
+        insn[i] = cpu_ldl_code(env, pc + i * 4);
+        if (bswap_code(s->sctlr_b)) {
+            insn[i] = bswap32(insn[i]);
+        }
+    }
+
+    n = copy_loop_xfer(s, insn[0], true, &src, &list);
+    if (!copy_loop_xfer(s, insn[n], false, &dst, &slist) ||
+        (n && slist != list)) {
+        return;
+    }
+    fill = !n;
+    list = slist;
+
+    /* subs rC, rC, #step */
+    if ((insn[n + 1] & 0xfff00000) != 0xe2500000 ||
+        extract32(insn[n + 1], 12, 4) != extract32(insn[n + 1], 16, 4)) {
+        return;
+    }
+    cnt = extract32(insn[n + 1], 16, 4);
+    step = ror32(extract32(insn[n + 1], 0, 8), extract32(insn[n + 1], 8, 4) * 2);
+
+    /* b<cond> loop */
+    cond = extract32(insn[n + 2], 28, 4);
+    if ((insn[n + 2] & 0x0f000000) != 0x0a000000 ||
+        pc + (n + 2) * 4 + 8 + (sextract32(insn[n + 2], 0, 24) << 2) != pc ||
+        !(cond == 0x1 || cond == 0x2 || cond == 0x8 ||
+          cond == 0xa || cond == 0xc)) {
+        return;
+    }
+
+    /* The pointers and the counter must be distinct from the data. */
+    used = list | (1 << dst) | (1 << cnt) | (fill ? 0 : 1 << src);
+    if (step == 0 || step >= 0x10000 || (used & (1 << 15)) ||
+        ctpop32(used) != ctpop32(list) + (fill ? 2 : 3)) {
+        return;
+    }
+
+    desc = (fill ? 0 : src) | dst << 4 | cnt << 8 | cond << 12 |
+           fill << 16 | (s->be_data == MO_BE) << 17 |
+           get_mem_index(s) << 20;
+    gen_helper_copy_loop(cpu_env, tcg_constant_i32(desc),
+                         tcg_constant_i32(list), tcg_constant_i32(step));
+}
+#endif
+
 static void arm_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *dc = container_of(dcbase, DisasContext, base);
@@ -9555,6 +9752,12 @@ static void arm_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
         return;
     }
 
+#ifndef CONFIG_USER_ONLY
+    if (dc->base.num_insns == 1) {
+        gen_copy_loop(dc, env);
+    }
+#endif
+
     dc->pc_curr = dc->base.pc_next;
     insn = arm_ldl_code(env, &dc->base, dc->base.pc_next, dc->sctlr_b);
     dc->insn = insn;
@@ -9804,10 +10007,15 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             break;
         case DISAS_UPDATE_NOCHAIN:
             gen_set_pc_im(dc, dc->base.pc_next);
-            /* fall through */
-        case DISAS_JUMP:
             gen_goto_ptr();
             break;
+        case DISAS_JUMP:
+            /*
+             * bx lr, pop {pc}, ldr pc, [...] and friends: returns mostly
+             * go back to the same caller, so remember the last target.
+             */
+            tcg_gen_lookup_and_goto_ptr_cached(dc->base.tb);
+            break;
         case DISAS_UPDATE_EXIT:
             gen_set_pc_im(dc, dc->base.pc_next);
             /* fall through */
@@ -98,6 +98,8 @@ typedef struct DisasContext {
     bool hstr_active;
     /* True if memory operations require alignment */
     bool align_mem;
+    /* True if copy and fill loops may be run by helper_copy_loop */
+    bool copy_loops;
     /* True if PSTATE.IL is set */
     bool pstate_il;
     /* True if MVE insns are definitely not predicated by VPR or LTPSIZE */
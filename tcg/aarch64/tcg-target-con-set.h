@@ -31,6 +31,8 @@ C_O1_I2(w, w, w)
 C_O1_I2(w, w, wN)
 C_O1_I2(w, w, wO)
 C_O1_I2(w, w, wZ)
+C_N1_I2(r, a, aZ)
+C_O1_I3(a, a, 0, aZ)
 C_O1_I3(w, w, w, w)
 C_O1_I4(r, r, rA, rZ, rZ)
 C_O2_I4(r, r, rZ, rZ, rA, rMZ)
@@ -8,6 +8,7 @@
  * Define constraint letters for register sets:
  * REGS(letter, register_mask)
  */
+REGS('a', ALL_ATOMIC_REGS)
 REGS('r', ALL_GENERAL_REGS)
 REGS('l', ALL_QLDST_REGS)
 REGS('w', ALL_VECTOR_REGS)
@@ -231,6 +231,7 @@ static inline void tb_target_set_jmp_target(uintptr_t tc_ptr, uintptr_t jmp_rx,
 #define TCG_TARGET_DEFAULT_MO (TCG_MO_ALL & ~TCG_MO_ST_LD)
 
 #define TCG_TARGET_HAS_MEMORY_BSWAP  have_movbe
+#define TCG_TARGET_HAS_qemu_atomic   0
 
 #ifdef CONFIG_SOFTMMU
 #define TCG_TARGET_NEED_LDST_LABELS
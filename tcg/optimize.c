@@ -44,17 +44,46 @@ typedef struct TempOptInfo {
     uint64_t val;
     uint64_t z_mask;  /* mask bit is 0 if and only if value bit is 0 */
     uint64_t s_mask;  /* a left-aligned mask of clrsb(value) bits. */
+    uint32_t gen;     /* bumped each time the temp is redefined */
+    /* If addr_base, the value is addr_base as of addr_gen, plus addr_ofs. */
+    TCGTemp *addr_base;
+    uint32_t addr_gen;
+    int64_t addr_ofs;
 } TempOptInfo;
 
+/*
+ * A guest store that a later load in the same basic block may be
+ * forwarded from: the address is base@base_gen + ofs, and val still
+ * holds the data as long as its gen is val_gen.
+ */
+typedef struct StoreFwdInfo {
+    TCGTemp *base;
+    uint32_t base_gen;
+    int64_t ofs;
+    TCGTemp *val;
+    uint32_t val_gen;
+    MemOpIdx oi;
+    bool is64;
+} StoreFwdInfo;
+
+#define MAX_STORE_FWD 8
+
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
     TCGTempSet temps_used;
 
+    /* Candidates for store-to-load forwarding; base is NULL if unused. */
+    StoreFwdInfo st_fwd[MAX_STORE_FWD];
+    unsigned st_fwd_next;
+
     /* In flight values from optimization. */
     uint64_t a_mask;  /* mask bit is 0 iff value identical to first input */
     uint64_t z_mask;  /* mask bit is 0 iff value bit is 0 */
     uint64_t s_mask;  /* mask of clrsb(value) bits */
+    TCGTemp *addr_base; /* address info for the first output, or NULL */
+    uint32_t addr_gen;
+    int64_t addr_ofs;
     TCGType type;
 } OptContext;
 
@@ -136,6 +165,10 @@ static void reset_ts(TCGTemp *ts)
     ti->is_const = false;
     ti->z_mask = -1;
     ti->s_mask = 0;
+    ti->gen++;
+    ti->addr_base = ts->fwd_base ? ts : NULL;
+    ti->addr_gen = ti->gen;
+    ti->addr_ofs = 0;
 }
 
 static void reset_temp(TCGArg arg)
@@ -172,6 +205,10 @@ static void init_ts_info(OptContext *ctx, TCGTemp *ts)
         ti->z_mask = -1;
         ti->s_mask = 0;
     }
+    ti->gen = 0;
+    ti->addr_base = ts->fwd_base ? ts : NULL;
+    ti->addr_gen = 0;
+    ti->addr_ofs = 0;
 }
 
 static TCGTemp *find_better_copy(TCGContext *s, TCGTemp *ts)
@@ -265,6 +302,11 @@ static bool tcg_opt_gen_mov(OptContext *ctx, TCGOp *op, TCGArg dst, TCGArg src)
 
     di->z_mask = si->z_mask;
     di->s_mask = si->s_mask;
+    if (si->addr_base) {
+        di->addr_base = si->addr_base;
+        di->addr_gen = si->addr_gen;
+        di->addr_ofs = si->addr_ofs;
+    }
 
     if (src_ts->type == dst_ts->type) {
         TempOptInfo *ni = ts_info(si->next_copy);
@@ -697,6 +739,7 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
      */
     if (def->flags & TCG_OPF_BB_END) {
         memset(&ctx->temps_used, 0, sizeof(ctx->temps_used));
+        memset(ctx->st_fwd, 0, sizeof(ctx->st_fwd));
         ctx->prev_mb = NULL;
         return;
     }
@@ -712,6 +755,11 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
         if (i == 0) {
             ts_info(ts)->z_mask = ctx->z_mask;
             ts_info(ts)->s_mask = ctx->s_mask;
+            if (ctx->addr_base) {
+                ts_info(ts)->addr_base = ctx->addr_base;
+                ts_info(ts)->addr_gen = ctx->addr_gen;
+                ts_info(ts)->addr_ofs = ctx->addr_ofs;
+            }
         }
     }
 }
@@ -727,6 +775,29 @@ static void finish_folding(OptContext *ctx, TCGOp *op)
  * folders for more specific operations.
  */
 
+/*
+ * Record that the output of an add or sub with a constant second input
+ * is an address relative to a forwarding base, if the first input is.
+ */
+static void fold_addr_offset(OptContext *ctx, TCGOp *op, bool neg)
+{
+    TempOptInfo *ai = arg_info(op->args[1]);
+    int64_t ofs;
+
+    if (ctx->type > TCG_TYPE_I64 || !ai->addr_base ||
+        !arg_is_const(op->args[2])) {
+        return;
+    }
+    ofs = arg_info(op->args[2])->val;
+    ofs = ai->addr_ofs + (neg ? -ofs : ofs);
+    if (ctx->type == TCG_TYPE_I32) {
+        ofs = (int32_t)ofs;
+    }
+    ctx->addr_base = ai->addr_base;
+    ctx->addr_gen = ai->addr_gen;
+    ctx->addr_ofs = ofs;
+}
+
 static bool fold_const1(OptContext *ctx, TCGOp *op)
 {
     if (arg_is_const(op->args[1])) {
@@ -902,6 +973,7 @@ static bool fold_add(OptContext *ctx, TCGOp *op)
         fold_xi_to_x(ctx, op, 0)) {
         return true;
     }
+    fold_addr_offset(ctx, op, false);
     return false;
 }
 
@@ -1211,8 +1283,9 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
         reset_temp(op->args[i]);
     }
 
-    /* Stop optimizing MB across calls. */
+    /* Stop optimizing MB and forwarding stores across calls. */
     ctx->prev_mb = NULL;
+    memset(ctx->st_fwd, 0, sizeof(ctx->st_fwd));
     return true;
 }
 
@@ -1462,6 +1535,9 @@ static bool fold_extu(OptContext *ctx, TCGOp *op)
 
 static bool fold_mb(OptContext *ctx, TCGOp *op)
 {
+    /* Keep it simple: do not forward stores across a barrier. */
+    memset(ctx->st_fwd, 0, sizeof(ctx->st_fwd));
+
     /* Eliminate duplicate and redundant fence instructions.  */
     if (ctx->prev_mb) {
         /*
@@ -1692,6 +1768,81 @@ static bool fold_orc(OptContext *ctx, TCGOp *op)
     return false;
 }
 
+/*
+ * Find the address of a guest access relative to a forwarding base.
+ * Only the simple layouts, with the data and the address in one temp
+ * each, are handled.
+ */
+static TempOptInfo *st_fwd_addr(TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int nb_data = def->nb_oargs ? def->nb_oargs : def->nb_iargs - 1;
+    TempOptInfo *ai;
+
+    if (nb_data != 1 || def->nb_oargs + def->nb_iargs != 2) {
+        return NULL;
+    }
+    ai = arg_info(op->args[1]);
+    return ai->addr_base ? ai : NULL;
+}
+
+static bool st_fwd_disjoint(const StoreFwdInfo *sf, const TempOptInfo *ai,
+                            int size)
+{
+    int64_t d = ai->addr_ofs - sf->ofs;
+
+    if (sf->base != ai->addr_base || sf->base_gen != ai->addr_gen ||
+        d <= -0x10000 || d >= 0x10000) {
+        return false;
+    }
+    return d >= memop_size(get_memop(sf->oi)) || -d >= size;
+}
+
+static bool fold_qemu_ld_fwd(OptContext *ctx, TCGOp *op)
+{
+    TempOptInfo *ai = st_fwd_addr(op);
+    MemOpIdx oi = op->args[2];
+    MemOp mop = get_memop(oi);
+    bool is64 = op->opc == INDEX_op_qemu_ld_i64;
+    int i;
+
+    if (!ai || ctx->tcg->no_st_fwd) {
+        return false;
+    }
+    for (i = 0; i < MAX_STORE_FWD; i++) {
+        StoreFwdInfo *sf = &ctx->st_fwd[i];
+        MemOp smop = get_memop(sf->oi);
+        int width;
+
+        if (sf->base != ai->addr_base || sf->base_gen != ai->addr_gen ||
+            sf->ofs != ai->addr_ofs || sf->is64 != is64 ||
+            get_mmuidx(sf->oi) != get_mmuidx(oi) ||
+            (smop & ~MO_SIGN) != (mop & ~MO_SIGN) ||
+            ts_info(sf->val)->gen != sf->val_gen) {
+            continue;
+        }
+
+        width = 8 * memop_size(mop);
+        if (width == (is64 ? 64 : 32)) {
+            return tcg_opt_gen_mov(ctx, op, op->args[0], temp_arg(sf->val));
+        }
+        if (mop & MO_SIGN) {
+            return false;
+        }
+
+        /* Narrow unsigned reload: just zero-extend the stored value. */
+        op->opc = is64 ? INDEX_op_and_i64 : INDEX_op_and_i32;
+        op->args[1] = temp_arg(sf->val);
+        op->args[2] = temp_arg(tcg_constant_internal(ctx->type,
+                                                     MAKE_64BIT_MASK(0, width)));
+        init_ts_info(ctx, arg_temp(op->args[2]));
+        ctx->z_mask = MAKE_64BIT_MASK(0, width);
+        finish_folding(ctx, op);
+        return true;
+    }
+    return false;
+}
+
 static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
 {
     const TCGOpDef *def = &tcg_op_defs[op->opc];
@@ -1699,6 +1850,10 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
     MemOp mop = get_memop(oi);
     int width = 8 * memop_size(mop);
 
+    if (fold_qemu_ld_fwd(ctx, op)) {
+        return true;
+    }
+
     if (width < 64) {
         ctx->s_mask = MAKE_64BIT_MASK(width, 64 - width);
         if (!(mop & MO_SIGN)) {
@@ -1712,10 +1867,44 @@ static bool fold_qemu_ld(OptContext *ctx, TCGOp *op)
     return false;
 }
 
+static bool fold_qemu_atomic(OptContext *ctx, TCGOp *op)
+{
+    /* Guest atomics order memory like a barrier; forget everything.  */
+    ctx->prev_mb = NULL;
+    memset(ctx->st_fwd, 0, sizeof(ctx->st_fwd));
+    return false;
+}
+
 static bool fold_qemu_st(OptContext *ctx, TCGOp *op)
 {
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    MemOpIdx oi = op->args[def->nb_iargs];
+    TempOptInfo *ai = st_fwd_addr(op);
+    int size = memop_size(get_memop(oi));
+    StoreFwdInfo *sf;
+    int i;
+
     /* Opcodes that touch guest memory stop the mb optimization.  */
     ctx->prev_mb = NULL;
+
+    /* Forget the stores that this one may overwrite. */
+    for (i = 0; i < MAX_STORE_FWD; i++) {
+        sf = &ctx->st_fwd[i];
+        if (sf->base && !(ai && st_fwd_disjoint(sf, ai, size))) {
+            sf->base = NULL;
+        }
+    }
+
+    if (ai && !ctx->tcg->no_st_fwd) {
+        sf = &ctx->st_fwd[ctx->st_fwd_next++ % MAX_STORE_FWD];
+        sf->base = ai->addr_base;
+        sf->base_gen = ai->addr_gen;
+        sf->ofs = ai->addr_ofs;
+        sf->val = arg_temp(op->args[0]);
+        sf->val_gen = ts_info(sf->val)->gen;
+        sf->oi = oi;
+        sf->is64 = op->opc == INDEX_op_qemu_st_i64;
+    }
     return false;
 }
 
@@ -1946,6 +2135,7 @@ static bool fold_sub(OptContext *ctx, TCGOp *op)
         fold_sub_to_neg(ctx, op)) {
         return true;
     }
+    fold_addr_offset(ctx, op, true);
     return false;
 }
 
@@ -2046,6 +2236,7 @@ void tcg_optimize(TCGContext *s)
         ctx.a_mask = -1;
         ctx.z_mask = -1;
         ctx.s_mask = 0;
+        ctx.addr_base = NULL;
 
         /*
          * Process each opcode.
@@ -2173,6 +2364,12 @@ void tcg_optimize(TCGContext *s)
         case INDEX_op_qemu_st_i64:
             done = fold_qemu_st(&ctx, op);
             break;
+        case INDEX_op_qemu_cmpxchg_i32:
+        case INDEX_op_qemu_cmpxchg_i64:
+        case INDEX_op_qemu_atomic_i32:
+        case INDEX_op_qemu_atomic_i64:
+            done = fold_qemu_atomic(&ctx, op);
+            break;
         CASE_OP_32_64(rem):
         CASE_OP_32_64(remu):
             done = fold_remainder(&ctx, op);
@@ -24,11 +24,17 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "exec/exec-all.h"
 #include "tcg/tcg.h"
 #include "tcg-internal.h"
 
+#ifdef CONFIG_NUMA
+#include <numaif.h>
+#endif
 
 struct tcg_region_tree {
     QemuMutex lock;
@@ -54,12 +60,39 @@ struct tcg_region_state {
     size_t total_size; /* size of entire buffer, >= n * stride */
 
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    size_t *free;           /* indexes of the unused regions... */
+    size_t n_free;          /* ...handed out from the end */
+    size_t *used;           /* regions handed out, oldest first */
+    size_t n_used;
     size_t agg_size_full; /* aggregate size of full regions */
 };
 
 static struct tcg_region_state region;
 
+/*
+ * How the code gen buffer is backed.  With a large buffer, fetching
+ * the translated code misses a lot in the host iTLB unless it sits on
+ * huge pages: "thp" asks for transparent hugepages, "hugetlb" maps the
+ * buffer from the hugetlbfs pool, which cannot be split for guard pages.
+ */
+typedef enum {
+    TCG_HUGEPAGES_OFF,
+    TCG_HUGEPAGES_THP,
+    TCG_HUGEPAGES_HUGETLB,
+} TCGHugepages;
+
+static const char * const tcg_hugepages_names[] = {
+    [TCG_HUGEPAGES_OFF] = "off",
+    [TCG_HUGEPAGES_THP] = "thp",
+    [TCG_HUGEPAGES_HUGETLB] = "hugetlb",
+};
+
+/* Set before tcg_region_init */
+static TCGHugepages tcg_hugepages = TCG_HUGEPAGES_THP;
+static int tcg_numa_node = -1;
+/* Page size of a hugetlb code gen buffer, 0 if it is not one */
+static size_t tcg_hugetlb_size;
+
 /*
  * This is an array of struct tcg_region_tree's, with padding.
  * We use void * to simplify the computation of region_trees[i]; each
@@ -78,6 +111,29 @@ bool in_code_gen_buffer(const void *p)
     return (size_t)(p - region.start_aligned) <= region.total_size;
 }
 
+bool tcg_region_set_hugepages(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(tcg_hugepages_names); i++) {
+        if (!strcmp(name, tcg_hugepages_names[i])) {
+            tcg_hugepages = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *tcg_region_get_hugepages(void)
+{
+    return tcg_hugepages_names[tcg_hugepages];
+}
+
+void tcg_region_set_numa_node(int node)
+{
+    tcg_numa_node = node;
+}
+
 #ifdef CONFIG_DEBUG_TCG
 const void *tcg_splitwx_to_rx(void *rw)
 {
@@ -163,10 +219,9 @@ static void tcg_region_trees_init(void)
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+/* Return the index of the region holding @p, or -1 if there is none */
+static ptrdiff_t tc_ptr_to_region_idx(const void *p)
 {
-    size_t region_idx;
-
     /*
      * Like tcg_splitwx_to_rw, with no assert.  The pc may come from
      * a signal handler over which the caller has no control.
@@ -174,20 +229,28 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
     if (!in_code_gen_buffer(p)) {
         p -= tcg_splitwx_diff;
         if (!in_code_gen_buffer(p)) {
-            return NULL;
+            return -1;
         }
     }
 
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
+            return region.n - 1;
         }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
+{
+    ptrdiff_t region_idx = tc_ptr_to_region_idx(p);
+
+    if (region_idx < 0) {
+        return NULL;
     }
     return region_trees + region_idx * tree_size;
 }
@@ -331,14 +394,28 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i;
+
+    if (region.n_free == 0) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    i = region.free[--region.n_free];
+    tcg_region_assign(s, i);
+    region.used[region.n_used++] = i;
     return false;
 }
 
+static void tcg_region_free_all__locked(void)
+{
+    size_t i;
+
+    region.n_used = 0;
+    for (i = 0; i < region.n; i++) {
+        region.free[i] = region.n - 1 - i;
+    }
+    region.n_free = region.n;
+}
+
 /*
  * Request a new region once the one in use has filled up.
  * Returns true on error.
@@ -382,7 +459,7 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
+    tcg_region_free_all__locked();
     region.agg_size_full = 0;
 
     for (i = 0; i < n_ctxs; i++) {
@@ -394,7 +471,83 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
-static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
+static gboolean tcg_region_reclaim_iter(gpointer key, gpointer value,
+                                        gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return false;
+}
+
+/*
+ * Call from a safe-work context.
+ *
+ * Free the oldest quarter of the regions in use, except the ones that
+ * TCG contexts are currently translating into.  @invalidate is called
+ * on each of their TBs first, and must leave nothing else pointing to
+ * them.  Code that is still hot is retranslated into the current
+ * regions, so the survivors of a reclaim are the recently used TBs.
+ *
+ * Returns the number of TBs discarded, or -1 if no region could be freed.
+ */
+ssize_t tcg_region_reclaim(void (*invalidate)(TranslationBlock *tb))
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    g_autoptr(GPtrArray) tbs = g_ptr_array_new();
+    g_autofree bool *busy = g_new0(bool, region.n);
+    size_t i, j, want, first, done = 0;
+
+    qemu_mutex_lock(&region.lock);
+    first = region.n_free;
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        busy[tc_ptr_to_region_idx(s->code_gen_buffer)] = true;
+    }
+
+    want = MAX(region.n_used / 4, 1);
+    for (i = j = 0; i < region.n_used; i++) {
+        size_t r = region.used[i];
+        struct tcg_region_tree *rt = region_trees + r * tree_size;
+        void *start, *end;
+
+        if (done == want || busy[r]) {
+            region.used[j++] = r;
+            continue;
+        }
+
+        qemu_mutex_lock(&rt->lock);
+        g_tree_foreach(rt->tree, tcg_region_reclaim_iter, tbs);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(r, &start, &end);
+        region.agg_size_full -= (end - start) - TCG_HIGHWATER;
+        region.free[region.n_free++] = r;
+        done++;
+    }
+    region.n_used = j;
+    qemu_mutex_unlock(&region.lock);
+
+    if (!done) {
+        return -1;
+    }
+
+    for (i = 0; i < tbs->len; i++) {
+        invalidate(g_ptr_array_index(tbs, i));
+    }
+    for (i = first; i < first + done; i++) {
+        struct tcg_region_tree *rt = region_trees +
+                                     region.free[i] * tree_size;
+
+        qemu_mutex_lock(&rt->lock);
+        /* Increment the refcount first so that destroy acts as a reset */
+        g_tree_ref(rt->tree);
+        g_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+    }
+    return tbs->len;
+}
+
+static size_t tcg_n_regions(size_t tb_size, unsigned max_threads)
 {
 #ifdef CONFIG_USER_ONLY
     return 1;
@@ -402,25 +555,22 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
     size_t n_regions;
 
     /*
-     * It is likely that some vCPUs will translate more code than others,
-     * so we first try to set more regions than max_cpus, with those regions
-     * being of reasonable size. If that's not possible we make do by evenly
-     * dividing the code_gen_buffer among the vCPUs.
+     * It is likely that some threads will translate more code than others,
+     * so we first try to set more regions than max_threads, with those
+     * regions being of reasonable size. If that's not possible we make do
+     * by evenly dividing the code_gen_buffer among the threads.
      */
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
-    }
-
     /*
-     * Try to have more regions than max_cpus, with each region being >= 2 MB.
-     * If we can't, then just allocate one region per vCPU thread.
+     * Try to have more regions than max_threads, with each region being
+     * >= 2 MB.  If we can't, then just allocate one region per thread.
+     * Even a single thread gets several, so that filling up the buffer
+     * only has the oldest of them reclaimed (see tcg_region_reclaim).
      */
     n_regions = tb_size / (2 * MiB);
-    if (n_regions <= max_cpus) {
-        return max_cpus;
+    if (n_regions <= max_threads) {
+        return max_threads;
     }
-    return MIN(n_regions, max_cpus * 8);
+    return MIN(n_regions, max_threads * 8);
 #endif
 }
 
@@ -656,11 +806,86 @@ static int alloc_code_gen_buffer_splitwx(size_t size, Error **errp)
     return -1;
 }
 
+#if defined(CONFIG_LINUX) && defined(MAP_HUGETLB)
+/* Default hugetlbfs page size, the one MAP_HUGETLB uses, or 0 */
+static size_t hugetlb_default_size(void)
+{
+    g_autofree char *meminfo = NULL;
+    const char *p, *end;
+    uint64_t kib;
+
+    if (!g_file_get_contents("/proc/meminfo", &meminfo, NULL, NULL)) {
+        return 0;
+    }
+    p = strstr(meminfo, "Hugepagesize:");
+    if (!p || qemu_strtou64(p + strlen("Hugepagesize:"), &end, 10, &kib) ||
+        !is_power_of_2(kib)) {
+        return 0;
+    }
+    return kib * KiB;
+}
+
+static int alloc_code_gen_buffer_hugetlb(size_t size, Error **errp)
+{
+    size_t page_size = hugetlb_default_size();
+    int prot = PROT_READ | PROT_WRITE;
+    void *buf;
+
+#ifndef CONFIG_TCG_INTERPRETER
+    prot |= PROT_EXEC;
+#endif
+    if (page_size == 0) {
+        error_setg(errp, "no hugetlb page size on this host");
+        return -1;
+    }
+
+    /*
+     * Map it with its final protection: mprotect of part of a huge page,
+     * as tcg_region_init does otherwise, fails.
+     */
+    size = MAX(QEMU_ALIGN_DOWN(size, page_size), page_size);
+    buf = mmap(NULL, size, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+               -1, 0);
+    if (buf == MAP_FAILED) {
+        error_setg_errno(errp, errno, "allocate %zu bytes of hugetlb pages "
+                         "for jit buffer", size);
+        return -1;
+    }
+
+    region.start_aligned = buf;
+    region.total_size = size;
+    tcg_hugetlb_size = page_size;
+    return prot;
+}
+#else
+static int alloc_code_gen_buffer_hugetlb(size_t size, Error **errp)
+{
+    error_setg(errp, "jit hugetlb pages not supported");
+    return -1;
+}
+#endif
+
 static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
 {
     ERRP_GUARD();
     int prot, flags;
 
+    if (tcg_hugepages == TCG_HUGEPAGES_HUGETLB) {
+        if (splitwx > 0) {
+            error_setg(errp, "jit split-wx does not support hugetlb pages");
+            return -1;
+        }
+        prot = alloc_code_gen_buffer_hugetlb(size, errp);
+        if (prot >= 0) {
+            return prot;
+        }
+        /* The pool is often too small; let the buffer use normal pages. */
+        warn_report_err(*errp);
+        *errp = NULL;
+        tcg_hugepages = TCG_HUGEPAGES_THP;
+        splitwx = 0;
+    }
+
     if (splitwx) {
         prot = alloc_code_gen_buffer_splitwx(size, errp);
         if (prot >= 0) {
@@ -705,11 +930,10 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * and then assigning regions to TCG threads so that the threads can translate
  * code in parallel without synchronization.
  *
- * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
- * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
- * must have been parsed before calling this function, since it calls
- * qemu_tcg_mttcg_enabled().
+ * In softmmu the number of TCG threads is bounded by max_threads: max_cpus
+ * in MTTCG, one in !MTTCG, plus the speculative translation worker if
+ * enabled.  We use at least max_threads regions, or a single region if
+ * there is only one thread.
  *
  * In user-mode we use a single region.  Having multiple regions in user-mode
  * is not supported, because the number of vCPU threads (recall that each thread
@@ -723,10 +947,10 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
  * in practice. Multi-threaded guests share most if not all of their translated
  * code, which makes parallel code generation less appealing than in softmmu.
  */
-void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_region_init(size_t tb_size, int splitwx, unsigned max_threads)
 {
     const size_t page_size = qemu_real_host_page_size;
-    size_t region_size;
+    size_t region_size, guard_size = page_size;
     int have_prot, need_prot;
 
     /* Size the buffer.  */
@@ -749,19 +973,53 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     have_prot = alloc_code_gen_buffer(tb_size, splitwx, &error_fatal);
     assert(have_prot >= 0);
 
+    if (tcg_hugetlb_size) {
+        /* No guard pages: they would have to be huge pages too. */
+        guard_size = 0;
+        tb_size = region.total_size;
+    } else if (tcg_hugepages == TCG_HUGEPAGES_HUGETLB) {
+        warn_report("jit hugetlb pages not supported on this host");
+        tcg_hugepages = TCG_HUGEPAGES_THP;
+    }
+
     /* Request large pages for the buffer and the splitwx.  */
-    qemu_madvise(region.start_aligned, region.total_size, QEMU_MADV_HUGEPAGE);
-    if (tcg_splitwx_diff) {
-        qemu_madvise(region.start_aligned + tcg_splitwx_diff,
-                     region.total_size, QEMU_MADV_HUGEPAGE);
+    if (tcg_hugepages == TCG_HUGEPAGES_THP) {
+        qemu_madvise(region.start_aligned, region.total_size,
+                     QEMU_MADV_HUGEPAGE);
+        if (tcg_splitwx_diff) {
+            qemu_madvise(region.start_aligned + tcg_splitwx_diff,
+                         region.total_size, QEMU_MADV_HUGEPAGE);
+        }
     }
 
+#ifdef CONFIG_NUMA
+    /*
+     * Nothing has been written to the buffer yet, so all of it will be
+     * faulted in on the node that runs the vCPU threads.
+     */
+    if (tcg_numa_node >= 0) {
+        g_autofree unsigned long *nodes = bitmap_new(tcg_numa_node + 1);
+
+        set_bit(tcg_numa_node, nodes);
+        /* Like hostmem, pass one more bit than needed for old kernels */
+        if (mbind(region.start_aligned, region.total_size, MPOL_PREFERRED,
+                  nodes, tcg_numa_node + 2, 0)) {
+            warn_report("cannot bind jit buffer to host NUMA node %d: %s",
+                        tcg_numa_node, strerror(errno));
+        }
+    }
+#else
+    if (tcg_numa_node >= 0) {
+        warn_report("jit buffer NUMA placement not supported, ignoring it");
+    }
+#endif
+
     /*
      * Make region_size a multiple of page_size, using aligned as the start.
      * As a result of this we might end up with a few extra pages at the end of
      * the buffer; we will assign those to the last region.
      */
-    region.n = tcg_n_regions(tb_size, max_cpus);
+    region.n = tcg_n_regions(tb_size, max_threads);
     region_size = tb_size / region.n;
     region_size = QEMU_ALIGN_DOWN(region_size, page_size);
 
@@ -770,8 +1028,8 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
     region.stride = region_size;
 
     /* Reserve space for guard pages. */
-    region.size = region_size - page_size;
-    region.total_size -= page_size;
+    region.size = region_size - guard_size;
+    region.total_size -= guard_size;
 
     /*
      * The first region will be smaller than the others, via the prologue,
@@ -782,6 +1040,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.free = g_new(size_t, region.n);
+    region.used = g_new(size_t, region.n);
+    tcg_region_free_all__locked();
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
@@ -814,9 +1075,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
                                  "mprotect of jit buffer");
             }
         }
-        if (have_prot != 0) {
+        if (have_prot != 0 && guard_size) {
             /* Guard pages are nice for bug detection but are not essential. */
-            (void)qemu_mprotect_none(end, page_size);
+            (void)qemu_mprotect_none(end, guard_size);
         }
     }
 
@@ -872,6 +1133,72 @@ size_t tcg_code_size(void)
     return total;
 }
 
+/*
+ * Returns how many bytes of [start, start + size) are currently backed
+ * by huge pages, as reported by the host kernel.
+ */
+static size_t tcg_region_huge_bytes(const void *start, size_t size)
+{
+    size_t total = 0;
+#ifdef CONFIG_LINUX
+    uintptr_t lo = (uintptr_t)start, hi = lo + size;
+    g_autofree char *smaps = NULL;
+    g_auto(GStrv) lines = NULL;
+    bool inside = false;
+    char **l;
+
+    if (!g_file_get_contents("/proc/self/smaps", &smaps, NULL, NULL)) {
+        return 0;
+    }
+    lines = g_strsplit(smaps, "\n", -1);
+    for (l = lines; *l; l++) {
+        unsigned long vm_start, vm_end, kib;
+
+        if (sscanf(*l, "%lx-%lx ", &vm_start, &vm_end) == 2) {
+            inside = vm_start < hi && vm_end > lo;
+        } else if (inside &&
+                   (sscanf(*l, "AnonHugePages: %lu kB", &kib) == 1 ||
+                    sscanf(*l, "ShmemPmdMapped: %lu kB", &kib) == 1 ||
+                    sscanf(*l, "Private_Hugetlb: %lu kB", &kib) == 1 ||
+                    sscanf(*l, "Shared_Hugetlb: %lu kB", &kib) == 1)) {
+            total += kib * KiB;
+        }
+    }
+#endif
+    return MIN(total, size);
+}
+
+/*
+ * Describe the host pages under the code gen buffer for "info jit".
+ * The iTLB footprint is the number of host pages, huge or not, that the
+ * translated code spans, assuming it fills the huge pages first.
+ */
+void tcg_region_dump_info(GString *buf)
+{
+    const void *rx = tcg_splitwx_to_rx(region.start_aligned);
+    size_t code_size = tcg_code_size();
+    size_t huge_size = tcg_hugetlb_size ? tcg_hugetlb_size : qemu_thp_size();
+    size_t huge = tcg_region_huge_bytes(rx, region.total_size);
+    size_t on_huge = MIN(huge, code_size);
+    size_t pages = DIV_ROUND_UP(code_size - on_huge,
+                                qemu_real_host_page_size);
+
+    if (huge_size) {
+        pages += DIV_ROUND_UP(on_huge, huge_size);
+    }
+    g_string_append_printf(buf, "code buffer pages   %s, %zu/%zu MiB huge "
+                           "(%zu KiB pages)\n",
+                           tcg_hugepages_names[tcg_hugepages], huge / MiB,
+                           region.total_size / MiB, huge_size / KiB);
+    if (tcg_numa_node >= 0) {
+        g_string_append_printf(buf, "code buffer node    %d\n",
+                               tcg_numa_node);
+    }
+    g_string_append_printf(buf, "code iTLB footprint %zu pages "
+                           "(%zu with base pages only)\n", pages,
+                           DIV_ROUND_UP(code_size, qemu_real_host_page_size));
+}
+
 /*
  * Returns the code capacity (in bytes) of the entire cache, i.e. including all
  * regions.
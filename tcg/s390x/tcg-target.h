@@ -166,6 +166,7 @@ extern uint64_t s390_facilities[3];
 
 #define TCG_TARGET_EXTEND_ARGS 1
 #define TCG_TARGET_HAS_MEMORY_BSWAP   1
+#define TCG_TARGET_HAS_qemu_atomic    0
 
 #define TCG_TARGET_DEFAULT_MO (TCG_MO_ALL & ~TCG_MO_ST_LD)
 
@@ -2762,6 +2762,24 @@ void tcg_gen_lookup_and_goto_ptr(void)
     tcg_temp_free_ptr(ptr);
 }
 
+void tcg_gen_lookup_and_goto_ptr_cached(const TranslationBlock *tb)
+{
+    TCGv_ptr ptr, src;
+
+    if (tcg_ctx->tb_cflags & (CF_NO_GOTO_PTR | CF_PARALLEL)) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    ptr = tcg_temp_new_ptr();
+    src = tcg_const_ptr(tb);
+    gen_helper_lookup_tb_ptr_cached(ptr, cpu_env, src);
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptr));
+    tcg_temp_free_ptr(src);
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline MemOp tcg_canonicalize_memop(MemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
@@ -3106,6 +3124,46 @@ typedef void (*gen_atomic_op_i64)(TCGv_i64, TCGv_env, TCGv,
 # define WITH_ATOMIC64(X)
 #endif
 
+/*
+ * Use the qemu_cmpxchg and qemu_atomic opcodes rather than the out of
+ * line helpers when the backend has them and no byte swap is needed.
+ * The backend slow path calls the helpers, which already report the
+ * access to plugins, so keep the helpers while plugins instrument it.
+ */
+static bool atomic_use_opc(MemOp memop)
+{
+#ifdef CONFIG_PLUGIN
+    if (tcg_ctx->plugin_insn != NULL) {
+        return false;
+    }
+#endif
+    return TCG_TARGET_REG_BITS == 64 && TCG_TARGET_HAS_qemu_atomic &&
+           !(memop & MO_BSWAP);
+}
+
+static TCGArg tcgv_addr_arg(TCGv addr)
+{
+#if TARGET_LONG_BITS == 32
+    return tcgv_i32_arg(addr);
+#else
+    return tcgv_i64_arg(addr);
+#endif
+}
+
+static void gen_atomic_cx_opc(TCGOpcode opc, TCGArg retv, TCGv addr,
+                              TCGArg cmpv, TCGArg newv, MemOpIdx oi)
+{
+    trace_guest_rmw_before_tcg(tcg_ctx->cpu, cpu_env, addr, oi);
+    tcg_gen_op5(opc, retv, tcgv_addr_arg(addr), cmpv, newv, oi);
+}
+
+static void gen_atomic_op_opc(TCGOpcode opc, TCGArg ret, TCGv addr,
+                              TCGArg val, MemOpIdx oi, TCGAtomicOp aop)
+{
+    trace_guest_rmw_before_tcg(tcg_ctx->cpu, cpu_env, addr, oi);
+    tcg_gen_op5(opc, ret, tcgv_addr_arg(addr), val, oi, aop);
+}
+
 static void * const table_cmpxchg[(MO_SIZE | MO_BSWAP) + 1] = {
     [MO_8] = gen_helper_atomic_cmpxchgb,
     [MO_16 | MO_LE] = gen_helper_atomic_cmpxchgw_le,
@@ -3138,6 +3196,13 @@ void tcg_gen_atomic_cmpxchg_i32(TCGv_i32 retv, TCGv addr, TCGv_i32 cmpv,
             tcg_gen_mov_i32(retv, t1);
         }
         tcg_temp_free_i32(t1);
+    } else if (atomic_use_opc(memop)) {
+        gen_atomic_cx_opc(INDEX_op_qemu_cmpxchg_i32, tcgv_i32_arg(retv), addr,
+                          tcgv_i32_arg(cmpv), tcgv_i32_arg(newv),
+                          make_memop_idx(memop & ~MO_SIGN, idx));
+        if (memop & MO_SIGN) {
+            tcg_gen_ext_i32(retv, retv, memop);
+        }
     } else {
         gen_atomic_cx_i32 gen;
         MemOpIdx oi;
@@ -3176,6 +3241,13 @@ void tcg_gen_atomic_cmpxchg_i64(TCGv_i64 retv, TCGv addr, TCGv_i64 cmpv,
             tcg_gen_mov_i64(retv, t1);
         }
         tcg_temp_free_i64(t1);
+    } else if (atomic_use_opc(memop)) {
+        gen_atomic_cx_opc(INDEX_op_qemu_cmpxchg_i64, tcgv_i64_arg(retv), addr,
+                          tcgv_i64_arg(cmpv), tcgv_i64_arg(newv),
+                          make_memop_idx(memop & ~MO_SIGN, idx));
+        if (memop & MO_SIGN) {
+            tcg_gen_ext_i64(retv, retv, memop);
+        }
     } else if ((memop & MO_SIZE) == MO_64) {
 #ifdef CONFIG_ATOMIC64
         gen_atomic_cx_i64 gen;
@@ -3231,6 +3303,34 @@ static void do_nonatomic_op_i32(TCGv_i32 ret, TCGv addr, TCGv_i32 val,
     tcg_temp_free_i32(t2);
 }
 
+/*
+ * The qemu_atomic opcodes return the previous contents of memory; compute
+ * the new value from it for the NAME_fetch operations.
+ */
+static void do_atomic_opc_i32(TCGv_i32 ret, TCGv addr, TCGv_i32 val,
+                              TCGArg idx, MemOp memop, TCGAtomicOp aop,
+                              bool new_val,
+                              void (*gen)(TCGv_i32, TCGv_i32, TCGv_i32))
+{
+    MemOpIdx oi = make_memop_idx(memop & ~MO_SIGN, idx);
+    TCGv_i32 t1 = new_val ? tcg_temp_new_i32() : ret;
+
+    gen_atomic_op_opc(INDEX_op_qemu_atomic_i32, tcgv_i32_arg(t1), addr,
+                      tcgv_i32_arg(val), oi, aop);
+    if (new_val) {
+        TCGv_i32 t2 = tcg_temp_new_i32();
+
+        tcg_gen_ext_i32(t1, t1, memop);
+        tcg_gen_ext_i32(t2, val, memop);
+        gen(t2, t1, t2);
+        tcg_gen_ext_i32(ret, t2, memop);
+        tcg_temp_free_i32(t1);
+        tcg_temp_free_i32(t2);
+    } else if (memop & MO_SIGN) {
+        tcg_gen_ext_i32(ret, ret, memop);
+    }
+}
+
 static void do_atomic_op_i32(TCGv_i32 ret, TCGv addr, TCGv_i32 val,
                              TCGArg idx, MemOp memop, void * const table[])
 {
@@ -3269,6 +3369,30 @@ static void do_nonatomic_op_i64(TCGv_i64 ret, TCGv addr, TCGv_i64 val,
     tcg_temp_free_i64(t2);
 }
 
+static void do_atomic_opc_i64(TCGv_i64 ret, TCGv addr, TCGv_i64 val,
+                              TCGArg idx, MemOp memop, TCGAtomicOp aop,
+                              bool new_val,
+                              void (*gen)(TCGv_i64, TCGv_i64, TCGv_i64))
+{
+    MemOpIdx oi = make_memop_idx(memop & ~MO_SIGN, idx);
+    TCGv_i64 t1 = new_val ? tcg_temp_new_i64() : ret;
+
+    gen_atomic_op_opc(INDEX_op_qemu_atomic_i64, tcgv_i64_arg(t1), addr,
+                      tcgv_i64_arg(val), oi, aop);
+    if (new_val) {
+        TCGv_i64 t2 = tcg_temp_new_i64();
+
+        tcg_gen_ext_i64(t1, t1, memop);
+        tcg_gen_ext_i64(t2, val, memop);
+        gen(t2, t1, t2);
+        tcg_gen_ext_i64(ret, t2, memop);
+        tcg_temp_free_i64(t1);
+        tcg_temp_free_i64(t2);
+    } else if (memop & MO_SIGN) {
+        tcg_gen_ext_i64(ret, ret, memop);
+    }
+}
+
 static void do_atomic_op_i64(TCGv_i64 ret, TCGv addr, TCGv_i64 val,
                              TCGArg idx, MemOp memop, void * const table[])
 {
@@ -3307,7 +3431,7 @@ static void do_atomic_op_i64(TCGv_i64 ret, TCGv addr, TCGv_i64 val,
     }
 }
 
-#define GEN_ATOMIC_HELPER(NAME, OP, NEW)                                \
+#define GEN_ATOMIC_HELPER(NAME, OP, AOP, NEW)                           \
 static void * const table_##NAME[(MO_SIZE | MO_BSWAP) + 1] = {          \
     [MO_8] = gen_helper_atomic_##NAME##b,                               \
     [MO_16 | MO_LE] = gen_helper_atomic_##NAME##w_le,                   \
@@ -3320,41 +3444,49 @@ static void * const table_##NAME[(MO_SIZE | MO_BSWAP) + 1] = {          \
 void tcg_gen_atomic_##NAME##_i32                                        \
     (TCGv_i32 ret, TCGv addr, TCGv_i32 val, TCGArg idx, MemOp memop)    \
 {                                                                       \
-    if (tcg_ctx->tb_cflags & CF_PARALLEL) {                             \
-        do_atomic_op_i32(ret, addr, val, idx, memop, table_##NAME);     \
-    } else {                                                            \
+    if (!(tcg_ctx->tb_cflags & CF_PARALLEL)) {                          \
         do_nonatomic_op_i32(ret, addr, val, idx, memop, NEW,            \
                             tcg_gen_##OP##_i32);                        \
+    } else if (atomic_use_opc(tcg_canonicalize_memop(memop, 0, 0))) {   \
+        do_atomic_opc_i32(ret, addr, val, idx,                          \
+                          tcg_canonicalize_memop(memop, 0, 0),          \
+                          AOP, NEW, tcg_gen_##OP##_i32);                \
+    } else {                                                            \
+        do_atomic_op_i32(ret, addr, val, idx, memop, table_##NAME);     \
     }                                                                   \
 }                                                                       \
 void tcg_gen_atomic_##NAME##_i64                                        \
     (TCGv_i64 ret, TCGv addr, TCGv_i64 val, TCGArg idx, MemOp memop)    \
 {                                                                       \
-    if (tcg_ctx->tb_cflags & CF_PARALLEL) {                             \
-        do_atomic_op_i64(ret, addr, val, idx, memop, table_##NAME);     \
-    } else {                                                            \
+    if (!(tcg_ctx->tb_cflags & CF_PARALLEL)) {                          \
         do_nonatomic_op_i64(ret, addr, val, idx, memop, NEW,            \
                             tcg_gen_##OP##_i64);                        \
+    } else if (atomic_use_opc(tcg_canonicalize_memop(memop, 1, 0))) {   \
+        do_atomic_opc_i64(ret, addr, val, idx,                          \
+                          tcg_canonicalize_memop(memop, 1, 0),          \
+                          AOP, NEW, tcg_gen_##OP##_i64);                \
+    } else {                                                            \
+        do_atomic_op_i64(ret, addr, val, idx, memop, table_##NAME);     \
     }                                                                   \
 }
 
-GEN_ATOMIC_HELPER(fetch_add, add, 0)
-GEN_ATOMIC_HELPER(fetch_and, and, 0)
-GEN_ATOMIC_HELPER(fetch_or, or, 0)
-GEN_ATOMIC_HELPER(fetch_xor, xor, 0)
-GEN_ATOMIC_HELPER(fetch_smin, smin, 0)
-GEN_ATOMIC_HELPER(fetch_umin, umin, 0)
-GEN_ATOMIC_HELPER(fetch_smax, smax, 0)
-GEN_ATOMIC_HELPER(fetch_umax, umax, 0)
-
-GEN_ATOMIC_HELPER(add_fetch, add, 1)
-GEN_ATOMIC_HELPER(and_fetch, and, 1)
-GEN_ATOMIC_HELPER(or_fetch, or, 1)
-GEN_ATOMIC_HELPER(xor_fetch, xor, 1)
-GEN_ATOMIC_HELPER(smin_fetch, smin, 1)
-GEN_ATOMIC_HELPER(umin_fetch, umin, 1)
-GEN_ATOMIC_HELPER(smax_fetch, smax, 1)
-GEN_ATOMIC_HELPER(umax_fetch, umax, 1)
+GEN_ATOMIC_HELPER(fetch_add, add, TCG_ATOMIC_ADD, 0)
+GEN_ATOMIC_HELPER(fetch_and, and, TCG_ATOMIC_AND, 0)
+GEN_ATOMIC_HELPER(fetch_or, or, TCG_ATOMIC_OR, 0)
+GEN_ATOMIC_HELPER(fetch_xor, xor, TCG_ATOMIC_XOR, 0)
+GEN_ATOMIC_HELPER(fetch_smin, smin, TCG_ATOMIC_SMIN, 0)
+GEN_ATOMIC_HELPER(fetch_umin, umin, TCG_ATOMIC_UMIN, 0)
+GEN_ATOMIC_HELPER(fetch_smax, smax, TCG_ATOMIC_SMAX, 0)
+GEN_ATOMIC_HELPER(fetch_umax, umax, TCG_ATOMIC_UMAX, 0)
+
+GEN_ATOMIC_HELPER(add_fetch, add, TCG_ATOMIC_ADD, 1)
+GEN_ATOMIC_HELPER(and_fetch, and, TCG_ATOMIC_AND, 1)
+GEN_ATOMIC_HELPER(or_fetch, or, TCG_ATOMIC_OR, 1)
+GEN_ATOMIC_HELPER(xor_fetch, xor, TCG_ATOMIC_XOR, 1)
+GEN_ATOMIC_HELPER(smin_fetch, smin, TCG_ATOMIC_SMIN, 1)
+GEN_ATOMIC_HELPER(umin_fetch, umin, TCG_ATOMIC_UMIN, 1)
+GEN_ATOMIC_HELPER(smax_fetch, smax, TCG_ATOMIC_SMAX, 1)
+GEN_ATOMIC_HELPER(umax_fetch, umax, TCG_ATOMIC_UMAX, 1)
 
 static void tcg_gen_mov2_i32(TCGv_i32 r, TCGv_i32 a, TCGv_i32 b)
 {
@@ -3366,6 +3498,6 @@ static void tcg_gen_mov2_i64(TCGv_i64 r, TCGv_i64 a, TCGv_i64 b)
     tcg_gen_mov_i64(r, b);
 }
 
-GEN_ATOMIC_HELPER(xchg, mov2, 0)
+GEN_ATOMIC_HELPER(xchg, mov2, TCG_ATOMIC_XCHG, 0)
 
 #undef GEN_ATOMIC_HELPER
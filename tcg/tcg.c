@@ -43,6 +43,7 @@
 #define NO_CPU_IO_DEFS
 
 #include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
 #include "tcg/tcg-op.h"
 
 #if UINTPTR_MAX == UINT32_MAX
@@ -168,6 +169,7 @@ unsigned int tcg_max_ctxs;
 TCGv_env cpu_env = 0;
 const void *tcg_code_gen_epilogue;
 uintptr_t tcg_splitwx_diff;
+bool tcg_keep_globals = true;
 
 #ifndef CONFIG_TCG_INTERPRETER
 tcg_prologue_fn *tcg_qemu_tb_exec;
@@ -567,7 +569,7 @@ static void process_op_defs(TCGContext *s);
 static TCGTemp *tcg_global_reg_new_internal(TCGContext *s, TCGType type,
                                             TCGReg reg, const char *name);
 
-static void tcg_context_init(unsigned max_cpus)
+static void tcg_context_init(unsigned max_threads)
 {
     TCGContext *s = &tcg_init_ctx;
     int op, total_args, n, i;
@@ -671,15 +673,15 @@ static void tcg_context_init(unsigned max_cpus)
      * In user-mode we simply share the init context among threads, since we
      * use a single region. See the documentation tcg_region_init() for the
      * reasoning behind this.
-     * In softmmu we will have at most max_cpus TCG threads.
+     * In softmmu we will have at most max_threads TCG threads.
      */
 #ifdef CONFIG_USER_ONLY
     tcg_ctxs = &tcg_ctx;
     tcg_cur_ctxs = 1;
     tcg_max_ctxs = 1;
 #else
-    tcg_max_ctxs = max_cpus;
-    tcg_ctxs = g_new0(TCGContext *, max_cpus);
+    tcg_max_ctxs = max_threads;
+    tcg_ctxs = g_new0(TCGContext *, max_threads);
 #endif
 
     tcg_debug_assert(!tcg_regset_test_reg(s->reserved_regs, TCG_AREG0));
@@ -687,10 +689,10 @@ static void tcg_context_init(unsigned max_cpus)
     cpu_env = temp_tcgv_ptr(ts);
 }
 
-void tcg_init(size_t tb_size, int splitwx, unsigned max_cpus)
+void tcg_init(size_t tb_size, int splitwx, unsigned max_threads)
 {
-    tcg_context_init(max_cpus);
-    tcg_region_init(tb_size, splitwx, max_cpus);
+    tcg_context_init(max_threads);
+    tcg_region_init(tb_size, splitwx, max_threads);
 }
 
 /*
@@ -1185,6 +1187,12 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_qemu_st8_i32:
         return TCG_TARGET_HAS_qemu_st8_i32;
 
+    case INDEX_op_qemu_cmpxchg_i32:
+    case INDEX_op_qemu_cmpxchg_i64:
+    case INDEX_op_qemu_atomic_i32:
+    case INDEX_op_qemu_atomic_i64:
+        return TCG_TARGET_HAS_qemu_atomic;
+
     case INDEX_op_mov_i32:
     case INDEX_op_setcond_i32:
     case INDEX_op_brcond_i32:
@@ -1679,6 +1687,12 @@ static void tcg_reg_alloc_start(TCGContext *s)
     }
 
     memset(s->reg_to_temp, 0, sizeof(s->reg_to_temp));
+
+    s->global_gen = NULL;
+    if (tcg_keep_globals) {
+        s->global_gen = tcg_malloc(sizeof(uint32_t) * s->nb_globals);
+        memset(s->global_gen, 0, sizeof(uint32_t) * s->nb_globals);
+    }
 }
 
 static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
@@ -1910,6 +1924,10 @@ static void tcg_dump_ops(TCGContext *s, bool have_prefs)
             case INDEX_op_qemu_st8_i32:
             case INDEX_op_qemu_ld_i64:
             case INDEX_op_qemu_st_i64:
+            case INDEX_op_qemu_cmpxchg_i32:
+            case INDEX_op_qemu_cmpxchg_i64:
+            case INDEX_op_qemu_atomic_i32:
+            case INDEX_op_qemu_atomic_i64:
                 {
                     MemOpIdx oi = op->args[k++];
                     MemOp op = get_memop(oi);
@@ -1970,16 +1988,14 @@ static void tcg_dump_ops(TCGContext *s, bool have_prefs)
 
         if (have_prefs || op->life) {
 
-            QemuLogFile *logfile;
+            FILE *logfile = qemu_log_lock();
 
-            rcu_read_lock();
-            logfile = qatomic_rcu_read(&qemu_logfile);
             if (logfile) {
                 for (; col < 40; ++col) {
-                    putc(' ', logfile->fd);
+                    putc(' ', logfile);
                 }
             }
-            rcu_read_unlock();
+            qemu_log_unlock(logfile);
         }
 
         if (op->life) {
@@ -2161,26 +2177,28 @@ static void process_op_defs(TCGContext *s)
     }
 }
 
-void tcg_op_remove(TCGContext *s, TCGOp *op)
+/* The label that @op branches to, or NULL if it is not a branch.  */
+static TCGLabel *op_branch_label(TCGOp *op)
 {
-    TCGLabel *label;
-
     switch (op->opc) {
     case INDEX_op_br:
-        label = arg_label(op->args[0]);
-        label->refs--;
-        break;
+        return arg_label(op->args[0]);
     case INDEX_op_brcond_i32:
     case INDEX_op_brcond_i64:
-        label = arg_label(op->args[3]);
-        label->refs--;
-        break;
+        return arg_label(op->args[3]);
     case INDEX_op_brcond2_i32:
-        label = arg_label(op->args[5]);
-        label->refs--;
-        break;
+        return arg_label(op->args[5]);
     default:
-        break;
+        return NULL;
+    }
+}
+
+void tcg_op_remove(TCGContext *s, TCGOp *op)
+{
+    TCGLabel *label = op_branch_label(op);
+
+    if (label) {
+        label->refs--;
     }
 
     QTAILQ_REMOVE(&s->ops, op, link);
@@ -2397,14 +2415,10 @@ static void la_global_sync(TCGContext *s, int ng)
     }
 }
 
-/*
- * liveness analysis: conditional branch: all temps are dead,
- * globals and local temps should be synced.
- */
-static void la_bb_sync(TCGContext *s, int ng, int nt)
+/* liveness analysis: at a conditional branch, temps are dead and
+   local temps synced.  */
+static void la_bb_sync_temps(TCGContext *s, int ng, int nt)
 {
-    la_global_sync(s, ng);
-
     for (int i = ng; i < nt; ++i) {
         TCGTemp *ts = &s->temps[i];
         int state;
@@ -2429,6 +2443,93 @@ static void la_bb_sync(TCGContext *s, int ng, int nt)
     }
 }
 
+/*
+ * liveness analysis: conditional branch: all temps are dead,
+ * globals and local temps should be synced.
+ */
+static void la_bb_sync(TCGContext *s, int ng, int nt)
+{
+    la_global_sync(s, ng);
+    la_bb_sync_temps(s, ng, nt);
+}
+
+/*
+ * liveness analysis: conditional branch to a label further down, whose
+ * state was saved by la_label_sync.  A global has to be in memory, or
+ * kept alive, only if it has to on either path; so a value that both
+ * overwrite, e.g. a guest condition flag that only conditional code
+ * separates from the next flag-setting instruction, is not even
+ * computed.
+ */
+static void la_fwd_branch(TCGContext *s, TCGLabel *l, int ng, int nt)
+{
+    for (int i = 0; i < ng; ++i) {
+        TCGTemp *ts = &s->temps[i];
+        int state = ts->state;
+        int label_state = l->la_state[i];
+
+        ts->state = (state & label_state & TS_DEAD) |
+                    ((state | label_state) & TS_MEM);
+        if (state == TS_DEAD && ts->state != TS_DEAD) {
+            la_reset_pref(ts);
+        }
+    }
+    la_bb_sync_temps(s, ng, nt);
+}
+
+/*
+ * liveness analysis: label that is only reached by forward branches,
+ * which are conditional branches or br.  Globals that are used later
+ * must be in memory, since the register allocator may free them here;
+ * with @keep they may also stay in a register (see tcg_reg_alloc_label).
+ * Dead globals need not be stored at all: every path from here
+ * overwrites them first.  Indirect globals, local temps and temps are
+ * handled as at the end of a basic block.  The state of the globals is
+ * saved for la_fwd_branch.
+ */
+static void la_label_sync(TCGContext *s, TCGLabel *l, int ng, int nt,
+                          bool keep)
+{
+    for (int i = 0; i < nt; ++i) {
+        TCGTemp *ts = &s->temps[i];
+        int state = ts->state;
+
+        switch (ts->kind) {
+        case TEMP_GLOBAL:
+            if (!ts->indirect_reg) {
+                if (state & TS_DEAD) {
+                    continue;
+                }
+                if (keep) {
+                    ts->state = state | TS_MEM;
+                    continue;
+                }
+                ts->state = TS_DEAD | TS_MEM;
+                break;
+            }
+            /* fall through */
+        case TEMP_FIXED:
+        case TEMP_LOCAL:
+            ts->state = TS_DEAD | TS_MEM;
+            break;
+        case TEMP_NORMAL:
+        case TEMP_CONST:
+            ts->state = TS_DEAD;
+            break;
+        default:
+            g_assert_not_reached();
+        }
+        la_reset_pref(ts);
+    }
+
+    if (!l->la_state) {
+        l->la_state = tcg_malloc(ng);
+    }
+    for (int i = 0; i < ng; ++i) {
+        l->la_state[i] = s->temps[i].state;
+    }
+}
+
 /* liveness analysis: sync globals back to memory and kill.  */
 static void la_global_kill(TCGContext *s, int ng)
 {
@@ -2470,6 +2571,7 @@ static void liveness_pass_1(TCGContext *s)
     int nb_globals = s->nb_globals;
     int nb_temps = s->nb_temps;
     TCGOp *op, *op_prev;
+    TCGLabel *label;
     TCGRegSet *prefs;
     int i;
 
@@ -2478,6 +2580,11 @@ static void liveness_pass_1(TCGContext *s)
         s->temps[i].state_ptr = prefs + i;
     }
 
+    QSIMPLEQ_FOREACH(label, &s->labels, next) {
+        label->la_seen = false;
+        label->backward = false;
+    }
+
     /* ??? Should be redundant with the exit_tb that ends the TB.  */
     la_func_end(s, nb_globals, nb_temps);
 
@@ -2702,11 +2809,33 @@ static void liveness_pass_1(TCGContext *s)
                 la_reset_pref(ts);
             }
 
+            /*
+             * Walking backwards, a branch is met before its label only
+             * if it jumps back to it.
+             */
+            label = op_branch_label(op);
+            if (label && !label->la_seen) {
+                label->backward = true;
+            }
+
             /* If end of basic block, update.  */
             if (def->flags & TCG_OPF_BB_EXIT) {
                 la_func_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_COND_BRANCH) {
-                la_bb_sync(s, nb_globals, nb_temps);
+                if (label->la_seen) {
+                    la_fwd_branch(s, label, nb_globals, nb_temps);
+                } else {
+                    la_bb_sync(s, nb_globals, nb_temps);
+                }
+            } else if (opc == INDEX_op_set_label) {
+                label = arg_label(op->args[0]);
+                label->la_seen = true;
+                if (!label->backward) {
+                    la_label_sync(s, label, nb_globals, nb_temps,
+                                  tcg_keep_globals);
+                } else {
+                    la_bb_end(s, nb_globals, nb_temps);
+                }
             } else if (def->flags & TCG_OPF_BB_END) {
                 la_bb_end(s, nb_globals, nb_temps);
             } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
@@ -3327,8 +3456,8 @@ static void sync_globals(TCGContext *s, TCGRegSet allocated_regs)
 }
 
 /* at the end of a basic block, we assume all temporaries are dead and
-   all globals are stored at their canonical location. */
-static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
+   local temps are stored at their canonical location. */
+static void tcg_reg_alloc_bb_end_temps(TCGContext *s, TCGRegSet allocated_regs)
 {
     int i;
 
@@ -3352,18 +3481,113 @@ static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
             g_assert_not_reached();
         }
     }
+}
 
+/* at the end of a basic block, we assume all temporaries are dead and
+   all globals are stored at their canonical location. */
+static void tcg_reg_alloc_bb_end(TCGContext *s, TCGRegSet allocated_regs)
+{
+    tcg_reg_alloc_bb_end_temps(s, allocated_regs);
     save_globals(s, allocated_regs);
 }
 
+/*
+ * Remember where a forward branch to @l leaves the globals.  Only those
+ * that all the branches leave synced in the same register, and that are
+ * not written before the label, can stay in their register there.
+ */
+static void tcg_reg_alloc_branch(TCGContext *s, TCGLabel *l)
+{
+    int i, n = s->nb_globals;
+
+    if (!s->global_gen || l->backward) {
+        return;
+    }
+    if (!l->fwd) {
+        l->fwd = tcg_malloc(sizeof(TCGLabelGlobal) * n);
+    }
+    for (i = 0; i < n; i++) {
+        TCGTemp *ts = &s->temps[i];
+        int reg = -1;
+
+        if (ts->kind == TEMP_GLOBAL && !ts->indirect_reg &&
+            ts->val_type == TEMP_VAL_REG && ts->mem_coherent) {
+            reg = ts->reg;
+        }
+        if (l->nb_fwd == 0) {
+            l->fwd[i].reg = reg;
+            l->fwd[i].gen = s->global_gen[i];
+        } else if (l->fwd[i].reg != reg ||
+                   l->fwd[i].gen != s->global_gen[i]) {
+            l->fwd[i].reg = -1;
+        }
+    }
+    l->nb_fwd++;
+}
+
+/* Note the globals that @op writes, for tcg_reg_alloc_branch.  */
+static void tcg_reg_alloc_note_writes(TCGContext *s, TCGOp *op)
+{
+    int i, nb_oargs;
+
+    if (op->opc == INDEX_op_call) {
+        nb_oargs = TCGOP_CALLO(op);
+        if (!(tcg_call_flags(op) & TCG_CALL_NO_WRITE_GLOBALS)) {
+            for (i = 0; i < s->nb_globals; i++) {
+                s->global_gen[i]++;
+            }
+            return;
+        }
+    } else {
+        nb_oargs = tcg_op_defs[op->opc].nb_oargs;
+    }
+    for (i = 0; i < nb_oargs; i++) {
+        TCGTemp *ts = arg_temp(op->args[i]);
+
+        if (ts->kind == TEMP_GLOBAL) {
+            s->global_gen[temp_idx(ts)]++;
+        }
+    }
+}
+
+/*
+ * At a label, all temporaries are dead and local temps are stored as at
+ * the end of any basic block.  If only forward branches reach it, the
+ * globals that are in the same register on all paths stay there, and
+ * the others go back to memory.  Liveness made sure that the globals
+ * still needed are synced.
+ */
+static void tcg_reg_alloc_label(TCGContext *s, TCGLabel *l)
+{
+    bool keep = s->global_gen && !l->backward && l->nb_fwd == l->refs;
+    int i;
+
+    tcg_reg_alloc_bb_end_temps(s, s->reserved_regs);
+
+    for (i = 0; i < s->nb_globals; i++) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (ts->kind != TEMP_GLOBAL || ts->val_type != TEMP_VAL_REG) {
+            continue;
+        }
+        /* If not synced, the global is dead: see la_label_sync.  */
+        if (keep && ts->mem_coherent && (l->nb_fwd == 0 ||
+                     (l->fwd[i].reg == ts->reg &&
+                      l->fwd[i].gen == s->global_gen[i]))) {
+            continue;
+        }
+        temp_free_or_dead(s, ts, -1);
+    }
+}
+
 /*
  * At a conditional branch, we assume all temporaries are dead and
- * all globals and local temps are synced to their location.
+ * local temps are synced to their location.  So are the globals,
+ * except for those that liveness found dead on the branch target
+ * (see la_fwd_branch): their register may be dirty.
  */
 static void tcg_reg_alloc_cbranch(TCGContext *s, TCGRegSet allocated_regs)
 {
-    sync_globals(s, allocated_regs);
-
     for (int i = s->nb_globals; i < s->nb_temps; i++) {
         TCGTemp *ts = &s->temps[i];
         /*
@@ -4317,7 +4541,7 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             temp_dead(s, arg_temp(op->args[0]));
             break;
         case INDEX_op_set_label:
-            tcg_reg_alloc_bb_end(s, s->reserved_regs);
+            tcg_reg_alloc_label(s, arg_label(op->args[0]));
             tcg_out_label(s, arg_label(op->args[0]));
             break;
         case INDEX_op_call:
@@ -4337,6 +4561,14 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb)
             tcg_reg_alloc_op(s, op);
             break;
         }
+        if (s->global_gen) {
+            TCGLabel *l = op_branch_label(op);
+
+            if (l) {
+                tcg_reg_alloc_branch(s, l);
+            }
+            tcg_reg_alloc_note_writes(s, op);
+        }
 #ifdef CONFIG_DEBUG_TCG
         check_regs(s);
 #endif
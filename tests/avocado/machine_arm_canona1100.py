@@ -8,6 +8,12 @@
 # This work is licensed under the terms of the GNU GPL, version 2 or
 # later.  See the COPYING file in the top-level directory.
 
+import json
+import os
+import re
+import time
+
+from avocado import skipUnless
 from avocado_qemu import QemuSystemTest
 from avocado_qemu import wait_for_console_pattern
 from avocado.utils import archive
@@ -17,12 +23,7 @@ class CanonA1100Machine(QemuSystemTest):
 
     timeout = 90
 
-    def test_arm_canona1100(self):
-        """
-        :avocado: tags=arch:arm
-        :avocado: tags=machine:canon-a1100
-        :avocado: tags=device:pflash_cfi02
-        """
+    def launch_barebox(self, *args):
         tar_url = ('https://www.qemu-advent-calendar.org'
                    '/2018/download/day18.tar.xz')
         tar_hash = '068b5fc4242b29381acee94713509f8a876e9db6'
@@ -30,6 +31,65 @@ def test_arm_canona1100(self):
         archive.extract(file_path, self.workdir)
         self.vm.set_console()
         self.vm.add_args('-bios',
-                         self.workdir + '/day18/barebox.canon-a1100.bin')
+                         self.workdir + '/day18/barebox.canon-a1100.bin',
+                         *args)
         self.vm.launch()
+
+    def test_arm_canona1100(self):
+        """
+        :avocado: tags=arch:arm
+        :avocado: tags=machine:canon-a1100
+        :avocado: tags=device:pflash_cfi02
+        """
+        self.launch_barebox()
         wait_for_console_pattern(self, 'running /env/bin/init')
+
+    def jit_counter(self, text, name):
+        match = re.search(r'^%s\s+(\d+)' % name, text, re.MULTILINE)
+        return int(match.group(1)) if match else None
+
+    @skipUnless(os.getenv('QEMU_BENCHMARK'), 'benchmarks are opt-in')
+    def test_arm_canona1100_boot_time(self):
+        """
+        Time the phases of the boot, and write them to boot-time.json
+        in the output directory of the test.  If QEMU_BOOT_TIME_MAX is
+        set, fail when reaching the shell prompt takes longer than that
+        many seconds.
+
+        :avocado: tags=arch:arm
+        :avocado: tags=machine:canon-a1100
+        :avocado: tags=device:pflash_cfi02
+        :avocado: tags=benchmark
+        """
+        start = time.monotonic()
+        self.launch_barebox('-S')
+        self.vm.command('cont')
+        first_insn = time.monotonic() - start
+
+        self.vm.console_socket.recv(1)
+        first_uart_byte = time.monotonic() - start
+        wait_for_console_pattern(self, 'running /env/bin/init')
+        init = time.monotonic() - start
+
+        jit = self.vm.command('x-query-jit')['human-readable-text']
+        with open('/proc/%d/stat' % self.vm.get_pid()) as stat:
+            # utime and stime, after the parenthesized command name
+            fields = stat.read().rsplit(')', 1)[1].split()
+            cpu_time = (int(fields[11]) + int(fields[12])) / \
+                       os.sysconf('SC_CLK_TCK')
+
+        result = {
+            'first-insn': round(first_insn, 3),
+            'first-uart-byte': round(first_uart_byte, 3),
+            'init': round(init, 3),
+            'tb-count': self.jit_counter(jit, 'TB count'),
+            'tb-flush-count': self.jit_counter(jit, 'TB flush count'),
+            'cpu-time': round(cpu_time, 3),
+        }
+        self.log.info('boot time: %s', json.dumps(result))
+        with open(os.path.join(self.outputdir, 'boot-time.json'), 'w') as f:
+            json.dump(result, f)
+
+        limit = os.getenv('QEMU_BOOT_TIME_MAX')
+        if limit:
+            self.assertLessEqual(init, float(limit))
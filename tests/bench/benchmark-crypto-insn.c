@@ -0,0 +1,193 @@
+/*
+ * Speed benchmark of the AES and SHA instruction primitives
+ *
+ * Measures the throughput a guest gets from the AESE/AESMC and
+ * SHA256H/SHA256H2 instructions, by running AES-128 encryption and the
+ * SHA-256 compression function the way Arm code using the Crypto
+ * Extensions does, with each implementation the host supports.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "crypto/aes.h"
+#include "crypto/insn.h"
+
+#define BENCH_BUF_SIZE  (64 * KiB)
+#define BENCH_TOTAL     (256 * MiB)
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha256_h0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+/* AES-128 with the round keys in @rk, as AESE and AESMC run it */
+static void aes128_encrypt(uint8_t *out, const uint8_t *in,
+                           const uint64_t rk[11][2])
+{
+    uint64_t st[2] = { ldq_le_p(in), ldq_le_p(in + 8) };
+    int r;
+
+    for (r = 0; r < 9; r++) {
+        crypto_insn_aese(st, st, rk[r], false);
+        crypto_insn_aesmc(st, st, false);
+    }
+    crypto_insn_aese(st, st, rk[9], false);
+    stq_le_p(out, st[0] ^ rk[10][0]);
+    stq_le_p(out + 8, st[1] ^ rk[10][1]);
+}
+
+/* One 64-byte block of SHA-256, as SHA256H and SHA256H2 run it */
+static void sha256_block(uint32_t *h, const uint8_t *blk)
+{
+    uint64_t abcd[2], efgh[2], wk[2];
+    uint32_t w[64];
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = ldl_be_p(blk + 4 * i);
+    }
+    for (i = 16; i < 64; i++) {
+        uint32_t s0 = ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^
+                      (w[i - 15] >> 3);
+        uint32_t s1 = ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^
+                      (w[i - 2] >> 10);
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    abcd[0] = deposit64(h[0], 32, 32, h[1]);
+    abcd[1] = deposit64(h[2], 32, 32, h[3]);
+    efgh[0] = deposit64(h[4], 32, 32, h[5]);
+    efgh[1] = deposit64(h[6], 32, 32, h[7]);
+    for (i = 0; i < 64; i += 4) {
+        wk[0] = deposit64(w[i] + sha256_k[i], 32, 32,
+                          w[i + 1] + sha256_k[i + 1]);
+        wk[1] = deposit64(w[i + 2] + sha256_k[i + 2], 32, 32,
+                          w[i + 3] + sha256_k[i + 3]);
+        crypto_insn_sha256(abcd, efgh, wk);
+    }
+    for (i = 0; i < 4; i++) {
+        h[i] += (i < 2 ? abcd[0] : abcd[1]) >> (i % 2 * 32);
+        h[i + 4] += (i < 2 ? efgh[0] : efgh[1]) >> (i % 2 * 32);
+    }
+}
+
+static void bench_aes(uint8_t *buf)
+{
+    uint8_t key[16], rkbytes[16], out[16], ref[16];
+    uint64_t rk[11][2];
+    AES_KEY aes;
+    size_t i, done;
+    int r, j;
+
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = g_test_rand_int();
+    }
+    AES_set_encrypt_key(key, 128, &aes);
+    for (r = 0; r < 11; r++) {
+        for (j = 0; j < 4; j++) {
+            stl_be_p(rkbytes + 4 * j, aes.rd_key[4 * r + j]);
+        }
+        rk[r][0] = ldq_le_p(rkbytes);
+        rk[r][1] = ldq_le_p(rkbytes + 8);
+    }
+
+    /* Check against the AES implementation of QEMU */
+    for (i = 0; i < BENCH_BUF_SIZE; i += 16) {
+        aes128_encrypt(out, buf + i, rk);
+        AES_encrypt(buf + i, ref, &aes);
+        g_assert(!memcmp(out, ref, sizeof(out)));
+    }
+
+    g_test_timer_start();
+    for (done = 0; done < BENCH_TOTAL; done += BENCH_BUF_SIZE) {
+        for (i = 0; i < BENCH_BUF_SIZE; i += 16) {
+            aes128_encrypt(buf + i, buf + i, rk);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("crypto-insn: %s, aes-128 encrypt, %.2f MB/sec",
+                   crypto_insn_accel_name(),
+                   (double)BENCH_TOTAL / MiB / g_test_timer_last());
+}
+
+static void bench_sha256(const uint8_t *buf)
+{
+    static const uint32_t abc_digest[8] = {
+        0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+        0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad,
+    };
+    /* "abc", padded, with its length in bits at the end */
+    uint8_t abc[64] = { 'a', 'b', 'c', 0x80, [63] = 24 };
+    uint32_t h[8];
+    size_t i, done;
+
+    memcpy(h, sha256_h0, sizeof(h));
+    sha256_block(h, abc);
+    g_assert(!memcmp(h, abc_digest, sizeof(h)));
+
+    memcpy(h, sha256_h0, sizeof(h));
+    g_test_timer_start();
+    for (done = 0; done < BENCH_TOTAL; done += BENCH_BUF_SIZE) {
+        for (i = 0; i < BENCH_BUF_SIZE; i += 64) {
+            sha256_block(h, buf + i);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("crypto-insn: %s, sha-256, %.2f MB/sec",
+                   crypto_insn_accel_name(),
+                   (double)BENCH_TOTAL / MiB / g_test_timer_last());
+}
+
+/*
+ * The implementations are measured from the one picked on this host
+ * down to the portable one, which comes last.
+ */
+static void test_insn_speed(void)
+{
+    uint8_t *buf = g_malloc(BENCH_BUF_SIZE);
+    size_t i;
+
+    for (i = 0; i < BENCH_BUF_SIZE; i++) {
+        buf[i] = g_test_rand_int();
+    }
+
+    do {
+        bench_aes(buf);
+        bench_sha256(buf);
+    } while (crypto_insn_next_accel());
+
+    g_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crypto/insn/speed", test_insn_speed);
+    return g_test_run();
+}
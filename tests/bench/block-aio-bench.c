@@ -0,0 +1,128 @@
+/*
+ * Block request path benchmark
+ *
+ * Measures how many requests per second go through a BlockBackend to
+ * the null-co driver, which completes them without doing any I/O.
+ * blk_aio_preadv() runs every request in its own coroutine; issuing
+ * the same requests from one coroutine with blk_co_preadv() shows how
+ * much of the cost is the per-request coroutine.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "sysemu/block-backend.h"
+#include "qapi/error.h"
+#include "qapi/qmp/qdict.h"
+#include "qemu/main-loop.h"
+
+#define BENCH_REQUESTS      2000000
+#define BENCH_QUEUE_DEPTH   64
+#define BENCH_REQUEST_SIZE  4096
+
+typedef struct BenchState {
+    BlockBackend *blk;
+    QEMUIOVector qiov;
+    int submitted;
+    int completed;
+    bool done;
+} BenchState;
+
+static BlockBackend *bench_open(void)
+{
+    QDict *opts = qdict_new();
+
+    qdict_put_str(opts, "driver", "null-co");
+    qdict_put_int(opts, "size", 1ULL << 30);
+    qdict_put_bool(opts, "read-zeroes", false);
+    return blk_new_open(NULL, NULL, opts, BDRV_O_RDWR, &error_abort);
+}
+
+static int64_t bench_offset(int n)
+{
+    return (int64_t)(n % 1024) * BENCH_REQUEST_SIZE;
+}
+
+static void bench_aio_cb(void *opaque, int ret)
+{
+    BenchState *s = opaque;
+
+    g_assert_cmpint(ret, ==, 0);
+    s->completed++;
+    if (s->submitted < BENCH_REQUESTS) {
+        blk_aio_preadv(s->blk, bench_offset(s->submitted++), &s->qiov, 0,
+                       bench_aio_cb, s);
+    }
+}
+
+static void coroutine_fn bench_co_entry(void *opaque)
+{
+    BenchState *s = opaque;
+
+    while (s->submitted < BENCH_REQUESTS) {
+        int ret = blk_co_preadv(s->blk, bench_offset(s->submitted++),
+                                BENCH_REQUEST_SIZE, &s->qiov, 0);
+
+        g_assert_cmpint(ret, ==, 0);
+        s->completed++;
+    }
+    s->done = true;
+}
+
+static void bench_report(const char *path, BenchState *s)
+{
+    g_test_message("block: %s, %.2f Miops (%d bytes)", path,
+                   s->completed / g_test_timer_last() / 1e6,
+                   BENCH_REQUEST_SIZE);
+}
+
+static void test_aio_speed(void)
+{
+    BenchState s = { .blk = bench_open() };
+    void *buf = g_malloc(BENCH_REQUEST_SIZE);
+    int i;
+
+    qemu_iovec_init_buf(&s.qiov, buf, BENCH_REQUEST_SIZE);
+    g_test_timer_start();
+    for (i = 0; i < BENCH_QUEUE_DEPTH; i++) {
+        blk_aio_preadv(s.blk, bench_offset(s.submitted++), &s.qiov, 0,
+                       bench_aio_cb, &s);
+    }
+    while (s.completed < BENCH_REQUESTS) {
+        aio_poll(qemu_get_aio_context(), true);
+    }
+    g_test_timer_elapsed();
+    bench_report("blk_aio_preadv, coroutine per request", &s);
+
+    blk_unref(s.blk);
+    g_free(buf);
+}
+
+static void test_co_speed(void)
+{
+    BenchState s = { .blk = bench_open() };
+    void *buf = g_malloc(BENCH_REQUEST_SIZE);
+
+    qemu_iovec_init_buf(&s.qiov, buf, BENCH_REQUEST_SIZE);
+    g_test_timer_start();
+    qemu_coroutine_enter(qemu_coroutine_create(bench_co_entry, &s));
+    while (!s.done) {
+        aio_poll(qemu_get_aio_context(), true);
+    }
+    g_test_timer_elapsed();
+    bench_report("blk_co_preadv, one coroutine", &s);
+
+    blk_unref(s.blk);
+    g_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/block/benchmark/aio", test_aio_speed);
+    g_test_add_func("/block/benchmark/co", test_co_speed);
+    return g_test_run();
+}
@@ -0,0 +1,57 @@
+/*
+ * buffer_is_zero speed benchmark
+ *
+ * Measures every accelerator available on the host, from the preferred
+ * one (accel 0) down to the plain integer loop, for the sizes used by RAM
+ * migration (pages) and by qemu-img convert (clusters).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/units.h"
+
+#define BUFFER_SIZE     (64 * MiB)
+#define BUFFER_PASSES   16
+
+/*
+ * test_buffer_is_zero_next_accel() cannot go back to a better accelerator,
+ * so all the sizes are measured for one before moving to the next.
+ */
+static void test_bufferiszero_speed(void)
+{
+    static const size_t sizes[] = { 4 * KiB, 64 * KiB, 2 * MiB };
+    g_autofree char *buf = g_malloc0(BUFFER_SIZE);
+    int accel = 0;
+
+    do {
+        int n;
+
+        for (n = 0; n < ARRAY_SIZE(sizes); n++) {
+            size_t len = sizes[n];
+            size_t i;
+            int pass;
+
+            g_test_timer_start();
+            for (pass = 0; pass < BUFFER_PASSES; pass++) {
+                for (i = 0; i + len <= BUFFER_SIZE; i += len) {
+                    g_assert(buffer_is_zero(buf + i, len));
+                }
+            }
+            g_test_timer_elapsed();
+            g_test_message("bufferiszero: accel %d, %zu bytes, %.2f GB/s",
+                           accel, len,
+                           (double)BUFFER_SIZE * BUFFER_PASSES /
+                           g_test_timer_last() / 1e9);
+        }
+        accel++;
+    } while (test_buffer_is_zero_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/cutils/bufferiszero/speed", test_bufferiszero_speed);
+    return g_test_run();
+}
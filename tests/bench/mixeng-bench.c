@@ -0,0 +1,172 @@
+/*
+ * Audio mixing engine speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "audio/audio.h"
+#include "audio/audio_int.h"
+
+/* 10 ms of 48 kHz audio, the usual period of the audio timer */
+#define MIXENG_SAMPLES  480
+#define MIXENG_ROUNDS   20000
+
+/*
+ * mixeng.c is built into the benchmark on its own; these stand in for
+ * what it uses from audio.c.
+ */
+const struct mixeng_volume nominal_volume = {
+    .mute = 0,
+#ifdef FLOAT_MIXENG
+    .r = 1.0,
+    .l = 1.0,
+#else
+    .r = 1ULL << 32,
+    .l = 1ULL << 32,
+#endif
+};
+
+void *audio_calloc(const char *funcname, int nmemb, size_t size)
+{
+    return g_malloc0_n(nmemb, size);
+}
+
+void AUD_log(const char *cap, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+typedef struct MixengFormat {
+    const char *name;
+    int stereo;
+    int sign;
+    int swap;
+    int bits;   /* 0, 1 or 2 for 8, 16 or 32 bits, -1 for float */
+} MixengFormat;
+
+static const MixengFormat formats[] = {
+    { "u8 mono",            0, 0, 0, 0 },
+    { "s16 stereo",         1, 1, 0, 1 },
+    { "s16 stereo swapped", 1, 1, 1, 1 },
+    { "u16 stereo",         1, 0, 0, 1 },
+    { "s32 stereo",         1, 1, 0, 2 },
+    { "f32 stereo",         1, 0, 0, -1 },
+};
+
+static void report(const char *what, const char *name)
+{
+    g_test_message("mixeng: %s, %s, %.1f Msamples/sec", what, name,
+                   (double)MIXENG_SAMPLES * MIXENG_ROUNDS /
+                   g_test_timer_last() / 1e6);
+}
+
+static void test_conv_speed(void)
+{
+    uint8_t *raw = g_malloc(MIXENG_SAMPLES * 2 * 4);
+    uint8_t *out = g_malloc(MIXENG_SAMPLES * 2 * 4);
+    struct st_sample *buf = g_new(struct st_sample, MIXENG_SAMPLES);
+    size_t i;
+    int n;
+
+    for (i = 0; i < MIXENG_SAMPLES * 2 * 4; i++) {
+        raw[i] = g_test_rand_int();
+    }
+
+    for (i = 0; i < ARRAY_SIZE(formats); i++) {
+        const MixengFormat *f = &formats[i];
+        t_sample *conv;
+        f_sample *clip;
+
+        if (f->bits < 0) {
+            conv = mixeng_conv_float[f->stereo];
+            clip = mixeng_clip_float[f->stereo];
+        } else {
+            conv = mixeng_conv[f->stereo][f->sign][f->swap][f->bits];
+            clip = mixeng_clip[f->stereo][f->sign][f->swap][f->bits];
+        }
+
+        g_test_timer_start();
+        for (n = 0; n < MIXENG_ROUNDS; n++) {
+            conv(buf, raw, MIXENG_SAMPLES);
+        }
+        g_test_timer_elapsed();
+        report("conv", f->name);
+
+        g_test_timer_start();
+        for (n = 0; n < MIXENG_ROUNDS; n++) {
+            clip(out, buf, MIXENG_SAMPLES);
+        }
+        g_test_timer_elapsed();
+        report("clip", f->name);
+    }
+
+    g_free(raw);
+    g_free(out);
+    g_free(buf);
+}
+
+static void test_volume_speed(void)
+{
+    struct st_sample *buf = g_new0(struct st_sample, MIXENG_SAMPLES);
+    struct mixeng_volume nominal = nominal_volume;
+    struct mixeng_volume half = nominal_volume;
+    int n;
+
+#ifdef FLOAT_MIXENG
+    half.l = half.r = 0.5;
+#else
+    half.l = half.r = nominal_volume.l / 2;
+#endif
+
+    g_test_timer_start();
+    for (n = 0; n < MIXENG_ROUNDS; n++) {
+        mixeng_volume(buf, MIXENG_SAMPLES, &nominal);
+    }
+    g_test_timer_elapsed();
+    report("volume", "nominal");
+
+    g_test_timer_start();
+    for (n = 0; n < MIXENG_ROUNDS; n++) {
+        mixeng_volume(buf, MIXENG_SAMPLES, &half);
+    }
+    g_test_timer_elapsed();
+    report("volume", "half");
+
+    g_free(buf);
+}
+
+static void test_rate_speed(void)
+{
+    struct st_sample *ibuf = g_new0(struct st_sample, MIXENG_SAMPLES);
+    struct st_sample *obuf = g_new0(struct st_sample, MIXENG_SAMPLES * 2);
+    void *rate = st_rate_start(44100, 48000);
+    int n;
+
+    g_test_timer_start();
+    for (n = 0; n < MIXENG_ROUNDS; n++) {
+        size_t isamp = MIXENG_SAMPLES;
+        size_t osamp = MIXENG_SAMPLES * 2;
+
+        st_rate_flow_mix(rate, ibuf, obuf, &isamp, &osamp);
+    }
+    g_test_timer_elapsed();
+    report("rate", "44100 to 48000 Hz");
+
+    st_rate_stop(rate);
+    g_free(ibuf);
+    g_free(obuf);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/mixeng/benchmark/conv", test_conv_speed);
+    g_test_add_func("/mixeng/benchmark/volume", test_volume_speed);
+    g_test_add_func("/mixeng/benchmark/rate", test_rate_speed);
+    return g_test_run();
+}
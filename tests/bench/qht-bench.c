@@ -9,6 +9,7 @@
 #include "qemu/atomic.h"
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "qemu/xxhash.h"
 
 struct thread_stats {
@@ -20,6 +21,7 @@ struct thread_stats {
     size_t not_rm;
     size_t rz;
     size_t not_rz;
+    int64_t max_in_ns;
 };
 
 struct thread_info {
@@ -60,6 +62,7 @@ static double resize_rate; /* 0.0 to 1.0 */
 static unsigned int n_rz_threads = 1;
 static QemuThread *rz_threads;
 static bool precompute_hash;
+static bool grow_under_load;
 
 static double update_rate; /* 0.0 to 1.0 */
 static uint64_t update_threshold;
@@ -92,7 +95,9 @@ static const char commands_string[] =
     " -R = enable auto-resize\n"
     " -S = resize rate (0.0 to 100.0)\n"
     " -D = delay (in us) between potential resizes\n"
-    " -N = number of resize threads";
+    " -N = number of resize threads\n"
+    " -G = resizes only shrink the table, to 1/64 of the keys, and -R grows\n"
+    "      it back under load; report the longest insertion";
 
 static void usage_complete(int argc, char *argv[])
 {
@@ -144,7 +149,7 @@ static void do_rz(struct thread_info *info)
         bool resized;
 
         resized = qht_resize(&ht, size);
-        info->resize_down = !info->resize_down;
+        info->resize_down = grow_under_load || !info->resize_down;
 
         if (resized) {
             stats->rz++;
@@ -180,7 +185,15 @@ static void do_rw(struct thread_info *info)
             bool written = false;
 
             if (qht_lookup(&ht, p, hash) == NULL) {
-                written = qht_insert(&ht, p, hash, NULL);
+                if (grow_under_load) {
+                    int64_t t = get_clock();
+
+                    written = qht_insert(&ht, p, hash, NULL);
+                    t = get_clock() - t;
+                    stats->max_in_ns = MAX(stats->max_in_ns, t);
+                } else {
+                    written = qht_insert(&ht, p, hash, NULL);
+                }
             }
             if (written) {
                 stats->in++;
@@ -334,7 +347,7 @@ static void htable_init(void)
     do_threshold(resize_rate, &resize_threshold);
 
     if (resize_rate) {
-        resize_min = n / 2;
+        resize_min = grow_under_load ? MAX(n / 64, 1) : n / 2;
         resize_max = n;
         assert(resize_min < resize_max);
     } else {
@@ -383,6 +396,7 @@ static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
 
         s->rz += stats->rz;
         s->not_rz += stats->not_rz;
+        s->max_in_ns = MAX(s->max_in_ns, stats->max_in_ns);
     }
 }
 
@@ -413,6 +427,9 @@ static void pr_stats(void)
            (double)s.rm / 1e6,
            (double)s.rm / (s.rm + s.not_rm) * 100,
            (double)(s.rm + s.not_rm) / 1e6);
+    if (grow_under_load) {
+        printf(" Longest insertion: %.2f us\n", s.max_in_ns / 1e3);
+    }
 
     tx = (s.rd + s.not_rd + s.in + s.not_in + s.rm + s.not_rm) / 1e6 / duration;
     printf(" Throughput:        %.2f MT/s\n", tx);
@@ -444,7 +461,7 @@ static void parse_args(int argc, char *argv[])
     int c;
 
     for (;;) {
-        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:pr:Rs:S:u:");
+        c = getopt(argc, argv, "d:D:g:Gk:K:l:hn:N:o:pr:Rs:S:u:");
         if (c < 0) {
             break;
         }
@@ -462,6 +479,9 @@ static void parse_args(int argc, char *argv[])
             qht_n_elems = atol(optarg);
             init_size = atol(optarg);
             break;
+        case 'G':
+            grow_under_load = true;
+            break;
         case 'h':
             usage_complete(argc, argv);
             exit(0);
@@ -0,0 +1,113 @@
+/*
+ * Timer list speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+
+#define TIMER_CHURN_OPS     1000000
+#define TIMER_DEADLINE_OPS  1000000
+
+typedef struct BenchTimer {
+    QEMUTimer timer;
+    int64_t expire;
+} BenchTimer;
+
+static int64_t last_expire;
+static int fired;
+
+static void bench_notify(void *opaque, QEMUClockType type)
+{
+}
+
+static void bench_timer_cb(void *opaque)
+{
+    BenchTimer *bt = opaque;
+
+    g_assert_cmpint(bt->expire, >=, last_expire);
+    last_expire = bt->expire;
+    fired++;
+}
+
+/*
+ * Arm @n timers, then move random ones around as devices do when they
+ * reprogram their timers, and check that they fire in order.
+ */
+static void test_timer_churn(gconstpointer opaque)
+{
+    int n = GPOINTER_TO_INT(opaque);
+    QEMUTimerList *tl = timerlist_new(QEMU_CLOCK_REALTIME, bench_notify, NULL);
+    QEMUTimerListGroup tlg = { .tl = { [QEMU_CLOCK_REALTIME] = tl } };
+    BenchTimer *timers = g_new0(BenchTimer, n);
+    /* Far enough in the future that nothing expires while measuring */
+    int64_t base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                   3600 * NANOSECONDS_PER_SECOND;
+    int64_t deadline = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        timer_init_full(&timers[i].timer, &tlg, QEMU_CLOCK_REALTIME,
+                        SCALE_NS, 0, bench_timer_cb, &timers[i]);
+        timers[i].expire = base + g_test_rand_int_range(0, INT32_MAX);
+        timer_mod_ns(&timers[i].timer, timers[i].expire);
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < TIMER_CHURN_OPS; i++) {
+        BenchTimer *bt = &timers[g_test_rand_int_range(0, n)];
+
+        if (i & 1) {
+            bt->expire = base + g_test_rand_int_range(0, INT32_MAX);
+            timer_mod_ns(&bt->timer, bt->expire);
+        } else {
+            timer_del(&bt->timer);
+        }
+    }
+    g_test_timer_elapsed();
+    g_test_message("timer: %d timers, %.1f Mops/sec for arm/disarm",
+                   n, TIMER_CHURN_OPS / g_test_timer_last() / 1e6);
+
+    g_test_timer_start();
+    for (i = 0; i < TIMER_DEADLINE_OPS; i++) {
+        deadline = MAX(deadline, timerlist_deadline_ns(tl));
+    }
+    g_test_timer_elapsed();
+    g_test_message("timer: %d timers, %.1f Mops/sec for the deadline",
+                   n, TIMER_DEADLINE_OPS / g_test_timer_last() / 1e6);
+    g_assert_cmpint(deadline, >, 0);
+
+    /* Move everything to the past and let it fire */
+    for (i = 0; i < n; i++) {
+        timers[i].expire = g_test_rand_int_range(0, INT32_MAX);
+        timer_mod_ns(&timers[i].timer, timers[i].expire);
+    }
+    last_expire = 0;
+    fired = 0;
+    timerlist_run_timers(tl);
+    g_assert_cmpint(fired, ==, n);
+    g_assert(!timerlist_has_timers(tl));
+
+    for (i = 0; i < n; i++) {
+        timer_deinit(&timers[i].timer);
+    }
+    g_free(timers);
+    timerlist_free(tl);
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = { 16, 256, 4096, 65536 };
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+    init_clocks(bench_notify);
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        g_autofree char *path = g_strdup_printf("/timer/benchmark/churn/%d",
+                                                sizes[i]);
+        g_test_add_data_func(path, GINT_TO_POINTER(sizes[i]),
+                             test_timer_churn);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,67 @@
+/*
+ * XBZRLE encoder speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define XBZRLE_PAGE_SIZE 4096
+
+/* Runs of changed bytes per page */
+static const int changes[] = { 0, 2, 16, 64, 256 };
+
+/*
+ * The encoders are numbered from the one xbzrle_encode_buffer() picks
+ * on this host down to the generic one, which comes last.
+ */
+static void test_encode_speed(void)
+{
+    const size_t total = 1 * GiB;
+    uint8_t *old = qemu_memalign(64, XBZRLE_PAGE_SIZE);
+    uint8_t *new = qemu_memalign(64, XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int accel = 0;
+    size_t done;
+    int i, j;
+
+    do {
+        for (i = 0; i < ARRAY_SIZE(changes); i++) {
+            for (j = 0; j < XBZRLE_PAGE_SIZE; j++) {
+                old[j] = g_test_rand_int();
+            }
+            memcpy(new, old, XBZRLE_PAGE_SIZE);
+            for (j = 0; j < changes[i]; j++) {
+                int offset = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE - 8);
+
+                memset(new + offset, g_test_rand_int(),
+                       g_test_rand_int_range(1, 8));
+            }
+
+            g_test_timer_start();
+            for (done = 0; done < total; done += XBZRLE_PAGE_SIZE) {
+                xbzrle_encode_buffer(old, new, XBZRLE_PAGE_SIZE, compressed,
+                                     XBZRLE_PAGE_SIZE);
+            }
+            g_test_timer_elapsed();
+
+            g_test_message("xbzrle: encoder %d, %d changes per page, "
+                           "%.2f MB/sec", accel, changes[i],
+                           total / MiB / g_test_timer_last());
+        }
+        accel++;
+    } while (xbzrle_encode_next_accel());
+
+    qemu_vfree(old);
+    qemu_vfree(new);
+    g_free(compressed);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/xbzrle/benchmark/encode", test_encode_speed);
+    return g_test_run();
+}
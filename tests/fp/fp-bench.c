@@ -15,6 +15,7 @@
 #include <fenv.h>
 #include "qemu/timer.h"
 #include "qemu/int128.h"
+#include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
 /* amortize the computation of random inputs */
@@ -34,6 +35,9 @@ enum op {
     OP_FMA,
     OP_SQRT,
     OP_CMP,
+    OP_MAXNUM,
+    OP_TOINT,
+    OP_CVT,
     OP_MAX_NR,
 };
 
@@ -45,6 +49,9 @@ static const char * const op_names[] = {
     [OP_FMA] = "mulAdd",
     [OP_SQRT] = "sqrt",
     [OP_CMP] = "cmp",
+    [OP_MAXNUM] = "maxnum",
+    [OP_TOINT] = "toint32",
+    [OP_CVT] = "cvt",
     [OP_MAX_NR] = NULL,
 };
 
@@ -191,23 +198,35 @@ static void update_random_ops(int n_ops, enum precision prec)
     }
 }
 
+/*
+ * Random exponents make nearly all conversions to int32 overflow; with
+ * @int_range the operands are kept within [1, 2^31) in magnitude.
+ */
 static void fill_random(union fp *ops, int n_ops, enum precision prec,
-                        bool no_neg)
+                        bool no_neg, bool int_range)
 {
     int i;
 
     for (i = 0; i < n_ops; i++) {
+        uint64_t r = random_ops[i];
+
         switch (prec) {
         case PREC_SINGLE:
         case PREC_FLOAT32:
-            ops[i].f32 = make_float32(random_ops[i]);
+            if (int_range) {
+                r = deposit64(r, 23, 8, 127 + extract64(r, 23, 8) % 31);
+            }
+            ops[i].f32 = make_float32(r);
             if (no_neg && float32_is_neg(ops[i].f32)) {
                 ops[i].f32 = float32_chs(ops[i].f32);
             }
             break;
         case PREC_DOUBLE:
         case PREC_FLOAT64:
-            ops[i].f64 = make_float64(random_ops[i]);
+            if (int_range) {
+                r = deposit64(r, 52, 11, 1023 + extract64(r, 52, 11) % 31);
+            }
+            ops[i].f64 = make_float64(r);
             if (no_neg && float64_is_neg(ops[i].f64)) {
                 ops[i].f64 = float64_chs(ops[i].f64);
             }
@@ -215,6 +234,12 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
         case PREC_QUAD:
         case PREC_FLOAT128:
             ops[i].f128 = random_quad_ops[i];
+            if (int_range) {
+                uint64_t hi = ops[i].f128.high;
+                uint64_t exp = 16383 + extract64(hi, 48, 15) % 31;
+
+                ops[i].f128.high = deposit64(hi, 48, 15, exp);
+            }
             if (no_neg && float128_is_neg(ops[i].f128)) {
                 ops[i].f128 = float128_chs(ops[i].f128);
             }
@@ -241,7 +266,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
         update_random_ops(n_ops, prec);
         switch (prec) {
         case PREC_SINGLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float a = ops[0].f;
@@ -270,13 +295,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MAXNUM:
+                    res.f = fmaxf(a, b);
+                    break;
+                case OP_TOINT:
+                    res.u64 = (int32_t)a;
+                    break;
+                case OP_CVT:
+                    res.d = a;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_DOUBLE:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 double a = ops[0].d;
@@ -305,13 +339,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = isgreater(a, b);
                     break;
+                case OP_MAXNUM:
+                    res.d = fmax(a, b);
+                    break;
+                case OP_TOINT:
+                    res.u64 = (int32_t)a;
+                    break;
+                case OP_CVT:
+                    res.f = a;
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT32:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float32 a = ops[0].f32;
@@ -340,13 +383,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float32_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAXNUM:
+                    res.f32 = float32_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float32_to_int32_round_to_zero(a, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f64 = float32_to_float64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT64:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float64 a = ops[0].f64;
@@ -375,13 +427,22 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float64_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAXNUM:
+                    res.f64 = float64_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float64_to_int32_round_to_zero(a, &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f32 = float64_to_float32(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
             }
             break;
         case PREC_FLOAT128:
-            fill_random(ops, n_ops, prec, no_neg);
+            fill_random(ops, n_ops, prec, no_neg, op == OP_TOINT);
             t0 = get_clock();
             for (i = 0; i < OPS_PER_ITER; i++) {
                 float128 a = ops[0].f128;
@@ -410,6 +471,16 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 case OP_CMP:
                     res.u64 = float128_compare_quiet(a, b, &soft_status);
                     break;
+                case OP_MAXNUM:
+                    res.f128 = float128_maxnum(a, b, &soft_status);
+                    break;
+                case OP_TOINT:
+                    res.u64 = float128_to_int32_round_to_zero(a,
+                                                              &soft_status);
+                    break;
+                case OP_CVT:
+                    res.f64 = float128_to_float64(a, &soft_status);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -448,6 +519,9 @@ GEN_BENCH_ALL_TYPES(mul, OP_MUL, 2)
 GEN_BENCH_ALL_TYPES(div, OP_DIV, 2)
 GEN_BENCH_ALL_TYPES(fma, OP_FMA, 3)
 GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
+GEN_BENCH_ALL_TYPES(maxnum, OP_MAXNUM, 2)
+GEN_BENCH_ALL_TYPES(toint, OP_TOINT, 1)
+GEN_BENCH_ALL_TYPES(cvt, OP_CVT, 1)
 #undef GEN_BENCH_ALL_TYPES
 
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
@@ -480,6 +554,9 @@ static const bench_func_t bench_funcs[OP_MAX_NR][PREC_MAX_NR] = {
     GEN_BENCH_FUNCS(fma, OP_FMA),
     GEN_BENCH_FUNCS(sqrt, OP_SQRT),
     GEN_BENCH_FUNCS(cmp, OP_CMP),
+    GEN_BENCH_FUNCS(maxnum, OP_MAXNUM),
+    GEN_BENCH_FUNCS(toint, OP_TOINT),
+    GEN_BENCH_FUNCS(cvt, OP_CVT),
 };
 
 #undef GEN_BENCH_FUNCS
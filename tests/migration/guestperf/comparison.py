@@ -135,4 +135,67 @@ def __init__(self, name, scenarios):
         Scenario("compr-multifd-channels-64",
                  multifd=True, multifd_channels=64),
     ]),
+
+
+    # Looking at effect of the multifd compression method
+    Comparison("compr-multifd-method", scenarios = [
+        Scenario("compr-multifd-method-none",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="none"),
+        Scenario("compr-multifd-method-zlib",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="zlib"),
+        Scenario("compr-multifd-method-zstd",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="zstd"),
+    ]),
+
+
+    # Looking at each migration method against the same
+    # guest workload, dirtying a 256 MiB hot set at ~400 MiB/s
+    Comparison("method", scenarios = [
+        Scenario("method-precopy",
+                 dirty_hot_size=256, dirty_page_rate=100000),
+        Scenario("method-multifd-none",
+                 multifd=True, multifd_channels=4,
+                 dirty_hot_size=256, dirty_page_rate=100000),
+        Scenario("method-multifd-zlib",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="zlib",
+                 dirty_hot_size=256, dirty_page_rate=100000),
+        Scenario("method-multifd-zstd",
+                 multifd=True, multifd_channels=4,
+                 multifd_compression="zstd",
+                 dirty_hot_size=256, dirty_page_rate=100000),
+        Scenario("method-xbzrle",
+                 compression_xbzrle=True, compression_xbzrle_cache=50,
+                 dirty_hot_size=256, dirty_page_rate=100000),
+        Scenario("method-post-copy",
+                 post_copy=True, post_copy_iters=1,
+                 dirty_hot_size=256, dirty_page_rate=100000),
+    ]),
+
+
+    # Looking at effect of the guest dirty page rate
+    # with a fixed 256 MiB hot set
+    Comparison("dirty-page-rate", scenarios = [
+        Scenario("dirty-page-rate-10k",
+                 dirty_hot_size=256, dirty_page_rate=10000),
+        Scenario("dirty-page-rate-50k",
+                 dirty_hot_size=256, dirty_page_rate=50000),
+        Scenario("dirty-page-rate-100k",
+                 dirty_hot_size=256, dirty_page_rate=100000),
+        Scenario("dirty-page-rate-unlimited",
+                 dirty_hot_size=256),
+    ]),
+
+
+    # Looking at effect of the size of the guest hot set
+    Comparison("dirty-hot-size", scenarios = [
+        Scenario("dirty-hot-size-64m",
+                 dirty_hot_size=64),
+        Scenario("dirty-hot-size-256m",
+                 dirty_hot_size=256),
+        Scenario("dirty-hot-size-all"),
+    ]),
 ]
@@ -108,7 +108,11 @@ def _migrate_progress(self, vm):
     def _migrate(self, hardware, scenario, src, dst, connect_uri):
         src_qemu_time = []
         src_vcpu_time = []
+        dst_qemu_time = []
         src_pid = src.get_pid()
+        dst_pid = None
+        if self._dst_host == "localhost":
+            dst_pid = dst.get_pid()
 
         vcpus = src.command("query-cpus-fast")
         src_threads = []
@@ -116,13 +120,17 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
             src_threads.append(vcpu["thread-id"])
 
         # XXX how to get dst timings on remote host ?
+        def sample_timings():
+            src_qemu_time.append(self._cpu_timing(src_pid))
+            src_vcpu_time.extend(self._vcpu_timing(src_pid, src_threads))
+            if dst_pid is not None:
+                dst_qemu_time.append(self._cpu_timing(dst_pid))
 
         if self._verbose:
             print("Sleeping %d seconds for initial guest workload run" % self._sleep)
         sleep_secs = self._sleep
         while sleep_secs > 1:
-            src_qemu_time.append(self._cpu_timing(src_pid))
-            src_vcpu_time.extend(self._vcpu_timing(src_pid, src_threads))
+            sample_timings()
             time.sleep(1)
             sleep_secs -= 1
 
@@ -203,6 +211,10 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
                                ])
             resp = dst.command("migrate-set-parameters",
                                multifd_channels=scenario._multifd_channels)
+            resp = src.command("migrate-set-parameters",
+                               multifd_compression=scenario._multifd_compression)
+            resp = dst.command("migrate-set-parameters",
+                               multifd_compression=scenario._multifd_compression)
 
         resp = src.command("migrate", uri=connect_uri)
 
@@ -219,8 +231,7 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
 
             progress = self._migrate_progress(src)
             if (loop % 20) == 0:
-                src_qemu_time.append(self._cpu_timing(src_pid))
-                src_vcpu_time.extend(self._vcpu_timing(src_pid, src_threads))
+                sample_timings()
 
             if (len(progress_history) == 0 or
                 (progress_history[-1]._ram._iterations <
@@ -232,6 +243,7 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
                     dst.command("cont")
                 if progress_history[-1] != progress:
                     progress_history.append(progress)
+                sample_timings()
 
                 if progress._status == "completed":
                     if self._verbose:
@@ -239,11 +251,11 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
                     sleep_secs = self._sleep
                     while sleep_secs > 1:
                         time.sleep(1)
-                        src_qemu_time.append(self._cpu_timing(src_pid))
-                        src_vcpu_time.extend(self._vcpu_timing(src_pid, src_threads))
+                        sample_timings()
                         sleep_secs -= 1
 
-                return [progress_history, src_qemu_time, src_vcpu_time]
+                return [progress_history, src_qemu_time, src_vcpu_time,
+                        dst_qemu_time]
 
             if self._verbose and (loop % 20) == 0:
                 print("Iter %d: remain %5dMB of %5dMB (total %5dMB @ %5dMb/sec)" % (
@@ -282,7 +294,7 @@ def _migrate(self, hardware, scenario, src, dst, connect_uri):
                 resp = src.command("stop")
                 paused = True
 
-    def _get_common_args(self, hardware, tunnelled=False):
+    def _get_common_args(self, hardware, scenario, tunnelled=False):
         args = [
             "noapic",
             "edd=off",
@@ -298,6 +310,10 @@ def _get_common_args(self, hardware, tunnelled=False):
             args.append("quiet")
 
         args.append("ramsize=%s" % hardware._mem)
+        if scenario._dirty_hot_size:
+            args.append("hotsize=%d" % scenario._dirty_hot_size)
+        if scenario._dirty_page_rate:
+            args.append("pagerate=%d" % scenario._dirty_page_rate)
 
         cmdline = " ".join(args)
         if tunnelled:
@@ -328,14 +344,14 @@ def _get_common_args(self, hardware, tunnelled=False):
 
         return argv
 
-    def _get_src_args(self, hardware):
-        return self._get_common_args(hardware)
+    def _get_src_args(self, hardware, scenario):
+        return self._get_common_args(hardware, scenario)
 
-    def _get_dst_args(self, hardware, uri):
+    def _get_dst_args(self, hardware, scenario, uri):
         tunnelled = False
         if self._dst_host != "localhost":
             tunnelled = True
-        argv = self._get_common_args(hardware, tunnelled)
+        argv = self._get_common_args(hardware, scenario, tunnelled)
         return argv + ["-incoming", uri]
 
     @staticmethod
@@ -404,13 +420,13 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
         srcmonaddr = "/var/tmp/qemu-src-%d-monitor.sock" % os.getpid()
 
         src = QEMUMachine(self._binary,
-                          args=self._get_src_args(hardware),
+                          args=self._get_src_args(hardware, scenario),
                           wrapper=self._get_src_wrapper(hardware),
                           name="qemu-src-%d" % os.getpid(),
                           monitor_address=srcmonaddr)
 
         dst = QEMUMachine(self._binary,
-                          args=self._get_dst_args(hardware, uri),
+                          args=self._get_dst_args(hardware, scenario, uri),
                           wrapper=self._get_dst_wrapper(hardware),
                           name="qemu-dst-%d" % os.getpid(),
                           monitor_address=dstmonaddr)
@@ -423,6 +439,7 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
             progress_history = ret[0]
             qemu_timings = ret[1]
             vcpu_timings = ret[2]
+            dst_qemu_timings = ret[3]
             if uri[0:5] == "unix:" and os.path.exists(uri[5:]):
                 os.remove(uri[5:])
 
@@ -443,7 +460,8 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
                           Timings(qemu_timings),
                           Timings(vcpu_timings),
                           self._binary, self._dst_host, self._kernel,
-                          self._initrd, self._transport, self._sleep)
+                          self._initrd, self._transport, self._sleep,
+                          Timings(dst_qemu_timings))
         except Exception as e:
             if self._debug:
                 print("Failed: %s" % str(e))
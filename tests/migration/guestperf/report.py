@@ -38,7 +38,8 @@ def __init__(self,
                  kernel,
                  initrd,
                  transport,
-                 sleep):
+                 sleep,
+                 dst_qemu_timings=None):
 
         self._hardware = hardware
         self._scenario = scenario
@@ -52,6 +53,9 @@ def __init__(self,
         self._initrd = initrd
         self._transport = transport
         self._sleep = sleep
+        if dst_qemu_timings is None:
+            dst_qemu_timings = Timings([])
+        self._dst_qemu_timings = dst_qemu_timings
 
     def serialize(self):
         return {
@@ -67,6 +71,7 @@ def serialize(self):
             "initrd": self._initrd,
             "transport": self._transport,
             "sleep": self._sleep,
+            "dst_qemu_timings": self._dst_qemu_timings.serialize(),
         }
 
     @classmethod
@@ -83,7 +88,31 @@ def deserialize(cls, data):
             data["kernel"],
             data["initrd"],
             data["transport"],
-            data["sleep"])
+            data["sleep"],
+            Timings.deserialize(data.get("dst_qemu_timings", [])))
+
+    def summary(self):
+        """
+        Return the headline numbers of the run: total time, bytes sent,
+        downtime and the CPU time each QEMU process used, in ms.
+        """
+        def cpu_time(timings):
+            if len(timings._records) < 2:
+                return None
+            return (timings._records[-1]._value -
+                    timings._records[0]._value)
+
+        last = self._progress_history[-1]
+        return {
+            "scenario": self._scenario._name,
+            "status": last._status,
+            "total_time": last._duration,
+            "transferred_bytes": last._ram._transferred_bytes,
+            "downtime": last._downtime,
+            "iterations": last._ram._iterations,
+            "src_cpu_time": cpu_time(self._qemu_timings),
+            "dst_cpu_time": cpu_time(self._dst_qemu_timings),
+        }
 
     def to_json(self):
         return json.dumps(self.serialize(), indent=4)
@@ -30,7 +30,9 @@ def __init__(self, name,
                  auto_converge=False, auto_converge_step=10,
                  compression_mt=False, compression_mt_threads=1,
                  compression_xbzrle=False, compression_xbzrle_cache=10,
-                 multifd=False, multifd_channels=2):
+                 multifd=False, multifd_channels=2,
+                 multifd_compression="none",
+                 dirty_hot_size=0, dirty_page_rate=0):
 
         self._name = name
 
@@ -59,6 +61,11 @@ def __init__(self, name,
 
         self._multifd = multifd
         self._multifd_channels = multifd_channels
+        self._multifd_compression = multifd_compression # none, zlib or zstd
+
+        # Guest dirtying workload, zero means all of RAM / unlimited
+        self._dirty_hot_size = dirty_hot_size # MiB
+        self._dirty_page_rate = dirty_page_rate # pages per second
 
     def serialize(self):
         return {
@@ -79,6 +86,9 @@ def serialize(self):
             "compression_xbzrle_cache": self._compression_xbzrle_cache,
             "multifd": self._multifd,
             "multifd_channels": self._multifd_channels,
+            "multifd_compression": self._multifd_compression,
+            "dirty_hot_size": self._dirty_hot_size,
+            "dirty_page_rate": self._dirty_page_rate,
         }
 
     @classmethod
@@ -100,4 +110,7 @@ def deserialize(cls, data):
             data["compression_xbzrle"],
             data["compression_xbzrle_cache"],
             data["multifd"],
-            data["multifd_channels"])
+            data["multifd_channels"],
+            data.get("multifd_compression", "none"),
+            data.get("dirty_hot_size", 0),
+            data.get("dirty_page_rate", 0))
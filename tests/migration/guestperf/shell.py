@@ -20,6 +20,7 @@
 
 import argparse
 import fnmatch
+import json
 import os
 import os.path
 import platform
@@ -126,6 +127,15 @@ def __init__(self):
                             action="store_true")
         parser.add_argument("--multifd-channels", dest="multifd_channels",
                             default=2, type=int)
+        parser.add_argument("--multifd-compression", dest="multifd_compression",
+                            default="none", choices=["none", "zlib", "zstd"])
+
+        parser.add_argument("--dirty-hot-size", dest="dirty_hot_size",
+                            default=0, type=int,
+                            help="MiB of guest RAM the workload dirties")
+        parser.add_argument("--dirty-page-rate", dest="dirty_page_rate",
+                            default=0, type=int,
+                            help="Pages per second the workload dirties")
 
     def get_scenario(self, args):
         return Scenario(name="perfreport",
@@ -150,7 +160,11 @@ def get_scenario(self, args):
                         compression_xbzrle_cache=args.compression_xbzrle_cache,
 
                         multifd=args.multifd,
-                        multifd_channels=args.multifd_channels)
+                        multifd_channels=args.multifd_channels,
+                        multifd_compression=args.multifd_compression,
+
+                        dirty_hot_size=args.dirty_hot_size,
+                        dirty_page_rate=args.dirty_page_rate)
 
     def run(self, argv):
         args = self._parser.parse_args(argv)
@@ -218,6 +232,7 @@ def run(self, argv):
                     report = engine.run(hardware, scenario)
                     with open(filename, "w") as fh:
                         print(report.to_json(), file=fh)
+                    print(json.dumps(report.summary()))
         except Exception as e:
             print("Error: %s" % str(e), file=sys.stderr)
             if args.debug:
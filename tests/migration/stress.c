@@ -156,8 +156,20 @@ static unsigned long long now(void)
     return (tv.tv_sec * 1000ull) + (tv.tv_usec / 1000ull);
 }
 
-static void stressone(unsigned long long ramsizeMB)
+typedef struct StressArgs {
+    unsigned long long ramsizeMB;
+    unsigned long long hotsizeMB;
+    unsigned long long pagerate;
+} StressArgs;
+
+/*
+ * Dirty the first @hotsizeMB of @ramsizeMB over and over, at most
+ * @pagerate pages per second if it is not zero.
+ */
+static void stressone(const StressArgs *args)
 {
+    unsigned long long ramsizeMB = args->ramsizeMB;
+    unsigned long long hotsizeMB = args->hotsizeMB;
     size_t pagesPerMB = 1024 * 1024 / RAM_PAGE_SIZE;
     g_autofree char *ram = g_malloc(ramsizeMB * 1024 * 1024);
     char *ramptr;
@@ -166,6 +178,7 @@ static void stressone(unsigned long long ramsizeMB)
     char *dataptr;
     size_t nMB = 0;
     unsigned long long before, after;
+    unsigned long long start, pages = 0;
 
     /* We don't care about initial state, but we do want
      * to fault it all into RAM, otherwise the first iter
@@ -178,12 +191,12 @@ static void stressone(unsigned long long ramsizeMB)
         return;
     }
 
-    before = now();
+    before = start = now();
 
     while (1) {
 
         ramptr = ram;
-        for (i = 0; i < ramsizeMB; i++, nMB++) {
+        for (i = 0; i < hotsizeMB; i++, nMB++) {
             for (j = 0; j < pagesPerMB; j++) {
                 dataptr = data;
                 for (k = 0; k < RAM_PAGE_SIZE; k += sizeof(long long)) {
@@ -193,6 +206,17 @@ static void stressone(unsigned long long ramsizeMB)
                 }
             }
 
+            if (args->pagerate) {
+                unsigned long long due;
+
+                pages += pagesPerMB;
+                due = start + pages * 1000 / args->pagerate;
+                after = now();
+                if (due > after) {
+                    usleep((due - after) * 1000);
+                }
+            }
+
             if (nMB == 1024) {
                 after = now();
                 fprintf(stderr, "%s (%05d): INFO: %06llums copied 1 GB in %05llums\n",
@@ -207,26 +231,43 @@ static void stressone(unsigned long long ramsizeMB)
 
 static void *stressthread(void *arg)
 {
-    unsigned long long ramsizeMB = *(unsigned long long *)arg;
-
-    stressone(ramsizeMB);
+    stressone(arg);
 
     return NULL;
 }
 
-static void stress(unsigned long long ramsizeGB, int ncpus)
+static void stress(unsigned long long ramsizeGB, unsigned long long hotsizeMB,
+                   unsigned long long pagerate, int ncpus)
 {
     size_t i;
-    unsigned long long ramsizeMB = ramsizeGB * 1024 / ncpus;
+    StressArgs args = {
+        .ramsizeMB = ramsizeGB * 1024 / ncpus,
+        .hotsizeMB = hotsizeMB / ncpus,
+        .pagerate = pagerate / ncpus,
+    };
+
+    /*
+     * Zero means "no limit", so a limit that gets divided down to nothing
+     * must still be at least one unit per CPU.
+     */
+    if (hotsizeMB && !args.hotsizeMB) {
+        args.hotsizeMB = 1;
+    }
+    if (pagerate && !args.pagerate) {
+        args.pagerate = 1;
+    }
+    if (!args.hotsizeMB || args.hotsizeMB > args.ramsizeMB) {
+        args.hotsizeMB = args.ramsizeMB;
+    }
     ncpus--;
 
     for (i = 0; i < ncpus; i++) {
         pthread_t thr;
         pthread_create(&thr, NULL,
-                       stressthread,   &ramsizeMB);
+                       stressthread,   &args);
     }
 
-    stressone(ramsizeMB);
+    stressone(&args);
 }
 
 
@@ -263,14 +304,18 @@ static int mount_all(void)
 int main(int argc, char **argv)
 {
     unsigned long long ramsizeGB = 1;
+    unsigned long long hotsizeMB = 0;
+    unsigned long long pagerate = 0;
     char *end;
     int ch;
     int opt_ind = 0;
-    const char *sopt = "hr:c:";
+    const char *sopt = "hr:c:s:p:";
     struct option lopt[] = {
         { "help", no_argument, NULL, 'h' },
         { "ramsize", required_argument, NULL, 'r' },
         { "cpus", required_argument, NULL, 'c' },
+        { "hotsize", required_argument, NULL, 's' },
+        { "pagerate", required_argument, NULL, 'p' },
         { NULL, 0, NULL, 0 }
     };
     int ret;
@@ -300,9 +345,30 @@ int main(int argc, char **argv)
             }
             break;
 
+        case 's':
+            errno = 0;
+            hotsizeMB = strtoll(optarg, &end, 10);
+            if (errno != 0 || *end) {
+                fprintf(stderr, "%s (%05d): ERROR: Cannot parse hot set size %s\n",
+                        argv0, gettid(), optarg);
+                exit_failure();
+            }
+            break;
+
+        case 'p':
+            errno = 0;
+            pagerate = strtoll(optarg, &end, 10);
+            if (errno != 0 || *end) {
+                fprintf(stderr, "%s (%05d): ERROR: Cannot parse page rate %s\n",
+                        argv0, gettid(), optarg);
+                exit_failure();
+            }
+            break;
+
         case '?':
         case 'h':
-            fprintf(stderr, "%s: [--help][--ramsize GB][--cpus N]\n", argv0);
+            fprintf(stderr, "%s: [--help][--ramsize GB][--cpus N]"
+                    "[--hotsize MB][--pagerate PAGES]\n", argv0);
             exit_failure();
         }
     }
@@ -314,6 +380,12 @@ int main(int argc, char **argv)
         ret = get_command_arg_ull("ramsize", &ramsizeGB);
         if (ret < 0)
             exit_failure();
+        ret = get_command_arg_ull("hotsize", &hotsizeMB);
+        if (ret < 0)
+            exit_failure();
+        ret = get_command_arg_ull("pagerate", &pagerate);
+        if (ret < 0)
+            exit_failure();
     }
 
     if (ncpus == 0)
@@ -322,7 +394,12 @@ int main(int argc, char **argv)
     fprintf(stdout, "%s (%05d): INFO: RAM %llu GiB across %d CPUs\n",
             argv0, gettid(), ramsizeGB, ncpus);
 
-    stress(ramsizeGB, ncpus);
+    if (hotsizeMB || pagerate) {
+        fprintf(stdout, "%s (%05d): INFO: dirtying %llu MiB at %llu pages/sec\n",
+                argv0, gettid(), hotsizeMB, pagerate);
+    }
+
+    stress(ramsizeGB, hotsizeMB, pagerate, ncpus);
 
     exit_failure();
 }
@@ -0,0 +1,208 @@
+/*
+ * QTest testcase for the Canon DIGIC EDMAC engines
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+#include "qemu/cutils.h"
+
+#define EDMAC_BASE      0xc0f04000
+#define INTC_BASE       0xc0201000
+#define CPU_PATH        "/machine/camera[0]/cluster/cpu"
+
+#define NB_CHANNELS     16
+#define CH(n)           (EDMAC_BASE + (n) * 0x100)
+
+#define CTRL            0x00
+#define STATUS          0x04
+#define SRC             0x08
+#define DST             0x0c
+#define XSIZE           0x10
+#define YSIZE           0x14
+#define SRC_PITCH       0x18
+#define DST_PITCH       0x1c
+
+#define CTRL_START      (1 << 0)
+#define CTRL_IRQ_EN     (1 << 1)
+#define STATUS_DONE     (1 << 0)
+
+/* Default "bytes-per-us" of the SoC */
+#define BYTES_PER_US    200
+
+#define IRQ_EDMAC0      0x40
+#define INTC_ID         0x00
+#define INTC_ENABLE     0x04
+#define INTC_PENDING2   0x18
+
+/* The CPU input the interrupt controller drives, ARM_CPU_IRQ */
+#define CPU_IRQ         0
+
+#define SRC_ADDR        0x00100000
+#define DST_ADDR        0x00200000
+
+static void edmac_start(void)
+{
+    qtest_start("-machine canon-a1100");
+    qtest_irq_intercept_in(global_qtest, CPU_PATH);
+}
+
+static void fill(uint64_t addr, size_t len, uint8_t seed)
+{
+    g_autofree uint8_t *buf = g_malloc(len);
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = seed + i * 7;
+    }
+    memwrite(addr, buf, len);
+}
+
+static void test_reset(void)
+{
+    int i, reg;
+
+    edmac_start();
+
+    for (i = 0; i < NB_CHANNELS; i++) {
+        for (reg = CTRL; reg <= DST_PITCH; reg += 4) {
+            g_assert_cmphex(readl(CH(i) + reg), ==, 0);
+        }
+    }
+    g_assert_cmphex(readl(INTC_BASE + INTC_PENDING2), ==, 0);
+
+    qtest_end();
+}
+
+static void test_copy(void)
+{
+    const size_t len = 4096;
+    g_autofree uint8_t *src = g_malloc(len);
+    g_autofree uint8_t *dst = g_malloc(len);
+    int ch = 3;
+
+    edmac_start();
+    writel(INTC_BASE + INTC_ENABLE, IRQ_EDMAC0 + ch);
+
+    fill(SRC_ADDR, len, 0x11);
+    qtest_memset(global_qtest, DST_ADDR, 0, len);
+
+    writel(CH(ch) + SRC, SRC_ADDR);
+    writel(CH(ch) + DST, DST_ADDR);
+    writel(CH(ch) + XSIZE, len);
+    writel(CH(ch) + YSIZE, 1);
+    writel(CH(ch) + SRC_PITCH, len);
+    writel(CH(ch) + DST_PITCH, len);
+    writel(CH(ch) + CTRL, CTRL_START | CTRL_IRQ_EN);
+
+    /* Nothing happens until the transfer time has elapsed */
+    clock_step(len * 1000 / BYTES_PER_US - 1);
+    g_assert_cmphex(readl(CH(ch) + STATUS), ==, 0);
+    g_assert_cmphex(readl(CH(ch) + CTRL), ==, CTRL_START | CTRL_IRQ_EN);
+    g_assert_false(get_irq(CPU_IRQ));
+    g_assert_cmphex(readb(DST_ADDR), ==, 0);
+
+    clock_step(1);
+    g_assert_cmphex(readl(CH(ch) + STATUS), ==, STATUS_DONE);
+    g_assert_cmphex(readl(CH(ch) + CTRL), ==, CTRL_IRQ_EN);
+    memread(SRC_ADDR, src, len);
+    memread(DST_ADDR, dst, len);
+    g_assert(memcmp(src, dst, len) == 0);
+
+    g_assert_cmphex(readl(INTC_BASE + INTC_PENDING2), ==, 1u << ch);
+    g_assert_cmphex(readl(INTC_BASE + INTC_ID), ==, IRQ_EDMAC0 + ch);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    /* DONE is write 1 to clear, and takes the interrupt down with it */
+    writel(CH(ch) + STATUS, STATUS_DONE);
+    g_assert_cmphex(readl(CH(ch) + STATUS), ==, 0);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+static void test_2d(void)
+{
+    const int xsize = 16, ysize = 4, src_pitch = 64, dst_pitch = 32;
+    uint8_t src[16], dst[32];
+    int ch = 0, y;
+
+    edmac_start();
+
+    fill(SRC_ADDR, src_pitch * ysize, 0x5a);
+    qtest_memset(global_qtest, DST_ADDR, 0, dst_pitch * ysize);
+
+    writel(CH(ch) + SRC, SRC_ADDR);
+    writel(CH(ch) + DST, DST_ADDR);
+    writel(CH(ch) + XSIZE, xsize);
+    writel(CH(ch) + YSIZE, ysize);
+    writel(CH(ch) + SRC_PITCH, src_pitch);
+    writel(CH(ch) + DST_PITCH, dst_pitch);
+    writel(CH(ch) + CTRL, CTRL_START);
+
+    clock_step(xsize * ysize * 1000 / BYTES_PER_US);
+    g_assert_cmphex(readl(CH(ch) + STATUS), ==, STATUS_DONE);
+    /* Without IRQ_EN the channel doesn't interrupt */
+    g_assert_cmphex(readl(INTC_BASE + INTC_PENDING2), ==, 0);
+
+    for (y = 0; y < ysize; y++) {
+        memread(SRC_ADDR + y * src_pitch, src, xsize);
+        memread(DST_ADDR + y * dst_pitch, dst, dst_pitch);
+        g_assert(memcmp(src, dst, xsize) == 0);
+        /* The gap between destination rows is left alone */
+        g_assert(buffer_is_zero(dst + xsize, dst_pitch - xsize));
+    }
+
+    qtest_end();
+}
+
+static void test_abort(void)
+{
+    int ch = 15;
+
+    edmac_start();
+
+    qtest_memset(global_qtest, DST_ADDR, 0, 256);
+    fill(SRC_ADDR, 256, 0x33);
+
+    writel(CH(ch) + SRC, SRC_ADDR);
+    writel(CH(ch) + DST, DST_ADDR);
+    writel(CH(ch) + XSIZE, 256);
+    writel(CH(ch) + YSIZE, 1);
+    writel(CH(ch) + SRC_PITCH, 256);
+    writel(CH(ch) + DST_PITCH, 256);
+    writel(CH(ch) + CTRL, CTRL_START);
+
+    /* A busy channel can't be reprogrammed */
+    writel(CH(ch) + XSIZE, 16);
+    g_assert_cmphex(readl(CH(ch) + XSIZE), ==, 256);
+
+    /* Clearing START aborts the transfer before anything is copied */
+    writel(CH(ch) + CTRL, 0);
+    clock_step(256 * 1000 / BYTES_PER_US);
+    g_assert_cmphex(readl(CH(ch) + STATUS), ==, 0);
+    g_assert_cmphex(readl(DST_ADDR), ==, 0);
+
+    qtest_end();
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/digic-edmac/reset", test_reset);
+    qtest_add_func("/digic-edmac/copy", test_copy);
+    qtest_add_func("/digic-edmac/2d", test_2d);
+    qtest_add_func("/digic-edmac/abort", test_abort);
+
+    return g_test_run();
+}
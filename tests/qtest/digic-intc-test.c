@@ -0,0 +1,171 @@
+/*
+ * QTest testcase for the Canon DIGIC interrupt controller
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define INTC_BASE       0xc0201000
+#define INTC_PATH       "/machine/camera[0]/intc"
+#define CPU_PATH        "/machine/camera[0]/cluster/cpu"
+
+#define ID              0x00
+#define ENABLE          0x04
+#define DISABLE         0x08
+#define ACK             0x0c
+#define PENDING(n)      (0x10 + (n) * 4)
+#define ENABLED(n)      (0x20 + (n) * 4)
+
+#define NB_WORDS        4
+#define ID_NONE         0xffffffff
+
+/* The CPU input the controller drives, ARM_CPU_IRQ */
+#define CPU_IRQ         0
+
+static void intc_start(void)
+{
+    qtest_start("-machine canon-a1100");
+    qtest_irq_intercept_in(global_qtest, CPU_PATH);
+}
+
+static void intc_set_irq(int n, int level)
+{
+    qtest_set_irq_in(global_qtest, INTC_PATH, NULL, n, level);
+}
+
+static void test_reset(void)
+{
+    int i;
+
+    intc_start();
+
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, ID_NONE);
+    for (i = 0; i < NB_WORDS; i++) {
+        g_assert_cmphex(readl(INTC_BASE + PENDING(i)), ==, 0);
+        g_assert_cmphex(readl(INTC_BASE + ENABLED(i)), ==, 0);
+    }
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+static void test_enable(void)
+{
+    intc_start();
+
+    writel(INTC_BASE + ENABLE, 5);
+    writel(INTC_BASE + ENABLE, 97);
+    g_assert_cmphex(readl(INTC_BASE + ENABLED(0)), ==, 1u << 5);
+    g_assert_cmphex(readl(INTC_BASE + ENABLED(3)), ==, 1u << 1);
+
+    writel(INTC_BASE + DISABLE, 5);
+    g_assert_cmphex(readl(INTC_BASE + ENABLED(0)), ==, 0);
+
+    writel(INTC_BASE + ENABLED(1), 0xf0f0f0f0);
+    g_assert_cmphex(readl(INTC_BASE + ENABLED(1)), ==, 0xf0f0f0f0);
+
+    /* Out of range interrupt numbers are ignored */
+    writel(INTC_BASE + ENABLE, 128);
+    g_assert_cmphex(readl(INTC_BASE + ENABLED(0)), ==, 0);
+
+    qtest_end();
+}
+
+static void test_level(void)
+{
+    intc_start();
+
+    writel(INTC_BASE + ENABLE, 0x2e);
+    intc_set_irq(0x2e, 1);
+    g_assert_cmphex(readl(INTC_BASE + PENDING(1)), ==, 1u << (0x2e - 32));
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, 0x2e);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    /* An acknowledge doesn't clear an input that is still high */
+    writel(INTC_BASE + ACK, 0x2e);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, 0x2e);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    intc_set_irq(0x2e, 0);
+    g_assert_cmphex(readl(INTC_BASE + PENDING(1)), ==, 0);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, ID_NONE);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+static void test_pulse(void)
+{
+    intc_start();
+
+    writel(INTC_BASE + ENABLE, 0x0a);
+    intc_set_irq(0x0a, 1);
+    intc_set_irq(0x0a, 0);
+
+    /* The rising edge stays pending until acknowledged */
+    g_assert_cmphex(readl(INTC_BASE + PENDING(0)), ==, 1u << 0x0a);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, 0x0a);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    writel(INTC_BASE + ACK, 0x0a);
+    g_assert_cmphex(readl(INTC_BASE + PENDING(0)), ==, 0);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, ID_NONE);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+static void test_priority(void)
+{
+    intc_start();
+
+    /* A disabled interrupt is pending but not signalled */
+    intc_set_irq(0x40, 1);
+    intc_set_irq(0x40, 0);
+    g_assert_cmphex(readl(INTC_BASE + PENDING(2)), ==, 1);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, ID_NONE);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    writel(INTC_BASE + ENABLE, 0x40);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, 0x40);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    /* Lower numbers go first */
+    writel(INTC_BASE + ENABLE, 0x0a);
+    intc_set_irq(0x0a, 1);
+    intc_set_irq(0x0a, 0);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, 0x0a);
+
+    writel(INTC_BASE + ACK, 0x0a);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, 0x40);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    writel(INTC_BASE + DISABLE, 0x40);
+    g_assert_cmphex(readl(INTC_BASE + ID), ==, ID_NONE);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/digic-intc/reset", test_reset);
+    qtest_add_func("/digic-intc/enable", test_enable);
+    qtest_add_func("/digic-intc/level", test_level);
+    qtest_add_func("/digic-intc/pulse", test_pulse);
+    qtest_add_func("/digic-intc/priority", test_priority);
+
+    return g_test_run();
+}
@@ -0,0 +1,207 @@
+/*
+ * QTest testcase for the Canon DIGIC LCD controller
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define LCD_BASE        0xc0f14000
+
+#define CTRL            0x00
+#define BMP_ADDR        0x04
+#define BMP_PITCH       0x08
+#define YUV_ADDR        0x0c
+#define YUV_PITCH       0x10
+#define PALETTE(n)      (0x400 + (n) * 4)
+
+#define CTRL_BMP_EN     (1 << 0)
+#define CTRL_YUV_EN     (1 << 1)
+
+#define WIDTH           720
+#define HEIGHT          480
+
+#define BMP_FB          0x00100000
+#define YUV_FB          0x00200000
+
+static char dump_path[] = "/tmp/qtest-digic-lcd.XXXXXX";
+
+/* Take a screendump and return its RGB pixels */
+static uint8_t *lcd_screendump(void)
+{
+    g_autofree char *contents = NULL;
+    uint8_t *pixels;
+    gsize len;
+    int w, h, n = 0;
+
+    qtest_qmp_assert_success(global_qtest,
+                             "{ 'execute': 'screendump', "
+                             "  'arguments': { 'filename': %s } }",
+                             dump_path);
+    g_assert_true(g_file_get_contents(dump_path, &contents, &len, NULL));
+    g_assert_cmpint(sscanf(contents, "P6\n%d %d\n255\n%n", &w, &h, &n), ==, 2);
+    g_assert_cmpint(w, ==, WIDTH);
+    g_assert_cmpint(h, ==, HEIGHT);
+    g_assert_cmpuint(len, ==, n + WIDTH * HEIGHT * 3);
+
+    pixels = g_malloc(WIDTH * HEIGHT * 3);
+    memcpy(pixels, contents + n, WIDTH * HEIGHT * 3);
+    return pixels;
+}
+
+static const uint8_t *pixel(const uint8_t *pixels, int x, int y)
+{
+    return &pixels[(y * WIDTH + x) * 3];
+}
+
+static void test_reset(void)
+{
+    int i;
+
+    qtest_start("-machine canon-a1100");
+
+    g_assert_cmphex(readl(LCD_BASE + CTRL), ==, 0);
+    g_assert_cmphex(readl(LCD_BASE + BMP_ADDR), ==, 0);
+    g_assert_cmphex(readl(LCD_BASE + BMP_PITCH), ==, WIDTH);
+    g_assert_cmphex(readl(LCD_BASE + YUV_ADDR), ==, 0);
+    g_assert_cmphex(readl(LCD_BASE + YUV_PITCH), ==, WIDTH * 2);
+    for (i = 0; i < 256; i++) {
+        g_assert_cmphex(readl(LCD_BASE + PALETTE(i)), ==, 0);
+    }
+
+    /* Only the defined bits are kept */
+    writel(LCD_BASE + CTRL, 0xffffffff);
+    g_assert_cmphex(readl(LCD_BASE + CTRL), ==, CTRL_BMP_EN | CTRL_YUV_EN);
+    writel(LCD_BASE + BMP_PITCH, 0x12345678);
+    g_assert_cmphex(readl(LCD_BASE + BMP_PITCH), ==, 0x5678);
+    writel(LCD_BASE + PALETTE(255), 0x80112233);
+    g_assert_cmphex(readl(LCD_BASE + PALETTE(255)), ==, 0x80112233);
+
+    qtest_end();
+}
+
+static void test_bmp(void)
+{
+    g_autofree uint8_t *pixels = NULL;
+    uint8_t row[WIDTH];
+    int x;
+
+    qtest_start("-machine canon-a1100");
+
+    qtest_memset(global_qtest, BMP_FB, 0, WIDTH * HEIGHT);
+    for (x = 0; x < WIDTH; x++) {
+        row[x] = x & 1;
+    }
+    memwrite(BMP_FB + 10 * WIDTH, row, WIDTH);
+
+    writel(LCD_BASE + PALETTE(0), 0x00ffffff);
+    writel(LCD_BASE + PALETTE(1), 0xffff8000);
+    writel(LCD_BASE + BMP_ADDR, BMP_FB);
+    writel(LCD_BASE + CTRL, CTRL_BMP_EN);
+
+    pixels = lcd_screendump();
+    for (x = 0; x < 4; x++) {
+        const uint8_t *p = pixel(pixels, x, 10);
+
+        if (x & 1) {
+            g_assert_cmphex(p[0], ==, 0xff);
+            g_assert_cmphex(p[1], ==, 0x80);
+            g_assert_cmphex(p[2], ==, 0x00);
+        } else {
+            /* Zero alpha is transparent, over nothing */
+            g_assert_cmphex(p[0] | p[1] | p[2], ==, 0);
+        }
+    }
+    g_assert_cmphex(pixel(pixels, 1, 11)[0], ==, 0);
+
+    qtest_end();
+}
+
+static void test_overlay(void)
+{
+    g_autofree uint8_t *pixels = NULL;
+    g_autofree uint8_t *yuv = g_malloc(WIDTH * 2);
+    uint8_t bmp[4] = { 0, 1, 0, 1 };
+    int x;
+
+    qtest_start("-machine canon-a1100");
+
+    /* White: U, Y0, V, Y1 with chroma centered on 0 */
+    for (x = 0; x < WIDTH; x += 2) {
+        yuv[x * 2] = 0;
+        yuv[x * 2 + 1] = 0xff;
+        yuv[x * 2 + 2] = 0;
+        yuv[x * 2 + 3] = 0xff;
+    }
+    memwrite(YUV_FB + 20 * WIDTH * 2, yuv, WIDTH * 2);
+    qtest_memset(global_qtest, BMP_FB, 0, WIDTH * HEIGHT);
+    memwrite(BMP_FB + 20 * WIDTH, bmp, sizeof(bmp));
+
+    writel(LCD_BASE + PALETTE(1), 0xff0000ff);
+    writel(LCD_BASE + BMP_ADDR, BMP_FB);
+    writel(LCD_BASE + YUV_ADDR, YUV_FB);
+    writel(LCD_BASE + CTRL, CTRL_BMP_EN | CTRL_YUV_EN);
+
+    pixels = lcd_screendump();
+    for (x = 0; x < 4; x++) {
+        const uint8_t *p = pixel(pixels, x, 20);
+
+        if (bmp[x]) {
+            g_assert_cmphex(p[0], ==, 0x00);
+            g_assert_cmphex(p[1], ==, 0x00);
+            g_assert_cmphex(p[2], ==, 0xff);
+        } else {
+            /* The YUV layer shows through */
+            g_assert_cmphex(p[0], >=, 0xfe);
+            g_assert_cmphex(p[1], >=, 0xfe);
+            g_assert_cmphex(p[2], >=, 0xfe);
+        }
+    }
+
+    /* Disabling the overlay only leaves the YUV layer */
+    writel(LCD_BASE + CTRL, CTRL_YUV_EN);
+    g_free(pixels);
+    pixels = lcd_screendump();
+    g_assert_cmphex(pixel(pixels, 1, 20)[0], >=, 0xfe);
+    g_assert_cmphex(pixel(pixels, 1, 20)[1], >=, 0xfe);
+
+    qtest_end();
+}
+
+static void cleanup(void *opaque)
+{
+    unlink(dump_path);
+}
+
+int main(int argc, char **argv)
+{
+    int fd, ret;
+
+    fd = mkstemp(dump_path);
+    if (fd == -1) {
+        g_printerr("Failed to create temporary file %s: %s\n", dump_path,
+                   strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    qtest_add_abrt_handler(cleanup, NULL);
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/digic-lcd/reset", test_reset);
+    qtest_add_func("/digic-lcd/bmp", test_bmp);
+    qtest_add_func("/digic-lcd/overlay", test_overlay);
+
+    ret = g_test_run();
+    cleanup(NULL);
+    return ret;
+}
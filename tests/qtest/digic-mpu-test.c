@@ -0,0 +1,225 @@
+/*
+ * QTest testcase for the Canon DIGIC MPU message channel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+#include "libqtest-single.h"
+#include "qemu/atomic.h"
+#include "qemu/bswap.h"
+#include "chardev/shm-ring.h"
+
+#define MPU_BASE        0xc0820000
+#define INTC_BASE       0xc0201000
+#define CPU_PATH        "/machine/camera[0]/cluster/cpu"
+
+#define STATUS          0x00
+#define IRQ_EN          0x04
+#define RX_LEN          0x08
+#define RX_POP          0x0c
+#define TX_SEND         0x10
+#define LOST            0x14
+#define RX_WINDOW       0x100
+#define TX_WINDOW       0x200
+
+#define ST_RX_RDY       (1 << 0)
+#define ST_TX_RDY       (1 << 1)
+
+/* See include/hw/misc/digic-mpu.h */
+#define RING_FROM_OFFSET    4096
+#define RING_SIZE           16384
+#define SHM_SIZE            (2 * RING_FROM_OFFSET + 2 * RING_SIZE)
+
+#define IRQ_MPU         0x36
+#define INTC_ID         0x00
+#define INTC_ENABLE     0x04
+#define INTC_ACK        0x0c
+
+/* The CPU input the interrupt controller drives, ARM_CPU_IRQ */
+#define CPU_IRQ         0
+
+static char shm_path[] = "/tmp/qtest-digic-mpu.XXXXXX";
+
+typedef struct MpuShm {
+    uint8_t *base;
+    QemuShmRing *to_mpu;
+    QemuShmRing *from_mpu;
+} MpuShm;
+
+static void mpu_start(MpuShm *shm)
+{
+    g_autofree char *args = g_strdup_printf("-machine canon-a1100 "
+                                            "-global digic-mpu.path=%s",
+                                            shm_path);
+    int fd;
+
+    qtest_start(args);
+    qtest_irq_intercept_in(global_qtest, CPU_PATH);
+
+    /* QEMU created the file when realizing the device */
+    fd = open(shm_path, O_RDWR);
+    g_assert_cmpint(fd, >=, 0);
+    shm->base = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    close(fd);
+    g_assert(shm->base != MAP_FAILED);
+    shm->to_mpu = (QemuShmRing *)shm->base;
+    shm->from_mpu = (QemuShmRing *)(shm->base + RING_FROM_OFFSET);
+}
+
+static void mpu_end(MpuShm *shm)
+{
+    munmap(shm->base, SHM_SIZE);
+    qtest_end();
+}
+
+/* Publish a message from the MPU, as the process emulating it would */
+static void mpu_post(MpuShm *shm, const void *msg, uint16_t len)
+{
+    QemuShmRing *r = shm->from_mpu;
+    uint8_t *data = shm->base + r->data_offset;
+    uint32_t prod = qatomic_read(&r->prod);
+    uint8_t hdr[2];
+
+    stw_le_p(hdr, len);
+    g_assert_cmpuint((prod % RING_SIZE) + sizeof(hdr) + len, <=, RING_SIZE);
+    memcpy(data + prod % RING_SIZE, hdr, sizeof(hdr));
+    memcpy(data + prod % RING_SIZE + sizeof(hdr), msg, len);
+    qatomic_store_release(&r->prod, prod + sizeof(hdr) + len);
+}
+
+static void test_reset(void)
+{
+    MpuShm shm;
+
+    mpu_start(&shm);
+
+    g_assert_cmphex(readl(MPU_BASE + STATUS), ==, ST_TX_RDY);
+    g_assert_cmphex(readl(MPU_BASE + IRQ_EN), ==, 0);
+    g_assert_cmphex(readl(MPU_BASE + RX_LEN), ==, 0);
+    g_assert_cmphex(readl(MPU_BASE + LOST), ==, 0);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    g_assert_cmphex(shm.to_mpu->magic, ==, QEMU_SHM_RING_MAGIC);
+    g_assert_cmpuint(shm.to_mpu->version, ==, QEMU_SHM_RING_VERSION);
+    g_assert_cmpuint(shm.to_mpu->size, ==, RING_SIZE);
+    g_assert_cmphex(shm.from_mpu->magic, ==, QEMU_SHM_RING_MAGIC);
+    g_assert_cmpuint(shm.from_mpu->size, ==, RING_SIZE);
+    g_assert_cmpuint(shm.to_mpu->prod, ==, 0);
+    g_assert_cmpuint(shm.from_mpu->cons, ==, 0);
+
+    mpu_end(&shm);
+}
+
+static void test_send(void)
+{
+    static const uint8_t msg[] = { 0x06, 0x05, 0x03, 0x19, 0x01, 0x00 };
+    MpuShm shm;
+    uint8_t *data;
+    int i;
+
+    mpu_start(&shm);
+
+    for (i = 0; i < sizeof(msg); i++) {
+        writeb(MPU_BASE + TX_WINDOW + i, msg[i]);
+    }
+    g_assert_cmphex(readl(MPU_BASE + TX_WINDOW), ==, ldl_le_p(msg));
+    writel(MPU_BASE + TX_SEND, sizeof(msg));
+
+    /* The message is published whole, after its length */
+    g_assert_cmpuint(qatomic_load_acquire(&shm.to_mpu->prod), ==,
+                     2 + sizeof(msg));
+    data = shm.base + shm.to_mpu->data_offset;
+    g_assert_cmpuint(lduw_le_p(data), ==, sizeof(msg));
+    g_assert(memcmp(data + 2, msg, sizeof(msg)) == 0);
+
+    /* Bad lengths are dropped */
+    writel(MPU_BASE + TX_SEND, 0);
+    writel(MPU_BASE + TX_SEND, 257);
+    g_assert_cmpuint(shm.to_mpu->prod, ==, 2 + sizeof(msg));
+
+    mpu_end(&shm);
+}
+
+static void test_receive(void)
+{
+    static const uint8_t msg1[] = { 0x08, 0x06, 0x00, 0x00, 0x04, 0x00, 0x00 };
+    static const uint8_t msg2[] = { 0x06, 0x05, 0x04, 0x0e, 0x01 };
+    MpuShm shm;
+    int i;
+
+    mpu_start(&shm);
+    writel(INTC_BASE + INTC_ENABLE, IRQ_MPU);
+    writel(MPU_BASE + IRQ_EN, ST_RX_RDY);
+
+    mpu_post(&shm, msg1, sizeof(msg1));
+    mpu_post(&shm, msg2, sizeof(msg2));
+
+    /* Without a kick, a STATUS read finds the message */
+    g_assert_cmphex(readl(MPU_BASE + STATUS), ==, ST_RX_RDY | ST_TX_RDY);
+    g_assert_cmpuint(readl(MPU_BASE + RX_LEN), ==, sizeof(msg1));
+    for (i = 0; i < sizeof(msg1); i++) {
+        g_assert_cmphex(readb(MPU_BASE + RX_WINDOW + i), ==, msg1[i]);
+    }
+    g_assert_cmphex(readl(INTC_BASE + INTC_ID), ==, IRQ_MPU);
+    g_assert_true(get_irq(CPU_IRQ));
+    g_assert_cmpuint(qatomic_load_acquire(&shm.from_mpu->cons), ==,
+                     2 + sizeof(msg1));
+
+    /* Popping it brings in the next one */
+    writel(MPU_BASE + RX_POP, 1);
+    g_assert_cmpuint(readl(MPU_BASE + RX_LEN), ==, sizeof(msg2));
+    g_assert_cmphex(readl(MPU_BASE + RX_WINDOW), ==, ldl_le_p(msg2));
+    g_assert_true(get_irq(CPU_IRQ));
+
+    writel(MPU_BASE + RX_POP, 1);
+    g_assert_cmpuint(readl(MPU_BASE + RX_LEN), ==, 0);
+    g_assert_cmphex(readl(MPU_BASE + STATUS), ==, ST_TX_RDY);
+    writel(INTC_BASE + INTC_ACK, IRQ_MPU);
+    g_assert_false(get_irq(CPU_IRQ));
+    g_assert_cmpuint(shm.from_mpu->cons, ==,
+                     4 + sizeof(msg1) + sizeof(msg2));
+    /* QEMU asks to be kicked for the next message */
+    g_assert_cmpuint(shm.from_mpu->waiting, ==, 1);
+
+    mpu_end(&shm);
+}
+
+static void cleanup(void *opaque)
+{
+    unlink(shm_path);
+}
+
+int main(int argc, char **argv)
+{
+    int fd, ret;
+
+    fd = mkstemp(shm_path);
+    if (fd == -1) {
+        g_printerr("Failed to create temporary file %s: %s\n", shm_path,
+                   strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    qtest_add_abrt_handler(cleanup, NULL);
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/digic-mpu/reset", test_reset);
+    qtest_add_func("/digic-mpu/send", test_send);
+    qtest_add_func("/digic-mpu/receive", test_receive);
+
+    ret = g_test_run();
+    cleanup(NULL);
+    return ret;
+}
@@ -0,0 +1,258 @@
+/*
+ * QTest testcase for the Canon DIGIC SD host controller
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+#include "qemu/bswap.h"
+
+#define SDHOST_BASE     0xc0c10000
+#define INTC_BASE       0xc0201000
+#define CPU_PATH        "/machine/camera[0]/cluster/cpu"
+
+#define CMD             0x00
+#define ARG             0x04
+#define STATUS          0x08
+#define IRQ_EN          0x0c
+#define RESP(n)         (0x10 + (n) * 4)
+#define BLKSIZE         0x20
+#define BLKCNT          0x24
+#define DMA_ADDR        0x28
+#define DATA            0x2c
+
+#define CMD_RSP_SHORT   (1 << 8)
+#define CMD_RSP_LONG    (1 << 9)
+#define CMD_DATA        (1 << 10)
+#define CMD_WRITE       (1 << 11)
+#define CMD_DMA         (1 << 12)
+
+#define ST_CMD_DONE     (1 << 0)
+#define ST_DATA_DONE    (1 << 1)
+#define ST_CMD_ERROR    (1 << 2)
+#define ST_IRQ_MASK     0xf
+#define ST_INSERTED     (1 << 8)
+#define ST_RX_READY     (1 << 11)
+
+#define IRQ_SDHOST      0x32
+#define INTC_ID         0x00
+#define INTC_ENABLE     0x04
+
+/* The CPU input the interrupt controller drives, ARM_CPU_IRQ */
+#define CPU_IRQ         0
+
+#define BLOCK_SIZE      512
+#define CARD_SIZE       (1024 * 1024)
+#define RAM_ADDR        0x00100000
+
+static char image_path[] = "/tmp/qtest.XXXXXX";
+
+static void sdhost_start(void)
+{
+    g_autofree char *args = g_strdup_printf("-machine canon-a1100 "
+                                            "-drive if=sd,index=0,file=%s,"
+                                            "format=raw", image_path);
+
+    qtest_start(args);
+    qtest_irq_intercept_in(global_qtest, CPU_PATH);
+}
+
+static uint32_t sd_cmd(uint32_t cmd, uint32_t arg)
+{
+    uint32_t status;
+
+    writel(SDHOST_BASE + STATUS, ST_IRQ_MASK);
+    writel(SDHOST_BASE + ARG, arg);
+    writel(SDHOST_BASE + CMD, cmd);
+    status = readl(SDHOST_BASE + STATUS);
+    g_assert_cmphex(status & ST_CMD_ERROR, ==, 0);
+    g_assert_cmphex(status & ST_CMD_DONE, ==, ST_CMD_DONE);
+    return readl(SDHOST_BASE + RESP(0));
+}
+
+/* Bring the card to the transfer state */
+static void sd_card_init(void)
+{
+    uint32_t rca;
+
+    sd_cmd(0, 0);
+    g_assert_cmphex(sd_cmd(8 | CMD_RSP_SHORT, 0x1aa) & 0xfff, ==, 0x1aa);
+    sd_cmd(55 | CMD_RSP_SHORT, 0);
+    sd_cmd(41 | CMD_RSP_SHORT, 0x00ff8000);
+    sd_cmd(2 | CMD_RSP_LONG, 0);
+    rca = sd_cmd(3 | CMD_RSP_SHORT, 0) >> 16;
+    sd_cmd(7 | CMD_RSP_SHORT, rca << 16);
+}
+
+static void image_pattern(uint8_t *buf, size_t len, size_t offset)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = (offset + i) * 13 + ((offset + i) >> 9);
+    }
+}
+
+static void test_reset(void)
+{
+    int i;
+
+    sdhost_start();
+
+    g_assert_cmphex(readl(SDHOST_BASE + CMD), ==, 0);
+    g_assert_cmphex(readl(SDHOST_BASE + ARG), ==, 0);
+    g_assert_cmphex(readl(SDHOST_BASE + STATUS), ==, ST_INSERTED);
+    g_assert_cmphex(readl(SDHOST_BASE + IRQ_EN), ==, 0);
+    for (i = 0; i < 4; i++) {
+        g_assert_cmphex(readl(SDHOST_BASE + RESP(i)), ==, 0);
+    }
+    g_assert_cmphex(readl(SDHOST_BASE + BLKSIZE), ==, BLOCK_SIZE);
+    g_assert_cmphex(readl(SDHOST_BASE + BLKCNT), ==, 0);
+    g_assert_cmphex(readl(SDHOST_BASE + DMA_ADDR), ==, 0);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+static void test_irq(void)
+{
+    sdhost_start();
+    writel(INTC_BASE + INTC_ENABLE, IRQ_SDHOST);
+
+    /* A completed command only interrupts once enabled */
+    writel(SDHOST_BASE + CMD, 0);
+    g_assert_cmphex(readl(SDHOST_BASE + STATUS) & ST_IRQ_MASK, ==,
+                    ST_CMD_DONE);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    writel(SDHOST_BASE + IRQ_EN, ST_CMD_DONE);
+    g_assert_cmphex(readl(INTC_BASE + INTC_ID), ==, IRQ_SDHOST);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    /* Writing 1 acknowledges */
+    writel(SDHOST_BASE + STATUS, ST_CMD_DONE);
+    g_assert_cmphex(readl(SDHOST_BASE + STATUS) & ST_IRQ_MASK, ==, 0);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    qtest_end();
+}
+
+static void test_dma_read(void)
+{
+    const size_t len = 2 * BLOCK_SIZE;
+    uint8_t expected[2 * BLOCK_SIZE], buf[2 * BLOCK_SIZE];
+    uint32_t offset = 4 * BLOCK_SIZE;
+
+    sdhost_start();
+    sd_card_init();
+    writel(INTC_BASE + INTC_ENABLE, IRQ_SDHOST);
+    writel(SDHOST_BASE + IRQ_EN, ST_DATA_DONE);
+
+    qtest_memset(global_qtest, RAM_ADDR, 0, len);
+    writel(SDHOST_BASE + BLKSIZE, BLOCK_SIZE);
+    writel(SDHOST_BASE + BLKCNT, 2);
+    writel(SDHOST_BASE + DMA_ADDR, RAM_ADDR);
+    sd_cmd(18 | CMD_RSP_SHORT | CMD_DATA | CMD_DMA, offset);
+
+    g_assert_cmphex(readl(SDHOST_BASE + STATUS) & ST_DATA_DONE, ==,
+                    ST_DATA_DONE);
+    g_assert_cmphex(readl(SDHOST_BASE + BLKCNT), ==, 0);
+    g_assert_cmphex(readl(SDHOST_BASE + DMA_ADDR), ==, RAM_ADDR + len);
+    g_assert_true(get_irq(CPU_IRQ));
+
+    image_pattern(expected, len, offset);
+    memread(RAM_ADDR, buf, len);
+    g_assert(memcmp(expected, buf, len) == 0);
+
+    writel(SDHOST_BASE + STATUS, ST_IRQ_MASK);
+    g_assert_false(get_irq(CPU_IRQ));
+
+    /* STOP_TRANSMISSION */
+    sd_cmd(12 | CMD_RSP_SHORT, 0);
+
+    qtest_end();
+}
+
+static void test_dma_write(void)
+{
+    uint8_t data[BLOCK_SIZE];
+    uint32_t offset = 9 * BLOCK_SIZE;
+    int i;
+
+    sdhost_start();
+    sd_card_init();
+
+    for (i = 0; i < BLOCK_SIZE; i++) {
+        data[i] = 0xff - i;
+    }
+    memwrite(RAM_ADDR, data, BLOCK_SIZE);
+    writel(SDHOST_BASE + BLKSIZE, BLOCK_SIZE);
+    writel(SDHOST_BASE + BLKCNT, 1);
+    writel(SDHOST_BASE + DMA_ADDR, RAM_ADDR);
+    sd_cmd(24 | CMD_RSP_SHORT | CMD_DATA | CMD_WRITE | CMD_DMA, offset);
+    g_assert_cmphex(readl(SDHOST_BASE + STATUS) & ST_DATA_DONE, ==,
+                    ST_DATA_DONE);
+
+    /* Read the block back through the PIO data register */
+    writel(SDHOST_BASE + BLKCNT, 1);
+    sd_cmd(17 | CMD_RSP_SHORT | CMD_DATA, offset);
+    for (i = 0; i < BLOCK_SIZE; i += 4) {
+        g_assert_cmphex(readl(SDHOST_BASE + STATUS) & ST_RX_READY, ==,
+                        ST_RX_READY);
+        g_assert_cmphex(readl(SDHOST_BASE + DATA), ==, ldl_le_p(&data[i]));
+    }
+    g_assert_cmphex(readl(SDHOST_BASE + STATUS) & (ST_DATA_DONE | ST_RX_READY),
+                    ==, ST_DATA_DONE);
+
+    qtest_end();
+}
+
+static void cleanup(void *opaque)
+{
+    unlink(image_path);
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree uint8_t *image = g_malloc(CARD_SIZE);
+    int fd, ret;
+
+    fd = mkstemp(image_path);
+    if (fd == -1) {
+        g_printerr("Failed to create temporary file %s: %s\n", image_path,
+                   strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    image_pattern(image, CARD_SIZE, 0);
+    if (write(fd, image, CARD_SIZE) != CARD_SIZE) {
+        int error_code = errno;
+
+        close(fd);
+        unlink(image_path);
+        g_printerr("Failed to write %s: %s\n", image_path,
+                   strerror(error_code));
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    qtest_add_abrt_handler(cleanup, NULL);
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/digic-sdhost/reset", test_reset);
+    qtest_add_func("/digic-sdhost/irq", test_irq);
+    qtest_add_func("/digic-sdhost/dma-read", test_dma_read);
+    qtest_add_func("/digic-sdhost/dma-write", test_dma_write);
+
+    ret = g_test_run();
+    cleanup(NULL);
+    return ret;
+}
@@ -530,6 +530,42 @@ void qtest_memwrite(QTestState *s, uint64_t addr, const void *data, size_t size)
 void qtest_bufwrite(QTestState *s, uint64_t addr,
                     const void *data, size_t size);
 
+/*
+ * Operations of a batch, with the same values as in the "batch" command
+ * of the qtest protocol.
+ */
+typedef enum QTestBatchOpType {
+    QTEST_BATCH_READ = 0,
+    QTEST_BATCH_WRITE = 1,
+    QTEST_BATCH_CLOCK_STEP = 2,
+} QTestBatchOpType;
+
+/**
+ * QTestBatchOp:
+ * @type: What to do.
+ * @size: Access size in bytes for reads and writes: 1, 2, 4 or 8.
+ * @addr: Guest address to access.
+ * @value: Value to write, or nanoseconds to advance the clock by; set to
+ * the value read, or the new clock value, once the batch has run.
+ */
+typedef struct QTestBatchOp {
+    QTestBatchOpType type;
+    unsigned size;
+    uint64_t addr;
+    uint64_t value;
+} QTestBatchOp;
+
+/**
+ * qtest_batch:
+ * @s: #QTestState instance to operate on.
+ * @ops: Operations to run, in order.
+ * @count: Number of operations in @ops.
+ *
+ * Run @count MMIO accesses and clock steps with a single round trip to
+ * QEMU, which is much faster than issuing them one at a time.
+ */
+void qtest_batch(QTestState *s, QTestBatchOp *ops, size_t count);
+
 /**
  * qtest_memset:
  * @s: #QTestState instance to operate on.
@@ -22,6 +22,7 @@
 
 #include "libqos/libqtest.h"
 #include "qemu-common.h"
+#include "qemu/bswap.h"
 #include "qemu/ctype.h"
 #include "qemu/cutils.h"
 #include "qapi/error.h"
@@ -1206,6 +1207,46 @@ void qtest_bufwrite(QTestState *s, uint64_t addr, const void *data, size_t size)
     g_free(bdata);
 }
 
+#define QTEST_BATCH_OP_SIZE 24
+
+void qtest_batch(QTestState *s, QTestBatchOp *ops, size_t count)
+{
+    g_autofree uint8_t *buf = NULL;
+    g_autofree uint8_t *results = NULL;
+    gchar *bdata;
+    gchar **args;
+    gsize len;
+    size_t i;
+
+    if (!count) {
+        return;
+    }
+
+    buf = g_malloc0(count * QTEST_BATCH_OP_SIZE);
+    for (i = 0; i < count; i++) {
+        uint8_t *op = buf + i * QTEST_BATCH_OP_SIZE;
+
+        op[0] = ops[i].type;
+        op[1] = ops[i].size;
+        stq_le_p(op + 8, ops[i].addr);
+        stq_le_p(op + 16, ops[i].value);
+    }
+
+    bdata = g_base64_encode(buf, count * QTEST_BATCH_OP_SIZE);
+    qtest_sendf(s, "batch %zu ", count);
+    s->ops.send(s, bdata);
+    s->ops.send(s, "\n");
+    g_free(bdata);
+
+    args = qtest_rsp_args(s, 2);
+    results = g_base64_decode(args[1], &len);
+    g_assert_cmpuint(len, ==, count * sizeof(uint64_t));
+    for (i = 0; i < count; i++) {
+        ops[i].value = ldq_le_p(results + i * sizeof(uint64_t));
+    }
+    g_strfreev(args);
+}
+
 void qtest_bufread(QTestState *s, uint64_t addr, void *data, size_t size)
 {
     gchar **args;
@@ -1298,6 +1298,13 @@ static void test_multifd_tcp_zstd(void)
 }
 #endif
 
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    test_multifd_tcp("lz4");
+}
+#endif
+
 /*
  * This test does:
  *  source               target
@@ -1479,6 +1486,9 @@ int main(int argc, char **argv)
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/zstd", test_multifd_tcp_zstd);
 #endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/lz4", test_multifd_tcp_lz4);
+#endif
 
     if (kvm_dirty_ring_supported()) {
         qtest_add_func("/migration/dirty_ring",
@@ -605,6 +605,67 @@ static void test_cfi_in_autoselect(const void *opaque)
     qtest_quit(qtest);
 }
 
+/*
+ * Program a sector and read it back with batched qtest commands, and check
+ * that the regular commands see the same contents.
+ */
+static void test_batch(const void *opaque)
+{
+    const FlashConfig *config = opaque;
+    QTestState *qtest;
+    qtest = qtest_initf("-M musicpal"
+                        " -drive if=pflash,file=%s,format=raw,copy-on-read=on",
+                        image_path);
+    FlashConfig explicit_config = expand_config_defaults(config);
+    explicit_config.qtest = qtest;
+    const FlashConfig *c = &explicit_config;
+    enum { NB_WORDS = 64 };
+    QTestBatchOp ops[NB_WORDS * 4];
+    size_t n = 0;
+
+    sector_erase(c, 0);
+    wait_for_completion(c, 0);
+
+    for (uint64_t i = 0; i < NB_WORDS; i++) {
+        uint64_t byte_addr = i * c->bank_width;
+
+        ops[n++] = (QTestBatchOp) {
+            QTEST_BATCH_WRITE, c->bank_width,
+            BASE_ADDR + as_byte_addr(c, UNLOCK0_ADDR),
+            replicate(c, UNLOCK0_CMD)
+        };
+        ops[n++] = (QTestBatchOp) {
+            QTEST_BATCH_WRITE, c->bank_width,
+            BASE_ADDR + as_byte_addr(c, UNLOCK1_ADDR),
+            replicate(c, UNLOCK1_CMD)
+        };
+        ops[n++] = (QTestBatchOp) {
+            QTEST_BATCH_WRITE, c->bank_width,
+            BASE_ADDR + as_byte_addr(c, UNLOCK0_ADDR),
+            replicate(c, PROGRAM_CMD)
+        };
+        ops[n++] = (QTestBatchOp) {
+            QTEST_BATCH_WRITE, c->bank_width, BASE_ADDR + byte_addr,
+            0x1000 + i
+        };
+    }
+    qtest_batch(qtest, ops, n);
+
+    for (uint64_t i = 0; i < NB_WORDS; i++) {
+        ops[i] = (QTestBatchOp) {
+            QTEST_BATCH_READ, c->bank_width, BASE_ADDR + i * c->bank_width
+        };
+    }
+    qtest_batch(qtest, ops, NB_WORDS);
+
+    for (uint64_t i = 0; i < NB_WORDS; i++) {
+        g_assert_cmphex(ops[i].value, ==, 0x1000 + i);
+        g_assert_cmphex(flash_read(c, i * c->bank_width), ==, 0x1000 + i);
+    }
+
+    qtest_quit(qtest);
+}
+
 static void cleanup(void *opaque)
 {
     unlink(image_path);
@@ -675,6 +736,7 @@ int main(int argc, char **argv)
 
     qtest_add_data_func("pflash-cfi02/cfi-in-autoselect", &configuration[0],
                         test_cfi_in_autoselect);
+    qtest_add_data_func("pflash-cfi02/batch", &configuration[0], test_batch);
     int result = g_test_run();
     cleanup(NULL);
     return result;
@@ -0,0 +1,144 @@
+/*
+ * QTest testcase for the pmem-read and pmem-write QMP commands
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define ADDR        0x100000
+
+/* Much larger than a default pipe buffer, so QEMU has to wait for the reader */
+#define BIG_SIZE    (1024 * 1024)
+
+static void fill(uint8_t *buf, size_t len, uint8_t seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = seed + i * 7;
+    }
+}
+
+static void pass_fd(QTestState *qts, int fd, const char *name)
+{
+    QDict *resp;
+
+    resp = qtest_qmp_fds(qts, &fd, 1,
+                         "{'execute': 'getfd',"
+                         " 'arguments': {'fdname': %s}}", name);
+    g_assert(qdict_haskey(resp, "return"));
+    qobject_unref(resp);
+    close(fd);
+}
+
+static void test_pmem_write(void)
+{
+    QTestState *qts = qtest_init("-m 16");
+    int len = 16 * 1024;
+    g_autofree uint8_t *src = g_malloc(len);
+    g_autofree uint8_t *dst = g_malloc(len);
+    QDict *resp;
+    int fds[2];
+
+    fill(src, len, 0x5a);
+    g_assert_cmpint(pipe(fds), ==, 0);
+    g_assert_cmpint(write(fds[1], src, len), ==, len);
+    close(fds[1]);
+    pass_fd(qts, fds[0], "in");
+
+    resp = qtest_qmp(qts, "{'execute': 'pmem-write',"
+                     " 'arguments': {'val': %d, 'size': %d, 'fdname': 'in'}}",
+                     ADDR, len);
+    g_assert(qdict_haskey(resp, "return"));
+    qobject_unref(resp);
+
+    qtest_memread(qts, ADDR, dst, len);
+    g_assert(memcmp(src, dst, len) == 0);
+
+    qtest_quit(qts);
+}
+
+static void test_pmem_write_short(void)
+{
+    QTestState *qts = qtest_init("-m 16");
+    uint8_t buf[512];
+    QDict *resp;
+    int fds[2];
+
+    fill(buf, sizeof(buf), 0x11);
+    g_assert_cmpint(pipe(fds), ==, 0);
+    g_assert_cmpint(write(fds[1], buf, sizeof(buf)), ==, sizeof(buf));
+    close(fds[1]);
+    pass_fd(qts, fds[0], "in");
+
+    resp = qtest_qmp(qts, "{'execute': 'pmem-write',"
+                     " 'arguments': {'val': %d, 'size': %d, 'fdname': 'in'}}",
+                     ADDR, (int)sizeof(buf) * 2);
+    g_assert(qdict_haskey(resp, "error"));
+    qobject_unref(resp);
+
+    qtest_quit(qts);
+}
+
+/*
+ * The reader does not drain the pipe until QEMU has filled it; the main
+ * loop must keep serving the qtest protocol meanwhile.
+ */
+static void test_pmem_read_slow_reader(void)
+{
+    QTestState *qts = qtest_init("-m 16");
+    g_autofree uint8_t *src = g_malloc(BIG_SIZE);
+    g_autofree uint8_t *dst = g_malloc(BIG_SIZE);
+    struct pollfd pfd;
+    size_t done = 0;
+    QDict *resp;
+    int fds[2];
+
+    fill(src, BIG_SIZE, 0xa5);
+    qtest_memwrite(qts, ADDR, src, BIG_SIZE);
+
+    g_assert_cmpint(pipe(fds), ==, 0);
+    pass_fd(qts, fds[1], "out");
+
+    qtest_qmp_send(qts, "{'execute': 'pmem-read',"
+                   " 'arguments': {'val': %d, 'size': %d, 'fdname': 'out'}}",
+                   ADDR, BIG_SIZE);
+
+    /* Wait until QEMU has started writing, then talk to it over qtest */
+    pfd = (struct pollfd) { .fd = fds[0], .events = POLLIN };
+    g_assert_cmpint(poll(&pfd, 1, -1), ==, 1);
+    g_assert_cmphex(qtest_readb(qts, ADDR), ==, src[0]);
+
+    while (done < BIG_SIZE) {
+        ssize_t ret = read(fds[0], dst + done, BIG_SIZE - done);
+
+        g_assert_cmpint(ret, >, 0);
+        done += ret;
+    }
+    g_assert(memcmp(src, dst, BIG_SIZE) == 0);
+
+    resp = qtest_qmp_receive(qts);
+    g_assert(qdict_haskey(resp, "return"));
+    qobject_unref(resp);
+
+    /* QEMU closed its end once done */
+    g_assert_cmpint(read(fds[0], dst, 1), ==, 0);
+    close(fds[0]);
+
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/pmem/write", test_pmem_write);
+    qtest_add_func("/pmem/write-short", test_pmem_write_short);
+    qtest_add_func("/pmem/read-slow-reader", test_pmem_read_slow_reader);
+
+    return g_test_run();
+}
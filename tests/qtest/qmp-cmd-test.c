@@ -49,11 +49,16 @@ static int query_error_class(const char *cmd)
 #ifndef CONFIG_PROFILER
         { "x-query-profile", ERROR_CLASS_GENERIC_ERROR },
 #endif
+        /* Only valid with a DIGIC machine */
+        { "x-query-digic-mmio", ERROR_CLASS_GENERIC_ERROR },
         /* Only valid with a USB bus added */
         { "x-query-usb", ERROR_CLASS_GENERIC_ERROR },
         /* Only valid with accel=tcg */
         { "x-query-jit", ERROR_CLASS_GENERIC_ERROR },
         { "x-query-opcount", ERROR_CLASS_GENERIC_ERROR },
+        { "x-query-smc", ERROR_CLASS_GENERIC_ERROR },
+        { "x-query-tb-chains", ERROR_CLASS_GENERIC_ERROR },
+        { "x-query-tlb", ERROR_CLASS_GENERIC_ERROR },
         { NULL, -1 }
     };
     int i;
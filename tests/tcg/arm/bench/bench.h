@@ -0,0 +1,29 @@
+/*
+ * TCG benchmark payloads - shared definitions
+ *
+ * Each payload sets up a stack, runs its loop a fixed number of times
+ * and exits QEMU through semihosting, so that the time of the run is
+ * the time of the loop plus a constant startup cost.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#define SYS_EXIT                    0x18
+#define ADP_STOPPED_APPLICATIONEXIT 0x20026
+
+    .macro bench_start
+    .text
+    .arm
+    .global _start
+_start:
+    ldr     sp, =stack_top
+    .endm
+
+    .macro bench_exit
+    mov     r0, #SYS_EXIT
+    ldr     r1, =ADP_STOPPED_APPLICATIONEXIT
+    svc     0x123456
+99:
+    b       99b
+    .ltorg
+    .endm
@@ -606,6 +606,53 @@ static void test_dummy_delchild(void)
     object_unparent(OBJECT(dev));
 }
 
+static bool dummy_backend_get_late(Object *obj, Error **errp)
+{
+    return true;
+}
+
+static void test_dummy_late_class_prop(void)
+{
+    Object *backend = object_new(TYPE_DUMMY_BACKEND);
+
+    g_assert(!object_property_find(backend, "late"));
+
+    /* Added once the class is in use, it must still be found */
+    object_class_property_add_bool(object_get_class(backend), "late",
+                                   dummy_backend_get_late, NULL);
+    g_assert(object_property_find(backend, "late"));
+    g_assert(object_property_get_bool(backend, "late", &error_abort));
+
+    object_unref(backend);
+}
+
+static void test_qom_abs_path(void)
+{
+    Object *parent = object_get_objects_root();
+    DummyDev *dev;
+
+    dev = DUMMY_DEV(object_new_with_props(TYPE_DUMMY_DEV, parent, "dev0",
+                                          &error_abort, NULL));
+    g_assert(object_resolve_path("/objects/dev0/bus/backend", NULL) ==
+             OBJECT(dev->bus->backend));
+    g_assert(object_resolve_path("/objects//dev0/bus/backend/", NULL) ==
+             OBJECT(dev->bus->backend));
+    g_assert(object_resolve_path("/objects/dev0/backend", NULL) ==
+             OBJECT(dev->bus->backend));
+    g_assert(!object_resolve_path_type("/objects/dev0/bus", TYPE_DUMMY_DEV,
+                                       NULL));
+    object_unparent(OBJECT(dev));
+
+    /* A path resolved before must not outlive the object */
+    g_assert(!object_resolve_path("/objects/dev0/bus/backend", NULL));
+
+    dev = DUMMY_DEV(object_new_with_props(TYPE_DUMMY_DEV, parent, "dev0",
+                                          &error_abort, NULL));
+    g_assert(object_resolve_path("/objects/dev0/bus/backend", NULL) ==
+             OBJECT(dev->bus->backend));
+    object_unparent(OBJECT(dev));
+}
+
 static void test_qom_partial_path(void)
 {
     Object *root  = object_get_objects_root();
@@ -665,6 +712,9 @@ int main(int argc, char **argv)
     g_test_add_func("/qom/proplist/iterator", test_dummy_iterator);
     g_test_add_func("/qom/proplist/class_iterator", test_dummy_class_iterator);
     g_test_add_func("/qom/proplist/delchild", test_dummy_delchild);
+    g_test_add_func("/qom/proplist/late_class_prop",
+                    test_dummy_late_class_prop);
+    g_test_add_func("/qom/resolve/absolute", test_qom_abs_path);
     g_test_add_func("/qom/resolve/partial", test_qom_partial_path);
 
     return g_test_run();
@@ -1260,6 +1260,83 @@ static void char_file_fifo_test(void)
     g_rmdir(tmp_path);
     g_free(tmp_path);
 }
+
+static void char_coalesce_test(void)
+{
+    char *tmp_path = g_dir_make_tmp("qemu-test-char.XXXXXX", NULL);
+    char *fifo = g_build_filename(tmp_path, "fifo", NULL);
+    ChardevFile file = { .has_coalesce = true,
+                         .coalesce = true,
+                         .out = fifo };
+    ChardevBackend backend = { .type = CHARDEV_BACKEND_KIND_FILE,
+                               .u.file.data = &file };
+    Chardev *chr;
+    CharBackend be;
+    uint8_t buf[256];
+    size_t filled = 0, got = 0;
+    bool seen = false;
+    int rfd, wfd, ret, i;
+
+    g_assert_cmpint(mkfifo(fifo, 0600), ==, 0);
+    rfd = open(fifo, O_RDONLY | O_NONBLOCK);
+    g_assert_cmpint(rfd, >=, 0);
+
+    chr = qemu_chardev_new("label-coalesce", TYPE_CHARDEV_FILE, &backend,
+                           NULL, &error_abort);
+    qemu_chr_fe_init(&be, chr, &error_abort);
+
+    /* Fill the pipe, so that the back end takes nothing */
+    wfd = open(fifo, O_WRONLY | O_NONBLOCK);
+    g_assert_cmpint(wfd, >=, 0);
+    memset(buf, 'x', sizeof(buf));
+    while ((ret = write(wfd, buf, sizeof(buf))) > 0) {
+        filled += ret;
+    }
+    while ((ret = write(wfd, buf, 1)) > 0) {
+        filled += ret;
+    }
+    g_assert_cmpint(errno, ==, EAGAIN);
+    close(wfd);
+
+    /* The output is held back, and writes are short once it is full */
+    g_assert_cmpint(qemu_chr_fe_write(&be, (uint8_t *)"a", 1), ==, 1);
+    g_assert_cmpint(qemu_chr_fe_write(&be, buf, 200), ==, 200);
+    g_assert_cmpint(qemu_chr_fe_write(&be, buf, 100), ==, 55);
+    ret = qemu_chr_fe_write(&be, buf, 1);
+    g_assert_cmpint(ret, ==, -1);
+    g_assert_cmpint(errno, ==, EAGAIN);
+
+    /* Retrying from the main loop doesn't wait for the pipe */
+    for (i = 0; i < 5; i++) {
+        g_usleep(2000);
+        main_loop_wait(true);
+    }
+
+    /* Once the pipe has room, the output goes out by itself */
+    while (got < filled + sizeof(buf)) {
+        ret = read(rfd, buf, sizeof(buf));
+        if (ret > 0) {
+            if (!seen && got + ret > filled) {
+                g_assert_cmpint(buf[filled - got], ==, 'a');
+                seen = true;
+            }
+            got += ret;
+        } else {
+            g_assert_cmpint(errno, ==, EAGAIN);
+            main_loop_wait(false);
+        }
+    }
+    g_assert_true(seen);
+    g_assert_cmpint(got, ==, filled + sizeof(buf));
+
+    qemu_chr_fe_deinit(&be, true);
+    close(rfd);
+
+    g_unlink(fifo);
+    g_free(fifo);
+    g_rmdir(tmp_path);
+    g_free(tmp_path);
+}
 #endif
 
 static void char_file_test_internal(Chardev *ext_chr, const char *filepath)
@@ -1474,6 +1551,7 @@ int main(int argc, char **argv)
     g_test_add_func("/char/file", char_file_test);
 #ifndef _WIN32
     g_test_add_func("/char/file-fifo", char_file_fifo_test);
+    g_test_add_func("/char/coalesce", char_coalesce_test);
 #endif
 
 #define SOCKET_SERVER_TEST(name, addr)                                  \
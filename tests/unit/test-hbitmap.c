@@ -1042,6 +1042,50 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+/*
+ * Merge and look for zeroes with each level kernel; the sizes leave
+ * a partial vector and a partial word at the end of the bottom level.
+ */
+static void test_hbitmap_accel(void)
+{
+    const uint64_t size = L2 * 3 + L1 * 3 + 37;
+
+    do {
+        HBitmap *a = hbitmap_alloc(size, 0);
+        HBitmap *b = hbitmap_alloc(size, 0);
+        HBitmap *r = hbitmap_alloc(size, 0);
+        uint64_t i, count = 0;
+
+        for (i = 0; i < size; i += 7) {
+            hbitmap_set(a, i, 1);
+        }
+        for (i = 3; i < size; i += 11) {
+            hbitmap_set(b, i, 1);
+        }
+        hbitmap_set(b, L1 * 5, L2 + L1 * 2 + 9);
+
+        g_assert(hbitmap_merge(a, b, r));
+        for (i = 0; i < size; i++) {
+            bool set = hbitmap_get(a, i) || hbitmap_get(b, i);
+
+            g_assert_cmpint(hbitmap_get(r, i), ==, set);
+            count += set;
+        }
+        g_assert_cmpuint(hbitmap_count(r), ==, count);
+
+        for (i = L1 * 5; hbitmap_get(b, i); i++) {
+            /* nothing */
+        }
+        g_assert_cmpint(hbitmap_next_zero(b, L1 * 5, size - L1 * 5), ==, i);
+        hbitmap_set(r, 0, size);
+        g_assert_cmpint(hbitmap_next_zero(r, 1, size - 1), ==, -1);
+
+        hbitmap_free(a);
+        hbitmap_free(b);
+        hbitmap_free(r);
+    } while (hbitmap_test_next_accel());
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1113,6 +1157,9 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
 
+    /* Last, as it leaves the plain C kernels selected */
+    g_test_add_func("/hbitmap/accel", test_hbitmap_accel);
+
     g_test_run();
 
     return 0;
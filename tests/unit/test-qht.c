@@ -251,10 +251,42 @@ static void test_resize(void)
     qht_test(QHT_MODE_AUTO_RESIZE);
 }
 
+/*
+ * Auto-resize grows the table a few buckets per insertion, so checking
+ * between insertions looks up entries while a resize is in progress:
+ * some of them are still in the old map and some are only in the new one.
+ */
+static void test_resize_lookup(void)
+{
+    int i;
+
+    qht_init(&ht, is_equal, 0, QHT_MODE_AUTO_RESIZE);
+    for (i = 0; i < N; i++) {
+        insert(i, i + 1);
+        if (i % 16 == 0) {
+            check(0, i + 1, true);
+            check(i + 1, i + 17, false);
+        }
+    }
+    check_n(N);
+
+    for (i = 0; i < N; i += 2) {
+        rm(i, i + 1);
+        insert(N + i, N + i + 1);
+    }
+    for (i = 0; i < N; i++) {
+        check(i, i + 1, i % 2);
+        check(N + i, N + i + 1, !(i % 2));
+    }
+    check_n(N);
+    qht_destroy(&ht);
+}
+
 int main(int argc, char *argv[])
 {
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/qht/mode/default", test_default);
     g_test_add_func("/qht/mode/resize", test_resize);
+    g_test_add_func("/qht/resize/lookup", test_resize_lookup);
     return g_test_run();
 }
@@ -334,6 +334,71 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+/* Adjacent fields that the copy plan merges, around one it does not */
+
+typedef struct TestRuns {
+    uint32_t u32_1;
+    uint32_t u32_2[2];
+    uint8_t buf[4];
+    uint8_t u8_1;
+    bool b_1;
+    uint32_t u32_3;
+} TestRuns;
+
+TestRuns obj_runs = {
+    .u32_1 = 0x01020304,
+    .u32_2 = { 0x05060708, 0x090a0b0c },
+    .buf = { 0x11, 0x12, 0x13, 0x14 },
+    .u8_1 = 0x15,
+    .b_1 = true,
+    .u32_3 = 0x21222324,
+};
+
+static const VMStateDescription vmstate_runs = {
+    .name = "simple/runs",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(u32_1, TestRuns),
+        VMSTATE_UINT32_ARRAY(u32_2, TestRuns, 2),
+        VMSTATE_BUFFER(buf, TestRuns),
+        VMSTATE_UINT8(u8_1, TestRuns),
+        VMSTATE_BOOL(b_1, TestRuns),
+        VMSTATE_UINT32(u32_3, TestRuns),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+uint8_t wire_runs[] = {
+    /* u32_1 */ 0x01, 0x02, 0x03, 0x04,
+    /* u32_2 */ 0x05, 0x06, 0x07, 0x08,
+    /* u32_2 */ 0x09, 0x0a, 0x0b, 0x0c,
+    /* buf */   0x11, 0x12, 0x13, 0x14,
+    /* u8_1 */  0x15,
+    /* b_1 */   0x01,
+    /* u32_3 */ 0x21, 0x22, 0x23, 0x24,
+    QEMU_VM_EOF, /* just to ensure we won't get EOF reported prematurely */
+};
+
+static void obj_runs_copy(void *target, void *source)
+{
+    memcpy(target, source, sizeof(TestRuns));
+}
+
+static void test_simple_runs(void)
+{
+    TestRuns obj, obj_clone;
+
+    memset(&obj, 0, sizeof(obj));
+    save_vmstate(&vmstate_runs, &obj_runs);
+
+    compare_vmstate(wire_runs, sizeof(wire_runs));
+
+    SUCCESS(load_vmstate(&vmstate_runs, &obj, &obj_clone,
+                         obj_runs_copy, 1, wire_runs, sizeof(wire_runs)));
+    SUCCESS(memcmp(&obj, &obj_runs, sizeof(obj)));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1497,6 +1562,7 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/simple/runs", test_simple_runs);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
@@ -165,13 +165,53 @@ static void encode_decode_range(void)
     g_free(test);
 }
 
+/* Changes of random lengths at random offsets, the same for all encoders */
+static void encode_decode_random(void)
+{
+    uint8_t *old = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *new = g_malloc(XBZRLE_PAGE_SIZE);
+    uint8_t *compressed = g_malloc(XBZRLE_PAGE_SIZE);
+    int changes = g_test_rand_int_range(1, 200);
+    int i, j, dlen, rc;
+
+    for (i = 0; i < XBZRLE_PAGE_SIZE; i++) {
+        old[i] = g_test_rand_int();
+    }
+    memcpy(new, old, XBZRLE_PAGE_SIZE);
+    for (i = 0; i < changes; i++) {
+        int offset = g_test_rand_int_range(0, XBZRLE_PAGE_SIZE);
+        int len = g_test_rand_int_range(1, 80);
+
+        for (j = offset; j < MIN(offset + len, XBZRLE_PAGE_SIZE); j++) {
+            new[j] ^= g_test_rand_int_range(0, 3) ? 0xa5 : 0;
+        }
+    }
+
+    dlen = xbzrle_encode_buffer(old, new, XBZRLE_PAGE_SIZE, compressed,
+                                XBZRLE_PAGE_SIZE);
+    if (dlen > 0) {
+        rc = xbzrle_decode_buffer(compressed, dlen, old, XBZRLE_PAGE_SIZE);
+        g_assert(rc <= XBZRLE_PAGE_SIZE);
+    }
+    if (dlen >= 0) {
+        g_assert(memcmp(old, new, XBZRLE_PAGE_SIZE) == 0);
+    }
+
+    g_free(old);
+    g_free(new);
+    g_free(compressed);
+}
+
 static void test_encode_decode(void)
 {
     int i;
 
-    for (i = 0; i < 10000; i++) {
-        encode_decode_range();
-    }
+    do {
+        for (i = 0; i < 10000; i++) {
+            encode_decode_range();
+            encode_decode_random();
+        }
+    } while (xbzrle_encode_next_accel());
 }
 
 int main(int argc, char **argv)
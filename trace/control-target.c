@@ -30,6 +30,9 @@ void trace_event_set_state_dynamic_init(TraceEvent *ev, bool state)
             trace_events_enabled_count--;
             *ev->dstate = 0;
         }
+#ifdef CONFIG_TRACE_STATIC_KEYS
+        trace_static_key_update(ev, state);
+#endif
     }
 }
 
@@ -56,6 +59,9 @@ void trace_event_set_state_dynamic(TraceEvent *ev, bool state)
                 trace_events_enabled_count--;
                 *ev->dstate = 0;
             }
+#ifdef CONFIG_TRACE_STATIC_KEYS
+            trace_static_key_update(ev, state);
+#endif
         }
     }
 }
@@ -14,6 +14,9 @@
 #ifdef CONFIG_TRACE_SIMPLE
 #include "trace/simple.h"
 #endif
+#ifdef CONFIG_TRACE_RING
+#include "trace/ring.h"
+#endif
 #ifdef CONFIG_TRACE_FTRACE
 #include "trace/ftrace.h"
 #endif
@@ -86,6 +89,9 @@ void trace_event_register_group(TraceEvent **events)
 #ifdef CONFIG_TRACE_SIMPLE
     st_init_group(nevent_groups - 1);
 #endif
+#ifdef CONFIG_TRACE_RING
+    ring_init_group(nevent_groups - 1);
+#endif
 }
 
 
@@ -253,6 +259,11 @@ void trace_init_file(void)
     if (init_trace_on_startup) {
         st_set_trace_file_enabled(true);
     }
+#elif defined CONFIG_TRACE_RING
+    ring_set_trace_file(trace_opts_file);
+    if (init_trace_on_startup) {
+        ring_set_trace_file_enabled(true);
+    }
 #elif defined CONFIG_TRACE_LOG
     /*
      * If both the simple and the log backends are enabled, "--trace file"
@@ -299,6 +310,13 @@ bool trace_init_backends(void)
     }
 #endif
 
+#ifdef CONFIG_TRACE_RING
+    if (!ring_init()) {
+        fprintf(stderr, "failed to initialize ring tracing backend.\n");
+        return false;
+    }
+#endif
+
 #ifdef CONFIG_TRACE_FTRACE
     if (!ftrace_init()) {
         fprintf(stderr, "failed to initialize ftrace backend.\n");
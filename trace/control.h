@@ -11,6 +11,9 @@
 #define TRACE__CONTROL_H
 
 #include "event-internal.h"
+#ifdef CONFIG_TRACE_STATIC_KEYS
+#include "static-key.h"
+#endif
 
 typedef struct TraceEventIter {
     /* iter state */
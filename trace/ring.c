@@ -0,0 +1,366 @@
+/*
+ * Per-thread ring trace backend
+ *
+ * Each thread that emits trace events writes them to a ring of its own,
+ * with no lock and no atomic read-modify-write: the thread is the only
+ * producer, and a writeout thread is the only consumer that empties it
+ * into the trace file.  The file is therefore made of chunks of records
+ * from one thread each, that the reader merges by timestamp.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "qemu/atomic.h"
+#include "qemu/units.h"
+#include "qemu/timer.h"
+#include "trace/control.h"
+#include "trace/ring.h"
+#include "qemu/error-report.h"
+#include "qemu/qemu-print.h"
+
+#define RING_MAGIC      0x51454d5552494e47ULL   /* "QEMURING" */
+#define RING_VERSION    1
+
+/* Bytes of the ring of each thread, a power of 2 */
+#define RING_LEN        (256 * KiB)
+/* How often the writeout thread empties the rings */
+#define RING_WRITEOUT_INTERVAL_US   (10 * 1000)
+
+enum {
+    RING_CHUNK_MAPPING,     /* u64 event ID, u32 length, name */
+    RING_CHUNK_EVENTS,      /* records of one thread */
+    RING_CHUNK_DROPPED,     /* u64 count of records lost by one thread */
+};
+
+typedef struct {
+    uint64_t magic;
+    uint64_t version;
+} RingTraceHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t length;        /* of the payload that follows, in bytes */
+    uint32_t tid;
+    uint32_t reserved;
+} RingTraceChunk;
+
+/* Records are 8-byte aligned in the ring and in the file */
+typedef struct {
+    uint32_t event;
+    uint32_t length;        /* including this header and the padding */
+    uint64_t timestamp_ns;
+} RingTraceRecord;
+
+struct TraceRing {
+    uint64_t head;          /* written by the owner thread only */
+    uint64_t tail;          /* written by the writeout thread only */
+    uint64_t dropped;       /* written by the owner thread only */
+    uint64_t dropped_written;
+    uint32_t tid;
+    bool dead;
+    TraceRing *next;
+    uint8_t buf[RING_LEN];
+};
+
+static GMutex trace_lock;       /* protects everything below */
+static GCond trace_cond;
+static TraceRing *rings;
+static FILE *trace_fp;
+static char *trace_file_name;
+
+static __thread TraceRing *thread_ring;
+
+static void ring_thread_exit(gpointer opaque)
+{
+    TraceRing *ring = opaque;
+
+    /* The writeout thread frees the ring once it is empty */
+    thread_ring = NULL;
+    qatomic_store_release(&ring->dead, true);
+}
+
+static GPrivate ring_key = G_PRIVATE_INIT(ring_thread_exit);
+
+static TraceRing *ring_get(void)
+{
+    TraceRing *ring = thread_ring;
+
+    if (likely(ring)) {
+        return ring;
+    }
+    ring = g_malloc0(sizeof(*ring));
+    ring->tid = qemu_get_thread_id();
+
+    g_mutex_lock(&trace_lock);
+    ring->next = rings;
+    rings = ring;
+    g_mutex_unlock(&trace_lock);
+
+    g_private_set(&ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+static void ring_write(TraceRing *ring, uint64_t off, const void *data,
+                       size_t size)
+{
+    size_t idx = off & (RING_LEN - 1);
+    size_t n = MIN(size, RING_LEN - idx);
+
+    memcpy(ring->buf + idx, data, n);
+    memcpy(ring->buf, (const uint8_t *)data + n, size - n);
+}
+
+bool ring_record_start(TraceRingRecord *rec, uint32_t event, size_t arglen)
+{
+    TraceRing *ring = ring_get();
+    RingTraceRecord hdr = {
+        .event = event,
+        .length = ROUND_UP(sizeof(hdr) + arglen, 8),
+        .timestamp_ns = get_clock(),
+    };
+    uint64_t tail = qatomic_load_acquire(&ring->tail);
+
+    if (ring->head + hdr.length - tail > RING_LEN) {
+        qatomic_set(&ring->dropped, ring->dropped + 1);
+        return false;
+    }
+    ring_write(ring, ring->head, &hdr, sizeof(hdr));
+
+    rec->ring = ring;
+    rec->off = ring->head + sizeof(hdr);
+    rec->end = ring->head + hdr.length;
+    return true;
+}
+
+void ring_record_write_u64(TraceRingRecord *rec, uint64_t val)
+{
+    ring_write(rec->ring, rec->off, &val, sizeof(val));
+    rec->off += sizeof(val);
+}
+
+void ring_record_write_str(TraceRingRecord *rec, const char *s, uint32_t slen)
+{
+    ring_write(rec->ring, rec->off, &slen, sizeof(slen));
+    ring_write(rec->ring, rec->off + sizeof(slen), s, slen);
+    rec->off += sizeof(slen) + slen;
+}
+
+void ring_record_finish(TraceRingRecord *rec)
+{
+    /* the record must be complete before the writeout thread sees it */
+    qatomic_store_release(&rec->ring->head, rec->end);
+}
+
+static bool write_chunk(uint32_t type, uint32_t tid,
+                        const void *p1, size_t n1,
+                        const void *p2, size_t n2)
+{
+    RingTraceChunk chunk = {
+        .type = type,
+        .length = n1 + n2,
+        .tid = tid,
+    };
+
+    return fwrite(&chunk, sizeof(chunk), 1, trace_fp) == 1 &&
+           (!n1 || fwrite(p1, n1, 1, trace_fp) == 1) &&
+           (!n2 || fwrite(p2, n2, 1, trace_fp) == 1);
+}
+
+static void ring_writeout(TraceRing *ring)
+{
+    uint64_t head = qatomic_load_acquire(&ring->head);
+    uint64_t tail = ring->tail;
+    uint64_t dropped = qatomic_read(&ring->dropped);
+
+    if (trace_fp && dropped != ring->dropped_written) {
+        uint64_t n = dropped - ring->dropped_written;
+
+        write_chunk(RING_CHUNK_DROPPED, ring->tid, &n, sizeof(n), NULL, 0);
+    }
+    ring->dropped_written = dropped;
+
+    if (trace_fp && head != tail) {
+        size_t idx = tail & (RING_LEN - 1);
+        size_t n = MIN(head - tail, RING_LEN - idx);
+
+        write_chunk(RING_CHUNK_EVENTS, ring->tid, ring->buf + idx, n,
+                    ring->buf, head - tail - n);
+    }
+    qatomic_store_release(&ring->tail, head);
+}
+
+static void ring_writeout_all__locked(void)
+{
+    TraceRing **p = &rings;
+
+    while (*p) {
+        TraceRing *ring = *p;
+        bool dead = qatomic_load_acquire(&ring->dead);
+
+        ring_writeout(ring);
+        if (dead) {
+            *p = ring->next;
+            g_free(ring);
+        } else {
+            p = &ring->next;
+        }
+    }
+    if (trace_fp) {
+        fflush(trace_fp);
+    }
+}
+
+static gpointer writeout_thread(gpointer opaque)
+{
+    g_mutex_lock(&trace_lock);
+    for (;;) {
+        g_cond_wait_until(&trace_cond, &trace_lock,
+                          g_get_monotonic_time() + RING_WRITEOUT_INTERVAL_US);
+        ring_writeout_all__locked();
+    }
+    g_mutex_unlock(&trace_lock);
+    return NULL;
+}
+
+static bool ring_write_event_mapping(TraceEventIter *iter)
+{
+    TraceEvent *ev;
+
+    while ((ev = trace_event_iter_next(iter)) != NULL) {
+        uint64_t id = trace_event_get_id(ev);
+        const char *name = trace_event_get_name(ev);
+        uint32_t len = strlen(name);
+        uint8_t buf[sizeof(id) + sizeof(len)];
+
+        memcpy(buf, &id, sizeof(id));
+        memcpy(buf + sizeof(id), &len, sizeof(len));
+        if (!write_chunk(RING_CHUNK_MAPPING, 0, buf, sizeof(buf),
+                         name, len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Enable / disable tracing, return whether it was enabled.
+ *
+ * @enable: enable if %true, else disable.
+ */
+bool ring_set_trace_file_enabled(bool enable)
+{
+    static const RingTraceHeader header = {
+        .magic = RING_MAGIC,
+        .version = RING_VERSION,
+    };
+    TraceEventIter iter;
+    bool was_enabled;
+
+    g_mutex_lock(&trace_lock);
+    was_enabled = trace_fp;
+    if (enable == was_enabled) {
+        goto out;
+    }
+
+    /* Write out, or discard, what was recorded so far */
+    ring_writeout_all__locked();
+    if (!enable) {
+        fclose(trace_fp);
+        trace_fp = NULL;
+        goto out;
+    }
+
+    trace_fp = fopen(trace_file_name, "wb");
+    if (!trace_fp) {
+        goto out;
+    }
+    trace_event_iter_init_all(&iter);
+    if (fwrite(&header, sizeof(header), 1, trace_fp) != 1 ||
+        !ring_write_event_mapping(&iter)) {
+        fclose(trace_fp);
+        trace_fp = NULL;
+    }
+out:
+    g_mutex_unlock(&trace_lock);
+    return was_enabled;
+}
+
+/**
+ * Set the name of a trace file
+ *
+ * @file        The trace file name or NULL for the default name-<pid> set at
+ *              config time
+ */
+void ring_set_trace_file(const char *file)
+{
+    bool saved_enable = ring_set_trace_file_enabled(false);
+
+    g_free(trace_file_name);
+
+    if (!file) {
+        /* Type cast needed for Windows where getpid() returns an int. */
+        trace_file_name = g_strdup_printf(CONFIG_TRACE_FILE "-" FMT_pid,
+                                          (pid_t)getpid());
+    } else {
+        trace_file_name = g_strdup(file);
+    }
+
+    ring_set_trace_file_enabled(saved_enable);
+}
+
+void ring_print_trace_file_status(void)
+{
+    qemu_printf("Trace file \"%s\" %s.\n",
+                trace_file_name, trace_fp ? "on" : "off");
+}
+
+void ring_flush_trace_buffer(void)
+{
+    g_mutex_lock(&trace_lock);
+    ring_writeout_all__locked();
+    g_mutex_unlock(&trace_lock);
+}
+
+/*
+ * As in the simple backend, use glib's thread with signals blocked, since
+ * QEMU's own thread functions can be traced.
+ */
+bool ring_init(void)
+{
+    GThread *thread;
+#ifndef _WIN32
+    sigset_t set, oldset;
+
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oldset);
+#endif
+    thread = g_thread_new("trace-thread", writeout_thread, NULL);
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+
+    if (!thread) {
+        warn_report("unable to initialize ring trace backend");
+        return false;
+    }
+
+    atexit(ring_flush_trace_buffer);
+    return true;
+}
+
+void ring_init_group(size_t group)
+{
+    TraceEventIter iter;
+
+    g_mutex_lock(&trace_lock);
+    if (trace_fp) {
+        trace_event_iter_init_group(&iter, group);
+        ring_write_event_mapping(&iter);
+    }
+    g_mutex_unlock(&trace_lock);
+}
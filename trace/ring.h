@@ -0,0 +1,52 @@
+/*
+ * Per-thread ring trace backend
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+typedef struct TraceRing TraceRing;
+
+typedef struct {
+    TraceRing *ring;
+    uint64_t off;       /* where the next argument goes */
+    uint64_t end;       /* where the next record goes */
+} TraceRingRecord;
+
+/* Strings are truncated to this length, as with the simple backend */
+#define RING_TRACE_STRLEN 512
+
+void ring_print_trace_file_status(void);
+bool ring_set_trace_file_enabled(bool enable);
+void ring_set_trace_file(const char *file);
+bool ring_init(void);
+void ring_init_group(size_t group);
+void ring_flush_trace_buffer(void);
+
+/**
+ * Claim space for a record in the ring of the calling thread
+ *
+ * @arglen  number of bytes required for arguments
+ *
+ * Returns false if the ring is full, in which case the record is dropped.
+ */
+bool ring_record_start(TraceRingRecord *rec, uint32_t id, size_t arglen);
+
+/**
+ * Append a 64-bit argument to a trace record
+ */
+void ring_record_write_u64(TraceRingRecord *rec, uint64_t val);
+
+/**
+ * Append a string argument to a trace record
+ */
+void ring_record_write_str(TraceRingRecord *rec, const char *s, uint32_t slen);
+
+/**
+ * Publish a trace record to the writeout thread
+ */
+void ring_record_finish(TraceRingRecord *rec);
+
+#endif /* TRACE_RING_H */
@@ -0,0 +1,135 @@
+/*
+ * Trace points that are patched in and out of the code at runtime
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "trace/control.h"
+
+/* Registration happens from constructors, before any thread is created */
+static QemuMutex static_key_lock;
+static GPtrArray *static_key_ranges;    /* start of each registered range */
+static GHashTable *static_keys;         /* TraceEvent -> GPtrArray of keys */
+
+#if defined(__x86_64__)
+static void static_key_write(const TraceStaticKey *key, bool enable)
+{
+    uint64_t *word = (uint64_t *)key->code;
+    uint8_t insn[8];
+
+    memcpy(insn, word, sizeof(insn));
+    if (enable) {
+        int32_t rel = key->target - (key->code + 5);
+
+        insn[0] = 0xe9;
+        memcpy(&insn[1], &rel, sizeof(rel));
+    } else {
+        static const uint8_t nop5[] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+        memcpy(insn, nop5, sizeof(nop5));
+    }
+    qatomic_set(word, *(uint64_t *)insn);
+}
+#elif defined(__aarch64__)
+static void static_key_write(const TraceStaticKey *key, bool enable)
+{
+    uint32_t *insn = (uint32_t *)key->code;
+
+    if (enable) {
+        ptrdiff_t rel = (intptr_t)(key->target - key->code) >> 2;
+
+        qatomic_set(insn, 0x14000000 | (rel & 0x03ffffff));     /* b */
+    } else {
+        qatomic_set(insn, 0xd503201f);                          /* nop */
+    }
+    __builtin___clear_cache((char *)insn, (char *)(insn + 1));
+}
+#endif
+
+static bool static_key_patch(const TraceStaticKey *key, bool enable)
+{
+    uintptr_t page = key->code & -qemu_real_host_page_size;
+
+    /* The aligned nop never crosses a page boundary */
+    if (mprotect((void *)page, qemu_real_host_page_size,
+                 PROT_READ | PROT_WRITE | PROT_EXEC)) {
+        return false;
+    }
+    static_key_write(key, enable);
+    mprotect((void *)page, qemu_real_host_page_size, PROT_READ | PROT_EXEC);
+    return true;
+}
+
+static void static_key_patch_event(TraceEvent *ev, GPtrArray *keys,
+                                   bool enable)
+{
+    guint i;
+
+    for (i = 0; i < keys->len; i++) {
+        if (!static_key_patch(g_ptr_array_index(keys, i), enable)) {
+            warn_report("trace: could not patch the trace points of "
+                        "'%s': %s", trace_event_get_name(ev),
+                        strerror(errno));
+            return;
+        }
+    }
+}
+
+void trace_static_keys_register(const TraceStaticKey *start,
+                                const TraceStaticKey *stop)
+{
+    const TraceStaticKey *key;
+
+    if (!static_key_ranges) {
+        qemu_mutex_init(&static_key_lock);
+        static_key_ranges = g_ptr_array_new();
+        static_keys = g_hash_table_new_full(NULL, NULL, NULL,
+                                            (GDestroyNotify)g_ptr_array_unref);
+    }
+    if (start == stop) {
+        return;
+    }
+
+    qemu_mutex_lock(&static_key_lock);
+    if (g_ptr_array_find(static_key_ranges, start, NULL)) {
+        qemu_mutex_unlock(&static_key_lock);
+        return;
+    }
+    g_ptr_array_add(static_key_ranges, (gpointer)start);
+
+    for (key = start; key < stop; key++) {
+        GPtrArray *keys = g_hash_table_lookup(static_keys, key->ev);
+
+        if (!keys) {
+            keys = g_ptr_array_new();
+            g_hash_table_insert(static_keys, key->ev, keys);
+        }
+        g_ptr_array_add(keys, (gpointer)key);
+
+        /* a module loaded after the event was enabled */
+        if (*key->ev->dstate && !static_key_patch(key, true)) {
+            warn_report("trace: could not patch the trace points of "
+                        "'%s': %s", trace_event_get_name(key->ev),
+                        strerror(errno));
+        }
+    }
+    qemu_mutex_unlock(&static_key_lock);
+}
+
+void trace_static_key_update(TraceEvent *ev, bool enable)
+{
+    GPtrArray *keys;
+
+    if (!static_key_ranges) {
+        return;
+    }
+    qemu_mutex_lock(&static_key_lock);
+    keys = g_hash_table_lookup(static_keys, ev);
+    if (keys) {
+        static_key_patch_event(ev, keys, enable);
+    }
+    qemu_mutex_unlock(&static_key_lock);
+}
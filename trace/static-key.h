@@ -0,0 +1,93 @@
+/*
+ * Trace points that are patched in and out of the code at runtime
+ *
+ * The trace points of the groups listed in the trace_static_keys build
+ * option start as a single nop instruction, instead of a load and test of
+ * the event's dynamic state.  When the event is enabled, the nop is
+ * rewritten into a jump to the out-of-line code that calls the backends,
+ * and back into a nop when it is disabled.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef TRACE__STATIC_KEY_H
+#define TRACE__STATIC_KEY_H
+
+#include "event-internal.h"
+
+/* One per trace point, collected by the linker in __trace_static_keys */
+typedef struct TraceStaticKey {
+    uintptr_t code;         /* address of the nop */
+    uintptr_t target;       /* where it jumps to once enabled */
+    TraceEvent *ev;
+} TraceStaticKey;
+
+#if defined(__x86_64__)
+/*
+ * A jmp rel32 is 5 bytes as well.  The alignment keeps the instruction
+ * within a single naturally aligned 8-byte word, so that it can be
+ * replaced with one store while other threads execute it.
+ */
+#define TRACE_STATIC_KEY_NOP    ".balign 8\n\t" \
+                                "1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00\n\t"
+#elif defined(__aarch64__)
+#define TRACE_STATIC_KEY_NOP    "1: nop\n\t"
+#else
+#error "trace_static_keys is not supported on this host"
+#endif
+
+/**
+ * trace_event_static_branch:
+ *
+ * Whether @ev was enabled, in the form of a nop that is patched into a
+ * jump.  The caller still has to check the dynamic state of the event:
+ * while several threads enable it, some may see the jump before others
+ * see the new state.
+ */
+static inline __attribute__((always_inline))
+bool trace_event_static_branch(TraceEvent *ev)
+{
+    asm goto(TRACE_STATIC_KEY_NOP
+             ".pushsection __trace_static_keys, \"aw\"\n\t"
+             ".balign 8\n\t"
+             ".quad 1b, %l[enabled], %c0\n\t"
+             ".popsection\n\t"
+             : : "i"(ev) : : enabled);
+    return false;
+ enabled:
+    return true;
+}
+
+/*
+ * Each executable and module has its own section; the symbols are weak
+ * so that an object without any trace point of such a group still links.
+ */
+#define TRACE_STATIC_KEYS_SECTION_DECLARE()                                \
+    extern const TraceStaticKey __start___trace_static_keys[]              \
+        __attribute__((weak, visibility("hidden")));                       \
+    extern const TraceStaticKey __stop___trace_static_keys[]               \
+        __attribute__((weak, visibility("hidden")))
+
+#define TRACE_STATIC_KEYS_SECTION_REGISTER()                               \
+    trace_static_keys_register(__start___trace_static_keys,                \
+                               __stop___trace_static_keys)
+
+/**
+ * trace_static_keys_register:
+ *
+ * Make the keys in [@start, @stop) known, patching in those of the events
+ * that are already enabled.  A range that was already registered is
+ * ignored.
+ */
+void trace_static_keys_register(const TraceStaticKey *start,
+                                const TraceStaticKey *stop);
+
+/**
+ * trace_static_key_update:
+ *
+ * Patch the trace points of @ev in or out.  Called whenever the dynamic
+ * state of @ev goes from zero to non-zero and back.
+ */
+void trace_static_key_update(TraceEvent *ev, bool enable);
+
+#endif /* TRACE__STATIC_KEY_H */
@@ -29,6 +29,7 @@
 #include "qapi/qapi-commands-ui.h"
 #include "qemu/fifo8.h"
 #include "qemu/main-loop.h"
+#include "qemu/mem-usage.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/timer.h"
@@ -129,6 +130,10 @@ struct DisplayState {
     bool refreshing;
     bool have_gfx;
     bool have_text;
+    /* Slow down refreshes while nothing gets redrawn */
+    bool adaptive_refresh;
+    bool damaged;
+    unsigned idle_shift;
 
     QLIST_HEAD(, DisplayChangeListener) listeners;
 };
@@ -154,6 +159,7 @@ static void gui_update(void *opaque)
     DisplayChangeListener *dcl;
     QemuConsole *con;
 
+    ds->damaged = false;
     ds->refreshing = true;
     dpy_refresh(ds);
     ds->refreshing = false;
@@ -165,6 +171,16 @@ static void gui_update(void *opaque)
             interval = dcl_interval;
         }
     }
+    if (ds->adaptive_refresh) {
+        /* Double the interval after each refresh that found no damage */
+        if (ds->damaged) {
+            ds->idle_shift = 0;
+        } else if ((interval << ds->idle_shift) < GUI_REFRESH_INTERVAL_IDLE) {
+            ds->idle_shift++;
+        }
+        interval = MIN(interval << ds->idle_shift,
+                       MAX(interval, GUI_REFRESH_INTERVAL_IDLE));
+    }
     if (ds->update_interval != interval) {
         ds->update_interval = interval;
         QTAILQ_FOREACH(con, &consoles, next) {
@@ -178,6 +194,16 @@ static void gui_update(void *opaque)
     timer_mod(ds->gui_timer, ds->last_update + interval);
 }
 
+/* Something was redrawn; with adaptive refresh, go back to full rate */
+static void dpy_damage(DisplayState *ds)
+{
+    ds->damaged = true;
+    if (ds->idle_shift && !ds->refreshing && ds->gui_timer) {
+        ds->idle_shift = 0;
+        timer_mod(ds->gui_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME));
+    }
+}
+
 static void gui_setup_refresh(DisplayState *ds)
 {
     DisplayChangeListener *dcl;
@@ -1339,6 +1365,8 @@ DisplaySurface *qemu_create_displaysurface(int width, int height)
                                               NULL, width * 4);
     assert(surface->image != NULL);
     surface->flags = QEMU_ALLOCATED_FLAG;
+    mem_usage_add(MEMORY_USAGE_SUBSYSTEM_DISPLAY,
+                  (size_t)surface_stride(surface) * height);
 
     return surface;
 }
@@ -1398,6 +1426,12 @@ void qemu_free_displaysurface(DisplaySurface *surface)
         return;
     }
     trace_displaysurface_free(surface);
+    if (surface->flags & QEMU_ALLOCATED_FLAG) {
+        size_t size = (size_t)surface_stride(surface) *
+                      surface_height(surface);
+
+        mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_DISPLAY, size);
+    }
     qemu_pixman_image_unref(surface->image);
     g_free(surface);
 }
@@ -1583,6 +1617,7 @@ void dpy_gfx_update(QemuConsole *con, int x, int y, int w, int h)
     if (!qemu_console_is_visible(con)) {
         return;
     }
+    dpy_damage(s);
     QLIST_FOREACH(dcl, &s->listeners, next) {
         if (con != (dcl->con ? dcl->con : active_console)) {
             continue;
@@ -1627,6 +1662,7 @@ void dpy_gfx_replace_surface(QemuConsole *con,
 
     assert(old_surface != surface);
 
+    dpy_damage(s);
     con->surface = surface;
     QLIST_FOREACH(dcl, &s->listeners, next) {
         if (con != (dcl->con ? dcl->con : active_console)) {
@@ -1701,6 +1737,7 @@ void dpy_text_update(QemuConsole *con, int x, int y, int w, int h)
     if (!qemu_console_is_visible(con)) {
         return;
     }
+    dpy_damage(s);
     QLIST_FOREACH(dcl, &s->listeners, next) {
         if (con != (dcl->con ? dcl->con : active_console)) {
             continue;
@@ -1860,6 +1897,7 @@ void dpy_gl_update(QemuConsole *con,
                    uint32_t x, uint32_t y, uint32_t w, uint32_t h)
 {
     assert(con->gl);
+    dpy_damage(con->ds);
     con->gl->ops->dpy_gl_update(con->gl, x, y, w, h);
 }
 
@@ -2362,6 +2400,8 @@ void qemu_display_early_init(DisplayOptions *opts)
 void qemu_display_init(DisplayState *ds, DisplayOptions *opts)
 {
     assert(opts->type < DISPLAY_TYPE__MAX);
+    ds->adaptive_refresh = opts->has_adaptive_refresh &&
+                           opts->adaptive_refresh;
     if (opts->type == DISPLAY_TYPE_NONE) {
         return;
     }
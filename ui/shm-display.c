@@ -0,0 +1,247 @@
+/*
+ * Shared memory display
+ *
+ * Exports each graphic console to a file, normally on tmpfs, that other
+ * processes can map to look at frames without going through screendump.
+ * The damaged areas are copied there as they are reported, and a damage
+ * counter in the header tells readers when it is worth looking again.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+#include "qemu/atomic.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/queue.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-ui.h"
+#include "sysemu/sysemu.h"
+#include "ui/console.h"
+#include "ui/shm-display.h"
+#include "trace.h"
+
+#define SHM_DISPLAY_DATA_OFFSET 4096
+
+typedef struct ShmDisplay {
+    DisplayChangeListener dcl;
+    DisplaySurface *ds;
+    int index;
+    char *path;
+    int fd;
+    QemuShmFb *fb;
+    size_t size;
+    QTAILQ_ENTRY(ShmDisplay) next;
+} ShmDisplay;
+
+static QTAILQ_HEAD(, ShmDisplay) shm_displays =
+    QTAILQ_HEAD_INITIALIZER(shm_displays);
+static Notifier shm_exit_notifier;
+
+static void shm_write_begin(ShmDisplay *sdpy)
+{
+    qatomic_set(&sdpy->fb->damage, sdpy->fb->damage + 1);
+    smp_wmb();
+}
+
+static void shm_write_end(ShmDisplay *sdpy)
+{
+    smp_wmb();
+    qatomic_set(&sdpy->fb->damage, sdpy->fb->damage + 1);
+}
+
+static void shm_copy(ShmDisplay *sdpy, int x, int y, int w, int h)
+{
+    int stride = surface_stride(sdpy->ds);
+    int bpp = surface_bytes_per_pixel(sdpy->ds);
+    uint8_t *src = surface_data(sdpy->ds) + y * stride + x * bpp;
+    uint8_t *dst = (uint8_t *)sdpy->fb + SHM_DISPLAY_DATA_OFFSET +
+                   y * stride + x * bpp;
+    int i;
+
+    for (i = 0; i < h; i++) {
+        memcpy(dst, src, w * bpp);
+        src += stride;
+        dst += stride;
+    }
+}
+
+static void shm_refresh(DisplayChangeListener *dcl)
+{
+    graphic_hw_update(dcl->con);
+}
+
+static void shm_gfx_update(DisplayChangeListener *dcl,
+                           int x, int y, int w, int h)
+{
+    ShmDisplay *sdpy = container_of(dcl, ShmDisplay, dcl);
+
+    if (!sdpy->fb || !sdpy->ds) {
+        return;
+    }
+    x = MIN(x, surface_width(sdpy->ds));
+    y = MIN(y, surface_height(sdpy->ds));
+    w = MIN(x + w, surface_width(sdpy->ds)) - x;
+    h = MIN(y + h, surface_height(sdpy->ds)) - y;
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+
+    shm_write_begin(sdpy);
+    shm_copy(sdpy, x, y, w, h);
+    shm_write_end(sdpy);
+    trace_shm_display_update(sdpy->index, x, y, w, h);
+}
+
+static void shm_gfx_switch(DisplayChangeListener *dcl,
+                           DisplaySurface *new_surface)
+{
+    ShmDisplay *sdpy = container_of(dcl, ShmDisplay, dcl);
+    size_t size;
+    void *fb;
+
+    /*
+     * The old surface goes away with this call, so until the new one
+     * fits in the mapping nothing is exported and the header keeps
+     * describing the last frame that was.
+     */
+    sdpy->ds = NULL;
+    if (!new_surface) {
+        return;
+    }
+
+    size = SHM_DISPLAY_DATA_OFFSET +
+           (size_t)surface_stride(new_surface) * surface_height(new_surface);
+    if (size > sdpy->size) {
+        /* Grow the file; readers keep any older, smaller mapping valid */
+        if (ftruncate(sdpy->fd, size) < 0) {
+            error_report("shm display: cannot resize %s: %s",
+                         sdpy->path, strerror(errno));
+            return;
+        }
+        fb = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  sdpy->fd, 0);
+        if (fb == MAP_FAILED) {
+            error_report("shm display: cannot map %s: %s",
+                         sdpy->path, strerror(errno));
+            return;
+        }
+        if (sdpy->fb) {
+            munmap(sdpy->fb, sdpy->size);
+        }
+        sdpy->fb = fb;
+        sdpy->size = size;
+    }
+
+    sdpy->ds = new_surface;
+    shm_write_begin(sdpy);
+    sdpy->fb->magic = QEMU_SHM_FB_MAGIC;
+    sdpy->fb->version = QEMU_SHM_FB_VERSION;
+    sdpy->fb->size = sdpy->size;
+    sdpy->fb->width = surface_width(new_surface);
+    sdpy->fb->height = surface_height(new_surface);
+    sdpy->fb->stride = surface_stride(new_surface);
+    sdpy->fb->format = surface_format(new_surface);
+    sdpy->fb->data_offset = SHM_DISPLAY_DATA_OFFSET;
+    shm_copy(sdpy, 0, 0, surface_width(new_surface),
+             surface_height(new_surface));
+    shm_write_end(sdpy);
+    trace_shm_display_switch(sdpy->index, surface_width(new_surface),
+                             surface_height(new_surface));
+}
+
+static const DisplayChangeListenerOps shm_ops = {
+    .dpy_name                = "shm",
+    .dpy_refresh             = shm_refresh,
+    .dpy_gfx_update          = shm_gfx_update,
+    .dpy_gfx_switch          = shm_gfx_switch,
+};
+
+static void shm_display_exit(Notifier *n, void *data)
+{
+    ShmDisplay *sdpy;
+
+    QTAILQ_FOREACH(sdpy, &shm_displays, next) {
+        unlink(sdpy->path);
+    }
+}
+
+static void shm_display_init(DisplayState *ds, DisplayOptions *opts)
+{
+    g_autofree char *prefix = NULL;
+    QemuConsole *con;
+    ShmDisplay *sdpy;
+    int idx, fd;
+
+    if (opts->u.shm.has_path) {
+        prefix = g_strdup(opts->u.shm.path);
+    } else {
+        prefix = g_strdup_printf("/dev/shm/qemu-%d-fb", (int)getpid());
+    }
+
+    for (idx = 0;; idx++) {
+        g_autofree char *path = NULL;
+
+        con = qemu_console_lookup_by_index(idx);
+        if (!con || !qemu_console_is_graphic(con)) {
+            break;
+        }
+
+        path = g_strdup_printf("%s%d", prefix, idx);
+        fd = qemu_open_old(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+            error_report("shm display: cannot create %s: %s",
+                         path, strerror(errno));
+            exit(1);
+        }
+
+        sdpy = g_new0(ShmDisplay, 1);
+        sdpy->index = idx;
+        sdpy->path = g_steal_pointer(&path);
+        sdpy->fd = fd;
+        sdpy->dcl.con = con;
+        sdpy->dcl.ops = &shm_ops;
+        QTAILQ_INSERT_TAIL(&shm_displays, sdpy, next);
+        register_displaychangelistener(&sdpy->dcl);
+    }
+
+    shm_exit_notifier.notify = shm_display_exit;
+    qemu_add_exit_notifier(&shm_exit_notifier);
+}
+
+ShmDisplayInfoList *qmp_query_shm_display(Error **errp)
+{
+    ShmDisplayInfoList *head = NULL, **tail = &head;
+    ShmDisplay *sdpy;
+
+    QTAILQ_FOREACH(sdpy, &shm_displays, next) {
+        ShmDisplayInfo *info;
+
+        if (!sdpy->fb) {
+            continue;
+        }
+        info = g_new0(ShmDisplayInfo, 1);
+        info->console = sdpy->index;
+        info->path = g_strdup(sdpy->path);
+        info->width = sdpy->fb->width;
+        info->height = sdpy->fb->height;
+        info->stride = sdpy->fb->stride;
+        info->format = sdpy->fb->format;
+        info->damage = qatomic_read(&sdpy->fb->damage);
+        QAPI_LIST_APPEND(tail, info);
+    }
+    return head;
+}
+
+static QemuDisplay qemu_display_shm = {
+    .type       = DISPLAY_TYPE_SHM,
+    .init       = shm_display_init,
+};
+
+static void register_shm(void)
+{
+    qemu_display_register(&qemu_display_shm);
+}
+
+type_init(register_shm);
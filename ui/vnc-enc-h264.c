@@ -0,0 +1,194 @@
+/*
+ * QEMU VNC display driver: Open H.264 encoding
+ *
+ * Each update is a frame of the whole screen, compressed with libx264,
+ * so that constantly changing content such as video only takes a low
+ * bitrate.  The encoder state lives as long as the screen size and
+ * quality do not change; the client is told to reset its decoder when
+ * a new one is started.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "vnc.h"
+#include "trace.h"
+
+/* Flags of the Open H.264 rectangle header */
+#define VNC_H264_RESET_CONTEXT      (1 << 0)
+
+/* Constant rate factor by quality level, for when the client sets one */
+static const float h264_crf[10] = {
+    40, 37, 34, 31, 28, 26, 24, 22, 20, 18
+};
+
+static void h264_close(VncH264 *h264)
+{
+    if (h264->enc) {
+        x264_encoder_close(h264->enc);
+        x264_picture_clean(&h264->pic);
+        h264->enc = NULL;
+    }
+}
+
+static int h264_open(VncState *vs, int w, int h)
+{
+    VncH264 *h264 = vs->h264;
+    uint8_t quality = vs->tight->quality;
+    x264_param_t param;
+
+    if (h264->enc && h264->width == w && h264->height == h &&
+        h264->quality == quality) {
+        return 0;
+    }
+    h264_close(h264);
+
+    if (x264_param_default_preset(&param, "ultrafast", "zerolatency") < 0) {
+        return -1;
+    }
+    param.i_csp = X264_CSP_I420;
+    param.i_width = w;
+    param.i_height = h;
+    param.i_fps_num = 30;
+    param.i_fps_den = 1;
+    param.b_vfr_input = 0;
+    param.b_repeat_headers = 1;
+    param.b_annexb = 1;
+    param.i_log_level = X264_LOG_NONE;
+    param.vui.b_fullrange = 0;
+    param.vui.i_colmatrix = 6; /* BT.601 */
+    param.rc.i_rc_method = X264_RC_CRF;
+    param.rc.f_rf_constant = quality < ARRAY_SIZE(h264_crf) ?
+                             h264_crf[quality] : 23;
+    if (x264_param_apply_profile(&param, "high") < 0) {
+        return -1;
+    }
+
+    if (x264_picture_alloc(&h264->pic, X264_CSP_I420, w, h) < 0) {
+        return -1;
+    }
+    h264->enc = x264_encoder_open(&param);
+    if (!h264->enc) {
+        x264_picture_clean(&h264->pic);
+        return -1;
+    }
+    h264->width = w;
+    h264->height = h;
+    h264->quality = quality;
+    h264->pts = 0;
+    h264->reset = true;
+    trace_vnc_h264_open(vs, w, h, param.rc.f_rf_constant);
+    return 0;
+}
+
+/* Fill the encoder picture from the server surface, BT.601 limited range */
+static void h264_load_picture(VncState *vs, int x, int y)
+{
+    VncH264 *h264 = vs->h264;
+    x264_image_t *img = &h264->pic.img;
+    int stride = vnc_server_fb_stride(vs->vd);
+    int i, j;
+
+    for (j = 0; j < h264->height; j += 2) {
+        const uint32_t *s0 = vnc_server_fb_ptr(vs->vd, x, y + j);
+        const uint32_t *s1 = (const uint32_t *)((const uint8_t *)s0 + stride);
+        uint8_t *y0 = img->plane[0] + j * img->i_stride[0];
+        uint8_t *y1 = y0 + img->i_stride[0];
+        uint8_t *u = img->plane[1] + j / 2 * img->i_stride[1];
+        uint8_t *v = img->plane[2] + j / 2 * img->i_stride[2];
+
+        for (i = 0; i < h264->width; i += 2) {
+            uint32_t p[4] = { s0[i], s0[i + 1], s1[i], s1[i + 1] };
+            int r = 0, g = 0, b = 0;
+            int k;
+
+            for (k = 0; k < 4; k++) {
+                int pr = (p[k] >> 16) & 0xff;
+                int pg = (p[k] >> 8) & 0xff;
+                int pb = p[k] & 0xff;
+                uint8_t *d = (k < 2 ? y0 : y1) + i + (k & 1);
+
+                *d = ((66 * pr + 129 * pg + 25 * pb + 128) >> 8) + 16;
+                r += pr;
+                g += pg;
+                b += pb;
+            }
+            r /= 4;
+            g /= 4;
+            b /= 4;
+            u[i / 2] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            v[i / 2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+    }
+}
+
+static int send_h264_rect(VncState *vs, int x, int y, int w, int h)
+{
+    VncH264 *h264 = vs->h264;
+    x264_picture_t pic_out;
+    x264_nal_t *nals;
+    int n_nals, size;
+    uint32_t flags;
+
+    if (h264_open(vs, w, h) < 0) {
+        error_report_once("vnc: could not start the H.264 encoder");
+        return -1;
+    }
+
+    h264_load_picture(vs, x, y);
+    h264->pic.i_pts = h264->pts++;
+    size = x264_encoder_encode(h264->enc, &nals, &n_nals, &h264->pic,
+                               &pic_out);
+    if (size < 0) {
+        return -1;
+    }
+
+    flags = 0;
+    if (h264->reset) {
+        flags |= VNC_H264_RESET_CONTEXT;
+        h264->reset = false;
+    }
+    vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_H264);
+    vnc_write_u32(vs, size);
+    vnc_write_u32(vs, flags);
+    /* The payloads of all the NAL units follow each other in memory */
+    if (size) {
+        vnc_write(vs, nals[0].p_payload, size);
+    }
+    return 1;
+}
+
+static int send_raw_rect(VncState *vs, int x, int y, int w, int h)
+{
+    if (!w || !h) {
+        return 0;
+    }
+    vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_RAW);
+    return vnc_raw_send_framebuffer_update(vs, x, y, w, h);
+}
+
+int vnc_h264_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+{
+    /* 4:2:0 frames have even sizes; the odd row or column is sent raw */
+    int ew = w & ~1;
+    int eh = h & ~1;
+    int n;
+
+    if (!ew || !eh) {
+        return send_raw_rect(vs, x, y, w, h);
+    }
+
+    n = send_h264_rect(vs, x, y, ew, eh);
+    if (n < 0) {
+        return send_raw_rect(vs, x, y, w, h);
+    }
+    n += send_raw_rect(vs, x + ew, y, w - ew, h);
+    n += send_raw_rect(vs, x, y + eh, ew, h - eh);
+    return n;
+}
+
+void vnc_h264_clear(VncState *vs)
+{
+    h264_close(vs->h264);
+}
@@ -816,6 +816,22 @@ static int tight_init_stream(VncState *vs, int stream_id,
     return 0;
 }
 
+/*
+ * Send the compression control byte of a rectangle compressed with
+ * @stream_id, resetting the stream first if it is due for it.
+ */
+static void tight_send_comp_ctl(VncState *vs, int stream_id, uint8_t ctl)
+{
+    if (vs->tight->reset_streams & (1 << stream_id)) {
+        if (vs->tight->stream[stream_id].opaque) {
+            deflateReset(&vs->tight->stream[stream_id]);
+        }
+        vs->tight->reset_streams &= ~(1 << stream_id);
+        ctl |= 1 << stream_id;
+    }
+    vnc_write_u8(vs, ctl);
+}
+
 static void tight_send_compact_size(VncState *vs, size_t len)
 {
     int lpc = 0;
@@ -925,7 +941,7 @@ static int send_full_color_rect(VncState *vs, int x, int y, int w, int h)
     }
 #endif
 
-    vnc_write_u8(vs, stream << 4); /* no flushing, no filter */
+    tight_send_comp_ctl(vs, stream, stream << 4); /* no filter */
 
     if (vs->tight->pixel24) {
         tight_pack24(vs, vs->tight->tight.buffer, w * h,
@@ -982,7 +998,7 @@ static int send_mono_rect(VncState *vs, int x, int y,
 
     bytes = DIV_ROUND_UP(w, 8) * h;
 
-    vnc_write_u8(vs, (stream | VNC_TIGHT_EXPLICIT_FILTER) << 4);
+    tight_send_comp_ctl(vs, stream, (stream | VNC_TIGHT_EXPLICIT_FILTER) << 4);
     vnc_write_u8(vs, VNC_TIGHT_FILTER_PALETTE);
     vnc_write_u8(vs, 1);
 
@@ -1048,7 +1064,7 @@ static bool send_gradient_rect(VncState *vs, int x, int y, int w, int h)
         return send_full_color_rect(vs, x, y, w, h);
     }
 
-    vnc_write_u8(vs, (stream | VNC_TIGHT_EXPLICIT_FILTER) << 4);
+    tight_send_comp_ctl(vs, stream, (stream | VNC_TIGHT_EXPLICIT_FILTER) << 4);
     vnc_write_u8(vs, VNC_TIGHT_FILTER_GRADIENT);
 
     buffer_reserve(&vs->tight->gradient, w * 3 * sizeof(int));
@@ -1090,7 +1106,7 @@ static int send_palette_rect(VncState *vs, int x, int y,
 
     colors = palette_size(palette);
 
-    vnc_write_u8(vs, (stream | VNC_TIGHT_EXPLICIT_FILTER) << 4);
+    tight_send_comp_ctl(vs, stream, (stream | VNC_TIGHT_EXPLICIT_FILTER) << 4);
     vnc_write_u8(vs, VNC_TIGHT_FILTER_PALETTE);
     vnc_write_u8(vs, colors - 1);
 
@@ -81,7 +81,8 @@ static int zrle_compress_data(VncState *vs, int level)
         zstream->zalloc = vnc_zlib_zalloc;
         zstream->zfree = vnc_zlib_zfree;
 
-        err = deflateInit2(zstream, level, Z_DEFLATED, MAX_WBITS,
+        err = deflateInit2(zstream, level, Z_DEFLATED,
+                           vs->zrle->stripes ? -MAX_WBITS : MAX_WBITS,
                            MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
 
         if (err != Z_OK) {
@@ -95,11 +96,19 @@ static int zrle_compress_data(VncState *vs, int level)
     /* reserve memory in output buffer */
     buffer_reserve(&vs->zrle->zlib, vs->zrle->zrle.offset + 64);
 
+    if (vs->zrle->stripes && !vs->zrle->header_sent) {
+        /* 32K window, default compression, no dictionary */
+        static const uint8_t zlib_header[] = { 0x78, 0x9c };
+
+        buffer_append(&vs->zrle->zlib, zlib_header, sizeof(zlib_header));
+        vs->zrle->header_sent = true;
+    }
+
     /* set pointers */
     zstream->next_in = vs->zrle->zrle.buffer;
     zstream->avail_in = vs->zrle->zrle.offset;
-    zstream->next_out = vs->zrle->zlib.buffer;
-    zstream->avail_out = vs->zrle->zlib.capacity;
+    zstream->next_out = vs->zrle->zlib.buffer + vs->zrle->zlib.offset;
+    zstream->avail_out = vs->zrle->zlib.capacity - vs->zrle->zlib.offset;
     zstream->data_type = Z_BINARY;
 
     /* start encoding */
@@ -107,6 +116,12 @@ static int zrle_compress_data(VncState *vs, int level)
         fprintf(stderr, "VNC: error during zrle compression\n");
         return -1;
     }
+    /*
+     * A stream that is not split in stripes started with the header, so
+     * the stripes must not send another one if encoder threads are added
+     * later.
+     */
+    vs->zrle->header_sent = true;
 
     vs->zrle->zlib.offset = vs->zrle->zlib.capacity - zstream->avail_out;
     return vs->zrle->zlib.offset;
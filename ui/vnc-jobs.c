@@ -51,14 +51,50 @@
  * its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * With more than one encoder thread, the worker thread splits each job in
+ * horizontal stripes and queues them under the stripe lock.  The encoder
+ * threads, and the worker thread itself, encode them in parallel while the
+ * worker thread keeps the VncDisplay lock; it then puts the results back
+ * together in order.  Every stripe starts from fresh zlib streams, so that
+ * it does not depend on what the other stripes sent.
  */
 
+/* A thread encoding stripes, with its own encoder state */
+typedef struct VncEncoder {
+    QemuThread thread;
+    VncState vs;
+    VncTight tight;
+    VncZrle zrle;
+} VncEncoder;
+
+typedef struct VncStripe {
+    VncJob *job;
+    int y;
+    int h;
+    /* Results */
+    Buffer output;
+    int n_rectangles;
+    bool zrle_header_sent;
+    QSIMPLEQ_ENTRY(VncStripe) next;
+} VncStripe;
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
     QemuThread thread;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
+
+    /* Protected by stripe_mutex */
+    QemuMutex stripe_mutex;
+    QemuCond stripe_cond;
+    QemuCond stripes_done;
+    QSIMPLEQ_HEAD(, VncStripe) stripes;
+    int stripes_pending;
+    /* The first one is used by the worker thread */
+    VncEncoder **encoders;
+    int n_encoders;
 };
 
 typedef struct VncJobQueue VncJobQueue;
@@ -193,6 +229,9 @@ static void vnc_async_encoding_start(VncState *orig, VncState *local)
     local->zlib = orig->zlib;
     local->hextile = orig->hextile;
     local->zrle = orig->zrle;
+#ifdef CONFIG_VNC_H264
+    local->h264 = orig->h264;
+#endif
     local->client_width = orig->client_width;
     local->client_height = orig->client_height;
 }
@@ -235,6 +274,199 @@ static bool vnc_worker_clamp_rect(VncState *vs, VncJob *job, VncRect *rect)
     return false;
 }
 
+static VncEncoder *vnc_encoder_new(int index)
+{
+    VncEncoder *enc = g_new0(VncEncoder, 1);
+
+    enc->vs.magic = VNC_MAGIC;
+    enc->vs.tight = &enc->tight;
+    enc->vs.zrle = &enc->zrle;
+    buffer_init(&enc->tight.tight,    "vnc-encoder-tight/%d", index);
+    buffer_init(&enc->tight.zlib,     "vnc-encoder-tight-zlib/%d", index);
+    buffer_init(&enc->tight.gradient, "vnc-encoder-tight-gradient/%d", index);
+#ifdef CONFIG_VNC_JPEG
+    buffer_init(&enc->tight.jpeg,     "vnc-encoder-tight-jpeg/%d", index);
+#endif
+#ifdef CONFIG_VNC_PNG
+    buffer_init(&enc->tight.png,      "vnc-encoder-tight-png/%d", index);
+#endif
+    buffer_init(&enc->zrle.zrle,      "vnc-encoder-zrle/%d", index);
+    buffer_init(&enc->zrle.fb,        "vnc-encoder-zrle-fb/%d", index);
+    buffer_init(&enc->zrle.zlib,      "vnc-encoder-zrle-zlib/%d", index);
+    enc->zrle.stripes = true;
+    return enc;
+}
+
+static void vnc_encode_stripe(VncEncoder *enc, VncStripe *stripe)
+{
+    VncState *orig = stripe->job->vs;
+    VncState *vs = &enc->vs;
+    VncRectEntry *entry;
+
+    vs->vnc_encoding = orig->vnc_encoding;
+    vs->features = orig->features;
+    vs->vd = orig->vd;
+    vs->lossy_rect = orig->lossy_rect;
+    vs->write_pixels = orig->write_pixels;
+    vs->client_pf = orig->client_pf;
+    vs->client_be = orig->client_be;
+    vs->hextile = orig->hextile;
+    vs->client_width = orig->client_width;
+    vs->client_height = orig->client_height;
+    enc->tight.quality = orig->tight->quality;
+    enc->tight.compression = orig->tight->compression;
+    enc->tight.reset_streams = (1 << ARRAY_SIZE(enc->tight.stream)) - 1;
+    enc->zrle.header_sent = orig->zrle->header_sent;
+    if (enc->zrle.stream.opaque) {
+        deflateReset(&enc->zrle.stream);
+    }
+
+    vs->output = stripe->output;
+    QLIST_FOREACH(entry, &stripe->job->rectangles, next) {
+        int y = MAX(entry->rect.y, stripe->y);
+        int h = MIN(entry->rect.y + entry->rect.h, stripe->y + stripe->h) - y;
+        int n;
+
+        if (h > 0) {
+            n = vnc_send_framebuffer_update(vs, entry->rect.x, y,
+                                            entry->rect.w, h);
+            if (n >= 0) {
+                stripe->n_rectangles += n;
+            }
+        }
+    }
+    stripe->output = vs->output;
+    stripe->zrle_header_sent = enc->zrle.header_sent;
+}
+
+/* Called with the stripe lock held, which is released while encoding */
+static void vnc_encode_next_stripe(VncJobQueue *queue, VncEncoder *enc)
+{
+    VncStripe *stripe = QSIMPLEQ_FIRST(&queue->stripes);
+
+    QSIMPLEQ_REMOVE_HEAD(&queue->stripes, next);
+    qemu_mutex_unlock(&queue->stripe_mutex);
+
+    vnc_encode_stripe(enc, stripe);
+
+    qemu_mutex_lock(&queue->stripe_mutex);
+    if (--queue->stripes_pending == 0) {
+        qemu_cond_broadcast(&queue->stripes_done);
+    }
+}
+
+static void *vnc_encoder_thread(void *arg)
+{
+    VncEncoder *enc = arg;
+
+    qemu_mutex_lock(&queue->stripe_mutex);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&queue->stripes)) {
+            qemu_cond_wait(&queue->stripe_cond, &queue->stripe_mutex);
+        }
+        vnc_encode_next_stripe(queue, enc);
+    }
+    return NULL;
+}
+
+static bool vnc_job_can_split(VncState *vs)
+{
+    switch (vs->vnc_encoding) {
+    case VNC_ENCODING_ZLIB:
+        /* A single stream and no means to restart it */
+        return false;
+#ifdef CONFIG_VNC_H264
+    case VNC_ENCODING_H264:
+        /* Whole frames, with a single encoder state */
+        return false;
+#endif
+    default:
+        return true;
+    }
+}
+
+/*
+ * Encode the rectangles of @job in horizontal stripes, spread over the
+ * encoder threads, and append them to vs->output in order.  Returns the
+ * number of rectangles sent.
+ */
+static int vnc_job_encode_stripes(VncJobQueue *queue, VncState *vs,
+                                  VncJob *job, int n_encoders)
+{
+    VncRectEntry *entry, *tmp;
+    VncStripe *stripes;
+    int top = INT_MAX, bottom = 0;
+    int n_stripes, height, n_rectangles = 0;
+    int i;
+
+    QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
+        if (!vnc_worker_clamp_rect(vs, job, &entry->rect)) {
+            QLIST_REMOVE(entry, next);
+            g_free(entry);
+            continue;
+        }
+        top = MIN(top, entry->rect.y);
+        bottom = MAX(bottom, entry->rect.y + entry->rect.h);
+    }
+    if (top >= bottom) {
+        return 0;
+    }
+
+    /*
+     * Stripes are made of whole VNC_STAT_RECT rows, so that lossy_rect is
+     * not shared between them.  Until the client has got its zlib header,
+     * ZRLE updates are kept in one piece.
+     */
+    top = QEMU_ALIGN_DOWN(top, VNC_STAT_RECT);
+    if ((vs->vnc_encoding == VNC_ENCODING_ZRLE ||
+         vs->vnc_encoding == VNC_ENCODING_ZYWRLE) &&
+        !job->vs->zrle->header_sent) {
+        n_stripes = 1;
+    } else {
+        n_stripes = MIN(n_encoders * 2,
+                        DIV_ROUND_UP(bottom - top, VNC_STAT_RECT));
+    }
+    height = QEMU_ALIGN_UP(DIV_ROUND_UP(bottom - top, n_stripes),
+                           VNC_STAT_RECT);
+    n_stripes = DIV_ROUND_UP(bottom - top, height);
+    trace_vnc_job_stripes(vs, job, n_stripes, height);
+
+    stripes = g_new0(VncStripe, n_stripes);
+    qemu_mutex_lock(&queue->stripe_mutex);
+    for (i = 0; i < n_stripes; i++) {
+        stripes[i].job = job;
+        stripes[i].y = top + i * height;
+        stripes[i].h = height;
+        buffer_init(&stripes[i].output, "vnc-stripe/%d", i);
+        QSIMPLEQ_INSERT_TAIL(&queue->stripes, &stripes[i], next);
+    }
+    queue->stripes_pending = n_stripes;
+    qemu_cond_broadcast(&queue->stripe_cond);
+
+    while (!QSIMPLEQ_EMPTY(&queue->stripes)) {
+        vnc_encode_next_stripe(queue, queue->encoders[0]);
+    }
+    while (queue->stripes_pending) {
+        qemu_cond_wait(&queue->stripes_done, &queue->stripe_mutex);
+    }
+    qemu_mutex_unlock(&queue->stripe_mutex);
+
+    for (i = 0; i < n_stripes; i++) {
+        buffer_move(&vs->output, &stripes[i].output);
+        buffer_free(&stripes[i].output);
+        n_rectangles += stripes[i].n_rectangles;
+        if (stripes[i].zrle_header_sent) {
+            job->vs->zrle->header_sent = true;
+        }
+    }
+    g_free(stripes);
+
+    QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
+        g_free(entry);
+    }
+    return n_rectangles;
+}
+
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
     VncJob *job;
@@ -242,6 +474,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     VncState vs = {};
     int n_rectangles;
     int saved_offset;
+    int n_encoders;
 
     vnc_lock_queue(queue);
     while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
@@ -282,7 +515,21 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
+    qemu_mutex_lock(&queue->stripe_mutex);
+    n_encoders = queue->n_encoders;
+    qemu_mutex_unlock(&queue->stripe_mutex);
+
     vnc_lock_display(job->vs->vd);
+    if (n_encoders > 1 && vnc_job_can_split(&vs)) {
+        if (job->vs->ioc == NULL) {
+            vnc_unlock_display(job->vs->vd);
+            /* Copy persistent encoding data */
+            vnc_async_encoding_end(job->vs, &vs);
+            goto disconnected;
+        }
+        n_rectangles = vnc_job_encode_stripes(queue, &vs, job, n_encoders);
+        QLIST_INIT(&job->rectangles);
+    }
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
@@ -341,6 +588,14 @@ static VncJobQueue *vnc_queue_init(void)
     qemu_cond_init(&queue->cond);
     qemu_mutex_init(&queue->mutex);
     QTAILQ_INIT(&queue->jobs);
+
+    qemu_mutex_init(&queue->stripe_mutex);
+    qemu_cond_init(&queue->stripe_cond);
+    qemu_cond_init(&queue->stripes_done);
+    QSIMPLEQ_INIT(&queue->stripes);
+    queue->encoders = g_new0(VncEncoder *, 1);
+    queue->encoders[0] = vnc_encoder_new(0);
+    queue->n_encoders = 1;
     return queue;
 }
 
@@ -380,3 +635,28 @@ void vnc_start_worker_thread(void)
                        QEMU_THREAD_DETACHED);
     queue = q; /* Set global queue */
 }
+
+/*
+ * Make sure at least @n threads encode the framebuffer updates, the worker
+ * thread included.  Threads are never stopped; the largest request of all
+ * displays wins.
+ */
+void vnc_start_encoder_threads(int n)
+{
+    int i;
+
+    assert(vnc_worker_thread_running());
+
+    qemu_mutex_lock(&queue->stripe_mutex);
+    if (n > queue->n_encoders) {
+        queue->encoders = g_renew(VncEncoder *, queue->encoders, n);
+        for (i = queue->n_encoders; i < n; i++) {
+            queue->encoders[i] = vnc_encoder_new(i);
+            qemu_thread_create(&queue->encoders[i]->thread, "vnc_encoder",
+                               vnc_encoder_thread, queue->encoders[i],
+                               QEMU_THREAD_DETACHED);
+        }
+        queue->n_encoders = n;
+    }
+    qemu_mutex_unlock(&queue->stripe_mutex);
+}
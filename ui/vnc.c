@@ -35,6 +35,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/bswap.h"
 #include "qemu/option.h"
 #include "qemu/sockets.h"
 #include "qemu/timer.h"
@@ -982,6 +983,11 @@ int vnc_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
         case VNC_ENCODING_ZYWRLE:
             n = vnc_zywrle_send_framebuffer_update(vs, x, y, w, h);
             break;
+#ifdef CONFIG_VNC_H264
+        case VNC_ENCODING_H264:
+            n = vnc_h264_send_framebuffer_update(vs, x, y, w, h);
+            break;
+#endif
         default:
             vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_RAW);
             n = vnc_raw_send_framebuffer_update(vs, x, y, w, h);
@@ -1188,6 +1194,17 @@ static int vnc_update_client(VncState *vs, int has_dirty)
     height = pixman_image_get_height(vd->server);
     width = pixman_image_get_width(vd->server);
 
+#ifdef CONFIG_VNC_H264
+    if (vs->vnc_encoding == VNC_ENCODING_H264) {
+        /* Video frames always cover the whole screen */
+        for (y = 0; y < height; y++) {
+            bitmap_zero(vs->dirty[y], VNC_DIRTY_BITS);
+        }
+        n += vnc_job_add_rect(job, 0, 0, width, height);
+        goto done;
+    }
+#endif
+
     y = 0;
     for (;;) {
         int x, h;
@@ -1218,6 +1235,9 @@ static int vnc_update_client(VncState *vs, int has_dirty)
         }
     }
 
+#ifdef CONFIG_VNC_H264
+ done:
+#endif
     vs->job_update = vs->update;
     vs->update = VNC_STATE_UPDATE_NONE;
     vnc_job_push(job);
@@ -1339,6 +1359,9 @@ void vnc_disconnect_finish(VncState *vs)
     vnc_zlib_clear(vs);
     vnc_tight_clear(vs);
     vnc_zrle_clear(vs);
+#ifdef CONFIG_VNC_H264
+    vnc_h264_clear(vs);
+#endif
 
 #ifdef CONFIG_VNC_SASL
     vnc_sasl_client_cleanup(vs);
@@ -1378,6 +1401,9 @@ void vnc_disconnect_finish(VncState *vs)
     vs->magic = 0;
     g_free(vs->zrle);
     g_free(vs->tight);
+#ifdef CONFIG_VNC_H264
+    g_free(vs->h264);
+#endif
     g_free(vs);
 }
 
@@ -2190,6 +2216,15 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
             vs->features |= VNC_FEATURE_ZYWRLE_MASK;
             vs->vnc_encoding = enc;
             break;
+#ifdef CONFIG_VNC_H264
+        case VNC_ENCODING_H264:
+            /* Lossy, like JPEG */
+            if (vs->vd->lossy) {
+                vs->features |= VNC_FEATURE_H264_MASK;
+                vs->vnc_encoding = enc;
+            }
+            break;
+#endif
         case VNC_ENCODING_DESKTOPRESIZE:
             vs->features |= VNC_FEATURE_RESIZE_MASK;
             break;
@@ -3087,6 +3122,71 @@ static void vnc_rect_updated(VncDisplay *vd, int x, int y, struct timeval * tv)
     rect->updated = true;
 }
 
+/* Chunks compared at once, to skip over unchanged areas quickly */
+#define VNC_CMP_GROUP 4
+
+/* Whether @len bytes differ; @len is a multiple of 8 */
+static bool vnc_bytes_differ(const uint8_t *a, const uint8_t *b, int len)
+{
+    uint64_t acc = 0;
+    int i;
+
+    for (i = 0; i < len; i += 8) {
+        acc |= ldq_he_p(a + i) ^ ldq_he_p(b + i);
+    }
+    return acc != 0;
+}
+
+/*
+ * Copy to @server the chunks of @guest, @cmp_bytes each, from @x to
+ * @end, whose bytes changed and set their bits in @changed.  The last
+ * chunk of the line may be shorter.  Unless @compare, all chunks are
+ * taken as changed.
+ */
+static void vnc_copy_changed(uint8_t *server, const uint8_t *guest,
+                             int x, int end, int cmp_bytes, int line_bytes,
+                             bool compare, unsigned long *changed)
+{
+    int full_end = MIN(end, line_bytes / cmp_bytes);
+    int i, j;
+
+    if (!compare) {
+        memcpy(server + x * cmp_bytes, guest + x * cmp_bytes,
+               MIN(end * cmp_bytes, line_bytes) - x * cmp_bytes);
+        bitmap_set(changed, x, end - x);
+        return;
+    }
+
+    if (cmp_bytes % 8 == 0) {
+        for (i = x; i < full_end; i += VNC_CMP_GROUP) {
+            int n = MIN(VNC_CMP_GROUP, full_end - i);
+            int off = i * cmp_bytes;
+
+            if (!vnc_bytes_differ(server + off, guest + off, n * cmp_bytes)) {
+                continue;
+            }
+            for (j = 0; j < n; j++, off += cmp_bytes) {
+                if (vnc_bytes_differ(server + off, guest + off, cmp_bytes)) {
+                    memcpy(server + off, guest + off, cmp_bytes);
+                    set_bit(i + j, changed);
+                }
+            }
+        }
+        x = MAX(x, full_end);
+    }
+
+    for (i = x; i < end; i++) {
+        int off = i * cmp_bytes;
+        int bytes = MIN(cmp_bytes, line_bytes - off);
+
+        assert(bytes >= 0);
+        if (memcmp(server + off, guest + off, bytes) != 0) {
+            memcpy(server + off, guest + off, bytes);
+            set_bit(i, changed);
+        }
+    }
+}
+
 static int vnc_refresh_server_surface(VncDisplay *vd)
 {
     int width = MIN(pixman_image_get_width(vd->guest.fb),
@@ -3094,10 +3194,12 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int height = MIN(pixman_image_get_height(vd->guest.fb),
                      pixman_image_get_height(vd->server));
     int cmp_bytes, server_stride, line_bytes, guest_ll, guest_stride, y = 0;
+    int end;
     uint8_t *guest_row0 = NULL, *server_row0;
     VncState *vs;
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
+    DECLARE_BITMAP(changed, VNC_DIRTY_BITS);
 
     struct timeval tv = { 0, 0 };
 
@@ -3128,9 +3230,10 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
                    * DIV_ROUND_UP(guest_bpp, 8);
     }
     line_bytes = MIN(server_stride, guest_ll);
+    end = DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
 
     for (;;) {
-        int x;
+        int x, run_end;
         uint8_t *guest_ptr, *server_ptr;
         unsigned long offset = find_next_bit((unsigned long *) &vd->guest.dirty,
                                              height * VNC_DIRTY_BPL(&vd->guest),
@@ -3142,7 +3245,7 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         y = offset / VNC_DIRTY_BPL(&vd->guest);
         x = offset % VNC_DIRTY_BPL(&vd->guest);
 
-        server_ptr = server_row0 + y * server_stride + x * cmp_bytes;
+        server_ptr = server_row0 + y * server_stride;
 
         if (vd->guest.format != VNC_SERVER_FB_FORMAT) {
             qemu_pixman_linebuf_fill(tmpbuf, vd->guest.fb, width, 0, y);
@@ -3150,30 +3253,29 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         } else {
             guest_ptr = guest_row0 + y * guest_stride;
         }
-        guest_ptr += x * cmp_bytes;
 
-        for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
-             x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
-            int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
-                continue;
-            }
-            if ((x + 1) * cmp_bytes > line_bytes) {
-                _cmp_bytes = line_bytes - x * cmp_bytes;
-            }
-            assert(_cmp_bytes >= 0);
-            if (memcmp(server_ptr, guest_ptr, _cmp_bytes) == 0) {
-                continue;
-            }
-            memcpy(server_ptr, guest_ptr, _cmp_bytes);
+        /* Copy the dirty runs of the line, then set the bits in bulk */
+        bitmap_zero(changed, VNC_DIRTY_BITS);
+        while (x < end) {
+            run_end = find_next_zero_bit(vd->guest.dirty[y], end, x);
+            bitmap_clear(vd->guest.dirty[y], x, run_end - x);
+            vnc_copy_changed(server_ptr, guest_ptr, x, run_end,
+                             cmp_bytes, line_bytes, vd->compare, changed);
+            x = find_next_bit(vd->guest.dirty[y], end, run_end);
+        }
+
+        if (!bitmap_empty(changed, end)) {
             if (!vd->non_adaptive) {
-                vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
-                                 y, &tv);
+                for (x = find_first_bit(changed, end); x < end;
+                     x = find_next_bit(changed, end, x + 1)) {
+                    vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
+                                     y, &tv);
+                }
             }
             QTAILQ_FOREACH(vs, &vd->clients, next) {
-                set_bit(x, vs->dirty[y]);
+                bitmap_or(vs->dirty[y], vs->dirty[y], changed, end);
             }
-            has_dirty++;
+            has_dirty += bitmap_count_one(changed, end);
         }
 
         y++;
@@ -3231,6 +3333,9 @@ static void vnc_connect(VncDisplay *vd, QIOChannelSocket *sioc,
     trace_vnc_client_connect(vs, sioc);
     vs->zrle = g_new0(VncZrle, 1);
     vs->tight = g_new0(VncTight, 1);
+#ifdef CONFIG_VNC_H264
+    vs->h264 = g_new0(VncH264, 1);
+#endif
     vs->magic = VNC_MAGIC;
     vs->sioc = sioc;
     object_ref(OBJECT(vs->sioc));
@@ -3577,6 +3682,12 @@ static QemuOptsList qemu_vnc_opts = {
         },{
             .name = "power-control",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "encode-threads",
+            .type = QEMU_OPT_NUMBER,
+        },{
+            .name = "compare",
+            .type = QEMU_OPT_BOOL,
         },
         { /* end of list */ }
     },
@@ -4016,6 +4127,7 @@ void vnc_display_open(const char *id, Error **errp)
     int key_delay_ms;
     const char *audiodev;
     const char *passwordSecret;
+    uint64_t encode_threads;
 
     if (!vd) {
         error_setg(errp, "VNC display not active");
@@ -4130,7 +4242,7 @@ void vnc_display_open(const char *id, Error **errp)
     }
     vd->connections_limit = qemu_opt_get_number(opts, "connections", 32);
 
-#ifdef CONFIG_VNC_JPEG
+#if defined(CONFIG_VNC_JPEG) || defined(CONFIG_VNC_H264)
     vd->lossy = qemu_opt_get_bool(opts, "lossy", false);
 #endif
     vd->non_adaptive = qemu_opt_get_bool(opts, "non-adaptive", false);
@@ -4142,6 +4254,15 @@ void vnc_display_open(const char *id, Error **errp)
     }
 
     vd->power_control = qemu_opt_get_bool(opts, "power-control", false);
+    vd->compare = qemu_opt_get_bool(opts, "compare", true);
+
+    encode_threads = qemu_opt_get_number(opts, "encode-threads", 1);
+    if (encode_threads < 1 || encode_threads > VNC_MAX_ENCODE_THREADS) {
+        error_setg(errp, "'encode-threads' must be between 1 and %d",
+                   VNC_MAX_ENCODE_THREADS);
+        goto fail;
+    }
+    vnc_start_encoder_threads(encode_threads);
 
     if (tlsauthz) {
         vd->tlsauthzid = g_strdup(tlsauthz);
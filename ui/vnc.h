@@ -40,6 +40,9 @@
 #include "io/net-listener.h"
 #include "authz/base.h"
 #include <zlib.h>
+#ifdef CONFIG_VNC_H264
+#include <x264.h>
+#endif
 
 #include "keymaps.h"
 #include "vnc-palette.h"
@@ -95,6 +98,9 @@ typedef void VncSendHextileTile(VncState *vs,
 #define VNC_STAT_COLS (VNC_MAX_WIDTH / VNC_STAT_RECT)
 #define VNC_STAT_ROWS (VNC_MAX_HEIGHT / VNC_STAT_RECT)
 
+/* Threads encoding the updates of a display, see vnc-jobs.c */
+#define VNC_MAX_ENCODE_THREADS 64
+
 #define VNC_AUTH_CHALLENGE_SIZE 16
 
 typedef struct VncDisplay VncDisplay;
@@ -179,6 +185,8 @@ struct VncDisplay
     bool lossy;
     bool non_adaptive;
     bool power_control;
+    /* Compare updated areas against the server surface */
+    bool compare;
     QCryptoTLSCreds *tlscreds;
     QAuthZ *tlsauthz;
     char *tlsauthzid;
@@ -206,6 +214,8 @@ typedef struct VncTight {
 #endif
     int levels[4];
     z_stream stream[4];
+    /* Streams to restart, on both ends, before they are used again */
+    uint8_t reset_streams;
 } VncTight;
 
 typedef struct VncHextile {
@@ -227,8 +237,29 @@ typedef struct VncZrle {
     Buffer zlib;
     z_stream stream;
     VncPalette palette;
+    /*
+     * Encoding in stripes: the stream is raw deflate data, restarted for
+     * every stripe, and the zlib header is only sent once per client.
+     * header_sent is also set once a serial stream has started, so that
+     * stripes carry on from it when encoder threads are added at runtime.
+     */
+    bool stripes;
+    bool header_sent;
 } VncZrle;
 
+#ifdef CONFIG_VNC_H264
+typedef struct VncH264 {
+    x264_t *enc;
+    x264_picture_t pic;
+    int width;
+    int height;
+    uint8_t quality;
+    int64_t pts;
+    /* The client must drop its decoder state before the next frame */
+    bool reset;
+} VncH264;
+#endif
+
 typedef struct VncZywrle {
     int buf[VNC_ZRLE_TILE_WIDTH * VNC_ZRLE_TILE_HEIGHT];
 } VncZywrle;
@@ -346,6 +377,9 @@ struct VncState
     VncHextile hextile;
     VncZrle *zrle;
     VncZywrle zywrle;
+#ifdef CONFIG_VNC_H264
+    VncH264 *h264;
+#endif
 
     Notifier mouse_mode_notifier;
 
@@ -406,6 +440,7 @@ enum {
 #define VNC_ENCODING_TRLE                 0x0000000f
 #define VNC_ENCODING_ZRLE                 0x00000010
 #define VNC_ENCODING_ZYWRLE               0x00000011
+#define VNC_ENCODING_H264                 0x00000032
 #define VNC_ENCODING_COMPRESSLEVEL0       0xFFFFFF00 /* -256 */
 #define VNC_ENCODING_QUALITYLEVEL0        0xFFFFFFE0 /* -32  */
 #define VNC_ENCODING_XCURSOR              0xFFFFFF10 /* -240 */
@@ -465,6 +500,7 @@ enum VncFeatures {
     VNC_FEATURE_LED_STATE,
     VNC_FEATURE_XVP,
     VNC_FEATURE_CLIPBOARD_EXT,
+    VNC_FEATURE_H264,
 };
 
 #define VNC_FEATURE_RESIZE_MASK              (1 << VNC_FEATURE_RESIZE)
@@ -482,6 +518,7 @@ enum VncFeatures {
 #define VNC_FEATURE_LED_STATE_MASK           (1 << VNC_FEATURE_LED_STATE)
 #define VNC_FEATURE_XVP_MASK                 (1 << VNC_FEATURE_XVP)
 #define VNC_FEATURE_CLIPBOARD_EXT_MASK       (1 <<  VNC_FEATURE_CLIPBOARD_EXT)
+#define VNC_FEATURE_H264_MASK                (1 << VNC_FEATURE_H264)
 
 
 /* Client -> Server message IDs */
@@ -637,6 +674,12 @@ int vnc_zrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
 int vnc_zywrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
 void vnc_zrle_clear(VncState *vs);
 
+#ifdef CONFIG_VNC_H264
+/* vnc-enc-h264.c */
+int vnc_h264_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
+void vnc_h264_clear(VncState *vs);
+#endif
+
 /* vnc-clipboard.c */
 void vnc_server_cut_text_caps(VncState *vs);
 void vnc_client_cut_text(VncState *vs, size_t len, uint8_t *text);
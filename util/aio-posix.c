@@ -20,12 +20,22 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qapi/error.h"
 #include "trace.h"
 #include "aio-posix.h"
 
 /* Stop userspace polling on a handler if it isn't active for some time */
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
+/*
+ * Also stop if it makes progress in less than one of POLL_MIN_HIT_RATIO
+ * polling rounds; busy waiting does not pay off then and the fd can wake
+ * us up instead.  The hit rate is averaged over the last POLL_RATE_WINDOWS
+ * rounds or so.
+ */
+#define POLL_RATE_WINDOWS   64
+#define POLL_MIN_HIT_RATIO  16
+
 bool aio_poll_disabled(AioContext *ctx)
 {
     return qatomic_read(&ctx->poll_disable_cnt);
@@ -316,6 +326,9 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
         !QLIST_IS_INSERTED(node, node_poll) &&
         node->io_poll) {
         trace_poll_add(ctx, node, node->pfd.fd, revents);
+        node->poll_windows = 0;
+        node->poll_hits = 0;
+        node->poll_progress = false;
         if (ctx->poll_started && node->io_poll_begin) {
             node->io_poll_begin(node->opaque);
         }
@@ -326,7 +339,10 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
         (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) &&
         aio_node_check(ctx, node->is_external) &&
         node->io_read) {
+        int64_t start = main_loop_cb_begin();
+
         node->io_read(node->opaque);
+        main_loop_cb_end(MAIN_LOOP_CB_FD, node->io_read, NULL, start);
 
         /* aio_notify() does not count as progress */
         if (node->opaque != &ctx->notifier) {
@@ -337,7 +353,10 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
         (revents & (G_IO_OUT | G_IO_ERR)) &&
         aio_node_check(ctx, node->is_external) &&
         node->io_write) {
+        int64_t start = main_loop_cb_begin();
+
         node->io_write(node->opaque);
+        main_loop_cb_end(MAIN_LOOP_CB_FD, node->io_write, NULL, start);
         progress = true;
     }
 
@@ -398,6 +417,7 @@ static bool run_poll_handlers_once(AioContext *ctx,
         if (aio_node_check(ctx, node->is_external) &&
             node->io_poll(node->opaque)) {
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
+            node->poll_progress = true;
 
             /*
              * Polling was successful, exit try_poll_mode immediately
@@ -420,6 +440,40 @@ static bool fdmon_supports_polling(AioContext *ctx)
     return ctx->fdmon_ops->need_wait != aio_poll_disabled;
 }
 
+/* Charge a polling round of @elapsed_time ns to the handlers being polled */
+static void account_poll_handlers(AioContext *ctx, int64_t elapsed_time)
+{
+    AioHandler *node;
+    uint64_t hits = 0;
+
+    QLIST_FOREACH(node, &ctx->poll_aio_handlers, node_poll) {
+        node->poll_time_ns += elapsed_time;
+        node->poll_windows++;
+        if (node->poll_progress) {
+            node->poll_progress = false;
+            node->poll_hits++;
+            hits++;
+        }
+        if (node->poll_windows == POLL_RATE_WINDOWS) {
+            node->poll_windows /= 2;
+            node->poll_hits /= 2;
+        }
+    }
+
+    stat64_add(&ctx->poll_time_ns, elapsed_time);
+    stat64_add(&ctx->poll_hits, hits);
+}
+
+static bool poll_handler_unproductive(AioContext *ctx, AioHandler *node)
+{
+    /* aio_notify() only kicks the notifier while we poll, keep it */
+    if (node->opaque == &ctx->notifier) {
+        return false;
+    }
+    return node->poll_windows >= POLL_RATE_WINDOWS / 2 &&
+           node->poll_hits * POLL_MIN_HIT_RATIO < node->poll_windows;
+}
+
 static bool remove_idle_poll_handlers(AioContext *ctx, int64_t now)
 {
     AioHandler *node;
@@ -439,8 +493,17 @@ static bool remove_idle_poll_handlers(AioContext *ctx, int64_t now)
     QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
         if (node->poll_idle_timeout == 0LL) {
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
-        } else if (now >= node->poll_idle_timeout) {
-            trace_poll_remove(ctx, node, node->pfd.fd);
+        } else if (now >= node->poll_idle_timeout ||
+                   poll_handler_unproductive(ctx, node)) {
+            if (now >= node->poll_idle_timeout) {
+                trace_poll_remove(ctx, node, node->pfd.fd);
+            } else {
+                trace_poll_remove_unproductive(ctx, node, node->pfd.fd,
+                                               node->poll_hits,
+                                               node->poll_windows,
+                                               node->poll_time_ns);
+                stat64_add(&ctx->poll_dropped, 1);
+            }
             node->poll_idle_timeout = 0LL;
             QLIST_SAFE_REMOVE(node, node_poll);
             if (ctx->poll_started && node->io_poll_end) {
@@ -496,6 +559,7 @@ static bool run_poll_handlers(AioContext *ctx, int64_t max_ns, int64_t *timeout)
         assert(!(max_ns && progress));
     } while (elapsed_time < max_ns && !ctx->fdmon_ops->need_wait(ctx));
 
+    account_poll_handlers(ctx, elapsed_time);
     if (remove_idle_poll_handlers(ctx, start_time + elapsed_time)) {
         *timeout = 0;
         progress = true;
@@ -728,3 +792,33 @@ void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
 
     aio_notify(ctx);
 }
+
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, int64_t cpu,
+                                     Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (cpu < -1 || cpu >= INT_MAX) {
+        error_setg(errp, "invalid host CPU %" PRId64 " for io_uring SQPOLL",
+                   cpu);
+        return;
+    }
+    if (ctx->linux_io_uring) {
+        error_setg(errp, "io_uring SQPOLL cannot be changed once in use");
+        return;
+    }
+    if (cpu == ctx->io_uring_sqpoll_cpu) {
+        return;
+    }
+
+    ctx->io_uring_sqpoll_cpu = cpu;
+    if (!fdmon_io_uring_restart(ctx)) {
+        error_setg(errp, "Unable to create io_uring ring with SQPOLL on "
+                   "host CPU %" PRId64, cpu);
+        ctx->io_uring_sqpoll_cpu = -1;
+    }
+#else
+    if (cpu != -1) {
+        error_setg(errp, "io_uring SQPOLL is not supported by this build");
+    }
+#endif
+}
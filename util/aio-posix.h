@@ -36,6 +36,10 @@ struct AioHandler {
     unsigned flags; /* see fdmon-io_uring.c */
 #endif
     int64_t poll_idle_timeout; /* when to stop userspace polling */
+    int64_t poll_time_ns;      /* time spent polling this handler */
+    unsigned poll_windows;     /* recent polling rounds it took part in */
+    unsigned poll_hits;        /* ... and the ones where it made progress */
+    bool poll_progress;        /* made progress in the current round */
     bool is_external;
 };
 
@@ -66,6 +70,7 @@ static inline void fdmon_epoll_disable(AioContext *ctx)
 
 #ifdef CONFIG_LINUX_IO_URING
 bool fdmon_io_uring_setup(AioContext *ctx);
+bool fdmon_io_uring_restart(AioContext *ctx);
 void fdmon_io_uring_destroy(AioContext *ctx);
 #else
 static inline bool fdmon_io_uring_setup(AioContext *ctx)
@@ -73,6 +78,11 @@ static inline bool fdmon_io_uring_setup(AioContext *ctx)
     return false;
 }
 
+static inline bool fdmon_io_uring_restart(AioContext *ctx)
+{
+    return true;
+}
+
 static inline void fdmon_io_uring_destroy(AioContext *ctx)
 {
 }
@@ -445,3 +445,11 @@ void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
                                 Error **errp)
 {
 }
+
+void aio_context_set_io_uring_sqpoll(AioContext *ctx, int64_t cpu,
+                                     Error **errp)
+{
+    if (cpu != -1) {
+        error_setg(errp, "io_uring is not implemented on Windows");
+    }
+}
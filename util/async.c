@@ -138,7 +138,10 @@ QEMUBH *aio_bh_new_full(AioContext *ctx, QEMUBHFunc *cb, void *opaque,
 
 void aio_bh_call(QEMUBH *bh)
 {
+    int64_t start = main_loop_cb_begin();
+
     bh->cb(bh->opaque);
+    main_loop_cb_end(MAIN_LOOP_CB_BH, bh->cb, bh->name, start);
 }
 
 /* Multiple occurrences of aio_bh_poll cannot be called concurrently. */
@@ -418,7 +421,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(ctx->io_uring_sqpoll_cpu, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -520,6 +523,7 @@ AioContext *aio_context_new(Error **errp)
     ctx = (AioContext *) g_source_new(&aio_source_funcs, sizeof(AioContext));
     QSLIST_INIT(&ctx->bh_list);
     QSIMPLEQ_INIT(&ctx->bh_slice_list);
+    ctx->io_uring_sqpoll_cpu = -1;
     aio_context_setup(ctx);
 
     ret = event_notifier_init(&ctx->notifier, false);
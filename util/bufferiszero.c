@@ -308,6 +308,127 @@ static void __attribute__((constructor)) init_cpuid_cache(void)
 }
 #endif /* CONFIG_AVX2_OPT */
 
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+/* Note that each of these vectorized functions require len >= 64.  */
+
+static bool
+buffer_zero_neon(const void *buf, size_t len)
+{
+    uint32x4_t t = vld1q_u32(buf);
+    const uint32x4_t *p = (uint32x4_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint32x4_t *e = (uint32x4_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u32(t))) {
+            return false;
+        }
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t |= e[-3];
+    t |= e[-2];
+    t |= e[-1];
+
+    /* Finish the unaligned tail.  */
+    t |= vld1q_u32(buf + len - 16);
+
+    return vmaxvq_u32(t) == 0;
+}
+
+#ifdef CONFIG_SVE_OPT
+#pragma GCC push_options
+#pragma GCC target("+sve")
+#include <arm_sve.h>
+
+static bool
+buffer_zero_sve(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    svbool_t pg = svptrue_b8();
+    uint64_t vl = svcntb();
+    uint64_t i;
+
+    /* Loop over blocks of four vectors, whatever the vector length.  */
+    for (i = 0; i + 4 * vl <= len; i += 4 * vl) {
+        svuint8_t t0 = svorr_u8_x(pg, svld1_u8(pg, p + i),
+                                  svld1_u8(pg, p + i + vl));
+        svuint8_t t1 = svorr_u8_x(pg, svld1_u8(pg, p + i + 2 * vl),
+                                  svld1_u8(pg, p + i + 3 * vl));
+
+        __builtin_prefetch(p + i + 4 * vl);
+        if (unlikely(svptest_any(pg, svcmpne_n_u8(pg,
+                                     svorr_u8_x(pg, t0, t1), 0)))) {
+            return false;
+        }
+    }
+
+    /* Finish with predicated loads, which need no unaligned tail.  */
+    for (; i < len; i += vl) {
+        svbool_t pt = svwhilelt_b8_u64(i, len);
+
+        if (svptest_any(pt, svcmpne_n_u8(pt, svld1_u8(pt, p + i), 0))) {
+            return false;
+        }
+    }
+    return true;
+}
+#pragma GCC pop_options
+
+#include <sys/auxv.h>
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#endif /* CONFIG_SVE_OPT */
+
+/* As above, the most preferred ISA must have the least significant bit.  */
+#define CACHE_SVE     1
+#define CACHE_NEON    2
+
+/* NEON is part of the base aarch64 ISA.  */
+#define INIT_CACHE CACHE_NEON
+#define INIT_ACCEL buffer_zero_neon
+
+static unsigned cpuid_cache = INIT_CACHE;
+static bool (*buffer_accel)(const void *, size_t) = INIT_ACCEL;
+static int length_to_accel = 64;
+
+static void init_accel(unsigned cache)
+{
+    bool (*fn)(const void *, size_t) = buffer_zero_int;
+    if (cache & CACHE_NEON) {
+        fn = buffer_zero_neon;
+        length_to_accel = 64;
+    }
+#ifdef CONFIG_SVE_OPT
+    if (cache & CACHE_SVE) {
+        fn = buffer_zero_sve;
+        length_to_accel = 64;
+    }
+#endif
+    buffer_accel = fn;
+}
+
+#ifdef CONFIG_SVE_OPT
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned cache = CACHE_NEON;
+
+    if (qemu_getauxval(AT_HWCAP) & HWCAP_SVE) {
+        cache |= CACHE_SVE;
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_SVE_OPT */
+#endif
+
+#ifdef INIT_ACCEL
 bool test_buffer_is_zero_next_accel(void)
 {
     /* If no bits set, we just tested buffer_zero_int, and there
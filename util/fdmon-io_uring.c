@@ -323,9 +323,16 @@ static const FDMonOps fdmon_io_uring_ops = {
 
 bool fdmon_io_uring_setup(AioContext *ctx)
 {
+    struct io_uring_params params = {};
     int ret;
 
-    ret = io_uring_queue_init(FDMON_IO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
+    if (ctx->io_uring_sqpoll_cpu >= 0) {
+        params.flags = IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF;
+        params.sq_thread_cpu = ctx->io_uring_sqpoll_cpu;
+    }
+
+    ret = io_uring_queue_init_params(FDMON_IO_URING_ENTRIES,
+                                     &ctx->fdmon_io_uring, &params);
     if (ret != 0) {
         return false;
     }
@@ -359,3 +366,29 @@ void fdmon_io_uring_destroy(AioContext *ctx)
         ctx->fdmon_ops = &fdmon_poll_ops;
     }
 }
+
+/*
+ * Create the ring again, for a change of ctx->io_uring_sqpoll_cpu, and
+ * monitor the existing handlers there.  Returns false if the new ring
+ * could not be created, in which case ctx falls back to fdmon-poll.
+ */
+bool fdmon_io_uring_restart(AioContext *ctx)
+{
+    AioHandler *node;
+
+    if (ctx->fdmon_ops != &fdmon_io_uring_ops) {
+        return true;
+    }
+
+    fdmon_io_uring_destroy(ctx);
+    if (!fdmon_io_uring_setup(ctx)) {
+        return false;
+    }
+
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (!QLIST_IS_INSERTED(node, node_deleted) && node->pfd.events) {
+            fdmon_io_uring_update(ctx, NULL, node);
+        }
+    }
+    return true;
+}
@@ -101,6 +101,188 @@ struct HBitmap {
     uint64_t sizes[HBITMAP_LEVELS];
 };
 
+/*
+ * Kernels that walk whole levels, with vector versions selected at
+ * startup like in bufferiszero.c.
+ *
+ * hb_or_count: dst[i] = a[i] | b[i] for i < n (dst may alias a or b),
+ * returning the number of bits set in dst.
+ *
+ * hb_find_not_ones: the first index in [pos, n) whose word is not all
+ * ones, or n.
+ */
+static uint64_t hb_or_count_int(unsigned long *dst, const unsigned long *a,
+                                const unsigned long *b, size_t n)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = a[i] | b[i];
+        count += ctpopl(dst[i]);
+    }
+    return count;
+}
+
+static size_t hb_find_not_ones_int(const unsigned long *p, size_t pos,
+                                   size_t n)
+{
+    while (pos < n && p[pos] == (unsigned long)-1) {
+        pos++;
+    }
+    return pos;
+}
+
+#if defined(CONFIG_AVX2_OPT) && defined(__x86_64__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+#define HB_AVX2_WORDS   (32 / sizeof(unsigned long))
+
+static uint64_t hb_or_count_avx2(unsigned long *dst, const unsigned long *a,
+                                 const unsigned long *b, size_t n)
+{
+    /* Bits set in each nibble, added up per 64-bit lane with vpsadbw */
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3,
+                                         1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    __m256i acc = _mm256_setzero_si256();
+    uint64_t count;
+    size_t i;
+
+    for (i = 0; i + HB_AVX2_WORDS <= n; i += HB_AVX2_WORDS) {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256((__m256i *)(a + i)),
+                                    _mm256_loadu_si256((__m256i *)(b + i)));
+        __m256i cnt;
+
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+        cnt = _mm256_add_epi8(
+            _mm256_shuffle_epi8(lut, _mm256_and_si256(v, low)),
+            _mm256_shuffle_epi8(lut, _mm256_and_si256(
+                                         _mm256_srli_epi16(v, 4), low)));
+        acc = _mm256_add_epi64(acc,
+                               _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+
+    count = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+            _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+    return count + hb_or_count_int(dst + i, a + i, b + i, n - i);
+}
+
+static size_t hb_find_not_ones_avx2(const unsigned long *p, size_t pos,
+                                    size_t n)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+
+    while (pos + HB_AVX2_WORDS <= n &&
+           _mm256_testc_si256(_mm256_loadu_si256((__m256i *)(p + pos)),
+                              ones)) {
+        pos += HB_AVX2_WORDS;
+    }
+    return hb_find_not_ones_int(p, pos, n);
+}
+#pragma GCC pop_options
+
+#include "qemu/cpuid.h"
+
+/* As in bufferiszero.c, the most preferred ISA has the least significant bit */
+#define HB_CACHE_AVX2   1
+
+static unsigned hb_cpuid_cache;
+static uint64_t (*hb_or_count)(unsigned long *, const unsigned long *,
+                               const unsigned long *, size_t) = hb_or_count_int;
+static size_t (*hb_find_not_ones)(const unsigned long *, size_t,
+                                  size_t) = hb_find_not_ones_int;
+
+static void hb_init_accel(unsigned cache)
+{
+    hb_or_count = hb_or_count_int;
+    hb_find_not_ones = hb_find_not_ones_int;
+    if (cache & HB_CACHE_AVX2) {
+        hb_or_count = hb_or_count_avx2;
+        hb_find_not_ones = hb_find_not_ones_avx2;
+    }
+}
+
+static void __attribute__((constructor)) hb_init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 7) {
+        __cpuid(1, a, b, c, d);
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= HB_CACHE_AVX2;
+            }
+        }
+    }
+    hb_cpuid_cache = cache;
+    hb_init_accel(cache);
+}
+
+bool hbitmap_test_next_accel(void)
+{
+    if (hb_cpuid_cache == 0) {
+        return false;
+    }
+    hb_cpuid_cache &= hb_cpuid_cache - 1;
+    hb_init_accel(hb_cpuid_cache);
+    return true;
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+/* NEON is part of the base aarch64 ISA, there is nothing to select */
+static uint64_t hb_or_count(unsigned long *dst, const unsigned long *a,
+                            const unsigned long *b, size_t n)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        uint8x16_t v = vorrq_u8(vld1q_u8((const uint8_t *)(a + i)),
+                                vld1q_u8((const uint8_t *)(b + i)));
+
+        vst1q_u8((uint8_t *)(dst + i), v);
+        count += vaddlvq_u8(vcntq_u8(v));
+    }
+    return count + hb_or_count_int(dst + i, a + i, b + i, n - i);
+}
+
+static size_t hb_find_not_ones(const unsigned long *p, size_t pos, size_t n)
+{
+    while (pos + 2 <= n &&
+           vminvq_u32(vld1q_u32((const uint32_t *)(p + pos))) == UINT32_MAX) {
+        pos += 2;
+    }
+    return hb_find_not_ones_int(p, pos, n);
+}
+
+bool hbitmap_test_next_accel(void)
+{
+    return false;
+}
+
+#else
+#define hb_or_count         hb_or_count_int
+#define hb_find_not_ones    hb_find_not_ones_int
+
+bool hbitmap_test_next_accel(void)
+{
+    return false;
+}
+#endif
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -245,10 +427,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_find_not_ones(last_lev, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
@@ -875,7 +1054,7 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
 bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 {
     int i;
-    uint64_t j;
+    uint64_t last;
 
     if (!hbitmap_can_merge(a, b) || !hbitmap_can_merge(a, result)) {
         return false;
@@ -910,14 +1089,22 @@ bool hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
      * by using hbitmap_iter_next, but this is suboptimal for dense maps.
      */
     assert(a->size == b->size);
-    for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
-        for (j = 0; j < a->sizes[i]; j++) {
-            result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
-        }
+    for (i = HBITMAP_LEVELS - 2; i >= 0; i--) {
+        hb_or_count(result->levels[i], a->levels[i], b->levels[i],
+                    a->sizes[i]);
     }
 
-    /* Recompute the dirty count */
-    result->count = hb_count_between(result, 0, result->size - 1);
+    /* The dirty count comes with the bottom level, minus any bit past size */
+    last = a->sizes[HBITMAP_LEVELS - 1] - 1;
+    result->count = hb_or_count(result->levels[HBITMAP_LEVELS - 1],
+                                a->levels[HBITMAP_LEVELS - 1],
+                                b->levels[HBITMAP_LEVELS - 1],
+                                last + 1);
+    if (result->size & (BITS_PER_LONG - 1)) {
+        unsigned long tail = result->levels[HBITMAP_LEVELS - 1][last];
+
+        result->count -= ctpopl(tail >> (result->size & (BITS_PER_LONG - 1)));
+    }
 
     return true;
 }
@@ -26,13 +26,324 @@
 #include "trace/control.h"
 #include "qemu/thread.h"
 #include "qemu/lockable.h"
+#include "qemu/notify.h"
+#include "qemu/queue.h"
+#include "qemu/units.h"
 
 static char *logfilename;
 static QemuMutex qemu_logfile_mutex;
 QemuLogFile *qemu_logfile;
 int qemu_loglevel;
 static int log_append = 0;
-static GArray *debug_regions;
+
+/* The -dfilter ranges, sorted and merged, or NULL for no filter */
+static Range *debug_ranges;
+static unsigned debug_nr_ranges;
+
+#ifdef CONFIG_OPEN_MEMSTREAM
+/*
+ * Asynchronous logging
+ *
+ * With "-d async", each thread formats its log into a memory stream of
+ * its own, so that threads don't contend on the lock of the log file
+ * or wait for its writes, and hands the text over to a writer thread
+ * by chunks of about LOG_CHUNK_SIZE bytes.  Chunks are only cut
+ * outside of qemu_log_lock() sections, so that lines logged together
+ * stay together under MTTCG.  When idle, the writer thread also picks
+ * up the text of threads that log little every LOG_SWEEP_MS.  Loggers
+ * wait if more than LOG_QUEUE_MAX bytes are queued, rather than
+ * dropping any.  At exit, the flush skips threads that are busy logging
+ * and waits at most LOG_EXIT_TIMEOUT_MS for the writer thread.
+ *
+ * Lock order: log_buffers_mutex, then QemuLogBuffer::lock, then
+ * log_queue_mutex.
+ */
+#define LOG_CHUNK_SIZE  (64 * KiB)
+#define LOG_QUEUE_MAX   (64 * MiB)
+#define LOG_SWEEP_MS    100
+#define LOG_EXIT_TIMEOUT_MS 1000
+
+typedef struct QemuLogChunk {
+    QSIMPLEQ_ENTRY(QemuLogChunk) next;
+    size_t len;
+    char data[];
+} QemuLogChunk;
+
+typedef struct QemuLogBuffer {
+    /* Held by the owner thread while it logs, and by flushes */
+    QemuMutex lock;
+    FILE *fd;
+    char *buf;
+    size_t size;
+    /* Nesting of qemu_log_lock() in the owner thread */
+    int depth;
+    Notifier exit;
+    QLIST_ENTRY(QemuLogBuffer) next;
+} QemuLogBuffer;
+
+static QemuMutex log_buffers_mutex;
+static QLIST_HEAD(, QemuLogBuffer) log_buffers;
+static __thread QemuLogBuffer *log_buffer;
+
+static QemuMutex log_queue_mutex;
+static QemuCond log_queue_avail;
+static QemuCond log_queue_done;
+static QSIMPLEQ_HEAD(, QemuLogChunk) log_queue =
+    QSIMPLEQ_HEAD_INITIALIZER(log_queue);
+static size_t log_queued;
+static bool log_writing;
+static bool log_writer_started;
+static bool log_exiting;
+static QemuThread log_writer;
+
+static void qemu_log_buffer_hand_over(QemuLogBuffer *b);
+
+/* Hand over the text of the threads that are not logging right now */
+static void qemu_log_sweep(void)
+{
+    QemuLogBuffer *b;
+
+    qemu_mutex_lock(&log_buffers_mutex);
+    QLIST_FOREACH(b, &log_buffers, next) {
+        if (qemu_mutex_trylock(&b->lock) == 0) {
+            qemu_log_buffer_hand_over(b);
+            qemu_mutex_unlock(&b->lock);
+        }
+    }
+    qemu_mutex_unlock(&log_buffers_mutex);
+}
+
+static void *qemu_log_writer_fn(void *opaque)
+{
+    QemuLogChunk *chunk;
+    QemuLogFile *logfile;
+
+    rcu_register_thread();
+    qemu_mutex_lock(&log_queue_mutex);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&log_queue)) {
+            if (!qemu_cond_timedwait(&log_queue_avail, &log_queue_mutex,
+                                     LOG_SWEEP_MS)) {
+                qemu_mutex_unlock(&log_queue_mutex);
+                qemu_log_sweep();
+                qemu_mutex_lock(&log_queue_mutex);
+            }
+        }
+        chunk = QSIMPLEQ_FIRST(&log_queue);
+        QSIMPLEQ_REMOVE_HEAD(&log_queue, next);
+        log_writing = true;
+        qemu_mutex_unlock(&log_queue_mutex);
+
+        rcu_read_lock();
+        logfile = qatomic_rcu_read(&qemu_logfile);
+        if (logfile) {
+            fwrite(chunk->data, 1, chunk->len, logfile->fd);
+        }
+        rcu_read_unlock();
+
+        qemu_mutex_lock(&log_queue_mutex);
+        log_queued -= chunk->len;
+        log_writing = false;
+        qemu_cond_broadcast(&log_queue_done);
+        g_free(chunk);
+    }
+    return NULL;
+}
+
+/* Queue what @b holds for the writer thread; @b->lock must be held */
+static void qemu_log_buffer_hand_over(QemuLogBuffer *b)
+{
+    QemuLogChunk *chunk;
+
+    fflush(b->fd);
+    if (!b->size) {
+        return;
+    }
+    chunk = g_malloc(sizeof(*chunk) + b->size);
+    chunk->len = b->size;
+    memcpy(chunk->data, b->buf, b->size);
+    /* Memory streams start over from the position, keeping the buffer */
+    rewind(b->fd);
+
+    qemu_mutex_lock(&log_queue_mutex);
+    /*
+     * The writer thread itself hands over text when sweeping, and there
+     * is no waiting for it any longer once the process is exiting.
+     */
+    while (log_queued > LOG_QUEUE_MAX && !qemu_thread_is_self(&log_writer) &&
+           !log_exiting) {
+        qemu_cond_wait(&log_queue_done, &log_queue_mutex);
+    }
+    QSIMPLEQ_INSERT_TAIL(&log_queue, chunk, next);
+    log_queued += chunk->len;
+    qemu_cond_signal(&log_queue_avail);
+    qemu_mutex_unlock(&log_queue_mutex);
+}
+
+static void qemu_log_buffer_exit(Notifier *n, void *data)
+{
+    QemuLogBuffer *b = container_of(n, QemuLogBuffer, exit);
+
+    qemu_mutex_lock(&log_buffers_mutex);
+    qemu_mutex_lock(&b->lock);
+    qemu_log_buffer_hand_over(b);
+    QLIST_REMOVE(b, next);
+    qemu_mutex_unlock(&b->lock);
+    qemu_mutex_unlock(&log_buffers_mutex);
+
+    log_buffer = NULL;
+    fclose(b->fd);
+    free(b->buf);
+    qemu_mutex_destroy(&b->lock);
+    g_free(b);
+}
+
+static QemuLogBuffer *qemu_log_buffer_get(void)
+{
+    QemuLogBuffer *b = log_buffer;
+
+    if (likely(b)) {
+        return b;
+    }
+
+    b = g_new0(QemuLogBuffer, 1);
+    b->fd = open_memstream(&b->buf, &b->size);
+    if (!b->fd) {
+        g_free(b);
+        return NULL;
+    }
+    qemu_mutex_init(&b->lock);
+    b->exit.notify = qemu_log_buffer_exit;
+    qemu_thread_atexit_add(&b->exit);
+
+    qemu_mutex_lock(&log_buffers_mutex);
+    QLIST_INSERT_HEAD(&log_buffers, b, next);
+    qemu_mutex_unlock(&log_buffers_mutex);
+    log_buffer = b;
+
+    qemu_mutex_lock(&log_queue_mutex);
+    if (!log_writer_started) {
+        qemu_thread_create(&log_writer, "log-writer", qemu_log_writer_fn,
+                           NULL, QEMU_THREAD_DETACHED);
+        log_writer_started = true;
+    }
+    qemu_mutex_unlock(&log_queue_mutex);
+    return b;
+}
+
+FILE *qemu_log_async_lock(void)
+{
+    QemuLogBuffer *b = qemu_log_buffer_get();
+
+    if (!b) {
+        return NULL;
+    }
+    if (b->depth++ == 0) {
+        qemu_mutex_lock(&b->lock);
+    }
+    return b->fd;
+}
+
+bool qemu_log_async_unlock(FILE *fd)
+{
+    QemuLogBuffer *b = log_buffer;
+
+    if (!b || fd != b->fd) {
+        return false;
+    }
+    if (--b->depth == 0) {
+        if (ftell(b->fd) >= LOG_CHUNK_SIZE) {
+            qemu_log_buffer_hand_over(b);
+        }
+        qemu_mutex_unlock(&b->lock);
+    }
+    return true;
+}
+
+/*
+ * Hand over the text of every thread and wait until it is written.
+ * Within a qemu_log_lock() section, this waits for the end of the
+ * section instead, which hands over the text if it is due.
+ */
+static void qemu_log_async_flush(void)
+{
+    QemuLogBuffer *b;
+
+    if (log_buffer && log_buffer->depth) {
+        return;
+    }
+
+    qemu_mutex_lock(&log_buffers_mutex);
+    QLIST_FOREACH(b, &log_buffers, next) {
+        qemu_mutex_lock(&b->lock);
+        qemu_log_buffer_hand_over(b);
+        qemu_mutex_unlock(&b->lock);
+    }
+    qemu_mutex_unlock(&log_buffers_mutex);
+
+    qemu_mutex_lock(&log_queue_mutex);
+    while (!QSIMPLEQ_EMPTY(&log_queue) || log_writing) {
+        qemu_cond_wait(&log_queue_done, &log_queue_mutex);
+    }
+    qemu_mutex_unlock(&log_queue_mutex);
+}
+
+/*
+ * Like qemu_log_async_flush(), but other threads may still be running
+ * or stuck inside a qemu_log_lock() section, and the writer thread may
+ * be stuck on a full pipe; so take only the text that can be taken
+ * right away, and give up on the writer after LOG_EXIT_TIMEOUT_MS.
+ */
+static void qemu_log_async_atexit(void)
+{
+    QemuLogBuffer *b;
+    int64_t deadline, left;
+
+    if (!(qemu_loglevel & LOG_ASYNC)) {
+        return;
+    }
+
+    qemu_mutex_lock(&log_queue_mutex);
+    log_exiting = true;
+    qemu_cond_broadcast(&log_queue_done);
+    qemu_mutex_unlock(&log_queue_mutex);
+
+    if (qemu_mutex_trylock(&log_buffers_mutex) == 0) {
+        QLIST_FOREACH(b, &log_buffers, next) {
+            if (qemu_mutex_trylock(&b->lock) == 0) {
+                qemu_log_buffer_hand_over(b);
+                qemu_mutex_unlock(&b->lock);
+            }
+        }
+        qemu_mutex_unlock(&log_buffers_mutex);
+    }
+
+    deadline = g_get_monotonic_time() / 1000 + LOG_EXIT_TIMEOUT_MS;
+    qemu_mutex_lock(&log_queue_mutex);
+    while (!QSIMPLEQ_EMPTY(&log_queue) || log_writing) {
+        left = deadline - g_get_monotonic_time() / 1000;
+        if (left <= 0 ||
+            !qemu_cond_timedwait(&log_queue_done, &log_queue_mutex, left)) {
+            break;
+        }
+    }
+    qemu_mutex_unlock(&log_queue_mutex);
+}
+#else
+FILE *qemu_log_async_lock(void)
+{
+    return NULL;
+}
+
+bool qemu_log_async_unlock(FILE *fd)
+{
+    return false;
+}
+
+static void qemu_log_async_flush(void)
+{
+}
+#endif
 
 /* Return the number of characters emitted.  */
 int qemu_log(const char *fmt, ...)
@@ -43,10 +354,18 @@ int qemu_log(const char *fmt, ...)
     rcu_read_lock();
     logfile = qatomic_rcu_read(&qemu_logfile);
     if (logfile) {
+        FILE *fd = NULL;
         va_list ap;
+
+        if (unlikely(qemu_loglevel & LOG_ASYNC)) {
+            fd = qemu_log_async_lock();
+        }
         va_start(ap, fmt);
-        ret = vfprintf(logfile->fd, fmt, ap);
+        ret = vfprintf(fd ?: logfile->fd, fmt, ap);
         va_end(ap);
+        if (fd) {
+            qemu_log_async_unlock(fd);
+        }
 
         /* Don't pass back error results.  */
         if (ret < 0) {
@@ -57,9 +376,36 @@ int qemu_log(const char *fmt, ...)
     return ret;
 }
 
+/* As close to the start of the process as the constructors get */
+static int64_t qemu_start_time_us;
+
 static void __attribute__((__constructor__)) qemu_logfile_init(void)
 {
     qemu_mutex_init(&qemu_logfile_mutex);
+    qemu_start_time_us = g_get_monotonic_time();
+#ifdef CONFIG_OPEN_MEMSTREAM
+    qemu_mutex_init(&log_buffers_mutex);
+    qemu_mutex_init(&log_queue_mutex);
+    qemu_cond_init(&log_queue_avail);
+    qemu_cond_init(&log_queue_done);
+    atexit(qemu_log_async_atexit);
+#endif
+}
+
+void qemu_log_startup(const char *fmt, ...)
+{
+    int64_t now = g_get_monotonic_time();
+    g_autofree char *msg = NULL;
+    va_list ap;
+
+    if (!qemu_loglevel_mask(LOG_STARTUP)) {
+        return;
+    }
+    va_start(ap, fmt);
+    msg = g_strdup_vprintf(fmt, ap);
+    va_end(ap);
+    qemu_log("startup: %8.3f ms %s\n",
+             (now - qemu_start_time_us) / 1000.0, msg);
 }
 
 static void qemu_logfile_free(QemuLogFile *logfile)
@@ -80,6 +426,10 @@ void qemu_set_log(int log_flags)
     bool need_to_open_file = false;
     QemuLogFile *logfile;
 
+    if ((qemu_loglevel & LOG_ASYNC) && !(log_flags & LOG_ASYNC)) {
+        /* Later logs go straight to the file, after what is buffered */
+        qemu_log_async_flush();
+    }
     qemu_loglevel = log_flags;
 #ifdef CONFIG_TRACE_LOG
     qemu_loglevel |= LOG_TRACE;
@@ -179,31 +529,69 @@ void qemu_set_log_filename(const char *filename, Error **errp)
  */
 bool qemu_log_in_addr_range(uint64_t addr)
 {
-    if (debug_regions) {
-        int i = 0;
-        for (i = 0; i < debug_regions->len; i++) {
-            Range *range = &g_array_index(debug_regions, Range, i);
-            if (range_contains(range, addr)) {
-                return true;
-            }
-        }
-        return false;
-    } else {
+    unsigned lo = 0, hi = debug_nr_ranges;
+
+    if (!debug_ranges) {
         return true;
     }
+
+    /* Find the last range starting at or below @addr */
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+
+        if (range_lob(&debug_ranges[mid]) <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo && range_upb(&debug_ranges[lo - 1]) >= addr;
 }
 
+static gint range_compare_lob(gconstpointer a, gconstpointer b)
+{
+    uint64_t la = range_lob((Range *)a), lb = range_lob((Range *)b);
+
+    return la < lb ? -1 : la > lb;
+}
+
+/*
+ * Sort @ranges and merge those that overlap or touch, so that an
+ * address is in the filter iff it is in the last range starting at or
+ * below it.
+ */
+static void qemu_set_debug_ranges(GArray *ranges)
+{
+    Range *merged = NULL;
+    unsigned i, n = 0;
+
+    g_array_sort(ranges, range_compare_lob);
+    if (ranges->len) {
+        merged = g_new(Range, ranges->len);
+    }
+    for (i = 0; i < ranges->len; i++) {
+        Range *r = &g_array_index(ranges, Range, i);
+
+        if (n && (range_upb(&merged[n - 1]) == UINT64_MAX ||
+                  range_lob(r) <= range_upb(&merged[n - 1]) + 1)) {
+            range_set_bounds(&merged[n - 1], range_lob(&merged[n - 1]),
+                             MAX(range_upb(&merged[n - 1]), range_upb(r)));
+        } else {
+            merged[n++] = *r;
+        }
+    }
+
+    g_free(debug_ranges);
+    debug_ranges = merged;
+    debug_nr_ranges = n;
+}
 
 void qemu_set_dfilter_ranges(const char *filter_spec, Error **errp)
 {
     gchar **ranges = g_strsplit(filter_spec, ",", 0);
+    g_autoptr(GArray) debug_regions = NULL;
     int i;
 
-    if (debug_regions) {
-        g_array_unref(debug_regions);
-        debug_regions = NULL;
-    }
-
     debug_regions = g_array_sized_new(FALSE, FALSE,
                                       sizeof(Range), g_strv_length(ranges));
     for (i = 0; ranges[i]; i++) {
@@ -263,6 +651,7 @@ void qemu_set_dfilter_ranges(const char *filter_spec, Error **errp)
         g_array_append_val(debug_regions, range);
     }
 out:
+    qemu_set_debug_ranges(debug_regions);
     g_strfreev(ranges);
 }
 
@@ -271,6 +660,9 @@ void qemu_log_flush(void)
 {
     QemuLogFile *logfile;
 
+    if (qemu_loglevel & LOG_ASYNC) {
+        qemu_log_async_flush();
+    }
     rcu_read_lock();
     logfile = qatomic_rcu_read(&qemu_logfile);
     if (logfile) {
@@ -284,6 +676,9 @@ void qemu_log_close(void)
 {
     QemuLogFile *logfile;
 
+    if (qemu_loglevel & LOG_ASYNC) {
+        qemu_log_async_flush();
+    }
     qemu_mutex_lock(&qemu_logfile_mutex);
     logfile = qemu_logfile;
 
@@ -334,6 +729,12 @@ const QEMULogItem qemu_log_items[] = {
 #endif
     { LOG_STRACE, "strace",
       "log every user-mode syscall, its input, and its result" },
+    { LOG_STARTUP, "startup",
+      "show where the time goes until the first guest instruction" },
+#ifdef CONFIG_OPEN_MEMSTREAM
+    { LOG_ASYNC, "async",
+      "buffer the log of each thread and write it from a separate thread" },
+#endif
     { 0, NULL, NULL },
 };
 
@@ -33,11 +33,17 @@
 #include "qemu/error-report.h"
 #include "qemu/queue.h"
 #include "qemu/compiler.h"
+#include "qemu/host-utils.h"
+#include "trace.h"
 
 #ifndef _WIN32
 #include <sys/wait.h>
 #endif
 
+#ifdef CONFIG_DLADDR
+#include <dlfcn.h>
+#endif
+
 #ifndef _WIN32
 
 /* If we have signalfd, we mask out the signals we want to handle and then
@@ -154,11 +160,15 @@ void qemu_notify_event(void)
 
 static GArray *gpollfds;
 
+/* Callbacks are only timed in the thread that runs the main loop */
+static __thread bool main_loop_thread;
+
 int qemu_init_main_loop(Error **errp)
 {
     int ret;
     GSource *src;
 
+    main_loop_thread = true;
     init_clocks(qemu_timer_notify_cb);
 
     ret = qemu_signal_init(errp);
@@ -542,6 +552,145 @@ void main_loop_wait(int nonblocking)
     qemu_clock_run_all_timers();
 }
 
+/*
+ * Callback latency statistics.  They are only updated and read from the
+ * main loop thread, so no locking is needed.
+ */
+#define MAIN_LOOP_HIST_BUCKETS  24
+#define MAIN_LOOP_SLOW_CBS      16
+
+typedef struct MainLoopSlowCB {
+    MainLoopCallbackType type;
+    const void *fn;
+    const char *name;
+    int64_t ns;
+    int64_t when;
+} MainLoopSlowCB;
+
+static const char *const main_loop_cb_names[MAIN_LOOP_CB__MAX] = {
+    [MAIN_LOOP_CB_BH] = "bh",
+    [MAIN_LOOP_CB_FD] = "fd",
+    [MAIN_LOOP_CB_TIMER] = "timer",
+};
+
+static struct {
+    /* Bucket 0 counts callbacks under 1 us, bucket i those under 2^i us */
+    uint64_t hist[MAIN_LOOP_CB__MAX][MAIN_LOOP_HIST_BUCKETS];
+    uint64_t total_ns[MAIN_LOOP_CB__MAX];
+    int64_t max_ns[MAIN_LOOP_CB__MAX];
+    MainLoopSlowCB slow[MAIN_LOOP_SLOW_CBS];
+    uint64_t n_slow;
+} main_loop_stats;
+
+int64_t main_loop_cb_begin(void)
+{
+    return main_loop_thread ? get_clock() : 0;
+}
+
+void main_loop_cb_end(MainLoopCallbackType type, const void *fn,
+                      const char *name, int64_t start)
+{
+    int64_t ns;
+    int bucket;
+
+    if (!start) {
+        return;
+    }
+    ns = get_clock() - start;
+    bucket = ns < 1000 ? 0 : 64 - clz64(ns / 1000);
+    bucket = MIN(bucket, MAIN_LOOP_HIST_BUCKETS - 1);
+    main_loop_stats.hist[type][bucket]++;
+    main_loop_stats.total_ns[type] += ns;
+    main_loop_stats.max_ns[type] = MAX(main_loop_stats.max_ns[type], ns);
+
+    if (ns > MAIN_LOOP_SLOW_CB_NS) {
+        MainLoopSlowCB *slow = &main_loop_stats.slow[main_loop_stats.n_slow++ %
+                                                     MAIN_LOOP_SLOW_CBS];
+
+        slow->type = type;
+        slow->fn = fn;
+        slow->name = name;
+        slow->ns = ns;
+        slow->when = start + ns;
+        trace_main_loop_slow_cb(main_loop_cb_names[type], (void *)fn,
+                                name ?: "", ns);
+    }
+}
+
+static void main_loop_format_fn(GString *buf, const void *fn)
+{
+#ifdef CONFIG_DLADDR
+    Dl_info info;
+
+    if (dladdr(fn, &info)) {
+        if (info.dli_sname) {
+            g_string_append_printf(buf, "%s+0x%" PRIxPTR, info.dli_sname,
+                                   (uintptr_t)fn - (uintptr_t)info.dli_saddr);
+        } else {
+            /* Static functions: "addr2line -f -e <file> <offset>" */
+            g_string_append_printf(buf, "%s+0x%" PRIxPTR, info.dli_fname,
+                                   (uintptr_t)fn - (uintptr_t)info.dli_fbase);
+        }
+        return;
+    }
+#endif
+    g_string_append_printf(buf, "%p", fn);
+}
+
+GString *main_loop_stats_format(void)
+{
+    GString *buf = g_string_new("");
+    int64_t now = get_clock();
+    uint64_t i;
+    int type, b;
+
+    for (type = 0; type < MAIN_LOOP_CB__MAX; type++) {
+        uint64_t n = 0;
+
+        for (b = 0; b < MAIN_LOOP_HIST_BUCKETS; b++) {
+            n += main_loop_stats.hist[type][b];
+        }
+        g_string_append_printf(buf, "%s callbacks: %" PRIu64,
+                               main_loop_cb_names[type], n);
+        if (!n) {
+            g_string_append(buf, "\n");
+            continue;
+        }
+        g_string_append_printf(buf, ", average %" PRIu64 " ns, "
+                               "max %" PRId64 " ns\n",
+                               main_loop_stats.total_ns[type] / n,
+                               main_loop_stats.max_ns[type]);
+        for (b = 0; b < MAIN_LOOP_HIST_BUCKETS; b++) {
+            if (main_loop_stats.hist[type][b]) {
+                g_string_append_printf(buf, "  < %8" PRIu64 " us: %" PRIu64
+                                       "\n", (uint64_t)1 << b,
+                                       main_loop_stats.hist[type][b]);
+            }
+        }
+    }
+
+    g_string_append_printf(buf, "slow callbacks (over %" PRId64 " ms): %"
+                           PRIu64 "\n", (int64_t)MAIN_LOOP_SLOW_CB_NS / SCALE_MS,
+                           main_loop_stats.n_slow);
+    i = main_loop_stats.n_slow > MAIN_LOOP_SLOW_CBS ?
+        main_loop_stats.n_slow - MAIN_LOOP_SLOW_CBS : 0;
+    for (; i < main_loop_stats.n_slow; i++) {
+        MainLoopSlowCB *slow = &main_loop_stats.slow[i % MAIN_LOOP_SLOW_CBS];
+
+        g_string_append_printf(buf, "  %" PRId64 " ms ago: %s ",
+                               (now - slow->when) / SCALE_MS,
+                               main_loop_cb_names[slow->type]);
+        if (slow->name) {
+            g_string_append(buf, slow->name);
+        } else {
+            main_loop_format_fn(buf, slow->fn);
+        }
+        g_string_append_printf(buf, " took %" PRId64 " us\n",
+                               slow->ns / SCALE_US);
+    }
+    return buf;
+}
+
 /* Functions to operate on the main QEMU AioContext.  */
 
 QEMUBH *qemu_bh_new_full(QEMUBHFunc *cb, void *opaque, const char *name)
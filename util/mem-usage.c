@@ -0,0 +1,37 @@
+/*
+ * Memory accounting per subsystem
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/mem-usage.h"
+#include "qemu/stats64.h"
+
+/*
+ * Stat64 can only grow, so keep what was allocated and what was freed
+ * apart; the difference is what is in use.
+ */
+static struct {
+    Stat64 allocated;
+    Stat64 freed;
+} mem_usage[MEMORY_USAGE_SUBSYSTEM__MAX];
+
+void mem_usage_add(MemoryUsageSubsystem subsys, uint64_t bytes)
+{
+    stat64_add(&mem_usage[subsys].allocated, bytes);
+}
+
+void mem_usage_sub(MemoryUsageSubsystem subsys, uint64_t bytes)
+{
+    stat64_add(&mem_usage[subsys].freed, bytes);
+}
+
+uint64_t mem_usage_get(MemoryUsageSubsystem subsys)
+{
+    /* Read freed first, so that a concurrent free cannot underflow */
+    uint64_t freed = stat64_get(&mem_usage[subsys].freed);
+
+    return stat64_get(&mem_usage[subsys].allocated) - freed;
+}
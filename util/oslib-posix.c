@@ -40,6 +40,7 @@
 #include <libgen.h>
 #include "qemu/cutils.h"
 #include "qemu/compiler.h"
+#include "qemu/mem-usage.h"
 
 #ifdef CONFIG_LINUX
 #include <sys/syscall.h>
@@ -226,6 +227,34 @@ void *qemu_memalign(size_t alignment, size_t size)
     return qemu_oom_check(qemu_try_memalign(alignment, size));
 }
 
+/*
+ * Size of a transparent hugepage on this host, or 0 if unknown.  It
+ * depends on the base page size: 2 MiB with 4 KiB pages, but 512 MiB
+ * on an aarch64 host with 64 KiB pages.
+ */
+size_t qemu_thp_size(void)
+{
+#ifdef CONFIG_LINUX
+    static size_t thp_size = -1;
+
+    if (thp_size == (size_t)-1) {
+        const char *path = "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size";
+        g_autofree char *contents = NULL;
+        uint64_t val;
+
+        thp_size = 0;
+        if (g_file_get_contents(path, &contents, NULL, NULL) &&
+            !qemu_strtou64(g_strstrip(contents), NULL, 10, &val) &&
+            is_power_of_2(val)) {
+            thp_size = val;
+        }
+    }
+    return thp_size;
+#else
+    return 0;
+#endif
+}
+
 /* alloc shared memory pages */
 void *qemu_anon_ram_alloc(size_t size, uint64_t *alignment, bool shared,
                           bool noreserve)
@@ -233,7 +262,13 @@ void *qemu_anon_ram_alloc(size_t size, uint64_t *alignment, bool shared,
     const uint32_t qemu_map_flags = (shared ? QEMU_MAP_SHARED : 0) |
                                     (noreserve ? QEMU_MAP_NORESERVE : 0);
     size_t align = QEMU_VMALLOC_ALIGN;
-    void *ptr = qemu_ram_mmap(-1, size, align, qemu_map_flags, 0);
+    void *ptr;
+
+    /* Let a block big enough for a hugepage start on one */
+    if (size >= qemu_thp_size()) {
+        align = MAX(align, qemu_thp_size());
+    }
+    ptr = qemu_ram_mmap(-1, size, align, qemu_map_flags, 0);
 
     if (ptr == MAP_FAILED) {
         return NULL;
@@ -738,6 +773,7 @@ void *qemu_alloc_stack(size_t *sz)
     }
 #endif
 
+    mem_usage_add(MEMORY_USAGE_SUBSYSTEM_COROUTINE_STACK, *sz);
     return ptr;
 }
 
@@ -765,6 +801,7 @@ void qemu_free_stack(void *stack, size_t sz)
     }
 #endif
 
+    mem_usage_sub(MEMORY_USAGE_SUBSYSTEM_COROUTINE_STACK, sz);
     munmap(stack, sz);
 }
 
@@ -81,6 +81,11 @@ static int get_allocation_granularity(void)
     return system_info.dwAllocationGranularity;
 }
 
+size_t qemu_thp_size(void)
+{
+    return 0;
+}
+
 void *qemu_anon_ram_alloc(size_t size, uint64_t *align, bool shared,
                           bool noreserve)
 {
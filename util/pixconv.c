@@ -0,0 +1,361 @@
+/*
+ * Pixel format conversion for display device models
+ *
+ * Display refreshes convert every dirty row of the guest framebuffer to
+ * the host surface format, which is the main CPU cost of large displays.
+ * Each conversion has a portable implementation and, on x86 hosts with
+ * AVX2, one that converts 8 pixels at a time.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/pixconv.h"
+#include "ui/pixel_ops.h"
+
+/* BT.601 full range, 16.16 fixed point */
+#define YUV_RV  91881
+#define YUV_GU  22554
+#define YUV_GV  46802
+#define YUV_BU  116130
+
+typedef struct PixconvAccel {
+    const char *name;
+    void (*rgb565)(uint32_t *dst, const uint8_t *src, int n, bool bgr);
+    void (*rgb888)(uint32_t *dst, const uint8_t *src, int n, bool bgr);
+    void (*rgbx8888)(uint32_t *dst, const uint8_t *src, int n, bool bgr);
+    void (*pal8)(uint32_t *dst, const uint8_t *src, int n,
+                 const uint32_t *palette);
+    void (*uyvy)(uint32_t *dst, const uint8_t *src, int n,
+                 bool signed_chroma);
+} PixconvAccel;
+
+static void pixconv_rgb565_int(uint32_t *dst, const uint8_t *src, int n,
+                               bool bgr)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t v = lduw_le_p(src + i * 2);
+
+        if (bgr) {
+            dst[i] = ((v & 0x001f) << 19) | ((v & 0x07e0) << 5) |
+                     ((v & 0xf800) >> 8);
+        } else {
+            dst[i] = ((v & 0xf800) << 8) | ((v & 0x07e0) << 5) |
+                     ((v & 0x001f) << 3);
+        }
+    }
+}
+
+static void pixconv_rgb888_int(uint32_t *dst, const uint8_t *src, int n,
+                               bool bgr)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        const uint8_t *p = src + i * 3;
+
+        dst[i] = bgr ? rgb_to_pixel32(p[2], p[1], p[0])
+                     : rgb_to_pixel32(p[0], p[1], p[2]);
+    }
+}
+
+static void pixconv_rgbx8888_int(uint32_t *dst, const uint8_t *src, int n,
+                                 bool bgr)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        const uint8_t *p = src + i * 4;
+
+        dst[i] = bgr ? rgb_to_pixel32(p[2], p[1], p[0])
+                     : rgb_to_pixel32(p[0], p[1], p[2]);
+    }
+}
+
+static void pixconv_pal8_int(uint32_t *dst, const uint8_t *src, int n,
+                             const uint32_t *palette)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = palette[src[i]];
+    }
+}
+
+static inline uint32_t pixconv_yuv(int y, int dr, int dg, int db)
+{
+    return rgb_to_pixel32(MIN(MAX(y + dr, 0), 255), MIN(MAX(y - dg, 0), 255),
+                          MIN(MAX(y + db, 0), 255));
+}
+
+static void pixconv_uyvy_int(uint32_t *dst, const uint8_t *src, int n,
+                             bool signed_chroma)
+{
+    int bias = signed_chroma ? 0 : 128;
+    int i;
+
+    for (i = 0; i < n / 2; i++) {
+        const uint8_t *p = src + i * 4;
+        int u = (signed_chroma ? (int8_t)p[0] : p[0]) - bias;
+        int v = (signed_chroma ? (int8_t)p[2] : p[2]) - bias;
+        int dr = (YUV_RV * v) >> 16;
+        int dg = (YUV_GU * u + YUV_GV * v) >> 16;
+        int db = (YUV_BU * u) >> 16;
+
+        dst[i * 2] = pixconv_yuv(p[1], dr, dg, db);
+        dst[i * 2 + 1] = pixconv_yuv(p[3], dr, dg, db);
+    }
+}
+
+static const PixconvAccel pixconv_int = {
+    .name = "int",
+    .rgb565 = pixconv_rgb565_int,
+    .rgb888 = pixconv_rgb888_int,
+    .rgbx8888 = pixconv_rgbx8888_int,
+    .pal8 = pixconv_pal8_int,
+    .uyvy = pixconv_uyvy_int,
+};
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static void pixconv_rgb565_avx2(uint32_t *dst, const uint8_t *src, int n,
+                                bool bgr)
+{
+    const __m256i r_mask = _mm256_set1_epi32(0xf800);
+    const __m256i g_mask = _mm256_set1_epi32(0x07e0);
+    const __m256i b_mask = _mm256_set1_epi32(0x001f);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_cvtepu16_epi32(
+            _mm_loadu_si128((const __m128i *)(src + i * 2)));
+        __m256i r = _mm256_and_si256(v, r_mask);
+        __m256i g = _mm256_slli_epi32(_mm256_and_si256(v, g_mask), 5);
+        __m256i b = _mm256_and_si256(v, b_mask);
+
+        if (bgr) {
+            r = _mm256_srli_epi32(r, 8);
+            b = _mm256_slli_epi32(b, 19);
+        } else {
+            r = _mm256_slli_epi32(r, 8);
+            b = _mm256_slli_epi32(b, 3);
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_or_si256(_mm256_or_si256(r, g), b));
+    }
+    pixconv_rgb565_int(dst + i, src + i * 2, n - i, bgr);
+}
+
+/* Byte shuffles of 4 pixels to host order, in each 128-bit lane */
+#define PIXCONV_SHUFFLE(a, b, c, s) \
+    _mm256_setr_epi8(a, b, c, -1, a + s, b + s, c + s, -1,              \
+                     a + 2 * s, b + 2 * s, c + 2 * s, -1,               \
+                     a + 3 * s, b + 3 * s, c + 3 * s, -1,               \
+                     a, b, c, -1, a + s, b + s, c + s, -1,              \
+                     a + 2 * s, b + 2 * s, c + 2 * s, -1,               \
+                     a + 3 * s, b + 3 * s, c + 3 * s, -1)
+
+static void pixconv_rgb888_avx2(uint32_t *dst, const uint8_t *src, int n,
+                                bool bgr)
+{
+    const __m256i shuf = bgr ? PIXCONV_SHUFFLE(0, 1, 2, 3)
+                             : PIXCONV_SHUFFLE(2, 1, 0, 3);
+    int i;
+
+    /* The second load reads 4 bytes past the 8 pixels */
+    for (i = 0; i + 10 <= n; i += 8) {
+        const uint8_t *p = src + i * 3;
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+            _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_shuffle_epi8(v, shuf));
+    }
+    pixconv_rgb888_int(dst + i, src + i * 3, n - i, bgr);
+}
+
+static void pixconv_rgbx8888_avx2(uint32_t *dst, const uint8_t *src, int n,
+                                  bool bgr)
+{
+    const __m256i shuf = bgr ? PIXCONV_SHUFFLE(0, 1, 2, 4)
+                             : PIXCONV_SHUFFLE(2, 1, 0, 4);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_shuffle_epi8(v, shuf));
+    }
+    pixconv_rgbx8888_int(dst + i, src + i * 4, n - i, bgr);
+}
+
+static void pixconv_pal8_avx2(uint32_t *dst, const uint8_t *src, int n,
+                              const uint32_t *palette)
+{
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i *)(src + i)));
+
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_i32gather_epi32((const int *)palette,
+                                                   idx, 4));
+    }
+    pixconv_pal8_int(dst + i, src + i, n - i, palette);
+}
+
+static void pixconv_uyvy_avx2(uint32_t *dst, const uint8_t *src, int n,
+                              bool signed_chroma)
+{
+    const __m128i y_shuf = _mm_setr_epi8(1, 3, 5, 7, 9, 11, 13, 15,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i u_shuf = _mm_setr_epi8(0, 0, 4, 4, 8, 8, 12, 12,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i v_shuf = _mm_setr_epi8(2, 2, 6, 6, 10, 10, 14, 14,
+                                         -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i max = _mm256_set1_epi32(255);
+    const __m256i bias = _mm256_set1_epi32(128);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m128i in = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m256i y = _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, y_shuf));
+        __m256i u, v, r, g, b;
+
+        if (signed_chroma) {
+            u = _mm256_cvtepi8_epi32(_mm_shuffle_epi8(in, u_shuf));
+            v = _mm256_cvtepi8_epi32(_mm_shuffle_epi8(in, v_shuf));
+        } else {
+            u = _mm256_sub_epi32(
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, u_shuf)), bias);
+            v = _mm256_sub_epi32(
+                _mm256_cvtepu8_epi32(_mm_shuffle_epi8(in, v_shuf)), bias);
+        }
+
+        r = _mm256_add_epi32(y, _mm256_srai_epi32(
+            _mm256_mullo_epi32(v, _mm256_set1_epi32(YUV_RV)), 16));
+        g = _mm256_sub_epi32(y, _mm256_srai_epi32(_mm256_add_epi32(
+            _mm256_mullo_epi32(u, _mm256_set1_epi32(YUV_GU)),
+            _mm256_mullo_epi32(v, _mm256_set1_epi32(YUV_GV))), 16));
+        b = _mm256_add_epi32(y, _mm256_srai_epi32(
+            _mm256_mullo_epi32(u, _mm256_set1_epi32(YUV_BU)), 16));
+
+        r = _mm256_max_epi32(_mm256_min_epi32(r, max), zero);
+        g = _mm256_max_epi32(_mm256_min_epi32(g, max), zero);
+        b = _mm256_max_epi32(_mm256_min_epi32(b, max), zero);
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(
+            _mm256_or_si256(_mm256_slli_epi32(r, 16),
+                            _mm256_slli_epi32(g, 8)), b));
+    }
+    pixconv_uyvy_int(dst + i, src + i * 2, n - i, signed_chroma);
+}
+
+#pragma GCC pop_options
+
+static const PixconvAccel pixconv_avx2 = {
+    .name = "avx2",
+    .rgb565 = pixconv_rgb565_avx2,
+    .rgb888 = pixconv_rgb888_avx2,
+    .rgbx8888 = pixconv_rgbx8888_avx2,
+    .pal8 = pixconv_pal8_avx2,
+    .uyvy = pixconv_uyvy_avx2,
+};
+#endif /* CONFIG_AVX2_OPT */
+
+#define CACHE_AVX2    1
+
+static unsigned cpuid_cache;
+static const PixconvAccel *pixconv_accel = &pixconv_int;
+
+static void init_accel(unsigned cache)
+{
+    const PixconvAccel *accel = &pixconv_int;
+
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        accel = &pixconv_avx2;
+    }
+#endif
+    pixconv_accel = accel;
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 7) {
+        __cpuid(1, a, b, c, d);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool pixconv_next_accel(void)
+{
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+const char *pixconv_accel_name(void)
+{
+    return pixconv_accel->name;
+}
+
+void pixconv_rgb565(uint32_t *dst, const uint8_t *src, int n, bool bgr)
+{
+    pixconv_accel->rgb565(dst, src, n, bgr);
+}
+
+void pixconv_rgb888(uint32_t *dst, const uint8_t *src, int n, bool bgr)
+{
+    pixconv_accel->rgb888(dst, src, n, bgr);
+}
+
+void pixconv_rgbx8888(uint32_t *dst, const uint8_t *src, int n, bool bgr)
+{
+    pixconv_accel->rgbx8888(dst, src, n, bgr);
+}
+
+void pixconv_pal8(uint32_t *dst, const uint8_t *src, int n,
+                  const uint32_t *palette)
+{
+    pixconv_accel->pal8(dst, src, n, palette);
+}
+
+void pixconv_uyvy(uint32_t *dst, const uint8_t *src, int n,
+                  bool signed_chroma)
+{
+    pixconv_accel->uyvy(dst, src, n, signed_chroma);
+}
@@ -16,14 +16,70 @@
 #include "trace.h"
 #include "qemu/thread.h"
 #include "qemu/atomic.h"
+#include "qemu/stats64.h"
 #include "qemu/coroutine.h"
 #include "qemu/coroutine_int.h"
 #include "block/aio.h"
 
 enum {
-    POOL_BATCH_SIZE = 64,
+    POOL_MIN_BATCH_SIZE = 64,
 };
 
+/*
+ * Coroutines beyond what the pools keep are freed along with their
+ * stack, and each new one maps a stack again.  Devices that keep many
+ * requests in flight raise the size so that they do not cause that
+ * churn.
+ */
+static unsigned int pool_batch_size = POOL_MIN_BATCH_SIZE;
+
+/*
+ * Coroutines created, those that needed a new stack, and stacks freed.
+ * Each thread counts in its own CoroutineStats, so that threads creating
+ * coroutines do not fight over one cache line; qemu_coroutine_stats_format()
+ * adds them up.  The counts of threads that exited go to stats_exited.
+ */
+typedef struct CoroutineStats {
+    Stat64 created;
+    Stat64 allocated;
+    Stat64 freed;
+    QSLIST_ENTRY(CoroutineStats) next;
+} CoroutineStats;
+
+/* Protects stats_list and stats_exited; zero is unlocked */
+static QemuSpin stats_lock;
+static QSLIST_HEAD(, CoroutineStats) stats_list;
+static CoroutineStats stats_exited;
+static __thread CoroutineStats thread_stats;
+static __thread Notifier coroutine_stats_notifier;
+
+static void coroutine_stats_sum(CoroutineStats *sum, CoroutineStats *stats)
+{
+    stat64_add(&sum->created, stat64_get(&stats->created));
+    stat64_add(&sum->allocated, stat64_get(&stats->allocated));
+    stat64_add(&sum->freed, stat64_get(&stats->freed));
+}
+
+static void coroutine_stats_cleanup(Notifier *n, void *value)
+{
+    qemu_spin_lock(&stats_lock);
+    coroutine_stats_sum(&stats_exited, &thread_stats);
+    QSLIST_REMOVE(&stats_list, &thread_stats, CoroutineStats, next);
+    qemu_spin_unlock(&stats_lock);
+}
+
+static CoroutineStats *coroutine_stats(void)
+{
+    if (unlikely(!coroutine_stats_notifier.notify)) {
+        coroutine_stats_notifier.notify = coroutine_stats_cleanup;
+        qemu_thread_atexit_add(&coroutine_stats_notifier);
+        qemu_spin_lock(&stats_lock);
+        QSLIST_INSERT_HEAD(&stats_list, &thread_stats, next);
+        qemu_spin_unlock(&stats_lock);
+    }
+    return &thread_stats;
+}
+
 /** Free list to speed up creation */
 static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
 static unsigned int release_pool_size;
@@ -38,18 +94,21 @@ static void coroutine_pool_cleanup(Notifier *n, void *value)
 
     QSLIST_FOREACH_SAFE(co, &alloc_pool, pool_next, tmp) {
         QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
+        stat64_add(&coroutine_stats()->freed, 1);
         qemu_coroutine_delete(co);
     }
 }
 
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
 {
+    CoroutineStats *stats = coroutine_stats();
     Coroutine *co = NULL;
 
+    stat64_add(&stats->created, 1);
     if (CONFIG_COROUTINE_POOL) {
         co = QSLIST_FIRST(&alloc_pool);
         if (!co) {
-            if (release_pool_size > POOL_BATCH_SIZE) {
+            if (release_pool_size > qatomic_read(&pool_batch_size)) {
                 /* Slow path; a good place to register the destructor, too.  */
                 if (!coroutine_pool_cleanup_notifier.notify) {
                     coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
@@ -72,6 +131,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     }
 
     if (!co) {
+        stat64_add(&stats->allocated, 1);
         co = qemu_coroutine_new();
     }
 
@@ -86,21 +146,66 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
+        unsigned int batch_size = qatomic_read(&pool_batch_size);
+
+        if (release_pool_size < batch_size * 2) {
             QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
             qatomic_inc(&release_pool_size);
             return;
         }
-        if (alloc_pool_size < POOL_BATCH_SIZE) {
+        if (alloc_pool_size < batch_size) {
             QSLIST_INSERT_HEAD(&alloc_pool, co, pool_next);
             alloc_pool_size++;
             return;
         }
     }
 
+    stat64_add(&coroutine_stats()->freed, 1);
     qemu_coroutine_delete(co);
 }
 
+void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size)
+{
+    qatomic_add(&pool_batch_size, additional_pool_size);
+}
+
+void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size)
+{
+    qatomic_sub(&pool_batch_size, removing_pool_size);
+}
+
+GString *qemu_coroutine_stats_format(void)
+{
+    GString *buf = g_string_new("");
+    CoroutineStats sum = {};
+    CoroutineStats *stats;
+    uint64_t created, allocated, freed;
+
+    qemu_spin_lock(&stats_lock);
+    coroutine_stats_sum(&sum, &stats_exited);
+    QSLIST_FOREACH(stats, &stats_list, next) {
+        coroutine_stats_sum(&sum, stats);
+    }
+    qemu_spin_unlock(&stats_lock);
+    created = stat64_get(&sum.created);
+    allocated = stat64_get(&sum.allocated);
+    freed = stat64_get(&sum.freed);
+
+    g_string_append_printf(buf, "created: %" PRIu64 "\n", created);
+    g_string_append_printf(buf, "  from pool: %" PRIu64 "\n",
+                           created - allocated);
+    g_string_append_printf(buf, "  newly allocated: %" PRIu64 "\n",
+                           allocated);
+    g_string_append_printf(buf, "stacks freed: %" PRIu64 "\n", freed);
+    g_string_append_printf(buf, "stacks mapped: %" PRIu64 "\n",
+                           allocated - freed);
+    g_string_append_printf(buf, "pool batch size: %u\n",
+                           qatomic_read(&pool_batch_size));
+    g_string_append_printf(buf, "shared pool: %u\n",
+                           qatomic_read(&release_pool_size));
+    return buf;
+}
+
 void qemu_aio_coroutine_enter(AioContext *ctx, Coroutine *co)
 {
     QSIMPLEQ_HEAD(, Coroutine) pending = QSIMPLEQ_HEAD_INITIALIZER(pending);
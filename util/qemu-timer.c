@@ -61,12 +61,21 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * used by different AioContexts / threads. Each clock also has
  * a list of the QEMUTimerLists associated with it, in order that
  * reenabling the clock can call all the notifiers.
+ *
+ * The active timers are kept in a pairing heap, whose root is the
+ * timer that expires first, so that arming a timer takes constant
+ * time and removing one takes amortized logarithmic time however
+ * many timers there are.  Each node points to its first child and
+ * to its next sibling; @prev is the previous sibling, or the parent
+ * for a first child.  Timers that expire at the same time run in
+ * the order they were armed, as @seq tells.
  */
 
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
     QEMUTimer *active_timers;
+    uint64_t seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -262,11 +271,8 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
         /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
-        }
+        ts = timer_heap_first(timer_list->active_timers, attr_mask);
         if (!ts) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
             continue;
@@ -375,43 +381,138 @@ void timer_deinit(QEMUTimer *ts)
     ts->timer_list = NULL;
 }
 
-static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
 {
-    QEMUTimer **pt, *t;
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
 
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            qatomic_set(pt, t->next);
-            break;
+/* Join two heaps; the result has no siblings */
+static QEMUTimer *timer_heap_meld(QEMUTimer *a, QEMUTimer *b)
+{
+    if (!a || (b && timer_before(b, a))) {
+        QEMUTimer *t = a;
+        a = b;
+        b = t;
+    }
+    if (!a) {
+        return NULL;
+    }
+    if (b) {
+        b->prev = a;
+        b->next = a->child;
+        if (a->child) {
+            a->child->prev = b;
         }
-        pt = &t->next;
+        a->child = b;
     }
+    a->next = NULL;
+    a->prev = NULL;
+    return a;
 }
 
-static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
-                                QEMUTimer *ts, int64_t expire_time)
+/* Join a list of siblings into one heap, two by two and then from the right */
+static QEMUTimer *timer_heap_merge_pairs(QEMUTimer *first)
 {
-    QEMUTimer **pt, *t;
+    QEMUTimer *pairs = NULL, *heap = NULL;
 
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
+    while (first) {
+        QEMUTimer *a = first, *b = a->next, *m;
+
+        first = b ? b->next : NULL;
+        m = timer_heap_meld(a, b);
+        m->next = pairs;
+        pairs = m;
+    }
+    while (pairs) {
+        QEMUTimer *m = pairs;
+
+        pairs = m->next;
+        heap = timer_heap_meld(m, heap);
+    }
+    return heap;
+}
+
+static QEMUTimer *timer_heap_parent(QEMUTimer *ts)
+{
+    while (ts->prev->child != ts) {
+        ts = ts->prev;
+    }
+    return ts->prev;
+}
+
+/* Remove @ts from the heap of @timer_list */
+static void timer_heap_remove(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    QEMUTimer *root = timer_list->active_timers;
+    QEMUTimer *sub = timer_heap_merge_pairs(ts->child);
+
+    if (ts == root) {
+        root = sub;
+    } else {
+        if (ts->prev->child == ts) {
+            ts->prev->child = ts->next;
+        } else {
+            ts->prev->next = ts->next;
+        }
+        if (ts->next) {
+            ts->next->prev = ts->prev;
+        }
+        root = timer_heap_meld(root, sub);
+    }
+    ts->child = ts->next = ts->prev = NULL;
+    qatomic_set(&timer_list->active_timers, root);
+}
+
+/*
+ * The first timer whose attributes are all in @attr_mask.  The heap is
+ * walked depth first, leaving out the subtrees whose root cannot come
+ * before the best timer found so far.
+ */
+static QEMUTimer *timer_heap_first(QEMUTimer *root, int attr_mask)
+{
+    QEMUTimer *best = NULL, *t = root;
+
+    while (t) {
+        bool skip = best && !timer_before(t, best);
+
+        if (!skip && !(t->attributes & ~attr_mask)) {
+            best = t;
+            skip = true;
+        }
+        if (!skip && t->child) {
+            t = t->child;
+            continue;
         }
-        pt = &t->next;
+        /* Next sibling, or that of the closest ancestor that has one */
+        while (t != root && !t->next) {
+            t = timer_heap_parent(t);
+        }
+        t = t == root ? NULL : t->next;
     }
+    return best;
+}
+
+static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    if (ts->expire_time != -1) {
+        timer_heap_remove(timer_list, ts);
+    }
+    ts->expire_time = -1;
+}
+
+static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
+                                QEMUTimer *ts, int64_t expire_time)
+{
+    QEMUTimer *root;
+
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    qatomic_set(pt, ts);
+    ts->seq = timer_list->seq++;
+    ts->child = NULL;
+    root = timer_heap_meld(timer_list->active_timers, ts);
+    qatomic_set(&timer_list->active_timers, root);
 
-    return pt == &timer_list->active_timers;
+    return root == ts;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -502,6 +603,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     bool progress = false;
     QEMUTimerCB *cb;
     void *opaque;
+    int64_t start;
 
     if (!qatomic_read(&timer_list->active_timers)) {
         return false;
@@ -562,15 +664,16 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
+        timer_heap_remove(timer_list, ts);
         ts->expire_time = -1;
         cb = ts->cb;
         opaque = ts->opaque;
 
         /* run the callback (the timer list can be modified) */
         qemu_mutex_unlock(&timer_list->active_timers_lock);
+        start = main_loop_cb_begin();
         cb(opaque);
+        main_loop_cb_end(MAIN_LOOP_CB_TIMER, cb, NULL, start);
         qemu_mutex_lock(&timer_list->active_timers_lock);
 
         progress = true;
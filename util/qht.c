@@ -43,10 +43,20 @@
  * just-removed entry. This makes lookups slightly faster, since the moment an
  * invalid entry is found, the (failed) lookup is over.
  *
- * Resizing is done by taking all bucket spinlocks (so that no other writers can
- * race with us) and then copying all entries into a new hash map. Then, the
- * ht->map pointer is set, and the old map is freed once no RCU readers can see
- * it anymore.
+ * Explicit resizes are done by taking all bucket spinlocks (so that no other
+ * writers can race with us) and then copying all entries into a new hash map.
+ * Then, the ht->map pointer is set, and the old map is freed once no RCU
+ * readers can see it anymore.
+ *
+ * Automatic resizes are incremental instead, so that writers are not stalled
+ * while a large table is copied. The new map is hung off the old one, which
+ * stays in ht->map, and the head buckets of the old map are migrated in
+ * order, a few at a time, by the insertions that follow.  Lookups that miss
+ * in the old map also search the new one.  Writers whose head bucket has
+ * already been migrated go on to the new map, see
+ * qht_bucket_lock__migrated().  Once the last bucket has been migrated,
+ * ht->map is set to the new map.  Operations on the whole table complete
+ * any pending migration first.
  *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occurred
@@ -159,6 +169,11 @@ QEMU_BUILD_BUG_ON(sizeof(struct qht_bucket) > QHT_BUCKET_ALIGN);
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @new: map that the entries are being migrated to, or NULL. It is set
+ *       under ht->lock.
+ * @n_migrated: number of head buckets, from the first one, whose entries
+ *              have been migrated to @new. It is only updated with the lock
+ *              of the last migrated bucket held.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
  */
@@ -168,14 +183,20 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *new;
+    size_t n_migrated;
 };
 
 /* trigger a resize when n_added_buckets > n_buckets / div */
 #define QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV 8
 
+/* number of head buckets migrated by each step of an automatic resize */
+#define QHT_RESIZE_BATCH 64
+
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static bool qht_resize_step__locked(struct qht *ht, size_t n);
 
 #ifdef QHT_DEBUG
 
@@ -274,35 +295,6 @@ static inline bool qht_map_is_stale__locked(const struct qht *ht,
     return map != ht->map;
 }
 
-/*
- * Grab all bucket locks, and set @pmap after making sure the map isn't stale.
- *
- * Pairs with qht_map_unlock_buckets(), hence the pass-by-reference.
- *
- * Note: callers cannot have ht->lock held.
- */
-static inline
-void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
-{
-    struct qht_map *map;
-
-    map = qatomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
-        *pmap = map;
-        return;
-    }
-    qht_map_unlock_buckets(map);
-
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
-    qht_lock(ht);
-    map = ht->map;
-    qht_map_lock_buckets(map);
-    qht_unlock(ht);
-    *pmap = map;
-    return;
-}
-
 /*
  * Get a head bucket and lock it, making sure its parent map is not stale.
  * @pmap is filled with a pointer to the bucket's parent map.
@@ -338,6 +330,57 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     return b;
 }
 
+/*
+ * Called with the lock of head bucket @b of *@pmap held, as returned by
+ * qht_bucket_lock__no_stale().  If the bucket has been migrated by an
+ * ongoing resize, lock the head bucket for @hash in the new map too, and
+ * return it after updating @pmap; otherwise return @b.
+ *
+ * By the time the new map's bucket is locked, the resize may have completed
+ * and another one may have started on the new map, so keep following the
+ * chain until the locked bucket has not been migrated.  Holding the lock of
+ * a head bucket keeps it from being migrated, so only the lock of @b and of
+ * the returned bucket need to be kept.
+ *
+ * Unlock with qht_bucket_unlock__migrated().
+ */
+static inline
+struct qht_bucket *qht_bucket_lock__migrated(struct qht_bucket *b,
+                                             uint32_t hash,
+                                             struct qht_map **pmap)
+{
+    struct qht_map *map = *pmap;
+    struct qht_bucket *cur = b;
+    struct qht_map *new;
+    struct qht_bucket *nb;
+
+    for (;;) {
+        new = qatomic_read(&map->new);
+        if (likely(!new) ||
+            (size_t)(cur - map->buckets) >= qatomic_read(&map->n_migrated)) {
+            break;
+        }
+        nb = qht_map_to_bucket(new, hash);
+        qemu_spin_lock(&nb->lock);
+        if (cur != b) {
+            qemu_spin_unlock(&cur->lock);
+        }
+        cur = nb;
+        map = new;
+    }
+    *pmap = map;
+    return cur;
+}
+
+static inline void qht_bucket_unlock__migrated(struct qht_bucket *b,
+                                               struct qht_bucket *nb)
+{
+    if (nb != b) {
+        qemu_spin_unlock(&nb->lock);
+    }
+    qemu_spin_unlock(&b->lock);
+}
+
 static inline bool qht_map_needs_resize(const struct qht_map *map)
 {
     return qatomic_read(&map->n_added_buckets) >
@@ -376,6 +419,8 @@ static struct qht_map *qht_map_create(size_t n_buckets)
 
     map = g_malloc(sizeof(*map));
     map->n_buckets = n_buckets;
+    map->new = NULL;
+    map->n_migrated = 0;
 
     map->n_added_buckets = 0;
     map->n_added_buckets_threshold = n_buckets /
@@ -411,6 +456,9 @@ void qht_init(struct qht *ht, qht_cmp_func_t cmp, size_t n_elems,
 /* call only when there are no readers/writers left */
 void qht_destroy(struct qht *ht)
 {
+    if (ht->map->new) {
+        qht_map_destroy(ht->map->new);
+    }
     qht_map_destroy(ht->map);
     memset(ht, 0, sizeof(*ht));
 }
@@ -450,9 +498,13 @@ void qht_reset(struct qht *ht)
 {
     struct qht_map *map;
 
-    qht_map_lock_buckets__no_stale(ht, &map);
+    qht_lock(ht);
+    qht_resize_step__locked(ht, SIZE_MAX);
+    map = ht->map;
+    qht_map_lock_buckets(map);
     qht_map_reset__all_locked(map);
     qht_map_unlock_buckets(map);
+    qht_unlock(ht);
 }
 
 static inline void qht_do_resize(struct qht *ht, struct qht_map *new)
@@ -474,6 +526,7 @@ bool qht_reset_size(struct qht *ht, size_t n_elems)
     n_buckets = qht_elems_to_buckets(n_elems);
 
     qht_lock(ht);
+    qht_resize_step__locked(ht, SIZE_MAX);
     map = ht->map;
     if (n_buckets != map->n_buckets) {
         new = qht_map_create(n_buckets);
@@ -525,15 +578,14 @@ void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
     return ret;
 }
 
-void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
-                        qht_lookup_func_t func)
+static inline
+void *qht_map_lookup(const struct qht_map *map, const void *userp,
+                     uint32_t hash, qht_lookup_func_t func)
 {
     const struct qht_bucket *b;
-    const struct qht_map *map;
     unsigned int version;
     void *ret;
 
-    map = qatomic_rcu_read(&ht->map);
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -548,6 +600,35 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
     return qht_lookup__slowpath(b, func, userp, hash);
 }
 
+void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
+                        qht_lookup_func_t func)
+{
+    const struct qht_map *map;
+    const struct qht_map *new;
+    void *ret;
+
+    map = qatomic_rcu_read(&ht->map);
+    ret = qht_map_lookup(map, userp, hash, func);
+    if (likely(ret)) {
+        return ret;
+    }
+    /*
+     * During a resize, the entry may have been migrated already.  The
+     * migration writes it to the new map before clearing it from the old
+     * one, so the seqlock retry above ensures we see it there.  A resize
+     * can start on the new map before this one is retired, so follow the
+     * chain until a map without a successor.
+     */
+    while (unlikely(new = qatomic_rcu_read(&map->new))) {
+        map = new;
+        ret = qht_map_lookup(map, userp, hash, func);
+        if (ret) {
+            return ret;
+        }
+    }
+    return NULL;
+}
+
 void *qht_lookup(const struct qht *ht, const void *userp, uint32_t hash)
 {
     return qht_lookup_custom(ht, userp, hash, ht->cmp);
@@ -603,43 +684,106 @@ static void *qht_insert__locked(const struct qht *ht, struct qht_map *map,
     return NULL;
 }
 
+/*
+ * Move the entries of head bucket @idx of @map, i.e. of its whole chain, to
+ * @map->new.  Call with ht->lock held.
+ */
+static void qht_map_migrate_bucket(struct qht *ht, struct qht_map *map,
+                                   size_t idx)
+{
+    struct qht_bucket *head = &map->buckets[idx];
+    struct qht_bucket *b;
+    int i;
+
+    qemu_spin_lock(&head->lock);
+    for (b = head; b; b = b->next) {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            struct qht_bucket *nb;
+
+            if (b->pointers[i] == NULL) {
+                goto done;
+            }
+            nb = qht_map_to_bucket(map->new, b->hashes[i]);
+            qemu_spin_lock(&nb->lock);
+            qht_insert__locked(ht, map->new, nb, b->pointers[i], b->hashes[i],
+                               NULL);
+            qemu_spin_unlock(&nb->lock);
+        }
+    }
+ done:
+    /* lookups that miss from now on will search the new map */
+    qht_bucket_reset__locked(head);
+    qatomic_set(&map->n_migrated, idx + 1);
+    qemu_spin_unlock(&head->lock);
+}
+
+/*
+ * Migrate up to @n more head buckets of an ongoing resize, and switch to the
+ * new map once they are all done.  Returns true if no resize is left ongoing.
+ * Call with ht->lock held.
+ */
+static bool qht_resize_step__locked(struct qht *ht, size_t n)
+{
+    struct qht_map *map = ht->map;
+    size_t idx;
+
+    if (!map->new) {
+        return true;
+    }
+    for (idx = map->n_migrated; idx < map->n_buckets && n; idx++, n--) {
+        qht_map_migrate_bucket(ht, map, idx);
+    }
+    if (idx < map->n_buckets) {
+        return false;
+    }
+    qht_map_debug__all_locked(map->new);
+    qatomic_rcu_set(&ht->map, map->new);
+    call_rcu(map, qht_map_destroy, rcu);
+    return true;
+}
+
 static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
 {
     struct qht_map *map;
 
     /*
-     * If the lock is taken it probably means there's an ongoing resize,
-     * so bail out.
+     * If the lock is taken it probably means there's an ongoing resize
+     * step, so bail out.
      */
     if (qht_trylock(ht)) {
         return;
     }
     map = ht->map;
-    /* another thread might have just performed the resize we were after */
-    if (qht_map_needs_resize(map)) {
-        struct qht_map *new = qht_map_create(map->n_buckets * 2);
-
-        qht_do_resize(ht, new);
+    if (map->new) {
+        qht_resize_step__locked(ht, QHT_RESIZE_BATCH);
+    } else if (qht_map_needs_resize(map)) {
+        /* another thread might have just performed the resize we were after */
+        qatomic_rcu_set(&map->new, qht_map_create(map->n_buckets * 2));
+        qht_resize_step__locked(ht, QHT_RESIZE_BATCH);
     }
     qht_unlock(ht);
 }
 
 bool qht_insert(struct qht *ht, void *p, uint32_t hash, void **existing)
 {
-    struct qht_bucket *b;
+    struct qht_bucket *b, *nb;
     struct qht_map *map;
     bool needs_resize = false;
+    bool resizing;
     void *prev;
 
     /* NULL pointers are not supported */
     qht_debug_assert(p);
 
     b = qht_bucket_lock__no_stale(ht, hash, &map);
-    prev = qht_insert__locked(ht, map, b, p, hash, &needs_resize);
-    qht_bucket_debug__locked(b);
-    qemu_spin_unlock(&b->lock);
-
-    if (unlikely(needs_resize) && ht->mode & QHT_MODE_AUTO_RESIZE) {
+    resizing = qatomic_read(&map->new) != NULL;
+    nb = qht_bucket_lock__migrated(b, hash, &map);
+    prev = qht_insert__locked(ht, map, nb, p, hash, &needs_resize);
+    qht_bucket_debug__locked(nb);
+    qht_bucket_unlock__migrated(b, nb);
+
+    if (unlikely(needs_resize || resizing) &&
+        ht->mode & QHT_MODE_AUTO_RESIZE) {
         qht_grow_maybe(ht);
     }
     if (likely(prev == NULL)) {
@@ -738,7 +882,7 @@ bool qht_remove__locked(struct qht_bucket *head, const void *p, uint32_t hash)
 
 bool qht_remove(struct qht *ht, const void *p, uint32_t hash)
 {
-    struct qht_bucket *b;
+    struct qht_bucket *b, *nb;
     struct qht_map *map;
     bool ret;
 
@@ -746,9 +890,10 @@ bool qht_remove(struct qht *ht, const void *p, uint32_t hash)
     qht_debug_assert(p);
 
     b = qht_bucket_lock__no_stale(ht, hash, &map);
-    ret = qht_remove__locked(b, p, hash);
-    qht_bucket_debug__locked(b);
-    qemu_spin_unlock(&b->lock);
+    nb = qht_bucket_lock__migrated(b, hash, &map);
+    ret = qht_remove__locked(nb, p, hash);
+    qht_bucket_debug__locked(nb);
+    qht_bucket_unlock__migrated(b, nb);
     return ret;
 }
 
@@ -804,8 +949,11 @@ do_qht_iter(struct qht *ht, const struct qht_iter *iter, void *userp)
 {
     struct qht_map *map;
 
-    map = qatomic_rcu_read(&ht->map);
+    qht_lock(ht);
+    qht_resize_step__locked(ht, SIZE_MAX);
+    map = ht->map;
     qht_map_lock_buckets(map);
+    qht_unlock(ht);
     qht_map_iter__all_locked(map, iter, userp);
     qht_map_unlock_buckets(map);
 }
@@ -860,6 +1008,7 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
     struct qht_map_copy_data data;
 
     old = ht->map;
+    g_assert(!old->new);
     qht_map_lock_buckets(old);
 
     if (reset) {
@@ -888,6 +1037,7 @@ bool qht_resize(struct qht *ht, size_t n_elems)
     size_t ret = false;
 
     qht_lock(ht);
+    qht_resize_step__locked(ht, SIZE_MAX);
     if (n_buckets != ht->map->n_buckets) {
         struct qht_map *new;
 
@@ -900,24 +1050,12 @@ bool qht_resize(struct qht *ht, size_t n_elems)
     return ret;
 }
 
-/* pass @stats to qht_statistics_destroy() when done */
-void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
+static void qht_map_statistics(const struct qht_map *map,
+                               struct qht_stats *stats)
 {
-    const struct qht_map *map;
     int i;
 
-    map = qatomic_rcu_read(&ht->map);
-
-    stats->used_head_buckets = 0;
-    stats->entries = 0;
-    qdist_init(&stats->chain);
-    qdist_init(&stats->occupancy);
-    /* bail out if the qht has not yet been initialized */
-    if (unlikely(map == NULL)) {
-        stats->head_buckets = 0;
-        return;
-    }
-    stats->head_buckets = map->n_buckets;
+    stats->head_buckets += map->n_buckets;
 
     for (i = 0; i < map->n_buckets; i++) {
         const struct qht_bucket *head = &map->buckets[i];
@@ -956,6 +1094,33 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
     }
 }
 
+/*
+ * pass @stats to qht_statistics_destroy() when done.
+ * During a resize, the buckets of both maps are accounted for.
+ */
+void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
+{
+    const struct qht_map *map;
+    const struct qht_map *new;
+
+    map = qatomic_rcu_read(&ht->map);
+
+    stats->head_buckets = 0;
+    stats->used_head_buckets = 0;
+    stats->entries = 0;
+    qdist_init(&stats->chain);
+    qdist_init(&stats->occupancy);
+    /* bail out if the qht has not yet been initialized */
+    if (unlikely(map == NULL)) {
+        return;
+    }
+    qht_map_statistics(map, stats);
+    new = qatomic_rcu_read(&map->new);
+    if (new) {
+        qht_map_statistics(new, stats);
+    }
+}
+
 void qht_statistics_destroy(struct qht_stats *stats)
 {
     qdist_destroy(&stats->occupancy);
@@ -32,6 +32,8 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/lockable.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -50,6 +52,14 @@ static int in_drain_call_rcu;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/* Statistics for "info rcu" */
+static Stat64 rcu_gp_count;
+static Stat64 rcu_gp_total_ns;
+static Stat64 rcu_gp_max_ns;
+static Stat64 rcu_cb_queued;
+static Stat64 rcu_cb_done;
+static Stat64 rcu_cb_max_backlog;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -145,7 +155,10 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    int64_t start, elapsed;
+
     QEMU_LOCK_GUARD(&rcu_sync_lock);
+    start = get_clock();
 
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
@@ -173,6 +186,11 @@ void synchronize_rcu(void)
 
         wait_for_readers();
     }
+
+    elapsed = get_clock() - start;
+    stat64_add(&rcu_gp_count, 1);
+    stat64_add(&rcu_gp_total_ns, elapsed);
+    stat64_max(&rcu_gp_max_ns, elapsed);
 }
 
 
@@ -264,6 +282,7 @@ static void *call_rcu_thread(void *opaque)
             n = qatomic_read(&rcu_call_count);
         }
 
+        stat64_max(&rcu_cb_max_backlog, n);
         qatomic_sub(&rcu_call_count, n);
         synchronize_rcu();
         qemu_mutex_lock_iothread();
@@ -282,6 +301,7 @@ static void *call_rcu_thread(void *opaque)
 
             n--;
             node->func(node);
+            stat64_add(&rcu_cb_done, 1);
         }
         qemu_mutex_unlock_iothread();
     }
@@ -292,6 +312,7 @@ void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
     node->func = func;
     enqueue(node);
+    stat64_add(&rcu_cb_queued, 1);
     qatomic_inc(&rcu_call_count);
     qemu_event_set(&rcu_call_ready_event);
 }
@@ -353,6 +374,29 @@ void drain_call_rcu(void)
 
 }
 
+GString *rcu_stats_format(void)
+{
+    GString *buf = g_string_new("");
+    uint64_t gps = stat64_get(&rcu_gp_count);
+    uint64_t queued = stat64_get(&rcu_cb_queued);
+    uint64_t done = stat64_get(&rcu_cb_done);
+
+    g_string_append_printf(buf, "grace periods: %" PRIu64 "\n", gps);
+    if (gps) {
+        g_string_append_printf(buf, "  average: %" PRIu64 " us\n",
+                               stat64_get(&rcu_gp_total_ns) / gps / SCALE_US);
+        g_string_append_printf(buf, "  longest: %" PRIu64 " us\n",
+                               stat64_get(&rcu_gp_max_ns) / SCALE_US);
+    }
+    g_string_append_printf(buf, "callbacks queued: %" PRIu64 "\n", queued);
+    g_string_append_printf(buf, "callbacks done: %" PRIu64 "\n", done);
+    g_string_append_printf(buf, "callbacks pending: %" PRIu64 "\n",
+                           queued - MIN(done, queued));
+    g_string_append_printf(buf, "largest batch: %" PRIu64 "\n",
+                           stat64_get(&rcu_cb_max_backlog));
+    return buf;
+}
+
 void rcu_register_thread(void)
 {
     assert(rcu_reader.ctr == 0);
@@ -18,6 +18,7 @@
 #include "qemu/queue.h"
 #include "qemu/thread.h"
 #include "qemu/coroutine.h"
+#include "qemu/lockable.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
@@ -25,6 +26,7 @@
 static void do_spawn_thread(ThreadPool *pool);
 
 typedef struct ThreadPoolElement ThreadPoolElement;
+typedef struct ThreadPoolWorker ThreadPoolWorker;
 
 enum ThreadState {
     THREAD_QUEUED,
@@ -38,34 +40,63 @@ struct ThreadPoolElement {
     ThreadPoolFunc *func;
     void *arg;
 
-    /* Moving state out of THREAD_QUEUED is protected by lock.  After
-     * that, only the worker thread can write to it.  Reads and writes
-     * of state and ret are ordered with memory barriers.
+    /* The worker whose queue holds the request; it does not change
+     * while the request is THREAD_QUEUED.
+     */
+    ThreadPoolWorker *worker;
+
+    /* Moving state out of THREAD_QUEUED is protected by worker->lock.
+     * After that, only the worker thread can write to it.  Reads and
+     * writes of state and ret are ordered with memory barriers.
      */
     enum ThreadState state;
     int ret;
 
-    /* Access to this list is protected by lock.  */
+    /* Access to this list is protected by worker->lock.  */
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
 
+/*
+ * Each worker thread serves its own queue of requests, so that workers
+ * do not all fight for one lock.  A worker that runs out of requests
+ * steals the oldest ones from the other queues before going to sleep.
+ * Requests go to a sleeping worker when there is one, which is then
+ * the only wakeup; otherwise they are spread over the busy workers,
+ * which take them without being woken.
+ */
+struct ThreadPoolWorker {
+    ThreadPool *pool;
+    QemuSemaphore sem;
+
+    /* Protected by pool->lock.  */
+    bool used;          /* a thread serves this worker, or will */
+    bool needs_thread;  /* the thread has yet to be created */
+    bool sleeping;      /* waiting on sem, in pool->idle_workers */
+    QSLIST_ENTRY(ThreadPoolWorker) idle;
+
+    QemuMutex lock;
+    /* Protected by lock.  */
+    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+};
+
 struct ThreadPool {
     AioContext *ctx;
     QEMUBH *completion_bh;
     QemuMutex lock;
     QemuCond worker_stopped;
-    QemuSemaphore sem;
     int max_threads;
     QEMUBH *new_thread_bh;
+    ThreadPoolWorker *workers;
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    unsigned int next_worker;
 
     /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+    QSLIST_HEAD(, ThreadPoolWorker) idle_workers;
     int cur_threads;
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
@@ -73,65 +104,173 @@ struct ThreadPool {
     bool stopping;
 };
 
-static void *worker_thread(void *opaque)
+static ThreadPoolElement *worker_pop(ThreadPoolWorker *w)
 {
-    ThreadPool *pool = opaque;
+    ThreadPoolElement *req;
 
-    qemu_mutex_lock(&pool->lock);
-    pool->pending_threads--;
-    do_spawn_thread(pool);
+    QEMU_LOCK_GUARD(&w->lock);
+    req = QTAILQ_FIRST(&w->request_list);
+    if (req) {
+        QTAILQ_REMOVE(&w->request_list, req, reqs);
+        req->state = THREAD_ACTIVE;
+    }
+    return req;
+}
 
-    while (!pool->stopping) {
+static ThreadPoolElement *worker_steal(ThreadPoolWorker *self)
+{
+    ThreadPool *pool = self->pool;
+    int first = self - pool->workers;
+    int i;
+
+    for (i = 1; i < pool->max_threads; i++) {
+        ThreadPoolWorker *w = &pool->workers[(first + i) % pool->max_threads];
         ThreadPoolElement *req;
-        int ret;
 
-        do {
-            pool->idle_threads++;
-            qemu_mutex_unlock(&pool->lock);
-            ret = qemu_sem_timedwait(&pool->sem, 10000);
-            qemu_mutex_lock(&pool->lock);
-            pool->idle_threads--;
-        } while (ret == -1 && !QTAILQ_EMPTY(&pool->request_list));
-        if (ret == -1 || pool->stopping) {
-            break;
+        if (QTAILQ_EMPTY(&w->request_list)) {
+            continue;
         }
+        req = worker_pop(w);
+        if (req) {
+            trace_thread_pool_steal(pool, req, self, w);
+            return req;
+        }
+    }
+    return NULL;
+}
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
-        req->state = THREAD_ACTIVE;
-        qemu_mutex_unlock(&pool->lock);
-
-        ret = req->func(req->arg);
-
-        req->ret = ret;
-        /* Write ret before state.  */
-        smp_wmb();
-        req->state = THREAD_DONE;
+static void worker_push(ThreadPoolWorker *w, ThreadPoolElement *req)
+{
+    req->worker = w;
+    WITH_QEMU_LOCK_GUARD(&w->lock) {
+        QTAILQ_INSERT_TAIL(&w->request_list, req, reqs);
+    }
+}
 
-        qemu_mutex_lock(&pool->lock);
+/*
+ * Runs with pool->lock taken.  Requests are only pushed under that lock,
+ * so once a worker has checked the queues and gone to sleep, any request
+ * that follows goes to it rather than behind a busy worker.
+ */
+static bool pool_has_queued_requests(ThreadPool *pool)
+{
+    int i;
 
-        qemu_bh_schedule(pool->completion_bh);
+    for (i = 0; i < pool->max_threads; i++) {
+        if (!QTAILQ_EMPTY(&pool->workers[i].request_list)) {
+            return true;
+        }
     }
+    return false;
+}
 
+/* Runs with pool->lock taken.  */
+static void worker_exit(ThreadPoolWorker *w)
+{
+    ThreadPool *pool = w->pool;
+
+    assert(QTAILQ_EMPTY(&w->request_list));
+    w->used = false;
     pool->cur_threads--;
     qemu_cond_signal(&pool->worker_stopped);
+}
+
+/*
+ * Go to sleep unless there is work left.  Returns false once the
+ * worker has stopped, because it timed out while idle or because the
+ * pool is being freed.
+ */
+static bool worker_wait(ThreadPoolWorker *w)
+{
+    ThreadPool *pool = w->pool;
+    int ret;
+
+    WITH_QEMU_LOCK_GUARD(&pool->lock) {
+        /* Requests queued behind busy workers since the last steal */
+        if (pool_has_queued_requests(pool)) {
+            return true;
+        }
+        if (pool->stopping) {
+            worker_exit(w);
+            return false;
+        }
+        w->sleeping = true;
+        QSLIST_INSERT_HEAD(&pool->idle_workers, w, idle);
+        pool->idle_threads++;
+    }
+
+    ret = qemu_sem_timedwait(&w->sem, 10000);
+
+    QEMU_LOCK_GUARD(&pool->lock);
+    if (w->sleeping) {
+        /* Timed out, and nobody has picked this worker since then */
+        assert(ret == -1);
+        w->sleeping = false;
+        QSLIST_REMOVE(&pool->idle_workers, w, ThreadPoolWorker, idle);
+        pool->idle_threads--;
+    } else if (ret == -1) {
+        /* Picked just as the wait timed out; the post is already done */
+        qemu_sem_wait(&w->sem);
+        ret = 0;
+    }
+    if (!QTAILQ_EMPTY(&w->request_list)) {
+        return true;
+    }
+    if (ret == -1 || pool->stopping) {
+        worker_exit(w);
+        return false;
+    }
+    return true;
+}
+
+static void *worker_thread(void *opaque)
+{
+    ThreadPoolWorker *w = opaque;
+    ThreadPool *pool = w->pool;
+
+    qemu_mutex_lock(&pool->lock);
+    pool->pending_threads--;
+    do_spawn_thread(pool);
     qemu_mutex_unlock(&pool->lock);
+
+    do {
+        ThreadPoolElement *req;
+        int ret;
+
+        while ((req = worker_pop(w)) || (req = worker_steal(w))) {
+            ret = req->func(req->arg);
+
+            req->ret = ret;
+            /* Write ret before state.  */
+            smp_wmb();
+            req->state = THREAD_DONE;
+
+            qemu_bh_schedule(pool->completion_bh);
+        }
+    } while (worker_wait(w));
+
     return NULL;
 }
 
 static void do_spawn_thread(ThreadPool *pool)
 {
     QemuThread t;
+    int i;
 
     /* Runs with lock taken.  */
     if (!pool->new_threads) {
         return;
     }
 
+    for (i = 0; !pool->workers[i].needs_thread; i++) {
+        assert(i + 1 < pool->max_threads);
+    }
+    pool->workers[i].needs_thread = false;
     pool->new_threads--;
     pool->pending_threads++;
 
-    qemu_thread_create(&t, "worker", worker_thread, pool, QEMU_THREAD_DETACHED);
+    qemu_thread_create(&t, "worker", worker_thread, &pool->workers[i],
+                       QEMU_THREAD_DETACHED);
 }
 
 static void spawn_thread_bh_fn(void *opaque)
@@ -143,8 +282,15 @@ static void spawn_thread_bh_fn(void *opaque)
     qemu_mutex_unlock(&pool->lock);
 }
 
-static void spawn_thread(ThreadPool *pool)
+static ThreadPoolWorker *spawn_thread(ThreadPool *pool)
 {
+    ThreadPoolWorker *w = pool->workers;
+
+    while (w->used) {
+        w++;
+    }
+    w->used = true;
+    w->needs_thread = true;
     pool->cur_threads++;
     pool->new_threads++;
     /* If there are threads being created, they will spawn new workers, so
@@ -157,6 +303,7 @@ static void spawn_thread(ThreadPool *pool)
     if (!pool->pending_threads) {
         qemu_bh_schedule(pool->new_thread_bh);
     }
+    return w;
 }
 
 static void thread_pool_completion_bh(void *opaque)
@@ -207,18 +354,14 @@ static void thread_pool_cancel(BlockAIOCB *acb)
 {
     ThreadPoolElement *elem = (ThreadPoolElement *)acb;
     ThreadPool *pool = elem->pool;
+    ThreadPoolWorker *w = elem->worker;
 
     trace_thread_pool_cancel(elem, elem->common.opaque);
 
-    QEMU_LOCK_GUARD(&pool->lock);
-    if (elem->state == THREAD_QUEUED &&
-        /* No thread has yet started working on elem. we can try to "steal"
-         * the item from the worker if we can get a signal from the
-         * semaphore.  Because this is non-blocking, we can do it with
-         * the lock taken and ensure that elem will remain THREAD_QUEUED.
-         */
-        qemu_sem_timedwait(&pool->sem, 0) == 0) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+    QEMU_LOCK_GUARD(&w->lock);
+    /* No thread has yet started working on elem, so it is still queued */
+    if (elem->state == THREAD_QUEUED) {
+        QTAILQ_REMOVE(&w->request_list, elem, reqs);
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
@@ -245,6 +388,7 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         BlockCompletionFunc *cb, void *opaque)
 {
     ThreadPoolElement *req;
+    ThreadPoolWorker *w;
 
     req = qemu_aio_get(&thread_pool_aiocb_info, NULL, cb, opaque);
     req->func = func;
@@ -257,12 +401,23 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
     trace_thread_pool_submit(pool, req, arg);
 
     qemu_mutex_lock(&pool->lock);
-    if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
-        spawn_thread(pool);
+    w = QSLIST_FIRST(&pool->idle_workers);
+    if (w) {
+        QSLIST_REMOVE_HEAD(&pool->idle_workers, idle);
+        pool->idle_threads--;
+        w->sleeping = false;
+        worker_push(w, req);
+        qemu_sem_post(&w->sem);
+    } else if (pool->cur_threads < pool->max_threads) {
+        worker_push(spawn_thread(pool), req);
+    } else {
+        /* All busy: queue behind one of them, whoever is free first runs it */
+        do {
+            w = &pool->workers[pool->next_worker++ % pool->max_threads];
+        } while (!w->used);
+        worker_push(w, req);
     }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
     qemu_mutex_unlock(&pool->lock);
-    qemu_sem_post(&pool->sem);
     return &req->common;
 }
 
@@ -300,17 +455,28 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
         ctx = qemu_get_aio_context();
     }
 
+    int i;
+
     memset(pool, 0, sizeof(*pool));
     pool->ctx = ctx;
     pool->completion_bh = aio_bh_new(ctx, thread_pool_completion_bh, pool);
     qemu_mutex_init(&pool->lock);
     qemu_cond_init(&pool->worker_stopped);
-    qemu_sem_init(&pool->sem, 0);
     pool->max_threads = 64;
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
+    pool->workers = g_new0(ThreadPoolWorker, pool->max_threads);
+    for (i = 0; i < pool->max_threads; i++) {
+        ThreadPoolWorker *w = &pool->workers[i];
+
+        w->pool = pool;
+        qemu_sem_init(&w->sem, 0);
+        qemu_mutex_init(&w->lock);
+        QTAILQ_INIT(&w->request_list);
+    }
+
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    QSLIST_INIT(&pool->idle_workers);
 }
 
 ThreadPool *thread_pool_new(AioContext *ctx)
@@ -322,6 +488,9 @@ ThreadPool *thread_pool_new(AioContext *ctx)
 
 void thread_pool_free(ThreadPool *pool)
 {
+    ThreadPoolWorker *w;
+    int i;
+
     if (!pool) {
         return;
     }
@@ -332,20 +501,35 @@ void thread_pool_free(ThreadPool *pool)
 
     /* Stop new threads from spawning */
     qemu_bh_delete(pool->new_thread_bh);
+    for (i = 0; i < pool->max_threads; i++) {
+        if (pool->workers[i].needs_thread) {
+            pool->workers[i].needs_thread = false;
+            pool->workers[i].used = false;
+        }
+    }
     pool->cur_threads -= pool->new_threads;
     pool->new_threads = 0;
 
     /* Wait for worker threads to terminate */
     pool->stopping = true;
+    while ((w = QSLIST_FIRST(&pool->idle_workers))) {
+        QSLIST_REMOVE_HEAD(&pool->idle_workers, idle);
+        pool->idle_threads--;
+        w->sleeping = false;
+        qemu_sem_post(&w->sem);
+    }
     while (pool->cur_threads > 0) {
-        qemu_sem_post(&pool->sem);
         qemu_cond_wait(&pool->worker_stopped, &pool->lock);
     }
 
     qemu_mutex_unlock(&pool->lock);
 
     qemu_bh_delete(pool->completion_bh);
-    qemu_sem_destroy(&pool->sem);
+    for (i = 0; i < pool->max_threads; i++) {
+        qemu_sem_destroy(&pool->workers[i].sem);
+        qemu_mutex_destroy(&pool->workers[i].lock);
+    }
+    g_free(pool->workers);
     qemu_cond_destroy(&pool->worker_stopped);
     qemu_mutex_destroy(&pool->lock);
     g_free(pool);
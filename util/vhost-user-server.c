@@ -217,6 +217,39 @@ static void kick_handler(void *opaque)
     }
 }
 
+/*
+ * Polling handler for kick fds, used when the AioContext polls (i.e. in
+ * iothreads).  It processes the virtqueue as soon as the driver makes
+ * buffers available, instead of waiting for the kick to be delivered.
+ * libvhost-user only watches kick fds, with the queue index as pvt.
+ */
+static bool kick_poll(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+    VuDev *vu_dev = vu_fd_watch->vu_dev;
+    int index = (intptr_t)vu_fd_watch->pvt;
+    VuVirtq *vq;
+
+    if (vu_dev->broken || !vu_dev->vq) {
+        return false;
+    }
+
+    vq = vu_get_queue(vu_dev, index);
+    if (!vq->handler || !vu_queue_started(vu_dev, vq) ||
+        vu_queue_empty(vu_dev, vq)) {
+        return false;
+    }
+
+    vq->handler(vu_dev, index);
+
+    if (vu_dev->broken) {
+        VuServer *server = container_of(vu_dev, VuServer, vu_dev);
+
+        qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    }
+    return true;
+}
+
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
 {
 
@@ -250,7 +283,7 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
         vu_fd_watch->cb = cb;
         qemu_set_nonblock(fd);
         aio_set_fd_handler(server->ioc->ctx, fd, true, kick_handler,
-                           NULL, NULL, vu_fd_watch);
+                           NULL, kick_poll, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
     }
@@ -377,7 +410,7 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
 
     QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
         aio_set_fd_handler(ctx, vu_fd_watch->fd, true, kick_handler, NULL,
-                           NULL, vu_fd_watch);
+                           kick_poll, vu_fd_watch);
     }
 
     aio_co_schedule(ctx, server->co_trip);